@@ -46,6 +46,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define ADB_DDR         DDRD
 #define ADB_DATA_BIT    0
 //#define ADB_PSW_BIT     1       // optional
+/* decode response with Timer1 input capture, data line should be on ICP1(PD4) */
+//#define ADB_USE_ICP
+
+/* interval of Talk to each device in ms(keyboard and mouse take turns in half of it) */
+//#define ADB_POLL_INTERVAL   12
 
 /* key combination for command */
 #ifndef __ASSEMBLER__
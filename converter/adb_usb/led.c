@@ -24,4 +24,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 void led_set(uint8_t usb_led)
 {
     adb_host_kbd_led(ADB_ADDR_KEYBOARD, ~usb_led);
+    // other keyboards moved to free address
+    for (uint8_t i = 0; i < adb_bus_count(); i++) {
+        const adb_device_t *dev = adb_bus_device(i);
+        if (dev->kind == ADB_ADDR_KEYBOARD && dev->addr != ADB_ADDR_KEYBOARD) {
+            adb_host_kbd_led(dev->addr, ~usb_led);
+        }
+    }
 }
@@ -35,15 +35,106 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 
-static bool has_media_keys = false;
 static bool is_iso_layout = false;
 
+// keyboards, keypads and media keys other than keyboard at default address
+static uint8_t others[ADB_ADDR_MAX];
+static uint8_t others_count = 0;
+static uint16_t others_media = 0;       // bit of others with Adjustable keyboard media keys
+static uint16_t others_pending = 0;     // bit of others to Talk
+static uint8_t others_next = 0;
+
 // matrix state buffer(1:on, 0:off)
 static matrix_row_t matrix[MATRIX_ROWS];
 
 static void register_key(uint8_t key);
 
 
+/*
+ * Bus schedule
+ *
+ * Each device is talked at ADB_POLL_INTERVAL at most, see adb_host_kbd_recv().
+ * The interval is split into turns of keyboard, mouse and other devices.
+ * Keyboard at default address is talked every interval. Mouse and others are
+ * talked only when a device asserted Service Request on previous Talk or it
+ * sent data last time, otherwise the bus stays idle in their turn. Others
+ * share one turn and are talked one by one, so the bus has the same number of
+ * Talks in an interval however many devices are on it and keyboard is polled
+ * at fixed interval.
+ */
+#ifndef ADB_POLL_INTERVAL
+#   define ADB_POLL_INTERVAL    12
+#endif
+
+enum { TURN_KEYBOARD, TURN_MOUSE, TURN_OTHERS };
+static uint8_t turns[3] = { TURN_KEYBOARD };
+static uint8_t turn_count = 1;
+static uint8_t turn = 0;
+#ifdef ADB_MOUSE_ENABLE
+static bool mouse_pending = true;
+#endif
+
+static bool bus_turn(uint8_t who)
+{
+    static uint16_t tick_ms;
+
+    if (turns[turn] != who) return false;
+    if (timer_elapsed(tick_ms) < ADB_POLL_INTERVAL / turn_count) return false;
+    tick_ms = timer_read();
+    if (++turn == turn_count) turn = 0;
+    return true;
+}
+
+static void bus_setup(void)
+{
+    others_count = 0;
+    others_media = 0;
+    for (uint8_t i = 0; i < adb_bus_count(); i++) {
+        const adb_device_t *dev = adb_bus_device(i);
+        if (dev->kind == ADB_ADDR_KEYBOARD && dev->addr != ADB_ADDR_KEYBOARD) {
+            // Enable left/right modifier distinction with SRQ for its turn
+            adb_host_listen(dev->addr, ADB_REG_3, 0x20 | dev->addr, ADB_HANDLER_EXTENDED_PROTOCOL);
+            adb_bus_update(dev->addr);
+            others[others_count++] = dev->addr;
+        } else if (dev->kind == ADB_ADDR_APPLIANCE && dev->handler == 0x02) {
+            // Adjustable keyboard media keys: address=0x07 and handlerID=0x02
+            xprintf("Found: media keys\n");
+            others_media |= (1U<<others_count);
+            others[others_count++] = dev->addr;
+        }
+    }
+    others_pending = (1U<<others_count) - 1;
+    others_next = 0;
+
+    turn_count = 0;
+    turns[turn_count++] = TURN_KEYBOARD;
+#ifdef ADB_MOUSE_ENABLE
+    turns[turn_count++] = TURN_MOUSE;
+#endif
+    if (others_count) turns[turn_count++] = TURN_OTHERS;
+    turn = 0;
+}
+
+/* index of next of others to Talk in its turn */
+static uint8_t others_turn(void)
+{
+    for (uint8_t n = 0; n < others_count; n++) {
+        uint8_t i = others_next;
+        if (++others_next == others_count) others_next = 0;
+        if (others_pending & (1U<<i)) return i;
+    }
+    return others_count;
+}
+
+static void print_devices(void)
+{
+    for (uint8_t i = 0; i < adb_bus_count(); i++) {
+        const adb_device_t *dev = adb_bus_device(i);
+        xprintf("Scan: addr:%d, kind:%d, handler:%02X\n", dev->addr, dev->kind, dev->handler);
+    }
+}
+
+
 void matrix_init(void)
 {
     // LED on
@@ -53,19 +144,14 @@ void matrix_init(void)
     // wait for keyboard to boot up and receive command
     _delay_ms(2000);
 
-    // device scan
+    // device scan, devices sharing default address are moved to free address
+    adb_bus_enumerate();
     xprintf("Before init:\n");
-    for (uint8_t addr = 1; addr < 16; addr++) {
-        uint16_t reg3 = adb_host_talk(addr, ADB_REG_3);
-        if (reg3) {
-            xprintf("Scan: addr:%d, reg3:%04X\n", addr, reg3);
-        }
-        _delay_ms(20);
-    }
+    print_devices();
 
     // Determine ISO keyboard by handler id
     // http://lxr.free-electrons.com/source/drivers/macintosh/adbhid.c?v=4.4#L815
-    uint8_t handler_id = (uint8_t) adb_host_talk(ADB_ADDR_KEYBOARD, ADB_REG_3);
+    uint8_t handler_id = adb_bus_update(ADB_ADDR_KEYBOARD);
     switch (handler_id) {
     case 0x04: case 0x05: case 0x07: case 0x09: case 0x0D:
     case 0x11: case 0x14: case 0x19: case 0x1D: case 0xC1:
@@ -78,27 +164,18 @@ void matrix_init(void)
     }
     xprintf("hadler_id: %02X, is_iso_layout: %s\n", handler_id, (is_iso_layout ? "yes" : "no"));
 
-    // Adjustable keyboard media keys: address=0x07 and handlerID=0x02
-    has_media_keys = (0x02 == (adb_host_talk(ADB_ADDR_APPLIANCE, ADB_REG_3) & 0xff));
-    if (has_media_keys) {
-        xprintf("Found: media keys\n");
-    }
-
     // Enable keyboard left/right modifier distinction
     // Listen Register3
     //  upper byte: reserved bits 0000, keyboard address 0010
     //  lower byte: device handler 00000011
     adb_host_listen(ADB_ADDR_KEYBOARD, ADB_REG_3, ADB_ADDR_KEYBOARD, ADB_HANDLER_EXTENDED_PROTOCOL);
+    adb_bus_update(ADB_ADDR_KEYBOARD);
+
+    // other keyboards, keypads and media keys
+    bus_setup();
 
-    // device scan
     xprintf("After init:\n");
-    for (uint8_t addr = 1; addr < 16; addr++) {
-        uint16_t reg3 = adb_host_talk(addr, ADB_REG_3);
-        if (reg3) {
-            xprintf("Scan: addr:%d, reg3:%04X\n", addr, reg3);
-        }
-        _delay_ms(20);
-    }
+    print_devices();
 
     // initialize matrix state: all keys off
     for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
@@ -125,50 +202,85 @@ void matrix_init(void)
 
 static report_mouse_t mouse_report = {};
 
+/*
+ * Extended Mouse Protocol(handler 4)
+ * Register0 has 3 bits more of each axis and 2 buttons more in every byte after
+ * two bytes of classic format, button is 0 when pressed.
+ *  byte0:  bit7=button1, bit6-0=Y
+ *  byte1:  bit7=button2, bit6-0=X
+ *  byte2-: bit7=button,  bit6-4=Y, bit3=button, bit2-0=X
+ * http://lxr.free-electrons.com/source/drivers/macintosh/adbhid.c?v=4.4#L426
+ */
+static uint8_t adb_mouse_decode(uint8_t *buf, uint8_t len, int16_t *x, int16_t *y)
+{
+    uint8_t buttons = 0;
+    uint8_t bits = 7;
+    *y = buf[0] & 0x7F;
+    *x = buf[1] & 0x7F;
+    if (~buf[0] & 0x80) buttons |= MOUSE_BTN1;
+    if (adb_mouse_handler() == ADB_HANDLER_EXTENDED_MOUSE) {
+        if (~buf[1] & 0x80) buttons |= MOUSE_BTN2;
+        for (uint8_t i = 2; i < len; i++) {
+            // up to 13 bits, no mouse moves that far in a poll
+            if (bits < 13) {
+                *y |= (int16_t)(buf[i]>>4 & 0x07) << bits;
+                *x |= (int16_t)(buf[i]>>0 & 0x07) << bits;
+                bits += 3;
+            }
+            // button3-5, more than that don't fit in report
+            if (~buf[i] & 0x80) buttons |= (MOUSE_BTN3 << ((i - 2) * 2)) & 0x1F;
+            if (~buf[i] & 0x08) buttons |= (MOUSE_BTN4 << ((i - 2) * 2)) & 0x1F;
+        }
+    }
+    // two's complement of the bits
+    if (*y & (1 << (bits - 1))) *y -= (1 << bits);
+    if (*x & (1 << (bits - 1))) *x -= (1 << bits);
+    return buttons;
+}
+
 void adb_mouse_task(void)
 {
-    uint16_t codes;
+    uint8_t buf[8];
+    uint8_t len;
     int16_t x, y;
     static int8_t mouseacc;
 
-    /* tick of last polling */
-    static uint16_t tick_ms;
-
-    // polling with 12ms interval
-    if (timer_elapsed(tick_ms) < 12) return;
-    tick_ms = timer_read();
+    if (!bus_turn(TURN_MOUSE)) return;
+    if (!mouse_pending) return;
 
-    codes = adb_host_mouse_recv();
+    len = adb_host_talk_buf(ADB_ADDR_MOUSE, ADB_REG_0, buf, sizeof(buf));
+    // keep polling while mouse is moving, otherwise wait for its SRQ on keyboard Talk
+    mouse_pending = (len != 0);
     // If nothing received reset mouse acceleration, and quit.
-    if (!codes) {
+    if (len < 2) {
         mouseacc = 1;
         return;
     };
-    // Bit sixteen is button.
-    if (~codes & (1 << 15))
-        mouse_report.buttons |= MOUSE_BTN1;
-    if (codes & (1 << 15))
-        mouse_report.buttons &= ~MOUSE_BTN1;
-    // lower seven bits are movement, as signed int_7.
-    // low byte is X-axis, high byte is Y.
-    y = (codes>>8 & 0x3F);
-    x = (codes>>0 & 0x3F);
-    // bit seven and fifteen is negative
-    // usb does not use int_8, but int_7 (measuring distance) with sign-bit.
-    if (codes & (1 << 6))
-          x = (x-0x40);
-    if (codes & (1 << 14))
-         y = (y-0x40);
+    mouse_report.buttons = adb_mouse_decode(buf, len, &x, &y);
     // Accelerate mouse. (They weren't meant to be used on screens larger than 320x200).
-    x *= mouseacc;
-    y *= mouseacc;
+    // Extended mouse reports in higher resolution and moves far enough by itself.
+    if (adb_mouse_handler() != ADB_HANDLER_EXTENDED_MOUSE) {
+        x *= mouseacc;
+        y *= mouseacc;
+    }
+#ifdef MOUSE_REPORT_MERGE
+    if (debug_mouse) {
+            print("adb_mouse raw: [");
+            phex(mouseacc); print(" ");
+            phex(mouse_report.buttons); print("|");
+            print_decs(x); print(" ");
+            print_decs(y); print("]\n");
+    }
+    // host keeps motion beyond a report for next one
+    host_mouse_move(mouse_report.buttons, x, y, 0, 0);
+#else
     // Cap our two bytes per axis to one byte.
     // Easier with a MIN-function, but since -MAX(-a,-b) = MIN(a,b)...
 	 // I.E. MIN(MAX(x,-127),127) = -MAX(-MAX(x, -127), -127) = MIN(-MIN(-x,127),127)
     mouse_report.x = -MAX(-MAX(x, -127), -127);
     mouse_report.y = -MAX(-MAX(y, -127), -127);
     if (debug_mouse) {
-            print("adb_host_mouse_recv: "); print_bin16(codes); print("\n");
+            print("adb_host_talk_buf: "); print_hex8(len); print("\n");
             print("adb_mouse raw: [");
             phex(mouseacc); print(" ");
             phex(mouse_report.buttons); print("|");
@@ -177,6 +289,7 @@ void adb_mouse_task(void)
     }
     // Send result by usb.
     host_mouse_send(&mouse_report);
+#endif
     // increase acceleration of mouse
     mouseacc += ( mouseacc < ADB_MOUSE_MAXACC ? 1 : 0 );
     return;
@@ -195,23 +308,38 @@ uint8_t matrix_scan(void)
     uint16_t codes;
     uint8_t key0, key1;
 
-    /* tick of last polling */
-    static uint16_t tick_ms;
-
     codes = extra_key;
     extra_key = 0xFFFF;
 
     if ( codes == 0xFFFF )
     {
-        // polling with 12ms interval
-        if (timer_elapsed(tick_ms) < 12) return 0;
-        tick_ms = timer_read();
+        uint8_t addr = ADB_ADDR_KEYBOARD;
+        uint8_t other = others_count;
+        if (bus_turn(TURN_KEYBOARD)) {
+            // keyboard at default address
+        } else if (bus_turn(TURN_OTHERS)) {
+            other = others_turn();
+            if (other == others_count) return 0;
+            addr = others[other];
+        } else {
+            return 0;
+        }
 
-        codes = adb_host_kbd_recv(ADB_ADDR_KEYBOARD);
+        codes = adb_host_kbd_recv(addr);
+        if (adb_host_srq()) {
+#ifdef ADB_MOUSE_ENABLE
+            mouse_pending = true;
+#endif
+            others_pending = (1U<<others_count) - 1;
+        }
+        if (other != others_count) {
+            // keep talking while it sends, otherwise wait for its SRQ
+            if (codes) others_pending |=  (1U<<other);
+            else       others_pending &= ~(1U<<other);
+        }
 
         // Adjustable keybaord media keys
-        if (codes == 0 && has_media_keys &&
-                (codes = adb_host_kbd_recv(ADB_ADDR_APPLIANCE))) {
+        if (codes && other != others_count && (others_media & (1U<<other))) {
             // key1
             switch (codes & 0x7f ) {
             case 0x00:  // Mic
@@ -31,6 +31,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 16  // keycode bit3-6 
 #define MATRIX_COLS 8   // keycode bit0-2
+/* matrix.c hands key changes to keyboard_task() directly */
+#define MATRIX_HAS_EVENTS
 
 
 /* key combination for command */
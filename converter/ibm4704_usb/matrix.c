@@ -27,8 +27,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 
 
-static void matrix_make(uint8_t code);
-static void matrix_break(uint8_t code);
+static void matrix_key(uint8_t code, bool pressed);
 
 
 /*
@@ -87,26 +86,34 @@ void matrix_init(void)
 
 /*
  * IBM 4704 Scan Code
+ *
+ * A byte is an event by itself, bit7 for break. All bytes queued by receiver
+ * are taken in a scan up to SCAN_CODES_MAX so that burst of fast typing
+ * doesn't wait a scan for each key, event queue is emptied by keyboard_task()
+ * every scan.
  */
+#define SCAN_CODES_MAX  4
 uint8_t matrix_scan(void)
 {
-    uint8_t code = ibm4704_recv();
-    if (code==0xFF) {
-        // Not receivd
-        return 0;
-    } else if ((code&0x7F) >= 0x7C) {
-        // 0xFF-FC and 0x7F-7C is not scancode
-        xprintf("Error: %02X\n", code);
-        matrix_clear();
-        return 0;
-    } else if (code&0x80) {
-        dprintf("%02X\n", code);
-        matrix_make(code);
-    } else {
-        dprintf("%02X\n", code);
-        matrix_break(code);
+    uint8_t changed = 0;
+    for (uint8_t n = 0; n < SCAN_CODES_MAX; n++) {
+        uint8_t code = ibm4704_recv();
+        if (code==0xFF) {
+            // Not receivd
+            break;
+        } else if ((code&0x7F) >= 0x7C) {
+            // 0xFF-FC and 0x7F-7C is not scancode
+            xprintf("Error: %02X\n", code);
+            // release keys down
+            for (uint8_t c = 0; c < 0x80; c++) matrix_key(c, false);
+            break;
+        } else {
+            dprintf("%02X\n", code);
+            matrix_key(code, code&0x80);
+            changed = 1;
+        }
     }
-    return 1;
+    return changed;
 }
 
 inline
@@ -115,19 +122,18 @@ uint8_t matrix_get_row(uint8_t row)
     return matrix[row];
 }
 
-inline
-static void matrix_make(uint8_t code)
-{
-    matrix[ROW(code)] |= 1<<COL(code);
-}
-
-inline
-static void matrix_break(uint8_t code)
+// queue change of key and keep its state unless queue is full
+static void matrix_key(uint8_t code, bool pressed)
 {
-    matrix[ROW(code)] &= ~(1<<COL(code));
+    if (matrix_is_on(ROW(code), COL(code)) == pressed) return;
+    if (!matrix_event_put((keypos_t){ .row = ROW(code), .col = COL(code) }, pressed, ibm4704_recv_time())) return;
+    if (pressed) matrix[ROW(code)] |=  (1<<COL(code));
+    else         matrix[ROW(code)] &= ~(1<<COL(code));
 }
 
+/* break of every key down so that action_exec() releases layer and tap
+ * keys too, queued changes go first */
 void matrix_clear(void)
 {
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+    for (uint8_t code = 0; code < MATRIX_ROWS * 8; code++) matrix_key(code, false);
 }
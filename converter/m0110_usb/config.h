@@ -31,6 +31,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_ROWS 14
 #define MATRIX_COLS 8
 
+/* matrix_scan() queues key events in order of M0110 codes */
+#define MATRIX_HAS_EVENTS
+
 
 /* Mechanical locking support. Use KC_LCAP, KC_LNUM or KC_LSCR instead in keymap */
 #define LOCKING_SUPPORT_ENABLE
@@ -59,4 +62,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define M0110_DATA_DDR          DDRD
 #define M0110_DATA_BIT          0
 
+/* receive key events with interrupt on both edges of clock(INT1/PD1)
+ * instead of polling with Instant in matrix_scan() */
+//#define M0110_USE_INT
+#define M0110_INT_INIT()  do {  \
+    EICRA |= ((0<<ISC11) |      \
+              (1<<ISC10));      \
+} while (0)
+#define M0110_INT_ON()  do {    \
+    EIFR  |= (1<<INTF1);        \
+    EIMSK |= (1<<INT1);         \
+} while (0)
+#define M0110_INT_OFF() do {    \
+    EIMSK &= ~(1<<INT1);        \
+} while (0)
+#define M0110_INT_VECT  INT1_vect
+
 #endif
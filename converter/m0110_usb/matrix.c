@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host.h"
 #include "led.h"
 #include "m0110.h"
+#include "timer.h"
 #include "matrix.h"
 
 
@@ -37,8 +38,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define COL(key)    ((key)&0x07)
 
 
-static bool is_modified = false;
-
 // matrix state buffer(1:on, 0:off)
 static uint8_t *matrix;
 static uint8_t _matrix0[MATRIX_ROWS];
@@ -61,26 +60,29 @@ void matrix_init(void)
     return;
 }
 
+/*
+ * Keypad and Shift prefixed events decode into two or three codes, e.g.
+ * Shift(u) then Arrow(u) and Calc(u). All of them are taken in a scan, codes
+ * already fetched by m0110_recv_key() cost no Instant, so arrow keys of M0110A
+ * don't wait a scan for each code. Events are queued in order they come,
+ * Shift has to be registered before key it modifies.
+ */
+#define SCAN_CODES_MAX  4
 uint8_t matrix_scan(void)
 {
-    uint8_t key;
+    uint8_t changed = 0;
+    uint8_t n = 0;
+    do {
+        uint8_t key = m0110_recv_key();
+        if (key == M0110_NULL || key == M0110_ERROR) break;
 
-    is_modified = false;
-    key = m0110_recv_key();
-
-    if (key == M0110_NULL) {
-        return 0;
-    } else if (key == M0110_ERROR) {
-        return 0;
-    } else {
-        is_modified = true;
         register_key(key);
-    }
-
-    if (debug_enable) {
-        print("["); phex(key); print("]\n");
-    }
-    return 1;
+        changed = 1;
+        if (debug_enable) {
+            print("["); phex(key); print("]\n");
+        }
+    } while (++n < SCAN_CODES_MAX && m0110_key_pending());
+    return changed;
 }
 
 inline
@@ -90,11 +92,16 @@ uint8_t matrix_get_row(uint8_t row)
 }
 
 inline
+// queue change of key and keep its state unless queue is full
 static void register_key(uint8_t key)
 {
-    if (key&0x80) {
-        matrix[ROW(key)] &= ~(1<<COL(key));
-    } else {
+    bool pressed = !(key&0x80);
+    key &= 0x7F;
+    if (matrix_is_on(ROW(key), COL(key)) == pressed) return;
+    if (!matrix_event_put((keypos_t){ .row = ROW(key), .col = COL(key) }, pressed, timer_read())) return;
+    if (pressed) {
         matrix[ROW(key)] |=  (1<<COL(key));
+    } else {
+        matrix[ROW(key)] &= ~(1<<COL(key));
     }
 }
@@ -29,6 +29,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 16  // keycode bit: 3-0
 #define MATRIX_COLS 8   // keycode bit: 6-4
+/* matrix.c hands key changes to keyboard_task() directly */
+#define MATRIX_HAS_EVENTS
 
 
 /* legacy keymap support */
@@ -47,6 +47,16 @@ static uint8_t matrix[MATRIX_ROWS];
 #define ROW(code)      ((code>>3)&0xF)
 #define COL(code)      (code&0x07)
 
+// queue change of key and keep its state unless queue is full
+static bool matrix_key(uint8_t code, bool pressed)
+{
+    if (matrix_is_on(ROW(code), COL(code)) == pressed) return false;
+    if (!matrix_event_put((keypos_t){ .row = ROW(code), .col = COL(code) }, pressed, news_recv_time())) return false;
+    if (pressed) matrix[ROW(code)] |=  (1<<COL(code));
+    else         matrix[ROW(code)] &= ~(1<<COL(code));
+    return true;
+}
+
 
 void matrix_init(void)
 {
@@ -58,27 +68,23 @@ void matrix_init(void)
     return;
 }
 
+/*
+ * Codes queued by receiver are taken in a scan up to SCAN_CODES_MAX so that
+ * burst like release of chord is done in one pass, event queue is emptied by
+ * keyboard_task() every scan.
+ */
+#define SCAN_CODES_MAX  4
 uint8_t matrix_scan(void)
 {
-    uint8_t code;
-    code = news_recv();
-    if (code == 0) {
-        return 0;
-    }
+    uint8_t changed = 0;
+    for (uint8_t n = 0; n < SCAN_CODES_MAX; n++) {
+        uint8_t code = news_recv();
+        if (code == 0) break;
 
-    phex(code); print(" ");
-    if (code&0x80) {
-        // break code
-        if (matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] &= ~(1<<COL(code));
-        }
-    } else {
-        // make code
-        if (!matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] |=  (1<<COL(code));
-        }
+        dprintf("%02X ", code);
+        if (matrix_key(code & 0x7F, !(code&0x80))) changed = 1;
     }
-    return code;
+    return changed;
 }
 
 inline
@@ -182,6 +182,22 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 //================= End of TMK converter Configuration ==================
 
+// poll keyboard with Timer1 and KBD_IN interrupt instead of blocking matrix_scan()
+// KBD_IN on PD0(INT0) of Pro Micro and TMK converter
+//#define NEXT_KBD_USE_TIMER
+#define NEXT_KBD_INT_INIT() do {    \
+    EICRA |= ((1<<ISC01) |          \
+              (0<<ISC00));          \
+} while (0)
+#define NEXT_KBD_INT_ON() do {      \
+    EIFR  |= (1<<INTF0);            \
+    EIMSK |= (1<<INT0);             \
+} while (0)
+#define NEXT_KBD_INT_OFF() do {     \
+    EIMSK &= ~(1<<INT0);            \
+} while (0)
+#define NEXT_KBD_INT_VECT   INT0_vect
+
 /* key combination for command */
 #define IS_COMMAND() ( \
     (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) || \
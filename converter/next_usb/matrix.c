@@ -146,7 +146,9 @@ void matrix_init(void)
 /* scan all key states on matrix */
 uint8_t matrix_scan(void)
 {
+#ifndef NEXT_KBD_USE_TIMER
     _delay_ms(5);
+#endif
     
     //next_kbd_set_leds(false, false);
     NEXT_KBD_LED1_OFF;
@@ -29,6 +29,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS     16
 #define MATRIX_COLS     8
+/* matrix.c hands key changes to keyboard_task() directly */
+#define MATRIX_HAS_EVENTS
 
 /* key combination for command */
 #define IS_COMMAND()    ( \
@@ -54,6 +56,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define PC98_RDY_DDR    DDRD
 #define PC98_RDY_PORT   PORTD
 #define PC98_RDY_BIT    4
+/* RDY is driven by receive buffer level: low(ready) while it has space */
+#define SERIAL_UART_RTS_LO()    do { PC98_RDY_PORT &= ~(1<<PC98_RDY_BIT); } while (0)
+#define SERIAL_UART_RTS_HI()    do { PC98_RDY_PORT |=  (1<<PC98_RDY_BIT); } while (0)
 /* PC98 Retry Port */
 #define PC98_RTY_DDR    DDRD
 #define PC98_RTY_PORT   PORTD
@@ -47,6 +47,16 @@ static uint8_t matrix[MATRIX_ROWS];
 #define ROW(code)      ((code>>3)&0xF)
 #define COL(code)      (code&0x07)
 
+// queue change of key and keep its state, false when queue is full
+static bool matrix_key(uint8_t code, bool pressed)
+{
+    if (matrix_is_on(ROW(code), COL(code)) == pressed) return true;
+    if (!matrix_event_put((keypos_t){ .row = ROW(code), .col = COL(code) }, pressed, serial_recv_time())) return false;
+    if (pressed) matrix[ROW(code)] |=  (1<<COL(code));
+    else         matrix[ROW(code)] &= ~(1<<COL(code));
+    return true;
+}
+
 
 static void pc98_send(uint8_t data)
 {
@@ -57,32 +67,45 @@ static void pc98_send(uint8_t data)
     PC98_RDY_PORT &= ~(1<<PC98_RDY_BIT);
 }
 
+// ACK(FA) or NACK(FC), key codes in between are skipped
 static int16_t pc98_wait_response(void)
 {
-    int16_t code = -1;
+    int16_t code;
     uint8_t timeout = 255;
-    while (timeout-- && (code = serial_recv2()) == -1) _delay_ms(1);
-    return code;
+    while (timeout--) {
+        code = serial_recv2();
+        if (code == 0xFA || code == 0xFC) return code;
+        if (code == -1) _delay_ms(1);
+    }
+    return -1;
 }
 
-static void pc98_inhibit_repeat(void)
-{
-    uint16_t code;
-
-    // clear recv buffer
-    while (serial_recv()) ;
-RETRY:
-    _delay_ms(100);
-    pc98_send(0x9C);
-    code = pc98_wait_response();
-    if (code != -1) xprintf("PC98: send 9C: %02X\n", code);
-    if (code != 0xFA) goto RETRY;
+#ifndef PC98_INIT_RETRY
+#define PC98_INIT_RETRY 10
+#endif
 
-    _delay_ms(100);
-    pc98_send(0x70);
-    code = pc98_wait_response();
-    if (code != -1) xprintf("PC98: send 70: %02X\n", code);
-    if (code != 0xFA) goto RETRY;
+static bool pc98_inhibit_repeat(void)
+{
+    int16_t code;
+
+    for (uint8_t retry = 0; retry < PC98_INIT_RETRY; retry++) {
+        // clear recv buffer, 00 is a key code
+        while (serial_recv2() != -1) ;
+
+        _delay_ms(100);
+        pc98_send(0x9C);
+        code = pc98_wait_response();
+        xprintf("PC98: send 9C: %02X\n", code);
+        if (code != 0xFA) continue;
+
+        _delay_ms(100);
+        pc98_send(0x70);
+        code = pc98_wait_response();
+        xprintf("PC98: send 70: %02X\n", code);
+        if (code == 0xFA) return true;
+    }
+    print("PC98: repeat not inhibited\n");
+    return false;
 }
 
 void matrix_init(void)
@@ -123,27 +146,20 @@ void matrix_init(void)
 
 uint8_t matrix_scan(void)
 {
-    uint16_t code;
-    PC98_RDY_PORT |= (1<<PC98_RDY_BIT);
-    //_delay_us(30);
-    code = serial_recv2();
-    PC98_RDY_PORT &= ~(1<<PC98_RDY_BIT);
-    if (code == -1) return 0;
-
-    print_hex8(code); print(" ");
-
-    if (code&0x80) {
-        // break code
-        if (matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] &= ~(1<<COL(code));
-        }
-    } else {
-        // make code
-        if (!matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] |=  (1<<COL(code));
+    // code held while event queue is full, RDY goes off as buffer fills up
+    static int16_t pending = -1;
+
+    for (;;) {
+        int16_t code = pending;
+        if (code == -1) {
+            code = serial_recv2();
+            if (code == -1) break;
+            if (debug_matrix) { print_hex8(code); print(" "); }
         }
+        pending = matrix_key(code & 0x7F, !(code&0x80)) ? -1 : code;
+        if (pending != -1) break;
     }
-    return code;
+    return 1;
 }
 
 inline
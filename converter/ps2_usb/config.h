@@ -31,6 +31,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 32  // keycode bit: 3-0
 #define MATRIX_COLS 8   // keycode bit: 6-4
+/* matrix.c hands key changes to keyboard_task() directly */
+#define MATRIX_HAS_EVENTS
 
 
 /* key combination for command */
@@ -42,6 +44,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 //#define NO_SUSPEND_POWER_DOWN
 
+/* use Scan Code Set 2 even if keyboard supports Set 3 */
+//#define PS2_SET2_ONLY
+
 
 /*
  * PS/2 Busywait
@@ -31,6 +31,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 32  // keycode bit: 3-0
 #define MATRIX_COLS 8   // keycode bit: 6-4
+/* matrix.c hands key changes to keyboard_task() directly */
+#define MATRIX_HAS_EVENTS
 
 
 /* key combination for command */
@@ -112,6 +114,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifdef THUMBSTICK_ENABLE
 #define MOUSEKEY_MAX_SPEED 5
 #define MOUSEKEY_ANALOG_XYVH
+
+/* Stick moves pointer, scrolls wheel or repeats arrow keys at rate of
+ * deflection. thumbstick_mode() returns mode, default one takes wheel or
+ * arrow mode while STICK_WHEEL_LAYER or STICK_ARROW_LAYER is on. */
+#define STICK_MODE_MOUSE    0
+#define STICK_MODE_WHEEL    1
+#define STICK_MODE_ARROW    2
+/* deflection summed for one wheel step or arrow key */
+#define STICK_WHEEL_STEP    16
+#define STICK_ARROW_STEP    32
+//#define STICK_WHEEL_LAYER   1
+//#define STICK_ARROW_LAYER   2
 #endif
 
 #endif
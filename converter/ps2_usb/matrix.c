@@ -26,6 +26,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host.h"
 #include "led.h"
 #include "matrix.h"
+#include "timer.h"
+#include "progmem.h"
 
 #ifdef EXTRA_BUTTONS_ENABLE
 
@@ -47,25 +49,51 @@ static uint16_t debouncing_time = 0;
 
 #include "mousekey.h"
 
-#define STICK_MAX 1023
-#define STICK_MIN 0
-#define STICK_CENTER 512
+/* dead zone around center in ADC counts */
+#ifndef STICK_SLOP
 #define STICK_SLOP 64
+#endif
+/* IIR filter, new sample weighs 1/(2^STICK_FILTER) */
+#ifndef STICK_FILTER
+#define STICK_FILTER 2
+#endif
+/* samples at boot to take center, stick must be left alone */
+#ifndef STICK_CALIBRATE
+#define STICK_CALIBRATE 32
+#endif
+/* report interval(ms), match mouse endpoint polling */
+#ifndef STICK_INTERVAL
+#define STICK_INTERVAL 10
+#endif
 
-static int8_t map_value(int16_t v)
+/* speed for deflection from center in steps of 16 counts, built from mk_max_speed */
+#define STICK_CURVE_STEP 16
+static int8_t stick_curve[512 / STICK_CURVE_STEP];
+static uint8_t stick_curve_speed = 0;
+
+static void stick_curve_build(void)
 {
-	v -= STICK_CENTER;
-	int sign = 1;
-	if (v < 0)
-	{
-		sign = -1;
-		v = -v;
+	for (uint8_t i = 0; i < sizeof(stick_curve); i++) {
+		uint16_t v = i * STICK_CURVE_STEP + STICK_CURVE_STEP / 2;
+		uint16_t speed = (v < STICK_SLOP) ? 0 : ((uint32_t)mk_max_speed * v) / 320;
+		stick_curve[i] = (speed > 127) ? 127 : speed;
 	}
+	stick_curve_speed = mk_max_speed;
+}
+
+static int8_t map_value(int16_t v)
+{
+	if (stick_curve_speed != mk_max_speed)
+		stick_curve_build();
 
-	if (v < STICK_SLOP)
+	uint16_t a = (v < 0) ? -v : v;
+	if (a < STICK_SLOP)
 		return 0;
+	if (a >= 512)
+		a = 511;
 
-	return (sign * mk_max_speed * v) / 320;
+	int8_t speed = stick_curve[a / STICK_CURVE_STEP];
+	return (v < 0) ? -speed : speed;
 }
 
 #endif
@@ -77,6 +105,8 @@ static void matrix_break(uint8_t code);
  * Matrix Array usage:
  * 'Scan Code Set 2' is assigned into 256(32x8)cell matrix.
  * Hmm, it is very sparse and not efficient :(
+ * So the matrix is not stored as bitmap, keys down are kept as sorted list
+ * of positions and changes are queued for keyboard_task(MATRIX_HAS_EVENTS).
  *
  * Notes:
  * Both 'Hanguel/English'(F1) and 'Hanja'(F2) collide with 'Delete'(E0 71) and 'Down'(E0 72).
@@ -97,9 +127,17 @@ static void matrix_break(uint8_t code);
  * 0xFC:    PrintScreen
  * 0xFE:    Pause
  */
-static uint8_t matrix[MATRIX_ROWS];
 #define ROW(code)      (code>>3)
 #define COL(code)      (code&0x07)
+#define CODE(row, col) ((row)<<3 | (col))
+
+// keys down in ascending order of position
+#ifndef MATRIX_KEYS_MAX
+#define MATRIX_KEYS_MAX 16
+#endif
+static uint8_t keys[MATRIX_KEYS_MAX];
+static uint8_t keys_len = 0;
+
 
 // matrix positions for exceptional keys
 #define F7             (0x83)
@@ -108,6 +146,11 @@ static uint8_t matrix[MATRIX_ROWS];
 
 static bool is_modified = false;
 
+// time of changes being made, when scan code came from keyboard
+static uint16_t change_time;
+
+static enum { SET2, SET3 } codeset = SET2;
+
 #ifdef EXTRA_BUTTONS_ENABLE
 static void init_buttons()
 {
@@ -128,30 +171,182 @@ static uint8_t read_buttons()
 
 #ifdef THUMBSTICK_ENABLE
 
+#include <avr/interrupt.h>
 #include "LUFA/Drivers/Peripheral/ADC.h"
+#include "timer.h"
+#include "action_layer.h"
+
+/*
+ * Sampling
+ *
+ * Scan starts conversion of channel 7(x) every millisecond and ADC interrupt
+ * chains channel 6(y), so scan doesn't wait for conversion. Readings are
+ * filtered in 1/16 counts.
+ */
+static volatile int16_t stick_filtered[2];
+static volatile uint8_t stick_samples = 0;
+static volatile bool stick_busy = false;
+static uint8_t stick_ch = 0;
+static int16_t stick_center[2];
+
+ISR(ADC_vect)
+{
+	int16_t v = ADC_GetResult() << 4;
+	int16_t f = stick_filtered[stick_ch];
+	stick_filtered[stick_ch] = stick_samples ? f + ((v - f) >> STICK_FILTER) : v;
+
+	if (stick_ch == 0) {
+		stick_ch = 1;
+		ADC_StartReading(ADC_REFERENCE_AVCC | ADC_CHANNEL6);
+	} else {
+		stick_ch = 0;
+		stick_busy = false;
+		if (stick_samples != UINT8_MAX) stick_samples++;
+	}
+}
+
+static void thumbstick_init(void)
+{
+	ADC_Init(ADC_SINGLE_CONVERSION | ADC_PRESCALE_32);
+	ADC_SetupChannel(6); // A1 -> PF6
+	ADC_SetupChannel(7); // A0 -> PF7
+	ADCSRA |= (1 << ADIE);
+}
+
+/* deflection from center in counts, center follows drift in dead zone */
+static int16_t thumbstick_deflection(uint8_t ch, int16_t filtered)
+{
+	int16_t d = filtered - stick_center[ch];
+	if (d > -(STICK_SLOP << 4) && d < (STICK_SLOP << 4))
+		stick_center[ch] += d >> 8;
+	return d >> 4;
+}
+
+#ifndef STICK_WHEEL_STEP
+#define STICK_WHEEL_STEP 16
+#endif
+#ifndef STICK_ARROW_STEP
+#define STICK_ARROW_STEP 32
+#endif
+
+__attribute__ ((weak))
+uint8_t thumbstick_mode(void)
+{
+#ifndef NO_ACTION_LAYER
+#   ifdef STICK_WHEEL_LAYER
+	if (layer_state & (1UL << STICK_WHEEL_LAYER))
+		return STICK_MODE_WHEEL;
+#   endif
+#   ifdef STICK_ARROW_LAYER
+	if (layer_state & (1UL << STICK_ARROW_LAYER))
+		return STICK_MODE_ARROW;
+#   endif
+#endif
+	return STICK_MODE_MOUSE;
+}
+
+/* deflection summed to steps, sign is direction */
+static int16_t stick_acc[2];
+
+static int8_t thumbstick_steps(int16_t *acc, int8_t speed, int16_t step)
+{
+	if (!speed) {
+		*acc = 0;
+		return 0;
+	}
+	*acc += speed;
+	int8_t n = *acc / step;
+	*acc -= n * step;
+	return n;
+}
 
-static void thumbstick_read(uint8_t chanmask, int8_t *value, int8_t *last_value,
-		bool *dirty)
+static void thumbstick_wheel(int8_t x, int8_t y)
 {
-	*value = map_value(ADC_GetChannelReading(ADC_REFERENCE_AVCC | chanmask));
+	int8_t h = thumbstick_steps(&stick_acc[0], x, STICK_WHEEL_STEP);
+	int8_t v = thumbstick_steps(&stick_acc[1], y, STICK_WHEEL_STEP);
+	if (v || h) {
+		mousekey_set_xyvh(0, 0, v, h);
+		mousekey_send();
+		// not to be repeated by mousekey_task
+		mousekey_set_xyvh(0, 0, 0, 0);
+	}
+}
 
-	if (*value != *last_value) {
-		*last_value = *value;
-		*dirty = true;
+static void thumbstick_tap(int8_t n, uint8_t neg, uint8_t pos)
+{
+	uint8_t code = (n < 0) ? neg : pos;
+	for (n = (n < 0) ? -n : n; n; n--) {
+		register_code(code);
+		unregister_code(code);
 	}
 }
 
+static void thumbstick_arrow(int8_t x, int8_t y)
+{
+	thumbstick_tap(thumbstick_steps(&stick_acc[0], x, STICK_ARROW_STEP), KC_LEFT, KC_RIGHT);
+	thumbstick_tap(thumbstick_steps(&stick_acc[1], y, STICK_ARROW_STEP), KC_DOWN, KC_UP);
+}
+
 void process_thumbstick(void)
 {
+	static uint16_t sample_time = 0;
+	static uint16_t report_time = 0;
+	static bool calibrated = false;
+	static uint8_t last_mode = STICK_MODE_MOUSE;
 	// Cache the prior read to avoid over-reporting mouse movement
 	static int8_t last_x = 0;
 	static int8_t last_y = 0;
-	int8_t x;
-	int8_t y;
 
-	bool dirty = false;
-	thumbstick_read(ADC_CHANNEL7, &x, &last_x, &dirty);
-	thumbstick_read(ADC_CHANNEL6, &y, &last_y, &dirty);
+	if (!stick_busy && timer_read() != sample_time) {
+		sample_time = timer_read();
+		stick_busy = true;
+		ADC_StartReading(ADC_REFERENCE_AVCC | ADC_CHANNEL7);
+	}
+
+	if (timer_elapsed(report_time) < STICK_INTERVAL)
+		return;
+	report_time = timer_read();
+
+	if (stick_samples < STICK_CALIBRATE)
+		return;
+
+	cli();
+	int16_t fx = stick_filtered[0];
+	int16_t fy = stick_filtered[1];
+	sei();
+
+	if (!calibrated) {
+		stick_center[0] = fx;
+		stick_center[1] = fy;
+		calibrated = true;
+		dprintf("stick center: %d %d\n", fx >> 4, fy >> 4);
+	}
+
+	int8_t x = map_value(thumbstick_deflection(0, fx));
+	int8_t y = map_value(thumbstick_deflection(1, fy));
+
+	uint8_t mode = thumbstick_mode();
+	if (mode != last_mode) {
+		if (last_mode == STICK_MODE_MOUSE && (last_x || last_y)) {
+			mousekey_set_xyvh(0, 0, 0, 0);
+			mousekey_send();
+		}
+		stick_acc[0] = stick_acc[1] = 0;
+		last_x = last_y = 0;
+		last_mode = mode;
+	}
+	if (mode == STICK_MODE_WHEEL) {
+		thumbstick_wheel(x, y);
+		return;
+	}
+	if (mode == STICK_MODE_ARROW) {
+		thumbstick_arrow(x, y);
+		return;
+	}
+
+	bool dirty = (x != last_x || y != last_y);
+	last_x = x;
+	last_y = y;
 
 	if (dirty || x || y) {
 		mousekey_set_xyvh(x, -y, 0, 0);
@@ -162,22 +357,165 @@ void process_thumbstick(void)
 
 #endif
 
+/*
+ * Scan Code Set 3
+ *
+ * Keyboard is asked for Set 3 with all keys make/break(F8), then every key
+ * is a single code with F0 prefix on break, no typematic repeat and Pause has
+ * break as well. Set 2 is used when keyboard refuses Set 3 or reports other
+ * set back(command F0, [3]). Keyboard returns to Set 2 by
+ * itself on reset, so this is done again on BAT.
+ */
+static void codeset_config(void)
+{
+#ifndef PS2_SET2_ONLY
+    if (ps2_host_send(0xF0) == PS2_ACK && ps2_host_send(0x03) == PS2_ACK &&
+            ps2_host_send(0xF0) == PS2_ACK && ps2_host_send(0x00) == PS2_ACK &&
+            ps2_host_recv_response() == 0x03 &&
+            ps2_host_send(0xF8) == PS2_ACK) {
+        codeset = SET3;
+        print("Set 3\n");
+        return;
+    }
+    // back to Set 2 in case it took Set 3 partly
+    if (ps2_host_send(0xF0) == PS2_ACK) ps2_host_send(0x02);
+#endif
+    codeset = SET2;
+    print("Set 2\n");
+}
+
+/* Set 3 code to matrix position of Set 2 above, 0 is unused code */
+static const uint8_t set3_pos[] PROGMEM = {
+    [0x07] = 0x05,  // F1
+    [0x08] = 0x76,  // Esc
+    [0x0D] = 0x0D,  // Tab
+    [0x0E] = 0x0E,  // `
+    [0x0F] = 0x06,  // F2
+    [0x11] = 0x14,  // LCtrl
+    [0x12] = 0x12,  // LShift
+    [0x13] = 0x61,  // ISO <>
+    [0x14] = 0x58,  // CapsLock
+    [0x15] = 0x15,  // Q
+    [0x16] = 0x16,  // 1
+    [0x17] = 0x04,  // F3
+    [0x19] = 0x11,  // LAlt
+    [0x1A] = 0x1A,  // Z
+    [0x1B] = 0x1B,  // S
+    [0x1C] = 0x1C,  // A
+    [0x1D] = 0x1D,  // W
+    [0x1E] = 0x1E,  // 2
+    [0x1F] = 0x0C,  // F4
+    [0x21] = 0x21,  // C
+    [0x22] = 0x22,  // X
+    [0x23] = 0x23,  // D
+    [0x24] = 0x24,  // E
+    [0x25] = 0x25,  // 4
+    [0x26] = 0x26,  // 3
+    [0x27] = 0x03,  // F5
+    [0x29] = 0x29,  // Space
+    [0x2A] = 0x2A,  // V
+    [0x2B] = 0x2B,  // F
+    [0x2C] = 0x2C,  // T
+    [0x2D] = 0x2D,  // R
+    [0x2E] = 0x2E,  // 5
+    [0x2F] = 0x0B,  // F6
+    [0x31] = 0x31,  // N
+    [0x32] = 0x32,  // B
+    [0x33] = 0x33,  // H
+    [0x34] = 0x34,  // G
+    [0x35] = 0x35,  // Y
+    [0x36] = 0x36,  // 6
+    [0x37] = 0x83,  // F7
+    [0x39] = 0x91,  // RAlt
+    [0x3A] = 0x3A,  // M
+    [0x3B] = 0x3B,  // J
+    [0x3C] = 0x3C,  // U
+    [0x3D] = 0x3D,  // 7
+    [0x3E] = 0x3E,  // 8
+    [0x3F] = 0x0A,  // F8
+    [0x41] = 0x41,  // ,
+    [0x42] = 0x42,  // K
+    [0x43] = 0x43,  // I
+    [0x44] = 0x44,  // O
+    [0x45] = 0x45,  // 0
+    [0x46] = 0x46,  // 9
+    [0x47] = 0x01,  // F9
+    [0x49] = 0x49,  // .
+    [0x4A] = 0x4A,  // /
+    [0x4B] = 0x4B,  // L
+    [0x4C] = 0x4C,  // ;
+    [0x4D] = 0x4D,  // P
+    [0x4E] = 0x4E,  // -
+    [0x4F] = 0x09,  // F10
+    [0x51] = 0x51,  // Ro
+    [0x52] = 0x52,  // '
+    [0x53] = 0x5D,  // ISO #
+    [0x54] = 0x54,  // [
+    [0x55] = 0x55,  // =
+    [0x56] = 0x78,  // F11
+    [0x57] = 0xFC,  // PrintScreen
+    [0x58] = 0x94,  // RCtrl
+    [0x59] = 0x59,  // RShift
+    [0x5A] = 0x5A,  // Enter
+    [0x5B] = 0x5B,  // ]
+    [0x5C] = 0x5D,  // Backslash
+    [0x5D] = 0x6A,  // Yen
+    [0x5E] = 0x07,  // F12
+    [0x5F] = 0x7E,  // ScrollLock
+    [0x60] = 0xF2,  // Down
+    [0x61] = 0xEB,  // Left
+    [0x62] = 0xFE,  // Pause
+    [0x63] = 0xF5,  // Up
+    [0x64] = 0xF1,  // Delete
+    [0x65] = 0xE9,  // End
+    [0x66] = 0x66,  // Backspace
+    [0x67] = 0xF0,  // Insert
+    [0x69] = 0x69,  // Keypad 1
+    [0x6A] = 0xF4,  // Right
+    [0x6B] = 0x6B,  // Keypad 4
+    [0x6C] = 0x6C,  // Keypad 7
+    [0x6D] = 0xFA,  // PageDown
+    [0x6E] = 0xEC,  // Home
+    [0x6F] = 0xFD,  // PageUp
+    [0x70] = 0x70,  // Keypad 0
+    [0x71] = 0x71,  // Keypad .
+    [0x72] = 0x72,  // Keypad 2
+    [0x73] = 0x73,  // Keypad 5
+    [0x74] = 0x74,  // Keypad 6
+    [0x75] = 0x75,  // Keypad 8
+    [0x76] = 0x77,  // NumLock
+    [0x77] = 0xCA,  // Keypad /
+    [0x79] = 0xDA,  // Keypad Enter
+    [0x7A] = 0x7A,  // Keypad 3
+    [0x7C] = 0x79,  // Keypad +
+    [0x7D] = 0x7D,  // Keypad 9
+    [0x7E] = 0x7C,  // Keypad *
+    [0x84] = 0x7B,  // Keypad -
+    [0x85] = 0x67,  // Muhenkan
+    [0x86] = 0x64,  // Henkan
+    [0x87] = 0x13,  // Kana
+    [0x8B] = 0x9F,  // LGUI
+    [0x8C] = 0xA7,  // RGUI
+    [0x8D] = 0xAF,  // App
+};
+
 void matrix_init(void)
 {
     debug_enable = true;
     ps2_host_init();
 
     // initialize matrix state: all keys off
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+    keys_len = 0;
+    matrix_event_clear();
+
+    codeset_config();
 
 #ifdef EXTRA_BUTTONS_ENABLE
     init_buttons();
 #endif
 
 #ifdef THUMBSTICK_ENABLE
-    ADC_Init(ADC_SINGLE_CONVERSION | ADC_PRESCALE_32);
-    ADC_SetupChannel(6); // A1 -> PF6
-    ADC_SetupChannel(7); // A0 -> PF7
+    thumbstick_init();
 #endif
 
     return;
@@ -248,6 +586,42 @@ void matrix_init(void)
  *               because it has no break code.
  *
  */
+static void matrix_scan_set3(uint8_t code)
+{
+    static bool brk = false;
+
+    switch (code) {
+        case 0xF0:
+            brk = true;
+            return;
+        case 0x00:  // Overrun
+        case 0xFF:
+            matrix_clear();
+            clear_keyboard();
+            print("Overrun\n");
+            break;
+        case 0xAA:  // Self-test passed
+        case 0xFC:  // Self-test failed
+            printf("BAT %s\n", (code == 0xAA) ? "OK" : "NG");
+            matrix_clear();
+            clear_keyboard();
+            codeset_config();
+            led_set(host_keyboard_leds());
+            break;
+        default: {
+            uint8_t pos = (code < sizeof(set3_pos)) ? pgm_read_byte(&set3_pos[code]) : 0;
+            if (!pos) {
+                xprintf("unknown set 3 code: %02X\n", code);
+            } else if (brk) {
+                matrix_break(pos);
+            } else {
+                matrix_make(pos);
+            }
+        }
+    }
+    brk = false;
+}
+
 uint8_t matrix_scan(void)
 {
 
@@ -275,13 +649,17 @@ uint8_t matrix_scan(void)
     is_modified = false;
 
     // 'pseudo break code' hack
-    if (matrix_is_on(ROW(PAUSE), COL(PAUSE))) {
+    change_time = timer_read();
+    if (codeset == SET2 && matrix_is_on(ROW(PAUSE), COL(PAUSE))) {
         matrix_break(PAUSE);
     }
 
     uint8_t code = ps2_host_recv();
+    change_time = ps2_host_recv_time();
     if (code) xprintf("%i\r\n", code);
-    if (!ps2_error) {
+    if (!ps2_error && codeset == SET3) {
+        matrix_scan_set3(code);
+    } else if (!ps2_error) {
         switch (state) {
             case INIT:
                 switch (code) {
@@ -311,6 +689,7 @@ uint8_t matrix_scan(void)
                     case 0xAA:  // Self-test passed
                     case 0xFC:  // Self-test failed
                         printf("BAT %s\n", (code == 0xAA) ? "OK" : "NG");
+                        codeset_config();
                         led_set(host_keyboard_leds());
                         state = INIT;
                         break;
@@ -488,6 +867,7 @@ uint8_t matrix_scan(void)
 */
 #ifdef EXTRA_BUTTONS_ENABLE
 
+    change_time = timer_read();
     uint8_t btns = read_buttons();
     
     if (buttons_debouncing != btns)
@@ -525,47 +905,71 @@ uint8_t matrix_scan(void)
     return 1;
 }
 
-inline
+// index of code in keys, or where it should be inserted
+static uint8_t keys_find(uint8_t code)
+{
+    uint8_t i = 0;
+    while (i < keys_len && keys[i] < code) i++;
+    return i;
+}
+
 bool matrix_is_on(uint8_t row, uint8_t col)
 {
-    return (matrix[row] & (1<<col));
+    uint8_t code = CODE(row, col);
+    uint8_t i = keys_find(code);
+    return (i < keys_len && keys[i] == code);
 }
 
-inline
 uint8_t matrix_get_row(uint8_t row)
 {
-    return matrix[row];
+    uint8_t bits = 0;
+    for (uint8_t i = keys_find(CODE(row, 0)); i < keys_len && ROW(keys[i]) == row; i++) {
+        bits |= 1<<COL(keys[i]);
+    }
+    return bits;
 }
 
 uint8_t matrix_key_count(void)
 {
-    uint8_t count = 0;
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        count += bitpop(matrix[i]);
-    }
-    return count;
+    return keys_len;
 }
 
+static bool change_add(uint8_t code, bool pressed)
+{
+    if (!matrix_event_put((keypos_t){ .row = ROW(code), .col = COL(code) }, pressed, change_time)) return false;
+    is_modified = true;
+    return true;
+}
 
-inline
 static void matrix_make(uint8_t code)
 {
-    if (!matrix_is_on(ROW(code), COL(code))) {
-        matrix[ROW(code)] |= 1<<COL(code);
-        is_modified = true;
+    uint8_t i = keys_find(code);
+    if (i < keys_len && keys[i] == code) return;
+    if (keys_len == MATRIX_KEYS_MAX) {
+        xprintf("matrix: too many keys: %02X\n", code);
+        return;
     }
+    if (!change_add(code, true)) return;
+    for (uint8_t j = keys_len; j > i; j--) keys[j] = keys[j - 1];
+    keys[i] = code;
+    keys_len++;
 }
 
-inline
 static void matrix_break(uint8_t code)
 {
-    if (matrix_is_on(ROW(code), COL(code))) {
-        matrix[ROW(code)] &= ~(1<<COL(code));
-        is_modified = true;
-    }
+    uint8_t i = keys_find(code);
+    if (i == keys_len || keys[i] != code) return;
+    if (!change_add(code, false)) return;
+    keys_len--;
+    for (; i < keys_len; i++) keys[i] = keys[i + 1];
 }
 
+/* break of every key down so that action_exec() releases layer and tap
+ * keys too, queued changes go first; key stays down if queue is full */
 void matrix_clear(void)
 {
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+    change_time = timer_read();
+    for (uint8_t i = keys_len; i--; ) {
+        matrix_break(keys[i]);
+    }
 }
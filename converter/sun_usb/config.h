@@ -28,6 +28,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 16
 #define MATRIX_COLS 8
+/* matrix.c hands key changes to keyboard_task() directly */
+#define MATRIX_HAS_EVENTS
 
 /* key combination for command */
 #define IS_COMMAND() ( \
@@ -56,6 +58,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
     #define SERIAL_UART_UBRR       ((F_CPU/(16UL*SERIAL_UART_BAUD))-1)
     #define SERIAL_UART_RXD_VECT   USART1_RX_vect
     #define SERIAL_UART_TXD_READY  (UCSR1A&(1<<UDRE1))
+    /* send from TX queue in background */
+    #define SERIAL_UART_TXD_VECT   USART1_UDRE_vect
+    #define SERIAL_UART_TXD_INT_ON()   do { UCSR1B |=  (1<<UDRIE1); } while (0)
+    #define SERIAL_UART_TXD_INT_OFF()  do { UCSR1B &= ~(1<<UDRIE1); } while (0)
     #define SERIAL_UART_INIT()     do { \
         UBRR1L = (uint8_t) SERIAL_UART_UBRR;       /* baud rate */ \
         UBRR1H = (uint8_t) (SERIAL_UART_UBRR>>8);  /* baud rate */ \
@@ -101,10 +107,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
         EIMSK |= (1<<INT2); \
         sei(); \
     } while (0)
-    #define SERIAL_SOFT_RXD_INT_ENTER()
+    #define SERIAL_SOFT_RXD_INT_ENTER() do { \
+        /* mask interrupt while receiving */ \
+        EIMSK &= ~(1<<INT2); \
+    } while (0)
     #define SERIAL_SOFT_RXD_INT_EXIT()  do { \
         /* clear interrupt  flag */ \
         EIFR = (1<<INTF2); \
+        EIMSK |= (1<<INT2); \
     } while (0)
     #define SERIAL_SOFT_RXD_READ()      (SERIAL_SOFT_RXD_PIN&(1<<SERIAL_SOFT_RXD_BIT))
     /* TXD Port */
@@ -121,6 +131,30 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
         /* idle */ \
         SERIAL_SOFT_TXD_ON(); \
     } while (0)
+    /* TXD Timer: Timer1 CTC at bit period, clk/8
+     * TX queue is sent in background */
+    #ifdef SLEEP_LED_ENABLE
+    #   error "Software Serial TX uses Timer1 and conflicts with SLEEP_LED_ENABLE"
+    #endif
+    #define SERIAL_SOFT_TXD_VECT        TIMER1_COMPA_vect
+    #define SERIAL_SOFT_TXD_TIMER_INIT() do { \
+        TCCR1A = 0; \
+        TCCR1B = (1<<WGM12) | (1<<CS11); \
+        OCR1A = (F_CPU/8/SERIAL_SOFT_BAUD) - 1; \
+    } while (0)
+    #define SERIAL_SOFT_TXD_TIMER_ON()  do { \
+        TCNT1 = 0; \
+        TIFR1 = (1<<OCF1A); \
+        TIMSK1 |= (1<<OCIE1A); \
+    } while (0)
+    #define SERIAL_SOFT_TXD_TIMER_OFF() do { \
+        TIMSK1 &= ~(1<<OCIE1A); \
+    } while (0)
+    /* With TXD on OC1A(PB5) compare unit places bits on time, OC1A is 0(ON)
+     * after reset. Negative logic: clear on match for ON, set for OFF.
+    #define SERIAL_SOFT_TXD_OC_ON()     (TCCR1A = (1<<COM1A1))
+    #define SERIAL_SOFT_TXD_OC_OFF()    (TCCR1A = (1<<COM1A1) | (1<<COM1A0))
+     */
 
 #endif //hardware serial
 #endif //config.h
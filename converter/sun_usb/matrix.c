@@ -48,6 +48,16 @@ static uint8_t matrix[MATRIX_ROWS];
 #define ROW(code)      ((code>>3)&0xF)
 #define COL(code)      (code&0x07)
 
+// queue change of key and keep its state unless queue is full
+static bool matrix_key(uint8_t code, bool pressed)
+{
+    if (matrix_is_on(ROW(code), COL(code)) == pressed) return false;
+    if (!matrix_event_put((keypos_t){ .row = ROW(code), .col = COL(code) }, pressed, serial_recv_time())) return false;
+    if (pressed) matrix[ROW(code)] |=  (1<<COL(code));
+    else         matrix[ROW(code)] &= ~(1<<COL(code));
+    return true;
+}
+
 
 void matrix_init(void)
 {
@@ -111,21 +121,11 @@ uint8_t matrix_scan(void)
             return 0;
         case 0x7F:
             // all keys up
-            for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+            for (uint8_t c = 0; c < 0x80; c++) matrix_key(c, false);
             return 0;
     }
 
-    if (code&0x80) {
-        // break code
-        if (matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] &= ~(1<<COL(code));
-        }
-    } else {
-        // make code
-        if (!matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] |=  (1<<COL(code));
-        }
-    }
+    matrix_key(code & 0x7F, !(code&0x80));
     return code;
 }
 
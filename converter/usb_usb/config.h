@@ -32,6 +32,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 16
 #define MATRIX_COLS 16
+/* key changes of reports are queued for keyboard_task() directly */
+#define MATRIX_HAS_EVENTS
+
+/* USB devices: hubs and keyboards/mice, see usb_usb.cpp */
+//#define USB_HUBS        2
+//#define USB_HID_DEVICES 4
+
+/* motion of USB mice is summed and split into reports */
+#define MOUSE_REPORT_MERGE
+
+/* mouse interface is read every 1ms to keep report rate of 1kHz mice */
+#define MOUSE_POLLING_INTERVAL 1
 
 /* key combination for command */
 #define IS_COMMAND() (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) 
@@ -97,10 +97,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
       KC_##K88, KC_##K89, KC_##K8A, KC_##K8B, KC_NO,    KC_NO,    KC_NO,    KC_NO    }, /* 88-8F */ \
     { KC_##K90, KC_##K91, KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,      /* 90-97 */ \
       KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO    }, /* 98-9F */ \
-    { KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,      /* A0-A7 */ \
-      KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO    }, /* A8-AF */ \
-    { KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,      /* B0-B7 */ \
-      KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO    }, /* B8-BF */ \
+    { KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_PWR,   KC_SLEP,  KC_WAKE,    /* A0-A7 */ \
+      KC_MUTE,  KC_VOLU,  KC_VOLD,  KC_MNXT,  KC_MPRV,  KC_MFFD,  KC_MRWD,  KC_MSTP  }, /* A8-AF */ \
+    { KC_MPLY,  KC_EJCT,  KC_MSEL,  KC_MAIL,  KC_CALC,  KC_MYCM,  KC_WSCH,  KC_WHOM,    /* B0-B7 */ \
+      KC_WBAK,  KC_WFWD,  KC_WSTP,  KC_WREF,  KC_WFAV,  KC_NO,    KC_NO,    KC_NO    }, /* B8-BF */ \
     { KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,      /* C0-C7 */ \
       KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO    }, /* C8-CF */ \
     { KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,    KC_NO,      /* D0-D7 */ \
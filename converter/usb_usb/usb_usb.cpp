@@ -17,12 +17,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 // USB HID host
 #include "Usb.h"
 #include "usbhub.h"
 #include "hid.h"
-#include "hidboot.h"
+#include "hiduniversal.h"
 #include "parser.h"
 
 #include "keycode.h"
@@ -34,6 +35,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "host.h"
 #include "keyboard.h"
+#include "watchdog.h"
 
 
 /* KEY CODE to Matrix
@@ -53,100 +55,199 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *   : |                |
  *  16 +----------------+
  */
-#define ROW_MASK 0xF0
-#define COL_MASK 0x0F
 #define CODE(row, col)  (((row) << 4) | (col))
-#define ROW(code)       (((code) & ROW_MASK) >> 4)
-#define COL(code)       ((code) & COL_MASK)
-#define ROW_BITS(code)  (1 << COL(code))
 
 
-// Integrated key state of all keyboards
-static report_keyboard_t keyboard_report;
+/* Integrated key state of all keyboards
+ *
+ * Bit per usage merged from bitmap of parsers, a row is two bytes of it and
+ * modifiers are row 0xE. It holds any number of keys down across keyboards.
+ * Changes to it are queued as events(MATRIX_HAS_EVENTS), it is state of
+ * keys already queued and the rest waits for room in queue.
+ */
+static uint8_t keyboard_bitmap[32];
+static uint8_t keyboard_key_count = 0;
+static bool keyboard_pending = false;
 
 static bool matrix_is_mod =false;
 
 /*
- * USB Host Shield HID keyboards
- * This supports two cascaded hubs and four keyboards
+ * USB Host Shield HID devices
+ * Table of USB_HUBS hubs and USB_HID_DEVICES keyboards or mice in any
+ * combination, read in report protocol to get NKRO, media keys and wheels.
+ * See HIDReportDevice in parser.h.
  */
+#ifndef USB_HUBS
+#define USB_HUBS        2
+#endif
+#ifndef USB_HID_DEVICES
+#define USB_HID_DEVICES 4
+#endif
+#if USB_HUBS + USB_HID_DEVICES > USB_NUMDEVICES
+#   error "USB_HUBS + USB_HID_DEVICES exceeds USB_NUMDEVICES of USB Host Shield library"
+#endif
+
 USB usb_host;
-USBHub hub1(&usb_host);
-USBHub hub2(&usb_host);
-HIDBoot<HID_PROTOCOL_KEYBOARD>    kbd1(&usb_host);
-HIDBoot<HID_PROTOCOL_KEYBOARD>    kbd2(&usb_host);
-HIDBoot<HID_PROTOCOL_KEYBOARD>    kbd3(&usb_host);
-HIDBoot<HID_PROTOCOL_KEYBOARD>    kbd4(&usb_host);
-KBDReportParser kbd_parser1;
-KBDReportParser kbd_parser2;
-KBDReportParser kbd_parser3;
-KBDReportParser kbd_parser4;
+USBHub hub[USB_HUBS];
+HIDReportDevice hid_dev[USB_HID_DEVICES];
+
+/*
+ * Enumeration of a keyboard takes seconds in usb_host.Task() with waits for
+ * address, hub port reset and retries. Keyboards already running are served
+ * in the waits and their keys are processed by nested keyboard_task(), which
+ * doesn't enter usb_host.Task() again.
+ */
+static bool usb_host_waiting = false;
+
+#define MODS_BYTE   (0xE0 >> 3)
+
+/* queue changed bits of a byte of bitmap, false when queue is full */
+static bool keyboard_event(uint8_t i, uint8_t bits, uint8_t mask)
+{
+    uint8_t change = (bits ^ keyboard_bitmap[i]) & mask;
+    for (uint8_t b = 0; change; b++, change >>= 1) {
+        if (!(change & 1)) continue;
+        uint8_t code = (i << 3) | b;
+        bool pressed = bits & (1 << b);
+        if (!matrix_event_put((keypos_t){ .col = (uint8_t)(code & 0xF), .row = (uint8_t)(code >> 4) }, pressed, timer_read())) {
+            return false;
+        }
+        if (pressed) {
+            keyboard_bitmap[i] |= (1 << b);
+            keyboard_key_count++;
+        } else {
+            keyboard_bitmap[i] &= ~(1 << b);
+            keyboard_key_count--;
+        }
+    }
+    return true;
+}
+
+/*
+ * Mouse buttons of all mice are merged and their motion is summed, then
+ * host_mouse_move() splits or merges it into reports. Motion over 127 is
+ * clipped without MOUSE_REPORT_MERGE.
+ */
+static void mouse_task(void)
+{
+    uint8_t buttons = 0;
+    int16_t x = 0, y = 0, v = 0, h = 0;
+    for (uint8_t i = 0; i < USB_HID_DEVICES; i++) {
+        HIDReportDevice &d = hid_dev[i];
+        if (!(d.changed & HIDReportDevice::CHANGED_MOUSE)) continue;
+        d.changed &= ~HIDReportDevice::CHANGED_MOUSE;
+        x += d.x; y += d.y; v += d.v; h += d.h;
+        d.x = d.y = d.v = d.h = 0;
+    }
+    for (uint8_t i = 0; i < USB_HID_DEVICES; i++) {
+        buttons |= hid_dev[i].buttons;
+    }
+    if (debug_mouse) dprintf("mouse: %02X %d %d %d %d\r\n", buttons, x, y, v, h);
+#ifdef MOUSE_REPORT_MERGE
+    host_mouse_move(buttons, x, y, v, h);
+#else
+    report_mouse_t report = {
+        .buttons = buttons,
+        .x = (int8_t)(x > 127 ? 127 : (x < -127 ? -127 : x)),
+        .y = (int8_t)(y > 127 ? 127 : (y < -127 ? -127 : y)),
+        .v = (int8_t)(v > 127 ? 127 : (v < -127 ? -127 : v)),
+        .h = (int8_t)(h > 127 ? 127 : (h < -127 ? -127 : h)),
+    };
+    host_mouse_send(&report);
+#endif
+}
+
+/* a mouse report is passed through as it comes, not once a scan */
+static void mouse_report(HIDReportDevice *dev)
+{
+    (void)dev;
+    mouse_task();
+}
+
+static void usb_host_wait(void)
+{
+    usb_host_waiting = true;
+    for (uint8_t i = 0; i < USB_HID_DEVICES; i++) {
+        hid_dev[i].Poll();
+    }
+    keyboard_task();
+    // kicked watchdog and left its stages, still in usb_host.Task()
+    WATCHDOG_STAGE(WATCHDOG_USB_HOST);
+    usb_host_waiting = false;
+}
 
 
 uint8_t matrix_rows(void) { return MATRIX_ROWS; }
 uint8_t matrix_cols(void) { return MATRIX_COLS; }
 bool matrix_has_ghost(void) { return false; }
 void matrix_init(void) {
-    // USB Host Shield setup
+    // USB Host Shield setup, hubs are registered first to be tried first
+    for (uint8_t i = 0; i < USB_HUBS; i++) {
+        hub[i].Attach(&usb_host);
+    }
+    for (uint8_t i = 0; i < USB_HID_DEVICES; i++) {
+        hid_dev[i].Attach(&usb_host);
+        hid_dev[i].setMouseHandler(mouse_report);
+    }
     usb_host.Init();
-    kbd1.SetReportParser(0, (HIDReportParser*)&kbd_parser1);
-    kbd2.SetReportParser(0, (HIDReportParser*)&kbd_parser2);
-    kbd3.SetReportParser(0, (HIDReportParser*)&kbd_parser3);
-    kbd4.SetReportParser(0, (HIDReportParser*)&kbd_parser4);
+    usb_host.setWaitHandler(usb_host_wait);
 }
 
-static void or_report(report_keyboard_t report) {
-    // integrate reports into keyboard_report
-    keyboard_report.mods |= report.mods;
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(report.keys[i])) {
-            for (uint8_t j = 0; j < KEYBOARD_REPORT_KEYS; j++) {
-                if (! keyboard_report.keys[j]) {
-                    keyboard_report.keys[j] = report.keys[i];
-                    break;
-                }
+uint8_t matrix_scan(void) {
+    // devices flag their change, state is merged only when some has one
+    uint8_t changed = 0;
+    for (uint8_t i = 0; i < USB_HID_DEVICES; i++) {
+        changed |= hid_dev[i].changed;
+        hid_dev[i].changed &= ~HIDReportDevice::CHANGED_KEYS;
+    }
+
+    // buttons released by removed mouse
+    if (changed & HIDReportDevice::CHANGED_MOUSE) {
+        mouse_task();
+    }
+
+    if ((changed & HIDReportDevice::CHANGED_KEYS) || keyboard_pending) {
+        // integrate key state of all keyboards, key up needs all of them
+        uint8_t bitmap[sizeof(keyboard_bitmap)];
+        ::memset(bitmap, 0, sizeof(bitmap));
+        for (uint8_t d = 0; d < USB_HID_DEVICES; d++) {
+            for (uint8_t i = 0; i < sizeof(bitmap); i++) {
+                bitmap[i] |= hid_dev[d].bitmap[i];
             }
         }
-    }
-}
 
-uint8_t matrix_scan(void) {
-    static uint16_t last_time_stamp1 = 0;
-    static uint16_t last_time_stamp2 = 0;
-    static uint16_t last_time_stamp3 = 0;
-    static uint16_t last_time_stamp4 = 0;
-
-    // check report came from keyboards
-    if (kbd_parser1.time_stamp != last_time_stamp1 ||
-        kbd_parser2.time_stamp != last_time_stamp2 ||
-        kbd_parser3.time_stamp != last_time_stamp3 ||
-        kbd_parser4.time_stamp != last_time_stamp4) {
-
-        last_time_stamp1 = kbd_parser1.time_stamp;
-        last_time_stamp2 = kbd_parser2.time_stamp;
-        last_time_stamp3 = kbd_parser3.time_stamp;
-        last_time_stamp4 = kbd_parser4.time_stamp;
-
-        // clear and integrate all reports
-        keyboard_report = {};
-        or_report(kbd_parser1.report);
-        or_report(kbd_parser2.report);
-        or_report(kbd_parser3.report);
-        or_report(kbd_parser4.report);
+        // modifiers are pressed before and released after other keys of
+        // the same report
+        keyboard_pending = true;
+        if (keyboard_event(MODS_BYTE, bitmap[MODS_BYTE], bitmap[MODS_BYTE])) {
+            uint8_t i = 0;
+            for (; i < sizeof(bitmap); i++) {
+                if (i != MODS_BYTE && !keyboard_event(i, bitmap[i], 0xFF)) break;
+            }
+            if (i == sizeof(bitmap) && keyboard_event(MODS_BYTE, bitmap[MODS_BYTE], 0xFF)) {
+                keyboard_pending = false;
+            }
+        }
 
         matrix_is_mod = true;
 
-        dprintf("state:  %02X %02X", keyboard_report.mods, keyboard_report.reserved);
-        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-            dprintf(" %02X", keyboard_report.keys[i]);
+        if (debug_keyboard) {
+            dprintf("state: ");
+            for (uint16_t code = 0; code < 256; code++) {
+                if (keyboard_bitmap[code >> 3] & (1 << (code & 7))) dprintf(" %02X", code);
+            }
+            dprint("\r\n");
         }
-        dprint("\r\n");
     } else {
         matrix_is_mod = false;
     }
 
+    // called from usb_host_wait()
+    if (usb_host_waiting) return 1;
+
     uint16_t timer;
     timer = timer_read();
+    WATCHDOG_STAGE(WATCHDOG_USB_HOST);
     usb_host.Task();
     timer = timer_elapsed(timer);
     if (timer > 100) {
@@ -173,47 +274,15 @@ bool matrix_is_modified(void) {
 
 bool matrix_is_on(uint8_t row, uint8_t col) {
     uint8_t code = CODE(row, col);
-
-    if (IS_MOD(code)) {
-        if (keyboard_report.mods & ROW_BITS(code)) {
-            return true;
-        }
-    }
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (keyboard_report.keys[i] == code) {
-            return true;
-        }
-    }
-    return false;
+    return keyboard_bitmap[code >> 3] & (1 << (code & 7));
 }
 
 matrix_row_t matrix_get_row(uint8_t row) {
-    uint16_t row_bits = 0;
-
-    if (IS_MOD(CODE(row, 0)) && keyboard_report.mods) {
-        row_bits |= keyboard_report.mods;
-    }
-
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(keyboard_report.keys[i])) {
-            if (row == ROW(keyboard_report.keys[i])) {
-                row_bits |= ROW_BITS(keyboard_report.keys[i]);
-            }
-        }
-    }
-    return row_bits;
+    return keyboard_bitmap[row*2] | (keyboard_bitmap[row*2 + 1] << 8);
 }
 
 uint8_t matrix_key_count(void) {
-    uint8_t count = 0;
-
-    count += bitpop(keyboard_report.mods);
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(keyboard_report.keys[i])) {
-            count++;
-        }
-    }
-    return count;
+    return keyboard_key_count;
 }
 
 void matrix_print(void) {
@@ -227,8 +296,7 @@ void matrix_print(void) {
 
 void led_set(uint8_t usb_led)
 {
-    kbd1.SetReport(0, 0, 2, 0, 1, &usb_led);
-    kbd2.SetReport(0, 0, 2, 0, 1, &usb_led);
-    kbd3.SetReport(0, 0, 2, 0, 1, &usb_led);
-    kbd4.SetReport(0, 0, 2, 0, 1, &usb_led);
+    for (uint8_t i = 0; i < USB_HID_DEVICES; i++) {
+        hid_dev[i].SetLED(usb_led);
+    }
 }
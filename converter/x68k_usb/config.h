@@ -30,6 +30,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 16
 #define MATRIX_COLS 8
+/* matrix.c hands key changes to keyboard_task() directly */
+#define MATRIX_HAS_EVENTS
 
 
 /* key combination for command */
@@ -49,6 +51,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
     #define SERIAL_UART_UBRR       ((F_CPU/(16UL*SERIAL_UART_BAUD))-1)
     #define SERIAL_UART_RXD_VECT   USART1_RX_vect
     #define SERIAL_UART_TXD_READY  (UCSR1A&(1<<UDRE1))
+    /* send from TX queue in background */
+    #define SERIAL_UART_TXD_VECT   USART1_UDRE_vect
+    #define SERIAL_UART_TXD_INT_ON()   do { UCSR1B |=  (1<<UDRIE1); } while (0)
+    #define SERIAL_UART_TXD_INT_OFF()  do { UCSR1B &= ~(1<<UDRIE1); } while (0)
     #define SERIAL_UART_INIT()     do { \
         UBRR1L = (uint8_t) SERIAL_UART_UBRR;       /* baud rate */ \
         UBRR1H = (uint8_t) (SERIAL_UART_UBRR>>8);  /* baud rate */ \
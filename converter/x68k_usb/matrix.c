@@ -49,10 +49,32 @@ static uint8_t matrix[MATRIX_ROWS];
 
 static bool is_modified = false;
 
+// queue change of key and keep its state unless queue is full
+static bool matrix_key(uint8_t code, bool pressed)
+{
+    if (matrix_is_on(ROW(code), COL(code)) == pressed) return false;
+    if (!matrix_event_put((keypos_t){ .row = ROW(code), .col = COL(code) }, pressed, serial_recv_time())) return false;
+    if (pressed) matrix[ROW(code)] |=  (1<<COL(code));
+    else         matrix[ROW(code)] &= ~(1<<COL(code));
+    return true;
+}
+
+
+/*
+ * Typematic repeat of keyboard is only traffic, converter drops make of key
+ * down already and action code repeats on host side. It can't be off, so the
+ * longest delay and time are set.
+ *   Repeat delay: 0110_dddd  200+d*100 ms
+ *   Repeat time:  0111_tttt  30+t^2*5 ms
+ */
+#define X68K_REPEAT_DELAY_MAX   0x6F    // 1700ms
+#define X68K_REPEAT_TIME_MAX    0x7F    // 1155ms
 
 void matrix_init(void)
 {
     serial_init();
+    serial_send(X68K_REPEAT_DELAY_MAX);
+    serial_send(X68K_REPEAT_TIME_MAX);
 
     // initialize matrix state: all keys off
     for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
@@ -60,31 +82,23 @@ void matrix_init(void)
     return;
 }
 
+/*
+ * Codes received are taken in a scan up to SCAN_CODES_MAX so that chord is
+ * done in one pass, event queue is emptied by keyboard_task() every scan.
+ */
+#define SCAN_CODES_MAX  4
 uint8_t matrix_scan(void)
 {
     is_modified = false;
 
-    uint16_t code;
-    code = serial_recv2();
-    if (code == -1) {
-        return 0;
-    }
+    for (uint8_t n = 0; n < SCAN_CODES_MAX; n++) {
+        int16_t code = serial_recv2();
+        if (code == -1) break;
 
-    dprintf("%02X\n", code);
-    if (code&0x80) {
-        // break code
-        if (matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] &= ~(1<<COL(code));
-            is_modified = true;
-        }
-    } else {
-        // make code
-        if (!matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] |=  (1<<COL(code));
-            is_modified = true;
-        }
+        dprintf("%02X\n", code);
+        if (matrix_key(code & 0x7F, !(code&0x80))) is_modified = true;
     }
-    return code;
+    return is_modified;
 }
 
 inline
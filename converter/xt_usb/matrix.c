@@ -23,13 +23,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "debug.h"
 #include "xt.h"
+#include "timer.h"
 #include "matrix.h"
 
 
-static void matrix_make(uint8_t code);
-static void matrix_break(uint8_t code);
+static bool matrix_make(uint8_t code);
+static bool matrix_break(uint8_t code);
 
 static uint8_t matrix[MATRIX_ROWS];
+// time of changes being made, when scan code came from keyboard
+static uint16_t change_time;
 #define ROW(code)      (code>>3)
 #define COL(code)      (code&0x07)
 
@@ -45,124 +48,23 @@ void matrix_init(void)
     return;
 }
 
-// convert E0-escaped codes into unused area
-static uint8_t move_e0code(uint8_t code) {
-    switch(code) {
-        // Original IBM XT keyboard has these keys
-        case 0x37: return 0x54; // Print Screen
-        case 0x46: return 0x55; // Ctrl + Pause
-        case 0x1C: return 0x6F; // Keypad Enter
-        case 0x35: return 0x7F; // Keypad /
-
-        // Any XT keyobard with these keys?
-        // http://download.microsoft.com/download/1/6/1/161ba512-40e2-4cc9-843a-923143f3456c/translate.pdf
-        // https://download.microsoft.com/download/1/6/1/161ba512-40e2-4cc9-843a-923143f3456c/scancode.doc
-        case 0x5B: return 0x5A; // Left  GUI
-        case 0x5C: return 0x5B; // Right GUI
-        case 0x5D: return 0x5C; // Application
-        case 0x5E: return 0x5D; // Power(not used)
-        case 0x5F: return 0x5E; // Sleep(not used)
-        case 0x63: return 0x5F; // Wake (not used)
-        case 0x48: return 0x60; // Up
-        case 0x4B: return 0x61; // Left
-        case 0x50: return 0x62; // Down
-        case 0x4D: return 0x63; // Right
-        case 0x52: return 0x71; // Insert
-        case 0x53: return 0x72; // Delete
-        case 0x47: return 0x74; // Home
-        case 0x4F: return 0x75; // End
-        case 0x49: return 0x77; // Home
-        case 0x51: return 0x78; // End
-        case 0x1D: return 0x7A; // Right Ctrl
-        case 0x38: return 0x7C; // Right Alt
-    }
-    return 0x00;
-}
-
+/* codes come decoded by xt_interrupt.c, see xt.h */
 uint8_t matrix_scan(void)
 {
-    static enum {
-        INIT,
-        E0,
-        // Pause: E1 1D 45, E1 9D C5
-        E1,
-        E1_1D,
-        E1_9D,
-    } state = INIT;
-
-    uint8_t code = xt_host_recv();
-    if (!code) return 0;
-    xprintf("%02X ", code);
-    switch (state) {
-        case INIT:
-            switch (code) {
-                case 0xE0:
-                    state = E0;
-                    break;
-                case 0xE1:
-                    state = E1;
-                    break;
-                default:
-                    if (code < 0x80)
-                        matrix_make(code);
-                    else
-                        matrix_break(code & 0x7F);
-                    break;
-            }
-            break;
-        case E0:
-            switch (code) {
-                case 0x2A:
-                case 0xAA:
-                case 0x36:
-                case 0xB6:
-                    //ignore fake shift
-                    state = INIT;
-                    break;
-                default:
-                    if (code < 0x80)
-                        matrix_make(move_e0code(code));
-                    else
-                        matrix_break(move_e0code(code & 0x7F));
-                    state = INIT;
-                    break;
-            }
-            break;
-        case E1:
-            switch (code) {
-                case 0x1D:
-                    state = E1_1D;
-                    break;
-                case 0x9D:
-                    state = E1_9D;
-                    break;
-                default:
-                    state = INIT;
-                    break;
-            }
-            break;
-        case E1_1D:
-            switch (code) {
-                case 0x45:
-                    matrix_make(0x55);
-                    break;
-                default:
-                    state = INIT;
-                    break;
-            }
-            break;
-        case E1_9D:
-            switch (code) {
-                case 0x45:
-                    matrix_break(0x55);
-                    break;
-                default:
-                    state = INIT;
-                    break;
-            }
-            break;
-        default:
-            state = INIT;
+    // code held while event queue is full
+    static uint8_t pending = 0;
+
+    for (;;) {
+        uint8_t code = pending;
+        if (!code) {
+            code = xt_host_recv();
+            if (!code) break;
+            change_time = xt_host_recv_time();
+            xprintf("%02X ", code);
+        }
+        bool done = (code & 0x80) ? matrix_break(code & 0x7F) : matrix_make(code);
+        pending = done ? 0 : code;
+        if (!done) break;
     }
     return 1;
 }
@@ -174,24 +76,31 @@ uint8_t matrix_get_row(uint8_t row)
 }
 
 inline
-static void matrix_make(uint8_t code)
+static bool matrix_make(uint8_t code)
 {
     if (!matrix_is_on(ROW(code), COL(code))) {
+        if (!matrix_event_put((keypos_t){ .row = ROW(code), .col = COL(code) }, true, change_time)) return false;
         matrix[ROW(code)] |= 1<<COL(code);
     }
+    return true;
 }
 
 inline
-static void matrix_break(uint8_t code)
+static bool matrix_break(uint8_t code)
 {
     if (matrix_is_on(ROW(code), COL(code))) {
+        if (!matrix_event_put((keypos_t){ .row = ROW(code), .col = COL(code) }, false, change_time)) return false;
         matrix[ROW(code)] &= ~(1<<COL(code));
     }
+    return true;
 }
 
+/* break of every key down so that action_exec() releases layer and tap
+ * keys too, queued changes go first */
 void matrix_clear(void)
 {
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+    change_time = timer_read();
+    for (uint8_t code = 0; code < MATRIX_ROWS * 8; code++) matrix_break(code);
 }
 
 /*
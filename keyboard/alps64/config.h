@@ -31,6 +31,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_ROWS 8
 #define MATRIX_COLS 8
 
+/* matrix pins for generic scanner */
+#define MATRIX_ROW_PINS(X)  X(D,0) X(D,1) X(D,2) X(D,3) X(D,4) X(D,5) X(D,6) X(C,2)
+#define MATRIX_COL_PINS(X)  X(B,0) X(B,1) X(B,2) X(B,3) X(B,4) X(B,5) X(B,6) X(B,7)
+
 /* define if matrix has ghost */
 //#define MATRIX_HAS_GHOST
 
@@ -18,6 +18,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <avr/io.h>
 #include "stdint.h"
 #include "led.h"
+#include "debug.h"
+#include "hook.h"
+#include "wait.h"
 
 
 void led_set(uint8_t usb_led)
@@ -32,3 +35,13 @@ void led_set(uint8_t usb_led)
         PORTC &= ~(1<<5);
     }
 }
+
+/* blink on start, matrix comes from generic scanner */
+void hook_late_init(void)
+{
+    //debug
+    debug_matrix = true;
+    led_set(1<<USB_LED_CAPS_LOCK);
+    wait_ms(500);
+    led_set(0);
+}
@@ -46,4 +46,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* Boot Magic salt key: Space */
 #define BOOTMAGIC_KEY_SALT      KC_SPACE
 
+/* search shortest stable scan delays at first boot and keep them in EEPROM */
+//#define MATRIX_TIMING_CALIBRATE
+
+/* hook_layer_change() of unimap_hasu.c and unimap_emu.c lights Insert LED */
+#define HOOK_LAYER_CHANGE
+
 #endif
@@ -20,13 +20,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <util/delay.h>
+#include <avr/eeprom.h>
 #include "print.h"
 #include "debug.h"
 #include "util.h"
 #include "timer.h"
 #include "matrix.h"
 #include "led.h"
+#include "eeconfig.h"
 #include "fc660c.h"
 
 
@@ -39,6 +42,114 @@ static matrix_row_t _matrix0[MATRIX_ROWS];
 static matrix_row_t _matrix1[MATRIX_ROWS];
 
 
+/*
+ * Scan timing
+ *
+ * Delays(us) of settle after select, settle after hysteresis and recovery of
+ * KEY_STATE. With MATRIX_TIMING_CALIBRATE they are narrowed down at boot and
+ * kept in EEPROM, as keyboard/hhkb/matrix.c does. Released key waits only
+ * TIMING_RECOVERY_MIN to make 25us after KEY_ENABLE, and next key is selected
+ * to settle during recovery.
+ */
+#define TIMING_SELECT       2
+#define TIMING_HYS          10
+#define TIMING_RECOVERY     75
+#define TIMING_RECOVERY_MIN 18
+#define WAIT_IDLE()         _delay_us(TIMING_RECOVERY_MIN)
+
+#ifdef MATRIX_TIMING_CALIBRATE
+#define TIMING_CLOCK        (F_CPU / 1000000)
+#define EE_TIMING_CLOCK     (EECONFIG_MATRIX_TIMING)
+#define EE_TIMING           (EECONFIG_MATRIX_TIMING + 1)
+#define CALIBRATE_PASSES    4
+
+static struct {
+    uint8_t select;
+    uint8_t hys;
+    uint8_t recovery;
+} timing = { TIMING_SELECT, TIMING_HYS, TIMING_RECOVERY };
+
+static void delay_us(uint8_t us)
+{
+    while (us--) _delay_us(1);
+}
+#define WAIT_SELECT()       delay_us(timing.select)
+#define WAIT_HYS()          delay_us(timing.hys)
+#define WAIT_RECOVERY()     delay_us(timing.recovery)
+
+static matrix_row_t matrix_ref[MATRIX_ROWS];
+
+/* scans read the same as reference with current timing */
+static bool timing_stable(void)
+{
+    for (uint8_t i = 0; i < CALIBRATE_PASSES; i++) {
+        // reference as previous state for hysteresis
+        memcpy(matrix, matrix_ref, sizeof(matrix_ref));
+        matrix_scan();
+        if (memcmp(matrix, matrix_ref, sizeof(matrix_ref))) return false;
+    }
+    return true;
+}
+
+/* binary search between min and current delay, which is known stable */
+static void calibrate_delay(uint8_t *delay, uint8_t min)
+{
+    uint8_t max = *delay;
+    uint8_t stable = max;
+    while (min < stable) {
+        *delay = (min + stable) / 2;
+        if (timing_stable()) {
+            stable = *delay;
+        } else {
+            min = *delay + 1;
+        }
+    }
+    // margin for supply voltage and temperature
+    *delay = stable + stable/4 + 1;
+    if (*delay > max) *delay = max;
+}
+
+static void timing_init(void)
+{
+    if (eeprom_read_byte(EE_TIMING_CLOCK) == TIMING_CLOCK) {
+        eeprom_read_block(&timing, EE_TIMING, sizeof(timing));
+        if (timing.select <= TIMING_SELECT &&
+                timing.hys <= TIMING_HYS &&
+                timing.recovery >= TIMING_RECOVERY_MIN &&
+                timing.recovery <= TIMING_RECOVERY) {
+            return;
+        }
+        timing.select = TIMING_SELECT;
+        timing.hys = TIMING_HYS;
+        timing.recovery = TIMING_RECOVERY;
+    }
+
+    matrix_scan();
+    memcpy(matrix_ref, matrix, sizeof(matrix_ref));
+    if (!timing_stable()) {
+        dprint("matrix: timing calibration failed\n");
+        return;
+    }
+    calibrate_delay(&timing.select, 0);
+    calibrate_delay(&timing.hys, 0);
+    // recovery is seen only after key down, keep the default without it
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        if (matrix_ref[i]) {
+            calibrate_delay(&timing.recovery, TIMING_RECOVERY_MIN);
+            break;
+        }
+    }
+    eeprom_update_block(&timing, EE_TIMING, sizeof(timing));
+    eeprom_update_byte(EE_TIMING_CLOCK, TIMING_CLOCK);
+    dprintf("matrix: timing %u %u %u\n", timing.select, timing.hys, timing.recovery);
+}
+#else
+#define WAIT_SELECT()       _delay_us(TIMING_SELECT)
+#define WAIT_HYS()          _delay_us(TIMING_HYS)
+#define WAIT_RECOVERY()     _delay_us(TIMING_RECOVERY)
+#endif
+
+
 void matrix_init(void)
 {
 #if 0
@@ -58,6 +169,10 @@ void matrix_init(void)
     for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
     matrix = _matrix0;
     matrix_prev = _matrix1;
+
+#ifdef MATRIX_TIMING_CALIBRATE
+    timing_init();
+#endif
 }
 
 uint8_t matrix_scan(void)
@@ -69,18 +184,16 @@ uint8_t matrix_scan(void)
     matrix = tmp;
 
     uint8_t row, col;
+    SET_COL(0);
+    SET_ROW(0);
+    WAIT_SELECT();
     for (col = 0; col < MATRIX_COLS; col++) {
-        SET_COL(col);
         for (row = 0; row < MATRIX_ROWS; row++) {
-            //KEY_SELECT(row, col);
-            SET_ROW(row);
-            _delay_us(2);
-
             // Not sure this is needed. This just emulates HHKB controller's behaviour.
             if (matrix_prev[row] & (1<<col)) {
                 KEY_HYS_ON();
             }
-            _delay_us(10);
+            WAIT_HYS();
 
             // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
             // If V-USB interrupts in this section we could lose 40us or so
@@ -92,10 +205,11 @@ uint8_t matrix_scan(void)
             // Wait for KEY_STATE outputs its value.
             _delay_us(2);
 
-            if (KEY_STATE()) {
-                matrix[row] &= ~(1<<col);
-            } else {
+            bool down = !KEY_STATE();
+            if (down) {
                 matrix[row] |= (1<<col);
+            } else {
+                matrix[row] &= ~(1<<col);
             }
 
             // Ignore if this code region execution time elapses more than 20us.
@@ -109,9 +223,21 @@ uint8_t matrix_scan(void)
             KEY_HYS_OFF();
             KEY_UNABLE();
 
+            // select next key to settle while KEY_STATE recovers
+            if (row + 1 < MATRIX_ROWS) {
+                SET_ROW(row + 1);
+            } else if (col + 1 < MATRIX_COLS) {
+                SET_COL(col + 1);
+                SET_ROW(0);
+            }
+
             // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
             // This takes 25us or more to make sure KEY_STATE returns to idle state.
-            _delay_us(75);
+            if (down) {
+                WAIT_RECOVERY();
+            } else {
+                WAIT_IDLE();
+            }
         }
         if (matrix[row] ^ matrix_prev[row]) {
             matrix_last_modified = timer_read32();
@@ -120,6 +246,36 @@ uint8_t matrix_scan(void)
     return 1;
 }
 
+/*
+ * Any key down for wakeup
+ * Stops at first key down, senses without hysteresis of previous state and
+ * with shorter recovery, about half time of matrix_scan().
+ */
+bool matrix_any_key_down(void)
+{
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        SET_COL(col);
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            SET_ROW(row);
+            _delay_us(2);
+
+            uint8_t last = TIMER_RAW;
+            KEY_ENABLE();
+            _delay_us(2);
+            bool down = !KEY_STATE();
+            // invalid when interrupted, see matrix_scan()
+            if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
+                down = false;
+            }
+            _delay_us(5);
+            KEY_UNABLE();
+            if (down) return true;
+            _delay_us(30);
+        }
+    }
+    return false;
+}
+
 inline
 matrix_row_t matrix_get_row(uint8_t row)
 {
@@ -46,4 +46,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* Boot Magic salt key: Space */
 #define BOOTMAGIC_KEY_SALT      KC_SPACE
 
+/* search shortest stable scan delays at first boot and keep them in EEPROM */
+//#define MATRIX_TIMING_CALIBRATE
+
 #endif
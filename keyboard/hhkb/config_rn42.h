@@ -52,6 +52,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 /* power control of key switch board */
 #define HHKB_POWER_SAVING
+/* power key switch board only around scan every 10ms */
+#define MATRIX_SCAN_INTERVAL    10
+#define MATRIX_POWER_WARMUP     5
+/* search shortest stable scan delays at first boot and keep them in EEPROM */
+#define MATRIX_TIMING_CALIBRATE
+
+/* MCU sleeps between scans while Bluetooth is idle, first key waits for this
+ * at most(WDTO_60MS in <avr/wdt.h>) */
+#define SUSPEND_SLOW_WDTO   2
 
 /*
  * Hardware Serial(UART)
@@ -68,6 +77,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
     #define SERIAL_UART_UBRR        ((F_CPU/(16.0*SERIAL_UART_BAUD)-1+0.5))
     #define SERIAL_UART_RXD_VECT    USART1_RX_vect
     #define SERIAL_UART_TXD_READY   (UCSR1A&(1<<UDRE1))
+    /* send from TX queue in background, room for some reports */
+    #define SERIAL_UART_TXD_VECT    USART1_UDRE_vect
+    #define SERIAL_UART_TXD_INT_ON()    do { UCSR1B |=  (1<<UDRIE1); } while (0)
+    #define SERIAL_UART_TXD_INT_OFF()   do { UCSR1B &= ~(1<<UDRIE1); } while (0)
+    #define SERIAL_UART_TBUF_SIZE   64
+    /* PF1: RTS of RN42(high: not allowed to send)
+     * PD5: CTS to RN42, held while it is pulsed to wake RN42 from deep sleep */
+    #define SERIAL_UART_TXD_HOLD    ((PINF&(1<<1)) || (PORTD&(1<<5)))
     #define SERIAL_UART_INIT()      do { \
         UBRR1L = (uint8_t) SERIAL_UART_UBRR;       /* baud rate */ \
         UBRR1H = ((uint16_t)SERIAL_UART_UBRR>>8);  /* baud rate */ \
@@ -45,8 +45,6 @@ static inline void KEY_PREV_OFF(void) { (PORTB &= ~(1<<7)); }
 static inline void KEY_POWER_ON(void) {
     DDRB = 0xFF; PORTB = 0x40;          // change pins output
     DDRD |= (1<<4); PORTD |= (1<<4);    // MOS FET switch on
-    /* Without this wait you will miss or get false key events. */
-    _delay_ms(5);                       // wait for powering up
 }
 static inline void KEY_POWER_OFF(void) {
     /* input with pull-up consumes less than without it when pin is open. */
@@ -54,10 +52,13 @@ static inline void KEY_POWER_OFF(void) {
     DDRD |= (1<<4); PORTD &= ~(1<<4);   // MOS FET switch off
 }
 static inline bool KEY_POWER_STATE(void) { return PORTD & (1<<4); }
+/* Without this wait(ms) after power on you will miss or get false key events. */
+#define KEY_POWER_WARMUP        5
 #else
 static inline void KEY_POWER_ON(void) {}
 static inline void KEY_POWER_OFF(void) {}
 static inline bool KEY_POWER_STATE(void) { return true; }
+#define KEY_POWER_WARMUP        0
 #endif
 static inline void KEY_INIT(void)
 {
@@ -120,6 +121,7 @@ static inline void KEY_SELECT(uint8_t ROW, uint8_t COL)
 #define KEY_POWER_ON()
 #define KEY_POWER_OFF()
 #define KEY_POWER_STATE()       true
+#define KEY_POWER_WARMUP        0
 
 
 #else
@@ -158,8 +160,8 @@ static inline void KEY_SELECT(uint8_t ROW, uint8_t COL)
 #define KEY_POWER_ON()          do {    \
     KEY_INIT();                         \
     PORTB &= ~(1<<5);                   \
-    _delay_ms(1);                       \
 } while (0)
+#define KEY_POWER_WARMUP        1
 #define KEY_POWER_OFF()         do {    \
     DDRB  &= ~0x3F;                     \
     PORTB &= ~0x3F;                     \
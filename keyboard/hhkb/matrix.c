@@ -20,12 +20,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <util/delay.h>
+#include <avr/eeprom.h>
 #include "print.h"
 #include "debug.h"
 #include "util.h"
 #include "timer.h"
 #include "matrix.h"
+#include "eeconfig.h"
 #include "hhkb_avr.h"
 #include <avr/wdt.h>
 #include "suspend.h"
@@ -43,6 +46,127 @@ static matrix_row_t _matrix0[MATRIX_ROWS];
 static matrix_row_t _matrix1[MATRIX_ROWS];
 
 
+/*
+ * Scan timing
+ *
+ * Delays(us) around sensing a key: settle after select, settle after
+ * hysteresis and recovery of KEY_STATE before next key. Defaults are the worst
+ * case of boards and clocks noted in matrix_scan(). With
+ * MATRIX_TIMING_CALIBRATE each delay is narrowed down at boot to the shortest
+ * one that still reads the matrix same as the defaults, and kept in EEPROM for
+ * the clock until eeconfig_init().
+ *
+ * Wait after KEY_ENABLE is not calibrated as it works only in narrow range.
+ * Released key leaves KEY_STATE idle and waits only TIMING_RECOVERY_MIN to
+ * make 25us after KEY_ENABLE, full recovery is for keys read down. Select of
+ * next key settles during either, they are not shorter than TIMING_SELECT.
+ */
+#define TIMING_SELECT       5
+#define TIMING_PREV         10
+#ifdef HHKB_JP
+// Looks like JP needs faster scan due to its twice larger matrix
+// or it can drop keys in fast key typing
+#define TIMING_RECOVERY     30
+#else
+#define TIMING_RECOVERY     75
+#endif
+#define TIMING_RECOVERY_MIN 15
+#define WAIT_IDLE()         _delay_us(TIMING_RECOVERY_MIN)
+
+#ifdef MATRIX_TIMING_CALIBRATE
+#define TIMING_CLOCK        (F_CPU / 1000000)
+#define EE_TIMING_CLOCK     (EECONFIG_MATRIX_TIMING)
+#define EE_TIMING           (EECONFIG_MATRIX_TIMING + 1)
+#define CALIBRATE_PASSES    4
+
+static struct {
+    uint8_t select;
+    uint8_t prev;
+    uint8_t recovery;
+} timing = { TIMING_SELECT, TIMING_PREV, TIMING_RECOVERY };
+
+static void delay_us(uint8_t us)
+{
+    while (us--) _delay_us(1);
+}
+#define WAIT_SELECT()       delay_us(timing.select)
+#define WAIT_PREV()         delay_us(timing.prev)
+#define WAIT_RECOVERY()     delay_us(timing.recovery)
+
+static matrix_row_t matrix_ref[MATRIX_ROWS];
+
+/* scans read the same as reference with current timing */
+static bool timing_stable(void)
+{
+    for (uint8_t i = 0; i < CALIBRATE_PASSES; i++) {
+        // reference as previous state for hysteresis
+        memcpy(matrix, matrix_ref, sizeof(matrix_ref));
+        matrix_scan();
+        if (memcmp(matrix, matrix_ref, sizeof(matrix_ref))) return false;
+    }
+    return true;
+}
+
+/* binary search between min and current delay, which is known stable */
+static void calibrate_delay(uint8_t *delay, uint8_t min)
+{
+    uint8_t max = *delay;
+    uint8_t stable = max;
+    while (min < stable) {
+        *delay = (min + stable) / 2;
+        if (timing_stable()) {
+            stable = *delay;
+        } else {
+            min = *delay + 1;
+        }
+    }
+    // margin for supply voltage and temperature
+    *delay = stable + stable/4 + 1;
+    if (*delay > max) *delay = max;
+}
+
+static void timing_init(void)
+{
+    if (eeprom_read_byte(EE_TIMING_CLOCK) == TIMING_CLOCK) {
+        eeprom_read_block(&timing, EE_TIMING, sizeof(timing));
+        if (timing.select <= TIMING_SELECT &&
+                timing.prev <= TIMING_PREV &&
+                timing.recovery >= TIMING_RECOVERY_MIN &&
+                timing.recovery <= TIMING_RECOVERY) {
+            return;
+        }
+        timing.select = TIMING_SELECT;
+        timing.prev = TIMING_PREV;
+        timing.recovery = TIMING_RECOVERY;
+    }
+
+    // reference read with the defaults, keys held at boot are fine
+    matrix_scan();
+    memcpy(matrix_ref, matrix, sizeof(matrix_ref));
+    if (!timing_stable()) {
+        dprint("matrix: timing calibration failed\n");
+        return;
+    }
+    calibrate_delay(&timing.select, 0);
+    calibrate_delay(&timing.prev, 0);
+    // recovery is seen only after key down, keep the default without it
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        if (matrix_ref[i]) {
+            calibrate_delay(&timing.recovery, TIMING_RECOVERY_MIN);
+            break;
+        }
+    }
+    eeprom_update_block(&timing, EE_TIMING, sizeof(timing));
+    eeprom_update_byte(EE_TIMING_CLOCK, TIMING_CLOCK);
+    dprintf("matrix: timing %u %u %u\n", timing.select, timing.prev, timing.recovery);
+}
+#else
+#define WAIT_SELECT()       _delay_us(TIMING_SELECT)
+#define WAIT_PREV()         _delay_us(TIMING_PREV)
+#define WAIT_RECOVERY()     _delay_us(TIMING_RECOVERY)
+#endif
+
+
 void matrix_init(void)
 {
 #ifdef DEBUG
@@ -57,6 +181,27 @@ void matrix_init(void)
     for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
     matrix = _matrix0;
     matrix_prev = _matrix1;
+
+#ifdef MATRIX_TIMING_CALIBRATE
+    timing_init();
+#endif
+}
+
+/*
+ * Power of key switch board
+ * matrix_power_up() just switches on and returns, scan waits for the rest of
+ * KEY_POWER_WARMUP. Scan scheduler of keyboard_task() powers up ahead of scan
+ * so that it doesn't have to wait at all.
+ */
+static bool power_warming = false;
+static uint16_t power_on_time = 0;
+
+static void key_power_ready(void)
+{
+    matrix_power_up();
+    // timer_elapsed() is short of real time by up to 1ms
+    while (power_warming && timer_elapsed(power_on_time) <= KEY_POWER_WARMUP) ;
+    power_warming = false;
 }
 
 uint8_t matrix_scan(void)
@@ -67,18 +212,16 @@ uint8_t matrix_scan(void)
     matrix_prev = matrix;
     matrix = tmp;
 
-    // power on
-    if (!KEY_POWER_STATE()) KEY_POWER_ON();
+    key_power_ready();
+    KEY_SELECT(0, 0);
+    WAIT_SELECT();
     for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
         for (uint8_t col = 0; col < MATRIX_COLS; col++) {
-            KEY_SELECT(row, col);
-            _delay_us(5);
-
             // Not sure this is needed. This just emulates HHKB controller's behaviour.
             if (matrix_prev[row] & (1<<col)) {
                 KEY_PREV_ON();
             }
-            _delay_us(10);
+            WAIT_PREV();
 
             // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
             // If V-USB interrupts in this section we could lose 40us or so
@@ -101,10 +244,11 @@ uint8_t matrix_scan(void)
             // 10us wait doesn't work on tmk PCB(8MHz) with pro2(very lagged scan)
             _delay_us(5);
 
-            if (KEY_STATE()) {
-                matrix[row] &= ~(1<<col);
-            } else {
+            bool down = !KEY_STATE();
+            if (down) {
                 matrix[row] |= (1<<col);
+            } else {
+                matrix[row] &= ~(1<<col);
             }
 
             // Ignore if this code region execution time elapses more than 20us.
@@ -118,15 +262,20 @@ uint8_t matrix_scan(void)
             KEY_PREV_OFF();
             KEY_UNABLE();
 
+            // select next key to settle while KEY_STATE recovers
+            if (col + 1 < MATRIX_COLS) {
+                KEY_SELECT(row, col + 1);
+            } else if (row + 1 < MATRIX_ROWS) {
+                KEY_SELECT(row + 1, 0);
+            }
+
             // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
             // This takes 25us or more to make sure KEY_STATE returns to idle state.
-#ifdef HHKB_JP
-            // Looks like JP needs faster scan due to its twice larger matrix
-            // or it can drop keys in fast key typing
-            _delay_us(30);
-#else
-            _delay_us(75);
-#endif
+            if (down) {
+                WAIT_RECOVERY();
+            } else {
+                WAIT_IDLE();
+            }
         }
         if (matrix[row] ^ matrix_prev[row]) matrix_last_modified = timer_read32();
     }
@@ -147,9 +296,48 @@ matrix_row_t matrix_get_row(uint8_t row)
     return matrix[row];
 }
 
+/*
+ * Any key down for wakeup
+ * Stops at first key down, senses without hysteresis of previous state and
+ * with shorter recovery as HHKB JP does, about half time of matrix_scan().
+ * Switch board is powered off again if it was off for power saving.
+ */
+bool matrix_any_key_down(void)
+{
+    bool powered = KEY_POWER_STATE();
+    bool down = false;
+
+    key_power_ready();
+    for (uint8_t row = 0; row < MATRIX_ROWS && !down; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            KEY_SELECT(row, col);
+            _delay_us(5);
+
+            uint8_t last = TIMER_RAW;
+            KEY_ENABLE();
+            _delay_us(5);
+            down = !KEY_STATE();
+            // invalid when interrupted, see matrix_scan()
+            if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
+                down = false;
+            }
+            _delay_us(5);
+            KEY_UNABLE();
+            if (down) break;
+            _delay_us(30);
+        }
+    }
+    if (!powered) matrix_power_down();
+    return down;
+}
+
 void matrix_power_up(void) {
+    if (KEY_POWER_STATE()) return;
     KEY_POWER_ON();
+    power_on_time = timer_read();
+    power_warming = true;
 }
 void matrix_power_down(void) {
     KEY_POWER_OFF();
+    power_warming = false;
 }
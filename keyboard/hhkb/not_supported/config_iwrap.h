@@ -34,11 +34,63 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* key combination for command */
 #define IS_COMMAND() (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) 
 
-/* pins for Software UART */
-#define SUART_IN_PIN    PINC
-#define SUART_IN_BIT    5
-#define SUART_OUT_PORT  PORTC
-#define SUART_OUT_BIT   4
+/* Software Serial for iWRAP: 19200bps, RX PC5/PCINT13 and TX PC4
+ * TX bits are sent by Timer1 compare interrupt from queue and received bytes
+ * go to MUX decoder of iwrap.c */
+#define SERIAL_SOFT_BAUD            19200
+#define SERIAL_SOFT_PARITY_NONE
+#define SERIAL_SOFT_BIT_ORDER_LSB
+#define SERIAL_RX_CALLBACK
+/* RXD Port */
+#define SERIAL_SOFT_RXD_DDR         DDRC
+#define SERIAL_SOFT_RXD_PORT        PORTC
+#define SERIAL_SOFT_RXD_PIN         PINC
+#define SERIAL_SOFT_RXD_BIT         5
+#define SERIAL_SOFT_RXD_VECT        PCINT1_vect
+#define SERIAL_SOFT_RXD_INIT()      do { \
+    /* pin configuration: input with pull-up */ \
+    SERIAL_SOFT_RXD_DDR &= ~(1<<SERIAL_SOFT_RXD_BIT); \
+    SERIAL_SOFT_RXD_PORT |= (1<<SERIAL_SOFT_RXD_BIT); \
+    PCMSK1 |= (1<<PCINT13); \
+    PCICR  |= (1<<PCIE1); \
+    sei(); \
+} while (0)
+/* pin change of start bit, mask the interrupt while receiving */
+#define SERIAL_SOFT_RXD_INT_ENTER() do { \
+    PCMSK1 &= ~(1<<PCINT13); \
+} while (0)
+#define SERIAL_SOFT_RXD_INT_EXIT()  do { \
+    PCIFR = (1<<PCIF1); \
+    PCMSK1 |= (1<<PCINT13); \
+} while (0)
+#define SERIAL_SOFT_RXD_READ()      (SERIAL_SOFT_RXD_PIN&(1<<SERIAL_SOFT_RXD_BIT))
+/* TXD Port */
+#define SERIAL_SOFT_TXD_DDR         DDRC
+#define SERIAL_SOFT_TXD_PORT        PORTC
+#define SERIAL_SOFT_TXD_PIN         PINC
+#define SERIAL_SOFT_TXD_BIT         4
+#define SERIAL_SOFT_TXD_HI()        do { SERIAL_SOFT_TXD_PORT |=  (1<<SERIAL_SOFT_TXD_BIT); } while (0)
+#define SERIAL_SOFT_TXD_LO()        do { SERIAL_SOFT_TXD_PORT &= ~(1<<SERIAL_SOFT_TXD_BIT); } while (0)
+#define SERIAL_SOFT_TXD_INIT()      do { \
+    /* pin configuration: output, idle(hi) */ \
+    SERIAL_SOFT_TXD_PORT |= (1<<SERIAL_SOFT_TXD_BIT); \
+    SERIAL_SOFT_TXD_DDR |= (1<<SERIAL_SOFT_TXD_BIT); \
+} while (0)
+/* TXD Timer: Timer1 CTC at bit period, clk/8 */
+#define SERIAL_SOFT_TXD_VECT        TIMER1_COMPA_vect
+#define SERIAL_SOFT_TXD_TIMER_INIT() do { \
+    TCCR1A = 0; \
+    TCCR1B = (1<<WGM12) | (1<<CS11); \
+    OCR1A = (F_CPU/8/SERIAL_SOFT_BAUD) - 1; \
+} while (0)
+#define SERIAL_SOFT_TXD_TIMER_ON()  do { \
+    TCNT1 = 0; \
+    TIFR1 = (1<<OCF1A); \
+    TIMSK1 |= (1<<OCIE1A); \
+} while (0)
+#define SERIAL_SOFT_TXD_TIMER_OFF() do { \
+    TIMSK1 &= ~(1<<OCIE1A); \
+} while (0)
 
 
 #define DEBUG_LED 1
@@ -1,6 +1,7 @@
 RN42_DIR = rn42
 
 SRC +=  serial_uart.c \
+	serial_frame.c \
 	rn42/suart.S \
 	rn42/rn42.c \
 	rn42/rn42_task.c \
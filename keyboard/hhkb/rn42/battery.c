@@ -1,8 +1,63 @@
 #include <avr/io.h>
 #include <util/delay.h>
+#include "timer.h"
 #include "battery.h"
 
 
+/*
+ * Voltage monitor
+ *
+ * Conversion runs in background from battery_task(): divider and ADC are
+ * enabled, conversion starts after S/H capacitance is charged and result is
+ * taken on a later pass. Voltage is moving average of BATTERY_AVERAGE samples
+ * so that low voltage detection doesn't flicker. Voltage is sampled less often
+ * while USB powered since it is driven by charger then.
+ */
+#ifndef BATTERY_SAMPLE_INTERVAL
+#define BATTERY_SAMPLE_INTERVAL             1000
+#endif
+#ifndef BATTERY_SAMPLE_INTERVAL_POWERED
+#define BATTERY_SAMPLE_INTERVAL_POWERED     10000
+#endif
+#define BATTERY_AVERAGE     8
+
+static enum {
+    ADC_IDLE,
+    ADC_SETTLE,
+    ADC_CONVERT,
+} adc_state = ADC_IDLE;
+static uint16_t adc_time = 0;
+static uint16_t samples[BATTERY_AVERAGE];
+static uint16_t samples_sum = 0;
+static uint8_t samples_head = 0;
+
+static void adc_enable(void)
+{
+    // ADC enable voltate divider(PF4)
+    DDRF  |=  (1<<4);
+    PORTF |=  (1<<4);
+    ADCSRA |= (1<<ADEN);
+}
+
+static uint16_t adc_disable(void)
+{
+    uint16_t bat = ADC;
+    ADCSRA &= ~(1<<ADEN);
+
+    // ADC disable voltate divider(PF4)
+    DDRF  |=  (1<<4);
+    PORTF &= ~(1<<4);
+    return bat;
+}
+
+static void sample_add(uint16_t adc)
+{
+    samples_sum += adc - samples[samples_head];
+    samples[samples_head] = adc;
+    samples_head = (samples_head + 1) % BATTERY_AVERAGE;
+}
+
+
 /*
  * Battery
  */
@@ -28,6 +83,49 @@ void battery_init(void)
     // ADC disable voltate divider(PF4)
     DDRF  |=  (1<<4);
     PORTF &= ~(1<<4);
+
+    // first sample fills average, later ones are taken in background
+    adc_enable();
+    _delay_ms(1);   // wait for charging S/H capacitance
+    ADCSRA |= (1<<ADSC);
+    while (ADCSRA & (1<<ADSC)) ;
+    uint16_t bat = adc_disable();
+    for (uint8_t i = 0; i < BATTERY_AVERAGE; i++) {
+        sample_add(bat);
+    }
+}
+
+void battery_task(void)
+{
+    static uint16_t sample_time = 0;
+    switch (adc_state) {
+        case ADC_IDLE:
+            if (timer_elapsed(sample_time) < ((USBSTA&(1<<VBUS)) ?
+                        BATTERY_SAMPLE_INTERVAL_POWERED : BATTERY_SAMPLE_INTERVAL)) {
+                break;
+            }
+            sample_time = adc_time = timer_read();
+            adc_enable();
+            adc_state = ADC_SETTLE;
+            break;
+        case ADC_SETTLE:
+            // wait for charging S/H capacitance, 1ms at least
+            if (timer_elapsed(adc_time) < 2) break;
+            ADCSRA |= (1<<ADSC);
+            adc_state = ADC_CONVERT;
+            break;
+        case ADC_CONVERT:
+            if (ADCSRA & (1<<ADSC)) break;
+            sample_add(adc_disable());
+            adc_state = ADC_IDLE;
+            break;
+    }
+}
+
+bool battery_busy(void)
+{
+    // ADC doesn't run in power down sleep
+    return adc_state != ADC_IDLE;
 }
 
 // Indicator for battery
@@ -83,30 +181,23 @@ bool battery_charging(void)
     return charging;
 }
 
-// Returns voltage in mV
+// Returns average voltage in mV
 uint16_t battery_voltage(void)
 {
-    // ADC disable voltate divider(PF4)
-    DDRF  |=  (1<<4);
-    PORTF |=  (1<<4);
-
-    volatile uint16_t bat;
-    ADCSRA |= (1<<ADEN);
-    _delay_ms(1);   // wait for charging S/H capacitance
-
-    ADCSRA |= (1<<ADSC);
-    while (ADCSRA & (1<<ADSC)) ;
-    bat = ADC;
-
-    ADCSRA &= ~(1<<ADEN);
-
-    // ADC disable voltate divider(PF4)
-    DDRF  |=  (1<<4);
-    PORTF &= ~(1<<4);
-
+    uint16_t bat = samples_sum / BATTERY_AVERAGE;
     return (bat - BATTERY_ADC_OFFSET) * BATTERY_ADC_RESOLUTION;
 }
 
+// Returns charge in percent, linear in voltage between empty and full
+uint8_t battery_level(void)
+{
+    uint16_t v = battery_voltage();
+    if (v <= BATTERY_VOLTAGE_EMPTY) return 0;
+    if (v >= BATTERY_VOLTAGE_FULL) return 100;
+    return (uint32_t)(v - BATTERY_VOLTAGE_EMPTY) * 100 /
+           (BATTERY_VOLTAGE_FULL - BATTERY_VOLTAGE_EMPTY);
+}
+
 static bool low_voltage(void) {
     static bool low = false;
     uint16_t v = battery_voltage();
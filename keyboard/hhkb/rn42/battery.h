@@ -21,13 +21,18 @@ typedef enum {
 
 /* Battery API */
 void battery_init(void);
+void battery_task(void);
+bool battery_busy(void);
 void battery_led(battery_led_t val);
 bool battery_charging(void);
 uint16_t battery_voltage(void);
+uint8_t battery_level(void);
 battery_status_t battery_status(void);
 
 #define BATTERY_VOLTAGE_LOW_LIMIT       3500
 #define BATTERY_VOLTAGE_LOW_RECOVERY    3700
+#define BATTERY_VOLTAGE_EMPTY           3300
+#define BATTERY_VOLTAGE_FULL            4100
 // ADC offset:16, resolution:5mV
 #define BATTERY_ADC_OFFSET              16
 #define BATTERY_ADC_RESOLUTION          5
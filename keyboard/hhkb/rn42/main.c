@@ -2,6 +2,7 @@
 #include <avr/power.h>
 #include <avr/wdt.h>
 #include "lufa.h"
+#include "host.h"
 #include "print.h"
 #include "sendchar.h"
 #include "rn42.h"
@@ -14,6 +15,7 @@
 #include "wait.h"
 #include "suart.h"
 #include "suspend.h"
+#include "battery.h"
 
 static int8_t sendchar_func(uint8_t c)
 {
@@ -90,6 +92,7 @@ int main(void)
             suspend_power_down();
             suspend_power_down();
             if (USB_Device_RemoteWakeupEnabled && suspend_wakeup_condition()) {
+                    keyboard_wakeup_keys();
                     USB_Device_SendRemoteWakeup();
             }
         }
@@ -101,5 +104,13 @@ int main(void)
 #endif
 
         rn42_task();
+
+        // sleep between scans while Bluetooth link is idle
+        if (host_get_driver() == &rn42_driver && rn42_power_idle() && !battery_busy()) {
+            suspend_power_down();
+        } else {
+            // scan at full rate again as soon as link is active
+            suspend_power_down_reset();
+        }
     }
 }
@@ -1,9 +1,12 @@
+#include <string.h>
 #include <avr/io.h>
 #include "host.h"
 #include "host_driver.h"
 #include "serial.h"
+#include "serial_frame.h"
 #include "rn42.h"
 #include "print.h"
+#include "debug.h"
 #include "timer.h"
 #include "wait.h"
 
@@ -132,7 +135,7 @@ bool rn42_linked(void)
 
 static uint8_t leds = 0;
 static uint8_t keyboard_leds(void) { return leds; }
-void rn42_set_leds(uint8_t l) { leds = l; }
+void rn42_set_leds(uint8_t l) { leds = l; host_keyboard_leds_changed(); }
 
 
 void rn42_send_str(const char *str)
@@ -162,44 +165,157 @@ void rn42_print_response(void)
 }
 
 
+/*
+ * Power management
+ *
+ * Link is idle when no report is sent for RN42_IDLE_TIMEOUT, RN42 then goes
+ * to sniff or deep sleep by itself as configured with SW command and MCU may
+ * sleep between scans. First report after that pulses CTS to wake RN42 from
+ * deep sleep, the report is held in TX queue while CTS is high instead of
+ * waiting for it here. Wake latency is measured until RN42 is ready(RTS low).
+ */
+#ifndef RN42_IDLE_TIMEOUT
+#define RN42_IDLE_TIMEOUT   5000
+#endif
+#ifndef RN42_WAKE_TIME
+#define RN42_WAKE_TIME      5
+#endif
+static enum {
+    RN42_ACTIVE,
+    RN42_IDLE,
+    RN42_WAKING,
+} power_state = RN42_ACTIVE;
+static uint16_t report_time = 0;
+static uint16_t wake_time = 0;
+static uint16_t wake_latency = 0;
+
+static void power_report(void)
+{
+    report_time = timer_read();
+    if (power_state == RN42_IDLE) {
+        PORTD |= (1<<5);    // wake from deep sleep, TX is held while high
+        wake_time = report_time;
+        power_state = RN42_WAKING;
+    }
+}
+
+void rn42_power_task(void)
+{
+    switch (power_state) {
+        case RN42_ACTIVE:
+            if (timer_elapsed(report_time) > RN42_IDLE_TIMEOUT) {
+                power_state = RN42_IDLE;
+            }
+            break;
+        case RN42_WAKING:
+            if (timer_elapsed(wake_time) < RN42_WAKE_TIME) break;
+            if (PORTD & (1<<5)) {
+                PORTD &= ~(1<<5);
+                serial_send_task();
+            }
+            if (rn42_rts()) break;
+            wake_latency = timer_elapsed(wake_time);
+            dprintf("rn42: wake %ums\n", wake_latency);
+            power_state = RN42_ACTIVE;
+            break;
+        default:
+            break;
+    }
+}
+
+bool rn42_power_idle(void)
+{
+    return power_state == RN42_IDLE;
+}
+
+uint16_t rn42_wake_latency(void)
+{
+    return wake_latency;
+}
+
+
 static void send_keyboard(report_keyboard_t *report)
 {
-    // wake from deep sleep
+    power_report();
+
+    uint8_t *f = serial_frame_alloc(SERIAL_FRAME_KEYBOARD, 11);
+    f[0] = 0xFD;        // Raw report mode
+    f[1] = 9;           // length
+    f[2] = 1;           // descriptor type
+    f[3] = report->mods;
+    f[4] = 0x00;
+    memcpy(&f[5], report->keys, 6);
+    serial_frame_task();
+}
+
 /*
-    PORTD |= (1<<5);    // high
-    wait_ms(5);
-    PORTD &= ~(1<<5);   // low
-*/
-
-    serial_send(0xFD);  // Raw report mode
-    serial_send(9);     // length
-    serial_send(1);     // descriptor type
-    serial_send(report->mods);
-    serial_send(0x00);
-    serial_send(report->keys[0]);
-    serial_send(report->keys[1]);
-    serial_send(report->keys[2]);
-    serial_send(report->keys[3]);
-    serial_send(report->keys[4]);
-    serial_send(report->keys[5]);
+ * Mouse report rate limit
+ *
+ * Motion is merged and sent once in RN42_MOUSE_INTERVAL so that mouse takes
+ * bounded share of the link, button change is sent at once. Report without
+ * motion nor button change is dropped. Motion waits for rn42_task() after
+ * keyboard_task() so that key reports of the scan go out before it.
+ */
+#ifndef RN42_MOUSE_INTERVAL
+#define RN42_MOUSE_INTERVAL 10
+#endif
+static report_mouse_t mouse_report = {};    // buttons sent and motion merged since
+static bool mouse_pending = false;
+static uint16_t mouse_time = 0;
+
+static bool mouse_merge(report_mouse_t *report)
+{
+    int16_t x = mouse_report.x + report->x;
+    int16_t y = mouse_report.y + report->y;
+    int16_t v = mouse_report.v + report->v;
+    if (x < -127 || x > 127 || y < -127 || y > 127 || v < -127 || v > 127)
+        return false;
+    mouse_report.x = x;
+    mouse_report.y = y;
+    mouse_report.v = v;
+    if (report->x || report->y || report->v)
+        mouse_pending = true;
+    return true;
+}
+
+static void mouse_flush(void)
+{
+    power_report();
+
+    uint8_t *f = serial_frame_alloc(SERIAL_FRAME_MOUSE, 7);
+    f[0] = 0xFD;        // Raw report mode
+    f[1] = 5;           // length
+    f[2] = 2;           // descriptor type
+    f[3] = mouse_report.buttons;
+    f[4] = mouse_report.x;
+    f[5] = mouse_report.y;
+    f[6] = mouse_report.v;
+    serial_frame_task();
+
+    mouse_report.x = mouse_report.y = mouse_report.v = 0;
+    mouse_pending = false;
+    mouse_time = timer_read();
 }
 
 static void send_mouse(report_mouse_t *report)
 {
-    // wake from deep sleep
-/*
-    PORTD |= (1<<5);    // high
-    wait_ms(5);
-    PORTD &= ~(1<<5);   // low
-*/
-
-    serial_send(0xFD);  // Raw report mode
-    serial_send(5);     // length
-    serial_send(2);     // descriptor type
-    serial_send(report->buttons);
-    serial_send(report->x);
-    serial_send(report->y);
-    serial_send(report->v);
+    if (!mouse_merge(report)) {
+        // sum overflows, send earlier motion first
+        mouse_flush();
+        mouse_merge(report);
+    }
+    if (report->buttons != mouse_report.buttons) {
+        mouse_report.buttons = report->buttons;
+        mouse_flush();
+    }
+}
+
+/* send motion merged when its interval has passed */
+void rn42_mouse_task(void)
+{
+    if (mouse_pending && timer_elapsed(mouse_time) >= RN42_MOUSE_INTERVAL) {
+        mouse_flush();
+    }
 }
 
 static void send_system(uint16_t data)
@@ -235,11 +351,15 @@ static uint16_t usage2bits(uint16_t usage)
 static void send_consumer(uint16_t data)
 {
     uint16_t bits = usage2bits(data);
-    serial_send(0xFD);  // Raw report mode
-    serial_send(3);     // length
-    serial_send(3);     // descriptor type
-    serial_send(bits&0xFF);
-    serial_send((bits>>8)&0xFF);
+    power_report();
+
+    uint8_t *f = serial_frame_alloc(SERIAL_FRAME_CONSUMER, 5);
+    f[0] = 0xFD;        // Raw report mode
+    f[1] = 3;           // length
+    f[2] = 3;           // descriptor type
+    f[3] = bits&0xFF;
+    f[4] = (bits>>8)&0xFF;
+    serial_frame_task();
 }
 
 
@@ -20,6 +20,10 @@ void rn42_cts_hi(void);
 void rn42_cts_lo(void);
 bool rn42_linked(void);
 void rn42_set_leds(uint8_t l);
+void rn42_mouse_task(void);
+void rn42_power_task(void);
+bool rn42_power_idle(void);
+uint16_t rn42_wake_latency(void);
 
 const char *rn42_send_command(const char *cmd);
 void rn42_send_str(const char *str);
@@ -4,6 +4,7 @@
 #include <avr/eeprom.h>
 #include "keycode.h"
 #include "serial.h"
+#include "serial_frame.h"
 #include "host.h"
 #include "action.h"
 #include "action_util.h"
@@ -72,34 +73,52 @@ void rn42_task(void)
         }
     }
 
+    rn42_mouse_task();
+    rn42_power_task();
+
+    // send what RN42 held off with RTS
+    serial_send_task();
+    serial_frame_task();
+
     /* Switch between USB and Bluetooth */
     if (!config_mode) { // not switch while config mode
         if (!force_usb && !rn42_rts()) {
             if (host_get_driver() != &rn42_driver) {
-                clear_keyboard();
+                host_switch_driver(&rn42_driver);
 #ifdef NKRO_ENABLE
                 rn42_nkro_last = keyboard_nkro;
                 keyboard_nkro = false;
+                reformat_keyboard_report(rn42_nkro_last);
 #endif
-                host_set_driver(&rn42_driver);
             }
         } else {
             if (host_get_driver() != &lufa_driver) {
-                clear_keyboard();
+                host_switch_driver(&lufa_driver);
 #ifdef NKRO_ENABLE
+                bool nkro = keyboard_nkro;
                 keyboard_nkro = rn42_nkro_last;
+                reformat_keyboard_report(nkro);
 #endif
-                host_set_driver(&lufa_driver);
             }
         }
     }
 
+    /* keys held are replayed once new host can receive */
+    if (host_driver_pending()) {
+        if (host_get_driver() == &rn42_driver ? rn42_linked() :
+                USB_DeviceState == DEVICE_STATE_Configured) {
+            host_driver_ready();
+        }
+    }
+
+
+    battery_task();
 
-    static uint16_t prev_timer = 0;
-    uint16_t e = timer_elapsed(prev_timer);
-    if (e > 1000) {
-        /* every second */
-        prev_timer += e/1000*1000;
+    static uint32_t prev_timer = 0;
+    uint32_t e = timer_elapsed32(prev_timer);
+    if (e >= 1000) {
+        /* every second, in phase with ms tick after suspend as well */
+        prev_timer += e - e % 1000;
 
         /* Low voltage alert */
         uint8_t bs = battery_status();
@@ -116,7 +135,7 @@ void rn42_task(void)
             uint8_t h = t/3600;
             uint8_t m = t%3600/60;
             uint8_t s = t%60;
-            dprintf("%02u:%02u:%02u\t%umV\n", h, m, s, v);
+            dprintf("%02u:%02u:%02u\t%umV\t%u%%\n", h, m, s, v, battery_level());
             /* TODO: xprintf doesn't work for this.
             xprintf("%02u:%02u:%02u\t%umV\n", (t/3600), (t%3600/60), (t%60), v);
             */
@@ -320,7 +339,7 @@ bool command_extra(uint8_t code)
                 case LOW_VOLTAGE:   xprintf("LOW"); break;
                 default:            xprintf("?"); break;
             };
-            xprintf("\n");
+            xprintf(" %u%%\n", battery_level());
             xprintf("RemoteWakeupEnabled: %X\n", USB_Device_RemoteWakeupEnabled);
             xprintf("VBUS: %X\n", USBSTA&(1<<VBUS));
             t = timer_read32()/1000;
@@ -340,7 +359,7 @@ bool command_extra(uint8_t code)
             // battery monitor
             t = timer_read32()/1000;
             b = battery_voltage();
-            xprintf("BAT: %umV\t", b);
+            xprintf("BAT: %umV %u%%\t", b, battery_level());
             xprintf("%02u:",   t/3600);
             xprintf("%02u:",   t%3600/60);
             xprintf("%02u\n",  t%60);
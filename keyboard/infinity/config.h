@@ -43,4 +43,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* Version 1.1a of the board */
 //#define INFINITY_LED
 
+/* IS31FL3731 of 1.1a, see is31fl3731.h */
+#define IS31_SDB_PIN    PTB16       // hardware shutdown, high to run
+#define IS31_FPS        60
+
 #endif
@@ -0,0 +1,195 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "MK20D5.h"
+#include "i2c_api.h"
+#include "gpio_api.h"
+#include "PinNames.h"
+#include "timer.h"
+#include "is31fl3731.h"
+#include "ramfunc.h"
+
+
+/* registers */
+#define COMMAND             0xFD        // page select
+#define PAGE_FUNCTION       0x0B
+#define FRAME_LED_CONTROL   0x00
+#define FRAME_PWM           0x24
+#define FUNC_CONFIG         0x00
+#define FUNC_PICTURE        0x01
+#define FUNC_SHUTDOWN       0x0A
+
+/* changed blocks of framebuffer */
+#define BLOCK               8
+#define BLOCKS              (IS31_LEDS / BLOCK)
+
+#define SLA_W               (IS31_ADDR << 1)
+
+
+static uint8_t pwm[IS31_LEDS];
+static volatile uint32_t dirty = (1UL << BLOCKS) - 1;
+
+/* frame on the bus: runs of blocks and position in them */
+static struct {
+    uint8_t start;
+    uint8_t end;
+} runs[BLOCKS / 2 + 1];
+static uint8_t run_count;
+static uint8_t run;
+static enum {
+    TX_ADDR,        // slave address is going out, register of run is next
+    TX_DATA,
+} tx_state;
+static uint8_t tx_pos;
+static volatile bool busy = false;
+
+static i2c_t i2c;
+
+
+static void reg_write(uint8_t reg, uint8_t data)
+{
+    char buf[2] = { reg, data };
+    i2c_write(&i2c, SLA_W, buf, 2, 1);
+}
+
+void is31_init(void)
+{
+#ifdef IS31_SDB_PIN
+    // out of hardware shutdown
+    gpio_t sdb;
+    gpio_init_out_ex(&sdb, IS31_SDB_PIN, 1);
+#endif
+    i2c_init(&i2c, PTB1, PTB0);
+    i2c_frequency(&i2c, IS31_I2C_FREQ);
+
+    // picture mode of frame 0
+    reg_write(COMMAND, PAGE_FUNCTION);
+    reg_write(FUNC_SHUTDOWN, 0x00);
+    reg_write(FUNC_CONFIG, 0x00);
+    reg_write(FUNC_PICTURE, 0x00);
+
+    // all LEDs on with PWM of framebuffer, blink off
+    reg_write(COMMAND, 0x00);
+    char buf[1 + FRAME_PWM];
+    buf[0] = FRAME_LED_CONTROL;
+    for (uint8_t i = 0; i < FRAME_PWM; i++) {
+        buf[1 + i] = (i < 0x12) ? 0xFF : 0x00;
+    }
+    i2c_write(&i2c, SLA_W, buf, sizeof(buf), 1);
+
+    reg_write(COMMAND, PAGE_FUNCTION);
+    reg_write(FUNC_SHUTDOWN, 0x01);
+    // frame 0 stays selected for PWM bursts
+    reg_write(COMMAND, 0x00);
+
+    i2c.i2c->C1 |= I2C_C1_IICIE_MASK;
+    NVIC_EnableIRQ(I2C0_IRQn);
+}
+
+void is31_set(uint8_t led, uint8_t value)
+{
+    if (led >= IS31_LEDS || pwm[led] == value) return;
+    pwm[led] = value;
+    dirty |= 1UL << (led / BLOCK);
+}
+
+uint8_t is31_get(uint8_t led)
+{
+    return (led < IS31_LEDS) ? pwm[led] : 0;
+}
+
+bool is31_busy(void)
+{
+    return busy;
+}
+
+__attribute__ ((weak))
+void is31_frame(uint16_t time)
+{
+}
+
+
+static void start_run(void)
+{
+    tx_state = TX_ADDR;
+    tx_pos = runs[run].start * BLOCK;
+    I2C0->D = SLA_W;
+}
+
+/* one byte per interrupt, runs are chained with repeated start */
+RAMFUNC
+void I2C0_IRQHandler(void)
+{
+    I2C0->S = I2C_S_IICIF_MASK;
+
+    if (I2C0->S & I2C_S_RXAK_MASK) {
+        // no ack, send whole frame next time
+        I2C0->C1 &= ~(I2C_C1_MST_MASK | I2C_C1_TX_MASK);
+        dirty = (1UL << BLOCKS) - 1;
+        busy = false;
+        return;
+    }
+
+    if (tx_state == TX_ADDR) {
+        tx_state = TX_DATA;
+        I2C0->D = FRAME_PWM + tx_pos;
+    } else if (tx_pos < runs[run].end * BLOCK) {
+        I2C0->D = pwm[tx_pos++];
+    } else if (++run < run_count) {
+        I2C0->C1 |= I2C_C1_RSTA_MASK;
+        start_run();
+    } else {
+        I2C0->C1 &= ~(I2C_C1_MST_MASK | I2C_C1_TX_MASK);
+        busy = false;
+    }
+}
+
+void is31_task(void)
+{
+    static uint16_t frame_time;
+
+    if (busy || timer_elapsed(frame_time) < 1000 / IS31_FPS) return;
+    frame_time = timer_read();
+
+    is31_frame(frame_time);
+
+    // runs of changed blocks, blocks changed from here on go to next frame
+    __disable_irq();
+    uint32_t d = dirty;
+    dirty = 0;
+    __enable_irq();
+    if (!d) return;
+
+    run_count = 0;
+    for (uint8_t b = 0; b < BLOCKS; b++) {
+        if (!(d & (1UL << b))) continue;
+        if (run_count && runs[run_count - 1].end == b) {
+            runs[run_count - 1].end = b + 1;
+        } else {
+            runs[run_count].start = b;
+            runs[run_count].end = b + 1;
+            run_count++;
+        }
+    }
+
+    busy = true;
+    run = 0;
+    I2C0->C1 |= I2C_C1_MST_MASK | I2C_C1_TX_MASK;      // START
+    start_run();
+}
@@ -0,0 +1,69 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IS31FL3731_H
+#define IS31FL3731_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * IS31FL3731 LED driver of Infinity 1.1a on I2C0(PTB0 SCL, PTB1 SDA)
+ *
+ * PWM of 144 LEDs is kept in RAM framebuffer. is31_task() runs frame hook
+ * every 1000/IS31_FPS ms and then sends only changed parts of framebuffer,
+ * each run of changed 8-byte blocks in one auto-increment burst. Bursts go
+ * out from I2C0 interrupt, one byte per interrupt, main loop never waits for
+ * the bus. At 400kHz whole frame takes 3.3ms of bus and interrupts of about
+ * 1us every 22us, scan and report of 1ms go on as usual.
+ *
+ * Framebuffer should be written from main loop. LED written while a frame is
+ * on the bus is sent in next frame.
+ */
+#ifndef IS31_ADDR
+#define IS31_ADDR           0x74        // AD pin to GND
+#endif
+#ifndef IS31_FPS
+#define IS31_FPS            60
+#endif
+#ifndef IS31_I2C_FREQ
+#define IS31_I2C_FREQ       400000
+#endif
+#define IS31_LEDS           144
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* setup of chip, blocks for a few ms at startup */
+void is31_init(void);
+/* framebuffer, 0-255 */
+void is31_set(uint8_t led, uint8_t pwm);
+uint8_t is31_get(uint8_t led);
+/* frame hook and sending of framebuffer, call from main loop */
+void is31_task(void);
+/* a frame is on the bus */
+bool is31_busy(void);
+
+/* effects update framebuffer here at frame rate, time is timer_read() */
+void is31_frame(uint16_t time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,9 +17,26 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "stdint.h"
 #include "led.h"
+#ifdef INFINITY_LED
+#include "is31fl3731.h"
+#endif
+#ifdef LED_EFFECT_ENABLE
+#include "led_effect.h"
+#endif
 
 
-/* TODO: setup led support for 1.1a version of the board */
+/* Caps Lock on LED of IS31_CAPS_LOCK_LED(0-143) of 1.1a board */
 void led_set(uint8_t usb_led)
 {
+#if defined(INFINITY_LED) && defined(IS31_CAPS_LOCK_LED)
+    is31_set(IS31_CAPS_LOCK_LED, (usb_led & (1<<USB_LED_CAPS_LOCK)) ? 0xFF : 0);
+#endif
 }
+
+#if defined(INFINITY_LED) && defined(LED_EFFECT_ENABLE)
+/* effects of led_effect.c go to framebuffer, IS31FL3731 LED n is key n */
+void led_effect_write(uint8_t led, uint8_t value)
+{
+    is31_set(led, value);
+}
+#endif
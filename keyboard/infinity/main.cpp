@@ -10,6 +10,9 @@
 #include "host.h"
 #include "host_driver.h"
 #include "mbed_driver.h"
+#ifdef INFINITY_LED
+#include "is31fl3731.h"
+#endif
 
 
 int main() {
@@ -19,10 +22,16 @@ int main() {
     uint16_t t = 0;
 
     host_set_driver(&mbed_driver);
+#ifdef INFINITY_LED
+    is31_init();
+#endif
     keyboard_init();
 
     while(1) {
         keyboard_task();
+#ifdef INFINITY_LED
+        is31_task();
+#endif
 
         bool matrix_on = false;
         matrix_scan();
@@ -1,9 +1,12 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "gpio_api.h"
+#include "port_api.h"
+#include "us_ticker_api.h"
 #include "timer.h"
 #include "wait.h"
 #include "matrix.h"
+#include "ramfunc.h"
 
 
 #ifndef DEBOUNCE
@@ -18,7 +21,8 @@
  *     col: { PTD1, PTD2, PTD3, PTD4, PTD5, PTD6, PTD7 }
  *     row: { PTB0, PTB1, PTB2, PTB3, PTB16, PTB17, PTC4, PTC5, PTD0 }
  */
-static gpio_t col[MATRIX_COLS];
+/* columns are read at once from PTD1-7 */
+static port_t col_port;
 static gpio_t row[MATRIX_ROWS];
 
 /* matrix state(1:on, 0:off) */
@@ -31,13 +35,8 @@ static uint16_t debouncing_time = 0;
 void matrix_init(void)
 {
     /* Column(sense) */
-    gpio_init_in_ex(&col[0], PTD1, PullDown);
-    gpio_init_in_ex(&col[1], PTD2, PullDown);
-    gpio_init_in_ex(&col[2], PTD3, PullDown);
-    gpio_init_in_ex(&col[3], PTD4, PullDown);
-    gpio_init_in_ex(&col[4], PTD5, PullDown);
-    gpio_init_in_ex(&col[5], PTD6, PullDown);
-    gpio_init_in_ex(&col[6], PTD7, PullDown);
+    port_init(&col_port, PortD, 0xFE, PIN_INPUT);
+    port_mode(&col_port, PullDown);
 
 #ifndef INFINITY_LED
     /* Row(strobe) */
@@ -64,19 +63,21 @@ void matrix_init(void)
 #endif
 }
 
+RAMFUNC
 uint8_t matrix_scan(void)
 {
+    // strobe next row before work on current one to overlap settle time
+    gpio_write(&row[0], 1);
+    uint32_t strobe_time = us_ticker_read();
     for (int i = 0; i < MATRIX_ROWS; i++) {
-        matrix_row_t r = 0;
-
-        gpio_write(&row[i], 1);
-        wait_us(1); // need wait to settle pin state
-        for (int j = 0; j < MATRIX_COLS; j++) {
-            if (gpio_read(&col[j])) {
-                r |= (1<<j);
-            }
-        }
+        // need wait to settle pin state
+        while (us_ticker_read() - strobe_time <= 1) ;
+        matrix_row_t r = (port_read(&col_port) >> 1);
         gpio_write(&row[i], 0);
+        if (i + 1 < MATRIX_ROWS) {
+            gpio_write(&row[i + 1], 1);
+            strobe_time = us_ticker_read();
+        }
 
         if (matrix_debouncing[i] != r) {
             matrix_debouncing[i] = r;
@@ -6,6 +6,7 @@
 #include "wait.h"
 #include "print.h"
 #include "matrix.h"
+#include "matrix_port.h"
 
 
 /*
@@ -22,28 +23,26 @@ static matrix_row_t matrix_debouncing[MATRIX_ROWS];
 static bool debouncing = false;
 static uint16_t debouncing_time = 0;
 
+static const matrix_pin_t col_pins[MATRIX_COLS] = {
+    MATRIX_PIN(GPIOD, 1), MATRIX_PIN(GPIOD, 2), MATRIX_PIN(GPIOD, 3), MATRIX_PIN(GPIOD, 4),
+    MATRIX_PIN(GPIOD, 5), MATRIX_PIN(GPIOD, 6), MATRIX_PIN(GPIOD, 7),
+};
+static const matrix_pin_t row_pins[MATRIX_ROWS] = {
+    MATRIX_PIN(GPIOB, 0), MATRIX_PIN(GPIOB, 1), MATRIX_PIN(GPIOB, 2), MATRIX_PIN(GPIOB, 3),
+    MATRIX_PIN(GPIOB, 16), MATRIX_PIN(GPIOB, 17), MATRIX_PIN(GPIOC, 4), MATRIX_PIN(GPIOC, 5),
+    MATRIX_PIN(GPIOD, 0),
+};
+
 
 void matrix_init(void)
 {
     /* Column(sense) */
-    palSetPadMode(GPIOD, 1,  PAL_MODE_INPUT_PULLDOWN);
-    palSetPadMode(GPIOD, 2,  PAL_MODE_INPUT_PULLDOWN);
-    palSetPadMode(GPIOD, 3,  PAL_MODE_INPUT_PULLDOWN);
-    palSetPadMode(GPIOD, 4,  PAL_MODE_INPUT_PULLDOWN);
-    palSetPadMode(GPIOD, 5,  PAL_MODE_INPUT_PULLDOWN);
-    palSetPadMode(GPIOD, 6,  PAL_MODE_INPUT_PULLDOWN);
-    palSetPadMode(GPIOD, 7,  PAL_MODE_INPUT_PULLDOWN);
+    matrix_port_init(col_pins, PAL_MODE_INPUT_PULLDOWN, false);
 
     /* Row(strobe) */
-    palSetPadMode(GPIOB, 0,  PAL_MODE_OUTPUT_PUSHPULL);
-    palSetPadMode(GPIOB, 1,  PAL_MODE_OUTPUT_PUSHPULL);
-    palSetPadMode(GPIOB, 2,  PAL_MODE_OUTPUT_PUSHPULL);
-    palSetPadMode(GPIOB, 3,  PAL_MODE_OUTPUT_PUSHPULL);
-    palSetPadMode(GPIOB, 16, PAL_MODE_OUTPUT_PUSHPULL);
-    palSetPadMode(GPIOB, 17, PAL_MODE_OUTPUT_PUSHPULL);
-    palSetPadMode(GPIOC, 4,  PAL_MODE_OUTPUT_PUSHPULL);
-    palSetPadMode(GPIOC, 5,  PAL_MODE_OUTPUT_PUSHPULL);
-    palSetPadMode(GPIOD, 0,  PAL_MODE_OUTPUT_PUSHPULL);
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        palSetPadMode(row_pins[row].port, row_pins[row].pad, PAL_MODE_OUTPUT_PUSHPULL);
+    }
 
     memset(matrix, 0, MATRIX_ROWS);
     memset(matrix_debouncing, 0, MATRIX_ROWS);
@@ -51,38 +50,20 @@ void matrix_init(void)
 
 uint8_t matrix_scan(void)
 {
+    // strobe next row before work on current one to overlap settle time
+    palSetPad(row_pins[0].port, row_pins[0].pad);
+    matrix_port_settle_start();
     for (int row = 0; row < MATRIX_ROWS; row++) {
-        matrix_row_t data = 0;
-
-        // strobe row
-        switch (row) {
-            case 0: palSetPad(GPIOB, 0);    break;
-            case 1: palSetPad(GPIOB, 1);    break;
-            case 2: palSetPad(GPIOB, 2);    break;
-            case 3: palSetPad(GPIOB, 3);    break;
-            case 4: palSetPad(GPIOB, 16);   break;
-            case 5: palSetPad(GPIOB, 17);   break;
-            case 6: palSetPad(GPIOC, 4);    break;
-            case 7: palSetPad(GPIOC, 5);    break;
-            case 8: palSetPad(GPIOD, 0);    break;
-        }
-
-        wait_us(1); // need wait to settle pin state
+        matrix_port_settle_wait(1); // need wait to settle pin state
 
         // read col data
-        data = (palReadPort(GPIOD)>>1);
+        matrix_row_t data = matrix_port_read();
 
         // un-strobe row
-        switch (row) {
-            case 0: palClearPad(GPIOB, 0);    break;
-            case 1: palClearPad(GPIOB, 1);    break;
-            case 2: palClearPad(GPIOB, 2);    break;
-            case 3: palClearPad(GPIOB, 3);    break;
-            case 4: palClearPad(GPIOB, 16);   break;
-            case 5: palClearPad(GPIOB, 17);   break;
-            case 6: palClearPad(GPIOC, 4);    break;
-            case 7: palClearPad(GPIOC, 5);    break;
-            case 8: palClearPad(GPIOD, 0);    break;
+        palClearPad(row_pins[row].port, row_pins[row].pad);
+        if (row + 1 < MATRIX_ROWS) {
+            palSetPad(row_pins[row + 1].port, row_pins[row + 1].pad);
+            matrix_port_settle_start();
         }
 
         if (matrix_debouncing[row] != data) {
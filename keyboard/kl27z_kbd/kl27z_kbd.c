@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 #include "led.h"
 #include "keymap.h"
+#include "suspend.h"
 #include "timer.h"
 
 
@@ -194,6 +195,51 @@ void matrix_print(void)
 }
 
 
+//
+// Suspend
+//
+/* Rows are all strobed and falling edge of any column wakes MCU from deep
+ * sleep, see common/chibios/suspend.c. Ports B-E share interrupt on KL27Z256.
+ */
+#define PCR_IRQC_MASK       (0xFUL << 16)
+#define PCR_IRQC_FALLING    (0xAUL << 16)
+
+static PORT_TypeDef * const col_port[MATRIX_COLS] = {
+    PORTD, PORTD, PORTD, PORTD, PORTA, PORTA, PORTA, PORTA, PORTA, PORTE, PORTE, PORTE, PORTE, PORTE
+};
+static const uint8_t col_pad[MATRIX_COLS] = {
+    6,     5,     4,     3,     19,    18,    4,     2,     1,     25,    24,    30,    29,    21
+};
+
+bool suspend_pin_wakeup(void)
+{
+    palClearPad(GPIOB, 3);
+    palClearPad(GPIOB, 16);
+    palClearPad(GPIOB, 17);
+    palClearPad(GPIOC, 0);
+    palClearPad(GPIOC, 1);
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        col_port[col]->PCR[col_pad[col]] = (col_port[col]->PCR[col_pad[col]] & ~PCR_IRQC_MASK) | PCR_IRQC_FALLING;
+    }
+    return true;
+}
+
+void matrix_power_up(void)
+{
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        col_port[col]->PCR[col_pad[col]] &= ~PCR_IRQC_MASK;
+    }
+    PORTA->ISFR = 0xFFFFFFFF;
+    PORTD->ISFR = 0xFFFFFFFF;
+    PORTE->ISFR = 0xFFFFFFFF;
+    palSetPad(GPIOB, 3);
+    palSetPad(GPIOB, 16);
+    palSetPad(GPIOB, 17);
+    palSetPad(GPIOC, 0);
+    palSetPad(GPIOC, 1);
+}
+
+
 //
 // LED
 //
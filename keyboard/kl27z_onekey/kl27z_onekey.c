@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 #include "led.h"
 #include "keymap.h"
+#include "suspend.h"
 
 
 inline
@@ -79,6 +80,26 @@ void matrix_print(void)
 {
 }
 
+
+//
+// Suspend
+//
+/* falling edge of key pin wakes MCU from deep sleep, see common/chibios/suspend.c */
+#define PCR_IRQC_MASK       (0xFUL << 16)
+#define PCR_IRQC_FALLING    (0xAUL << 16)
+
+bool suspend_pin_wakeup(void)
+{
+    PORTA->PCR[4] = (PORTA->PCR[4] & ~PCR_IRQC_MASK) | PCR_IRQC_FALLING;
+    return true;
+}
+
+void matrix_power_up(void)
+{
+    PORTA->PCR[4] &= ~PCR_IRQC_MASK;
+    PORTA->ISFR = (1UL << 4);
+}
+
 void led_set(uint8_t usb_led) {
     if (usb_led & (1<<USB_LED_CAPS_LOCK)) {
         // output high
@@ -37,6 +37,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* Set 0 if debouncing isn't needed */
 #define DEBOUNCE    5
 
+/* latency benchmark pulse with BENCH_GPIO_ENABLE */
+#define BENCH_GPIO_PORT PORTD
+#define BENCH_GPIO_DDR  DDRD
+#define BENCH_GPIO_BIT  4
+
 /* Mechanical locking support. Use KC_LCAP, KC_LNUM or KC_LSCR instead in keymap */
 #define LOCKING_SUPPORT_ENABLE
 /* Locking resynchronize hack */
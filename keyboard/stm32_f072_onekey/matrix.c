@@ -26,6 +26,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "matrix.h"
 #include "wait.h"
+#ifdef MATRIX_DMA_ENABLE
+#   include "debounce.h"
+#   include "matrix_dma.h"
+#endif
 
 #ifndef DEBOUNCE
 #   define DEBOUNCE 5
@@ -36,10 +40,19 @@ static uint8_t debouncing = DEBOUNCE;
 static matrix_row_t matrix[MATRIX_ROWS];
 static matrix_row_t matrix_debouncing[MATRIX_ROWS];
 
+#define COL_MODE    PAL_MODE_INPUT
+
+#ifdef MATRIX_DMA_ENABLE
+/* column pads of DMA port, in column order */
+static const uint8_t col_pads[MATRIX_COLS] = { GPIOA_BUTTON };
+#endif
+
+#ifndef MATRIX_DMA_ENABLE
 static matrix_row_t read_cols(void);
 static void init_cols(void);
 static void unselect_rows(void);
 static void select_row(uint8_t row);
+#endif
 
 
 inline
@@ -60,9 +73,15 @@ uint8_t matrix_cols(void)
 
 void matrix_init(void)
 {
+#ifdef MATRIX_DMA_ENABLE
+    // DMA scans rows and columns in background from now on
+    matrix_dma_init(NULL, NULL, GPIOA, col_pads, COL_MODE, false);
+    debounce_init();
+#else
     // initialize row and col
     unselect_rows();
     init_cols();
+#endif
 
     // initialize matrix state: all keys off
     for (uint8_t i=0; i < MATRIX_ROWS; i++) {
@@ -79,6 +98,10 @@ void matrix_init(void)
 
 uint8_t matrix_scan(void)
 {
+#ifdef MATRIX_DMA_ENABLE
+    bool changed = matrix_dma_read(matrix_debouncing);
+    debounce(matrix_debouncing, matrix, changed);
+#else
     for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
         select_row(i);
         wait_us(30);  // without this wait read unstable value.
@@ -102,6 +125,7 @@ uint8_t matrix_scan(void)
             }
         }
     }
+#endif
 
     return 1;
 }
@@ -128,12 +152,13 @@ void matrix_print(void)
     }
 }
 
+#ifndef MATRIX_DMA_ENABLE
 /* Column pin configuration
  */
 static void  init_cols(void)
 {
     // don't need pullup/down, since it's pulled down in hardware
-    palSetPadMode(GPIOA, GPIOA_BUTTON, PAL_MODE_INPUT);
+    palSetPadMode(GPIOA, GPIOA_BUTTON, COL_MODE);
 }
 
 /* Returns status of switches(1:on, 0:off) */
@@ -161,3 +186,4 @@ static void select_row(uint8_t row)
     //         break;
     // }
 }
+#endif
@@ -26,6 +26,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "matrix.h"
 #include "wait.h"
+#include "matrix_port.h"
+#include "ramfunc.h"
 
 #ifndef DEBOUNCE
 #   define DEBOUNCE 5
@@ -36,9 +38,9 @@ static uint8_t debouncing = DEBOUNCE;
 static matrix_row_t matrix[MATRIX_ROWS];
 static matrix_row_t matrix_debouncing[MATRIX_ROWS];
 
-static matrix_row_t read_cols(void);
 static void init_cols(void);
 static void unselect_rows(void);
+static void unselect_row(uint8_t row);
 static void select_row(uint8_t row);
 
 
@@ -77,12 +79,20 @@ void matrix_init(void)
     LED_OFF();
 }
 
+RAMFUNC
 uint8_t matrix_scan(void)
 {
+    // select next row before work on current one to overlap settle time
+    select_row(0);
+    matrix_port_settle_start();
     for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        select_row(i);
-        wait_us(30);  // without this wait read unstable value.
-        matrix_row_t cols = read_cols();
+        matrix_port_settle_wait(30);  // without this wait read unstable value.
+        matrix_row_t cols = matrix_port_read();
+        unselect_row(i);
+        if (i + 1 < MATRIX_ROWS) {
+            select_row(i + 1);
+            matrix_port_settle_start();
+        }
         if (matrix_debouncing[i] != cols) {
             matrix_debouncing[i] = cols;
             if (debouncing) {
@@ -90,7 +100,6 @@ uint8_t matrix_scan(void)
             }
             debouncing = DEBOUNCE;
         }
-        unselect_rows();
     }
 
     if (debouncing) {
@@ -130,92 +139,58 @@ void matrix_print(void)
 
 /* Column pin configuration
  */
-static void  init_cols(void)
-{
-    // internal pull-up
-    palSetPadMode(TEENSY_PIN6_IOPORT , TEENSY_PIN6,  PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN7_IOPORT , TEENSY_PIN7,  PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN8_IOPORT , TEENSY_PIN8,  PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN9_IOPORT , TEENSY_PIN9,  PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN10_IOPORT, TEENSY_PIN10, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN11_IOPORT, TEENSY_PIN11, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN12_IOPORT, TEENSY_PIN12, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN14_IOPORT, TEENSY_PIN14, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN15_IOPORT, TEENSY_PIN15, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN16_IOPORT, TEENSY_PIN16, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN17_IOPORT, TEENSY_PIN17, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN18_IOPORT, TEENSY_PIN18, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN19_IOPORT, TEENSY_PIN19, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN20_IOPORT, TEENSY_PIN20, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN21_IOPORT, TEENSY_PIN21, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN22_IOPORT, TEENSY_PIN22, PAL_MODE_INPUT_PULLUP);
-    palSetPadMode(TEENSY_PIN23_IOPORT, TEENSY_PIN23, PAL_MODE_INPUT_PULLUP);
-}
+static const matrix_pin_t col_pins[MATRIX_COLS] = {
+    MATRIX_PIN(TEENSY_PIN6_IOPORT, TEENSY_PIN6),
+    MATRIX_PIN(TEENSY_PIN7_IOPORT, TEENSY_PIN7),
+    MATRIX_PIN(TEENSY_PIN8_IOPORT, TEENSY_PIN8),
+    MATRIX_PIN(TEENSY_PIN9_IOPORT, TEENSY_PIN9),
+    MATRIX_PIN(TEENSY_PIN10_IOPORT, TEENSY_PIN10),
+    MATRIX_PIN(TEENSY_PIN11_IOPORT, TEENSY_PIN11),
+    MATRIX_PIN(TEENSY_PIN12_IOPORT, TEENSY_PIN12),
+    MATRIX_PIN(TEENSY_PIN14_IOPORT, TEENSY_PIN14),
+    MATRIX_PIN(TEENSY_PIN15_IOPORT, TEENSY_PIN15),
+    MATRIX_PIN(TEENSY_PIN16_IOPORT, TEENSY_PIN16),
+    MATRIX_PIN(TEENSY_PIN17_IOPORT, TEENSY_PIN17),
+    MATRIX_PIN(TEENSY_PIN18_IOPORT, TEENSY_PIN18),
+    MATRIX_PIN(TEENSY_PIN19_IOPORT, TEENSY_PIN19),
+    MATRIX_PIN(TEENSY_PIN20_IOPORT, TEENSY_PIN20),
+    MATRIX_PIN(TEENSY_PIN21_IOPORT, TEENSY_PIN21),
+    MATRIX_PIN(TEENSY_PIN22_IOPORT, TEENSY_PIN22),
+    MATRIX_PIN(TEENSY_PIN23_IOPORT, TEENSY_PIN23),
+};
 
-/* Returns status of switches(1:on, 0:off) */
-static matrix_row_t read_cols(void)
+static void  init_cols(void)
 {
-    return (
-          ((palReadPad(TEENSY_PIN6_IOPORT , TEENSY_PIN6 )==PAL_HIGH) ? 0 : (1<<0))
-        | ((palReadPad(TEENSY_PIN7_IOPORT , TEENSY_PIN7 )==PAL_HIGH) ? 0 : (1<<1))
-        | ((palReadPad(TEENSY_PIN8_IOPORT , TEENSY_PIN8 )==PAL_HIGH) ? 0 : (1<<2))
-        | ((palReadPad(TEENSY_PIN9_IOPORT , TEENSY_PIN9 )==PAL_HIGH) ? 0 : (1<<3))
-        | ((palReadPad(TEENSY_PIN10_IOPORT, TEENSY_PIN10)==PAL_HIGH) ? 0 : (1<<4))
-        | ((palReadPad(TEENSY_PIN11_IOPORT, TEENSY_PIN11)==PAL_HIGH) ? 0 : (1<<5))
-        | ((palReadPad(TEENSY_PIN12_IOPORT, TEENSY_PIN12)==PAL_HIGH) ? 0 : (1<<6))
-        | ((palReadPad(TEENSY_PIN14_IOPORT, TEENSY_PIN14)==PAL_HIGH) ? 0 : (1<<7))
-        | ((palReadPad(TEENSY_PIN15_IOPORT, TEENSY_PIN15)==PAL_HIGH) ? 0 : (1<<8))
-        | ((palReadPad(TEENSY_PIN16_IOPORT, TEENSY_PIN16)==PAL_HIGH) ? 0 : (1<<9))
-        | ((palReadPad(TEENSY_PIN17_IOPORT, TEENSY_PIN17)==PAL_HIGH) ? 0 : (1<<10))
-        | ((palReadPad(TEENSY_PIN18_IOPORT, TEENSY_PIN18)==PAL_HIGH) ? 0 : (1<<11))
-        | ((palReadPad(TEENSY_PIN19_IOPORT, TEENSY_PIN19)==PAL_HIGH) ? 0 : (1<<12))
-        | ((palReadPad(TEENSY_PIN20_IOPORT, TEENSY_PIN20)==PAL_HIGH) ? 0 : (1<<13))
-        | ((palReadPad(TEENSY_PIN21_IOPORT, TEENSY_PIN21)==PAL_HIGH) ? 0 : (1<<14))
-        | ((palReadPad(TEENSY_PIN22_IOPORT, TEENSY_PIN22)==PAL_HIGH) ? 0 : (1<<15))
-        | ((palReadPad(TEENSY_PIN23_IOPORT, TEENSY_PIN23)==PAL_HIGH) ? 0 : (1<<16))
-    );
+    // internal pull-up, switch pulls low
+    matrix_port_init(col_pins, PAL_MODE_INPUT_PULLUP, true);
 }
 
 /* Row pin configuration
  */
+static const matrix_pin_t row_pins[MATRIX_ROWS] = {
+    MATRIX_PIN(TEENSY_PIN5_IOPORT, TEENSY_PIN5),
+    MATRIX_PIN(TEENSY_PIN4_IOPORT, TEENSY_PIN4),
+    MATRIX_PIN(TEENSY_PIN3_IOPORT, TEENSY_PIN3),
+    MATRIX_PIN(TEENSY_PIN2_IOPORT, TEENSY_PIN2),
+    MATRIX_PIN(TEENSY_PIN1_IOPORT, TEENSY_PIN1),
+    MATRIX_PIN(TEENSY_PIN0_IOPORT, TEENSY_PIN0),
+};
+
 static void unselect_rows(void)
 {
-    palSetPadMode(TEENSY_PIN5_IOPORT, TEENSY_PIN5, PAL_MODE_INPUT);
-    palSetPadMode(TEENSY_PIN4_IOPORT, TEENSY_PIN4, PAL_MODE_INPUT);
-    palSetPadMode(TEENSY_PIN3_IOPORT, TEENSY_PIN3, PAL_MODE_INPUT);
-    palSetPadMode(TEENSY_PIN2_IOPORT, TEENSY_PIN2, PAL_MODE_INPUT);
-    palSetPadMode(TEENSY_PIN1_IOPORT, TEENSY_PIN1, PAL_MODE_INPUT);
-    palSetPadMode(TEENSY_PIN0_IOPORT, TEENSY_PIN0, PAL_MODE_INPUT);
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        unselect_row(i);
+    }
+}
+
+static void unselect_row(uint8_t row)
+{
+    palSetPadMode(row_pins[row].port, row_pins[row].pad, PAL_MODE_INPUT);
 }
 
 static void select_row(uint8_t row)
 {
-    (void)row;
     // Output low to select
-    switch (row) {
-        case 0:
-            palSetPadMode(TEENSY_PIN5_IOPORT, TEENSY_PIN5, PAL_MODE_OUTPUT_PUSHPULL);
-            palClearPad(TEENSY_PIN5_IOPORT, TEENSY_PIN5);
-            break;
-        case 1:
-            palSetPadMode(TEENSY_PIN4_IOPORT, TEENSY_PIN4, PAL_MODE_OUTPUT_PUSHPULL);
-            palClearPad(TEENSY_PIN4_IOPORT, TEENSY_PIN4);
-            break;
-        case 2:
-            palSetPadMode(TEENSY_PIN3_IOPORT, TEENSY_PIN3, PAL_MODE_OUTPUT_PUSHPULL);
-            palClearPad(TEENSY_PIN3_IOPORT, TEENSY_PIN3);
-            break;
-        case 3:
-            palSetPadMode(TEENSY_PIN2_IOPORT, TEENSY_PIN2, PAL_MODE_OUTPUT_PUSHPULL);
-            palClearPad(TEENSY_PIN2_IOPORT, TEENSY_PIN2);
-            break;
-        case 4:
-            palSetPadMode(TEENSY_PIN1_IOPORT, TEENSY_PIN1, PAL_MODE_OUTPUT_PUSHPULL);
-            palClearPad(TEENSY_PIN1_IOPORT, TEENSY_PIN1);
-            break;
-        case 5:
-            palSetPadMode(TEENSY_PIN0_IOPORT, TEENSY_PIN0, PAL_MODE_OUTPUT_PUSHPULL);
-            palClearPad(TEENSY_PIN0_IOPORT, TEENSY_PIN0);
-            break;
-    }
+    palSetPadMode(row_pins[row].port, row_pins[row].pad, PAL_MODE_OUTPUT_PUSHPULL);
+    palClearPad(row_pins[row].port, row_pins[row].pad);
 }
@@ -11,6 +11,8 @@ SRC +=	$(COMMON_DIR)/host.c \
 	$(COMMON_DIR)/debug.c \
 	$(COMMON_DIR)/util.c \
 	$(COMMON_DIR)/hook.c \
+	$(COMMON_DIR)/debounce.c \
+	$(COMMON_DIR)/deadline.c \
 	$(COMMON_DIR)/avr/suspend.c \
 	$(COMMON_DIR)/avr/xprintf.S \
 	$(COMMON_DIR)/avr/timer.c \
@@ -31,6 +33,33 @@ else
     endif
 endif
 
+ifeq (yes,$(strip $(DYNAMIC_KEYMAP_ENABLE)))
+    ifneq (,$(filter yes,$(strip $(UNIMAP_ENABLE)) $(strip $(ACTIONMAP_ENABLE))))
+        $(error DYNAMIC_KEYMAP_ENABLE supports only keymaps of keycode)
+    endif
+    SRC += $(COMMON_DIR)/dynamic_keymap.c
+    OPT_DEFS += -DDYNAMIC_KEYMAP_ENABLE
+endif
+
+ifeq (yes,$(strip $(COMBO_ENABLE)))
+    SRC += $(COMMON_DIR)/action_combo.c
+    OPT_DEFS += -DCOMBO_ENABLE
+endif
+
+ifeq (yes,$(strip $(LEADER_ENABLE)))
+    SRC += $(COMMON_DIR)/action_leader.c
+    OPT_DEFS += -DLEADER_ENABLE
+endif
+
+ifeq (yes,$(strip $(MACRO_PACK_ENABLE)))
+    OPT_DEFS += -DMACRO_PACK_ENABLE
+endif
+
+ifeq (yes,$(strip $(STENO_ENABLE)))
+    SRC += $(COMMON_DIR)/steno.c
+    OPT_DEFS += -DSTENO_ENABLE
+endif
+
 ifeq (yes,$(strip $(BOOTMAGIC_ENABLE)))
     SRC += $(COMMON_DIR)/bootmagic.c
     SRC += $(COMMON_DIR)/avr/eeconfig.c
@@ -48,6 +77,7 @@ ifeq (yes,$(strip $(EXTRAKEY_ENABLE)))
 endif
 
 ifeq (yes,$(strip $(CONSOLE_ENABLE)))
+    SRC += $(COMMON_DIR)/console_command.c
     OPT_DEFS += -DCONSOLE_ENABLE
 else
     OPT_DEFS += -DNO_PRINT
@@ -80,9 +110,132 @@ endif
 ifeq (yes,$(strip $(BACKLIGHT_ENABLE)))
     SRC += $(COMMON_DIR)/backlight.c
     OPT_DEFS += -DBACKLIGHT_ENABLE
+    ifeq (yes,$(strip $(BACKLIGHT_PWM_ENABLE)))
+        SRC += $(COMMON_DIR)/avr/backlight_pwm.c
+        OPT_DEFS += -DBACKLIGHT_PWM_ENABLE
+    endif
+endif
+
+ifeq (yes,$(strip $(LED_EFFECT_ENABLE)))
+    SRC += $(COMMON_DIR)/led_effect.c
+    OPT_DEFS += -DLED_EFFECT_ENABLE
+endif
+
+ifeq (yes,$(strip $(LATENCY_TRACE_ENABLE)))
+    SRC += $(COMMON_DIR)/latency.c
+    OPT_DEFS += -DLATENCY_TRACE_ENABLE
+endif
+
+ifeq (yes,$(strip $(TELEMETRY_ENABLE)))
+    SRC += $(COMMON_DIR)/telemetry.c
+    OPT_DEFS += -DTELEMETRY_ENABLE
+endif
+
+ifeq (yes,$(strip $(TYPING_STAT_ENABLE)))
+    SRC += $(COMMON_DIR)/typing_stat.c
+    OPT_DEFS += -DTYPING_STAT_ENABLE
+endif
+
+ifeq (yes,$(strip $(TYPE_INJECT_ENABLE)))
+    ifneq (yes,$(strip $(CONSOLE_ENABLE)))
+        $(error TYPE_INJECT_ENABLE needs CONSOLE_ENABLE)
+    endif
+    SRC += $(COMMON_DIR)/type_inject.c
+    OPT_DEFS += -DTYPE_INJECT_ENABLE
+endif
+
+ifeq (yes,$(strip $(STRESS_ENABLE)))
+    SRC += $(COMMON_DIR)/stress.c
+    OPT_DEFS += -DSTRESS_ENABLE
+endif
+
+ifeq (yes,$(strip $(PROFILE_ENABLE)))
+    SRC += $(COMMON_DIR)/profile.c \
+           $(COMMON_DIR)/avr/profile.c
+    OPT_DEFS += -DPROFILE_ENABLE
+endif
+
+ifeq (yes,$(strip $(WATCHDOG_ENABLE)))
+    SRC += $(COMMON_DIR)/avr/watchdog.c
+    OPT_DEFS += -DWATCHDOG_ENABLE
+endif
+
+ifeq (yes,$(strip $(POLL_SYNC_ENABLE)))
+    SRC += $(COMMON_DIR)/poll_sync.c
+    OPT_DEFS += -DPOLL_SYNC_ENABLE
+endif
+
+ifeq (yes,$(strip $(RAM_USAGE_ENABLE)))
+    SRC += $(COMMON_DIR)/avr/ram_usage.c
+    OPT_DEFS += -DRAM_USAGE_ENABLE
+endif
+
+ifeq (yes,$(strip $(MICROBENCH_ENABLE)))
+    SRC += $(COMMON_DIR)/microbench.c
+    ifneq (yes,$(strip $(LATENCY_TRACE_ENABLE)))
+        SRC += $(COMMON_DIR)/latency.c
+    endif
+    OPT_DEFS += -DMICROBENCH_ENABLE
+endif
+
+ifeq (yes,$(strip $(BENCH_GPIO_ENABLE)))
+    OPT_DEFS += -DBENCH_GPIO_ENABLE
+endif
+
+ifeq (yes,$(strip $(EVENT_TRACE_ENABLE)))
+    SRC += $(COMMON_DIR)/event_trace.c
+    OPT_DEFS += -DEVENT_TRACE_ENABLE
+endif
+
+ifeq (yes,$(strip $(INPUT_TRACE_ENABLE)))
+    SRC += $(COMMON_DIR)/input_trace.c
+    OPT_DEFS += -DINPUT_TRACE_ENABLE
+endif
+
+ifeq (yes,$(strip $(IDLE_SLEEP_ENABLE)))
+    OPT_DEFS += -DIDLE_SLEEP_ENABLE
+endif
+
+ifeq (yes,$(strip $(GENERIC_MATRIX_ENABLE)))
+    SRC += $(COMMON_DIR)/avr/matrix_generic.c
+    OPT_DEFS += -DGENERIC_MATRIX_ENABLE
+endif
+
+ifeq (yes,$(strip $(SPI_MATRIX_ENABLE)))
+    ifeq (yes,$(strip $(GENERIC_MATRIX_ENABLE)))
+        $(error SPI_MATRIX_ENABLE can not be used with GENERIC_MATRIX_ENABLE)
+    endif
+    SRC += $(COMMON_DIR)/avr/matrix_spi.c
+    OPT_DEFS += -DSPI_MATRIX_ENABLE
+endif
+
+ifeq (yes,$(strip $(MCP23017_MATRIX_ENABLE)))
+    ifeq (yes,$(strip $(GENERIC_MATRIX_ENABLE)$(SPI_MATRIX_ENABLE)))
+        $(error MCP23017_MATRIX_ENABLE can not be used with GENERIC_MATRIX_ENABLE or SPI_MATRIX_ENABLE)
+    endif
+    SRC += $(COMMON_DIR)/avr/matrix_mcp23017.c
+    OPT_DEFS += -DMCP23017_MATRIX_ENABLE
+endif
+
+ifeq (yes,$(strip $(ANALOG_KEY_ENABLE)))
+    ifneq (,$(filter yes,$(strip $(GENERIC_MATRIX_ENABLE)) $(strip $(SPI_MATRIX_ENABLE)) $(strip $(MCP23017_MATRIX_ENABLE))))
+        $(error ANALOG_KEY_ENABLE can not be used with other matrix scanners)
+    endif
+    SRC += $(COMMON_DIR)/analog_key.c
+    SRC += $(COMMON_DIR)/avr/analog_key_adc.c
+    OPT_DEFS += -DANALOG_KEY_ENABLE
+endif
+
+ifeq (yes,$(strip $(KEYMAP_PACK_ENABLE)))
+    ifeq (yes,$(strip $(KEYMAP_SECTION_ENABLE)))
+        $(error KEYMAP_PACK_ENABLE can not be used with KEYMAP_SECTION_ENABLE)
+    endif
+    SRC += $(COMMON_DIR)/keymap_pack.c
+    OPT_DEFS += -DKEYMAP_PACK_ENABLE
 endif
 
 ifeq (yes,$(strip $(KEYMAP_SECTION_ENABLE)))
+    SRC += $(COMMON_DIR)/keymap_image.c
     OPT_DEFS += -DKEYMAP_SECTION_ENABLE
 
     ifeq ($(strip $(MCU)),atmega32u2)
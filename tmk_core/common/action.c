@@ -25,9 +25,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "action_tapping.h"
 #include "action_macro.h"
 #include "action_util.h"
+#include "action_combo.h"
+#include "action_leader.h"
 #include "action.h"
 #include "hook.h"
 #include "wait.h"
+#include "event_trace.h"
+#include "bench_gpio.h"
+#include "ramfunc.h"
+#include "typing_stat.h"
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -36,27 +42,56 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
+RAMFUNC
 void action_exec(keyevent_t event)
 {
     if (!IS_NOEVENT(event)) {
+        BENCH_GPIO_EVENT();
         dprint("\n---- action_exec: start -----\n");
         dprint("EVENT: "); debug_event(event); dprintln();
+        EVENT_TRACE(TRACE_KEY, event.key, event.pressed);
         hook_matrix_change(event);
+        typing_stat_key(event);
     }
 
+#ifdef COMBO_ENABLE
+    action_combo_process(event);
+#else
+    action_exec_event(event);
+#endif
+}
+
+/* event after combo engine, to tapping or to action directly */
+RAMFUNC
+void action_exec_event(keyevent_t event)
+{
     keyrecord_t record = { .event = event };
 
 #ifndef NO_ACTION_TAPPING
-    action_tapping_process(record);
+    action_tapping_process(&record);
 #else
     process_action(&record);
     if (!IS_NOEVENT(record.event)) {
-        dprint("processed: "); debug_record(record); dprintln();
+        dprint("processed: "); debug_record(&record); dprintln();
+        EVENT_TRACE(TRACE_PROCESSED, record.event.key, TRACE_TAP_ARG(record));
     }
 #endif
 }
 
+/* resolve action from keymap and process it */
 void process_action(keyrecord_t *record)
+{
+    if (IS_NOEVENT(record->event)) { return; }
+
+    action_t action = layer_switch_get_action(record->event);
+#ifndef NO_ACTION_TAPPING
+    record->action = action;
+#endif
+    process_record_action(record, action);
+}
+
+/* process action resolved already, tapping code looks it up only once */
+void process_record_action(keyrecord_t *record, action_t action)
 {
     keyevent_t event = record->event;
 #ifndef NO_ACTION_TAPPING
@@ -64,8 +99,15 @@ void process_action(keyrecord_t *record)
 #endif
 
     if (IS_NOEVENT(event)) { return; }
+    // action of release is resolved already, every path frees its entry here
+    if (!event.pressed) layer_switch_release(event.key);
+
+#ifdef LEADER_ENABLE
+    // keys of leader sequence and their releases
+    if (action_leader_process(record, action)) { return; }
+#endif
 
-    action_t action = layer_switch_get_action(event);
+    EVENT_TRACE(TRACE_ACTION, event.key, action.kind.id);
     dprint("ACTION: "); debug_action(action);
 #ifndef NO_ACTION_LAYER
     dprint(" layer_state: "); layer_debug();
@@ -192,9 +234,9 @@ void process_action(keyrecord_t *record)
                     break;
                 case PAGE_CONSUMER:
                     if (event.pressed) {
-                        host_consumer_send(action.usage.code);
+                        host_consumer_add(action.usage.code);
                     } else {
-                        host_consumer_send(0);
+                        host_consumer_del(action.usage.code);
                     }
                     break;
             }
@@ -224,7 +266,11 @@ void process_action(keyrecord_t *record)
                         case OP_BIT_AND: default_layer_and(bits | mask); break;
                         case OP_BIT_OR:  default_layer_or(bits | mask);  break;
                         case OP_BIT_XOR: default_layer_xor(bits | mask); break;
-                        case OP_BIT_SET: default_layer_and(mask); default_layer_or(bits); break;
+                        case OP_BIT_SET:
+                            layer_state_begin();
+                            default_layer_and(mask); default_layer_or(bits);
+                            layer_state_commit();
+                            break;
                     }
                 }
             } else {
@@ -238,7 +284,11 @@ void process_action(keyrecord_t *record)
                         case OP_BIT_AND: layer_and(bits | mask); break;
                         case OP_BIT_OR:  layer_or(bits | mask);  break;
                         case OP_BIT_XOR: layer_xor(bits | mask); break;
-                        case OP_BIT_SET: layer_and(mask); layer_or(bits); break;
+                        case OP_BIT_SET:
+                            layer_state_begin();
+                            layer_and(mask); layer_or(bits);
+                            layer_state_commit();
+                            break;
                     }
                 }
             }
@@ -339,6 +389,11 @@ void process_action(keyrecord_t *record)
             break;
 #endif
         case ACT_COMMAND:
+#ifdef LEADER_ENABLE
+            if (event.pressed && action.command.id == COMMAND_LEADER) {
+                action_leader_start();
+            }
+#endif
             break;
 #ifndef NO_ACTION_FUNCTION
         case ACT_FUNCTION:
@@ -430,7 +485,7 @@ void register_code(uint8_t code)
         host_system_send(KEYCODE2SYSTEM(code));
     }
     else if IS_CONSUMER(code) {
-        host_consumer_send(KEYCODE2CONSUMER(code));
+        host_consumer_add(KEYCODE2CONSUMER(code));
     }
 }
 
@@ -488,7 +543,7 @@ void unregister_code(uint8_t code)
         host_system_send(0);
     }
     else if IS_CONSUMER(code) {
-        host_consumer_send(0);
+        host_consumer_del(KEYCODE2CONSUMER(code));
     }
 }
 
@@ -539,8 +594,11 @@ bool is_tap_key(keyevent_t event)
 {
     if (IS_NOEVENT(event)) { return false; }
 
-    action_t action = layer_switch_get_action(event);
+    return is_tap_action(layer_switch_get_action(event));
+}
 
+bool is_tap_action(action_t action)
+{
     switch (action.kind.id) {
         case ACT_LMODS_TAP:
         case ACT_RMODS_TAP:
@@ -579,11 +637,11 @@ void debug_event(keyevent_t event)
     dprintf("%04X%c(%u)", (event.key.row<<8 | event.key.col), (event.pressed ? 'd' : 'u'), event.time);
 }
 
-void debug_record(keyrecord_t record)
+void debug_record(const keyrecord_t *record)
 {
-    debug_event(record.event);
+    debug_event(record->event);
 #ifndef NO_ACTION_TAPPING
-    dprintf(":%u%c", record.tap.count, (record.tap.interrupted ? '-' : ' '));
+    dprintf(":%u%c", record->tap.count, (record->tap.interrupted ? '-' : ' '));
 #endif
 }
 
@@ -38,19 +38,26 @@ typedef struct {
     uint8_t count       :4;
 } tap_t;
 
-/* Key event container for recording */
+/* Key event container for recording
+ * action is resolved from keymap once when tapping code decides what to do
+ * with the record and is carried with it, e.g. in tapping_key. */
 typedef struct {
     keyevent_t  event;
 #ifndef NO_ACTION_TAPPING
     tap_t tap;
+    action_t action;
 #endif
 } keyrecord_t;
 
 /* Execute action per keyevent */
 void action_exec(keyevent_t event);
+void action_exec_event(keyevent_t event);
 
 /* action for key */
 action_t action_for_key(uint8_t layer, keypos_t key);
+/* key is transparent on layer, looked up without side effect of action
+ * like bootloader jump of KC_BOOTLOADER, Fn keys count as not transparent */
+bool keymap_key_is_transparent(uint8_t layer, keypos_t key);
 
 /* macro */
 const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt);
@@ -58,8 +65,15 @@ const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt);
 /* user defined special function */
 void action_function(keyrecord_t *record, uint8_t id, uint8_t opt);
 
+/* tapping term(ms) of tap key in record, TAPPING_TERM by default */
+uint16_t action_tapping_term(keyrecord_t *record);
+
+/* TAPPING_MODE flags of tap key in record, TAPPING_MODE by default */
+uint8_t action_tapping_mode(keyrecord_t *record);
+
 /* Utilities for actions.  */
 void process_action(keyrecord_t *record);
+void process_record_action(keyrecord_t *record, action_t action);
 void register_code(uint8_t code);
 void unregister_code(uint8_t code);
 void type_code(uint8_t code);
@@ -70,10 +84,11 @@ void clear_keyboard(void);
 void clear_keyboard_but_mods(void);
 void layer_switch(uint8_t new_layer);
 bool is_tap_key(keyevent_t event);
+bool is_tap_action(action_t action);
 
 /* debug */
 void debug_event(keyevent_t event);
-void debug_record(keyrecord_t record);
+void debug_record(const keyrecord_t *record);
 void debug_action(action_t action);
 
 #ifdef __cplusplus
@@ -94,6 +94,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  * ACT_COMMAND(1110):
  * 1110|opt | id(8)      Built-in Command exec
+ * 1110|0000|0000 0001   Leader key
  *
  * ACT_FUNCTION(1111):
  * 1111| address(12)     Function?
@@ -308,7 +309,11 @@ enum backlight_opt {
 #define ACTION_BACKLIGHT_STEP()         ACTION(ACT_BACKLIGHT, BACKLIGHT_STEP << 8)
 #define ACTION_BACKLIGHT_LEVEL(level)   ACTION(ACT_BACKLIGHT, BACKLIGHT_LEVEL << 8 | level)
 /* Command */
-#define ACTION_COMMAND(id, opt)         ACTION(ACT_COMMAND,  (opt)<<8 | (addr))
+enum command_id {
+    COMMAND_LEADER = 1,
+};
+#define ACTION_COMMAND(id, opt)         ACTION(ACT_COMMAND,  (opt)<<8 | (id))
+#define ACTION_LEADER()                 ACTION_COMMAND(COMMAND_LEADER, 0)
 /* Function */
 enum function_opts {
     FUNC_TAP = 0x8,     /* indciates function is tappable */
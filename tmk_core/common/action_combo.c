@@ -0,0 +1,206 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "timer.h"
+#include "action.h"
+#include "action_combo.h"
+#include "deadline.h"
+
+#ifdef DEBUG_ACTION
+#include "debug.h"
+#else
+#include "nodebug.h"
+#endif
+
+
+#define KEY_BIT(key)        ((matrix_row_t)1 << (key).col)
+#define IN_MATRIX(key)      ((key).row < MATRIX_ROWS && (key).col < MATRIX_COLS)
+
+/* keys in any combo */
+static matrix_row_t member[MATRIX_ROWS];
+/* keys of combos run, still held */
+static matrix_row_t consumed[MATRIX_ROWS];
+
+/* presses held while they can make a combo, in order */
+static keyevent_t held[COMBO_KEYS];
+static uint8_t held_count = 0;
+
+/* combo pressed and its record */
+static int16_t active = -1;
+static keyrecord_t active_record;
+
+
+static inline uint8_t combo_count(uint16_t i)
+{
+    return pgm_read_byte(&combos[i].count);
+}
+
+static inline action_t combo_action(uint16_t i)
+{
+    return (action_t){ .code = pgm_read_word(&combos[i].action.code) };
+}
+
+static bool combo_has(uint16_t i, keypos_t key)
+{
+    for (uint8_t j = 0; j < combo_count(i); j++) {
+        if (pgm_read_byte(&combos[i].keys[j].row) == key.row &&
+            pgm_read_byte(&combos[i].keys[j].col) == key.col) return true;
+    }
+    return false;
+}
+
+void action_combo_init(void)
+{
+    for (uint16_t i = 0; combo_count(i); i++) {
+        for (uint8_t j = 0; j < combo_count(i); j++) {
+            keypos_t key = {
+                .row = pgm_read_byte(&combos[i].keys[j].row),
+                .col = pgm_read_byte(&combos[i].keys[j].col),
+            };
+            if (IN_MATRIX(key)) member[key.row] |= KEY_BIT(key);
+        }
+    }
+}
+
+static inline bool is_member(keypos_t key)
+{
+    return IN_MATRIX(key) && (member[key.row] & KEY_BIT(key));
+}
+
+/* combo of just the held keys, or -1; *wider is set when a larger combo
+ * has all of them */
+static int16_t held_match(bool *wider)
+{
+    int16_t exact = -1;
+    *wider = false;
+    for (uint16_t i = 0; combo_count(i); i++) {
+        if (combo_count(i) < held_count) continue;
+        uint8_t j;
+        for (j = 0; j < held_count && combo_has(i, held[j].key); j++) ;
+        if (j < held_count) continue;
+        if (combo_count(i) == held_count) {
+            if (exact < 0) exact = i;
+        } else {
+            *wider = true;
+        }
+    }
+    return exact;
+}
+
+static void combo_release(uint16_t time)
+{
+    if (active < 0) return;
+    dprintf("combo: %d up\n", active);
+    active_record.event.pressed = false;
+    active_record.event.time = time;
+    process_record_action(&active_record, combo_action(active));
+    active = -1;
+}
+
+static void combo_press(int16_t i)
+{
+    keyevent_t last = held[held_count - 1];
+
+    combo_release(last.time);
+    dprintf("combo: %d down\n", i);
+    for (uint8_t j = 0; j < held_count; j++) {
+        consumed[held[j].key.row] |= KEY_BIT(held[j].key);
+    }
+    held_count = 0;
+    active = i;
+    active_record = (keyrecord_t){ .event = last };
+    active_record.event.key = (keypos_t){
+        .row = pgm_read_byte(&combos[i].keys[0].row),
+        .col = pgm_read_byte(&combos[i].keys[0].col),
+    };
+    process_record_action(&active_record, combo_action(i));
+}
+
+/* oldest held press goes on as normal key */
+static void held_pass(void)
+{
+    keyevent_t e = held[0];
+    for (uint8_t j = 1; j < held_count; j++) held[j - 1] = held[j];
+    held_count--;
+    action_exec_event(e);
+}
+
+/*
+ * Run combo or let presses go once it is decided. With end no more key can
+ * join, e.g. key of no combo was pressed or a held key was released. Time
+ * is of current event, event times are odd(timer_read() | 1) and may be
+ * ahead of timer_read().
+ */
+static void held_resolve(bool end, uint16_t time)
+{
+    while (held_count) {
+        bool wider;
+        int16_t exact = held_match(&wider);
+        if (!end && wider && TIMER_DIFF_16(time, held[0].time) < COMBO_TERM) return;
+        if (exact >= 0) {
+            combo_press(exact);
+            return;
+        }
+        // oldest can't be in combo with the rest, following may start one
+        held_pass();
+    }
+}
+
+static void combo_process(keyevent_t event)
+{
+    if (IS_NOEVENT(event)) {
+        if (held_count) held_resolve(false, timer_read() | 1);
+        action_exec_event(event);
+        return;
+    }
+
+    if (event.pressed) {
+        if (!is_member(event.key)) {
+            if (held_count) held_resolve(true, event.time);
+            action_exec_event(event);
+            return;
+        }
+        if (held_count == COMBO_KEYS) held_resolve(false, event.time);
+        held[held_count++] = event;
+        held_resolve(false, event.time);
+        return;
+    }
+
+    // release
+    if (held_count) held_resolve(true, event.time);
+    if (IN_MATRIX(event.key) && (consumed[event.key.row] & KEY_BIT(event.key))) {
+        consumed[event.key.row] &= ~KEY_BIT(event.key);
+        if (active >= 0 && combo_has(active, event.key)) combo_release(event.time);
+        return;
+    }
+    action_exec_event(event);
+}
+
+void action_combo_process(keyevent_t event)
+{
+    combo_process(event);
+
+    // TICK resolves held keys at end of COMBO_TERM, its time is odd and can
+    // reach the term a ms before timer_read() does
+    if (held_count) {
+        deadline_set(DEADLINE_COMBO, held[0].time + COMBO_TERM - 1);
+    } else {
+        deadline_clear(DEADLINE_COMBO);
+    }
+}
@@ -0,0 +1,77 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ACTION_COMBO_H
+#define ACTION_COMBO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "progmem.h"
+#include "keyboard.h"
+#include "action_code.h"
+
+
+/*
+ * Combo(COMBO_ENABLE)
+ *
+ * Keys of a combo pressed together within COMBO_TERM run its action instead
+ * of their own, the action is released when one of the keys is released.
+ * Events go through combo engine in action_exec() before tapping:
+ *   - a key in no combo is looked up in bitmap made by action_combo_init()
+ *     and passes at once, except that presses held by the engine go first.
+ *   - a press of combo key is held while it can still be part of a combo.
+ *     Combo runs as soon as held keys match it and no larger combo has them,
+ *     otherwise at COMBO_TERM or at a key which can't join.
+ *   - held keys which make no combo go on as normal keys in their order and
+ *     with their own time, so tap keys still see the real timing.
+ * Action of combo is processed directly, like that of a tap key decided,
+ * with first key of the combo as its position.
+ *
+ * Keymap defines combos in PROGMEM, terminated with COMBO_END:
+ *     const combo_t combos[] PROGMEM = {
+ *         COMBO(ACTION_KEY(KC_ESC), COMBO_KEY(0, 1), COMBO_KEY(0, 2)),
+ *         COMBO_END
+ *     };
+ */
+#ifndef COMBO_TERM
+#define COMBO_TERM      50
+#endif
+/* keys of a combo at most */
+#ifndef COMBO_KEYS
+#define COMBO_KEYS      4
+#endif
+
+typedef struct {
+    action_t action;
+    uint8_t  count;
+    keypos_t keys[COMBO_KEYS];
+} combo_t;
+
+#define COMBO_KEY(r, c)     { .col = (c), .row = (r) }
+#define COMBO(act, ...)     { .action = act, \
+                              .count = sizeof((keypos_t[]){ __VA_ARGS__ }) / sizeof(keypos_t), \
+                              .keys = { __VA_ARGS__ } }
+#define COMBO_END           { .count = 0 }
+
+extern const combo_t combos[];
+
+#ifdef COMBO_ENABLE
+void action_combo_init(void);
+/* takes event from action_exec() and gives action_exec_event() those to process */
+void action_combo_process(keyevent_t event);
+#endif
+
+#endif
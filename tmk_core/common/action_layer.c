@@ -1,9 +1,12 @@
 #include <stdint.h>
+#include <string.h>
 #include "keyboard.h"
+#include "matrix.h"
 #include "action.h"
 #include "util.h"
 #include "action_layer.h"
 #include "hook.h"
+#include "event_trace.h"
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -12,6 +15,19 @@
 #endif
 
 
+/*
+ * Batch of layer changes
+ *
+ * Depth of nested layer_state_begin() and states at outermost begin to tell
+ * what changed on commit.
+ */
+static uint8_t batch_depth = 0;
+static uint32_t batch_default_layer_state;
+#ifndef NO_ACTION_LAYER
+static uint32_t batch_layer_state;
+#endif
+
+
 /* 
  * Default Layer State
  */
@@ -19,9 +35,15 @@ uint32_t default_layer_state = 0;
 
 static void default_layer_state_set(uint32_t state)
 {
+    if (batch_depth) {
+        default_layer_state = state;
+        return;
+    }
     debug("default_layer_state: ");
     default_layer_debug(); debug(" to ");
     default_layer_state = state;
+    layer_cache_clear();
+    EVENT_TRACE_LAYER(TRACE_DEFAULT_LAYER, default_layer_state);
     hook_default_layer_change(default_layer_state);
     default_layer_debug(); debug("\n");
 #ifdef NO_TRACK_KEY_PRESS
@@ -63,9 +85,15 @@ uint32_t layer_state = 0;
 
 static void layer_state_set(uint32_t state)
 {
+    if (batch_depth) {
+        layer_state = state;
+        return;
+    }
     dprint("layer_state: ");
     layer_debug(); dprint(" to ");
     layer_state = state;
+    layer_cache_clear();
+    EVENT_TRACE_LAYER(TRACE_LAYER, layer_state);
     hook_layer_change(layer_state);
     layer_debug(); dprintln();
 #ifdef NO_TRACK_KEY_PRESS
@@ -118,24 +146,162 @@ void layer_debug(void)
 #endif
 
 
+void layer_state_begin(void)
+{
+    if (batch_depth++) return;
+    batch_default_layer_state = default_layer_state;
+#ifndef NO_ACTION_LAYER
+    batch_layer_state = layer_state;
+#endif
+}
 
-/* return layer effective for key at this time */
-static uint8_t current_layer_for_key(keypos_t key)
+void layer_state_commit(void)
 {
+    if (!batch_depth || --batch_depth) return;
+
+    bool changed = false;
+    if (default_layer_state != batch_default_layer_state) {
+        changed = true;
+        EVENT_TRACE_LAYER(TRACE_DEFAULT_LAYER, default_layer_state);
+        hook_default_layer_change(default_layer_state);
+    }
 #ifndef NO_ACTION_LAYER
-    action_t action = ACTION_TRANSPARENT;
-    uint32_t layers = layer_state | default_layer_state;
-    /* check top layer first */
-    for (int8_t i = 31; i >= 0; i--) {
-        if (layers & (1UL<<i)) {
-            action = action_for_key(i, key);
-            if (action.code != (action_t)ACTION_TRANSPARENT.code) {
-                return i;
+    if (layer_state != batch_layer_state) {
+        changed = true;
+        EVENT_TRACE_LAYER(TRACE_LAYER, layer_state);
+        hook_layer_change(layer_state);
+    }
+#endif
+    if (!changed) return;
+
+    debug("layer_state_commit: "); default_layer_debug();
+#ifndef NO_ACTION_LAYER
+    debug(" "); layer_debug();
+#endif
+    debug("\n");
+    layer_cache_clear();
+#ifdef NO_TRACK_KEY_PRESS
+    clear_keyboard_but_mods(); // To avoid stuck keys
+#endif
+}
+
+
+
+#if !defined(NO_ACTION_LAYER) && !defined(NO_LAYER_CACHE)
+/*
+ * Layer cache
+ *
+ * Layer effective for each key is resolved on first press after layer state
+ * changes. Entry holds layer(bit0-4) and generation(bit5-7) of the cache,
+ * entry of other generation is stale and 0 is never valid.
+ */
+#define LAYER_CACHE_LAYER       0x1F
+#define LAYER_CACHE_GEN_SHIFT   5
+#define LAYER_CACHE_GEN_MAX     7
+static uint8_t layer_cache[MATRIX_ROWS][MATRIX_COLS] = {};
+static uint8_t layer_cache_gen = 1;
+
+void layer_cache_clear(void)
+{
+    if (++layer_cache_gen > LAYER_CACHE_GEN_MAX) {
+        layer_cache_gen = 1;
+        memset(layer_cache, 0, sizeof(layer_cache));
+    }
+}
+#endif
+
+
+#ifndef NO_ACTION_LAYER
+/*
+ * Rows of layers
+ *
+ * Bit of row in layer_rows[layer] is set when the layer has a non-transparent
+ * key on the row, keys of the row don't probe layers without it. Sparse
+ * overlay layers are then skipped with a bit test. Rows of a layer are taken
+ * from its whole keymap on first lookup while it is active, layer_rows_known
+ * has the layers taken. Keys are tested with keymap_key_is_transparent(),
+ * action of the key is looked up only when it is pressed. Only the lowest
+ * LAYER_ROWS_LAYERS layers have rows(sizeof(matrix_rows_t) bytes each), keys
+ * probe layers above them always.
+ */
+#ifndef LAYER_ROWS_LAYERS
+#define LAYER_ROWS_LAYERS   8
+#endif
+#if LAYER_ROWS_LAYERS > 32
+#   error "LAYER_ROWS_LAYERS must not exceed 32"
+#endif
+#if LAYER_ROWS_LAYERS < 32
+#define LAYER_ROWS_ABOVE    (~0UL << LAYER_ROWS_LAYERS)
+#else
+#define LAYER_ROWS_ABOVE    0UL
+#endif
+static matrix_rows_t layer_rows[LAYER_ROWS_LAYERS];
+static uint32_t layer_rows_known = LAYER_ROWS_ABOVE;
+
+static void layer_rows_take(uint32_t layers)
+{
+    while (layers) {
+        uint8_t i = biton32(layers);
+        for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+            for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+                if (!keymap_key_is_transparent(i, (keypos_t){ .row = r, .col = c })) {
+                    layer_rows[i] |= MATRIX_ROW_BIT(r);
+                    break;
+                }
             }
         }
+        layer_rows_known |= (1UL<<i);
+        layers &= ~(1UL<<i);
+    }
+}
+
+void layer_rows_clear(void)
+{
+    layer_rows_known = LAYER_ROWS_ABOVE;
+    memset(layer_rows, 0, sizeof(layer_rows));
+    layer_cache_clear();
+}
+
+/* search active layers from top for non-transparent action */
+static uint8_t resolve_layer_for_key(keypos_t key)
+{
+    uint32_t layers = layer_state | default_layer_state;
+    if (layers & ~layer_rows_known) {
+        layer_rows_take(layers & ~layer_rows_known);
+    }
+    uint32_t probe = layers & LAYER_ROWS_ABOVE;
+    for (uint8_t i = 0; i < LAYER_ROWS_LAYERS; i++) {
+        if (layer_rows[i] & MATRIX_ROW_BIT(key.row)) probe |= (1UL<<i);
+    }
+    layers &= probe;
+    while (layers) {
+        uint8_t i = biton32(layers);
+        action_t action = action_for_key(i, key);
+        if (action.code != (action_t)ACTION_TRANSPARENT.code) {
+            return i;
+        }
+        layers &= ~(1UL<<i);
     }
     /* fall back to layer 0 */
     return 0;
+}
+#endif
+
+/* return layer effective for key at this time */
+uint8_t current_layer_for_key(keypos_t key)
+{
+#ifndef NO_ACTION_LAYER
+#   ifndef NO_LAYER_CACHE
+    uint8_t *entry = &layer_cache[key.row][key.col];
+    if ((*entry >> LAYER_CACHE_GEN_SHIFT) == layer_cache_gen) {
+        return *entry & LAYER_CACHE_LAYER;
+    }
+    uint8_t layer = resolve_layer_for_key(key);
+    *entry = (layer_cache_gen << LAYER_CACHE_GEN_SHIFT) | layer;
+    return layer;
+#   else
+    return resolve_layer_for_key(key);
+#   endif
 #else
     return biton32(default_layer_state);
 #endif
@@ -143,21 +309,104 @@ static uint8_t current_layer_for_key(keypos_t key)
 
 
 #ifndef NO_TRACK_KEY_PRESS
-/* record layer on where key is pressed */
+/*
+ * Layer on where key is pressed
+ *
+ * Only keys held need it, so it is kept in a table of LAYER_PRESSED_KEYS
+ * held keys(5 bytes each) instead of a byte per key of matrix. Entry holds
+ * action resolved on press as well, release and is_tap_key() take it
+ * without keymap lookup and get the same action even if keymap is changed
+ * in the meantime. Lookup is repeated while release waits in tapping
+ * buffer, entry is freed when process_record_action() gets the release.
+ * Key released without entry, e.g. pressed while table was full, takes
+ * current layer as with NO_TRACK_KEY_PRESS. When table is full entry of a
+ * key which is up in matrix is reused, its release was lost.
+ * LAYER_PRESSED_KEYS 0 keeps a byte per key.
+ */
+#ifndef LAYER_PRESSED_KEYS
+#define LAYER_PRESSED_KEYS  16
+#endif
+#if LAYER_PRESSED_KEYS > 127
+#   error "LAYER_PRESSED_KEYS must not exceed 127"
+#endif
+#if LAYER_PRESSED_KEYS > 0
+#define LAYER_PRESSED_FREE  0xFF
+static struct {
+    keypos_t key;
+    uint8_t layer;
+    action_t action;
+} layer_pressed[LAYER_PRESSED_KEYS] = {
+    [0 ... LAYER_PRESSED_KEYS - 1] = { .layer = LAYER_PRESSED_FREE }
+};
+
+static int8_t layer_pressed_find(keypos_t key)
+{
+    for (uint8_t i = 0; i < LAYER_PRESSED_KEYS; i++) {
+        if (layer_pressed[i].layer != LAYER_PRESSED_FREE &&
+                KEYEQ(layer_pressed[i].key, key)) return i;
+    }
+    return -1;
+}
+
+static void layer_pressed_put(keypos_t key, uint8_t layer, action_t action)
+{
+    int8_t i = layer_pressed_find(key);
+    for (uint8_t j = 0; i < 0 && j < LAYER_PRESSED_KEYS; j++) {
+        if (layer_pressed[j].layer == LAYER_PRESSED_FREE) i = j;
+    }
+    for (uint8_t j = 0; i < 0 && j < LAYER_PRESSED_KEYS; j++) {
+        if (!matrix_is_on(layer_pressed[j].key.row, layer_pressed[j].key.col)) i = j;
+    }
+    if (i < 0) {
+        dprint("layer_pressed: full\n");
+        return;
+    }
+    layer_pressed[i].key = key;
+    layer_pressed[i].layer = layer;
+    layer_pressed[i].action = action;
+}
+
+static action_t layer_pressed_get(keypos_t key)
+{
+    int8_t i = layer_pressed_find(key);
+    if (i < 0) return action_for_key(current_layer_for_key(key), key);
+    return layer_pressed[i].action;
+}
+#else
 static uint8_t layer_pressed[MATRIX_ROWS][MATRIX_COLS] = {};
 #endif
+#endif
+
+void layer_switch_release(keypos_t key)
+{
+#if !defined(NO_TRACK_KEY_PRESS) && LAYER_PRESSED_KEYS > 0
+    int8_t i = layer_pressed_find(key);
+    if (i >= 0) layer_pressed[i].layer = LAYER_PRESSED_FREE;
+#else
+    (void)key;
+#endif
+}
+
 action_t layer_switch_get_action(keyevent_t event)
 {
     if (IS_NOEVENT(event)) return (action_t)ACTION_NO;
 
     uint8_t layer = 0;
 #ifndef NO_TRACK_KEY_PRESS
+#   if LAYER_PRESSED_KEYS > 0
+    if (!event.pressed) return layer_pressed_get(event.key);
+    layer = current_layer_for_key(event.key);
+    action_t action = action_for_key(layer, event.key);
+    layer_pressed_put(event.key, layer, action);
+    return action;
+#   else
     if (event.pressed) {
         layer = current_layer_for_key(event.key);
         layer_pressed[event.key.row][event.key.col] = layer;
     } else {
         layer = layer_pressed[event.key.row][event.key.col];
     }
+#   endif
 #else
     layer = current_layer_for_key(event.key);
 #endif
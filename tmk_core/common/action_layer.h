@@ -22,6 +22,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "action.h"
 
 
+/* layer cache takes a byte of RAM per key of matrix, it is off by default on
+ * matrix over 128 keys, e.g. 32x8 of converters, unless LAYER_CACHE_ENABLE */
+#if !defined(NO_LAYER_CACHE) && !defined(LAYER_CACHE_ENABLE) && \
+        MATRIX_ROWS * MATRIX_COLS > 128
+#   define NO_LAYER_CACHE
+#endif
+
 /*
  * Default Layer
  */
@@ -55,7 +62,39 @@ void layer_xor(uint32_t state);
 #endif
 
 
+/* Batch of layer changes
+ *
+ * Changes of default and keymap layer state between begin and commit update
+ * the state only, commit then clears layer cache and calls hooks once for
+ * state changed in the batch. Only with NO_TRACK_KEY_PRESS it sends a report,
+ * once from clear_keyboard_but_mods() as each layer change does. Can be
+ * nested, outermost commit takes effect. Actions of keys must not be looked up inbetween.
+ */
+void layer_state_begin(void);
+void layer_state_commit(void);
+
+
+/* forget layers resolved for keys */
+#if !defined(NO_ACTION_LAYER) && !defined(NO_LAYER_CACHE)
+void layer_cache_clear(void);
+#else
+#define layer_cache_clear()
+#endif
+
+/* forget rows of layers with non-transparent keys and layers resolved for
+ * keys, call this when keymap itself is changed */
+#ifndef NO_ACTION_LAYER
+void layer_rows_clear(void);
+#else
+#define layer_rows_clear()
+#endif
+
+/* return layer effective for key at this time */
+uint8_t current_layer_for_key(keypos_t key);
+
 /* return action depending on current layer status */
 action_t layer_switch_get_action(keyevent_t key);
+/* release of key is processed, layer on where it was pressed is dropped */
+void layer_switch_release(keypos_t key);
 
 #endif
@@ -0,0 +1,178 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "timer.h"
+#include "keycode.h"
+#include "action.h"
+#include "action_leader.h"
+#include "deadline.h"
+
+#ifdef DEBUG_ACTION
+#include "debug.h"
+#else
+#include "nodebug.h"
+#endif
+
+/* generated from leader_sequences[] by tool/leader_trie */
+#include "leader_trie_data.h"
+
+
+#define KEY_BIT(key)        ((matrix_row_t)1 << (key).col)
+#define IN_MATRIX(key)      ((key).row < MATRIX_ROWS && (key).col < MATRIX_COLS)
+
+static bool active = false;
+static uint16_t node;
+static uint16_t last_time;
+
+/* presses used by leader, still held */
+static matrix_row_t consumed[MATRIX_ROWS];
+
+
+static inline uint8_t node_id(uint16_t n)
+{
+    return pgm_read_byte(&leader_node_id[n]);
+}
+
+static inline bool node_is_leaf(uint16_t n)
+{
+    return pgm_read_word(&leader_node_edges[n]) == pgm_read_word(&leader_node_edges[n + 1]);
+}
+
+/* child of node on keycode, edges are sorted by keycode; 0 is none, root is
+ * child of no node */
+static uint16_t node_child(uint16_t n, uint8_t code)
+{
+    uint16_t lo = pgm_read_word(&leader_node_edges[n]);
+    uint16_t hi = pgm_read_word(&leader_node_edges[n + 1]);
+    while (lo < hi) {
+        uint16_t mid = (lo + hi) / 2;
+        uint8_t k = pgm_read_byte(&leader_edge_key[mid]);
+        if (k == code) return pgm_read_word(&leader_edge_node[mid]);
+        if (k < code) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+/* keycode typed by record, 0 for others */
+static uint8_t record_keycode(keyrecord_t *record, action_t action)
+{
+    uint8_t code = 0;
+    switch (action.kind.id) {
+        case ACT_LMODS:
+        case ACT_RMODS:
+            if (!action.key.mods) code = action.key.code;
+            break;
+#ifndef NO_ACTION_TAPPING
+        case ACT_LMODS_TAP:
+        case ACT_RMODS_TAP:
+        case ACT_LAYER_TAP:
+        case ACT_LAYER_TAP_EXT:
+            if (record->tap.count) code = action.key.code;
+            break;
+#endif
+    }
+    return IS_KEY(code) ? code : 0;
+}
+
+static void leader_end(void)
+{
+    active = false;
+    deadline_clear(DEADLINE_LEADER);
+}
+
+static void leader_run(uint8_t id)
+{
+    leader_end();
+    dprintf("leader: %d\n", id);
+    action_macro_play(leader_get_macro(id));
+}
+
+void action_leader_start(void)
+{
+    dprint("leader: start\n");
+    active = true;
+    node = 0;
+    last_time = timer_read();
+    deadline_set(DEADLINE_LEADER, last_time + LEADER_TIMEOUT);
+}
+
+bool action_leader_process(keyrecord_t *record, action_t action)
+{
+    keyevent_t event = record->event;
+    if (!IN_MATRIX(event.key)) return false;
+    matrix_row_t bit = KEY_BIT(event.key);
+
+    if (!event.pressed) {
+        if (!(consumed[event.key.row] & bit)) return false;
+        consumed[event.key.row] &= ~bit;
+        return true;
+    }
+
+    if (!active) return false;
+    uint8_t code = record_keycode(record, action);
+    if (!code) return false;
+
+    uint16_t next = node_child(node, code);
+    if (!next) {
+        // keys so far may make a sequence, then the key goes on
+        uint8_t id = node_id(node);
+        if (id != LEADER_TRIE_NONE) {
+            leader_run(id);
+            return false;
+        }
+        dprint("leader: no sequence\n");
+        leader_end();
+        consumed[event.key.row] |= bit;
+        return true;
+    }
+
+    consumed[event.key.row] |= bit;
+    node = next;
+    if (node_is_leaf(node)) {
+        leader_run(node_id(node));
+    } else {
+        last_time = event.time;
+        deadline_set(DEADLINE_LEADER, last_time + LEADER_TIMEOUT);
+    }
+    return true;
+}
+
+void action_leader_task(void)
+{
+    if (!active) return;
+
+    // event time can be a ms ahead of timer_read()
+    uint16_t elapsed = TIMER_DIFF_16(timer_read(), last_time);
+    if (elapsed < LEADER_TIMEOUT || elapsed >= 0x8000) {
+        deadline_set(DEADLINE_LEADER, last_time + LEADER_TIMEOUT);
+        return;
+    }
+
+    uint8_t id = node_id(node);
+    if (id != LEADER_TRIE_NONE) {
+        leader_run(id);
+    } else {
+        dprint("leader: timeout\n");
+        leader_end();
+    }
+}
@@ -0,0 +1,78 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ACTION_LEADER_H
+#define ACTION_LEADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "progmem.h"
+#include "keycode.h"
+#include "action.h"
+#include "action_macro.h"
+
+
+/*
+ * Leader key(LEADER_ENABLE)
+ *
+ * ACTION_LEADER() starts a sequence and following keys are matched against
+ * sequences of keymap instead of being typed, macro of the sequence is played
+ * with action_macro_play() once it is matched:
+ *   - keys are looked up in a trie made by tool/leader_trie at build time, each
+ *     keystroke steps one node with binary search of its edges, so time per
+ *     key doesn't grow with number of sequences.
+ *   - a sequence runs at once when no longer one starts with it, otherwise
+ *     at LEADER_TIMEOUT from its last key or at a key which doesn't follow.
+ *   - a key which doesn't follow ends the leader, it goes on as normal key
+ *     after a sequence run or is dropped when keys so far make none.
+ * Keys of plain key actions and tapped tap keys are matched, others like
+ * modifiers and layer switches go on as normal so that keys in layers can be
+ * part of a sequence. Presses matched are dropped with their releases.
+ *
+ * Keymap lists sequences as bytes with id of its macro, ids 0-254:
+ *     const uint8_t leader_sequences[] PROGMEM = {
+ *         LEADER_SEQ(0, KC_G, KC_S),
+ *         LEADER_SEQ(1, KC_G),
+ *     };
+ *     const macro_t *leader_get_macro(uint8_t id)
+ *     {
+ *         switch (id) {
+ *             case 0: return MACRO( T(G), T(I), T(T), T(SPC), T(S), END );
+ *             ...
+ *         }
+ *         return MACRO_NONE;
+ *     }
+ * The list is read from objects at build time and is not linked itself.
+ */
+#ifndef LEADER_TIMEOUT
+#define LEADER_TIMEOUT  1000
+#endif
+
+#define LEADER_SEQ(id, ...)     (id), __VA_ARGS__, KC_NO
+
+extern const uint8_t leader_sequences[];
+
+const macro_t *leader_get_macro(uint8_t id);
+
+#ifdef LEADER_ENABLE
+void action_leader_start(void);
+/* takes record from process_action(), true when it was used by leader */
+bool action_leader_process(keyrecord_t *record, action_t action);
+/* LEADER_TIMEOUT from DEADLINE_LEADER */
+void action_leader_task(void);
+#endif
+
+#endif
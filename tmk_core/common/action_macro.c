@@ -14,10 +14,17 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <stddef.h>
 #include "action.h"
 #include "action_util.h"
 #include "action_macro.h"
+#include "host.h"
 #include "wait.h"
+#include "timer.h"
+#include "deadline.h"
+#ifdef MACRO_PACK_ENABLE
+#include "macro_pack_data.h"
+#endif
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -28,71 +35,252 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifndef NO_ACTION_MACRO
 
-#define MACRO_READ()  (macro = MACRO_GET(macro_p++))
-void action_macro_play(const macro_t *macro_p)
+typedef struct {
+    const macro_t *p;       /* next command, NULL while not playing */
+#ifdef MACRO_PACK_ENABLE
+    const macro_t *ret;     /* command after dictionary reference, NULL out of entry */
+#endif
+    uint8_t interval;
+    uint8_t mod_storage;
+    bool fast_type;
+} macro_play_t;
+
+#ifdef MACRO_PACK_ENABLE
+const macro_t *macro_pack_get(uint8_t id)
+{
+    if (id >= MACRO_PACK_IDS) return MACRO_NONE;
+    uint16_t offset = pgm_read_word(&macro_pack_index[id]);
+    if (offset == MACRO_PACK_NONE) return MACRO_NONE;
+    return &macro_pack_data[offset];
+}
+
+/* Next command, steps into dictionary entry at reference and back at its
+ * END. Arguments of command are read with MACRO_ARG(), entries hold whole
+ * commands. */
+static macro_t macro_next(macro_play_t *play)
+{
+    macro_t m = MACRO_GET(play->p++);
+    if (m == END && play->ret) {
+        play->p = play->ret;
+        play->ret = NULL;
+        m = MACRO_GET(play->p++);
+    }
+    if (m == DICT || m >= DICT_SHORT) {
+        uint8_t n = (m == DICT) ? MACRO_GET(play->p++) : m - DICT_SHORT;
+        play->ret = play->p;
+        play->p = &macro_pack_dict[pgm_read_word(&macro_pack_dict_index[n])];
+        m = MACRO_GET(play->p++);
+    }
+    return m;
+}
+#else
+#define macro_next(play)    MACRO_GET((play)->p++)
+#endif
+#define MACRO_ARG(play)     MACRO_GET((play)->p++)
+
+/* Returns keycode if play points to type of a key like T(A) and moves it
+ * past it, otherwise 0. */
+static uint8_t macro_read_type(macro_play_t *play)
+{
+    macro_play_t c = *play;
+    uint8_t down, up;
+    macro_t m;
+
+    m = macro_next(&c);
+    if (m == KEY_DOWN)                  down = MACRO_ARG(&c);
+    else if (0x04 <= m && m <= 0x73)    down = m;
+    else                                return 0;
+
+    m = macro_next(&c);
+    if (m == KEY_UP)                    up = MACRO_ARG(&c);
+    else if (0x84 <= m && m <= 0xF3)    up = m & 0x7F;
+    else                                return 0;
+
+    if (up != down || !IS_KEY(down)) return 0;
+    *play = c;
+    return down;
+}
+
+static bool key_in_report(uint8_t code)
+{
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (keyboard_report->keys[i] == code) return true;
+    }
+    return false;
+}
+
+/* FAST_TYPE: presses a run of typed keys in one report and releases them
+ * in next one. Run ends at other command, repeated key or full report;
+ * with NKRO also at key lower than previous since host reads the bitmap in
+ * keycode order. Returns number of keys typed. */
+static uint8_t macro_fast_type(macro_play_t *play)
+{
+    macro_play_t c = *play;
+    uint8_t code, n = 0;
+#ifdef NKRO_ENABLE
+    uint8_t last = 0;
+#endif
+
+    // order of keys in report is order of typing only when it starts empty
+    if (has_anykey()) return 0;
+
+    while ((code = macro_read_type(&c))) {
+#ifdef NKRO_ENABLE
+        if (keyboard_protocol && keyboard_nkro) {
+            if (code <= last) break;
+            last = code;
+        } else
+#endif
+        {
+            // keyboard endpoint sends six keys even if report has room for more
+            if (n == 6 || key_in_report(code)) break;
+        }
+        dprintf("TYPE(%02X)\n", code);
+        add_key(code);
+        n++;
+        *play = c;
+    }
+    if (n) {
+        send_keyboard_report();
+        clear_keys();
+        send_keyboard_report();
+    }
+    return n;
+}
+
+#define MACRO_READ()  (macro = MACRO_ARG(play))
+/* Runs a command and returns ms to wait before next one, -1 at END */
+static int16_t macro_step(macro_play_t *play)
 {
     macro_t macro = END;
-    uint8_t interval = 0;
+    uint8_t wait = 0;
 
-    uint8_t mod_storage = 0;
+    if (play->fast_type && macro_fast_type(play)) {
+        return play->interval;
+    }
 
-    if (!macro_p) return;
-    while (true) {
-        switch (MACRO_READ()) {
-            case KEY_DOWN:
-                MACRO_READ();
-                dprintf("KEY_DOWN(%02X)\n", macro);
-                if (IS_MOD(macro)) {
-                    add_weak_mods(MOD_BIT(macro));
-                    send_keyboard_report();
-                } else {
-                    register_code(macro);
-                }
-                break;
-            case KEY_UP:
-                MACRO_READ();
-                dprintf("KEY_UP(%02X)\n", macro);
-                if (IS_MOD(macro)) {
-                    del_weak_mods(MOD_BIT(macro));
-                    send_keyboard_report();
-                } else {
-                    unregister_code(macro);
-                }
-                break;
-            case WAIT:
-                MACRO_READ();
-                dprintf("WAIT(%u)\n", macro);
-                { uint8_t ms = macro; while (ms--) wait_ms(1); }
-                break;
-            case INTERVAL:
-                interval = MACRO_READ();
-                dprintf("INTERVAL(%u)\n", interval);
-                break;
-            case MOD_STORE:
-                mod_storage = get_mods();
-                break;
-            case MOD_RESTORE:
-                set_mods(mod_storage);
-                send_keyboard_report();
-                break;
-            case MOD_CLEAR:
-                clear_mods();
+    switch ((macro = macro_next(play))) {
+        case KEY_DOWN:
+            MACRO_READ();
+            dprintf("KEY_DOWN(%02X)\n", macro);
+            if (IS_MOD(macro)) {
+                add_weak_mods(MOD_BIT(macro));
                 send_keyboard_report();
-                break;
-            case 0x04 ... 0x73:
-                dprintf("DOWN(%02X)\n", macro);
+            } else {
                 register_code(macro);
-                break;
-            case 0x84 ... 0xF3:
-                dprintf("UP(%02X)\n", macro);
-                unregister_code(macro&0x7F);
-                break;
-            case END:
-            default:
-                return;
+            }
+            break;
+        case KEY_UP:
+            MACRO_READ();
+            dprintf("KEY_UP(%02X)\n", macro);
+            if (IS_MOD(macro)) {
+                del_weak_mods(MOD_BIT(macro));
+                send_keyboard_report();
+            } else {
+                unregister_code(macro);
+            }
+            break;
+        case WAIT:
+            MACRO_READ();
+            dprintf("WAIT(%u)\n", macro);
+            wait = macro;
+            break;
+        case INTERVAL:
+            play->interval = MACRO_READ();
+            dprintf("INTERVAL(%u)\n", play->interval);
+            break;
+        case MOD_STORE:
+            play->mod_storage = get_mods();
+            break;
+        case MOD_RESTORE:
+            set_mods(play->mod_storage);
+            send_keyboard_report();
+            break;
+        case MOD_CLEAR:
+            clear_mods();
+            send_keyboard_report();
+            break;
+        case FAST_TYPE:
+            dprintf("FAST_TYPE\n");
+            play->fast_type = true;
+            break;
+        case 0x04 ... 0x73:
+            dprintf("DOWN(%02X)\n", macro);
+            register_code(macro);
+            break;
+        case 0x84 ... 0xF3:
+            dprintf("UP(%02X)\n", macro);
+            unregister_code(macro&0x7F);
+            break;
+        case END:
+        default:
+            return -1;
+    }
+    return wait + play->interval;
+}
+
+#ifdef ACTION_MACRO_ASYNC
+/* Macro being played from action_macro_task() */
+static macro_play_t playing = {};
+static uint16_t playing_time;
+static uint16_t playing_wait;
+
+/* start macro, commands until first wait run at once */
+void action_macro_play(const macro_t *macro_p)
+{
+    if (!macro_p) return;
+
+    // macros are played in order, rest of current one runs inline
+    action_macro_finish();
+
+    playing = (macro_play_t){ .p = macro_p };
+    playing_time = timer_read();
+    playing_wait = 0;
+    action_macro_task();
+}
+
+/* run commands whose time has come, called from keyboard_task() */
+void action_macro_task(void)
+{
+    while (playing.p) {
+        if (timer_elapsed(playing_time) < playing_wait) {
+            deadline_set(DEADLINE_MACRO, playing_time + playing_wait);
+            return;
         }
-        // interval
-        { uint8_t ms = interval; while (ms--) wait_ms(1); }
+
+        int16_t ms = macro_step(&playing);
+        if (ms < 0) {
+            playing.p = NULL;
+            return;
+        }
+        playing_time = timer_read();
+        playing_wait = ms;
+    }
+}
+
+/* play rest of current macro with blocking wait */
+void action_macro_finish(void)
+{
+    while (playing.p) {
+        while (timer_elapsed(playing_time) < playing_wait) wait_ms(1);
+        action_macro_task();
+    }
+}
+
+bool action_macro_playing(void)
+{
+    return playing.p;
+}
+#else
+void action_macro_play(const macro_t *macro_p)
+{
+    macro_play_t play = { .p = macro_p };
+    int16_t ms;
+
+    if (!macro_p) return;
+    while ((ms = macro_step(&play)) >= 0) {
+        while (ms--) wait_ms(1);
     }
 }
 #endif
+#endif
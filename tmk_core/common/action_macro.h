@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef ACTION_MACRO_H
 #define ACTION_MACRO_H
 #include <stdint.h>
+#include <stdbool.h>
 #include "progmem.h"
 
 
@@ -33,6 +34,41 @@ void action_macro_play(const macro_t *macro_p);
 #define action_macro_play(macro)
 #endif
 
+/* ACTION_MACRO_ASYNC: action_macro_play() returns at first WAIT or INTERVAL
+ * and action_macro_task() in keyboard_task() plays the rest, keys are scanned
+ * and reported meanwhile. Playing a macro finishes previous one first. */
+#if !defined(NO_ACTION_MACRO) && defined(ACTION_MACRO_ASYNC)
+void action_macro_task(void);
+void action_macro_finish(void);
+bool action_macro_playing(void);
+#else
+#define action_macro_task()
+#define action_macro_finish()
+#define action_macro_playing()  false
+#endif
+
+/* MACRO_PACK_ENABLE: macros are listed with id in macro_sources[] instead of
+ * MACRO() and tool/macro_pack compresses them at build time, the list itself
+ * is not linked. Two byte key commands become one byte ones and runs of
+ * commands used more than once, like words of text, go to a dictionary which
+ * player reads in place of a reference, no buffer in RAM:
+ *     const macro_t macro_sources[] PROGMEM = {
+ *         MACRO_SRC(0, T(H), T(E), T(L), T(L), T(O), END),
+ *         MACRO_SRC(1, I(10), SFT_(T(H)), T(E), T(L), T(L), T(O), END),
+ *     };
+ *     const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt)
+ *     {
+ *         return (record->event.pressed ? macro_pack_get(id) : MACRO_NONE);
+ *     }
+ * Ids are 0-255, macro_pack_get() returns MACRO_NONE for id not listed. */
+#define MACRO_SRC(id, ...)      (id), __VA_ARGS__
+
+extern const macro_t macro_sources[];
+
+#if !defined(NO_ACTION_MACRO) && defined(MACRO_PACK_ENABLE)
+const macro_t *macro_pack_get(uint8_t id);
+#endif
+
 
 
 /* Macro commands
@@ -42,8 +78,16 @@ void action_macro_play(const macro_t *macro_p);
  *   { KEY_UP,   code(0x04-0xff) }      // key up(2bytes)
  *   WAIT                               // wait milli-seconds
  *   INTERVAL                           // set interval between macro commands
+ *   FAST_TYPE                          // type runs of keys in one report
+ *   { DICT, n } / DICT_SHORT + n       // commands of dictionary entry n
  *   END                                // stop macro execution
  *
+ * After FAST_TYPE consecutive types of distinct keys, like T(A), T(B), are
+ * pressed together in one report and released in next. A run counts as one
+ * command for INTERVAL and ends at any other command, so modifiers still
+ * change between reports: FT(), T(H), SFT_(T(E)), T(L), T(L), T(O) sends
+ * h, E, l, l and o in five pairs of reports instead of six.
+ *
  * Ideas(Not implemented):
  *   modifiers
  *   system usage
@@ -67,10 +111,13 @@ enum macro_command_id{
     MOD_STORE,
     MOD_RESTORE,
     MOD_CLEAR,
+    FAST_TYPE,
+    DICT,               /* dictionary entry of packed macro(2bytes) */
 
     /* 0x84 - 0xf3 (reserved for keycode up) */
 
     /* 0xf4 - 0xff */
+    DICT_SHORT          = 0xF4,     /* first 12 entries(1byte) */
 };
 
 
@@ -88,6 +135,7 @@ enum macro_command_id{
 #define STORE()         MOD_STORE
 #define RESTORE()       MOD_RESTORE
 #define CLEAR()         MOD_CLEAR
+#define FAST()          FAST_TYPE
 
 /* key down */
 #define D(key)          DOWN(KC_##key)
@@ -105,6 +153,8 @@ enum macro_command_id{
 #define RM()            RESTORE()
 /* clear modifier(s) */
 #define CM()            CLEAR()
+/* fast type rest of macro */
+#define FT()            FAST()
 /* key shift-type */
 #define ST(key)         D(LSFT),    T(key),   U(LSFT)
 /* modifier utility macros */
@@ -5,6 +5,11 @@
 #include "action_tapping.h"
 #include "keycode.h"
 #include "timer.h"
+#include "matrix.h"
+#include "event_trace.h"
+#include "telemetry.h"
+#include "deadline.h"
+#include "eeconfig.h"
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -18,16 +23,91 @@
 #define IS_TAPPING_PRESSED()    (IS_TAPPING() && tapping_key.event.pressed)
 #define IS_TAPPING_RELEASED()   (IS_TAPPING() && !tapping_key.event.pressed)
 #define IS_TAPPING_KEY(k)       (IS_TAPPING() && KEYEQ(tapping_key.event.key, (k)))
-#define WITHIN_TAPPING_TERM(e)  (TIMER_DIFF_16(e.time, tapping_key.event.time) < TAPPING_TERM)
+#define WITHIN_TAPPING_TERM(e)  (TIMER_DIFF_16(e.time, tapping_key.event.time) < TAPPING_TERM_OF_KEY)
+/* action of the record in process_tapping() */
+#define KEYP_ACTION()           record_action(keyp, &resolved)
 
 
+#if (WAITING_BUFFER_SIZE < 1 || WAITING_BUFFER_SIZE > 127)
+#   error "WAITING_BUFFER_SIZE must be 1 to 127"
+#endif
+
+
+/* learned term is default of action_tapping_term() */
+#if defined(TAPPING_TERM_ADAPTIVE) && !defined(TAPPING_TERM_PER_KEY)
+#   define TAPPING_TERM_PER_KEY
+#endif
+
 static keyrecord_t tapping_key = {};
+#ifdef TAPPING_TERM_PER_KEY
+static uint16_t tapping_term = TAPPING_TERM;
+#   define TAPPING_TERM_OF_KEY  tapping_term
+#else
+#   define TAPPING_TERM_OF_KEY  TAPPING_TERM
+#endif
+#ifdef TAPPING_MODE_PER_KEY
+static uint8_t tapping_mode = TAPPING_MODE;
+#   define TAPPING_MODE_OF_KEY  tapping_mode
+#else
+#   define TAPPING_MODE_OF_KEY  TAPPING_MODE
+#endif
+
+/* key held past tapping term which taps on release, TAPPING_RETRO */
+static keypos_t retro_key;
+static bool retro_pending = false;
+
+#ifdef TAPPING_TERM_ADAPTIVE
+/* Running statistics of a slot in ms<<4: mean and mean absolute deviation
+ * of tap durations, mean of holds(0 until first one). */
+typedef struct {
+    uint16_t tap_mean;
+    uint16_t tap_dev;
+    uint16_t hold_mean;
+    uint16_t term;
+} tapping_adapt_t;
+
+/* slot 0 is of keys not listed */
+#ifdef TAPPING_ADAPT_KEYS
+static const keypos_t adapt_keys[] = TAPPING_ADAPT_KEYS;
+#   define ADAPT_SLOTS  (1 + sizeof(adapt_keys) / sizeof(adapt_keys[0]))
+#else
+#   define ADAPT_SLOTS  1
+#endif
+static tapping_adapt_t adapt[ADAPT_SLOTS];
+
+/* samples longer than this tell nothing more */
+#define ADAPT_HOLD_MAX  1000
+
+/* tap key decided as hold, sampled on its release */
+static keypos_t hold_key;
+static uint16_t hold_time;
+static bool hold_pending = false;
+
+/* learned terms go to EEPROM only when it is written deferred */
+#if defined(EECONFIG_WRITE_DELAY) && defined(__AVR__)
+#   define ADAPT_PERSIST
+#endif
+#endif
+
+/* Ring of events waiting for settlement of tapping, head is the oldest.
+ * waiting_pressed/released are keys which have an event in the buffer. */
 static keyrecord_t waiting_buffer[WAITING_BUFFER_SIZE] = {};
 static uint8_t waiting_buffer_head = 0;
-static uint8_t waiting_buffer_tail = 0;
+static uint8_t waiting_buffer_count = 0;
+static matrix_row_t waiting_pressed[MATRIX_ROWS] = {};
+static matrix_row_t waiting_released[MATRIX_ROWS] = {};
+
+/* slot of n-th oldest event */
+#define WAITING_BUFFER_SLOT(n)  ((waiting_buffer_head + (n)) < WAITING_BUFFER_SIZE ? \
+                                 (waiting_buffer_head + (n)) : \
+                                 (waiting_buffer_head + (n)) - WAITING_BUFFER_SIZE)
 
 static bool process_tapping(keyrecord_t *record);
-static bool waiting_buffer_enq(keyrecord_t record);
+static void tapping_start(keyrecord_t *keyp);
+static void retro_tap(keyrecord_t *keyp);
+static void tapping_settle(void);
+static bool waiting_buffer_enq(const keyrecord_t *record);
+static void waiting_buffer_deq(void);
 static void waiting_buffer_clear(void);
 static bool waiting_buffer_typed(keyevent_t event);
 static void waiting_buffer_scan_tap(void);
@@ -35,37 +115,192 @@ static void debug_tapping_key(void);
 static void debug_waiting_buffer(void);
 
 
-void action_tapping_process(keyrecord_t record)
+/* Keymap lookup of record at most once in a process_tapping() call. Layer
+ * state can change while the record waits in buffer, so it is resolved
+ * again in next call. */
+static inline action_t record_action(keyrecord_t *keyp, bool *resolved)
+{
+    if (!*resolved) {
+        keyp->action = layer_switch_get_action(keyp->event);
+        *resolved = true;
+    }
+    return keyp->action;
+}
+
+
+#ifdef TAPPING_TERM_ADAPTIVE
+static uint8_t adapt_slot(keypos_t key)
+{
+#ifdef TAPPING_ADAPT_KEYS
+    for (uint8_t i = 1; i < ADAPT_SLOTS; i++) {
+        if (KEYEQ(key, adapt_keys[i - 1])) return i;
+    }
+#endif
+    (void)key;
+    return 0;
+}
+
+/*
+ * Term sits four deviations above mean tap so that slow taps still tap,
+ * but not beyond middle of tap and hold means once holds are known, and
+ * not under two deviations.
+ */
+static void adapt_update(uint8_t i)
+{
+    tapping_adapt_t *a = &adapt[i];
+    uint16_t term = (a->tap_mean + 4 * a->tap_dev) >> 4;
+    if (a->hold_mean) {
+        uint16_t floor = (a->tap_mean + 2 * a->tap_dev) >> 4;
+        uint16_t mid = ((a->tap_mean >> 1) + (a->hold_mean >> 1)) >> 4;
+        if (term > mid) term = (mid > floor) ? mid : floor;
+    }
+    if (term < TAPPING_ADAPT_MIN) term = TAPPING_ADAPT_MIN;
+    if (term > TAPPING_ADAPT_MAX) term = TAPPING_ADAPT_MAX;
+
+#ifdef ADAPT_PERSIST
+    if (i < EECONFIG_TAPPING_TERM_SLOTS && term / 2 != a->term / 2) {
+        eeconfig_write_tapping_term(i, term / 2);
+    }
+#endif
+    a->term = term;
+}
+
+static void adapt_tap(keypos_t key, uint16_t ms)
+{
+    uint8_t i = adapt_slot(key);
+    tapping_adapt_t *a = &adapt[i];
+    if (ms > TAPPING_ADAPT_MAX) ms = TAPPING_ADAPT_MAX;
+    int16_t d = (int16_t)(ms << 4) - (int16_t)a->tap_mean;
+    a->tap_mean += d / (1 << TAPPING_ADAPT_SHIFT);
+    a->tap_dev += ((d < 0 ? -d : d) - (int16_t)a->tap_dev) / (1 << TAPPING_ADAPT_SHIFT);
+    adapt_update(i);
+    dprintf("Tapping: adapt[%u] tap %u term %u\n", i, ms, a->term);
+}
+
+static void adapt_hold(keypos_t key, uint16_t ms)
+{
+    uint8_t i = adapt_slot(key);
+    tapping_adapt_t *a = &adapt[i];
+    if (ms > ADAPT_HOLD_MAX) ms = ADAPT_HOLD_MAX;
+    if (a->hold_mean) {
+        a->hold_mean += ((int16_t)(ms << 4) - (int16_t)a->hold_mean) / (1 << TAPPING_ADAPT_SHIFT);
+    } else {
+        a->hold_mean = ms << 4;
+    }
+    adapt_update(i);
+    dprintf("Tapping: adapt[%u] hold %u term %u\n", i, ms, a->term);
+}
+
+/* tapping key is decided as hold */
+static void adapt_hold_start(void)
+{
+    hold_key = tapping_key.event.key;
+    hold_time = tapping_key.event.time;
+    hold_pending = true;
+}
+
+/* stored term or TAPPING_TERM, statistics start where they give it */
+void action_tapping_init(void)
+{
+    for (uint8_t i = 0; i < ADAPT_SLOTS; i++) {
+        uint16_t term = TAPPING_TERM;
+#ifdef ADAPT_PERSIST
+        if (i < EECONFIG_TAPPING_TERM_SLOTS && eeconfig_is_enabled()) {
+            uint16_t stored = eeconfig_read_tapping_term(i) * 2;
+            if (TAPPING_ADAPT_MIN <= stored && stored <= TAPPING_ADAPT_MAX) term = stored;
+        }
+#endif
+        if (term < TAPPING_ADAPT_MIN) term = TAPPING_ADAPT_MIN;
+        if (term > TAPPING_ADAPT_MAX) term = TAPPING_ADAPT_MAX;
+        adapt[i] = (tapping_adapt_t){ .tap_mean = term << 3, .tap_dev = term << 1, .term = term };
+    }
+}
+
+uint16_t action_tapping_adapt_term(keypos_t key)
+{
+    return adapt[adapt_slot(key)].term;
+}
+#else
+#define adapt_tap(key, ms)
+#define adapt_hold_start()
+#endif
+
+
+/* No tap key, no event waiting and no release to follow up, tapping state
+ * machine has nothing to do with event of non-tap key. */
+static inline bool tapping_idle(void)
+{
+    return !IS_TAPPING() && !waiting_buffer_count && !retro_pending
+#ifdef TAPPING_TERM_ADAPTIVE
+        && !hold_pending
+#endif
+        ;
+}
+
+/* Record is owned by caller and is either processed in place or copied
+ * once into waiting_buffer, records in buffer are processed in their slot. */
+void action_tapping_process(keyrecord_t *record)
 {
-    if (process_tapping(&record)) {
-        if (!IS_NOEVENT(record.event)) {
+    // fast path of most events, tapping deadline is not armed while idle
+    if (tapping_idle()) {
+        if (IS_NOEVENT(record->event)) return;
+        record->action = layer_switch_get_action(record->event);
+        if (!record->event.pressed || !is_tap_action(record->action)) {
+            process_record_action(record, record->action);
+            EVENT_TRACE(TRACE_PROCESSED, record->event.key, TRACE_TAP_ARG(*record));
+            return;
+        }
+        // press of tap key starts tapping below, it looks up action again
+    }
+
+    if (process_tapping(record)) {
+        if (!IS_NOEVENT(record->event)) {
             debug("processed: "); debug_record(record); debug("\n");
+            EVENT_TRACE(TRACE_PROCESSED, record->event.key, TRACE_TAP_ARG(*record));
         }
     } else {
         if (!waiting_buffer_enq(record)) {
-            // clear all in case of overflow.
-            debug("OVERFLOW: CLEAR ALL STATES\n");
-            clear_keyboard();
-            waiting_buffer_clear();
-            tapping_key = (keyrecord_t){};
+            // settle tapping to make room rather than losing events
+            debug("OVERFLOW: SETTLE TAPPING\n");
+            EVENT_TRACE(TRACE_OVERFLOW, record->event.key, 1);
+            tapping_settle();
+            if (!waiting_buffer_enq(record)) {
+                // clear all in case of overflow.
+                debug("OVERFLOW: CLEAR ALL STATES\n");
+                EVENT_TRACE(TRACE_OVERFLOW, record->event.key, 2);
+                clear_keyboard();
+                waiting_buffer_clear();
+                tapping_key = (keyrecord_t){};
+            }
         }
     }
 
     // process waiting_buffer
-    if (!IS_NOEVENT(record.event) && waiting_buffer_head != waiting_buffer_tail) {
+    if (!IS_NOEVENT(record->event) && waiting_buffer_count) {
         debug("---- action_exec: process waiting_buffer -----\n");
     }
-    for (; waiting_buffer_tail != waiting_buffer_head; waiting_buffer_tail = (waiting_buffer_tail + 1) % WAITING_BUFFER_SIZE) {
-        if (process_tapping(&waiting_buffer[waiting_buffer_tail])) {
-            debug("processed: waiting_buffer["); debug_dec(waiting_buffer_tail); debug("] = ");
-            debug_record(waiting_buffer[waiting_buffer_tail]); debug("\n\n");
+    while (waiting_buffer_count) {
+        keyrecord_t *head = &waiting_buffer[waiting_buffer_head];
+        if (process_tapping(head)) {
+            debug("processed: waiting_buffer["); debug_dec(waiting_buffer_head); debug("] = ");
+            debug_record(head); debug("\n\n");
+            EVENT_TRACE(TRACE_PROCESSED, head->event.key, TRACE_TAP_ARG(*head));
+            waiting_buffer_deq();
         } else {
             break;
         }
     }
-    if (!IS_NOEVENT(record.event)) {
+    if (!IS_NOEVENT(record->event)) {
         debug("\n");
     }
+
+    // TICK is needed only to end tapping term, its time is odd and can reach
+    // the term a ms before timer_read() does
+    if (IS_TAPPING()) {
+        deadline_set(DEADLINE_TAPPING, tapping_key.event.time + TAPPING_TERM_OF_KEY - 1);
+    } else {
+        deadline_clear(DEADLINE_TAPPING);
+    }
 }
 
 
@@ -78,6 +313,19 @@ void action_tapping_process(keyrecord_t record)
 bool process_tapping(keyrecord_t *keyp)
 {
     keyevent_t event = keyp->event;
+    bool resolved = false;
+
+    if (event.pressed) retro_pending = false;
+
+#ifdef TAPPING_TERM_ADAPTIVE
+    if (hold_pending && !event.pressed && KEYEQ(event.key, hold_key)) {
+        hold_pending = false;
+        // released alone it is retro tap, not hold
+        if (!(retro_pending && KEYEQ(event.key, retro_key))) {
+            adapt_hold(event.key, event.time - hold_time);
+        }
+    }
+#endif
 
     // if tapping
     if (IS_TAPPING_PRESSED()) {
@@ -86,36 +334,37 @@ bool process_tapping(keyrecord_t *keyp)
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
                     // first tap!
                     debug("Tapping: First tap(0->1).\n");
+                    adapt_tap(event.key, event.time - tapping_key.event.time);
                     tapping_key.tap.count = 1;
                     debug_tapping_key();
-                    process_action(&tapping_key);
+                    process_record_action(&tapping_key, tapping_key.action);
 
                     // copy tapping state
                     keyp->tap = tapping_key.tap;
                     // enqueue
                     return false;
                 }
-#if TAPPING_TERM >= 500
                 /* Process a key typed within TAPPING_TERM
                  * This can register the key before settlement of tapping,
                  * useful for long TAPPING_TERM but may prevent fast typing.
                  */
-                else if (IS_RELEASED(event) && waiting_buffer_typed(event)) {
+                else if ((TAPPING_TERM >= 500 || (TAPPING_MODE_OF_KEY & TAPPING_PERMISSIVE_HOLD)) &&
+                         IS_RELEASED(event) && waiting_buffer_typed(event)) {
                     debug("Tapping: End. No tap. Interfered by typing key\n");
-                    process_action(&tapping_key);
+                    adapt_hold_start();
+                    process_record_action(&tapping_key, tapping_key.action);
                     tapping_key = (keyrecord_t){};
                     debug_tapping_key();
                     // enqueue
                     return false;
                 }
-#endif
                 /* Process release event of a key pressed before tapping starts
                  * Without this unexpected repeating will occur with having fast repeating setting
                  * https://github.com/tmk/tmk_keyboard/issues/60
                  */
                 else if (IS_RELEASED(event) && !waiting_buffer_typed(event)) {
                     // Modifier should be retained till end of this tapping.
-                    action_t action = layer_switch_get_action(event);
+                    action_t action = KEYP_ACTION();
                     switch (action.kind.id) {
                         case ACT_LMODS:
                         case ACT_RMODS:
@@ -130,9 +379,18 @@ bool process_tapping(keyrecord_t *keyp)
                     }
                     // Release of key should be process immediately.
                     debug("Tapping: release event of a key pressed before tapping\n");
-                    process_action(keyp);
+                    process_record_action(keyp, KEYP_ACTION());
                     return true;
                 }
+                else if (event.pressed && (TAPPING_MODE_OF_KEY & TAPPING_HOLD_ON_PRESS)) {
+                    debug("Tapping: End. No tap. Interfered by pressing key\n");
+                    adapt_hold_start();
+                    process_record_action(&tapping_key, tapping_key.action);
+                    tapping_key = (keyrecord_t){};
+                    debug_tapping_key();
+                    // enqueue
+                    return false;
+                }
                 else {
                     // set interrupted flag when other key preesed during tapping
                     if (event.pressed) {
@@ -147,12 +405,12 @@ bool process_tapping(keyrecord_t *keyp)
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
                     debug("Tapping: Tap release("); debug_dec(tapping_key.tap.count); debug(")\n");
                     keyp->tap = tapping_key.tap;
-                    process_action(keyp);
+                    process_record_action(keyp, KEYP_ACTION());
                     tapping_key = *keyp;
                     debug_tapping_key();
                     return true;
                 }
-                else if (is_tap_key(event) && event.pressed) {
+                else if (is_tap_action(KEYP_ACTION()) && event.pressed) {
                     if (tapping_key.tap.count > 1) {
                         debug("Tapping: Start new tap with releasing last tap(>1).\n");
                         // unregister key
@@ -165,8 +423,7 @@ bool process_tapping(keyrecord_t *keyp)
                     } else {
                         debug("Tapping: Start while last tap(1).\n");
                     }
-                    tapping_key = *keyp;
-                    waiting_buffer_scan_tap();
+                    tapping_start(keyp);
                     debug_tapping_key();
                     return true;
                 }
@@ -174,7 +431,7 @@ bool process_tapping(keyrecord_t *keyp)
                     if (!IS_NOEVENT(event)) {
                         debug("Tapping: key event while last tap(>0).\n");
                     }
-                    process_action(keyp);
+                    process_record_action(keyp, KEYP_ACTION());
                     return true;
                 }
             }
@@ -184,7 +441,12 @@ bool process_tapping(keyrecord_t *keyp)
             if (tapping_key.tap.count == 0) {
                 debug("Tapping: End. Timeout. Not tap(0): ");
                 debug_event(event); debug("\n");
-                process_action(&tapping_key);
+                adapt_hold_start();
+                process_record_action(&tapping_key, tapping_key.action);
+                if (TAPPING_MODE_OF_KEY & TAPPING_RETRO) {
+                    retro_key = tapping_key.event.key;
+                    retro_pending = true;
+                }
                 tapping_key = (keyrecord_t){};
                 debug_tapping_key();
                 return false;
@@ -192,11 +454,11 @@ bool process_tapping(keyrecord_t *keyp)
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
                     debug("Tapping: End. last timeout tap release(>0).");
                     keyp->tap = tapping_key.tap;
-                    process_action(keyp);
+                    process_record_action(keyp, KEYP_ACTION());
                     tapping_key = (keyrecord_t){};
                     return true;
                 }
-                else if (is_tap_key(event) && event.pressed) {
+                else if (is_tap_action(KEYP_ACTION()) && event.pressed) {
                     if (tapping_key.tap.count > 1) {
                         debug("Tapping: Start new tap with releasing last timeout tap(>1).\n");
                         // unregister key
@@ -209,8 +471,7 @@ bool process_tapping(keyrecord_t *keyp)
                     } else {
                         debug("Tapping: Start while last timeout tap(1).\n");
                     }
-                    tapping_key = *keyp;
-                    waiting_buffer_scan_tap();
+                    tapping_start(keyp);
                     debug_tapping_key();
                     return true;
                 }
@@ -218,7 +479,7 @@ bool process_tapping(keyrecord_t *keyp)
                     if (!IS_NOEVENT(event)) {
                         debug("Tapping: key event while last timeout tap(>0).\n");
                     }
-                    process_action(keyp);
+                    process_record_action(keyp, KEYP_ACTION());
                     return true;
                 }
             }
@@ -232,32 +493,32 @@ bool process_tapping(keyrecord_t *keyp)
                         keyp->tap = tapping_key.tap;
                         if (keyp->tap.count < 15) keyp->tap.count += 1;
                         debug("Tapping: Tap press("); debug_dec(keyp->tap.count); debug(")\n");
-                        process_action(keyp);
+                        process_record_action(keyp, KEYP_ACTION());
                         tapping_key = *keyp;
                         debug_tapping_key();
                         return true;
                     } else {
                         // FIX: start new tap again
+                        KEYP_ACTION();
                         tapping_key = *keyp;
                         return true;
                     }
-                } else if (is_tap_key(event)) {
+                } else if (is_tap_action(KEYP_ACTION())) {
                     // Sequential tap can be interfered with other tap key.
                     debug("Tapping: Start with interfering other tap.\n");
-                    tapping_key = *keyp;
-                    waiting_buffer_scan_tap();
+                    tapping_start(keyp);
                     debug_tapping_key();
                     return true;
                 } else {
                     // should none in buffer
                     // FIX: interrupted when other key is pressed
                     tapping_key.tap.interrupted = true;
-                    process_action(keyp);
+                    process_record_action(keyp, KEYP_ACTION());
                     return true;
                 }
             } else {
                 if (!IS_NOEVENT(event)) debug("Tapping: other key just after tap.\n");
-                process_action(keyp);
+                process_record_action(keyp, KEYP_ACTION());
                 return true;
             }
         } else {
@@ -272,55 +533,156 @@ bool process_tapping(keyrecord_t *keyp)
     }
     // not tapping state
     else {
-        if (event.pressed && is_tap_key(event)) {
+        if (event.pressed && is_tap_action(KEYP_ACTION())) {
             debug("Tapping: Start(Press tap key).\n");
-            tapping_key = *keyp;
-            waiting_buffer_scan_tap();
+            tapping_start(keyp);
             debug_tapping_key();
             return true;
         } else {
-            process_action(keyp);
+            process_record_action(keyp, KEYP_ACTION());
+            if (retro_pending && IS_RELEASED(event) && KEYEQ(event.key, retro_key)) {
+                retro_tap(keyp);
+            }
             return true;
         }
     }
 }
 
 
+/* New key starts tapping, release of it may be in buffer already */
+static void tapping_start(keyrecord_t *keyp)
+{
+    tapping_key = *keyp;
+#ifdef TAPPING_TERM_PER_KEY
+    tapping_term = action_tapping_term(&tapping_key);
+#endif
+#ifdef TAPPING_MODE_PER_KEY
+    tapping_mode = action_tapping_mode(&tapping_key);
+#endif
+    waiting_buffer_scan_tap();
+}
+
+/* Type tap of key released after holding it alone past tapping term */
+static void retro_tap(keyrecord_t *keyp)
+{
+    keyrecord_t record = *keyp;
+
+    debug("Tapping: Retro tap\n");
+    retro_pending = false;
+#ifdef TAPPING_TERM_ADAPTIVE
+    // tap longer than term pushes it up
+    adapt_tap(keyp->event.key, keyp->event.time - hold_time);
+#endif
+    record.tap = (tap_t){ .count = 1 };
+    record.event.pressed = true;
+    process_record_action(&record, record.action);
+    record.event.pressed = false;
+    process_record_action(&record, record.action);
+}
+
+#ifdef TAPPING_TERM_PER_KEY
+/* keymap can override this to give keys their own term */
+__attribute__ ((weak))
+uint16_t action_tapping_term(keyrecord_t *record)
+{
+#ifdef TAPPING_TERM_ADAPTIVE
+    return action_tapping_adapt_term(record->event.key);
+#else
+    (void)record;
+    return TAPPING_TERM;
+#endif
+}
+#endif
+
+#ifdef TAPPING_MODE_PER_KEY
+/* keymap can override this to choose early decision of each key */
+__attribute__ ((weak))
+uint8_t action_tapping_mode(keyrecord_t *record)
+{
+    (void)record;
+    return TAPPING_MODE;
+}
+#endif
+
+
+/* Settle tapping key as hold when waiting buffer is full and process
+ * buffered events as far as possible. Tap needs release of the key and
+ * it would have been found in the buffer already. */
+static void tapping_settle(void)
+{
+    if (IS_TAPPING_PRESSED() && tapping_key.tap.count == 0) {
+        debug("Tapping: End. Buffer full. Not tap(0)\n");
+        adapt_hold_start();
+        process_record_action(&tapping_key, tapping_key.action);
+    }
+    tapping_key = (keyrecord_t){};
+    debug_tapping_key();
+
+    while (waiting_buffer_count && process_tapping(&waiting_buffer[waiting_buffer_head])) {
+        waiting_buffer_deq();
+    }
+}
+
+
 /*
  * Waiting buffer
  */
-bool waiting_buffer_enq(keyrecord_t record)
+static inline matrix_row_t *waiting_index(bool pressed)
 {
-    if (IS_NOEVENT(record.event)) {
+    return pressed ? waiting_pressed : waiting_released;
+}
+
+bool waiting_buffer_enq(const keyrecord_t *record)
+{
+    if (IS_NOEVENT(record->event)) {
         return true;
     }
 
-    if ((waiting_buffer_head + 1) % WAITING_BUFFER_SIZE == waiting_buffer_tail) {
+    if (waiting_buffer_count == WAITING_BUFFER_SIZE) {
         debug("waiting_buffer_enq: Over flow.\n");
+        TELEMETRY_COUNT(TELEMETRY_WAITING_LOST);
         return false;
     }
 
-    waiting_buffer[waiting_buffer_head] = record;
-    waiting_buffer_head = (waiting_buffer_head + 1) % WAITING_BUFFER_SIZE;
+    keypos_t key = record->event.key;
+    waiting_buffer[WAITING_BUFFER_SLOT(waiting_buffer_count)] = *record;
+    waiting_buffer_count++;
+    TELEMETRY_PEAK_SET(TELEMETRY_WAITING_PEAK, waiting_buffer_count);
+    waiting_index(record->event.pressed)[key.row] |= ((matrix_row_t)1<<key.col);
 
     debug("waiting_buffer_enq: "); debug_waiting_buffer();
     return true;
 }
 
+/* remove the oldest event */
+void waiting_buffer_deq(void)
+{
+    keyevent_t event = waiting_buffer[waiting_buffer_head].event;
+    waiting_buffer_head = WAITING_BUFFER_SLOT(1);
+    waiting_buffer_count--;
+
+    // keep the key in index if it has the same event yet
+    for (uint8_t n = 0; n < waiting_buffer_count; n++) {
+        keyevent_t e = waiting_buffer[WAITING_BUFFER_SLOT(n)].event;
+        if (KEYEQ(event.key, e.key) && event.pressed == e.pressed) return;
+    }
+    waiting_index(event.pressed)[event.key.row] &= ~((matrix_row_t)1<<event.key.col);
+}
+
 void waiting_buffer_clear(void)
 {
     waiting_buffer_head = 0;
-    waiting_buffer_tail = 0;
+    waiting_buffer_count = 0;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        waiting_pressed[r] = 0;
+        waiting_released[r] = 0;
+    }
 }
 
+/* whether the key has opposite event in buffer */
 bool waiting_buffer_typed(keyevent_t event)
 {
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
-        if (KEYEQ(event.key, waiting_buffer[i].event.key) && event.pressed !=  waiting_buffer[i].event.pressed) {
-            return true;
-        }
-    }
-    return false;
+    return waiting_index(!event.pressed)[event.key.row] & ((matrix_row_t)1<<event.key.col);
 }
 
 /* scan buffer for tapping */
@@ -330,14 +692,17 @@ void waiting_buffer_scan_tap(void)
     if (tapping_key.tap.count > 0) return;
     // invalid state: tapping_key released && tap.count == 0
     if (!tapping_key.event.pressed) return;
+    // release of tapping key is not in buffer
+    if (!waiting_buffer_typed(tapping_key.event)) return;
 
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
+    for (uint8_t n = 0; n < waiting_buffer_count; n++) {
+        uint8_t i = WAITING_BUFFER_SLOT(n);
         if (IS_TAPPING_KEY(waiting_buffer[i].event.key) &&
                 !waiting_buffer[i].event.pressed &&
                 WITHIN_TAPPING_TERM(waiting_buffer[i].event)) {
             tapping_key.tap.count = 1;
             waiting_buffer[i].tap.count = 1;
-            process_action(&tapping_key);
+            process_record_action(&tapping_key, tapping_key.action);
 
             debug("waiting_buffer_scan_tap: found at ["); debug_dec(i); debug("]\n");
             debug_waiting_buffer();
@@ -350,16 +715,19 @@ void waiting_buffer_scan_tap(void)
 /*
  * debug print
  */
+/* called whenever tapping_key is updated */
 static void debug_tapping_key(void)
 {
-    debug("TAPPING_KEY="); debug_record(tapping_key); debug("\n");
+    debug("TAPPING_KEY="); debug_record(&tapping_key); debug("\n");
+    EVENT_TRACE(TRACE_TAPPING, tapping_key.event.key, TRACE_TAP_ARG(tapping_key));
 }
 
 static void debug_waiting_buffer(void)
 {
     debug("{ ");
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
-        debug("["); debug_dec(i); debug("]="); debug_record(waiting_buffer[i]); debug(" ");
+    for (uint8_t n = 0; n < waiting_buffer_count; n++) {
+        uint8_t i = WAITING_BUFFER_SLOT(n);
+        debug("["); debug_dec(i); debug("]="); debug_record(&waiting_buffer[i]); debug(" ");
     }
     debug("}\n");
 }
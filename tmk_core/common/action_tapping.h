@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef ACTION_TAPPING_H
 #define ACTION_TAPPING_H
 
+#include "keyboard.h"
 
 
 /* period of tapping(ms) */
@@ -29,11 +30,56 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define TAPPING_TOGGLE  5
 #endif
 
+/* Early decision of tap key, flags of TAPPING_MODE
+ * TAPPING_HOLD_ON_PRESS:   hold as soon as other key is pressed
+ * TAPPING_PERMISSIVE_HOLD: hold when other key is pressed and released,
+ *                          always on with TAPPING_TERM >= 500
+ * TAPPING_RETRO:           tap on release after timeout when no other key
+ *                          was pressed while holding */
+#define TAPPING_HOLD_ON_PRESS   (1<<0)
+#define TAPPING_PERMISSIVE_HOLD (1<<1)
+#define TAPPING_RETRO           (1<<2)
+
+/* mode of all tap keys, or default of action_tapping_mode() */
+#ifndef TAPPING_MODE
+#define TAPPING_MODE    0
+#endif
+
+/* number of events buffered while tapping is undecided */
+#ifndef WAITING_BUFFER_SIZE
 #define WAITING_BUFFER_SIZE 8
+#endif
+
+
+/* TAPPING_TERM_ADAPTIVE: term of tap key is learned from durations of its
+ * taps and holds, between TAPPING_ADAPT_MIN and TAPPING_ADAPT_MAX(ms).
+ * Keys of TAPPING_ADAPT_KEYS have their own term and others share one:
+ *     #define TAPPING_ADAPT_KEYS { { .row = 2, .col = 1 }, { .row = 2, .col = 10 } }
+ * Learned terms of first four are kept in EEPROM with EECONFIG_WRITE_DELAY. */
+#ifdef TAPPING_TERM_ADAPTIVE
+#   ifndef TAPPING_ADAPT_MIN
+#   define TAPPING_ADAPT_MIN    (TAPPING_TERM / 2)
+#   endif
+#   ifndef TAPPING_ADAPT_MAX
+#   define TAPPING_ADAPT_MAX    (TAPPING_TERM + TAPPING_TERM / 2)
+#   endif
+/* weight of new sample is 1/2^SHIFT */
+#   ifndef TAPPING_ADAPT_SHIFT
+#   define TAPPING_ADAPT_SHIFT  4
+#   endif
+#   if TAPPING_ADAPT_MAX > 510 || TAPPING_ADAPT_MIN > TAPPING_ADAPT_MAX
+#   error "TAPPING_ADAPT_MIN and TAPPING_ADAPT_MAX must be in order and up to 510"
+#   endif
+#endif
 
 
 #ifndef NO_ACTION_TAPPING
-void action_tapping_process(keyrecord_t record);
+void action_tapping_process(keyrecord_t *record);
+#   ifdef TAPPING_TERM_ADAPTIVE
+void action_tapping_init(void);
+/* learned term of key, default of action_tapping_term() */
+uint16_t action_tapping_adapt_term(keypos_t key);
+#   endif
 #endif
 
 #endif
@@ -14,36 +14,68 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <string.h>
 #include "host.h"
 #include "report.h"
 #include "debug.h"
 #include "action_util.h"
 #include "timer.h"
+#include "deadline.h"
+#include "progmem.h"
 
 static inline void add_key_byte(uint8_t code);
 static inline void del_key_byte(uint8_t code);
 #ifdef NKRO_ENABLE
 static inline void add_key_bit(uint8_t code);
 static inline void del_key_bit(uint8_t code);
+
+/* index of lowest set bit of each nibble, 0 has none */
+static const uint8_t ffs_nibble[16] PROGMEM = {
+    0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+};
+
+static inline uint8_t bitffs(uint8_t bits)
+{
+    if (bits & 0x0F) return pgm_read_byte(&ffs_nibble[bits & 0x0F]);
+    return 4 + pgm_read_byte(&ffs_nibble[bits >> 4]);
+}
 #endif
 
 static uint8_t real_mods = 0;
 static uint8_t weak_mods = 0;
 
 #ifdef USB_6KRO_ENABLE
-#define RO_ADD(a, b) ((a + b) % KEYBOARD_REPORT_KEYS)
-#define RO_SUB(a, b) ((a - b + KEYBOARD_REPORT_KEYS) % KEYBOARD_REPORT_KEYS)
-#define RO_INC(a) RO_ADD(a, 1)
-#define RO_DEC(a) RO_SUB(a, 1)
-static int8_t cb_head = 0;
-static int8_t cb_tail = 0;
-static int8_t cb_count = 0;
+/* Keys stay in the slot they are added to. key_bits is presence bitmap of
+ * all usages so that repeated add and del of absent key return at once,
+ * slot_age is order of press of key in each slot, 0 is the oldest. No search
+ * for duplicate and no compaction of report, loops are over the slots only.
+ */
+static uint8_t key_bits[32];
+static uint8_t slot_age[KEYBOARD_REPORT_KEYS];
+static uint8_t key_count = 0;
+#endif
+
+/* ARM and native hosts are little-endian and load a word as cheap as a byte,
+ * so the report is inspected four bytes at a time. Report is packed, words are
+ * read through memcpy to stay safe on Cortex-M0 which faults on unaligned access.
+ */
+#if defined(__arm__) || defined(PROTOCOL_NATIVE)
+#define REPORT_WORD_ACCESS
+static inline uint32_t report_word(const uint8_t *p)
+{
+    uint32_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
 #endif
 
 // TODO: pointer variable is not needed
 //report_keyboard_t keyboard_report = {};
 report_keyboard_t *keyboard_report = &(report_keyboard_t){};
 
+/* last report sent, the same report is not sent again */
+static report_keyboard_t keyboard_report_sent = {};
+
 #ifndef NO_ACTION_ONESHOT
 static int8_t oneshot_mods = 0;
 #if (defined(ONESHOT_TIMEOUT) && (ONESHOT_TIMEOUT > 0))
@@ -52,6 +84,106 @@ static int16_t oneshot_time = 0;
 #endif
 
 
+static void send_report(report_keyboard_t *report)
+{
+    if (!memcmp(report, &keyboard_report_sent, sizeof(report_keyboard_t))) {
+        return;
+    }
+    keyboard_report_sent = *report;
+    host_keyboard_send(report);
+}
+
+#ifdef KEYBOARD_REPORT_BATCH
+/*
+ * Report batching
+ *
+ * Between batch begin and end send_keyboard_report() keeps the report and
+ * the last one kept is sent at end, events of a scan pass go in one report.
+ * Kept report is sent first when the next one can't be merged into it
+ * without changing what host sees:
+ *  - a key or modifier changes again in the batch, a tap would be lost
+ *  - modifiers change after a key is added, the key needs its own mods
+ *  - another key is added after one, with NKRO host reads the bitmap in
+ *    keycode order and with 6KRO slots are in order of typing only when
+ *    report started the batch empty, as FAST_TYPE of macro
+ *  - time passed since kept one, e.g. wait of macro played in action
+ */
+static bool batching = false;
+static bool batch_pending = false;
+static uint16_t batch_time;
+static report_keyboard_t keyboard_report_batch;
+
+static bool report_has_key(const report_keyboard_t *report, uint8_t code)
+{
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (report->keys[i] == code) return true;
+    }
+    return false;
+}
+
+static bool batch_mergeable(const report_keyboard_t *next)
+{
+    const report_keyboard_t *sent = &keyboard_report_sent;
+    const report_keyboard_t *prev = &keyboard_report_batch;
+    bool keys_added = false;
+    bool keys_adding = false;
+    bool ordered = false;
+
+    if (timer_read() != batch_time) return false;
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_BITS; i++) {
+            uint8_t batch = sent->nkro.bits[i] ^ prev->nkro.bits[i];
+            if (batch & (prev->nkro.bits[i] ^ next->nkro.bits[i])) return false;
+            if (batch & prev->nkro.bits[i]) keys_added = true;
+            if (next->nkro.bits[i] & ~prev->nkro.bits[i]) keys_adding = true;
+        }
+    } else
+#endif
+    {
+        // slots of keys added are in order of typing
+        ordered = true;
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            if (sent->keys[i]) ordered = false;
+        }
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            uint8_t code = prev->keys[i];
+            if (!code || report_has_key(sent, code)) continue;
+            keys_added = true;
+            // added in batch and deleted now
+            if (!report_has_key(next, code)) return false;
+        }
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            uint8_t code = next->keys[i];
+            if (!code || report_has_key(prev, code)) continue;
+            keys_adding = true;
+            // deleted in batch and added again now
+            if (report_has_key(sent, code)) return false;
+        }
+    }
+    if (keys_added && keys_adding && !ordered) return false;
+
+    uint8_t mods = prev->mods ^ next->mods;
+    if (mods & (sent->mods ^ prev->mods)) return false;
+    if (mods && keys_added) return false;
+    return true;
+}
+
+void keyboard_report_batch_begin(void)
+{
+    batching = true;
+}
+
+void keyboard_report_batch_end(void)
+{
+    batching = false;
+    if (batch_pending) {
+        batch_pending = false;
+        send_report(&keyboard_report_batch);
+    }
+}
+#endif
+
 void send_keyboard_report(void) {
     keyboard_report->mods  = real_mods;
     keyboard_report->mods |= weak_mods;
@@ -69,13 +201,27 @@ void send_keyboard_report(void) {
         }
     }
 #endif
-    host_keyboard_send(keyboard_report);
+#ifdef KEYBOARD_REPORT_BATCH
+    if (batching) {
+        if (batch_pending && !batch_mergeable(keyboard_report)) {
+            send_report(&keyboard_report_batch);
+        }
+        keyboard_report_batch = *keyboard_report;
+        batch_time = timer_read();
+        batch_pending = true;
+        return;
+    }
+#endif
+    send_report(keyboard_report);
 }
 
 /* key */
 void add_key(uint8_t key)
 {
-#ifdef NKRO_ENABLE
+#ifdef NKRO_HYBRID
+    // bitmap has all keys, boot report first six of them
+    add_key_bit(key);
+#elif defined(NKRO_ENABLE)
     if (keyboard_protocol && keyboard_nkro) {
         add_key_bit(key);
         return;
@@ -86,7 +232,9 @@ void add_key(uint8_t key)
 
 void del_key(uint8_t key)
 {
-#ifdef NKRO_ENABLE
+#ifdef NKRO_HYBRID
+    del_key_bit(key);
+#elif defined(NKRO_ENABLE)
     if (keyboard_protocol && keyboard_nkro) {
         del_key_bit(key);
         return;
@@ -101,7 +249,36 @@ void clear_keys(void)
     for (int8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
         keyboard_report->raw[i] = 0;
     }
+#ifdef USB_6KRO_ENABLE
+    memset(key_bits, 0, sizeof(key_bits));
+    key_count = 0;
+#endif
+}
+
+#ifdef NKRO_ENABLE
+/* keep keys held in report format of keyboard_nkro after it is changed */
+void reformat_keyboard_report(bool was_nkro)
+{
+    bool from = keyboard_protocol && was_nkro;
+    bool to   = keyboard_protocol && keyboard_nkro;
+    if (from == to) return;
+
+    report_keyboard_t old = *keyboard_report;
+    clear_keys();
+    if (from) {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_BITS; i++) {
+            for (uint8_t j = 0; j < 8; j++) {
+                if (old.nkro.bits[i] & (1<<j)) add_key(i<<3 | j);
+            }
+        }
+    } else {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            if (old.keys[i]) add_key(old.keys[i]);
+        }
+    }
+    send_keyboard_report();
 }
+#endif
 
 
 /* modifier */
@@ -125,6 +302,8 @@ void set_oneshot_mods(uint8_t mods)
     oneshot_mods = mods;
 #if (defined(ONESHOT_TIMEOUT) && (ONESHOT_TIMEOUT > 0))
     oneshot_time = timer_read();
+    // keyboard_task() sends report to release the mods on timeout
+    deadline_set(DEADLINE_ONESHOT, oneshot_time + ONESHOT_TIMEOUT);
 #endif
 }
 void clear_oneshot_mods(void)
@@ -132,6 +311,7 @@ void clear_oneshot_mods(void)
     oneshot_mods = 0;
 #if (defined(ONESHOT_TIMEOUT) && (ONESHOT_TIMEOUT > 0))
     oneshot_time = 0;
+    deadline_clear(DEADLINE_ONESHOT);
 #endif
 }
 #endif
@@ -145,7 +325,21 @@ void clear_oneshot_mods(void)
 uint8_t has_anykey(void)
 {
     uint8_t cnt = 0;
-    for (uint8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
+#ifdef NKRO_HYBRID
+    // keys of boot report are in bitmap as well
+    uint8_t i = KEYBOARD_REPORT_SIZE - KEYBOARD_REPORT_BITS;
+#else
+    uint8_t i = 1;
+#endif
+#ifdef REPORT_WORD_ACCESS
+    for (; i + 4 <= KEYBOARD_REPORT_SIZE; i += 4) {
+        uint32_t w = report_word(&keyboard_report->raw[i]);
+        if (!w) continue;
+        cnt += !!(w & 0x000000FF) + !!(w & 0x0000FF00) +
+               !!(w & 0x00FF0000) + !!(w & 0xFF000000);
+    }
+#endif
+    for (; i < KEYBOARD_REPORT_SIZE; i++) {
         if (keyboard_report->raw[i])
             cnt++;
     }
@@ -161,21 +355,26 @@ uint8_t get_first_key(void)
 {
 #ifdef NKRO_ENABLE
     if (keyboard_protocol && keyboard_nkro) {
+        const uint8_t *bits = keyboard_report->nkro.bits;
         uint8_t i = 0;
-        for (; i < KEYBOARD_REPORT_BITS && !keyboard_report->nkro.bits[i]; i++)
-            ;
-        return i<<3 | biton(keyboard_report->nkro.bits[i]);
+#ifdef REPORT_WORD_ACCESS
+        for (; i + 4 <= KEYBOARD_REPORT_BITS; i += 4) {
+            uint32_t w = report_word(&bits[i]);
+            if (w) return (i<<3) + __builtin_ctz(w);
+        }
+#endif
+        for (; i < KEYBOARD_REPORT_BITS; i++) {
+            if (bits[i]) return i<<3 | bitffs(bits[i]);
+        }
+        return 0;
     }
 #endif
 #ifdef USB_6KRO_ENABLE
-    uint8_t i = cb_head;
-    do {
-        if (keyboard_report->keys[i] != 0) {
-            break;
-        }
-        i = RO_INC(i);
-    } while (i != cb_tail);
-    return keyboard_report->keys[i];
+    if (!key_count) return 0;
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (slot_age[i] == 0 && keyboard_report->keys[i]) return keyboard_report->keys[i];
+    }
+    return 0;
 #else
     return keyboard_report->keys[0];
 #endif
@@ -187,50 +386,24 @@ uint8_t get_first_key(void)
 static inline void add_key_byte(uint8_t code)
 {
 #ifdef USB_6KRO_ENABLE
-    int8_t i = cb_head;
-    int8_t empty = -1;
-    if (cb_count) {
-        do {
-            if (keyboard_report->keys[i] == code) {
-                return;
-            }
-            if (empty == -1 && keyboard_report->keys[i] == 0) {
-                empty = i;
-            }
-            i = RO_INC(i);
-        } while (i != cb_tail);
-        if (i == cb_tail) {
-            if (cb_tail == cb_head) {
-                // buffer is full
-                if (empty == -1) {
-                    // pop head when has no empty space
-                    cb_head = RO_INC(cb_head);
-                    cb_count--;
-                }
-                else {
-                    // left shift when has empty space
-                    uint8_t offset = 1;
-                    i = RO_INC(empty);
-                    do {
-                        if (keyboard_report->keys[i] != 0) {
-                            keyboard_report->keys[empty] = keyboard_report->keys[i];
-                            keyboard_report->keys[i] = 0;
-                            empty = RO_INC(empty);
-                        }
-                        else {
-                            offset++;
-                        }
-                        i = RO_INC(i);
-                    } while (i != cb_tail);
-                    cb_tail = RO_SUB(cb_tail, offset);
-                }
-            }
+    if (!code || (key_bits[code>>3] & (1<<(code&7)))) return;
+
+    uint8_t slot = 0;
+    if (key_count == KEYBOARD_REPORT_KEYS) {
+        // full: newest key wins, oldest one is dropped and its slot reused
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            if (slot_age[i] == 0) slot = i;
+            slot_age[i]--;
         }
+        uint8_t old = keyboard_report->keys[slot];
+        key_bits[old>>3] &= ~(1<<(old&7));
+        key_count--;
+    } else {
+        while (keyboard_report->keys[slot]) slot++;
     }
-    // add to tail
-    keyboard_report->keys[cb_tail] = code;
-    cb_tail = RO_INC(cb_tail);
-    cb_count++;
+    keyboard_report->keys[slot] = code;
+    slot_age[slot] = key_count++;
+    key_bits[code>>3] |= 1<<(code&7);
 #else
     int8_t i = 0;
     int8_t empty = -1;
@@ -253,29 +426,17 @@ static inline void add_key_byte(uint8_t code)
 static inline void del_key_byte(uint8_t code)
 {
 #ifdef USB_6KRO_ENABLE
-    uint8_t i = cb_head;
-    if (cb_count) {
-        do {
-            if (keyboard_report->keys[i] == code) {
-                keyboard_report->keys[i] = 0;
-                cb_count--;
-                if (cb_count == 0) {
-                    // reset head and tail
-                    cb_tail = cb_head = 0;
-                }
-                if (i == RO_DEC(cb_tail)) {
-                    // left shift when next to tail
-                    do {
-                        cb_tail = RO_DEC(cb_tail);
-                        if (keyboard_report->keys[RO_DEC(cb_tail)] != 0) {
-                            break;
-                        }
-                    } while (cb_tail != cb_head);
-                }
-                break;
-            }
-            i = RO_INC(i);
-        } while (i != cb_tail);
+    if (!code || !(key_bits[code>>3] & (1<<(code&7)))) return;
+    key_bits[code>>3] &= ~(1<<(code&7));
+
+    uint8_t slot = 0;
+    while (keyboard_report->keys[slot] != code) slot++;
+    keyboard_report->keys[slot] = 0;
+    key_count--;
+    // keys pressed after it move up by one, empty slots don't care
+    uint8_t age = slot_age[slot];
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (slot_age[i] > age) slot_age[i]--;
     }
 #else
     for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
@@ -27,11 +27,19 @@ extern "C" {
 extern report_keyboard_t *keyboard_report;
 
 void send_keyboard_report(void);
+#ifdef KEYBOARD_REPORT_BATCH
+/* reports sent between them are merged, see action_util.c */
+void keyboard_report_batch_begin(void);
+void keyboard_report_batch_end(void);
+#endif
 
 /* key */
 void add_key(uint8_t key);
 void del_key(uint8_t key);
 void clear_keys(void);
+#ifdef NKRO_ENABLE
+void reformat_keyboard_report(bool was_nkro);
+#endif
 
 /* modifier */
 uint8_t get_mods(void);
@@ -17,6 +17,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include "action_code.h"
 #include "actionmap.h"
+#ifdef KEYMAP_PACK_ENABLE
+#include "keymap_pack.h"
+#endif
 
 
 /* Keymapping with 16bit action codes */
@@ -27,7 +30,18 @@ extern const action_t actionmaps[][MATRIX_ROWS][MATRIX_COLS];
 __attribute__ ((weak))
 action_t action_for_key(uint8_t layer, keypos_t key)
 {
+#ifdef KEYMAP_PACK_ENABLE
+    return (action_t)keymap_pack_get(layer, key.row, key.col);
+#else
     return (action_t)pgm_read_word(&actionmaps[(layer)][(key.row)][(key.col)]);
+#endif
+}
+
+/* action of actionmap has no side effect */
+__attribute__ ((weak))
+bool keymap_key_is_transparent(uint8_t layer, keypos_t key)
+{
+    return action_for_key(layer, key).code == (action_t)ACTION_TRANSPARENT.code;
 }
 
 /* Macro */
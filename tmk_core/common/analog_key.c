@@ -0,0 +1,199 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Matrix of analog keys, see analog_key.h
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "print.h"
+#include "debug.h"
+#include "timer.h"
+#include "wait.h"
+#include "matrix.h"
+#include "analog_key.h"
+
+
+#if ANALOG_KEYS > MATRIX_ROWS * MATRIX_COLS || ANALOG_KEYS > 255
+#   error "ANALOG_KEYS must fit in MATRIX_ROWS * MATRIX_COLS and not exceed 255"
+#endif
+#if ANALOG_KEY_RANGE < 1 || ANALOG_KEY_RANGE > 1023
+#   error "ANALOG_KEY_RANGE must be 1-1023"
+#endif
+
+/* travel = deviation * SCALE >> 8 for deviation below ANALOG_KEY_RANGE */
+#define SCALE   ((uint16_t)(255UL * 256 / ANALOG_KEY_RANGE))
+
+/* samples averaged for rest value */
+#define CALIBRATE_SAMPLES   8
+
+
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_rows_t changed_rows = MATRIX_ROWS_ALL;
+
+static uint16_t rest[ANALOG_KEYS];
+/* travel at last scan and top point while released or bottom point while pressed */
+static uint8_t travel[ANALOG_KEYS];
+static uint8_t extreme[ANALOG_KEYS];
+
+static analog_key_config_t config = {
+    .actuation = ANALOG_KEY_ACTUATION,
+    .hysteresis = ANALOG_KEY_HYSTERESIS,
+    .deadzone = ANALOG_KEY_DEADZONE,
+    .rapid_press = ANALOG_KEY_RAPID_PRESS,
+    .rapid_release = ANALOG_KEY_RAPID_RELEASE,
+};
+
+
+void analog_key_get_config(analog_key_config_t *c)
+{
+    *c = config;
+}
+
+void analog_key_set_config(const analog_key_config_t *c)
+{
+    config = *c;
+    if (!config.rapid_release) config.rapid_release = config.rapid_press;
+    // start tracking from where keys are now
+    for (uint8_t k = 0; k < ANALOG_KEYS; k++) {
+        extreme[k] = travel[k];
+    }
+}
+
+uint8_t analog_key_travel(uint8_t key)
+{
+    return (key < ANALOG_KEYS) ? travel[key] : 0;
+}
+
+void analog_key_calibrate(void)
+{
+    // wait for first conversion of all keys
+    uint16_t t = timer_read();
+    for (uint8_t k = 0; k < ANALOG_KEYS; k++) {
+        while (!analog_key_hw_read(k) && timer_elapsed(t) < 100) ;
+    }
+
+    uint16_t sum[ANALOG_KEYS];
+    for (uint8_t k = 0; k < ANALOG_KEYS; k++) sum[k] = 0;
+    for (uint8_t i = 0; i < CALIBRATE_SAMPLES; i++) {
+        for (uint8_t k = 0; k < ANALOG_KEYS; k++) {
+            sum[k] += analog_key_hw_read(k);
+        }
+        wait_ms(1);
+    }
+    for (uint8_t k = 0; k < ANALOG_KEYS; k++) {
+        rest[k] = sum[k] / CALIBRATE_SAMPLES;
+    }
+    dprintf("analog_key: rest of key0: %u\n", rest[0]);
+}
+
+static uint8_t key_travel(uint8_t k)
+{
+    uint16_t v = analog_key_hw_read(k);
+#ifdef ANALOG_KEY_INVERT
+    if (v >= rest[k]) return 0;
+    uint16_t d = rest[k] - v;
+#else
+    if (v <= rest[k]) return 0;
+    uint16_t d = v - rest[k];
+#endif
+    if (d >= ANALOG_KEY_RANGE) return 255;
+    return (d * SCALE) >> 8;
+}
+
+/* new state of key, extreme is updated */
+static bool key_state(uint8_t t, bool on, uint8_t *ext)
+{
+    if (!config.rapid_press) {
+        if (on) return t + config.hysteresis >= config.actuation;
+        return t >= config.actuation;
+    }
+
+    if (t <= config.deadzone) {
+        *ext = t;
+        return false;
+    }
+    if (on) {
+        if (t > *ext) *ext = t;
+        if (*ext - t >= config.rapid_release) {
+            *ext = t;
+            return false;
+        }
+    } else {
+        if (t < *ext) *ext = t;
+        if (t - *ext >= config.rapid_press) {
+            *ext = t;
+            return true;
+        }
+    }
+    return on;
+}
+
+
+void matrix_init(void)
+{
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        matrix[i] = 0;
+    }
+    for (uint8_t k = 0; k < ANALOG_KEYS; k++) {
+        travel[k] = 0;
+        extreme[k] = 0;
+    }
+    analog_key_hw_init();
+    analog_key_calibrate();
+}
+
+uint8_t matrix_scan(void)
+{
+    uint8_t k = 0;
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS && k < ANALOG_KEYS; col++, k++) {
+            matrix_row_t mask = (matrix_row_t)1 << col;
+            bool on = matrix[row] & mask;
+            uint8_t t = key_travel(k);
+            uint8_t ext = extreme[k];
+            bool state = key_state(t, on, &ext);
+            travel[k] = t;
+
+            if (state != on) {
+#ifdef MATRIX_HAS_EVENTS
+                // queue full, take the change again in next scan
+                if (!matrix_event_put((keypos_t){ .row = row, .col = col }, state, timer_read())) {
+                    continue;
+                }
+#endif
+                matrix[row] ^= mask;
+                changed_rows |= MATRIX_ROW_BIT(row);
+            }
+            extreme[k] = ext;
+        }
+    }
+    return 1;
+}
+
+inline
+matrix_row_t matrix_get_row(uint8_t row)
+{
+    return matrix[row];
+}
+
+matrix_rows_t matrix_changed_rows(void)
+{
+    matrix_rows_t rows = changed_rows;
+    changed_rows = 0;
+    return rows;
+}
@@ -0,0 +1,94 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALOG_KEY_H
+#define ANALOG_KEY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Analog keys(ANALOG_KEY_ENABLE)
+ *
+ * Matrix of Hall effect or capacitive sensors whose value moves with travel
+ * of key. Sampler of platform converts all keys in background, by ADC
+ * interrupt or DMA, and matrix_scan() turns latest samples into travel of
+ * 0(rest) to 255(bottom) and key states, changes go to keyboard_task() like
+ * any matrix, or with time of the scan under MATRIX_HAS_EVENTS.
+ *
+ * Key n is row n / MATRIX_COLS and column n % MATRIX_COLS. Rest value of
+ * each key is taken at matrix_init(), no key should be held then. Travel is
+ * deviation from rest over ANALOG_KEY_RANGE counts, toward lower values with
+ * ANALOG_KEY_INVERT.
+ *
+ * Actuation:
+ *   fixed       press at actuation, release below actuation - hysteresis
+ *   rapid       press on travel of rapid_press down from the top point since
+ *               release, release on travel of rapid_release up from the
+ *               bottom point since press, anywhere past deadzone. Always
+ *               released within deadzone.
+ *
+ * Rapid trigger is on when rapid_press is not 0. Movements should be larger
+ * than noise of the sensor, no debounce is applied.
+ */
+#ifndef ANALOG_KEYS
+#define ANALOG_KEYS             (MATRIX_ROWS * MATRIX_COLS)
+#endif
+/* counts of sample from rest to bottom */
+#ifndef ANALOG_KEY_RANGE
+#define ANALOG_KEY_RANGE        200
+#endif
+/* travel of 0-255 */
+#ifndef ANALOG_KEY_ACTUATION
+#define ANALOG_KEY_ACTUATION    128
+#endif
+#ifndef ANALOG_KEY_HYSTERESIS
+#define ANALOG_KEY_HYSTERESIS   16
+#endif
+#ifndef ANALOG_KEY_DEADZONE
+#define ANALOG_KEY_DEADZONE     24
+#endif
+#ifndef ANALOG_KEY_RAPID_PRESS
+#define ANALOG_KEY_RAPID_PRESS  0
+#endif
+#ifndef ANALOG_KEY_RAPID_RELEASE
+#define ANALOG_KEY_RAPID_RELEASE    ANALOG_KEY_RAPID_PRESS
+#endif
+
+typedef struct {
+    uint8_t actuation;
+    uint8_t hysteresis;
+    uint8_t deadzone;
+    uint8_t rapid_press;        // 0: fixed actuation
+    uint8_t rapid_release;
+} analog_key_config_t;
+
+/* actuation of all keys, default is ANALOG_KEY_* of config.h */
+void analog_key_get_config(analog_key_config_t *config);
+void analog_key_set_config(const analog_key_config_t *config);
+/* travel of key at last scan, 0(rest) to 255(bottom) */
+uint8_t analog_key_travel(uint8_t key);
+/* take rest value of all keys again */
+void analog_key_calibrate(void);
+
+/* sampler of platform */
+/* start converting keys in background */
+void analog_key_hw_init(void);
+/* latest sample of key, 0 before first conversion of it */
+uint16_t analog_key_hw_read(uint8_t key);
+
+#endif
@@ -0,0 +1,140 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Sampler of analog keys on ADC of AVR
+ *
+ * Sensors are on ADC channels directly or through analog multiplexers like
+ * 74HC4051/4067 whose select lines are shared. ADC interrupt stores result
+ * and starts next conversion, it goes through all channels of a select
+ * value and then changes select lines. Mux output settles in ISR time before
+ * the sample and hold of next conversion, which needs sensors of low output
+ * impedance as Hall effect sensors with push-pull output.
+ *
+ * Key is channel_index * MUX_SIZE + select, MUX_SIZE is 1 << number of
+ * select lines(1 without mux). With MATRIX_COLS of MUX_SIZE a mux is a row.
+ *
+ *     #define ANALOG_KEY_ADC_CHANNELS(X)  X(4) X(5) X(6) X(7)
+ *     #define ANALOG_KEY_MUX_PINS(X)      X(B,4) X(B,5) X(B,6)   // S0 first
+ *
+ * At ADC clock of F_CPU/16(ANALOG_KEY_ADC_PRESCALE 4) a conversion takes
+ * 13us, 64 keys are sampled in 0.85ms. This uses ADC_vect and can not be
+ * used with other ADC users like the thumbstick of ps2_usb laser.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "matrix.h"
+#include "analog_key.h"
+
+
+#ifndef ANALOG_KEY_ADC_CHANNELS
+#   error "ANALOG_KEY_ENABLE needs ANALOG_KEY_ADC_CHANNELS in config.h"
+#endif
+/* ADPS bits, 2^n of F_CPU */
+#ifndef ANALOG_KEY_ADC_PRESCALE
+#define ANALOG_KEY_ADC_PRESCALE 4
+#endif
+
+#define CH_COUNT(ch)        +1
+#define CHANNELS            (0 ANALOG_KEY_ADC_CHANNELS(CH_COUNT))
+#ifdef ANALOG_KEY_MUX_PINS
+#   define PIN_COUNT(port, bit)    +1
+#   define MUX_SIZE         (1 << (0 ANALOG_KEY_MUX_PINS(PIN_COUNT)))
+#else
+#   define MUX_SIZE         1
+#endif
+
+#if ANALOG_KEYS > CHANNELS * MUX_SIZE
+#   error "ANALOG_KEYS exceeds channels of ANALOG_KEY_ADC_CHANNELS and ANALOG_KEY_MUX_PINS"
+#endif
+
+
+#define CH_LIST(ch)         ch,
+static const uint8_t channels[CHANNELS] = { ANALOG_KEY_ADC_CHANNELS(CH_LIST) };
+
+static volatile uint16_t samples[CHANNELS * MUX_SIZE];
+static uint8_t ch_index;
+static uint8_t mux_sel;
+
+
+static inline void adc_channel(uint8_t ch)
+{
+    ADMUX = (1<<REFS0) | (ch & 0x07);       // AVCC
+#ifdef MUX5
+    if (ch & 0x08) ADCSRB |= (1<<MUX5); else ADCSRB &= ~(1<<MUX5);
+#endif
+}
+
+#ifdef ANALOG_KEY_MUX_PINS
+static inline void mux_select(uint8_t s)
+{
+    uint8_t b = 0;
+#define X(port, bit)    if (s & (1<<b)) PORT##port |= (1<<bit); else PORT##port &= ~(1<<bit); b++;
+    ANALOG_KEY_MUX_PINS(X)
+#undef X
+}
+#endif
+
+ISR(ADC_vect)
+{
+    samples[ch_index * MUX_SIZE + mux_sel] = ADC;
+
+    if (++ch_index == CHANNELS) {
+        ch_index = 0;
+#ifdef ANALOG_KEY_MUX_PINS
+        if (++mux_sel == MUX_SIZE) mux_sel = 0;
+        mux_select(mux_sel);
+#endif
+    }
+    adc_channel(channels[ch_index]);
+    ADCSRA |= (1<<ADSC);
+}
+
+void analog_key_hw_init(void)
+{
+#ifdef ANALOG_KEY_MUX_PINS
+#define X(port, bit)    DDR##port |= (1<<bit);
+    ANALOG_KEY_MUX_PINS(X)
+#undef X
+    mux_select(0);
+#endif
+#ifdef DIDR0
+    // no digital input buffer on analog pins
+    for (uint8_t i = 0; i < CHANNELS; i++) {
+        if (channels[i] < 8) DIDR0 |= (1 << channels[i]);
+    }
+#endif
+
+    ch_index = 0;
+    mux_sel = 0;
+    adc_channel(channels[0]);
+    ADCSRA = (1<<ADEN) | (1<<ADIE) | (1<<ADSC) | (ANALOG_KEY_ADC_PRESCALE & 0x07);
+    // calibration waits for samples in matrix_init()
+    sei();
+}
+
+uint16_t analog_key_hw_read(uint8_t key)
+{
+    uint16_t v;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        v = samples[key];
+    }
+    return v;
+}
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "backlight.h"
+
+
+/*
+ * Hardware PWM backlight
+ *
+ * Timer1 drives backlight pin from its output compare in 8-bit fast PWM, CPU
+ * spends nothing on steady level. Breathing steps duty from overflow interrupt
+ * only while enabled. Duty is double-buffered by hardware and takes effect at
+ * BOTTOM without glitch.
+ *
+ * 256              clocks/period[resolution]
+ * F_CPU/64/256     periods/second(976Hz at 16MHz)
+ */
+#ifndef BACKLIGHT_PWM_CHANNEL
+#define BACKLIGHT_PWM_CHANNEL   'B'
+#endif
+
+#if BACKLIGHT_PWM_CHANNEL == 'A'
+#   define PWM_OCR      OCR1A
+#   define PWM_COM      (1<<COM1A1)
+#   define PWM_COM_INV  (1<<COM1A1 | 1<<COM1A0)
+#elif BACKLIGHT_PWM_CHANNEL == 'B'
+#   define PWM_OCR      OCR1B
+#   define PWM_COM      (1<<COM1B1)
+#   define PWM_COM_INV  (1<<COM1B1 | 1<<COM1B0)
+#elif BACKLIGHT_PWM_CHANNEL == 'C' && defined(OCR1C)
+#   define PWM_OCR      OCR1C
+#   define PWM_COM      (1<<COM1C1)
+#   define PWM_COM_INV  (1<<COM1C1 | 1<<COM1C0)
+#else
+#   error "BACKLIGHT_PWM_CHANNEL: A, B or C(32U4/AT90USB) of Timer1"
+#endif
+
+/* OC1A-C pin */
+#if defined(__AVR_ATmega32U4__) || defined(__AVR_ATmega16U4__) || \
+    defined(__AVR_AT90USB1286__) || defined(__AVR_AT90USB646__)
+#   define PWM_BIT      (5 + BACKLIGHT_PWM_CHANNEL - 'A')
+#elif defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+#   define PWM_BIT      (1 + BACKLIGHT_PWM_CHANNEL - 'A')
+#else
+#   error "define OC1x pin of the MCU"
+#endif
+
+/* pin is high on duty, low on duty with BACKLIGHT_PWM_INVERT */
+#ifdef BACKLIGHT_PWM_INVERT
+#   define PWM_ON_DUTY  PWM_COM_INV
+#   define PWM_PIN_OFF()   (PORTB |=  (1<<PWM_BIT))
+#else
+#   define PWM_ON_DUTY  PWM_COM
+#   define PWM_PIN_OFF()   (PORTB &= ~(1<<PWM_BIT))
+#endif
+
+/* overflows per step of breathing table: 64 steps in 4 seconds */
+#define BREATHING_STEP  (F_CPU/64/256/16)
+
+
+/* Duty of levels in CIE 1931 lightness, linear to eyes
+ * (0..15).each {|i| l=100.0*i/15; p ((l<=8 ? l/903.3 : ((l+16)/116)**3)*255).round }
+ */
+static const uint8_t gamma_table[16] PROGMEM = {
+0, 2, 4, 8, 13, 20, 29, 40, 54, 72, 92, 116, 145, 177, 214, 255
+};
+
+/* Breathing brighness scaled by duty of level, see sleep_led.c
+ * (0..63).each {|x| p ((sin(x/64.0*PI)**8)*255).to_i }
+ */
+static const uint8_t breathing_table[64] PROGMEM = {
+0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 6, 10,
+15, 23, 32, 44, 58, 74, 93, 113, 135, 157, 179, 199, 218, 233, 245, 252,
+255, 252, 245, 233, 218, 199, 179, 157, 135, 113, 93, 74, 58, 44, 32, 23,
+15, 10, 6, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static uint8_t level_duty = 0;
+static volatile uint8_t breathing_duty = 0;
+static bool breathing = false;
+
+
+static void pwm_init(void)
+{
+    DDRB |= (1<<PWM_BIT);
+    PWM_PIN_OFF();
+    /* Fast PWM 8-bit, clk/64 */
+    TCCR1A = (1<<WGM10);
+    TCCR1B = (1<<WGM12) | (1<<CS11) | (1<<CS10);
+}
+
+static void pwm_duty(uint8_t duty)
+{
+    if (!(TCCR1B & (1<<CS10))) pwm_init();
+
+    if (duty) {
+        PWM_OCR = duty;
+        TCCR1A |= PWM_ON_DUTY;
+    } else {
+        /* spike of a clock remains at OCR 0, disconnect pin */
+        TCCR1A &= ~PWM_COM_INV;
+        PWM_PIN_OFF();
+    }
+}
+
+void backlight_set(uint8_t level)
+{
+    if (level > BACKLIGHT_LEVELS) level = BACKLIGHT_LEVELS;
+    level_duty = pgm_read_byte(&gamma_table[(uint16_t)level * 15 / BACKLIGHT_LEVELS]);
+
+    // breathing picks it up on next step
+    if (breathing) {
+        breathing_duty = level_duty ? level_duty : 255;
+        return;
+    }
+    pwm_duty(level_duty);
+}
+
+void backlight_pwm_duty(uint8_t duty)
+{
+    if (breathing) return;
+    pwm_duty(duty);
+}
+
+void backlight_breathing_enable(void)
+{
+    if (breathing) return;
+    breathing = true;
+    // breathes at full brightness while backlight is off
+    breathing_duty = level_duty ? level_duty : 255;
+    if (!(TCCR1B & (1<<CS10))) pwm_init();
+    TIMSK1 |= (1<<TOIE1);
+}
+
+void backlight_breathing_disable(void)
+{
+    if (!breathing) return;
+    TIMSK1 &= ~(1<<TOIE1);
+    breathing = false;
+    pwm_duty(level_duty);
+}
+
+bool backlight_breathing(void)
+{
+    return breathing;
+}
+
+ISR(TIMER1_OVF_vect)
+{
+    static uint8_t count = 0;
+    static uint8_t index = 0;
+
+    if (++count < BREATHING_STEP) return;
+    count = 0;
+    index = (index + 1) & 63;
+    pwm_duty(((uint16_t)pgm_read_byte(&breathing_table[index]) * breathing_duty) >> 8);
+}
@@ -5,6 +5,8 @@
 #include <avr/wdt.h>
 #include <util/delay.h>
 #include "bootloader.h"
+#include "eeconfig.h"
+#include "watchdog.h"
 
 #ifdef PROTOCOL_LUFA
 #include <LUFA/Drivers/USB/USB.h>
@@ -73,6 +75,12 @@ uint32_t reset_key  __attribute__ ((section (".noinit")));
 
 /* initialize MCU status by watchdog reset */
 void bootloader_jump(void) {
+    eeconfig_flush();
+#ifdef WATCHDOG_ENABLE
+    // not to be taken for hang while USB detaches
+    wdt_disable();
+#endif
+
 #ifdef PROTOCOL_LUFA
     USB_Disable();
     cli();
@@ -111,6 +119,13 @@ void bootloader_jump_after_watchdog_reset(void)
         // This is compled into 'icall', address should be in word unit, not byte.
         ((void (*)(void))(BOOTLOADER_START/2))();
     }
+#ifdef WATCHDOG_ENABLE
+    // WDRF keeps watchdog running at shortest timeout, clear it before it
+    // resets MCU again and keep cause for watchdog_init()
+    watchdog_mcusr = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+#endif
 }
 
 
@@ -122,6 +137,8 @@ void bootloader_jump_after_watchdog_reset(void)
  * - needs to initialize more regisers or interrupt setting?
  */
 void bootloader_jump(void) {
+    eeconfig_flush();
+
 #ifdef PROTOCOL_LUFA
     USB_Disable();
     cli();
@@ -2,14 +2,73 @@
 #include <stdbool.h>
 #include <avr/eeprom.h>
 #include "eeconfig.h"
+#include "timer.h"
+
+
+#ifdef EECONFIG_WRITE_DELAY
+/* bytes at address 0-15 waiting for write, bit per address */
+static uint16_t pending = 0;
+static uint8_t pending_val[16];
+static uint16_t pending_time;
+
+static uint8_t read_byte(uint8_t *addr)
+{
+    uint8_t i = (uintptr_t)addr;
+    if (pending & (1U<<i)) return pending_val[i];
+    return eeprom_read_byte(addr);
+}
+
+static void write_byte(uint8_t *addr, uint8_t val)
+{
+    uint8_t i = (uintptr_t)addr;
+    pending_val[i] = val;
+    pending |= (1U<<i);
+    pending_time = timer_read();
+}
+
+static void write_pending(void)
+{
+    uint8_t i = 0;
+    while (!(pending & (1U<<i))) i++;
+    pending &= ~(1U<<i);
+    // no write cycle when value is back to the stored one
+    eeprom_update_byte((uint8_t *)(uintptr_t)i, pending_val[i]);
+}
+
+void eeconfig_task(void)
+{
+    if (pending && eeprom_is_ready() &&
+            timer_elapsed(pending_time) >= EECONFIG_WRITE_DELAY) {
+        write_pending();
+    }
+}
+
+void eeconfig_flush(void)
+{
+    while (pending) write_pending();
+    eeprom_busy_wait();
+}
+#else
+#define read_byte(addr)         eeprom_read_byte(addr)
+#define write_byte(addr, val)   eeprom_write_byte((addr), (val))
+#endif
+
 
 void eeconfig_init(void)
 {
+#ifdef EECONFIG_WRITE_DELAY
+    pending = 0;
+#endif
     eeprom_write_word(EECONFIG_MAGIC,          EECONFIG_MAGIC_NUMBER);
     eeprom_write_byte(EECONFIG_DEBUG,          0);
     eeprom_write_byte(EECONFIG_DEFAULT_LAYER,  0);
     eeprom_write_byte(EECONFIG_KEYMAP,         0);
     eeprom_write_byte(EECONFIG_MOUSEKEY_ACCEL, 0);
+    eeprom_write_byte(EECONFIG_MATRIX_TIMING,  0);
+    eeprom_write_byte(EECONFIG_SCAN_RATE,      0);
+    for (uint8_t i = 0; i < EECONFIG_TAPPING_TERM_SLOTS; i++) {
+        eeprom_write_byte(EECONFIG_TAPPING_TERM + i, 0);
+    }
 #ifdef BACKLIGHT_ENABLE
     eeprom_write_byte(EECONFIG_BACKLIGHT,      0);
 #endif
@@ -30,16 +89,22 @@ bool eeconfig_is_enabled(void)
     return (eeprom_read_word(EECONFIG_MAGIC) == EECONFIG_MAGIC_NUMBER);
 }
 
-uint8_t eeconfig_read_debug(void)      { return eeprom_read_byte(EECONFIG_DEBUG); }
-void eeconfig_write_debug(uint8_t val) { eeprom_write_byte(EECONFIG_DEBUG, val); }
+uint8_t eeconfig_read_debug(void)      { return read_byte(EECONFIG_DEBUG); }
+void eeconfig_write_debug(uint8_t val) { write_byte(EECONFIG_DEBUG, val); }
+
+uint8_t eeconfig_read_default_layer(void)      { return read_byte(EECONFIG_DEFAULT_LAYER); }
+void eeconfig_write_default_layer(uint8_t val) { write_byte(EECONFIG_DEFAULT_LAYER, val); }
+
+uint8_t eeconfig_read_keymap(void)      { return read_byte(EECONFIG_KEYMAP); }
+void eeconfig_write_keymap(uint8_t val) { write_byte(EECONFIG_KEYMAP, val); }
 
-uint8_t eeconfig_read_default_layer(void)      { return eeprom_read_byte(EECONFIG_DEFAULT_LAYER); }
-void eeconfig_write_default_layer(uint8_t val) { eeprom_write_byte(EECONFIG_DEFAULT_LAYER, val); }
+uint8_t eeconfig_read_scan_rate(void)      { return read_byte(EECONFIG_SCAN_RATE); }
+void eeconfig_write_scan_rate(uint8_t val) { write_byte(EECONFIG_SCAN_RATE, val); }
 
-uint8_t eeconfig_read_keymap(void)      { return eeprom_read_byte(EECONFIG_KEYMAP); }
-void eeconfig_write_keymap(uint8_t val) { eeprom_write_byte(EECONFIG_KEYMAP, val); }
+uint8_t eeconfig_read_tapping_term(uint8_t slot)      { return read_byte(EECONFIG_TAPPING_TERM + slot); }
+void eeconfig_write_tapping_term(uint8_t slot, uint8_t val) { write_byte(EECONFIG_TAPPING_TERM + slot, val); }
 
 #ifdef BACKLIGHT_ENABLE
-uint8_t eeconfig_read_backlight(void)      { return eeprom_read_byte(EECONFIG_BACKLIGHT); }
-void eeconfig_write_backlight(uint8_t val) { eeprom_write_byte(EECONFIG_BACKLIGHT, val); }
+uint8_t eeconfig_read_backlight(void)      { return read_byte(EECONFIG_BACKLIGHT); }
+void eeconfig_write_backlight(uint8_t val) { write_byte(EECONFIG_BACKLIGHT, val); }
 #endif
@@ -0,0 +1,206 @@
+/*
+Copyright 2012 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Generic matrix scanner(GENERIC_MATRIX_ENABLE)
+ *
+ * Board lists its pins in config.h in order of row and column, by port letter
+ * and bit:
+ *
+ *     #define MATRIX_ROW_PINS(X)  X(D,0) X(D,1) X(D,2) X(D,3) X(D,5)
+ *     #define MATRIX_COL_PINS(X)  X(F,0) X(F,1) X(E,6) X(C,7) ...
+ *
+ * Lists expand into straight code at compile time, so that every pin is a
+ * single bit instruction on I/O register(sbis/sbi/cbi) like hand-written
+ * scanner. Rows are driven low to select and Hi-Z to unselect, columns are
+ * inputs with pull-up and read low for key on. Optional
+ * MATRIX_COL_ALIAS_PINS(Y) lists Y(col,port,bit) for a second pin read into
+ * the same column, for board revisions that moved a column.
+ *
+ * Changes go through debounce(), so DEBOUNCE_TYPE picks per row or per key
+ * debouncing for the board.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <util/delay.h>
+#include "print.h"
+#include "debug.h"
+#include "util.h"
+#include "matrix.h"
+#include "debounce.h"
+
+
+#if !defined(MATRIX_ROW_PINS) || !defined(MATRIX_COL_PINS)
+#   error "GENERIC_MATRIX_ENABLE needs MATRIX_ROW_PINS and MATRIX_COL_PINS in config.h"
+#endif
+
+#define PIN_COUNT(port, bit)    +1
+#if (0 MATRIX_ROW_PINS(PIN_COUNT)) != MATRIX_ROWS
+#   error "MATRIX_ROW_PINS must list MATRIX_ROWS pins"
+#endif
+#if (0 MATRIX_COL_PINS(PIN_COUNT)) != MATRIX_COLS
+#   error "MATRIX_COL_PINS must list MATRIX_COLS pins"
+#endif
+
+/* wait for column lines to settle after row select(us) */
+#ifndef MATRIX_SETTLE_US
+#define MATRIX_SETTLE_US    30
+#endif
+
+
+/* matrix state(1:on, 0:off) */
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_debouncing[MATRIX_ROWS];
+/* debounced matrix was updated since matrix_changed_rows() */
+static matrix_rows_t changed_rows = MATRIX_ROWS_ALL;
+
+static matrix_row_t read_cols(void);
+static void init_cols(void);
+static void unselect_rows(void);
+static void select_row(uint8_t row);
+#ifdef IDLE_SLEEP_ENABLE
+static void select_all_rows(void);
+#endif
+
+
+void matrix_init(void)
+{
+    // initialize row and col
+    unselect_rows();
+    init_cols();
+
+    // initialize matrix state: all keys off
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
+        matrix[i] = 0;
+        matrix_debouncing[i] = 0;
+    }
+    debounce_init();
+}
+
+uint8_t matrix_scan(void)
+{
+    bool changed = false;
+
+#ifdef IDLE_SLEEP_ENABLE
+    /* When nothing is down read all rows at once and skip scan */
+    if (!debounce_active()) {
+        bool idle = true;
+        for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+            if (matrix_debouncing[i]) idle = false;
+        }
+        if (idle) {
+            select_all_rows();
+            _delay_us(MATRIX_SETTLE_US);
+            matrix_row_t cols = read_cols();
+            unselect_rows();
+            if (!cols) return 1;
+        }
+    }
+#endif
+
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        select_row(i);
+        _delay_us(MATRIX_SETTLE_US);  // without this wait read unstable value.
+        matrix_row_t cols = read_cols();
+        if (matrix_debouncing[i] != cols) {
+            matrix_debouncing[i] = cols;
+            if (debounce_active()) {
+                debug("bounce!\n");
+            }
+            changed = true;
+        }
+        unselect_rows();
+    }
+
+    if (debounce(matrix_debouncing, matrix, changed)) {
+        changed_rows = MATRIX_ROWS_ALL;
+    }
+
+    return 1;
+}
+
+inline
+matrix_row_t matrix_get_row(uint8_t row)
+{
+    return matrix[row];
+}
+
+matrix_rows_t matrix_changed_rows(void)
+{
+    matrix_rows_t rows = changed_rows;
+    changed_rows = 0;
+    return rows;
+}
+
+static void  init_cols(void)
+{
+    // Input with pull-up(DDR:0, PORT:1)
+#define X(port, bit)        DDR##port &= ~(1<<bit); PORT##port |= (1<<bit);
+    MATRIX_COL_PINS(X)
+#ifdef MATRIX_COL_ALIAS_PINS
+#define Y(col, port, bit)   X(port, bit)
+    MATRIX_COL_ALIAS_PINS(Y)
+#undef Y
+#endif
+#undef X
+}
+
+/* Returns status of switches(1:on, 0:off) */
+static matrix_row_t read_cols(void)
+{
+    matrix_row_t cols = 0;
+    uint8_t col = 0;
+    // col is constant at each pin after compile
+#define X(port, bit)        if (!(PIN##port & (1<<bit))) cols |= ((matrix_row_t)1<<col); col++;
+    MATRIX_COL_PINS(X)
+#undef X
+#ifdef MATRIX_COL_ALIAS_PINS
+#define Y(c, port, bit)     if (!(PIN##port & (1<<bit))) cols |= ((matrix_row_t)1<<(c));
+    MATRIX_COL_ALIAS_PINS(Y)
+#undef Y
+#endif
+    (void)col;
+    return cols;
+}
+
+static void unselect_rows(void)
+{
+    // Hi-Z(DDR:0, PORT:0) to unselect
+#define X(port, bit)        DDR##port &= ~(1<<bit); PORT##port &= ~(1<<bit);
+    MATRIX_ROW_PINS(X)
+#undef X
+}
+
+static void select_row(uint8_t row)
+{
+    // Output low(DDR:1, PORT:0) to select
+    uint8_t r = 0;
+#define X(port, bit)        if (row == r) { DDR##port |= (1<<bit); PORT##port &= ~(1<<bit); } r++;
+    MATRIX_ROW_PINS(X)
+#undef X
+}
+
+#ifdef IDLE_SLEEP_ENABLE
+static void select_all_rows(void)
+{
+    // Output low(DDR:1, PORT:0) to select
+#define X(port, bit)        DDR##port |= (1<<bit); PORT##port &= ~(1<<bit);
+    MATRIX_ROW_PINS(X)
+#undef X
+}
+#endif
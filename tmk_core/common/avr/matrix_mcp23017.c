@@ -0,0 +1,339 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Matrix scanner of MCP23017 I2C IO expander(MCP23017_MATRIX_ENABLE)
+ *
+ * Rows are GPA0-7 of expander, driven low to select and Hi-Z to unselect.
+ * Columns are GPB0-7 with pull-up of expander. Whole scan is one I2C
+ * transaction, with repeated start each row is selected with write of IODIRA
+ * and its columns are read from GPIOB. Scan ends with all rows selected.
+ *
+ * While no key is down rows stay selected and interrupt-on-change of columns
+ * is armed, INTA/INTB of expander go low on first press. With MCP23017_INT_PIN
+ * scan just looks at the pin and bus is idle until the pin gets low, without
+ * it one byte of GPIOB is read per scan.
+ *
+ *     #define MCP23017_ADDR       0x20        // A2-A0 low
+ *     #define MCP23017_INT_PIN    D,2         // INTA or INTB of expander
+ *
+ * With MCP23017_INT_INIT()/ON()/OFF()/VECT of external or pin change
+ * interrupt on the pin, as PS2_INT_* of ps2_usb, the interrupt wakes MCU
+ * from sleep of suspend and calls keyboard_scan_wakeup() with
+ * MATRIX_SCAN_ADAPTIVE. It is on only while idle and between
+ * matrix_power_down() and matrix_power_up().
+ *
+ * Expander not responding is retried every MCP23017_RETRY_MS with all keys
+ * released. Changes go through debounce() like generic matrix.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+#include "print.h"
+#include "debug.h"
+#include "timer.h"
+#include "keyboard.h"
+#include "matrix.h"
+#include "debounce.h"
+
+
+#if MATRIX_ROWS > 8 || MATRIX_COLS > 8
+#   error "MCP23017_MATRIX_ENABLE supports up to 8 rows on GPA and 8 columns on GPB"
+#endif
+
+#ifndef MCP23017_ADDR
+#define MCP23017_ADDR       0x20
+#endif
+#ifndef MCP23017_I2C_FREQ
+#define MCP23017_I2C_FREQ   400000UL
+#endif
+#ifndef MCP23017_RETRY_MS
+#define MCP23017_RETRY_MS   1000
+#endif
+#ifndef MCP23017_INT_ON
+#define MCP23017_INT_ON()
+#endif
+#ifndef MCP23017_INT_OFF
+#define MCP23017_INT_OFF()
+#endif
+
+/* registers in IOCON.BANK=0 */
+#define IODIRA      0x00
+#define GPIOB       0x13
+#define OLATA       0x14
+#define IOCON_MIRROR    (1<<6)
+
+#define ROW_MASK    ((uint8_t)((1U << MATRIX_ROWS) - 1))
+#define COL_MASK    ((uint8_t)((1U << MATRIX_COLS) - 1))
+
+/* pin given as port letter and bit */
+#define PIN_IN(p)       PIN_IN_(p)
+#define PIN_IN_(port, bit)      (DDR##port &= ~(1<<bit), PORT##port |= (1<<bit))
+#define PIN_READ(p)     PIN_READ_(p)
+#define PIN_READ_(port, bit)    (PIN##port & (1<<bit))
+
+
+/* matrix state(1:on, 0:off) */
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_debouncing[MATRIX_ROWS];
+/* debounced matrix was updated since matrix_changed_rows() */
+static matrix_rows_t changed_rows = MATRIX_ROWS_ALL;
+
+static bool expander_ok = false;
+static bool idle = false;
+static uint16_t retry_time;
+
+
+/*
+ * Blocking TWI master, each step gives up when TWI makes no progress
+ */
+static bool twi_wait(void)
+{
+    uint16_t n = 0;
+    while (!(TWCR & (1<<TWINT))) {
+        if (++n == 0) return false;
+    }
+    return true;
+}
+
+static bool twi_start(uint8_t sla)
+{
+    TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
+    if (!twi_wait()) return false;
+    if (TW_STATUS != TW_START && TW_STATUS != TW_REP_START) return false;
+    TWDR = sla;
+    TWCR = (1<<TWINT) | (1<<TWEN);
+    if (!twi_wait()) return false;
+    return TW_STATUS == TW_MT_SLA_ACK || TW_STATUS == TW_MR_SLA_ACK;
+}
+
+static bool twi_write(uint8_t data)
+{
+    TWDR = data;
+    TWCR = (1<<TWINT) | (1<<TWEN);
+    if (!twi_wait()) return false;
+    return TW_STATUS == TW_MT_DATA_ACK;
+}
+
+/* last byte of read is not acked */
+static bool twi_read(uint8_t *data)
+{
+    TWCR = (1<<TWINT) | (1<<TWEN);
+    if (!twi_wait()) return false;
+    *data = TWDR;
+    return TW_STATUS == TW_MR_DATA_NACK;
+}
+
+static void twi_stop(void)
+{
+    TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
+}
+
+/* register write and register read to be chained with repeated start */
+static bool reg_write(uint8_t reg, uint8_t data)
+{
+    return twi_start((MCP23017_ADDR << 1) | TW_WRITE) && twi_write(reg) && twi_write(data);
+}
+
+static bool reg_read(uint8_t reg, uint8_t *data)
+{
+    return twi_start((MCP23017_ADDR << 1) | TW_WRITE) && twi_write(reg) &&
+           twi_start((MCP23017_ADDR << 1) | TW_READ) && twi_read(data);
+}
+
+
+static bool expander_init(void)
+{
+    /* sequential write from IODIRA */
+    static const uint8_t regs[] = {
+        0xFF,           // IODIRA: rows Hi-Z
+        0xFF,           // IODIRB: columns input
+        0x00,           // IPOLA
+        0xFF,           // IPOLB: key on reads 1
+        0x00,           // GPINTENA
+        COL_MASK,       // GPINTENB: interrupt on change of columns
+        0x00, 0x00,     // DEFVALA/B
+        0x00, 0x00,     // INTCONA/B: compare with previous value
+        IOCON_MIRROR,   // IOCON: INTA and INTB both, active low
+        IOCON_MIRROR,   // IOCON
+        0x00,           // GPPUA
+        0xFF,           // GPPUB: pull-up on columns
+    };
+    uint8_t cols;
+
+    bool ok = twi_start((MCP23017_ADDR << 1) | TW_WRITE) && twi_write(IODIRA);
+    for (uint8_t i = 0; ok && i < sizeof(regs); i++) {
+        ok = twi_write(regs[i]);
+    }
+    // rows output low when selected, then select all and clear interrupt
+    ok = ok && reg_write(OLATA, 0x00) &&
+         reg_write(IODIRA, (uint8_t)~ROW_MASK) && reg_read(GPIOB, &cols);
+    twi_stop();
+    return ok;
+}
+
+static void expander_lost(void)
+{
+    dprint("mcp23017: not responding\n");
+    expander_ok = false;
+    idle = false;
+    MCP23017_INT_OFF();
+    retry_time = timer_read();
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        matrix_debouncing[i] = 0;
+    }
+}
+
+/* reads all rows in one transaction, ends with all rows selected */
+static bool read_rows(matrix_row_t *rows, uint8_t *all)
+{
+    bool ok = true;
+    for (uint8_t i = 0; ok && i < MATRIX_ROWS; i++) {
+        uint8_t cols = 0;
+        ok = reg_write(IODIRA, (uint8_t)~(1<<i)) && reg_read(GPIOB, &cols);
+        rows[i] = cols & COL_MASK;
+    }
+    ok = ok && reg_write(IODIRA, (uint8_t)~ROW_MASK) && reg_read(GPIOB, all);
+    twi_stop();
+    return ok;
+}
+
+#ifndef MCP23017_INT_PIN
+/* columns with all rows selected, also clears interrupt */
+static bool read_all(uint8_t *all)
+{
+    bool ok = reg_read(GPIOB, all);
+    twi_stop();
+    return ok;
+}
+#endif
+
+
+void matrix_init(void)
+{
+    // I2C at MCP23017_I2C_FREQ with pull-ups of SDA/SCL
+    TWSR = 0;
+    TWBR = ((F_CPU / MCP23017_I2C_FREQ) - 16) / 2;
+#ifdef MCP23017_INT_PIN
+    PIN_IN(MCP23017_INT_PIN);
+#endif
+#ifdef MCP23017_INT_INIT
+    MCP23017_INT_INIT();
+#endif
+
+    // initialize matrix state: all keys off
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
+        matrix[i] = 0;
+        matrix_debouncing[i] = 0;
+    }
+    debounce_init();
+
+    expander_ok = expander_init();
+    if (!expander_ok) expander_lost();
+}
+
+uint8_t matrix_scan(void)
+{
+    bool changed = false;
+
+    if (!expander_ok && timer_elapsed(retry_time) > MCP23017_RETRY_MS) {
+        expander_ok = expander_init();
+        if (!expander_ok) retry_time = timer_read();
+    }
+
+    if (expander_ok && idle) {
+        /* no change of columns since all rows were selected */
+#ifdef MCP23017_INT_PIN
+        if (PIN_READ(MCP23017_INT_PIN)) return 1;
+#else
+        uint8_t all;
+        if (!read_all(&all)) {
+            expander_lost();
+            return 1;
+        }
+        if (!(all & COL_MASK)) return 1;
+#endif
+        idle = false;
+        MCP23017_INT_OFF();
+    }
+
+    if (expander_ok) {
+        matrix_row_t rows[MATRIX_ROWS];
+        uint8_t all = 0;
+        if (read_rows(rows, &all)) {
+            for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+                if (matrix_debouncing[i] != rows[i]) {
+                    matrix_debouncing[i] = rows[i];
+                    if (debounce_active()) {
+                        debug("bounce!\n");
+                    }
+                    changed = true;
+                }
+            }
+        } else {
+            expander_lost();
+            changed = true;
+        }
+
+        /* nothing down, wait for interrupt-on-change */
+        if (expander_ok && !changed && !debounce_active() && !(all & COL_MASK)) {
+            idle = true;
+            MCP23017_INT_ON();
+        }
+    }
+
+    if (debounce(matrix_debouncing, matrix, changed)) {
+        changed_rows = MATRIX_ROWS_ALL;
+    }
+
+    return 1;
+}
+
+inline
+matrix_row_t matrix_get_row(uint8_t row)
+{
+    return matrix[row];
+}
+
+matrix_rows_t matrix_changed_rows(void)
+{
+    matrix_rows_t rows = changed_rows;
+    changed_rows = 0;
+    return rows;
+}
+
+/* interrupt wakes MCU from sleep while matrix is powered down */
+void matrix_power_down(void)
+{
+    if (expander_ok) MCP23017_INT_ON();
+}
+
+void matrix_power_up(void)
+{
+    if (!idle) MCP23017_INT_OFF();
+}
+
+#ifdef MCP23017_INT_VECT
+ISR(MCP23017_INT_VECT)
+{
+#ifdef MATRIX_SCAN_ADAPTIVE
+    keyboard_scan_wakeup();
+#endif
+}
+#endif
@@ -0,0 +1,289 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Shift register matrix scanner on hardware SPI(SPI_MATRIX_ENABLE)
+ *
+ * Columns are read from chain of 74HC165: SH/LD pin pulsed low latches all
+ * column inputs and SPI clocks out column bytes of the row back to back, in
+ * a burst of 1us per byte at F_CPU/2. Byte nearest to MISO comes first and
+ * is columns 0-7, bit of H input first is column 7 unless MATRIX_SPI_LSB_FIRST.
+ * Inputs pulled up read low for key on.
+ *
+ * Rows are either pins as in generic matrix(MATRIX_ROW_PINS) or chain of
+ * 74HC595 on the same SPI with latch pin(MATRIX_SPI_ROW_LATCH), whose outputs
+ * are driven low to select. 74HC165 shifting while rows are written is
+ * harmless as it is loaded again before read.
+ *
+ *     #define MATRIX_SPI_LOAD         B,4     // SH/LD of 74HC165
+ *     #define MATRIX_SPI_ROW_LATCH    B,5     // RCLK of 74HC595, or MATRIX_ROW_PINS
+ *     #define MATRIX_SPI_MODE         0       // CPOL/CPHA
+ *
+ * Changes go through debounce() like generic matrix.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <util/delay.h>
+#include "print.h"
+#include "debug.h"
+#include "util.h"
+#include "matrix.h"
+#include "debounce.h"
+
+
+#ifndef MATRIX_SPI_LOAD
+#   error "SPI_MATRIX_ENABLE needs MATRIX_SPI_LOAD pin of 74HC165 in config.h"
+#endif
+#if !defined(MATRIX_ROW_PINS) && !defined(MATRIX_SPI_ROW_LATCH)
+#   error "SPI_MATRIX_ENABLE needs MATRIX_ROW_PINS or MATRIX_SPI_ROW_LATCH in config.h"
+#endif
+#if defined(MATRIX_ROW_PINS)
+#   define PIN_COUNT(port, bit)    +1
+#   if (0 MATRIX_ROW_PINS(PIN_COUNT)) != MATRIX_ROWS
+#       error "MATRIX_ROW_PINS must list MATRIX_ROWS pins"
+#   endif
+#endif
+
+/* SPI pins: SS has to be output to stay master */
+#if defined(__AVR_ATmega32U4__) || defined(__AVR_ATmega32U2__) || defined(__AVR_ATmega16U2__) || \
+    defined(__AVR_AT90USB1286__) || defined(__AVR_AT90USB646__) || defined(__AVR_AT90USB162__)
+#   define SPI_SS       B,0
+#   define SPI_SCK      B,1
+#   define SPI_MOSI     B,2
+#   define SPI_MISO     B,3
+#elif defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__) || defined(__AVR_ATmega88__)
+#   define SPI_SS       B,2
+#   define SPI_MOSI     B,3
+#   define SPI_MISO     B,4
+#   define SPI_SCK      B,5
+#else
+#   error "SPI_MATRIX_ENABLE: SPI pins of this MCU are not known"
+#endif
+
+#ifndef MATRIX_SPI_MODE
+#define MATRIX_SPI_MODE     0
+#endif
+/* wait for column lines to settle after row select(us) */
+#ifndef MATRIX_SETTLE_US
+#define MATRIX_SETTLE_US    30
+#endif
+
+#define COL_BYTES   ((MATRIX_COLS + 7) / 8)
+#define ROW_BYTES   ((MATRIX_ROWS + 7) / 8)
+
+/* pin given as port letter and bit */
+#define PIN_OUT(p)      PIN_OUT_(p)
+#define PIN_OUT_(port, bit)     (DDR##port |= (1<<bit))
+#define PIN_IN(p)       PIN_IN_(p)
+#define PIN_IN_(port, bit)      (DDR##port &= ~(1<<bit))
+#define PIN_HI(p)       PIN_HI_(p)
+#define PIN_HI_(port, bit)      (PORT##port |= (1<<bit))
+#define PIN_LO(p)       PIN_LO_(p)
+#define PIN_LO_(port, bit)      (PORT##port &= ~(1<<bit))
+
+
+/* matrix state(1:on, 0:off) */
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_debouncing[MATRIX_ROWS];
+/* debounced matrix was updated since matrix_changed_rows() */
+static matrix_rows_t changed_rows = MATRIX_ROWS_ALL;
+
+static void spi_init(void);
+static matrix_row_t read_cols(void);
+static void unselect_rows(void);
+static void select_row(uint8_t row);
+#ifdef IDLE_SLEEP_ENABLE
+static void select_all_rows(void);
+#endif
+
+
+void matrix_init(void)
+{
+    spi_init();
+    unselect_rows();
+
+    // initialize matrix state: all keys off
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
+        matrix[i] = 0;
+        matrix_debouncing[i] = 0;
+    }
+    debounce_init();
+}
+
+uint8_t matrix_scan(void)
+{
+    bool changed = false;
+
+#ifdef IDLE_SLEEP_ENABLE
+    /* When nothing is down read all rows at once and skip scan */
+    if (!debounce_active()) {
+        bool idle = true;
+        for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+            if (matrix_debouncing[i]) idle = false;
+        }
+        if (idle) {
+            select_all_rows();
+            _delay_us(MATRIX_SETTLE_US);
+            matrix_row_t cols = read_cols();
+            unselect_rows();
+            if (!cols) return 1;
+        }
+    }
+#endif
+
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        select_row(i);
+        _delay_us(MATRIX_SETTLE_US);  // without this wait read unstable value.
+        matrix_row_t cols = read_cols();
+        if (matrix_debouncing[i] != cols) {
+            matrix_debouncing[i] = cols;
+            if (debounce_active()) {
+                debug("bounce!\n");
+            }
+            changed = true;
+        }
+    }
+    unselect_rows();
+
+    if (debounce(matrix_debouncing, matrix, changed)) {
+        changed_rows = MATRIX_ROWS_ALL;
+    }
+
+    return 1;
+}
+
+inline
+matrix_row_t matrix_get_row(uint8_t row)
+{
+    return matrix[row];
+}
+
+matrix_rows_t matrix_changed_rows(void)
+{
+    matrix_rows_t rows = changed_rows;
+    changed_rows = 0;
+    return rows;
+}
+
+static void spi_init(void)
+{
+    PIN_OUT(SPI_SS);  PIN_HI(SPI_SS);
+    PIN_OUT(SPI_SCK);
+    PIN_OUT(SPI_MOSI);
+    PIN_IN(SPI_MISO);
+    PIN_OUT(MATRIX_SPI_LOAD); PIN_HI(MATRIX_SPI_LOAD);
+#ifdef MATRIX_SPI_ROW_LATCH
+    PIN_OUT(MATRIX_SPI_ROW_LATCH); PIN_LO(MATRIX_SPI_ROW_LATCH);
+#endif
+
+    // master at F_CPU/2
+    SPCR = (1<<SPE) | (1<<MSTR) | ((MATRIX_SPI_MODE & 3) << CPHA)
+#ifdef MATRIX_SPI_LSB_FIRST
+           | (1<<DORD)
+#endif
+           ;
+    SPSR = (1<<SPI2X);
+}
+
+static inline uint8_t spi_transfer(uint8_t data)
+{
+    SPDR = data;
+    while (!(SPSR & (1<<SPIF))) ;
+    return SPDR;
+}
+
+/* Returns status of switches(1:on, 0:off) */
+static matrix_row_t read_cols(void)
+{
+    // latch inputs, 74HC165 takes 20ns of low
+    PIN_LO(MATRIX_SPI_LOAD);
+    PIN_HI(MATRIX_SPI_LOAD);
+
+    matrix_row_t cols = 0;
+    for (uint8_t i = 0; i < COL_BYTES; i++) {
+        cols |= (matrix_row_t)(uint8_t)~spi_transfer(0xFF) << (i * 8);
+    }
+#if (MATRIX_COLS % 8)
+    cols &= ((matrix_row_t)1 << MATRIX_COLS) - 1;
+#endif
+    return cols;
+}
+
+#ifdef MATRIX_SPI_ROW_LATCH
+/* bits of rows low to select, last byte goes to 74HC595 nearest to MCU */
+static void write_rows(const uint8_t *rows)
+{
+    for (uint8_t i = ROW_BYTES; i--; ) {
+        spi_transfer(rows[i]);
+    }
+    PIN_HI(MATRIX_SPI_ROW_LATCH);
+    PIN_LO(MATRIX_SPI_ROW_LATCH);
+}
+
+static void unselect_rows(void)
+{
+    uint8_t rows[ROW_BYTES];
+    for (uint8_t i = 0; i < ROW_BYTES; i++) rows[i] = 0xFF;
+    write_rows(rows);
+}
+
+static void select_row(uint8_t row)
+{
+    uint8_t rows[ROW_BYTES];
+    for (uint8_t i = 0; i < ROW_BYTES; i++) rows[i] = 0xFF;
+    rows[row / 8] &= ~(1 << (row % 8));
+    write_rows(rows);
+}
+
+#ifdef IDLE_SLEEP_ENABLE
+static void select_all_rows(void)
+{
+    uint8_t rows[ROW_BYTES];
+    for (uint8_t i = 0; i < ROW_BYTES; i++) rows[i] = 0x00;
+    write_rows(rows);
+}
+#endif
+#else
+static void unselect_rows(void)
+{
+    // Hi-Z(DDR:0, PORT:0) to unselect
+#define X(port, bit)        DDR##port &= ~(1<<bit); PORT##port &= ~(1<<bit);
+    MATRIX_ROW_PINS(X)
+#undef X
+}
+
+static void select_row(uint8_t row)
+{
+    unselect_rows();
+    // Output low(DDR:1, PORT:0) to select
+    uint8_t r = 0;
+#define X(port, bit)        if (row == r) { DDR##port |= (1<<bit); PORT##port &= ~(1<<bit); } r++;
+    MATRIX_ROW_PINS(X)
+#undef X
+}
+
+#ifdef IDLE_SLEEP_ENABLE
+static void select_all_rows(void)
+{
+    // Output low(DDR:1, PORT:0) to select
+#define X(port, bit)        DDR##port |= (1<<bit); PORT##port &= ~(1<<bit);
+    MATRIX_ROW_PINS(X)
+#undef X
+}
+#endif
+#endif
@@ -0,0 +1,103 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "timer_avr.h"
+#include "profile.h"
+
+
+#ifdef __AVR_3_BYTE_PC__
+#   define PC_BYTES     3
+#else
+#   define PC_BYTES     2
+#endif
+
+static uint8_t count = 0;
+
+
+/* called from ISR below with word address of interrupted code */
+void profile_sample_pc(uint16_t pc) __attribute__ ((used));
+void profile_sample_pc(uint16_t pc)
+{
+    if (++count < PROFILE_INTERVAL) return;
+    count = 0;
+    profile_sample((uint32_t)pc << 1);
+}
+
+void profile_init(void)
+{
+    // Timer0 runs CTC to OCR0A for tick of timer.c, B matches midway
+    OCR0B = TIMER_RAW_TOP / 2;
+#ifdef TIMSK0
+    TIMSK0 |= (1<<OCIE0B);
+#else
+    TIMSK |= (1<<OCIE0B);
+#endif
+}
+
+/*
+ * Naked to know where return address is: 15 bytes of registers saved here
+ * are above SP, then PC of interrupted code with high byte first. High byte
+ * of 3-byte PC is dropped, code above 128KB is off by 128KB.
+ */
+ISR(TIMER0_COMPB_vect, ISR_NAKED)
+{
+    __asm__ __volatile__ (
+        "push   r0                  \n\t"
+        "in     r0, __SREG__        \n\t"
+        "push   r0                  \n\t"
+        "push   r1                  \n\t"
+        "clr    r1                  \n\t"
+        "push   r18                 \n\t"
+        "push   r19                 \n\t"
+        "push   r20                 \n\t"
+        "push   r21                 \n\t"
+        "push   r22                 \n\t"
+        "push   r23                 \n\t"
+        "push   r24                 \n\t"
+        "push   r25                 \n\t"
+        "push   r26                 \n\t"
+        "push   r27                 \n\t"
+        "push   r30                 \n\t"
+        "push   r31                 \n\t"
+        "in     r30, __SP_L__       \n\t"
+        "in     r31, __SP_H__       \n\t"
+        "ldd    r25, Z+%[hi]        \n\t"
+        "ldd    r24, Z+%[lo]        \n\t"
+        "%~call profile_sample_pc   \n\t"
+        "pop    r31                 \n\t"
+        "pop    r30                 \n\t"
+        "pop    r27                 \n\t"
+        "pop    r26                 \n\t"
+        "pop    r25                 \n\t"
+        "pop    r24                 \n\t"
+        "pop    r23                 \n\t"
+        "pop    r22                 \n\t"
+        "pop    r21                 \n\t"
+        "pop    r20                 \n\t"
+        "pop    r19                 \n\t"
+        "pop    r18                 \n\t"
+        "pop    r1                  \n\t"
+        "pop    r0                  \n\t"
+        "out    __SREG__, r0        \n\t"
+        "pop    r0                  \n\t"
+        "reti                       \n\t"
+        :
+        : [hi] "I" (15 + PC_BYTES - 1), [lo] "I" (15 + PC_BYTES)
+    );
+}
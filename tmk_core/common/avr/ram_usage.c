@@ -0,0 +1,75 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <avr/io.h>
+#include "print.h"
+#include "ram_usage.h"
+
+
+#define PAINT   0xC5
+
+/* from avr-libc linker script */
+extern uint8_t __data_start;
+extern uint8_t __data_end;
+extern uint8_t __bss_start;
+extern uint8_t __bss_end;
+extern uint8_t _end;
+extern uint8_t __stack;
+
+/* .init1 runs before stack pointer and zero register are set up, no C here */
+void ram_usage_paint(void) __attribute__ ((naked, used, section(".init1")));
+void ram_usage_paint(void)
+{
+    __asm__ volatile (
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :: "M" (PAINT)
+    );
+}
+
+uint16_t ram_usage_free_min(void)
+{
+    const uint8_t *p = &_end;
+    while (p <= &__stack && *p == PAINT) p++;
+    return p - &_end;
+}
+
+uint16_t ram_usage_stack_max(void)
+{
+    return (&__stack - &_end + 1) - ram_usage_free_min();
+}
+
+void ram_usage_print(void)
+{
+    uint8_t here;
+    xprintf("\n\t- RAM usage -\n");
+    xprintf("total     %u\n", (unsigned)(&__stack - (uint8_t *)RAMSTART + 1));
+    xprintf("data      %u\n", (unsigned)(&__data_end - &__data_start));
+    xprintf("bss       %u\n", (unsigned)(&__bss_end - &__bss_start));
+    xprintf("stack now %u\n", (unsigned)(&__stack - &here));
+    xprintf("stack max %u\n", ram_usage_stack_max());
+    xprintf("free min  %u\n", ram_usage_free_min());
+}
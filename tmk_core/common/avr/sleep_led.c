@@ -4,6 +4,143 @@
 #include <avr/pgmspace.h>
 #include "led.h"
 #include "sleep_led.h"
+#include "backlight.h"
+
+
+#ifdef BACKLIGHT_PWM_ENABLE
+/* Timer1 is backlight PWM, breathe backlight instead */
+void sleep_led_init(void)
+{
+}
+
+void sleep_led_enable(void)
+{
+    backlight_breathing_enable();
+}
+
+void sleep_led_disable(void)
+{
+    backlight_breathing_disable();
+}
+
+#else
+
+__attribute__ ((weak))
+void sleep_led_on(void)
+{
+    led_set(1<<USB_LED_CAPS_LOCK);
+}
+
+__attribute__ ((weak))
+void sleep_led_off(void)
+{
+    led_set(0);
+}
+
+
+/* Breathing Sleep LED brighness(PWM On period) table
+ * (64[steps] * 4[duration]) / 64[PWM periods/s] = 4 second breath cycle
+ *
+ * http://www.wolframalpha.com/input/?i=%28sin%28+x%2F64*pi%29**8+*+255%2C+x%3D0+to+63
+ * (0..63).each {|x| p ((sin(x/64.0*PI)**8)*255).to_i }
+ */
+static const uint8_t breathing_table[64] PROGMEM = {
+0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 6, 10,
+15, 23, 32, 44, 58, 74, 93, 113, 135, 157, 179, 199, 218, 233, 245, 252,
+255, 252, 245, 233, 218, 199, 179, 157, 135, 113, 93, 74, 58, 44, 32, 23,
+15, 10, 6, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+#ifdef SLEEP_LED_PWM_CHANNEL
+/* Hardware PWM
+ *
+ * LED on OC1x pin(SLEEP_LED_PWM_CHANNEL 'A', 'B' or 'C') is driven by Timer1
+ * fast PWM, overflow interrupt only steps the breathing table. MCU sleeps in
+ * idle mode between interrupts during suspend, see suspend_power_down().
+ *
+ * 256              clocks/period[resolution]
+ * F_CPU/256/256    periods/second(244Hz at 16MHz)
+ */
+#if SLEEP_LED_PWM_CHANNEL == 'A'
+#   define PWM_OCR      OCR1A
+#   define PWM_COM      (1<<COM1A1)
+#   define PWM_COM_INV  (1<<COM1A1 | 1<<COM1A0)
+#elif SLEEP_LED_PWM_CHANNEL == 'B'
+#   define PWM_OCR      OCR1B
+#   define PWM_COM      (1<<COM1B1)
+#   define PWM_COM_INV  (1<<COM1B1 | 1<<COM1B0)
+#elif SLEEP_LED_PWM_CHANNEL == 'C' && defined(OCR1C)
+#   define PWM_OCR      OCR1C
+#   define PWM_COM      (1<<COM1C1)
+#   define PWM_COM_INV  (1<<COM1C1 | 1<<COM1C0)
+#else
+#   error "SLEEP_LED_PWM_CHANNEL: A, B or C(32U4/AT90USB) of Timer1"
+#endif
+
+#if defined(__AVR_ATmega32U4__) || defined(__AVR_ATmega16U4__) || \
+    defined(__AVR_AT90USB1286__) || defined(__AVR_AT90USB646__)
+#   define PWM_BIT      (5 + SLEEP_LED_PWM_CHANNEL - 'A')
+#elif defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+#   define PWM_BIT      (1 + SLEEP_LED_PWM_CHANNEL - 'A')
+#else
+#   error "define OC1x pin of the MCU"
+#endif
+
+/* LED is on while pin is high, low with SLEEP_LED_PWM_INVERT */
+#ifdef SLEEP_LED_PWM_INVERT
+#   define PWM_ON_DUTY  PWM_COM_INV
+#   define PWM_PIN_OFF()   (PORTB |=  (1<<PWM_BIT))
+#else
+#   define PWM_ON_DUTY  PWM_COM
+#   define PWM_PIN_OFF()   (PORTB &= ~(1<<PWM_BIT))
+#endif
+
+/* overflows per step of breathing table: 64 steps in 4 seconds */
+#define SLEEP_LED_STEP  (F_CPU/256/256/16)
+
+void sleep_led_init(void)
+{
+}
+
+void sleep_led_enable(void)
+{
+    DDRB |= (1<<PWM_BIT);
+    PWM_PIN_OFF();
+    PWM_OCR = 0;
+    /* Fast PWM 8-bit, clk/256 */
+    TCCR1A = (1<<WGM10);
+    TCCR1B = (1<<WGM12) | (1<<CS12);
+    TIMSK1 |= _BV(TOIE1);
+}
+
+void sleep_led_disable(void)
+{
+    TIMSK1 &= ~_BV(TOIE1);
+    TCCR1B = 0;
+    TCCR1A = 0;
+    PWM_PIN_OFF();
+}
+
+ISR(TIMER1_OVF_vect)
+{
+    static uint8_t count = 0;
+    static uint8_t index = 0;
+
+    if (++count < SLEEP_LED_STEP) return;
+    count = 0;
+    index = (index + 1) & 63;
+    uint8_t duty = pgm_read_byte(&breathing_table[index]);
+    if (duty) {
+        PWM_OCR = duty;
+        TCCR1A |= PWM_ON_DUTY;
+    } else {
+        /* spike of a clock remains at OCR 0, disconnect pin */
+        TCCR1A &= ~PWM_COM_INV;
+        PWM_PIN_OFF();
+    }
+}
+
+#else
 
 /* Software PWM
  *  ______           ______           __
@@ -46,32 +183,6 @@ void sleep_led_disable(void)
 }
 
 
-__attribute__ ((weak))
-void sleep_led_on(void)
-{
-    led_set(1<<USB_LED_CAPS_LOCK);
-}
-
-__attribute__ ((weak))
-void sleep_led_off(void)
-{
-    led_set(0);
-}
-
-
-/* Breathing Sleep LED brighness(PWM On period) table
- * (64[steps] * 4[duration]) / 64[PWM periods/s] = 4 second breath cycle
- *
- * http://www.wolframalpha.com/input/?i=%28sin%28+x%2F64*pi%29**8+*+255%2C+x%3D0+to+63
- * (0..63).each {|x| p ((sin(x/64.0*PI)**8)*255).to_i }
- */
-static const uint8_t breathing_table[64] PROGMEM = {
-0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 6, 10,
-15, 23, 32, 44, 58, 74, 93, 113, 135, 157, 179, 199, 218, 233, 245, 252,
-255, 252, 245, 233, 218, 199, 179, 157, 135, 113, 93, 74, 58, 44, 32, 23,
-15, 10, 6, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-};
-
 ISR(TIMER1_COMPA_vect)
 {
     /* Software PWM
@@ -100,3 +211,5 @@ ISR(TIMER1_COMPA_vect)
         sleep_led_off();
     }
 }
+#endif
+#endif
@@ -8,9 +8,14 @@
 #include "suspend_avr.h"
 #include "suspend.h"
 #include "timer.h"
+#include "eeconfig.h"
+#include "watchdog.h"
 #ifdef PROTOCOL_LUFA
 #include "lufa.h"
 #endif
+#ifdef PROTOCOL_PJRC
+#include "usb.h"
+#endif
 
 
 #define wdt_intr_enable(value)   \
@@ -44,12 +49,82 @@ __asm__ __volatile__ (  \
  *          WDTO_8S
  */
 static uint8_t wdt_timeout = 0;
+
+/* time of watchdog timeout in ms */
+static uint16_t wdt_ms(uint8_t wdto)
+{
+    if (wdto == WDTO_15MS) return 15 + 2;   // WDTO_15MS + 2(from observation)
+    return 16U << wdto;
+}
+
+/*
+ * Suspend tiers
+ *
+ * Power down wakes every 15ms for first SUSPEND_FAST_TIME(ms), then watchdog
+ * timeout is doubled every SUSPEND_TIER_TIME up to SUSPEND_SLOW_WDTO. After
+ * SUSPEND_DEEP_TIME MCU sleeps without watchdog if keyboard armed pin change
+ * interrupt of keys with suspend_pin_wakeup(). Tiers start over with
+ * suspend_power_down_reset(), on wakeup and when a key is found down.
+ */
+#ifndef SUSPEND_FAST_TIME
+#define SUSPEND_FAST_TIME   2000
+#endif
+#ifndef SUSPEND_TIER_TIME
+#define SUSPEND_TIER_TIME   4000
+#endif
+#ifndef SUSPEND_SLOW_WDTO
+#define SUSPEND_SLOW_WDTO   WDTO_250MS
+#endif
+#ifndef SUSPEND_DEEP_TIME
+#define SUSPEND_DEEP_TIME   60000
+#endif
+static uint16_t suspend_time = 0;   // ms in power down since tiers started
+
+void suspend_power_down_reset(void)
+{
+    suspend_time = 0;
+}
+
+/* arm pin change interrupt of keys and return true, or false when matrix can't */
+__attribute__ ((weak))
+bool suspend_pin_wakeup(void)
+{
+    return false;
+}
+
+static uint8_t suspend_wdto(void)
+{
+    if (suspend_time < SUSPEND_FAST_TIME) return WDTO_15MS;
+    // WDTO_30MS, WDTO_60MS, ... are 1, 2, ...
+    uint16_t tier = 1 + (suspend_time - SUSPEND_FAST_TIME) / SUSPEND_TIER_TIME;
+    return (tier < SUSPEND_SLOW_WDTO) ? tier : SUSPEND_SLOW_WDTO;
+}
+
 static void power_down(uint8_t wdto)
 {
 #ifdef PROTOCOL_LUFA
     if (USB_DeviceState == DEVICE_STATE_Configured) return;
 #endif
+#ifdef PROTOCOL_PJRC
+    // resumed before sleep, USB interrupt cleared it
+    if (!suspend) return;
+#endif
+    if (suspend_time >= SUSPEND_DEEP_TIME && suspend_pin_wakeup()) {
+        // wakes on key or USB resume only, timer stops meanwhile
+#ifdef WATCHDOG_ENABLE
+        wdt_disable();
+#endif
+        set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        watchdog_resume();
+        return;
+    }
     wdt_timeout = wdto;
+    uint16_t t = suspend_time + wdt_ms(wdto);
+    suspend_time = (t < suspend_time) ? UINT16_MAX : t;
 
     // Watchdog Interrupt Mode
     wdt_intr_enable(wdto);
@@ -68,17 +143,23 @@ static void power_down(uint8_t wdto)
 
     // Disable watchdog after sleep
     wdt_disable();
+    watchdog_resume();
 }
 
 #ifdef SUSPEND_MODE_STANDBY
 static void standby(void)
 {
 #ifdef SLEEP_MODE_STANDBY
+    // timer stops as well, watchdog would reset before wakeup
+#ifdef WATCHDOG_ENABLE
+    wdt_disable();
+#endif
     set_sleep_mode(SLEEP_MODE_STANDBY);
     sleep_enable();
     sei();
     sleep_cpu();
     sleep_disable();
+    watchdog_resume();
 #endif
 }
 #endif
@@ -98,9 +179,36 @@ void suspend_idle(uint8_t time)
     idle();
 }
 
+#if defined(SLEEP_LED_ENABLE) && \
+    (defined(SLEEP_LED_PWM_CHANNEL) || defined(BACKLIGHT_PWM_ENABLE))
+/* Sleep LED breathes on Timer1 PWM which stops in power down, idle instead
+ * for as long as the fastest power down tier. */
+static void sleep_led_idle(void)
+{
+    uint16_t t = timer_read();
+    do {
+        idle();
+#ifdef PROTOCOL_LUFA
+        if (USB_DeviceState != DEVICE_STATE_Suspended) return;
+#endif
+#ifdef PROTOCOL_PJRC
+        if (!suspend) return;
+#endif
+    } while (timer_elapsed(t) < 15);
+}
+#define SLEEP_LED_IDLE
+#endif
+
 void suspend_power_down(void)
 {
-#ifdef NO_SUSPEND_POWER_DOWN
+    // protocol loops here while suspended instead of keyboard_task()
+    watchdog_kick();
+    WATCHDOG_STAGE(WATCHDOG_SUSPEND);
+    eeconfig_flush();
+
+#if defined(NO_SUSPEND_POWER_DOWN) && defined(SLEEP_LED_IDLE)
+    sleep_led_idle();
+#elif defined(NO_SUSPEND_POWER_DOWN)
     ;
 #elif defined(SUSPEND_MODE_NOPOWERSAVE)
     ;
@@ -109,24 +217,29 @@ void suspend_power_down(void)
 #elif defined(SUSPEND_MODE_IDLE)
     idle();
 #else
-    power_down(WDTO_15MS);
+    power_down(suspend_wdto());
 #endif
 }
 
 bool suspend_wakeup_condition(void)
 {
+#ifdef MATRIX_SCAN_ISR
+    keyboard_scan_isr_enable(false);
+#endif
     matrix_power_up();
-    matrix_scan();
+    bool down = matrix_any_key_down();
     matrix_power_down();
-    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
-        if (matrix_get_row(r)) return true;
-    }
-    return false;
+#ifdef MATRIX_SCAN_ISR
+    keyboard_scan_isr_enable(true);
+#endif
+    if (down) suspend_power_down_reset();
+    return down;
 }
 
 // run immediately after wakeup
 void suspend_wakeup_init(void)
 {
+    suspend_power_down_reset();
     // clear keyboard state
     matrix_clear();
     clear_keyboard();
@@ -140,12 +253,6 @@ void suspend_wakeup_init(void)
 ISR(WDT_vect)
 {
     // compensate timer for sleep
-    switch (wdt_timeout) {
-        case WDTO_15MS:
-            timer_count += 15 + 2;  // WDTO_15MS + 2(from observation)
-            break;
-        default:
-            ;
-    }
+    timer_count += wdt_ms(wdt_timeout);
 }
 #endif
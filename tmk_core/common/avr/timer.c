@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include "timer_avr.h"
 #include "timer.h"
+#include "keyboard.h"
 
 
 // counter resolution 1ms
@@ -114,8 +115,42 @@ uint32_t timer_elapsed32(uint32_t last)
     return TIMER_DIFF_32(t, last);
 }
 
+/* ms count and Timer0 phase, taken together */
+uint32_t timer_read_us(void)
+{
+    uint32_t ms;
+    uint8_t raw;
+
+    uint8_t sreg = SREG;
+    cli();
+    ms = timer_count;
+    raw = TIMER_RAW;
+#ifdef TIFR0
+    if (TIFR0 & (1<<OCF0A)) {
+#else
+    if (TIFR & (1<<OCF0A)) {
+#endif
+        // compare match not serviced yet
+        ms++;
+        raw = TIMER_RAW;
+    }
+    SREG = sreg;
+
+    return ms * 1000 + TIMER_RAW_TO_US(raw);
+}
+
+uint32_t timer_elapsed_us(uint32_t last)
+{
+    return TIMER_DIFF_32(timer_read_us(), last);
+}
+
 // excecuted once per 1ms.(excess for just timer count?)
 ISR(TIMER0_COMPA_vect)
 {
     timer_count++;
+#ifdef MATRIX_SCAN_ISR
+    // scan with interrupts on, USB and next tick are not held off by it
+    sei();
+    keyboard_scan_isr();
+#endif
 }
@@ -33,10 +33,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 #define TIMER_RAW_FREQ      (F_CPU/TIMER_PRESCALER)
 #define TIMER_RAW           TCNT0
-#define TIMER_RAW_TOP       (TIMER_RAW_FREQ/1000)
+/* CTC counts 0..TOP, period of TOP+1 counts is 1ms */
+#define TIMER_RAW_TOP       (TIMER_RAW_FREQ/1000 - 1)
 
 #if (TIMER_RAW_TOP > 255)
 #   error "Timer0 can't count 1ms at this clock freq. Use larger prescaler."
 #endif
 
+/* Timer0 wraps at TOP+1, not 256 */
+#define TIMER_DIFF_RAW(a, b)    ((a) >= (b) ? (a) - (b) : (TIMER_RAW_TOP + 1) - (b) + (a))
+
+/* counts to microseconds, 16-bit math while count is whole microseconds */
+#if (1000000 % TIMER_RAW_FREQ) == 0
+#   define TIMER_RAW_TO_US(raw) ((uint16_t)(raw) * (uint16_t)(1000000 / TIMER_RAW_FREQ))
+#else
+#   define TIMER_RAW_TO_US(raw) ((uint32_t)(raw) * 1000000 / TIMER_RAW_FREQ)
+#endif
+
 #endif
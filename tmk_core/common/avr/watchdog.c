@@ -0,0 +1,105 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/wdt.h>
+#include "print.h"
+#include "watchdog.h"
+
+
+/* not cleared by startup code, valid after reset other than power on */
+volatile uint8_t watchdog_stage __attribute__ ((section (".noinit")));
+uint8_t watchdog_mcusr __attribute__ ((section (".noinit")));
+static uint8_t reset_count __attribute__ ((section (".noinit")));
+static uint16_t noinit_magic __attribute__ ((section (".noinit")));
+
+static uint8_t reset_stage = WATCHDOG_BOOT;
+
+/* bootloader may have cleared PORF, RAM without it is random as well */
+#define NOINIT_MAGIC    0x5744
+
+
+#ifndef NO_PRINT
+static void print_stage(uint8_t stage)
+{
+    switch (stage) {
+        case WATCHDOG_BOOT:       print("boot"); break;
+        case WATCHDOG_LOOP:       print("loop"); break;
+        case WATCHDOG_SCAN:       print("scan"); break;
+        case WATCHDOG_ACTION:     print("action"); break;
+        case WATCHDOG_TIMED:      print("timed"); break;
+        case WATCHDOG_MOUSE:      print("mouse"); break;
+        case WATCHDOG_LED:        print("led"); break;
+        case WATCHDOG_REPORT:     print("report"); break;
+        case WATCHDOG_PS2_SEND:   print("ps2 send"); break;
+        case WATCHDOG_PS2_RECV:   print("ps2 recv"); break;
+        case WATCHDOG_ADB_TALK:   print("adb talk"); break;
+        case WATCHDOG_ADB_LISTEN: print("adb listen"); break;
+        case WATCHDOG_USB_HOST:   print("usb host"); break;
+        case WATCHDOG_SUSPEND:    print("suspend"); break;
+        default:                  print("?"); break;
+    }
+}
+#endif
+
+void watchdog_init(void)
+{
+    if ((watchdog_mcusr & ((1<<PORF) | (1<<BORF))) || noinit_magic != NOINIT_MAGIC) {
+        // RAM has no count yet
+        noinit_magic = NOINIT_MAGIC;
+        reset_count = 0;
+    } else if (watchdog_mcusr & (1<<WDRF)) {
+        reset_stage = watchdog_stage;
+        if (reset_count < UINT8_MAX) reset_count++;
+        watchdog_print();
+    }
+    watchdog_stage = WATCHDOG_LOOP;
+    wdt_enable(WATCHDOG_WDTO);
+}
+
+void watchdog_resume(void)
+{
+    wdt_enable(WATCHDOG_WDTO);
+}
+
+uint8_t watchdog_reset_cause(void)
+{
+    return watchdog_mcusr;
+}
+
+uint8_t watchdog_reset_stage(void)
+{
+    return reset_stage;
+}
+
+uint8_t watchdog_reset_count(void)
+{
+    return reset_count;
+}
+
+void watchdog_print(void)
+{
+#ifndef NO_PRINT
+    if (!(watchdog_mcusr & (1<<WDRF))) {
+        xprintf("watchdog: no reset MCUSR:%02X count:%u\n", watchdog_mcusr, reset_count);
+        return;
+    }
+    xprintf("watchdog: reset at stage %u(", reset_stage);
+    print_stage(reset_stage);
+    xprintf(") MCUSR:%02X count:%u\n", watchdog_mcusr, reset_count);
+#endif
+}
@@ -37,4 +37,15 @@ void backlight_step(void);
 void backlight_set(uint8_t level);
 void backlight_level(uint8_t level);
 
+/* BACKLIGHT_PWM_ENABLE: Timer1 PWM on OC1x pin(BACKLIGHT_PWM_CHANNEL) in
+ * avr/backlight_pwm.c implements backlight_set(), breathing runs from timer
+ * interrupt and sleep LED breathes backlight. */
+#ifdef BACKLIGHT_PWM_ENABLE
+void backlight_breathing_enable(void);
+void backlight_breathing_disable(void);
+bool backlight_breathing(void);
+/* duty of 0-255 as is, e.g. for led_effect.c, until next backlight_set() */
+void backlight_pwm_duty(uint8_t duty);
+#endif
+
 #endif
@@ -0,0 +1,67 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BENCH_GPIO_H
+#define BENCH_GPIO_H
+
+/* Latency benchmark pin
+ *
+ * Pin goes high when key event enters action_exec() and low when next
+ * keyboard report is committed to USB endpoint, so width of the pulse is
+ * time in firmware from matrix to USB including tapping and report queue.
+ * With switch actuated by external trigger, trigger to rising edge on scope
+ * is scan and debounce, and tool/bench_latency measures trigger to arrival
+ * of report at host.
+ *
+ * Key without report(layer key, tap undecided) keeps pin high until next
+ * report of any key.
+ *
+ * AVR:     #define BENCH_GPIO_PORT PORTD
+ *          #define BENCH_GPIO_DDR  DDRD
+ *          #define BENCH_GPIO_BIT  4
+ * ChibiOS: #define BENCH_GPIO_PORT GPIOB
+ *          #define BENCH_GPIO_BIT  9
+ */
+#ifdef BENCH_GPIO_ENABLE
+#   if !defined(BENCH_GPIO_PORT) || !defined(BENCH_GPIO_BIT)
+#       error "BENCH_GPIO_ENABLE needs BENCH_GPIO_PORT and BENCH_GPIO_BIT in config.h"
+#   endif
+#   if defined(__AVR__)
+#       include <avr/io.h>
+#       define BENCH_GPIO_INIT()    do { \
+            BENCH_GPIO_PORT &= ~(1<<BENCH_GPIO_BIT); \
+            BENCH_GPIO_DDR  |=  (1<<BENCH_GPIO_BIT); \
+        } while (0)
+#       define BENCH_GPIO_EVENT()   (BENCH_GPIO_PORT |=  (1<<BENCH_GPIO_BIT))
+#       define BENCH_GPIO_REPORT()  (BENCH_GPIO_PORT &= ~(1<<BENCH_GPIO_BIT))
+#   elif defined(PROTOCOL_CHIBIOS)
+#       include "hal.h"
+#       define BENCH_GPIO_INIT()    do { \
+            palClearPad(BENCH_GPIO_PORT, BENCH_GPIO_BIT); \
+            palSetPadMode(BENCH_GPIO_PORT, BENCH_GPIO_BIT, PAL_MODE_OUTPUT_PUSHPULL); \
+        } while (0)
+#       define BENCH_GPIO_EVENT()   palSetPad(BENCH_GPIO_PORT, BENCH_GPIO_BIT)
+#       define BENCH_GPIO_REPORT()  palClearPad(BENCH_GPIO_PORT, BENCH_GPIO_BIT)
+#   else
+#       error "BENCH_GPIO_ENABLE is for AVR and ChibiOS"
+#   endif
+#else
+#   define BENCH_GPIO_INIT()
+#   define BENCH_GPIO_EVENT()
+#   define BENCH_GPIO_REPORT()
+#endif
+
+#endif
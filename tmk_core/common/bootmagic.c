@@ -14,6 +14,8 @@
 
 keymap_config_t keymap_config;
 
+static bool scan_key(uint16_t code);
+
 void bootmagic(void)
 {
     /* check signature */
@@ -21,11 +23,20 @@ void bootmagic(void)
         eeconfig_init();
     }
 
-    /* do scans in case of bounce */
-    print("bootmagic scan: ... ");
-    uint8_t scan = 100;
-    while (scan--) { matrix_scan(); wait_ms(10); }
-    print("done.\n");
+#ifdef BOOTMAGIC_FAST_SCAN
+    /* scan just long enough to settle debounce, the long scan below only
+     * when salt key is held. Without salt no magic key is taken. */
+    uint8_t fast = BOOTMAGIC_FAST_SCAN;
+    while (fast--) { matrix_scan(); wait_ms(1); }
+    if (scan_key(BOOTMAGIC_KEY_SALT))
+#endif
+    {
+        /* do scans in case of bounce */
+        print("bootmagic scan: ... ");
+        uint8_t scan = 100;
+        while (scan--) { matrix_scan(); wait_ms(10); }
+        print("done.\n");
+    }
 
     /* bootmagic skip */
     if (bootmagic_scan_key(BOOTMAGIC_KEY_SKIP)) {
@@ -46,7 +57,8 @@ void bootmagic(void)
     hook_bootmagic();
 
     /* debug enable */
-    debug_config.raw = eeconfig_read_debug();
+    uint8_t saved = eeconfig_read_debug();
+    debug_config.raw = saved;
     if (bootmagic_scan_key(BOOTMAGIC_KEY_DEBUG_ENABLE)) {
         if (bootmagic_scan_key(BOOTMAGIC_KEY_DEBUG_MATRIX)) {
             debug_config.matrix = !debug_config.matrix;
@@ -58,10 +70,12 @@ void bootmagic(void)
             debug_config.enable = !debug_config.enable;
         }
     }
-    eeconfig_write_debug(debug_config.raw);
+    // write only changed config, AVR takes 3.4ms for a byte
+    if (debug_config.raw != saved) eeconfig_write_debug(debug_config.raw);
 
     /* keymap config */
-    keymap_config.raw = eeconfig_read_keymap();
+    saved = eeconfig_read_keymap();
+    keymap_config.raw = saved;
     if (bootmagic_scan_key(BOOTMAGIC_KEY_SWAP_CONTROL_CAPSLOCK)) {
         keymap_config.swap_control_capslock = !keymap_config.swap_control_capslock;
     }
@@ -86,9 +100,9 @@ void bootmagic(void)
     if (bootmagic_scan_key(BOOTMAGIC_HOST_NKRO)) {
         keymap_config.nkro = !keymap_config.nkro;
     }
-    eeconfig_write_keymap(keymap_config.raw);
+    if (keymap_config.raw != saved) eeconfig_write_keymap(keymap_config.raw);
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_HYBRID)
     keyboard_nkro = keymap_config.nkro;
 #endif
 
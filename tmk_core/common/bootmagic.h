@@ -2,6 +2,10 @@
 #define BOOTMAGIC_H
 
 
+/* BOOTMAGIC_FAST_SCAN: scan for this time(ms) at boot instead of 1000ms,
+ * the full scan still runs when salt key is held. Must be longer than
+ * debounce of matrix. */
+
 /* bootmagic salt key */
 #ifndef BOOTMAGIC_KEY_SALT
 #define BOOTMAGIC_KEY_SALT              KC_SPACE
@@ -317,15 +317,25 @@ extern uint32_t __eeprom_workarea_end__;
 
 static uint32_t flashend = 0;
 
+// Latest value of each address. The work area is a log of (data << 8 | offset)
+// half-words, it is scanned once here instead of on every read.
+static uint8_t shadow[EEPROM_SIZE];
+
 void eeprom_initialize(void)
 {
 	const uint16_t *p = (uint16_t *)SYMVAL(__eeprom_workarea_start__);
+	uint16_t val;
 
+	for (uint32_t i = 0; i < EEPROM_SIZE; i++) {
+		shadow[i] = 0xFF;
+	}
 	do {
-		if (*p++ == 0xFFFF) {
+		val = *p++;
+		if (val == 0xFFFF) {
 			flashend = (uint32_t)(p - 2);
 			return;
 		}
+		if ((val & 255) < EEPROM_SIZE) shadow[val & 255] = val >> 8;
 	} while (p < (uint16_t *)SYMVAL(__eeprom_workarea_end__));
 	flashend = (uint32_t)((uint16_t *)SYMVAL(__eeprom_workarea_end__) - 1);
 }
@@ -333,22 +343,10 @@ void eeprom_initialize(void)
 uint8_t eeprom_read_byte(const uint8_t *addr)
 {
 	uint32_t offset = (uint32_t)addr;
-	const uint16_t *p = (uint16_t *)SYMVAL(__eeprom_workarea_start__);
-	const uint16_t *end = (const uint16_t *)((uint32_t)flashend);
-	uint16_t val;
-	uint8_t data=0xFF;
 
-	if (!end) {
-		eeprom_initialize();
-		end = (const uint16_t *)((uint32_t)flashend);
-	}
-	if (offset < EEPROM_SIZE) {
-		while (p <= end) {
-			val = *p++;
-			if ((val & 255) == offset) data = val >> 8;
-		}
-	}
-	return data;
+	if (offset >= EEPROM_SIZE) return 0xFF;
+	if (!flashend) eeprom_initialize();
+	return shadow[offset];
 }
 
 static void flash_write(const uint16_t *code, uint32_t addr, uint32_t data)
@@ -370,17 +368,20 @@ static void flash_write(const uint16_t *code, uint32_t addr, uint32_t data)
 void eeprom_write_byte(uint8_t *addr, uint8_t data)
 {
 	uint32_t offset = (uint32_t)addr;
-	const uint16_t *p, *end = (const uint16_t *)((uint32_t)flashend);
+	const uint16_t *end = (const uint16_t *)((uint32_t)flashend);
 	uint32_t i, val, flashaddr;
 	uint16_t do_flash_cmd[] = {
 		0x2380, 0x7003, 0x7803, 0xb25b, 0x2b00, 0xdafb, 0x4770};
-	uint8_t buf[EEPROM_SIZE];
 
 	if (offset >= EEPROM_SIZE) return;
 	if (!end) {
 		eeprom_initialize();
 		end = (const uint16_t *)((uint32_t)flashend);
 	}
+	// no flash program for unchanged value
+	if (shadow[offset] == data) return;
+	shadow[offset] = data;
+
 	if (++end < (uint16_t *)SYMVAL(__eeprom_workarea_end__)) {
 		val = (data << 8) | offset;
 		flashaddr = (uint32_t)end;
@@ -393,16 +394,7 @@ void eeprom_write_byte(uint8_t *addr, uint8_t data)
 		}
 		flash_write(do_flash_cmd, flashaddr, val);
 	} else {
-		for (i=0; i < EEPROM_SIZE; i++) {
-			buf[i] = 0xFF;
-		}
-		for (p = (uint16_t *)SYMVAL(__eeprom_workarea_start__); p < (uint16_t *)SYMVAL(__eeprom_workarea_end__); p++) {
-			val = *p;
-			if ((val & 255) < EEPROM_SIZE) {
-				buf[val & 255] = val >> 8;
-			}
-		}
-		buf[offset] = data;
+		// log is full: erase it and write latest values from shadow
 		for (flashaddr=(uint32_t)(uint16_t *)SYMVAL(__eeprom_workarea_start__); flashaddr < (uint32_t)(uint16_t *)SYMVAL(__eeprom_workarea_end__); flashaddr += 1024) {
 			*(uint32_t *)&(FTFA->FCCOB3) = 0x09000000 | flashaddr;
 			__disable_irq();
@@ -414,16 +406,17 @@ void eeprom_write_byte(uint8_t *addr, uint8_t data)
 		}
 		flashaddr=(uint32_t)(uint16_t *)SYMVAL(__eeprom_workarea_start__);
 		for (i=0; i < EEPROM_SIZE; i++) {
-			if (buf[i] == 0xFF) continue;
+			if (shadow[i] == 0xFF) continue;
 			if ((flashaddr & 2) == 0) {
-				val = (buf[i] << 8) | i;
+				val = (shadow[i] << 8) | i;
 			} else {
-				val = val | (buf[i] << 24) | (i << 16);
+				val = val | (shadow[i] << 24) | (i << 16);
 				flash_write(do_flash_cmd, flashaddr, val);
 			}
 			flashaddr += 2;
 		}
-		flashend = flashaddr;
+		// last written entry, next write goes to flashaddr
+		flashend = flashaddr - 2;
 		if ((flashaddr & 2)) {
 			val |= 0xFFFF0000;
 			flash_write(do_flash_cmd, flashaddr, val);
@@ -516,6 +509,10 @@ void eeconfig_init(void)
     eeprom_write_byte(EECONFIG_DEFAULT_LAYER,  0);
     eeprom_write_byte(EECONFIG_KEYMAP,         0);
     eeprom_write_byte(EECONFIG_MOUSEKEY_ACCEL, 0);
+    eeprom_write_byte(EECONFIG_SCAN_RATE,      0);
+    for (uint8_t i = 0; i < EECONFIG_TAPPING_TERM_SLOTS; i++) {
+        eeprom_write_byte(EECONFIG_TAPPING_TERM + i, 0);
+    }
 #ifdef BACKLIGHT_ENABLE
     eeprom_write_byte(EECONFIG_BACKLIGHT,      0);
 #endif
@@ -545,6 +542,12 @@ void eeconfig_write_default_layer(uint8_t val) { eeprom_write_byte(EECONFIG_DEFA
 uint8_t eeconfig_read_keymap(void)      { return eeprom_read_byte(EECONFIG_KEYMAP); }
 void eeconfig_write_keymap(uint8_t val) { eeprom_write_byte(EECONFIG_KEYMAP, val); }
 
+uint8_t eeconfig_read_scan_rate(void)      { return eeprom_read_byte(EECONFIG_SCAN_RATE); }
+void eeconfig_write_scan_rate(uint8_t val) { eeprom_write_byte(EECONFIG_SCAN_RATE, val); }
+
+uint8_t eeconfig_read_tapping_term(uint8_t slot)      { return eeprom_read_byte(EECONFIG_TAPPING_TERM + slot); }
+void eeconfig_write_tapping_term(uint8_t slot, uint8_t val) { eeprom_write_byte(EECONFIG_TAPPING_TERM + slot, val); }
+
 #ifdef BACKLIGHT_ENABLE
 uint8_t eeconfig_read_backlight(void)      { return eeprom_read_byte(EECONFIG_BACKLIGHT); }
 void eeconfig_write_backlight(uint8_t val) { eeprom_write_byte(EECONFIG_BACKLIGHT, val); }
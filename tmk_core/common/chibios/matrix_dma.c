@@ -0,0 +1,121 @@
+#include "hal.h"
+#include "matrix_dma.h"
+
+#if !STM32_HAS_TIM3 || defined(STM32_DMA_CR_CHSEL_MASK)
+#   error "matrix_dma.c needs TIM3 and fixed DMA request mapping(STM32F0/F1/F3)"
+#endif
+
+#define ROW_STREAM      STM32_DMA1_STREAM3      // TIM3_UP
+#define COL_STREAM      STM32_DMA1_STREAM2      // TIM3_CH3
+#define DMA_PRIORITY    3
+#define TIM_US_FREQ     1000000
+
+/* BSRR words: selected pad reset, others set(released in open-drain) */
+static uint32_t row_pattern[MATRIX_ROWS];
+static volatile uint16_t snapshot[MATRIX_ROWS];
+static uint16_t last[MATRIX_ROWS];
+static matrix_row_t rows[MATRIX_ROWS];
+
+static const uint8_t *cols;
+static bool invert = false;
+static bool strobe = false;
+
+void matrix_dma_init(ioportid_t row_port, const uint8_t row_pads[],
+                     ioportid_t col_port, const uint8_t col_pads[],
+                     iomode_t col_mode, bool active_low)
+{
+    cols = col_pads;
+    invert = active_low;
+    strobe = (row_port != NULL);
+
+    for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+        palSetPadMode(col_port, col_pads[c], col_mode);
+    }
+
+    uint32_t row_mask = 0;
+    for (uint8_t r = 0; strobe && r < MATRIX_ROWS; r++) {
+        row_mask |= PAL_PORT_BIT(row_pads[r]);
+        palSetPad(row_port, row_pads[r]);
+        palSetPadMode(row_port, row_pads[r], PAL_MODE_OUTPUT_OPENDRAIN);
+    }
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        uint32_t sel = strobe ? PAL_PORT_BIT(row_pads[r]) : 0;
+        row_pattern[r] = (row_mask & ~sel) | (sel << 16);
+        snapshot[r] = last[r] = invert ? 0xFFFF : 0;
+        rows[r] = 0;
+    }
+
+#if !defined(STM32_DMA_REQUIRED)
+    /* halInit() skips DMA init when no HAL driver uses it */
+    dmaInit();
+#endif
+    bool busy;
+    if (strobe) {
+        busy = dmaStreamAllocate(ROW_STREAM, DMA_PRIORITY, NULL, NULL);
+        osalDbgAssert(!busy, "row stream already allocated");
+        dmaStreamSetPeripheral(ROW_STREAM, &row_port->BSRR);
+        dmaStreamSetMemory0(ROW_STREAM, row_pattern);
+        dmaStreamSetTransactionSize(ROW_STREAM, MATRIX_ROWS);
+        dmaStreamSetMode(ROW_STREAM, STM32_DMA_CR_PL(DMA_PRIORITY) |
+                STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC |
+                STM32_DMA_CR_PSIZE_WORD | STM32_DMA_CR_MSIZE_WORD);
+        dmaStreamEnable(ROW_STREAM);
+    }
+    busy = dmaStreamAllocate(COL_STREAM, DMA_PRIORITY, NULL, NULL);
+    osalDbgAssert(!busy, "column stream already allocated");
+    dmaStreamSetPeripheral(COL_STREAM, &col_port->IDR);
+    dmaStreamSetMemory0(COL_STREAM, snapshot);
+    dmaStreamSetTransactionSize(COL_STREAM, MATRIX_ROWS);
+    dmaStreamSetMode(COL_STREAM, STM32_DMA_CR_PL(DMA_PRIORITY) |
+            STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC |
+            STM32_DMA_CR_PSIZE_HWORD | STM32_DMA_CR_MSIZE_HWORD);
+    dmaStreamEnable(COL_STREAM);
+    (void)busy;
+
+    /* 1us count, period of a row; columns are sampled at the end of period
+     * just before update event strobes next row. */
+    rccEnableTIM3(FALSE);
+    rccResetTIM3();
+    STM32_TIM3->PSC = STM32_TIMCLK1 / TIM_US_FREQ - 1;
+    STM32_TIM3->ARR = MATRIX_DMA_ROW_US - 1;
+    STM32_TIM3->CCR[2] = MATRIX_DMA_ROW_US - 1;
+    STM32_TIM3->DIER = (strobe ? STM32_TIM_DIER_UDE : 0) | STM32_TIM_DIER_CC3DE;
+    /* UG loads prescaler and strobes row 0 through update DMA request */
+    STM32_TIM3->EGR = STM32_TIM_EGR_UG;
+    STM32_TIM3->CR1 = STM32_TIM_CR1_CEN;
+}
+
+bool matrix_dma_read(matrix_row_t raw[])
+{
+    bool changed = false;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        uint16_t v = snapshot[r];
+        if (v != last[r]) {
+            last[r] = v;
+            if (invert) v = ~v;
+            matrix_row_t bits = 0;
+            for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+                if (v & (1 << cols[c])) bits |= ((matrix_row_t)1 << c);
+            }
+            if (bits != rows[r]) {
+                rows[r] = bits;
+                changed = true;
+            }
+        }
+        raw[r] = rows[r];
+    }
+    return changed;
+}
+
+void matrix_dma_stop(void)
+{
+    STM32_TIM3->CR1 = 0;
+    STM32_TIM3->DIER = 0;
+    if (strobe) {
+        dmaStreamDisable(ROW_STREAM);
+        dmaStreamRelease(ROW_STREAM);
+    }
+    dmaStreamDisable(COL_STREAM);
+    dmaStreamRelease(COL_STREAM);
+    rccDisableTIM3(FALSE);
+}
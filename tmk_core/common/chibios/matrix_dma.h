@@ -0,0 +1,36 @@
+#ifndef MATRIX_DMA_H
+#define MATRIX_DMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "matrix.h"
+
+/*
+ * DMA matrix scan on STM32(F0/F1/F3)
+ *
+ * TIM3 paces the scan by itself and CPU only compares snapshots:
+ *
+ *     update event     DMA1 ch3: next row pattern -> row port BSRR
+ *     compare 3(ARR)   DMA1 ch2: column port IDR  -> snapshot of the row
+ *
+ * Both channels run circular over MATRIX_ROWS entries, so snapshot[i] always
+ * holds columns read MATRIX_DMA_ROW_US after row i was strobed. Rows are on
+ * one port in open-drain, selected row is driven low; columns are on one port.
+ * row_port NULL for matrix without row strobe(direct pins).
+ *
+ * TIM2 is system tick on these boards, TIM3 and the two DMA channels must
+ * not be used by other drivers.
+ */
+#ifndef MATRIX_DMA_ROW_US
+#define MATRIX_DMA_ROW_US   30
+#endif
+
+void matrix_dma_init(ioportid_t row_port, const uint8_t row_pads[],
+                     ioportid_t col_port, const uint8_t col_pads[],
+                     iomode_t col_mode, bool active_low);
+/* Copies latest rows(1:on, 0:off) to raw, returns true if any row changed */
+bool matrix_dma_read(matrix_row_t raw[]);
+void matrix_dma_stop(void);
+
+#endif
@@ -0,0 +1,97 @@
+#include "wait.h"
+#include "matrix_port.h"
+
+#ifndef MATRIX_PORT_MAX
+#define MATRIX_PORT_MAX 5
+#endif
+
+/* columns sharing port and shift, moved by one mask & shift */
+typedef struct {
+    uint8_t port;
+    int8_t shift;   // pad - column
+    ioportmask_t mask;
+} col_group_t;
+
+static ioportid_t ports[MATRIX_PORT_MAX];
+static uint8_t ports_len = 0;
+static col_group_t groups[MATRIX_COLS];
+static uint8_t groups_len = 0;
+static bool invert = false;
+
+void matrix_port_init(const matrix_pin_t *pins, iomode_t mode, bool active_low)
+{
+    ports_len = 0;
+    groups_len = 0;
+    invert = active_low;
+
+    for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+        palSetPadMode(pins[c].port, pins[c].pad, mode);
+
+        uint8_t p = 0;
+        while (p < ports_len && ports[p] != pins[c].port) p++;
+        if (p == ports_len) {
+            if (ports_len == MATRIX_PORT_MAX) continue;
+            ports[ports_len++] = pins[c].port;
+        }
+
+        int8_t shift = (int8_t)pins[c].pad - (int8_t)c;
+        uint8_t g = 0;
+        while (g < groups_len && !(groups[g].port == p && groups[g].shift == shift)) g++;
+        if (g == groups_len) {
+            groups[g] = (col_group_t){ .port = p, .shift = shift, .mask = 0 };
+            groups_len++;
+        }
+        groups[g].mask |= PAL_PORT_BIT(pins[c].pad);
+    }
+}
+
+/* Returns column bits(1:on, 0:off) */
+matrix_row_t matrix_port_read(void)
+{
+    ioportmask_t v[MATRIX_PORT_MAX];
+    for (uint8_t p = 0; p < ports_len; p++) {
+        v[p] = palReadPort(ports[p]);
+        if (invert) v[p] = ~v[p];
+    }
+
+    matrix_row_t cols = 0;
+    for (uint8_t g = 0; g < groups_len; g++) {
+        ioportmask_t bits = v[groups[g].port] & groups[g].mask;
+        if (groups[g].shift >= 0)
+            cols |= (matrix_row_t)(bits >> groups[g].shift);
+        else
+            cols |= (matrix_row_t)bits << -groups[g].shift;
+    }
+    return cols;
+}
+
+#if defined(KINETIS_SYSCLK_FREQUENCY)
+#   define CPU_FREQ     KINETIS_SYSCLK_FREQUENCY
+#elif defined(STM32_SYSCLK)
+#   define CPU_FREQ     STM32_SYSCLK
+#endif
+
+#if PORT_SUPPORTS_RT && defined(CPU_FREQ)
+static rtcnt_t settle_start;
+
+void matrix_port_settle_start(void)
+{
+    settle_start = chSysGetRealtimeCounterX();
+}
+
+void matrix_port_settle_wait(uint16_t us)
+{
+    rtcnt_t cycles = (rtcnt_t)us * (CPU_FREQ / 1000000);
+    while ((rtcnt_t)(chSysGetRealtimeCounterX() - settle_start) < cycles) ;
+}
+#else
+/* no cycle counter(Cortex-M0): wait as before */
+void matrix_port_settle_start(void)
+{
+}
+
+void matrix_port_settle_wait(uint16_t us)
+{
+    wait_us(us);
+}
+#endif
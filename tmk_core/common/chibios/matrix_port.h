@@ -0,0 +1,39 @@
+#ifndef MATRIX_PORT_H
+#define MATRIX_PORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "matrix.h"
+
+/*
+ * Column read by port
+ *
+ * Board lists its column pins in column order:
+ *
+ *     static const matrix_pin_t col_pins[MATRIX_COLS] = {
+ *         MATRIX_PIN(GPIOD, 4), MATRIX_PIN(GPIOD, 2), ...
+ *     };
+ *
+ * matrix_port_init() groups columns by port and by distance between pad and
+ * column bit, then matrix_port_read() reads each port once and moves every
+ * group into place with a mask and a shift instead of a read per pin.
+ *
+ * Row settle wait can overlap with work on previous row: call
+ * matrix_port_settle_start() right after strobing the row and
+ * matrix_port_settle_wait() just before reading it. Wait is polled on cycle
+ * counter, wait_us() would sleep a whole system tick on ChibiOS.
+ */
+typedef struct {
+    ioportid_t port;
+    uint8_t pad;
+} matrix_pin_t;
+
+#define MATRIX_PIN(port, pad)   { (port), (pad) }
+
+void matrix_port_init(const matrix_pin_t *pins, iomode_t mode, bool active_low);
+matrix_row_t matrix_port_read(void);
+void matrix_port_settle_start(void);
+void matrix_port_settle_wait(uint16_t us);
+
+#endif
@@ -0,0 +1,25 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "profile.h"
+
+
+static virtual_timer_t profile_timer;
+
+
+/* Threads run on PSP and exception entry stacked r0-r3, r12, lr, pc, xpsr
+ * there; callback of virtual timer runs in SysTick interrupt on MSP. */
+static void profile_cb(void *arg)
+{
+    (void)arg;
+
+    uint32_t *frame = (uint32_t *)__get_PSP();
+    profile_sample(frame[6]);
+    chVTSetI(&profile_timer, MS2ST(PROFILE_INTERVAL), profile_cb, NULL);
+}
+
+void profile_init(void)
+{
+    chVTObjectInit(&profile_timer);
+    chVTSet(&profile_timer, MS2ST(PROFILE_INTERVAL), profile_cb, NULL);
+}
@@ -4,6 +4,81 @@
 #include "led.h"
 #include "sleep_led.h"
 
+
+#if defined(SLEEP_LED_PWM_DRIVER) && HAL_USE_PWM
+/* Hardware PWM
+ *
+ * LED on a timer channel is driven by HAL PWM, SLEEP_LED_PWM_DRIVER(PWMD3 e.g.)
+ * and SLEEP_LED_PWM_CHANNEL(0-3) with the pin mux set by board. A virtual
+ * timer steps duty 16 times a second, no interrupt per PWM period and MCU
+ * sleeps between.
+ */
+#ifndef SLEEP_LED_PWM_CHANNEL
+#define SLEEP_LED_PWM_CHANNEL   0
+#endif
+
+/* (0..63).each {|x| p ((sin(x/64.0*PI)**8)*255).to_i } */
+static const uint8_t breathing_table[64] = {
+0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 6, 10,
+15, 23, 32, 44, 58, 74, 93, 113, 135, 157, 179, 199, 218, 233, 245, 252,
+255, 252, 245, 233, 218, 199, 179, 157, 135, 113, 93, 74, 58, 44, 32, 23,
+15, 10, 6, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/* 100kHz/256 = 390Hz PWM */
+static const PWMConfig pwm_config = {
+    .frequency = 100000,
+    .period = 256,
+    .callback = NULL,
+    .channels = {
+        [SLEEP_LED_PWM_CHANNEL] = { PWM_OUTPUT_ACTIVE_HIGH, NULL },
+    },
+};
+
+static virtual_timer_t breathing_timer;
+static bool breathing = false;
+
+/* 64 steps in 4 seconds */
+static void breathing_cb(void *arg)
+{
+    static uint8_t index = 0;
+    (void)arg;
+
+    index = (index + 1) & 63;
+    pwmEnableChannelI(&SLEEP_LED_PWM_DRIVER, SLEEP_LED_PWM_CHANNEL, breathing_table[index]);
+    chVTSetI(&breathing_timer, MS2ST(62), breathing_cb, NULL);
+}
+
+void sleep_led_init(void) {
+    chVTObjectInit(&breathing_timer);
+}
+
+void sleep_led_enable(void) {
+    if (breathing) return;
+    breathing = true;
+    pwmStart(&SLEEP_LED_PWM_DRIVER, &pwm_config);
+    chSysLock();
+    chVTSetI(&breathing_timer, MS2ST(62), breathing_cb, NULL);
+    chSysUnlock();
+}
+
+void sleep_led_disable(void) {
+    if (!breathing) return;
+    breathing = false;
+    chVTReset(&breathing_timer);
+    pwmStop(&SLEEP_LED_PWM_DRIVER);
+}
+
+void sleep_led_toggle(void) {
+    if (breathing) {
+        sleep_led_disable();
+    } else {
+        sleep_led_enable();
+    }
+}
+
+#else /* software PWM */
+
 /* All right, we go the "software" way: timer, toggle LED in interrupt.
  * Based on hasu's code for AVRs.
  * Use LP timer on Kinetises, TIM14 on STM32F0.
@@ -223,4 +298,6 @@ void sleep_led_toggle(void) {
     // not implemented
 }
 
-#endif /* platform selection */
\ No newline at end of file
+#endif /* platform selection */
+
+#endif /* SLEEP_LED_PWM_DRIVER */
\ No newline at end of file
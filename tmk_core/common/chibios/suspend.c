@@ -16,10 +16,100 @@ void suspend_idle(uint8_t time) {
 	chThdSleepMilliseconds(time);
 }
 
+__attribute__ ((weak)) void matrix_power_up(void) {}
+__attribute__ ((weak)) void matrix_power_down(void) {}
+
+/* arm pin interrupt of keys and return true, or false when matrix can't,
+ * matrix_power_up() restores pins for scan after wakeup */
+__attribute__ ((weak))
+bool suspend_pin_wakeup(void)
+{
+    return false;
+}
+
+#if (defined(KL2x) || defined(K20x)) && !defined(SLEEP_LED_ENABLE)
+#define SUSPEND_DEEP_SLEEP
+/* Deep sleep of Kinetis
+ *
+ * Very Low Power Stop(VLPS) keeps RAM and pins, clocks stop and come back by
+ * themselves on wakeup. WFE with SEVONPEND wakes on any interrupt even if it
+ * is not enabled in NVIC: pin interrupt of keys and asynchronous resume
+ * interrupt of USB. Low power timer on 1kHz LPO also wakes every
+ * SUSPEND_WAKE_MS so that bus reset without resume is seen by USB driver.
+ * Interrupts are held off until USB is out of suspend again, then ChibiOS
+ * driver handles resume as usual. LLS would need all column pins on LLWU,
+ * which boards don't have. Breathing LED uses the timer, no deep sleep with
+ * SLEEP_LED_ENABLE.
+ */
+#ifndef SUSPEND_WAKE_MS
+#define SUSPEND_WAKE_MS     8
+#endif
+/* bits of registers, names vary among Kinetis headers */
+#define PMPROT_AVLP         0x20
+#define PMCTRL_STOPM_MASK   0x07
+#define PMCTRL_STOPM_VLPS   0x02
+#define USBCTRL_SUSP        0x80
+#define USBTRC0_USBRESMEN   0x20
+#define LPTMR_CLOCK_LPO     1
+#if !defined(SIM_SCGC5_LPTMR)
+#define SIM_SCGC5_LPTMR SIM_SCGC5_LPTIMER
+#endif
+
+#define NVIC_WORDS          ((CORTEX_NUM_VECTORS + 31) / 32)
+
+static bool irq_pending(void)
+{
+    for (uint8_t i = 0; i < NVIC_WORDS; i++) {
+        if (NVIC->ISPR[i]) return true;
+    }
+    return false;
+}
+
+static void deep_sleep(void)
+{
+    // write-once after reset, nothing else here uses low power modes
+    SMC->PMPROT = PMPROT_AVLP;
+
+    SIM->SCGC5 |= SIM_SCGC5_LPTMR;
+    LPTMR0->CSR = 0;
+    LPTMR0->PSR = LPTMRx_PSR_PCS(LPTMR_CLOCK_LPO) | LPTMRx_PSR_PBYP;
+    LPTMR0->CMR = SUSPEND_WAKE_MS - 1;
+
+    chSysLock();
+    LPTMR0->CSR = LPTMRx_CSR_TIE | LPTMRx_CSR_TEN;
+    USB0->USBCTRL |= USBCTRL_SUSP;
+    USB0->USBTRC0 |= USBTRC0_USBRESMEN;
+    SMC->PMCTRL = (SMC->PMCTRL & ~PMCTRL_STOPM_MASK) | PMCTRL_STOPM_VLPS;
+    (void)SMC->PMCTRL;      // write completes before stop
+    SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk | SCB_SCR_SEVONPEND_Msk;
+
+    // nobody handles interrupts not enabled, their pending is stale unless
+    // request is still on(key down since armed)
+    for (uint8_t i = 0; i < NVIC_WORDS; i++) {
+        NVIC->ICPR[i] = ~NVIC->ISER[i];
+    }
+    __DSB();
+    __SEV();
+    __WFE();                // event register is clear now
+    if (!irq_pending()) __WFE();
+
+    SCB->SCR &= ~(SCB_SCR_SLEEPDEEP_Msk | SCB_SCR_SEVONPEND_Msk);
+    USB0->USBTRC0 &= ~USBTRC0_USBRESMEN;
+    USB0->USBCTRL &= ~USBCTRL_SUSP;
+    LPTMR0->CSR = LPTMRx_CSR_TCF;   // stop and clear
+    chSysUnlock();
+}
+#endif
+
 void suspend_power_down(void) {
-	// TODO: figure out what to power down and how
-	// shouldn't power down TPM/FTM if we want a breathing LED
-	// also shouldn't power down USB
+#ifdef SUSPEND_DEEP_SLEEP
+	// stop until key or USB resume when matrix can wake MCU up
+	if (suspend_pin_wakeup()) {
+		deep_sleep();
+		matrix_power_up();
+		return;
+	}
+#endif
 
 	// on AVR, this enables the watchdog for 15ms (max), and goes to
 	// SLEEP_MODE_PWR_DOWN
@@ -27,17 +117,13 @@ void suspend_power_down(void) {
 	chThdSleepMilliseconds(17);
 }
 
-__attribute__ ((weak)) void matrix_power_up(void) {}
-__attribute__ ((weak)) void matrix_power_down(void) {}
+void suspend_power_down_reset(void) {}
 bool suspend_wakeup_condition(void)
 {
     matrix_power_up();
-    matrix_scan();
+    bool down = matrix_any_key_down();
     matrix_power_down();
-    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
-        if (matrix_get_row(r)) return true;
-    }
-    return false;
+    return down;
 }
 
 // run immediately after wakeup
@@ -2,26 +2,105 @@
 
 #include "timer.h"
 
-void timer_init(void) {}
+/*
+ * System time is 16 bit on some configs and ST2MS() overflows on large tick,
+ * so elapsed system ticks are summed into 32-bit ms and us counters instead.
+ * Counter has to be read once per wrap of system time at least, keyboard loop
+ * does it every cycle.
+ */
+#if (CH_CFG_ST_FREQUENCY % 1000)
+#   error "timer.c needs CH_CFG_ST_FREQUENCY of multiple of 1000"
+#endif
+#define TICKS_PER_MS    (CH_CFG_ST_FREQUENCY / 1000)
 
-void timer_clear(void) {}
+static systime_t last_st = 0;
+static uint32_t ms_count = 0;
+static uint32_t ms_rem = 0;     // ticks short of a ms
+
+#if PORT_SUPPORTS_RT && defined(STM32_SYSCLK)
+/* cycle counter for us, it wraps in a minute at 72MHz */
+#   define CYCLES_PER_US    (STM32_SYSCLK / 1000000)
+static rtcnt_t last_rt = 0;
+static uint32_t us_count = 0;
+static uint32_t us_rem = 0;     // cycles short of a us
+#endif
+
+/* called locked */
+static uint32_t timer_update(void)
+{
+    systime_t now = chVTGetSystemTimeX();
+    uint32_t d = (systime_t)(now - last_st) + ms_rem;
+    last_st = now;
+    ms_count += d / TICKS_PER_MS;
+    ms_rem = d % TICKS_PER_MS;
+#if PORT_SUPPORTS_RT && defined(STM32_SYSCLK)
+    rtcnt_t rt = chSysGetRealtimeCounterX();
+    uint32_t c = (rtcnt_t)(rt - last_rt) + us_rem;
+    last_rt = rt;
+    us_count += c / CYCLES_PER_US;
+    us_rem = c % CYCLES_PER_US;
+#endif
+    return ms_count;
+}
+
+void timer_init(void)
+{
+    timer_clear();
+}
+
+void timer_clear(void)
+{
+    syssts_t sts = chSysGetStatusAndLockX();
+    last_st = chVTGetSystemTimeX();
+    ms_count = 0;
+    ms_rem = 0;
+#if PORT_SUPPORTS_RT && defined(STM32_SYSCLK)
+    last_rt = chSysGetRealtimeCounterX();
+    us_count = 0;
+    us_rem = 0;
+#endif
+    chSysRestoreStatusX(sts);
+}
 
 uint16_t timer_read(void)
 {
-    return (uint16_t)ST2MS(chVTGetSystemTime());
+    return (uint16_t)timer_read32();
 }
 
 uint32_t timer_read32(void)
 {
-    return ST2MS(chVTGetSystemTime());
+    syssts_t sts = chSysGetStatusAndLockX();
+    uint32_t t = timer_update();
+    chSysRestoreStatusX(sts);
+    return t;
 }
 
 uint16_t timer_elapsed(uint16_t last)
 {
-    return (uint16_t)(ST2MS(chVTTimeElapsedSinceX(MS2ST(last))));
+    return TIMER_DIFF_16(timer_read(), last);
 }
 
 uint32_t timer_elapsed32(uint32_t last)
 {
-    return ST2MS(chVTTimeElapsedSinceX(MS2ST(last)));
+    return TIMER_DIFF_32(timer_read32(), last);
+}
+
+/* system tick resolution without cycle counter(Cortex-M0) */
+uint32_t timer_read_us(void)
+{
+    uint32_t t;
+    syssts_t sts = chSysGetStatusAndLockX();
+#if PORT_SUPPORTS_RT && defined(STM32_SYSCLK)
+    timer_update();
+    t = us_count;
+#else
+    t = timer_update() * 1000 + ms_rem * 1000 / TICKS_PER_MS;
+#endif
+    chSysRestoreStatusX(sts);
+    return t;
+}
+
+uint32_t timer_elapsed_us(uint32_t last)
+{
+    return TIMER_DIFF_32(timer_read_us(), last);
 }
@@ -33,6 +33,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "command.h"
 #include "backlight.h"
+#include "latency.h"
+#include "telemetry.h"
+#include "microbench.h"
+#include "ram_usage.h"
+#include "input_trace.h"
+#include "profile.h"
+#include "stress.h"
+#include "watchdog.h"
+#include "poll_sync.h"
 
 #ifdef MOUSEKEY_ENABLE
 #include "mousekey.h"
@@ -49,6 +58,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   include "usbdrv.h"
 #endif
 
+#ifdef PS2_USE_INT
+#   include "ps2.h"
+#endif
+
 
 static bool command_common(uint8_t code);
 static void command_common_help(void);
@@ -93,6 +106,11 @@ bool command_proc(uint8_t code)
     return true;
 }
 
+bool command_exec(uint8_t code)
+{
+    return (command_extra(code) || command_common(code));
+}
+
 /* TODO: Refactoring is needed. */
 /* This allows to define extra commands. return false when not processed. */
 bool command_extra(uint8_t code) __attribute__ ((weak));
@@ -141,6 +159,43 @@ static void command_common_help(void)
 #ifdef SLEEP_LED_ENABLE
           "z:	sleep LED test\n"
 #endif
+
+#ifdef LATENCY_TRACE_ENABLE
+          "l:	latency trace(and clear)\n"
+#endif
+
+#ifdef TELEMETRY_ENABLE
+          "t:	telemetry(and clear)\n"
+#endif
+
+#ifdef MICROBENCH_ENABLE
+          "b:	microbenchmark\n"
+#endif
+
+#ifdef RAM_USAGE_ENABLE
+          "u:	RAM usage\n"
+#endif
+
+#ifdef PROFILE_ENABLE
+          "p:	profile dump(and clear)\n"
+#endif
+
+#ifdef STRESS_ENABLE
+          "f:	report stress test(start/stop)\n"
+#endif
+
+#ifdef WATCHDOG_ENABLE
+          "w:	watchdog reset cause\n"
+#endif
+
+#ifdef POLL_SYNC_ENABLE
+          "j:	host poll sync\n"
+#endif
+
+#ifdef INPUT_TRACE_ENABLE
+          "i:	input trace dump\n"
+          "r:	input trace replay\n"
+#endif
     );
 }
 
@@ -201,6 +256,57 @@ static bool command_common(uint8_t code)
             sleep_led_test = !sleep_led_test;
             break;
 #endif
+#ifdef LATENCY_TRACE_ENABLE
+        case KC_L:
+            latency_print();
+            latency_clear();
+            break;
+#endif
+#ifdef TELEMETRY_ENABLE
+        case KC_T:
+            telemetry_print();
+            telemetry_clear();
+            break;
+#endif
+#ifdef MICROBENCH_ENABLE
+        case KC_B:
+            microbench_run();
+            break;
+#endif
+#ifdef RAM_USAGE_ENABLE
+        case KC_U:
+            ram_usage_print();
+            break;
+#endif
+#ifdef PROFILE_ENABLE
+        case KC_P:
+            profile_print();
+            profile_clear();
+            break;
+#endif
+#ifdef STRESS_ENABLE
+        case KC_F:
+            stress_toggle();
+            break;
+#endif
+#ifdef WATCHDOG_ENABLE
+        case KC_W:
+            watchdog_print();
+            break;
+#endif
+#ifdef POLL_SYNC_ENABLE
+        case KC_J:
+            poll_sync_print();
+            break;
+#endif
+#ifdef INPUT_TRACE_ENABLE
+        case KC_I:
+            input_trace_dump();
+            break;
+        case KC_R:
+            input_trace_replay();
+            break;
+#endif
 #ifdef BOOTMAGIC_ENABLE
         case KC_E:
             print("eeconfig:\n");
@@ -319,6 +425,24 @@ static bool command_common(uint8_t code)
 #endif
 #ifdef KEYMAP_SECTION_ENABLE
             " KEYMAP_SECTION"
+#endif
+#ifdef LATENCY_TRACE_ENABLE
+            " LATENCY_TRACE"
+#endif
+#ifdef TELEMETRY_ENABLE
+            " TELEMETRY"
+#endif
+#ifdef MICROBENCH_ENABLE
+            " MICROBENCH"
+#endif
+#ifdef PROFILE_ENABLE
+            " PROFILE"
+#endif
+#ifdef STRESS_ENABLE
+            " STRESS"
+#endif
+#ifdef INPUT_TRACE_ENABLE
+            " INPUT_TRACE"
 #endif
             " " STR(BOOTLOADER_SIZE) "\n");
 
@@ -340,6 +464,10 @@ static bool command_common(uint8_t code)
             print_val_hex8(keyboard_nkro);
 #endif
             print_val_hex32(timer_read32());
+#ifdef PS2_USE_INT
+            print_val_hex16(ps2_error_count);
+            print_val_hex16(ps2_resync_count);
+#endif
 
 #ifdef PROTOCOL_PJRC
             print_val_hex8(UDCON);
@@ -355,7 +483,7 @@ static bool command_common(uint8_t code)
 #   endif
 #endif
             break;
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_HYBRID)
         case KC_N:
             clear_keyboard(); //Prevents stuck keys.
             keyboard_nkro = !keyboard_nkro;
@@ -28,6 +28,8 @@ bool command_console_extra(uint8_t code);
 
 #ifdef COMMAND_ENABLE
 bool command_proc(uint8_t code);
+/* runs Magic command of code regardless of Magic keys, for console command */
+bool command_exec(uint8_t code);
 #else
 #define command_proc(code)      false
 #endif
@@ -0,0 +1,105 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "command.h"
+#include "console_command.h"
+#ifdef TELEMETRY_ENABLE
+#   include "telemetry.h"
+#endif
+#ifdef DYNAMIC_KEYMAP_ENABLE
+#   include "dynamic_keymap.h"
+#endif
+#ifdef TYPE_INJECT_ENABLE
+#   include "type_inject.h"
+#endif
+#ifdef MOUSEKEY_ENABLE
+#   include "mousekey.h"
+
+/* in order of mousekey console */
+static uint8_t * const mk_params[] = {
+    &mk_delay, &mk_interval, &mk_max_speed, &mk_time_to_max,
+    &mk_wheel_max_speed, &mk_wheel_time_to_max
+};
+#define MK_PARAMS   (sizeof(mk_params) / sizeof(mk_params[0]))
+#endif
+
+
+static bool command_client(uint8_t *data, uint8_t length)
+{
+    switch (data[0]) {
+#ifdef COMMAND_ENABLE
+        case CONSOLE_COMMAND_EXEC:
+            if (length < 3) break;
+            data[2] = command_exec(data[1]);
+            return true;
+        case CONSOLE_COMMAND_SCRIPT: {
+            uint8_t n = data[1];
+            if (n > length - 2) break;
+            uint8_t done = 0;
+            while (done < n && command_exec(data[2 + done])) done++;
+            data[2] = done;
+            return true;
+        }
+#endif
+#ifdef MOUSEKEY_ENABLE
+        case CONSOLE_COMMAND_MK_GET:
+            if (length < 1 + MK_PARAMS) break;
+            for (uint8_t i = 0; i < MK_PARAMS; i++) data[1 + i] = *mk_params[i];
+            return true;
+        case CONSOLE_COMMAND_MK_SET: {
+            uint8_t count = 0;
+            for (uint8_t i = 1; i + 1 < length && data[i]; i += 2) {
+                if (data[i] > MK_PARAMS) break;
+                *mk_params[data[i] - 1] = data[i + 1];
+                count++;
+            }
+            data[1] = count;
+            return true;
+        }
+#endif
+        default:
+            break;
+    }
+    data[1] = data[0];
+    data[0] = CONSOLE_COMMAND_ERROR;
+    return true;
+}
+
+bool console_command(uint8_t *data, uint8_t length)
+{
+    if (length < 2 || !(data[0] & 0x80)) return false;
+
+    switch (data[0] & 0xF0) {
+        case 0xB0:
+            return command_client(data, length);
+#ifdef TELEMETRY_ENABLE
+        case 0xC0:
+            return telemetry_command(data, length);
+#endif
+#ifdef DYNAMIC_KEYMAP_ENABLE
+        case 0xD0:
+            return dynamic_keymap_command(data, length);
+#endif
+#ifdef TYPE_INJECT_ENABLE
+        case 0xE0:
+            return type_inject_command(data, length);
+#endif
+        default:
+            return false;
+    }
+}
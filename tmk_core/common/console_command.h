@@ -0,0 +1,63 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CONSOLE_COMMAND_H
+#define CONSOLE_COMMAND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Console commands
+ *
+ * Host tools share console endpoints with hid_listen. A packet on console
+ * OUT endpoint is a command when its first byte has bit7 set and the reply
+ * is a whole packet on console IN endpoint starting with the same byte or
+ * error of the client. Text of console never starts with a byte of bit7 set,
+ * so a tool reads replies and text from one endpoint and tells them apart.
+ * Send full packets(CONSOLE_EPSIZE), replies are no longer than request.
+ *
+ * High nibble of first byte picks client:
+ *
+ *   Bx     command     COMMAND_ENABLE
+ *   Cx     telemetry   TELEMETRY_ENABLE, see telemetry.h
+ *   Dx     keymap      DYNAMIC_KEYMAP_ENABLE, see dynamic_keymap.h
+ *   Ex     typing      TYPE_INJECT_ENABLE, see type_inject.h
+ *
+ * Command runs a Magic command as if key of code was pressed with Magic keys
+ * held, its output goes out on console as text. Script runs n of them in
+ * order and stops at first one not processed. Mousekey parameters are read
+ * and set several at once without the interactive mousekey console, index is
+ * 1-6 as in that console(delay, interval, max_speed, time_to_max,
+ * wheel_max_speed, wheel_time_to_max), index 0 ends the list:
+ *
+ *   B0 keycode         exec    -> B0 keycode processed(1/0)
+ *   B1 n keycode...    script  -> B1 n done
+ *   B2                 mk get  -> B2 delay interval ... wheel_time_to_max
+ *   B3 i v [i v]... 0  mk set  -> B3 count_set
+ *   error                      -> BF command
+ */
+#define CONSOLE_COMMAND_EXEC    0xB0
+#define CONSOLE_COMMAND_SCRIPT  0xB1
+#define CONSOLE_COMMAND_MK_GET  0xB2
+#define CONSOLE_COMMAND_MK_SET  0xB3
+#define CONSOLE_COMMAND_ERROR   0xBF
+
+
+/* runs command in data and puts reply in it, returns false if not command */
+bool console_command(uint8_t *data, uint8_t length);
+
+#endif
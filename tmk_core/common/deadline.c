@@ -0,0 +1,52 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "deadline.h"
+
+
+static uint16_t deadline_time[DEADLINES];
+static uint8_t armed = 0;
+
+
+void deadline_set(deadline_t id, uint16_t time)
+{
+    deadline_time[id] = time;
+    armed |= DEADLINE_BIT(id);
+}
+
+void deadline_clear(deadline_t id)
+{
+    armed &= ~DEADLINE_BIT(id);
+}
+
+uint8_t deadline_take(void)
+{
+    // nothing waits in most of scans
+    if (!armed) return 0;
+
+    uint16_t now = timer_read();
+    uint8_t due = 0;
+    for (uint8_t i = 0; i < DEADLINES; i++) {
+        if ((armed & DEADLINE_BIT(i)) && TIMER_DIFF_16(now, deadline_time[i]) < 0x8000) {
+            due |= DEADLINE_BIT(i);
+        }
+    }
+    armed &= ~due;
+    return due;
+}
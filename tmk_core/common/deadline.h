@@ -0,0 +1,48 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <stdint.h>
+
+
+/*
+ * Deadlines of timed states
+ *
+ * Modules which wait for time arm their slot with the time of timer_read()
+ * when they need a call, and keyboard_task() calls them only once it comes
+ * instead of polling them every scan. Slot is cleared when taken, module
+ * arms it again as long as it still waits, so that being called a little
+ * early is harmless. Time must be within 32 seconds from now.
+ */
+typedef enum {
+    DEADLINE_TAPPING,       // tapping term of tapping_key, action_exec(TICK)
+    DEADLINE_COMBO,         // COMBO_TERM of held keys, action_exec(TICK)
+    DEADLINE_ONESHOT,       // ONESHOT_TIMEOUT, send_keyboard_report()
+    DEADLINE_MACRO,         // wait of ACTION_MACRO_ASYNC, action_macro_task()
+    DEADLINE_LEADER,        // LEADER_TIMEOUT of sequence, action_leader_task()
+    DEADLINES
+} deadline_t;
+
+#define DEADLINE_BIT(id)    ((uint8_t)1 << (id))
+
+void deadline_set(deadline_t id, uint16_t time);
+void deadline_clear(deadline_t id);
+/* bits of slots whose time has come, they are cleared */
+uint8_t deadline_take(void);
+
+#endif
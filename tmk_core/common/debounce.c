@@ -0,0 +1,330 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Debounce of matrix
+ *
+ * Time is measured with timer_read() instead of waiting in scan loop, a
+ * timer counts down remaining ms and 0 means idle. Timers are updated
+ * with time elapsed since last call so that scan rate doesn't matter.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "debounce.h"
+
+
+#define ROW_BIT(col)    ((matrix_row_t)1<<(col))
+
+#if DEBOUNCE > 0
+
+static uint16_t last_time;
+
+#if DEBOUNCE_TYPE == DEBOUNCE_DEFER_GLOBAL
+static uint8_t global_timer;
+#elif DEBOUNCE_TYPE == DEBOUNCE_DEFER_ROW || DEBOUNCE_TYPE == DEBOUNCE_EAGER_ROW
+static uint8_t timers[MATRIX_ROWS];
+static uint8_t active;
+#   if DEBOUNCE_TYPE == DEBOUNCE_DEFER_ROW
+/* raw rows of last call, to restart timer on bounce */
+static matrix_row_t raw_prev[MATRIX_ROWS];
+#   endif
+#elif DEBOUNCE_TYPE == DEBOUNCE_DEFER_KEY || DEBOUNCE_TYPE == DEBOUNCE_EAGER_KEY
+static uint8_t timers[MATRIX_ROWS][MATRIX_COLS];
+/* keys whose timer is running */
+static matrix_row_t running[MATRIX_ROWS];
+static uint16_t active;
+#else
+#   error "DEBOUNCE_TYPE: unknown debounce algorithm"
+#endif
+
+#ifdef DEBOUNCE_ADAPTIVE
+static debounce_stat_t stats[MATRIX_ROWS][MATRIX_COLS];
+/* time of last release of key */
+static uint16_t released[MATRIX_ROWS][MATRIX_COLS];
+#   define KEY_DEBOUNCE(r, c)   (stats[r][c].time)
+#   define KEY_BOUNCED(r, c)    do { \
+        if (stats[r][c].bounces < 255) stats[r][c].bounces++; \
+    } while (0)
+#else
+#   define KEY_DEBOUNCE(r, c)   DEBOUNCE
+#   define KEY_BOUNCED(r, c)    ((void)0)
+#endif
+
+
+/* ms elapsed since last call, saturated to counter range */
+static uint8_t elapsed_ms(void)
+{
+    uint16_t now = timer_read();
+    uint16_t t = TIMER_DIFF_16(now, last_time);
+    last_time = now;
+    return (t > 255) ? 255 : t;
+}
+
+#ifdef DEBOUNCE_ADAPTIVE
+/* Called when cooked state of key changes, at time of this debounce() call. */
+static void key_changed(uint8_t r, uint8_t c, bool pressed)
+{
+    if (!pressed) {
+        released[r][c] = last_time;
+        return;
+    }
+    if (TIMER_DIFF_16(last_time, released[r][c]) >= DEBOUNCE_CHATTER) return;
+
+    debounce_stat_t *s = &stats[r][c];
+    if (s->chatters < 255) s->chatters++;
+    s->time = (s->time > DEBOUNCE_ADAPTIVE_MAX - DEBOUNCE_ADAPTIVE_STEP) ?
+              DEBOUNCE_ADAPTIVE_MAX : s->time + DEBOUNCE_ADAPTIVE_STEP;
+}
+
+const debounce_stat_t *debounce_stat(uint8_t row, uint8_t col)
+{
+    return &stats[row][col];
+}
+
+void debounce_stat_clear(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            stats[r][c].bounces = 0;
+            stats[r][c].chatters = 0;
+        }
+    }
+}
+#else
+#   define key_changed(r, c, pressed)   ((void)0)
+#endif
+
+/* counts down timer and returns true when it expires */
+static inline bool countdown(uint8_t *t, uint8_t elapsed)
+{
+    if (*t > elapsed) {
+        *t -= elapsed;
+        return false;
+    }
+    *t = 0;
+    return true;
+}
+
+void debounce_init(void)
+{
+    last_time = timer_read();
+#if DEBOUNCE_TYPE == DEBOUNCE_DEFER_GLOBAL
+    global_timer = 0;
+#else
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+#   if DEBOUNCE_TYPE == DEBOUNCE_DEFER_ROW || DEBOUNCE_TYPE == DEBOUNCE_EAGER_ROW
+        timers[r] = 0;
+#       if DEBOUNCE_TYPE == DEBOUNCE_DEFER_ROW
+        raw_prev[r] = 0;
+#       endif
+#   else
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            timers[r][c] = 0;
+#       ifdef DEBOUNCE_ADAPTIVE
+            stats[r][c] = (debounce_stat_t){ .time = DEBOUNCE };
+            released[r][c] = last_time - DEBOUNCE_CHATTER;
+#       endif
+        }
+        running[r] = 0;
+#   endif
+    }
+    active = 0;
+#endif
+}
+
+bool debounce_active(void)
+{
+#if DEBOUNCE_TYPE == DEBOUNCE_DEFER_GLOBAL
+    return global_timer;
+#else
+    return active;
+#endif
+}
+
+
+#if DEBOUNCE_TYPE == DEBOUNCE_DEFER_GLOBAL
+/* Copy whole matrix after no change for DEBOUNCE ms. */
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], bool changed)
+{
+    uint8_t elapsed = elapsed_ms();
+
+    if (changed) {
+        global_timer = DEBOUNCE;
+        return false;
+    }
+    if (!global_timer || !countdown(&global_timer, elapsed)) return false;
+
+    bool updated = false;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (cooked[r] != raw[r]) {
+            cooked[r] = raw[r];
+            updated = true;
+        }
+    }
+    return updated;
+}
+
+#elif DEBOUNCE_TYPE == DEBOUNCE_DEFER_ROW
+/* Copy a row after the row is stable for DEBOUNCE ms. */
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], bool changed)
+{
+    uint8_t elapsed = elapsed_ms();
+    bool updated = false;
+
+    if (!changed && !active) return false;
+
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (raw[r] != raw_prev[r]) {
+            raw_prev[r] = raw[r];
+            if (raw[r] == cooked[r]) {
+                // bounced back
+                if (timers[r]) { timers[r] = 0; active--; }
+            } else {
+                if (!timers[r]) active++;
+                timers[r] = DEBOUNCE;
+            }
+        } else if (timers[r] && countdown(&timers[r], elapsed)) {
+            active--;
+            cooked[r] = raw[r];
+            updated = true;
+        }
+    }
+    return updated;
+}
+
+#elif DEBOUNCE_TYPE == DEBOUNCE_DEFER_KEY
+/* Copy a key after the key is stable for DEBOUNCE ms. */
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], bool changed)
+{
+    uint8_t elapsed = elapsed_ms();
+    bool updated = false;
+
+    if (!changed && !active) return false;
+
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        matrix_row_t diff = raw[r] ^ cooked[r];
+        matrix_row_t keys = diff | running[r];
+        if (!keys) continue;
+
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            matrix_row_t bit = ROW_BIT(c);
+            if (!(keys & bit)) continue;
+
+            if (!(diff & bit)) {
+                // bounced back while waiting
+                timers[r][c] = 0;
+                running[r] &= ~bit;
+                active--;
+                KEY_BOUNCED(r, c);
+            } else if (!(running[r] & bit)) {
+                timers[r][c] = KEY_DEBOUNCE(r, c);
+                running[r] |= bit;
+                active++;
+            } else if (countdown(&timers[r][c], elapsed)) {
+                running[r] &= ~bit;
+                active--;
+                cooked[r] ^= bit;
+                key_changed(r, c, cooked[r] & bit);
+                updated = true;
+            }
+        }
+    }
+    return updated;
+}
+
+#elif DEBOUNCE_TYPE == DEBOUNCE_EAGER_ROW
+/* Copy a row at once and then ignore the row for DEBOUNCE ms. */
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], bool changed)
+{
+    uint8_t elapsed = elapsed_ms();
+    bool updated = false;
+
+    if (!changed && !active) return false;
+
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (timers[r]) {
+            if (!countdown(&timers[r], elapsed)) continue;
+            active--;
+        }
+        // idle or just expired: take change occurred in the meantime
+        if (raw[r] != cooked[r]) {
+            cooked[r] = raw[r];
+            timers[r] = DEBOUNCE;
+            active++;
+            updated = true;
+        }
+    }
+    return updated;
+}
+
+#elif DEBOUNCE_TYPE == DEBOUNCE_EAGER_KEY
+/* Copy a key at once and then ignore the key for DEBOUNCE ms. */
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], bool changed)
+{
+    uint8_t elapsed = elapsed_ms();
+    bool updated = false;
+
+    if (!changed && !active) return false;
+
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        matrix_row_t keys = (raw[r] ^ cooked[r]) | running[r];
+        if (!keys) continue;
+
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            matrix_row_t bit = ROW_BIT(c);
+            if (!(keys & bit)) continue;
+
+            if (running[r] & bit) {
+                if (!countdown(&timers[r][c], elapsed)) continue;
+                running[r] &= ~bit;
+                active--;
+            }
+            if ((raw[r] ^ cooked[r]) & bit) {
+                cooked[r] ^= bit;
+                key_changed(r, c, cooked[r] & bit);
+                timers[r][c] = KEY_DEBOUNCE(r, c);
+                running[r] |= bit;
+                active++;
+                updated = true;
+            }
+        }
+    }
+    return updated;
+}
+#endif
+
+#else /* DEBOUNCE == 0 */
+
+void debounce_init(void) {}
+
+bool debounce_active(void) { return false; }
+
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], bool changed)
+{
+    if (!changed) return false;
+
+    bool updated = false;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (cooked[r] != raw[r]) {
+            cooked[r] = raw[r];
+            updated = true;
+        }
+    }
+    return updated;
+}
+#endif
@@ -0,0 +1,113 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+
+/* debounce time(ms), 0 disables debouncing */
+#ifndef DEBOUNCE
+#   define DEBOUNCE 5
+#endif
+#if (DEBOUNCE > 255)
+#   error "DEBOUNCE must not exceed 255"
+#endif
+
+/* Debounce algorithms for DEBOUNCE_TYPE
+ *
+ * DEFER: report a change after it has been stable for DEBOUNCE ms.
+ * EAGER: report a change at once, then ignore the key for DEBOUNCE ms.
+ *        Needs switches which don't make noise when idle.
+ *
+ * GLOBAL(default) waits for the whole matrix to settle, like old matrix.c
+ * code. ROW and KEY keep a timer per row or per key(MATRIX_ROWS*MATRIX_COLS
+ * bytes of RAM) so that one key doesn't hold back others.
+ */
+#define DEBOUNCE_DEFER_GLOBAL   0
+#define DEBOUNCE_DEFER_ROW      1
+#define DEBOUNCE_DEFER_KEY      2
+#define DEBOUNCE_EAGER_ROW      3
+#define DEBOUNCE_EAGER_KEY      4
+
+#ifndef DEBOUNCE_TYPE
+#   define DEBOUNCE_TYPE    DEBOUNCE_DEFER_GLOBAL
+#endif
+
+/* Adaptive debounce(DEBOUNCE_ADAPTIVE) for DEBOUNCE_DEFER_KEY and EAGER_KEY
+ *
+ * A key pressed again within DEBOUNCE_CHATTER ms after its release is taken
+ * as chatter of worn switch, nobody types that fast. Each chatter raises
+ * debounce time of the key by DEBOUNCE_ADAPTIVE_STEP up to
+ * DEBOUNCE_ADAPTIVE_MAX, other keys keep DEBOUNCE. Raised time lasts until
+ * reset. Statistics of each key are read with telemetry command(C5) and take
+ * five bytes of RAM per key.
+ */
+#ifdef DEBOUNCE_ADAPTIVE
+#   if DEBOUNCE_TYPE != DEBOUNCE_DEFER_KEY && DEBOUNCE_TYPE != DEBOUNCE_EAGER_KEY
+#       error "DEBOUNCE_ADAPTIVE needs DEBOUNCE_DEFER_KEY or DEBOUNCE_EAGER_KEY"
+#   endif
+#   if DEBOUNCE == 0
+#       error "DEBOUNCE_ADAPTIVE needs DEBOUNCE"
+#   endif
+#   ifndef DEBOUNCE_CHATTER
+#       define DEBOUNCE_CHATTER         30
+#   endif
+#   ifndef DEBOUNCE_ADAPTIVE_STEP
+#       define DEBOUNCE_ADAPTIVE_STEP   DEBOUNCE
+#   endif
+#   ifndef DEBOUNCE_ADAPTIVE_MAX
+#       define DEBOUNCE_ADAPTIVE_MAX    (DEBOUNCE * 4)
+#   endif
+#   if DEBOUNCE_ADAPTIVE_MAX > 255 || DEBOUNCE_ADAPTIVE_MAX < DEBOUNCE
+#       error "DEBOUNCE_ADAPTIVE_MAX must be from DEBOUNCE to 255"
+#   endif
+
+typedef struct {
+    uint8_t bounces;    /* raw changes back before stable(DEFER_KEY), saturated */
+    uint8_t chatters;   /* presses within DEBOUNCE_CHATTER after release, saturated */
+    uint8_t time;       /* debounce time of key(ms) */
+} debounce_stat_t;
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void debounce_init(void);
+/* Update cooked(debounced) matrix from raw matrix read by scan.
+ * changed: raw matrix differs from that of last call
+ * returns true when cooked matrix is updated
+ */
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], bool changed);
+/* whether any debounce timer is running */
+bool debounce_active(void);
+
+#ifdef DEBOUNCE_ADAPTIVE
+const debounce_stat_t *debounce_stat(uint8_t row, uint8_t col);
+/* zero counters, debounce time of keys is kept */
+void debounce_stat_clear(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/eeprom.h>
+#include "keymap.h"
+#include "action.h"
+#include "action_layer.h"
+#include "eeconfig.h"
+#include "debug.h"
+#include "dynamic_keymap.h"
+
+
+/* EEPROM: magic word, layers, rows, cols and keycodes */
+#define DYNAMIC_KEYMAP_MAGIC    (uint16_t)0xD7E1
+#define EE_MAGIC                ((uint16_t *)EECONFIG_DYNAMIC_KEYMAP)
+#define EE_LAYERS               (EECONFIG_DYNAMIC_KEYMAP + 2)
+#define EE_ROWS                 (EECONFIG_DYNAMIC_KEYMAP + 3)
+#define EE_COLS                 (EECONFIG_DYNAMIC_KEYMAP + 4)
+#define EE_KEYS                 (EECONFIG_DYNAMIC_KEYMAP + 5)
+
+static uint8_t keycodes[DYNAMIC_KEYMAP_LAYERS][MATRIX_ROWS][MATRIX_COLS];
+/* EEPROM has the keymap */
+static bool stored = false;
+
+
+static bool eeprom_has_keymap(void)
+{
+    return eeprom_read_word(EE_MAGIC) == DYNAMIC_KEYMAP_MAGIC &&
+           eeprom_read_byte(EE_LAYERS) == DYNAMIC_KEYMAP_LAYERS &&
+           eeprom_read_byte(EE_ROWS) == MATRIX_ROWS &&
+           eeprom_read_byte(EE_COLS) == MATRIX_COLS;
+}
+
+static void load_keymaps(void)
+{
+    for (uint8_t layer = 0; layer < DYNAMIC_KEYMAP_LAYERS; layer++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+                keycodes[layer][row][col] = keymap_key_to_keycode(layer, (keypos_t){ .row = row, .col = col });
+            }
+        }
+    }
+}
+
+void dynamic_keymap_init(void)
+{
+    stored = eeprom_has_keymap();
+    if (stored) {
+        eeprom_read_block(keycodes, EE_KEYS, sizeof(keycodes));
+    } else {
+        load_keymaps();
+    }
+    layer_rows_clear();
+    dprintf("dynamic_keymap: %s\n", stored ? "eeprom" : "keymaps");
+}
+
+uint8_t dynamic_keymap_get(uint8_t layer, keypos_t key)
+{
+    return keycodes[layer][key.row][key.col];
+}
+
+void dynamic_keymap_set(uint8_t layer, keypos_t key, uint8_t keycode)
+{
+    // release of a held key would resolve to new keycode
+    clear_keyboard();
+
+    keycodes[layer][key.row][key.col] = keycode;
+    layer_rows_clear();
+    if (stored) {
+        eeprom_update_byte(EE_KEYS + (&keycodes[layer][key.row][key.col] - &keycodes[0][0][0]), keycode);
+        return;
+    }
+
+    // magic last so that keymap is valid only when completely written
+    eeprom_update_block(keycodes, EE_KEYS, sizeof(keycodes));
+    eeprom_update_byte(EE_LAYERS, DYNAMIC_KEYMAP_LAYERS);
+    eeprom_update_byte(EE_ROWS, MATRIX_ROWS);
+    eeprom_update_byte(EE_COLS, MATRIX_COLS);
+    eeprom_update_word(EE_MAGIC, DYNAMIC_KEYMAP_MAGIC);
+    stored = true;
+}
+
+void dynamic_keymap_reset(void)
+{
+    clear_keyboard();
+    eeprom_update_word(EE_MAGIC, 0xFFFF);
+    stored = false;
+    load_keymaps();
+    layer_rows_clear();
+}
+
+bool dynamic_keymap_command(uint8_t *data, uint8_t length)
+{
+    if (length == 0) return false;
+
+    uint8_t command = data[0];
+    switch (command) {
+        case DYNAMIC_KEYMAP_GET:
+        case DYNAMIC_KEYMAP_SET:
+            if (length < 5 ||
+                    data[1] >= DYNAMIC_KEYMAP_LAYERS ||
+                    data[2] >= MATRIX_ROWS ||
+                    data[3] >= MATRIX_COLS) {
+                break;
+            }
+            if (command == DYNAMIC_KEYMAP_SET) {
+                dynamic_keymap_set(data[1], (keypos_t){ .row = data[2], .col = data[3] }, data[4]);
+            }
+            data[4] = keycodes[data[1]][data[2]][data[3]];
+            return true;
+        case DYNAMIC_KEYMAP_RESET:
+            dynamic_keymap_reset();
+            return true;
+        case DYNAMIC_KEYMAP_INFO:
+            if (length < 4) break;
+            data[1] = DYNAMIC_KEYMAP_LAYERS;
+            data[2] = MATRIX_ROWS;
+            data[3] = MATRIX_COLS;
+            return true;
+        default:
+            return false;
+    }
+
+    data[0] = DYNAMIC_KEYMAP_ERROR;
+    data[1] = command;
+    return true;
+}
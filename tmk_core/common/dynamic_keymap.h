@@ -0,0 +1,62 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DYNAMIC_KEYMAP_H
+#define DYNAMIC_KEYMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyboard.h"
+
+
+/* Dynamic keymap
+ *
+ * Keycodes of layer 0 to DYNAMIC_KEYMAP_LAYERS-1 are kept in RAM and
+ * action_for_key() reads them from there, EEPROM is read only at startup.
+ * They are loaded from EEPROM if it has a keymap of this shape, otherwise
+ * from keymaps[]. Edits are written through to EEPROM; the first edit after
+ * reset writes whole keymap.
+ *
+ * Commands come as packets on console OUT endpoint and the reply is the
+ * packet on console IN endpoint. Text of console never starts with a byte
+ * of bit7 set, replies always do. See console_command.h for other clients.
+ *
+ *   D0 layer row col           get     -> D0 layer row col keycode
+ *   D1 layer row col keycode   set     -> D1 layer row col keycode
+ *   D2                         reset   -> D2, keymap is from keymaps[] again
+ *   D3                         info    -> D3 layers rows cols
+ *   error                              -> DF command
+ */
+#define DYNAMIC_KEYMAP_GET      0xD0
+#define DYNAMIC_KEYMAP_SET      0xD1
+#define DYNAMIC_KEYMAP_RESET    0xD2
+#define DYNAMIC_KEYMAP_INFO     0xD3
+#define DYNAMIC_KEYMAP_ERROR    0xDF
+
+/* layers in RAM, MATRIX_ROWS*MATRIX_COLS bytes of RAM and EEPROM each */
+#ifndef DYNAMIC_KEYMAP_LAYERS
+#define DYNAMIC_KEYMAP_LAYERS   2
+#endif
+
+
+void dynamic_keymap_init(void);
+uint8_t dynamic_keymap_get(uint8_t layer, keypos_t key);
+void dynamic_keymap_set(uint8_t layer, keypos_t key, uint8_t keycode);
+void dynamic_keymap_reset(void);
+/* runs command in data and puts reply in it, returns false if not command */
+bool dynamic_keymap_command(uint8_t *data, uint8_t length);
+
+#endif
@@ -31,6 +31,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define EECONFIG_KEYMAP                             (uint8_t *)4
 #define EECONFIG_MOUSEKEY_ACCEL                     (uint8_t *)5
 #define EECONFIG_BACKLIGHT                          (uint8_t *)6
+#define EECONFIG_SCAN_RATE                          (uint8_t *)7
+/* 8-11: scan timing calibrated by keyboard, see keyboard/hhkb/matrix.c */
+#define EECONFIG_MATRIX_TIMING                      (uint8_t *)8
+/* 12-15: learned tapping terms(ms/2), see TAPPING_TERM_ADAPTIVE */
+#define EECONFIG_TAPPING_TERM                       (uint8_t *)12
+#define EECONFIG_TAPPING_TERM_SLOTS                 4
+/* to end of keymap, see dynamic_keymap.c */
+#define EECONFIG_DYNAMIC_KEYMAP                     (uint8_t *)16
 
 
 /* debug bit */
@@ -39,6 +47,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define EECONFIG_DEBUG_KEYBOARD                     (1<<2)
 #define EECONFIG_DEBUG_MOUSE                        (1<<3)
 
+/* scan rate: active interval(ms) in high nibble, idle interval(4ms) in low
+ * nibble, 0 is default of config.h and so is 0xFF(unset), see
+ * MATRIX_SCAN_ADAPTIVE in keyboard.c */
+#define EECONFIG_SCAN_RATE_ACTIVE(rate)             ((rate) >> 4)
+#define EECONFIG_SCAN_RATE_IDLE(rate)               (((rate) & 0x0F) * 4)
+
 /* keyconf bit */
 #define EECONFIG_KEYMAP_SWAP_CONTROL_CAPSLOCK       (1<<0)
 #define EECONFIG_KEYMAP_CAPSLOCK_TO_CONTROL         (1<<1)
@@ -72,4 +86,22 @@ uint8_t eeconfig_read_backlight(void);
 void eeconfig_write_backlight(uint8_t val);
 #endif
 
+uint8_t eeconfig_read_scan_rate(void);
+void eeconfig_write_scan_rate(uint8_t val);
+
+uint8_t eeconfig_read_tapping_term(uint8_t slot);
+void eeconfig_write_tapping_term(uint8_t slot, uint8_t val);
+
+/* EECONFIG_WRITE_DELAY: eeconfig_write_*() only change RAM and
+ * eeconfig_task() writes the changed bytes after no change for the delay(ms),
+ * one byte per call when EEPROM is ready so that scan never waits for it.
+ * eeconfig_flush() writes them at once, before bootloader and suspend. */
+#if defined(EECONFIG_WRITE_DELAY) && defined(__AVR__)
+void eeconfig_task(void);
+void eeconfig_flush(void);
+#else
+#define eeconfig_task()
+#define eeconfig_flush()
+#endif
+
 #endif
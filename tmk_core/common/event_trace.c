@@ -0,0 +1,109 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "sendchar.h"
+#include "action_layer.h"
+#include "event_trace.h"
+
+
+#if (EVENT_TRACE_SIZE < 2 || EVENT_TRACE_SIZE > 128 || (EVENT_TRACE_SIZE & (EVENT_TRACE_SIZE - 1)))
+#   error "EVENT_TRACE_SIZE must be power of two up to 128"
+#endif
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  arg;
+    uint8_t  row;
+    uint8_t  col;
+    uint16_t time;
+    uint16_t layer;
+} event_trace_t;
+
+static event_trace_t ring[EVENT_TRACE_SIZE];
+static uint8_t head = 0;
+static uint8_t count = 0;
+static uint8_t dropped = 0;
+
+
+void event_trace(uint8_t type, keypos_t key, uint8_t arg, uint32_t layer, bool has_layer)
+{
+    if (count == EVENT_TRACE_SIZE) {
+        if (dropped != UINT8_MAX) dropped++;
+        return;
+    }
+#ifdef NO_ACTION_LAYER
+    if (!has_layer) layer = 0;
+#else
+    if (!has_layer) layer = layer_state;
+#endif
+
+    event_trace_t *t = &ring[(head + count) & (EVENT_TRACE_SIZE - 1)];
+    t->type = type;
+    t->arg = arg;
+    t->row = key.row;
+    t->col = key.col;
+    t->time = timer_read();
+    t->layer = (uint16_t)layer;
+    count++;
+}
+
+static void send_hex8(uint8_t v)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    sendchar(hex[v >> 4]);
+    sendchar(hex[v & 0x0F]);
+}
+
+static void send_record(const event_trace_t *t)
+{
+    sendchar('!');
+    send_hex8(t->type);
+    send_hex8(t->arg);
+    send_hex8(t->row);
+    send_hex8(t->col);
+    send_hex8(t->time >> 8);
+    send_hex8(t->time);
+    send_hex8(t->layer >> 8);
+    send_hex8(t->layer);
+    sendchar('\n');
+}
+
+void event_trace_task(void)
+{
+    if (count) {
+        send_record(&ring[head]);
+        head = (head + 1) & (EVENT_TRACE_SIZE - 1);
+        count--;
+        return;
+    }
+
+    // records lost while ring was full come after records in it
+    if (dropped) {
+        event_trace_t t = { .type = TRACE_DROP, .arg = dropped, .time = timer_read() };
+        dropped = 0;
+        send_record(&t);
+    }
+}
+
+void event_trace_clear(void)
+{
+    head = 0;
+    count = 0;
+    dropped = 0;
+}
@@ -0,0 +1,86 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyboard.h"
+
+
+/* Binary trace of action processing
+ *
+ * Records are put into a ring in RAM from action code, which costs only a
+ * few stores, and event_trace_task() sends them to console later from
+ * keyboard_task(). Each record is a line of '!' and 16 hex digits:
+ *
+ *   !TTAARRCCttttLLLL
+ *   TT: type    AA: arg    RR: row    CC: col
+ *   tttt: timer_read() at record    LLLL: lower 16 bits of layer_state
+ *
+ * tool/event_trace decodes the lines from hid_listen output.
+ */
+enum event_trace_type {
+    TRACE_KEY = 1,      /* key event of matrix, arg: pressed */
+    TRACE_ACTION,       /* process_action(), arg: action kind id */
+    TRACE_TAPPING,      /* tapping_key changed, arg: TRACE_TAP_ARG of tapping_key */
+    TRACE_PROCESSED,    /* record is settled, arg: TRACE_TAP_ARG */
+    TRACE_OVERFLOW,     /* waiting buffer is full, arg: 1 settled, 2 cleared */
+    TRACE_LAYER,        /* layer_state changed */
+    TRACE_DEFAULT_LAYER,/* default_layer_state changed, layer: new default_layer_state */
+    TRACE_DROP,         /* records lost, arg: count */
+};
+
+/* tap count in bit0-3, interrupted in bit6 and pressed in bit7 */
+#define TRACE_TAP_ARG(r)    (((r).tap.count & 0x0F) | \
+                             ((r).tap.interrupted ? 0x40 : 0) | \
+                             ((r).event.pressed ? 0x80 : 0))
+
+/* records in ring, power of two up to 128 */
+#ifndef EVENT_TRACE_SIZE
+#define EVENT_TRACE_SIZE    16
+#endif
+
+
+#ifdef EVENT_TRACE_ENABLE
+
+#define EVENT_TRACE(type, key, arg)     event_trace((type), (key), (arg), 0, false)
+#define EVENT_TRACE_LAYER(type, state)  event_trace((type), (keypos_t){}, 0, (state), true)
+
+#else
+
+#define EVENT_TRACE(type, key, arg)     ((void)0)
+#define EVENT_TRACE_LAYER(type, state)  ((void)0)
+
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* layer is taken from layer_state unless has_layer */
+void event_trace(uint8_t type, keypos_t key, uint8_t arg, uint32_t layer, bool has_layer);
+/* send a record to console, called from keyboard_task() */
+void event_trace_task(void);
+void event_trace_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
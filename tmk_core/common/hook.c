@@ -17,32 +17,74 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "keyboard.h"
 #include "hook.h"
+#ifdef LED_EFFECT_ENABLE
+#include "led_effect.h"
+#endif
+#ifdef STENO_ENABLE
+#include "steno.h"
+#endif
 
 /* -------------------------------------------------
  * Definitions of default hooks
  * ------------------------------------------------- */
 
+/* Hooks compiled out are never called, strong empty definitions make one of
+ * board fail to link without its HOOK_* define. Name in parentheses is not
+ * expanded as the macro. */
+#ifdef HOOK_KEYBOARD_LOOP
 __attribute__((weak))
-void hook_keyboard_loop(void) {}
+void hook_keyboard_loop(void) {
+#ifdef LED_EFFECT_ENABLE
+    led_effect_task();
+#endif
+}
+#else
+void (hook_keyboard_loop)(void) {}
+#endif
 
+#ifdef HOOK_MATRIX_CHANGE
 __attribute__((weak))
 void hook_matrix_change(keyevent_t event) {
     (void)event;
+#ifdef LED_EFFECT_ENABLE
+    led_effect_key(event);
+#endif
+#ifdef STENO_ENABLE
+    steno_key(event);
+#endif
 }
+#else
+void (hook_matrix_change)(keyevent_t event) { (void)event; }
+#endif
 
+#ifdef HOOK_DEFAULT_LAYER_CHANGE
 __attribute__((weak))
 void hook_default_layer_change(uint32_t default_layer_state) {
     (void)default_layer_state;
 }
+#else
+void (hook_default_layer_change)(uint32_t default_layer_state) { (void)default_layer_state; }
+#endif
 
+#ifdef HOOK_LAYER_CHANGE
 __attribute__((weak))
 void hook_layer_change(uint32_t layer_state) {
+#ifdef LED_EFFECT_ENABLE
+    led_effect_layer(layer_state);
+#else
     (void)layer_state;
+#endif
 }
+#else
+void (hook_layer_change)(uint32_t layer_state) { (void)layer_state; }
+#endif
 
 __attribute__((weak))
 void hook_keyboard_leds_change(uint8_t led_status) {
     keyboard_set_leds(led_status);
+#ifdef LED_EFFECT_ENABLE
+    led_effect_leds(led_status);
+#endif
 }
 
 __attribute__((weak))
@@ -52,21 +52,59 @@ void hook_usb_wakeup(void);
  * Keyboard hooks
  * ------------------------------------- */
 
+/* Hooks below are called on every loop or event, calls are compiled out
+ * unless a feature or the board uses them. Board which defines one of them
+ * tells so in config.h:
+ *     #define HOOK_KEYBOARD_LOOP
+ *     #define HOOK_MATRIX_CHANGE
+ *     #define HOOK_DEFAULT_LAYER_CHANGE
+ *     #define HOOK_LAYER_CHANGE
+ * Without the define the definition fails to build or link(multiple
+ * definition) instead of not being called. */
+#ifdef STENO_ENABLE
+#   ifndef HOOK_MATRIX_CHANGE
+#       define HOOK_MATRIX_CHANGE
+#   endif
+#endif
+#ifdef LED_EFFECT_ENABLE
+#   ifndef HOOK_KEYBOARD_LOOP
+#       define HOOK_KEYBOARD_LOOP
+#   endif
+#   ifndef HOOK_MATRIX_CHANGE
+#       define HOOK_MATRIX_CHANGE
+#   endif
+#   ifndef HOOK_LAYER_CHANGE
+#       define HOOK_LAYER_CHANGE
+#   endif
+#endif
+
 /* Called periodically from the keyboard loop (very often!) */
 /* Default behaviour: do nothing. */
 void hook_keyboard_loop(void);
+#ifndef HOOK_KEYBOARD_LOOP
+#   define hook_keyboard_loop()                 do { } while (0)
+#endif
 
 /* Called on matrix state change event (every keypress => often!) */
 /* Default behaviour: do nothing. */
 void hook_matrix_change(keyevent_t event);
+#ifndef HOOK_MATRIX_CHANGE
+#   define hook_matrix_change(event)            do { (void)(event); } while (0)
+#endif
 
 /* Called on default layer state change event. */
 /* Default behaviour: do nothing. */
 void hook_default_layer_change(uint32_t default_layer_state);
+#ifndef HOOK_DEFAULT_LAYER_CHANGE
+#   define hook_default_layer_change(state)     do { (void)(state); } while (0)
+#endif
 
 /* Called on layer state change event. */
 /* Default behaviour: do nothing. */
 void hook_layer_change(uint32_t layer_state);
+#ifndef HOOK_LAYER_CHANGE
+#   define hook_layer_change(state)             do { (void)(state); } while (0)
+#endif
 
 /* Called on indicator LED update event (when reported from host). */
 /* Default behaviour: calls keyboard_set_leds. */
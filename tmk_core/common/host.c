@@ -16,11 +16,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
+#include <string.h>
 //#include <avr/interrupt.h>
 #include "keycode.h"
 #include "host.h"
 #include "util.h"
 #include "debug.h"
+#include "latency.h"
+#include "ramfunc.h"
+#include "spsc_queue.h"
+#include "telemetry.h"
+#include "watchdog.h"
+#include "typing_stat.h"
+#ifdef MOUSE_REPORT_MERGE
+#   include "timer.h"
+#endif
 
 
 #ifdef NKRO_ENABLE
@@ -28,13 +38,200 @@ bool keyboard_nkro = true;
 #endif
 
 static host_driver_t *driver;
+static bool driver_ready = true;
+static volatile bool leds_changed = true;
 static uint16_t last_system_report = 0;
-static uint16_t last_consumer_report = 0;
+static report_consumer_t consumer_report = {};
+static report_keyboard_t last_keyboard_report = {};
+static uint8_t last_mouse_buttons = 0;
+
+/*
+ * System and consumer reports in order
+ *
+ * Driver which can't take a report at times tells with extra_ready(), then
+ * reports wait in queue and go out from host_extra_task() in order, so that
+ * both press and release of a quick tap reach host. When queue is full the
+ * changes in between are lost and latest state goes out after it drains.
+ */
+#ifndef HOST_EXTRA_QUEUE_SIZE
+#define HOST_EXTRA_QUEUE_SIZE   8
+#endif
+#define EXTRA_SYSTEM            1
+#define EXTRA_CONSUMER          2       // only this usage, none with 0
+#define EXTRA_CONSUMER_ADD      3
+#define EXTRA_CONSUMER_DEL      4
+#define EXTRA(op, usage)        ((uint32_t)(op) << 16 | (usage))
+
+/* report: op<<16 | usage, not 0 */
+SPSC_QUEUE(extra_queue, uint32_t, HOST_EXTRA_QUEUE_SIZE)
+static uint16_t sent_system_report = 0;
+static report_consumer_t sent_consumer_report = {};
+
+static bool extra_ready(void)
+{
+    return !driver->extra_ready || (*driver->extra_ready)();
+}
+
+/*
+ * Consumer usages held(CONSUMER_USAGES)
+ *
+ * Usages are packed in order of press, latest is last. When all are in use
+ * oldest one is pushed out, with one usage a press replaces the one held and
+ * release of other usage leaves it. Returns false when nothing changed.
+ */
+static uint16_t consumer_latest(report_consumer_t *r)
+{
+    for (uint8_t i = CONSUMER_USAGES; i--; ) {
+        if (r->usage[i]) return r->usage[i];
+    }
+    return 0;
+}
+
+static bool consumer_apply(report_consumer_t *r, uint32_t op)
+{
+    uint16_t usage = op & 0xFFFF;
+    uint8_t i;
+
+    if (op >> 16 == EXTRA_CONSUMER) {
+        if (r->usage[0] == usage && consumer_latest(r) == usage) return false;
+        memset(r, 0, sizeof(*r));
+        r->usage[0] = usage;
+        return true;
+    }
+
+    for (i = 0; i < CONSUMER_USAGES && r->usage[i] && r->usage[i] != usage; i++) ;
+    bool found = (i < CONSUMER_USAGES && r->usage[i] == usage);
+    if (op >> 16 == EXTRA_CONSUMER_DEL) {
+        if (!found) return false;
+    } else {
+        if (found) return false;
+        if (i < CONSUMER_USAGES) {
+            r->usage[i] = usage;
+            return true;
+        }
+        i = 0;
+    }
+    // close the gap at i, new usage goes to the end when adding
+    for (; i < CONSUMER_USAGES - 1; i++) r->usage[i] = r->usage[i + 1];
+    r->usage[CONSUMER_USAGES - 1] = (op >> 16 == EXTRA_CONSUMER_ADD) ? usage : 0;
+    return true;
+}
+
+/* driver without array of usages gets latest one */
+static void consumer_send(report_consumer_t *r)
+{
+    if (driver->send_consumer_report) {
+        (*driver->send_consumer_report)(r);
+    } else {
+        (*driver->send_consumer)(consumer_latest(r));
+    }
+}
+
+static void extra_send(uint32_t report)
+{
+    uint16_t usage = report & 0xFFFF;
+    if (report >> 16 == EXTRA_SYSTEM) {
+        sent_system_report = usage;
+        (*driver->send_system)(usage);
+    } else {
+        consumer_apply(&sent_consumer_report, report);
+        consumer_send(&sent_consumer_report);
+    }
+}
+
+static void extra_put(uint32_t report)
+{
+    if (!extra_queue_has_data() && extra_ready()) {
+        extra_send(report);
+    } else if (!extra_queue_enqueue(report)) {
+        dprint("host: extra queue full\n");
+    }
+}
+
+void host_extra_task(void)
+{
+    if (!driver || !driver_ready) return;
+    while (extra_queue_has_data()) {
+        if (!extra_ready()) return;
+        extra_send(extra_queue_dequeue());
+    }
+    if (sent_system_report != last_system_report && extra_ready()) {
+        extra_send(EXTRA(EXTRA_SYSTEM, last_system_report));
+    }
+    if (memcmp(&sent_consumer_report, &consumer_report, sizeof(consumer_report)) && extra_ready()) {
+        sent_consumer_report = consumer_report;
+        consumer_send(&sent_consumer_report);
+    }
+}
 
 
 void host_set_driver(host_driver_t *d)
 {
     driver = d;
+    driver_ready = true;
+    leds_changed = true;
+    extra_queue_clear();
+    sent_system_report = 0;
+    memset(&sent_consumer_report, 0, sizeof(sent_consumer_report));
+}
+
+/*
+ * Driver switch with handoff
+ *
+ * Host left behind gets all keys and buttons released so that nothing gets
+ * stuck there. Reports are held while new driver is not ready, only latest
+ * state of each report is kept, and it is replayed on host_driver_ready().
+ */
+void host_switch_driver(host_driver_t *d)
+{
+    if (d == driver) return;
+    if (driver && driver_ready) {
+        report_keyboard_t keyboard = {};
+        report_mouse_t mouse = {};
+        (*driver->send_keyboard)(&keyboard);
+        if (last_mouse_buttons) (*driver->send_mouse)(&mouse);
+        if (sent_system_report) (*driver->send_system)(0);
+        if (sent_consumer_report.usage[0]) {
+            memset(&sent_consumer_report, 0, sizeof(sent_consumer_report));
+            consumer_send(&sent_consumer_report);
+        }
+    }
+    driver = d;
+    driver_ready = false;
+    leds_changed = true;
+    extra_queue_clear();
+    sent_system_report = 0;
+    memset(&sent_consumer_report, 0, sizeof(sent_consumer_report));
+}
+
+void host_driver_ready(void)
+{
+    if (!driver || driver_ready) return;
+    driver_ready = true;
+    dprint("host: replay reports\n");
+    (*driver->send_keyboard)(&last_keyboard_report);
+    if (last_mouse_buttons) {
+        report_mouse_t mouse = { .buttons = last_mouse_buttons };
+        (*driver->send_mouse)(&mouse);
+    }
+    if (last_system_report) extra_put(EXTRA(EXTRA_SYSTEM, last_system_report));
+    for (uint8_t i = 0; i < CONSUMER_USAGES && consumer_report.usage[i]; i++) {
+        extra_put(EXTRA(EXTRA_CONSUMER_ADD, consumer_report.usage[i]));
+    }
+}
+
+bool host_driver_pending(void)
+{
+    return driver && !driver_ready;
+}
+
+void host_driver_reset(void)
+{
+    driver_ready = false;
+    // host has no state of reports, latest is replayed on ready
+    extra_queue_clear();
+    sent_system_report = 0;
+    memset(&sent_consumer_report, 0, sizeof(sent_consumer_report));
 }
 
 host_driver_t *host_get_driver(void)
@@ -47,11 +244,38 @@ uint8_t host_keyboard_leds(void)
     if (!driver) return 0;
     return (*driver->keyboard_leds)();
 }
+
+void host_keyboard_leds_changed(void)
+{
+    leds_changed = true;
+}
+
+/* flag is cleared before driver is read so that change in between is not lost */
+bool host_keyboard_leds_pending(void)
+{
+    if (!leds_changed) return false;
+    leds_changed = false;
+    return true;
+}
 /* send report */
+RAMFUNC
 void host_keyboard_send(report_keyboard_t *report)
 {
-    if (!driver) return;
+    last_keyboard_report = *report;
+    if (!driver || !driver_ready) return;
+#ifdef WATCHDOG_ENABLE
+    // driver waits for endpoint, stage of caller is back after it
+    uint8_t stage = watchdog_stage;
+    WATCHDOG_STAGE(WATCHDOG_REPORT);
+#endif
+    LATENCY_BEGIN();
     (*driver->send_keyboard)(report);
+    LATENCY_END(LATENCY_SEND);
+#ifdef WATCHDOG_ENABLE
+    WATCHDOG_STAGE(stage);
+#endif
+    TELEMETRY_COUNT(TELEMETRY_REPORT);
+    typing_stat_report();
 
     if (debug_keyboard) {
         dprint("keyboard: ");
@@ -62,38 +286,137 @@ void host_keyboard_send(report_keyboard_t *report)
     }
 }
 
-void host_mouse_send(report_mouse_t *report)
+#ifdef MOUSE_REPORT_MERGE
+/*
+ * Mouse motion summed from all sources, sent by host_mouse_task() at most
+ * once a millisecond(USB frame). Motion over 127 is split into reports of
+ * following frames instead of being clipped.
+ */
+static uint8_t mouse_buttons = 0;
+static int16_t mouse_x, mouse_y, mouse_v, mouse_h;
+static bool mouse_pending = false;
+static uint16_t mouse_time;
+
+static int16_t mouse_add(int16_t acc, int16_t d)
+{
+    int32_t sum = (int32_t)acc + d;
+    if (sum > INT16_MAX) return INT16_MAX;
+    if (sum < -INT16_MAX) return -INT16_MAX;
+    return sum;
+}
+
+/* take a report worth of motion out of accumulator */
+static int8_t mouse_take(int16_t *acc)
+{
+    int16_t d = *acc;
+    if (d > 127) d = 127;
+    if (d < -127) d = -127;
+    *acc -= d;
+    return d;
+}
+
+static void mouse_flush(void)
+{
+    if (!driver_ready) {
+        // motion while switching driver is dropped, buttons are replayed
+        mouse_x = mouse_y = mouse_v = mouse_h = 0;
+        mouse_pending = false;
+        return;
+    }
+    report_mouse_t report = {
+        .buttons = mouse_buttons,
+        .x = mouse_take(&mouse_x),
+        .y = mouse_take(&mouse_y),
+        .v = mouse_take(&mouse_v),
+        .h = mouse_take(&mouse_h),
+    };
+    mouse_pending = (mouse_x || mouse_y || mouse_v || mouse_h);
+    mouse_time = timer_read();
+    (*driver->send_mouse)(&report);
+}
+
+void host_mouse_move(uint8_t buttons, int16_t x, int16_t y, int16_t v, int16_t h)
 {
     if (!driver) return;
+    mouse_x = mouse_add(mouse_x, x);
+    mouse_y = mouse_add(mouse_y, y);
+    mouse_v = mouse_add(mouse_v, v);
+    mouse_h = mouse_add(mouse_h, h);
+    if (buttons != mouse_buttons) {
+        // button goes out at once with motion so far
+        mouse_buttons = last_mouse_buttons = buttons;
+        mouse_flush();
+        return;
+    }
+    if (x || y || v || h) mouse_pending = true;
+}
+
+void host_mouse_task(void)
+{
+    if (mouse_pending && driver && timer_read() != mouse_time) {
+        mouse_flush();
+    }
+}
+
+void host_mouse_send(report_mouse_t *report)
+{
+    host_mouse_move(report->buttons, report->x, report->y, report->v, report->h);
+}
+#else
+void host_mouse_send(report_mouse_t *report)
+{
+    last_mouse_buttons = report->buttons;
+    if (!driver || !driver_ready) return;
     (*driver->send_mouse)(report);
 }
+#endif
 
 void host_system_send(uint16_t report)
 {
     if (report == last_system_report) return;
     last_system_report = report;
 
-    if (!driver) return;
-    (*driver->send_system)(report);
+    if (!driver || !driver_ready) return;
+    extra_put(EXTRA(EXTRA_SYSTEM, report));
 
     if (debug_keyboard) {
         dprintf("system: %04X\n", report);
     }
 }
 
-void host_consumer_send(uint16_t report)
+static void consumer_put(uint32_t op)
 {
-    if (report == last_consumer_report) return;
-    last_consumer_report = report;
+    if (!consumer_apply(&consumer_report, op)) return;
 
-    if (!driver) return;
-    (*driver->send_consumer)(report);
+    if (!driver || !driver_ready) return;
+    extra_put(op);
 
     if (debug_keyboard) {
-        dprintf("consumer: %04X\n", report);
+        dprintf("consumer: %u %04X\n", (uint8_t)(op >> 16), (uint16_t)op);
     }
 }
 
+void host_consumer_send(uint16_t report)
+{
+    consumer_put(EXTRA(EXTRA_CONSUMER, report));
+}
+
+void host_consumer_add(uint16_t usage)
+{
+    if (usage) consumer_put(EXTRA(EXTRA_CONSUMER_ADD, usage));
+}
+
+void host_consumer_del(uint16_t usage)
+{
+    if (usage) consumer_put(EXTRA(EXTRA_CONSUMER_DEL, usage));
+}
+
+void host_steno_send(const uint8_t *data, uint8_t len)
+{
+    if (!driver || !driver->send_steno) return;
+    (*driver->send_steno)(data, len);
+}
+
 uint16_t host_last_system_report(void)
 {
     return last_system_report;
@@ -101,5 +424,5 @@ uint16_t host_last_system_report(void)
 
 uint16_t host_last_consumer_report(void)
 {
-    return last_consumer_report;
+    return consumer_latest(&consumer_report);
 }
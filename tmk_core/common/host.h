@@ -39,17 +39,49 @@ extern uint8_t keyboard_protocol;
 /* host driver */
 void host_set_driver(host_driver_t *driver);
 host_driver_t *host_get_driver(void);
+/* switch driver keeping state of reports, new driver gets them replayed on
+ * host_driver_ready() and nothing until then */
+void host_switch_driver(host_driver_t *driver);
+void host_driver_ready(void);
+bool host_driver_pending(void);
+/* host lost state of reports(bus reset, re-enumeration), reports are held
+ * and latest state is replayed on host_driver_ready() */
+void host_driver_reset(void);
 
 /* host driver interface */
 uint8_t host_keyboard_leds(void);
+/* LED state of host changed, driver calls this where it gets LED report(ISR
+ * safe) and keyboard_task() reads host_keyboard_leds() only after that */
+void host_keyboard_leds_changed(void);
+bool host_keyboard_leds_pending(void);
 void host_keyboard_send(report_keyboard_t *report);
 void host_mouse_send(report_mouse_t *report);
 void host_system_send(uint16_t data);
+/* consumer report of only this usage, 0 releases all */
 void host_consumer_send(uint16_t data);
+/* press and release of a usage, others held stay in report(CONSUMER_USAGES) */
+void host_consumer_add(uint16_t usage);
+void host_consumer_del(uint16_t usage);
+/* packet of steno chord(STENO_ENABLE), dropped when driver has no send_steno */
+void host_steno_send(const uint8_t *data, uint8_t len);
+
+/* sends system and consumer reports queued while driver was busy, call every
+ * keyboard loop */
+void host_extra_task(void);
 
 uint16_t host_last_system_report(void);
 uint16_t host_last_consumer_report(void);
 
+/* MOUSE_REPORT_MERGE: host_mouse_send() only adds motion of report and
+ * host_mouse_task() sends the sum once a frame, button change is sent at
+ * once. host_mouse_move() takes motion larger than a report. */
+#ifdef MOUSE_REPORT_MERGE
+void host_mouse_move(uint8_t buttons, int16_t x, int16_t y, int16_t v, int16_t h);
+void host_mouse_task(void);
+#else
+#define host_mouse_task()
+#endif
+
 #ifdef __cplusplus
 }
 #endif
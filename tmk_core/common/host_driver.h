@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define HOST_DRIVER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "report.h"
 
 
@@ -28,6 +29,14 @@ typedef struct {
     void (*send_mouse)(report_mouse_t *);
     void (*send_system)(uint16_t);
     void (*send_consumer)(uint16_t);
+    /* optional, false while system/consumer report can't be taken now, host
+     * queues those meanwhile and sends them in order from host_extra_task() */
+    bool (*extra_ready)(void);
+    /* optional, consumer report with all usages held(CONSUMER_USAGES > 1),
+     * without it send_consumer gets latest usage */
+    void (*send_consumer_report)(report_consumer_t *);
+    /* optional, steno chord packet to virtual serial port(STENO_ENABLE) */
+    void (*send_steno)(const uint8_t *, uint8_t);
 } host_driver_t;
 
 #endif
@@ -0,0 +1,190 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "sendchar.h"
+#include "matrix.h"
+#include "action.h"
+#include "input_trace.h"
+
+
+#if (INPUT_TRACE_SIZE < 2 || INPUT_TRACE_SIZE > 128 || (INPUT_TRACE_SIZE & (INPUT_TRACE_SIZE - 1)))
+#   error "INPUT_TRACE_SIZE must be power of two up to 128"
+#endif
+#define MASK    (INPUT_TRACE_SIZE - 1)
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  row;
+    uint16_t time;
+    matrix_row_t data;
+} input_trace_t;
+
+static input_trace_t ring[INPUT_TRACE_SIZE];
+static uint8_t head = 0;    // oldest
+static uint8_t count = 0;
+
+/* rows of ring start and rows of last scan */
+static matrix_row_t base[MATRIX_ROWS];
+static matrix_row_t last[MATRIX_ROWS];
+
+static enum { RECORD, DUMP, REPLAY } mode = RECORD;
+static uint8_t cursor = 0;      // DUMP: rows of base then ring, REPLAY: ring
+static bool started = false;    // REPLAY: base is played
+static uint16_t start_time = 0; // REPLAY: timer_read() at start
+static matrix_row_t replay_rows[MATRIX_ROWS];
+
+
+static void put(uint8_t type, uint8_t row, uint16_t time, matrix_row_t data)
+{
+    if (count == INPUT_TRACE_SIZE) {
+        // oldest goes into base
+        input_trace_t *t = &ring[head];
+        if (t->type == INPUT_TRACE_ROW) base[t->row] = t->data;
+        head = (head + 1) & MASK;
+        count--;
+    }
+    ring[(head + count) & MASK] = (input_trace_t){
+        .type = type, .row = row, .time = time, .data = data
+    };
+    count++;
+}
+
+void input_trace_rows(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        matrix_row_t row = MATRIX_READ_ROW(r);
+        if (row == last[r]) continue;
+        last[r] = row;
+        if (mode == RECORD) put(INPUT_TRACE_ROW, r, timer_read(), row);
+    }
+}
+
+void input_trace_byte(uint8_t data, uint16_t time)
+{
+    if (mode == RECORD) put(INPUT_TRACE_BYTE, 0, time, data);
+}
+
+
+static void send_hex8(uint8_t v)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    sendchar(hex[v >> 4]);
+    sendchar(hex[v & 0x0F]);
+}
+
+static void send_record(uint8_t type, uint8_t row, uint16_t time, uint32_t data)
+{
+    sendchar('@');
+    send_hex8(type);
+    send_hex8(row);
+    send_hex8(time >> 8);
+    send_hex8(time);
+    send_hex8(data >> 24);
+    send_hex8(data >> 16);
+    send_hex8(data >> 8);
+    send_hex8(data);
+    sendchar('\n');
+}
+
+static void replay_row(uint8_t row, matrix_row_t bits)
+{
+    matrix_row_t change = bits ^ replay_rows[row];
+    for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+        matrix_row_t mask = (matrix_row_t)1 << c;
+        if (!(change & mask)) continue;
+        action_exec((keyevent_t){
+            .key = (keypos_t){ .row = row, .col = c },
+            .pressed = (bits & mask),
+            .time = (timer_read() | 1) /* time should not be 0 */
+        });
+    }
+    replay_rows[row] = bits;
+}
+
+void input_trace_task(void)
+{
+    if (mode == DUMP) {
+        // base at time of oldest record, then ring
+        uint16_t time = count ? ring[head].time : timer_read();
+        while (cursor < MATRIX_ROWS) {
+            uint8_t r = cursor++;
+            if (base[r]) {
+                send_record(INPUT_TRACE_ROW, r, time, base[r]);
+                return;
+            }
+        }
+        if (cursor - MATRIX_ROWS < count) {
+            input_trace_t *t = &ring[(head + cursor - MATRIX_ROWS) & MASK];
+            send_record(t->type, t->row, t->time, t->data);
+            cursor++;
+            return;
+        }
+        mode = RECORD;
+        return;
+    }
+
+    if (mode == REPLAY) {
+        if (!started) {
+            started = true;
+            start_time = timer_read();
+            for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+                replay_rows[r] = 0;
+                replay_row(r, base[r]);
+            }
+        }
+        uint16_t elapsed = timer_elapsed(start_time);
+        while (cursor < count) {
+            input_trace_t *t = &ring[(head + cursor) & MASK];
+            if (t->type == INPUT_TRACE_ROW) {
+                if (TIMER_DIFF_16(t->time, ring[head].time) > elapsed) return;
+                replay_row(t->row, t->data);
+            }
+            cursor++;
+        }
+        for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+            replay_row(r, 0);
+        }
+        mode = RECORD;
+    }
+}
+
+void input_trace_dump(void)
+{
+    if (mode != RECORD) return;
+    mode = DUMP;
+    cursor = 0;
+}
+
+void input_trace_replay(void)
+{
+    if (mode != RECORD) return;
+    // played from keyboard_task(), not inside action of the command
+    mode = REPLAY;
+    cursor = 0;
+    started = false;
+}
+
+void input_trace_clear(void)
+{
+    head = 0;
+    count = 0;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        base[r] = last[r];
+    }
+}
@@ -0,0 +1,89 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef INPUT_TRACE_H
+#define INPUT_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+
+/* Capture and replay of raw input
+ *
+ * Rows of matrix_get_row() after each scan and bytes which converters take
+ * from their receive queue(SPSC_STAMPED_QUEUE) are recorded with time into a
+ * ring in RAM. Oldest record is overwritten so that the ring holds input
+ * just before a bug shows up, rows overwritten are kept in a base state.
+ *
+ * Magic+I dumps base and ring to console, a record per keyboard_task(), as
+ * lines of '@' and 16 hex digits:
+ *
+ *   @TTRRttttDDDDDDDD
+ *   TT: type    RR: row    tttt: timer_read() at record
+ *   DDDDDDDD: row bits or byte
+ *
+ * tool/input_trace converts the dump to a trace of tool/native, which plays
+ * it through matrix_scan() and keyboard_task() on build machine.
+ *
+ * Magic+R plays rows of base and ring again through action_exec() with the
+ * recorded intervals and releases keys left at end. Bytes are not played on
+ * device as their meaning depends on converter. Magic keys of the dump or
+ * replay itself are in the ring and played too, dump and replay requests are
+ * ignored while either runs. Recording is paused meanwhile.
+ */
+enum input_trace_type {
+    INPUT_TRACE_ROW = 1,    /* row: row, data: row bits */
+    INPUT_TRACE_BYTE,       /* data: byte of receive queue */
+};
+
+/* records in ring, power of two up to 128 */
+#ifndef INPUT_TRACE_SIZE
+#define INPUT_TRACE_SIZE    32
+#endif
+
+
+#ifdef INPUT_TRACE_ENABLE
+
+#define INPUT_TRACE_ROWS()              input_trace_rows()
+#define INPUT_TRACE_BYTE(data, time)    input_trace_byte((data), (time))
+
+#else
+
+#define INPUT_TRACE_ROWS()              ((void)0)
+#define INPUT_TRACE_BYTE(data, time)    ((void)0)
+
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* record rows changed since last call, called after matrix_scan() */
+void input_trace_rows(void);
+void input_trace_byte(uint8_t data, uint16_t time);
+/* dump or replay in progress, called from keyboard_task() */
+void input_trace_task(void);
+void input_trace_dump(void);
+void input_trace_replay(void);
+void input_trace_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -31,6 +31,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "eeconfig.h"
 #include "backlight.h"
 #include "hook.h"
+#include "latency.h"
+#include "action_macro.h"
+#include "action_combo.h"
+#include "action_leader.h"
+#include "action_tapping.h"
+#include "action_util.h"
+#include "deadline.h"
+#include "type_inject.h"
+#include "event_trace.h"
+#include "input_trace.h"
+#include "telemetry.h"
+#include "bench_gpio.h"
+#include "spsc_queue.h"
+#include "ramfunc.h"
+#include "profile.h"
+#include "stress.h"
+#include "watchdog.h"
+#include "poll_sync.h"
+#include "typing_stat.h"
+#ifdef DYNAMIC_KEYMAP_ENABLE
+#   include "dynamic_keymap.h"
+#endif
+#if defined(IDLE_SLEEP_ENABLE) || defined(MATRIX_SCAN_ADAPTIVE)
+#   include "debounce.h"
+#   include "suspend.h"
+#endif
 #ifdef MOUSEKEY_ENABLE
 #   include "mousekey.h"
 #endif
@@ -45,23 +71,320 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
+/* column of lowest changed bit, for width of matrix_row_t */
+#if (MATRIX_COLS <= 8)
+#   define row_ctz(bits)    bitctz(bits)
+#elif (MATRIX_COLS <= 16)
+#   define row_ctz(bits)    bitctz16(bits)
+#else
+#   define row_ctz(bits)    bitctz32(bits)
+#endif
+
+
 #ifdef MATRIX_HAS_GHOST
-static bool has_ghost_in_row(uint8_t row)
+/* Ghost occurs when the row shares column line with other row. Columns closed
+ * on two rows or more are taken in one pass once per scan, the check of each
+ * row is then an AND instead of reading all the other rows.
+ */
+static matrix_row_t shared_cols(void)
+{
+    matrix_row_t any = 0, shared = 0;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        matrix_row_t matrix_row = matrix_get_row(i);
+        shared |= any & matrix_row;
+        any |= matrix_row;
+    }
+    return shared;
+}
+
+/* Keys of the row which can be ghosts: corners of a rectangle closed on all
+ * four corners with another row, any of the four can be ghost of the other
+ * three. Only keys on shared columns can be corners and two of them are
+ * needed on the row, then the other rows are read. Other keys of the row are
+ * real and their changes go on.
+ */
+static matrix_row_t ghost_keys_in_row(uint8_t row, matrix_row_t matrix_row, matrix_row_t shared)
+{
+    matrix_row_t corners = matrix_row & shared;
+    if (!((corners - 1) & corners)) return 0;
+
+    matrix_row_t ghost = 0;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        if (i == row) continue;
+        matrix_row_t common = corners & matrix_get_row(i);
+        if ((common - 1) & common) ghost |= common;
+    }
+    return ghost;
+}
+#endif
+
+#if !defined(MATRIX_HAS_EVENTS) && !defined(MATRIX_SCAN_ISR)
+/*
+ * Keys which woke host up
+ *
+ * Host resumes tens of milliseconds after remote wakeup and matrix is cleared
+ * on wakeup, a key tapped meanwhile never shows up in scan. Rows at wakeup are
+ * kept and keyboard_task() presses those keys once driver takes reports again,
+ * release comes from diff with matrix as usual. Keys kept longer than
+ * WAKEUP_KEYS_TIMEOUT(ms) are dropped, host didn't resume for them.
+ */
+#ifndef WAKEUP_KEYS_TIMEOUT
+#define WAKEUP_KEYS_TIMEOUT     2000
+#endif
+static matrix_row_t wakeup_rows[MATRIX_ROWS];
+static uint16_t wakeup_time;
+static bool wakeup_keys = false;
+
+void keyboard_wakeup_keys(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        wakeup_rows[r] = matrix_get_row(r);
+    }
+    wakeup_time = timer_read();
+    wakeup_keys = true;
+}
+
+static void wakeup_keys_press(matrix_row_t *matrix_prev)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        matrix_row_t press = wakeup_rows[r] & ~matrix_prev[r];
+        for (; press; press &= press - 1) {
+            keyevent_t e = (keyevent_t){
+                .key = (keypos_t){ .row = r, .col = row_ctz(press) },
+                .pressed = true,
+                .time = (timer_read() | 1)
+            };
+            action_exec(e);
+            hook_matrix_change(e);
+            matrix_prev[r] |= press & -press;
+        }
+    }
+}
+#else
+void keyboard_wakeup_keys(void) {}
+#endif
+
+#ifdef MATRIX_SCAN_ISR
+/*
+ * Scan from timer interrupt
+ *
+ * matrix_scan() runs every MATRIX_SCAN_ISR_INTERVAL(ms) from interrupt of
+ * timer tick and changes of rows go into event queue with time of the scan,
+ * keyboard_task() takes them and runs actions and USB in main loop. Scan
+ * period doesn't depend on how long reports or macros take. Interrupts are
+ * enabled during the scan, a tick which comes while scan is still running is
+ * skipped. Changes which don't fit in queue are left in matrix_prev and
+ * queued at next scan.
+ *
+ * Nothing else may scan while it is enabled, code which scans from main loop
+ * (suspend wakeup, microbench) turns it off with keyboard_scan_isr_enable().
+ * Each scan is published as matrix snapshot and main loop reads matrix from
+ * it, see MATRIX_SNAPSHOT in matrix.h.
+ */
+#   if defined(MATRIX_HAS_EVENTS) || defined(MATRIX_HAS_GHOST) || defined(MATRIX_SCAN_INTERVAL)
+#       error "MATRIX_SCAN_ISR does not support MATRIX_HAS_EVENTS, MATRIX_HAS_GHOST and MATRIX_SCAN_INTERVAL"
+#   endif
+#   ifndef __AVR__
+#       error "MATRIX_SCAN_ISR is for Timer0 of AVR"
+#   endif
+#   if MATRIX_ROWS > 128
+#       error "MATRIX_SCAN_ISR supports up to 128 rows"
+#   endif
+#ifndef MATRIX_SCAN_ISR_INTERVAL
+#define MATRIX_SCAN_ISR_INTERVAL    1
+#endif
+#ifndef MATRIX_SCAN_QUEUE_SIZE
+#define MATRIX_SCAN_QUEUE_SIZE      16
+#endif
+
+/* event: time<<16 | pressed<<15 | row<<8 | col, time is not 0 */
+SPSC_QUEUE(scan_events, uint32_t, MATRIX_SCAN_QUEUE_SIZE)
+static volatile bool scan_isr_on = false;
+
+void keyboard_scan_isr_enable(bool on)
 {
-    matrix_row_t matrix_row = matrix_get_row(row);
-    // No ghost exists when less than 2 keys are down on the row
-    if (((matrix_row - 1) & matrix_row) == 0)
-        return false;
+    scan_isr_on = on;
+}
+
+RAMFUNC
+void keyboard_scan_isr(void)
+{
+    static matrix_row_t matrix_prev[MATRIX_ROWS];
+    static matrix_rows_t rows_left = 0;     // not taken for full queue
+    static volatile bool busy = false;
+    static uint8_t ticks = 0;
+
+    if (!scan_isr_on || busy) return;
+    if (++ticks < MATRIX_SCAN_ISR_INTERVAL) return;
+    ticks = 0;
+    busy = true;
 
-    // Ghost occurs when the row shares column line with other row
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
-        if (i != row && (matrix_get_row(i) & matrix_row))
-            return true;
+    matrix_scan();
+    matrix_snapshot_publish();
+    TELEMETRY_COUNT(TELEMETRY_SCAN);
+    uint32_t time = (uint32_t)(timer_read() | 1) << 16;
+    matrix_rows_t rows = matrix_changed_rows() | rows_left;
+    rows_left = 0;
+    matrix_rows_t row_bit = 1;
+    for (uint8_t r = 0; rows && r < MATRIX_ROWS; r++, row_bit <<= 1) {
+        if (!row_bit) row_bit = 1;
+        if (!(rows & row_bit)) continue;
+        matrix_row_t matrix_row = matrix_get_row(r);
+        matrix_row_t matrix_change = matrix_row ^ matrix_prev[r];
+        if (!matrix_change) continue;
+        for (; matrix_change; matrix_change &= matrix_change - 1) {
+            uint8_t c = row_ctz(matrix_change);
+            matrix_row_t col_mask = matrix_change & -matrix_change;
+            uint32_t e = time | (uint16_t)r<<8 | c;
+            if (matrix_row & col_mask) e |= 0x8000;
+            if (!scan_events_enqueue(e)) {
+                TELEMETRY_COUNT(TELEMETRY_EVENT_LOST);
+                rows_left = MATRIX_ROWS_ALL;
+                goto SCAN_END;
+            }
+            matrix_prev[r] ^= col_mask;
+        }
     }
-    return false;
+SCAN_END:
+    TELEMETRY_PEAK_SET(TELEMETRY_EVENT_PEAK, scan_events_count());
+    busy = false;
 }
 #endif
 
+#ifdef MATRIX_SCAN_ADAPTIVE
+/*
+ * Adaptive scan rate
+ *
+ * Matrix is scanned every active interval(ms, 0 is every call) while a key is
+ * down or debouncing and for MATRIX_SCAN_IDLE_DELAY(ms) after that, then every
+ * idle interval with sleep until next interrupt between scans. Intervals are
+ * read from EECONFIG_SCAN_RATE at init, 0 there takes MATRIX_SCAN_ACTIVE and
+ * MATRIX_SCAN_IDLE of config.h, as does 0xFF of byte left erased by earlier
+ * firmware. First press after idle waits for idle
+ * interval at most, or none when pin change interrupt of matrix calls
+ * keyboard_scan_wakeup().
+ */
+#   if defined(MATRIX_SCAN_INTERVAL) || defined(MATRIX_SCAN_ISR)
+#       error "MATRIX_SCAN_ADAPTIVE does not support MATRIX_SCAN_INTERVAL and MATRIX_SCAN_ISR"
+#   endif
+#ifndef MATRIX_SCAN_ACTIVE
+#define MATRIX_SCAN_ACTIVE      0
+#endif
+#ifndef MATRIX_SCAN_IDLE
+#define MATRIX_SCAN_IDLE        10
+#endif
+#ifndef MATRIX_SCAN_IDLE_DELAY
+#define MATRIX_SCAN_IDLE_DELAY  1000
+#endif
+static uint8_t scan_active = MATRIX_SCAN_ACTIVE;
+static uint8_t scan_idle = MATRIX_SCAN_IDLE;
+static uint16_t scan_time = 0;
+static uint16_t active_time = 0;
+static bool idle = false;
+static volatile bool wakeup = false;
+
+void keyboard_scan_wakeup(void)
+{
+    wakeup = true;
+}
+
+static void scan_rate_init(void)
+{
+    uint8_t rate = eeconfig_is_enabled() ? eeconfig_read_scan_rate() : 0;
+    if (rate == 0xFF) rate = 0;
+    if (EECONFIG_SCAN_RATE_ACTIVE(rate) != 0) scan_active = EECONFIG_SCAN_RATE_ACTIVE(rate);
+    if (EECONFIG_SCAN_RATE_IDLE(rate) != 0)   scan_idle = EECONFIG_SCAN_RATE_IDLE(rate);
+    active_time = timer_read();
+}
+
+static bool scan_rate_due(void)
+{
+    if (wakeup) {
+        wakeup = false;
+        idle = false;
+        active_time = timer_read();
+    } else {
+        uint8_t interval = idle ? scan_idle : scan_active;
+        if (interval && timer_elapsed(scan_time) < interval) return false;
+    }
+    scan_time = timer_read();
+    return true;
+}
+
+/* after events of scan are done, active is key down or debouncing */
+static void scan_rate_update(bool active)
+{
+    if (active) {
+        idle = false;
+        active_time = timer_read();
+    } else if (!idle && timer_elapsed(active_time) >= MATRIX_SCAN_IDLE_DELAY) {
+        idle = true;
+    }
+}
+#endif
+
+#ifdef MATRIX_SCAN_INTERVAL
+/*
+ * Scan scheduler
+ *
+ * Matrix is scanned every MATRIX_SCAN_INTERVAL(ms) instead of every call and
+ * powered only for scan window, from MATRIX_POWER_WARMUP(ms) ahead of scan
+ * until scan is done. Warmup runs from keyboard loop while matrix_power_up()
+ * returns without waiting for it.
+ */
+#ifndef MATRIX_POWER_WARMUP
+#define MATRIX_POWER_WARMUP 0
+#endif
+#if MATRIX_POWER_WARMUP >= MATRIX_SCAN_INTERVAL
+#   error "MATRIX_POWER_WARMUP must be shorter than MATRIX_SCAN_INTERVAL"
+#endif
+static bool matrix_scan_due(void)
+{
+    static uint16_t scan_time = 0;
+    static bool powered = false;
+
+    uint16_t elapsed = timer_elapsed(scan_time);
+    if (!powered && elapsed >= MATRIX_SCAN_INTERVAL - MATRIX_POWER_WARMUP) {
+        matrix_power_up();
+        powered = true;
+    }
+    if (elapsed < MATRIX_SCAN_INTERVAL) return false;
+    scan_time = timer_read();
+    powered = false;
+    return true;
+}
+#endif
+
+#ifdef POLL_SYNC_ENABLE
+/* scan just before host polls, see poll_sync.h */
+#   if defined(MATRIX_SCAN_ISR) || defined(MATRIX_SCAN_ADAPTIVE) || defined(MATRIX_SCAN_INTERVAL)
+#       error "POLL_SYNC_ENABLE does not support MATRIX_SCAN_ISR, MATRIX_SCAN_ADAPTIVE and MATRIX_SCAN_INTERVAL"
+#   endif
+#endif
+
+#ifdef KEYBOARD_TASK_SLICE
+/*
+ * Sliced keyboard task
+ *
+ * A call of keyboard_task() reads and processes KEYBOARD_TASK_SLICE rows of
+ * matrix, or takes as many events of MATRIX_HAS_EVENTS and MATRIX_SCAN_ISR,
+ * and returns so that main loop polls USB between slices, e.g. usbPoll() of
+ * V-USB. Matrix is scanned when the last slice of previous pass is done and
+ * rows stay as scanned until then, a pass with no changed rows ends at once.
+ * Worst case of a call is a scan and events of one slice.
+ */
+#   if KEYBOARD_TASK_SLICE < 1 || KEYBOARD_TASK_SLICE > 255
+#       error "KEYBOARD_TASK_SLICE must be 1-255"
+#   endif
+static uint8_t slice_row = 0;           // first row of next slice, 0 starts pass
+static matrix_rows_t slice_rows;        // rows of pass to read
+#   define SCAN_DUE(due)   (slice_row == 0 && (due))
+#   define SLICE_FULL(n)   ((n) >= KEYBOARD_TASK_SLICE)
+#else
+#   define SCAN_DUE(due)   (due)
+#   define SLICE_FULL(n)   false
+#endif
+
 
 void keyboard_setup(void)
 {
@@ -72,6 +395,7 @@ void keyboard_init(void)
 {
     timer_init();
     matrix_init();
+    BENCH_GPIO_INIT();
 #ifdef PS2_MOUSE_ENABLE
     ps2_mouse_init();
 #endif
@@ -87,72 +411,329 @@ void keyboard_init(void)
     bootmagic();
 #endif
 
+#ifdef DYNAMIC_KEYMAP_ENABLE
+    dynamic_keymap_init();
+#endif
+
+#ifdef COMBO_ENABLE
+    action_combo_init();
+#endif
+
+#if !defined(NO_ACTION_TAPPING) && defined(TAPPING_TERM_ADAPTIVE)
+    action_tapping_init();
+#endif
+
 #ifdef BACKLIGHT_ENABLE
     backlight_init();
 #endif
+
+#ifdef MATRIX_SCAN_ISR
+    keyboard_scan_isr_enable(true);
+#endif
+#ifdef MATRIX_SCAN_ADAPTIVE
+    scan_rate_init();
+#endif
+#ifdef PROFILE_ENABLE
+    profile_init();
+#endif
+    watchdog_init();
 }
 
 /*
  * Do keyboard routine jobs: scan matrix, light LEDs, ...
  * This is repeatedly called as fast as possible.
  */
+RAMFUNC
 void keyboard_task(void)
 {
+#ifdef MATRIX_HAS_EVENTS
+#   ifdef MATRIX_HAS_GHOST
+#       error "MATRIX_HAS_EVENTS does not support MATRIX_HAS_GHOST"
+#   endif
+    keyevent_t e;
+    uint8_t n = 0;
+#elif defined(MATRIX_SCAN_ISR)
+    uint32_t e;
+    uint8_t n = 0;
+#else
     static matrix_row_t matrix_prev[MATRIX_ROWS];
-#ifdef MATRIX_HAS_GHOST
+    matrix_rows_t rows, row_bit = 1;
+    uint8_t r = 0, row_end = MATRIX_ROWS;
+#   ifdef MATRIX_HAS_GHOST
+    static matrix_rows_t ghost_rows = 0;    // held back until ghost goes
     static matrix_row_t matrix_ghost[MATRIX_ROWS];
-#endif
-    static uint8_t led_status = 0;
+    matrix_row_t ghost_cols = 0;
+    bool ghost_cols_taken = false;
+#   endif
     matrix_row_t matrix_row = 0;
     matrix_row_t matrix_change = 0;
+#endif
+    static uint8_t led_status = 0;
 
-    matrix_scan();
-    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+    TELEMETRY_COUNT(TELEMETRY_LOOP);
+    watchdog_kick();
+    WATCHDOG_STAGE(WATCHDOG_SCAN);
+    LATENCY_BEGIN();
+    LATENCY_BEGIN();
+#if defined(MATRIX_SCAN_ISR)
+    // scanned in timer interrupt, latency is from taking its events
+    typing_stat_scan();
+#elif defined(MATRIX_SCAN_ADAPTIVE)
+    if (SCAN_DUE(scan_rate_due())) {
+        typing_stat_scan();
+        matrix_scan();
+        TELEMETRY_COUNT(TELEMETRY_SCAN);
+    }
+#elif defined(MATRIX_SCAN_INTERVAL)
+    if (SCAN_DUE(matrix_scan_due())) {
+        typing_stat_scan();
+        matrix_scan();
+        matrix_power_down();
+        TELEMETRY_COUNT(TELEMETRY_SCAN);
+    }
+#elif defined(POLL_SYNC_ENABLE)
+    uint32_t scan_start = timer_read_us();
+    bool scanned = SCAN_DUE(poll_sync_due());
+    if (scanned) {
+        typing_stat_scan();
+        matrix_scan();
+        TELEMETRY_COUNT(TELEMETRY_SCAN);
+    }
+#else
+    if (SCAN_DUE(true)) {
+        typing_stat_scan();
+        matrix_scan();
+        TELEMETRY_COUNT(TELEMETRY_SCAN);
+    }
+#endif
+    LATENCY_END(LATENCY_SCAN);
+    INPUT_TRACE_ROWS();
+    WATCHDOG_STAGE(WATCHDOG_ACTION);
+
+    LATENCY_BEGIN();
+#ifdef KEYBOARD_REPORT_BATCH
+    // one report for events of this scan where order allows
+    keyboard_report_batch_begin();
+#endif
+#if defined(MATRIX_SCAN_ISR)
+    // in order and with time of scan they came from
+    while (!SLICE_FULL(n) && (e = scan_events_dequeue())) {
+        n++;
+        keyevent_t event = (keyevent_t){
+            .key = (keypos_t){ .row = (e >> 8) & 0x7F, .col = e & 0xFF },
+            .pressed = (e & 0x8000),
+            .time = (e >> 16)
+        };
+        if (debug_matrix) matrix_print();
+        LATENCY_BEGIN();
+        action_exec(event);
+        LATENCY_END(LATENCY_ACTION);
+        hook_matrix_change(event);
+    }
+#elif defined(MATRIX_HAS_EVENTS)
+    // in order and with time they came from matrix
+    while (!SLICE_FULL(n) && matrix_event_get(&e)) {
+        n++;
+        if (debug_matrix) matrix_print();
+        LATENCY_BEGIN();
+        action_exec(e);
+        LATENCY_END(LATENCY_ACTION);
+        hook_matrix_change(e);
+    }
+#else
+#ifdef KEYBOARD_TASK_SLICE
+    if (slice_row) {
+        // rest of pass, matrix is not scanned meanwhile
+        rows = slice_rows;
+        r = slice_row;
+        row_bit = MATRIX_ROW_BIT(r);
+    } else
+#endif
+    {
+        // rows which matrix doesn't know changed are not read
+        rows = matrix_changed_rows();
+        if (wakeup_keys && !host_driver_pending()) {
+            wakeup_keys = false;
+            if (timer_elapsed(wakeup_time) < WAKEUP_KEYS_TIMEOUT) {
+                wakeup_keys_press(matrix_prev);
+            }
+            // keys released already are on rows matrix doesn't report
+            rows = MATRIX_ROWS_ALL;
+        }
+#ifdef MATRIX_HAS_GHOST
+        rows |= ghost_rows;
+        ghost_rows = 0;
+#endif
+    }
+#ifdef KEYBOARD_TASK_SLICE
+    if (rows && MATRIX_ROWS - r > KEYBOARD_TASK_SLICE) {
+        row_end = r + KEYBOARD_TASK_SLICE;
+        slice_row = row_end;
+        slice_rows = rows;
+    } else {
+        slice_row = 0;
+    }
+#endif
+    for (; rows && r < row_end; r++, row_bit <<= 1) {
+        if (!row_bit) row_bit = 1;
+        if (!(rows & row_bit)) continue;
         matrix_row = matrix_get_row(r);
         matrix_change = matrix_row ^ matrix_prev[r];
         if (matrix_change) {
 #ifdef MATRIX_HAS_GHOST
-            if (has_ghost_in_row(r)) {
+            // only when a changed row has two keys or more
+            if (!ghost_cols_taken && ((matrix_row - 1) & matrix_row)) {
+                ghost_cols = shared_cols();
+                ghost_cols_taken = true;
+            }
+            // presses of keys which can be ghosts are held back, releases
+            // and other keys of the row go on
+            matrix_row_t ghost = ghost_keys_in_row(r, matrix_row, ghost_cols) & matrix_change;
+            if (ghost) {
                 /* Keep track of whether ghosted status has changed for
-                 * debugging. But don't update matrix_prev until un-ghosted, or
-                 * the last key would be lost.
+                 * debugging. But don't update matrix_prev of them until
+                 * un-ghosted, or the last key would be lost.
                  */
                 if (debug_matrix && matrix_ghost[r] != matrix_row) {
                     matrix_print();
                 }
                 matrix_ghost[r] = matrix_row;
-                continue;
+                ghost_rows |= row_bit;
+                matrix_change &= ~ghost;
+                if (!matrix_change) continue;
+            } else {
+                matrix_ghost[r] = matrix_row;
             }
-            matrix_ghost[r] = matrix_row;
 #endif
             if (debug_matrix) matrix_print();
-            matrix_row_t col_mask = 1;
-            for (uint8_t c = 0; c < MATRIX_COLS; c++, col_mask <<= 1) {
-                if (matrix_change & col_mask) {
-                    keyevent_t e = (keyevent_t){
-                        .key = (keypos_t){ .row = r, .col = c },
-                        .pressed = (matrix_row & col_mask),
-                        .time = (timer_read() | 1) /* time should not be 0 */
-                    };
-                    action_exec(e);
-                    hook_matrix_change(e);
-                    // record a processed key
-                    matrix_prev[r] ^= col_mask;
-
-                    // This can miss stroke when scan matrix takes long like Topre
-                    // process a key per task call
-                    //goto MATRIX_LOOP_END;
-                }
+            // changed bits only, lowest column first
+            for (; matrix_change; matrix_change &= matrix_change - 1) {
+                uint8_t c = row_ctz(matrix_change);
+                matrix_row_t col_mask = matrix_change & -matrix_change;
+                keyevent_t e = (keyevent_t){
+                    .key = (keypos_t){ .row = r, .col = c },
+                    .pressed = (matrix_row & col_mask),
+                    .time = (timer_read() | 1) /* time should not be 0 */
+                };
+                LATENCY_BEGIN();
+                action_exec(e);
+                LATENCY_END(LATENCY_ACTION);
+                hook_matrix_change(e);
+                // record a processed key
+                matrix_prev[r] ^= col_mask;
+
+                // This can miss stroke when scan matrix takes long like Topre
+                // process a key per task call
+                //goto MATRIX_LOOP_END;
             }
         }
     }
-    // call with pseudo tick event when no real key event.
-    action_exec(TICK);
+#endif
+#ifdef KEYBOARD_REPORT_BATCH
+    keyboard_report_batch_end();
+#endif
+    LATENCY_END(LATENCY_DIFF);
+#ifdef POLL_SYNC_ENABLE
+    // report of scan is ready, poll_sync_due() starts next one this much ahead
+    if (scanned) poll_sync_work(timer_elapsed_us(scan_start));
+#endif
+
+    // timed states whose time has come, nothing to do in most of scans
+    WATCHDOG_STAGE(WATCHDOG_TIMED);
+    uint8_t due = deadline_take();
+
+    // pseudo tick event to end tapping or combo term
+    if (due & (DEADLINE_BIT(DEADLINE_TAPPING) | DEADLINE_BIT(DEADLINE_COMBO))) {
+        LATENCY_BEGIN();
+        action_exec(TICK);
+        LATENCY_END(LATENCY_TICK);
+    }
+
+    // release oneshot mods on timeout
+    if (due & DEADLINE_BIT(DEADLINE_ONESHOT)) send_keyboard_report();
+
+    // resume macro waiting for its time
+    if (due & DEADLINE_BIT(DEADLINE_MACRO)) action_macro_task();
+
+#ifdef LEADER_ENABLE
+    // sequence of leader key waiting for more keys
+    if (due & DEADLINE_BIT(DEADLINE_LEADER)) action_leader_task();
+#endif
+
+    // write back config changed a while ago
+    eeconfig_task();
+
+    // system and consumer reports held while driver was busy
+    host_extra_task();
+
+#ifdef TYPE_INJECT_ENABLE
+    // keys queued by host
+    type_inject_task();
+#endif
+
+#ifdef STRESS_ENABLE
+    // synthetic key events of report throughput test
+    stress_task();
+#endif
 
 //MATRIX_LOOP_END:
 
     hook_keyboard_loop();
 
+#ifndef MOUSE_TASK_SEPARATE
+    WATCHDOG_STAGE(WATCHDOG_MOUSE);
+    keyboard_mouse_task();
+#endif
+
+    // update LED
+    WATCHDOG_STAGE(WATCHDOG_LED);
+    LATENCY_BEGIN();
+    if (host_keyboard_leds_pending()) {
+        uint8_t leds = host_keyboard_leds();
+        if (led_status != leds) {
+            led_status = leds;
+            if (debug_keyboard) dprintf("LED: %02X\n", led_status);
+            hook_keyboard_leds_change(led_status);
+        }
+    }
+    LATENCY_END(LATENCY_LED);
+    WATCHDOG_STAGE(WATCHDOG_LOOP);
+
+    LATENCY_END(LATENCY_OTHER);
+    LATENCY_COMMIT();
+
+#ifdef EVENT_TRACE_ENABLE
+    // out of timed stages
+    event_trace_task();
+#endif
+#ifdef INPUT_TRACE_ENABLE
+    input_trace_task();
+#endif
+
+#if defined(IDLE_SLEEP_ENABLE) || defined(MATRIX_SCAN_ADAPTIVE)
+    /* Sleep until next interrupt(timer tick or USB frame) while no key is down.
+     * Scan runs as fast as possible again when key or debounce is active. */
+    bool active = debounce_active();
+#   if defined(MATRIX_HAS_EVENTS)
+    if (!active) active = matrix_key_count();
+#   elif !defined(MATRIX_SCAN_ISR)
+    for (uint8_t r = 0; !active && r < MATRIX_ROWS; r++) {
+        if (matrix_prev[r]) active = true;
+    }
+#   endif
+#   ifdef MATRIX_SCAN_ADAPTIVE
+    scan_rate_update(active);
+#       ifndef IDLE_SLEEP_ENABLE
+    // sleeps at idle rate only
+    if (!idle) active = true;
+#       endif
+#   endif
+    if (!active) suspend_idle(1);
+#endif
+}
+
+void keyboard_mouse_task(void)
+{
 #ifdef MOUSEKEY_ENABLE
     // mousekey repeat & acceleration
     mousekey_task();
@@ -163,19 +744,15 @@ void keyboard_task(void)
 #endif
 
 #ifdef SERIAL_MOUSE_ENABLE
-        serial_mouse_task();
+    serial_mouse_task();
 #endif
 
 #ifdef ADB_MOUSE_ENABLE
-        adb_mouse_task();
+    adb_mouse_task();
 #endif
 
-    // update LED
-    if (led_status != host_keyboard_leds()) {
-        led_status = host_keyboard_leds();
-        if (debug_keyboard) dprintf("LED: %02X\n", led_status);
-        hook_keyboard_leds_change(led_status);
-    }
+    // send mouse motion merged from sources above
+    host_mouse_task();
 }
 
 void keyboard_set_leds(uint8_t leds)
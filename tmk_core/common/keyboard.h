@@ -66,6 +66,24 @@ void keyboard_init(void);
 void keyboard_task(void);
 /* it runs when host LED status is updated */
 void keyboard_set_leds(uint8_t leds);
+/* it runs mouse sources and sends merged motion, from keyboard_task() unless
+ * MOUSE_TASK_SEPARATE where protocol runs it on its own */
+void keyboard_mouse_task(void);
+/* it keeps keys down at remote wakeup, call it before sending wakeup, and
+ * keyboard_task() presses them once host takes reports so that the key waking
+ * host is not lost(not with MATRIX_HAS_EVENTS or MATRIX_SCAN_ISR) */
+void keyboard_wakeup_keys(void);
+
+#ifdef MATRIX_SCAN_ADAPTIVE
+/* it makes next keyboard_task() scan at once, for pin change interrupt of matrix */
+void keyboard_scan_wakeup(void);
+#endif
+#ifdef MATRIX_SCAN_ISR
+/* it runs from timer interrupt every tick and scans matrix, see keyboard.c */
+void keyboard_scan_isr(void);
+/* it stops and restarts the scan for code scanning matrix from main loop */
+void keyboard_scan_isr_enable(bool on);
+#endif
 
 #ifdef __cplusplus
 }
@@ -23,6 +23,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "wait.h"
 #include "debug.h"
 #include "bootloader.h"
+#include "progmem.h"
+#ifdef KEYMAP_PACK_ENABLE
+#include "keymap_pack.h"
+#endif
+#ifdef DYNAMIC_KEYMAP_ENABLE
+#include "dynamic_keymap.h"
+#endif
 #if defined(__AVR__)
 #include <avr/pgmspace.h>
 #endif
@@ -34,11 +41,21 @@ extern keymap_config_t keymap_config;
 static action_t keycode_to_action(uint8_t keycode);
 
 
+uint8_t keymap_keycode_for_key(uint8_t layer, keypos_t key)
+{
+#ifdef DYNAMIC_KEYMAP_ENABLE
+    return (layer < DYNAMIC_KEYMAP_LAYERS) ? dynamic_keymap_get(layer, key) :
+                                             keymap_key_to_keycode(layer, key);
+#else
+    return keymap_key_to_keycode(layer, key);
+#endif
+}
+
 /* converts key to action */
 __attribute__ ((weak))
 action_t action_for_key(uint8_t layer, keypos_t key)
 {
-    uint8_t keycode = keymap_key_to_keycode(layer, key);
+    uint8_t keycode = keymap_keycode_for_key(layer, key);
     switch (keycode) {
         case KC_FN0 ... KC_FN31:
             return keymap_fn_to_action(keycode);
@@ -112,6 +129,13 @@ action_t action_for_key(uint8_t layer, keypos_t key)
     }
 }
 
+/* keycode is enough, keycode_to_action() jumps to bootloader on KC_BOOTLOADER */
+__attribute__ ((weak))
+bool keymap_key_is_transparent(uint8_t layer, keypos_t key)
+{
+    return keymap_keycode_for_key(layer, key) == KC_TRNS;
+}
+
 
 /* Macro */
 __attribute__ ((weak))
@@ -134,6 +158,45 @@ void action_function(keyrecord_t *record, uint8_t id, uint8_t opt)
 
 
 
+#ifndef NO_KEYCODE_ACTION_TABLE
+/*
+ * Keycode to action table
+ *
+ * Action of every keycode is generated at compile time from the same ranges
+ * as the switch below, so that translation is a single table load instead of
+ * range compares and the chain of KEYCODE2CONSUMER(). Fn keys are resolved
+ * by keymap_fn_to_action() before and KC_BOOTLOADER is kept out of the table.
+ * NO_KEYCODE_ACTION_TABLE saves its 512 bytes of flash.
+ */
+#define KEYCODE_ACTION(kc)                                                  \
+    ((KC_A <= (kc) && (kc) <= KC_EXSEL) || (KC_LCTRL <= (kc) && (kc) <= KC_RGUI) ? \
+        (ACT_MODS<<12 | (kc)) :                                             \
+    (KC_SYSTEM_POWER <= (kc) && (kc) <= KC_SYSTEM_WAKE) ?                   \
+        (ACT_USAGE<<12 | PAGE_SYSTEM<<10 | KEYCODE2SYSTEM((kc))) :          \
+    (KC_AUDIO_MUTE <= (kc) && (kc) <= KC_WWW_FAVORITES) ?                   \
+        (ACT_USAGE<<12 | PAGE_CONSUMER<<10 | KEYCODE2CONSUMER((kc))) :      \
+    (KC_MS_UP <= (kc) && (kc) <= KC_MS_ACCEL2) ?                            \
+        (ACT_MOUSEKEY<<12 | (kc)) :                                         \
+    ((kc) == KC_TRNS) ? 1 : 0)
+#define KEYCODE_ACTION4(n)  KEYCODE_ACTION(n), KEYCODE_ACTION(n+1), KEYCODE_ACTION(n+2), KEYCODE_ACTION(n+3)
+#define KEYCODE_ACTION16(n) KEYCODE_ACTION4(n), KEYCODE_ACTION4(n+4), KEYCODE_ACTION4(n+8), KEYCODE_ACTION4(n+12)
+#define KEYCODE_ACTION64(n) KEYCODE_ACTION16(n), KEYCODE_ACTION16(n+16), KEYCODE_ACTION16(n+32), KEYCODE_ACTION16(n+48)
+
+static const uint16_t keycode_actions[256] PROGMEM = {
+    KEYCODE_ACTION64(0), KEYCODE_ACTION64(64), KEYCODE_ACTION64(128), KEYCODE_ACTION64(192)
+};
+
+/* translates keycode to action */
+static action_t keycode_to_action(uint8_t keycode)
+{
+    if (keycode == KC_BOOTLOADER) {
+        clear_keyboard();
+        wait_ms(50);
+        bootloader_jump(); // not return
+    }
+    return (action_t){ .code = pgm_read_word(&keycode_actions[keycode]) };
+}
+#else
 /* translates keycode to action */
 static action_t keycode_to_action(uint8_t keycode)
 {
@@ -165,6 +228,7 @@ static action_t keycode_to_action(uint8_t keycode)
     }
     return (action_t)ACTION_NO;
 }
+#endif
 
 
 
@@ -232,7 +296,9 @@ extern const action_t fn_actions[];
 __attribute__ ((weak))
 uint8_t keymap_key_to_keycode(uint8_t layer, keypos_t key)
 {
-#if defined(__AVR__)
+#if defined(KEYMAP_PACK_ENABLE)
+    return keymap_pack_get(layer, key.row, key.col);
+#elif defined(__AVR__)
     return pgm_read_byte(&keymaps[(layer)][(key.row)][(key.col)]);
 #else
     return keymaps[(layer)][(key.row)][(key.col)];
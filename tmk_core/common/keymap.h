@@ -43,6 +43,8 @@ typedef union {
 
 /* translates key to keycode */
 uint8_t keymap_key_to_keycode(uint8_t layer, keypos_t key);
+/* keycode action_for_key() takes, from dynamic keymap if it has the layer */
+uint8_t keymap_keycode_for_key(uint8_t layer, keypos_t key);
 
 /* translates Fn keycode to action */
 action_t keymap_fn_to_action(uint8_t keycode);
@@ -0,0 +1,39 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include "matrix.h"
+#include "keymap_image.h"
+
+
+/* symbols of ldscript_keymap_*.x around arrays of keymap section */
+extern const uint8_t __keymap_start[];
+extern const uint8_t __keymap_fn_actions_end[];
+extern const uint8_t __keymap_keymaps[];
+extern const uint8_t __keymap_keymaps_end[];
+
+/* flash addresses fit in 16 bits of pointer, keymap region is under 64KB */
+const keymap_image_header_t keymap_image_header __attribute__ ((section (".keymap_header"), used)) = {
+    .magic          = { 'K', 'M' },
+    .version        = KEYMAP_IMAGE_VERSION,
+    .width          = KEYMAP_IMAGE_WIDTH,
+    .rows           = KEYMAP_IMAGE_ROWS,
+    .cols           = KEYMAP_IMAGE_COLS,
+    .fn_actions     = (uint16_t)__keymap_start,
+    .fn_actions_end = (uint16_t)__keymap_fn_actions_end,
+    .keymaps        = (uint16_t)__keymap_keymaps,
+    .keymaps_end    = (uint16_t)__keymap_keymaps_end,
+};
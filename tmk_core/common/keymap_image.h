@@ -0,0 +1,74 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef KEYMAP_IMAGE_H
+#define KEYMAP_IMAGE_H
+
+#include <stdint.h>
+
+
+/*
+ * Keymap image(KEYMAP_SECTION_ENABLE)
+ *
+ * Last 16 bytes of keymap region of ldscript_keymap_*.x hold this header,
+ * so that tool/keymap_image can find fn_actions[] and keymaps[] in firmware
+ * hex and patch other keymap into it without building firmware. The same
+ * header starts an image file of keymap, followed by fn_actions and keymaps;
+ * addresses are of flash in firmware and offsets in image file. Values are
+ * little endian:
+ *
+ *     0   'K' 'M'          magic
+ *     2   version          KEYMAP_IMAGE_VERSION
+ *     3   width            bytes of code, 1: keycode 2: action
+ *     4   rows, cols       shape of layer
+ *     6   crc              CRC-16/CCITT(0x1021, init 0xFFFF) of fn_actions
+ *                          and keymaps, 0 until tool seals it on build
+ *     8   fn_actions       start and end of fn_actions[]
+ *     10  fn_actions_end
+ *     12  keymaps          start and end of keymaps[], layers are
+ *     14  keymaps_end      (end - start) / (rows * cols * width)
+ */
+#define KEYMAP_IMAGE_VERSION    1
+
+#if defined(UNIMAP_ENABLE)
+#   include "unimap.h"
+#   define KEYMAP_IMAGE_ROWS    UNIMAP_ROWS
+#   define KEYMAP_IMAGE_COLS    UNIMAP_COLS
+#   define KEYMAP_IMAGE_WIDTH   2
+#elif defined(ACTIONMAP_ENABLE)
+#   define KEYMAP_IMAGE_ROWS    MATRIX_ROWS
+#   define KEYMAP_IMAGE_COLS    MATRIX_COLS
+#   define KEYMAP_IMAGE_WIDTH   2
+#else
+#   define KEYMAP_IMAGE_ROWS    MATRIX_ROWS
+#   define KEYMAP_IMAGE_COLS    MATRIX_COLS
+#   define KEYMAP_IMAGE_WIDTH   1
+#endif
+
+typedef struct {
+    uint8_t  magic[2];
+    uint8_t  version;
+    uint8_t  width;
+    uint8_t  rows;
+    uint8_t  cols;
+    uint16_t crc;
+    uint16_t fn_actions;
+    uint16_t fn_actions_end;
+    uint16_t keymaps;
+    uint16_t keymaps_end;
+} __attribute__ ((packed)) keymap_image_header_t;
+
+#endif
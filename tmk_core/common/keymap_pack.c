@@ -0,0 +1,52 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include "progmem.h"
+#include "util.h"
+#include "keymap_pack.h"
+
+/* generated from keymap by tool/keymap_pack */
+#include "keymap_pack_data.h"
+
+
+uint16_t keymap_pack_get(uint8_t layer, uint8_t row, uint8_t col)
+{
+    if (layer >= KEYMAP_PACK_LAYERS) return KEYMAP_PACK_TRANSPARENT;
+
+#if KEYMAP_PACK_BITS_SIZE == 1
+    uint8_t bits = pgm_read_byte(&keymap_pack_bits[layer][row]);
+    uint8_t mask = (1<<col);
+    if (!(bits & mask)) return KEYMAP_PACK_TRANSPARENT;
+    uint16_t i = pgm_read_word(&keymap_pack_index[layer][row]) + bitpop(bits & (mask - 1));
+#elif KEYMAP_PACK_BITS_SIZE == 2
+    uint16_t bits = pgm_read_word(&keymap_pack_bits[layer][row]);
+    uint16_t mask = (1U<<col);
+    if (!(bits & mask)) return KEYMAP_PACK_TRANSPARENT;
+    uint16_t i = pgm_read_word(&keymap_pack_index[layer][row]) + bitpop16(bits & (mask - 1));
+#else
+    uint32_t bits = pgm_read_dword(&keymap_pack_bits[layer][row]);
+    uint32_t mask = (1UL<<col);
+    if (!(bits & mask)) return KEYMAP_PACK_TRANSPARENT;
+    uint16_t i = pgm_read_word(&keymap_pack_index[layer][row]) + bitpop32(bits & (mask - 1));
+#endif
+
+#if KEYMAP_PACK_WIDTH == 1
+    return pgm_read_byte(&keymap_pack_codes[i]);
+#else
+    return pgm_read_word(&keymap_pack_codes[i]);
+#endif
+}
@@ -0,0 +1,57 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef KEYMAP_PACK_H
+#define KEYMAP_PACK_H
+
+#include <stdint.h>
+
+
+/* Packed keymap
+ *
+ * keymaps[] (or actionmaps[]) is converted by tool/keymap_pack at build time
+ * into a bitmap of non-transparent keys per row and array of their codes.
+ * Transparent keys take one bit instead of one entry and are found
+ * without reading codes.
+ *
+ * Shape and type of the source array for the converter.
+ */
+#if defined(UNIMAP_ENABLE)
+#   include "unimap.h"
+#   define KEYMAP_PACK_ROWS     UNIMAP_ROWS
+#   define KEYMAP_PACK_COLS     UNIMAP_COLS
+#   define KEYMAP_PACK_WIDTH    2
+#   define KEYMAP_PACK_SYMBOL   actionmaps
+#elif defined(ACTIONMAP_ENABLE)
+#   define KEYMAP_PACK_ROWS     MATRIX_ROWS
+#   define KEYMAP_PACK_COLS     MATRIX_COLS
+#   define KEYMAP_PACK_WIDTH    2
+#   define KEYMAP_PACK_SYMBOL   actionmaps
+#else
+#   define KEYMAP_PACK_ROWS     MATRIX_ROWS
+#   define KEYMAP_PACK_COLS     MATRIX_COLS
+#   define KEYMAP_PACK_WIDTH    1
+#   define KEYMAP_PACK_SYMBOL   keymaps
+#endif
+
+/* code of transparent: KC_TRNS and ACTION_TRANSPARENT */
+#define KEYMAP_PACK_TRANSPARENT 1
+
+
+/* returns keycode or action code at position of layer */
+uint16_t keymap_pack_get(uint8_t layer, uint8_t row, uint8_t col);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "print.h"
+#include "latency.h"
+#if defined(__AVR__)
+#   include <avr/io.h>
+#   include <avr/interrupt.h>
+#elif defined(__arm__) && !defined(PROTOCOL_CHIBIOS)
+#   include "us_ticker_api.h"
+#endif
+
+
+static latency_stat_t stats[LATENCY_STAGES];
+
+/* times of stages in current keyboard_task() call */
+static latency_tick_t current[LATENCY_STAGES];
+#if LATENCY_RING_SIZE > 0
+static latency_tick_t ring[LATENCY_RING_SIZE][LATENCY_STAGES];
+static uint8_t ring_head = 0;
+static uint8_t ring_count = 0;
+#endif
+static bool has_event = false;
+
+static latency_tick_t stack_start[LATENCY_DEPTH];
+static latency_tick_t stack_child[LATENCY_DEPTH];
+static uint8_t depth = 0;
+
+#ifndef NO_PRINT
+static void print_stage(uint8_t stage)
+{
+    switch (stage) {
+        case LATENCY_SCAN:      print("scan  "); break;
+        case LATENCY_DIFF:      print("diff  "); break;
+        case LATENCY_ACTION:    print("action"); break;
+        case LATENCY_TICK:      print("tick  "); break;
+        case LATENCY_SEND:      print("send  "); break;
+        case LATENCY_LED:       print("led   "); break;
+        case LATENCY_OTHER:     print("other "); break;
+    }
+}
+#endif
+
+
+latency_tick_t latency_ticks(void)
+{
+#if defined(__AVR__)
+    /* sub-ms count of Timer0 on top of ms count of timer.c */
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ms = (uint16_t)timer_count;
+    uint8_t raw = TIMER_RAW;
+#   ifdef TIFR0
+    if (TIFR0 & (1<<OCF0A)) {
+#   else
+    if (TIFR & (1<<OCF0A)) {
+#   endif
+        // compare match not serviced yet
+        ms++;
+        raw = TIMER_RAW;
+    }
+    SREG = sreg;
+    return ms * (TIMER_RAW_TOP + 1) + raw;
+#elif defined(PROTOCOL_CHIBIOS)
+#   if PORT_SUPPORTS_RT && defined(STM32_SYSCLK)
+    return chSysGetRealtimeCounterX();
+#   else
+    return chVTGetSystemTimeX();
+#   endif
+#elif defined(__arm__)
+    return us_ticker_read();
+#else
+    return timer_read32();
+#endif
+}
+
+void latency_begin(void)
+{
+    if (depth < LATENCY_DEPTH) {
+        stack_child[depth] = 0;
+        stack_start[depth] = latency_ticks();
+    }
+    depth++;
+}
+
+void latency_end(uint8_t stage)
+{
+    latency_tick_t now = latency_ticks();
+    if (!depth) return;
+
+    depth--;
+    if (depth >= LATENCY_DEPTH || stage >= LATENCY_STAGES) return;
+
+    latency_tick_t elapsed = now - stack_start[depth];
+    latency_tick_t t = elapsed - stack_child[depth];
+    if (depth) stack_child[depth - 1] += elapsed;
+
+    latency_stat_t *s = &stats[stage];
+    if (s->count == 0 || t < s->min) s->min = t;
+    if (t > s->max) s->max = t;
+    if (s->count < UINT16_MAX) {
+        s->count++;
+        s->sum += t;
+    }
+
+    uint8_t b = 0;
+    for (latency_tick_t v = t; v && b < LATENCY_HIST_BUCKETS - 1; v >>= 1) b++;
+    if (s->hist[b] < UINT16_MAX) s->hist[b]++;
+
+    current[stage] += t;
+    if (stage == LATENCY_ACTION) has_event = true;
+}
+
+void latency_commit(void)
+{
+#if LATENCY_RING_SIZE > 0
+    if (has_event) {
+        for (uint8_t i = 0; i < LATENCY_STAGES; i++) {
+            ring[ring_head][i] = current[i];
+        }
+        ring_head = (ring_head + 1) % LATENCY_RING_SIZE;
+        if (ring_count < LATENCY_RING_SIZE) ring_count++;
+    }
+#endif
+    for (uint8_t i = 0; i < LATENCY_STAGES; i++) {
+        current[i] = 0;
+    }
+    has_event = false;
+}
+
+const latency_stat_t *latency_stat(uint8_t stage)
+{
+    return &stats[stage];
+}
+
+void latency_clear(void)
+{
+    for (uint8_t i = 0; i < LATENCY_STAGES; i++) {
+        stats[i] = (latency_stat_t){};
+        current[i] = 0;
+    }
+    has_event = false;
+#if LATENCY_RING_SIZE > 0
+    ring_head = 0;
+    ring_count = 0;
+#endif
+}
+
+void latency_print(void)
+{
+#ifndef NO_PRINT
+    xprintf("\n\t- Latency(ticks of %luHz) -\n", (unsigned long)LATENCY_TICK_FREQ);
+    print("stage     min    max    avg  count | hist(log2)\n");
+    for (uint8_t i = 0; i < LATENCY_STAGES; i++) {
+        latency_stat_t *s = &stats[i];
+        print_stage(i);
+        xprintf(" %6lu %6lu %6lu %6u |",
+                (unsigned long)s->min, (unsigned long)s->max,
+                s->count ? (unsigned long)(s->sum / s->count) : 0UL, s->count);
+        for (uint8_t b = 0; b < LATENCY_HIST_BUCKETS; b++) {
+            xprintf(" %u", s->hist[b]);
+        }
+        print("\n");
+    }
+#if LATENCY_RING_SIZE > 0
+    print("recent events: scan diff action tick send led other\n");
+    for (uint8_t n = 0; n < ring_count; n++) {
+        uint8_t r = (ring_head + LATENCY_RING_SIZE - ring_count + n) % LATENCY_RING_SIZE;
+        for (uint8_t i = 0; i < LATENCY_STAGES; i++) {
+            xprintf(" %lu", (unsigned long)ring[r][i]);
+        }
+        print("\n");
+    }
+#endif
+#endif
+}
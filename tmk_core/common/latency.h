@@ -0,0 +1,126 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Stages of keyboard_task()
+ * Time of a stage excludes stages nested in it, e.g. ACTION doesn't
+ * include SEND of reports issued while processing the action.
+ */
+enum latency_stage {
+    LATENCY_SCAN,       /* matrix_scan() */
+    LATENCY_DIFF,       /* per-row XOR diff and event generation */
+    LATENCY_ACTION,     /* action_exec() of key event */
+    LATENCY_TICK,       /* action_exec() of TICK */
+    LATENCY_SEND,       /* host_keyboard_send() */
+    LATENCY_LED,        /* LED update */
+    LATENCY_OTHER,      /* rest of keyboard_task(): hooks, mouse tasks */
+    LATENCY_STAGES
+};
+
+/* log2 histogram buckets: [0], [1], [2-3], [4-7] ... [2^(N-2)-] */
+#ifndef LATENCY_HIST_BUCKETS
+#define LATENCY_HIST_BUCKETS    8
+#endif
+
+/* recent keyboard_task() calls with key event */
+#ifndef LATENCY_RING_SIZE
+#define LATENCY_RING_SIZE       8
+#endif
+
+/* nesting depth of stages */
+#define LATENCY_DEPTH           4
+
+
+/* Tick source
+ *   AVR:       Timer0 of timer.c, TIMER_RAW_FREQ(4us at 16MHz)
+ *   ChibiOS:   realtime counter if port supports, otherwise system tick
+ *   mbed:      us_ticker
+ *   others:    timer_read32() in ms
+ */
+#if defined(__AVR__)
+#   include "avr/timer_avr.h"
+typedef uint16_t latency_tick_t;
+#   define LATENCY_TICK_FREQ    TIMER_RAW_FREQ
+#elif defined(PROTOCOL_CHIBIOS)
+#   include "ch.h"
+typedef uint32_t latency_tick_t;
+#   ifndef LATENCY_TICK_FREQ
+#       if PORT_SUPPORTS_RT && defined(STM32_SYSCLK)
+#           define LATENCY_TICK_FREQ    STM32_SYSCLK
+#       else
+#           define LATENCY_TICK_FREQ    CH_CFG_ST_FREQUENCY
+#       endif
+#   endif
+#elif defined(__arm__)
+typedef uint32_t latency_tick_t;
+#   define LATENCY_TICK_FREQ    1000000
+#else
+typedef uint32_t latency_tick_t;
+#   define LATENCY_TICK_FREQ    1000
+#endif
+
+
+#ifdef LATENCY_TRACE_ENABLE
+
+#define LATENCY_BEGIN()         latency_begin()
+#define LATENCY_END(stage)      latency_end(stage)
+#define LATENCY_COMMIT()        latency_commit()
+
+#else
+
+#define LATENCY_BEGIN()         ((void)0)
+#define LATENCY_END(stage)      ((void)0)
+#define LATENCY_COMMIT()        ((void)0)
+
+#endif
+
+
+typedef struct {
+    latency_tick_t min;
+    latency_tick_t max;
+    uint32_t sum;
+    uint16_t count;
+    uint16_t hist[LATENCY_HIST_BUCKETS];
+} latency_stat_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+latency_tick_t latency_ticks(void);
+/* open a stage; stages can be nested up to LATENCY_DEPTH */
+void latency_begin(void);
+/* close the innermost stage and record its time */
+void latency_end(uint8_t stage);
+/* end of keyboard_task(): keep times of this call in ring if it had key event */
+void latency_commit(void);
+/* stats of stage since last clear, for telemetry */
+const latency_stat_t *latency_stat(uint8_t stage);
+void latency_clear(void);
+void latency_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
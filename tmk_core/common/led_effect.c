@@ -0,0 +1,175 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "led.h"
+#include "led_effect.h"
+#ifdef BACKLIGHT_PWM_ENABLE
+#include "backlight.h"
+#endif
+
+
+#if LED_EFFECT_LEDS > 254
+#   error "LED_EFFECT_LEDS must not exceed 254"
+#endif
+#if LED_EFFECT_BUDGET < 1 || LED_EFFECT_BUDGET > 255
+#   error "LED_EFFECT_BUDGET must be 1-255"
+#endif
+
+#define BITS        ((LED_EFFECT_LEDS + 7) / 8)
+#define BIT_GET(a, i)   ((a)[(i) / 8] & (1 << ((i) % 8)))
+#define BIT_SET(a, i)   ((a)[(i) / 8] |= (1 << ((i) % 8)))
+#define BIT_CLR(a, i)   ((a)[(i) / 8] &= ~(1 << ((i) % 8)))
+
+/* fade per ms in 8.8 fixed point */
+#define FADE_STEP   ((uint16_t)(255UL * 256 / LED_EFFECT_FADE_MS))
+
+
+static uint8_t fade[LED_EFFECT_LEDS];
+static uint8_t written[LED_EFFECT_LEDS];
+static uint8_t held[BITS];
+static uint8_t dirty[BITS] = { [0 ... BITS - 1] = 0xFF };
+
+static uint32_t layer = 0;
+static uint8_t usb_led = 0;
+
+/* frame in progress: next LED and fade of this frame */
+static bool in_frame = false;
+static bool active = true;          // something to compute in next frame
+static uint8_t pos;
+static uint8_t frame_fade;
+static uint16_t frame_time;
+static uint8_t fade_frac;
+
+
+static void mark_all(void)
+{
+    for (uint8_t i = 0; i < BITS; i++) dirty[i] = 0xFF;
+    active = true;
+}
+
+void led_effect_refresh(void)
+{
+    mark_all();
+}
+
+void led_effect_key(keyevent_t event)
+{
+    uint8_t led = led_effect_key_led(event.key);
+    if (led >= LED_EFFECT_LEDS) return;
+
+    if (event.pressed) {
+        BIT_SET(held, led);
+        fade[led] = 255;
+    } else {
+        BIT_CLR(held, led);
+    }
+    BIT_SET(dirty, led);
+    active = true;
+}
+
+void led_effect_layer(uint32_t state)
+{
+    if (layer == state) return;
+    layer = state;
+    mark_all();
+}
+
+void led_effect_leds(uint8_t leds)
+{
+    if (usb_led == leds) return;
+    usb_led = leds;
+    mark_all();
+}
+
+static void frame_start(void)
+{
+    uint16_t dt = timer_elapsed(frame_time);
+    frame_time = timer_read();
+    if (dt > LED_EFFECT_FADE_MS) dt = LED_EFFECT_FADE_MS;
+
+    uint32_t f = (uint32_t)dt * FADE_STEP + fade_frac;
+    fade_frac = f & 0xFF;
+    frame_fade = (f >> 8 > 255) ? 255 : f >> 8;
+}
+
+void led_effect_task(void)
+{
+    if (!in_frame) {
+        if (timer_elapsed(frame_time) < LED_EFFECT_FRAME_MS) return;
+        frame_start();
+        if (!active) return;
+        active = false;
+        in_frame = true;
+        pos = 0;
+    }
+
+    for (uint8_t budget = LED_EFFECT_BUDGET; budget && pos < LED_EFFECT_LEDS; budget--) {
+        uint8_t i = pos++;
+        bool is_held = BIT_GET(held, i);
+        if (!fade[i] && !BIT_GET(dirty, i)) continue;
+        BIT_CLR(dirty, i);
+
+        if (!is_held) {
+            fade[i] = (fade[i] > frame_fade) ? fade[i] - frame_fade : 0;
+        }
+        if (fade[i] && !is_held) active = true;
+
+        uint8_t v = led_effect_base(i, layer, usb_led);
+        if (fade[i] > v) v = fade[i];
+        if (v != written[i]) {
+            written[i] = v;
+            led_effect_write(i, v);
+        }
+    }
+    if (pos == LED_EFFECT_LEDS) in_frame = false;
+}
+
+
+__attribute__ ((weak))
+uint8_t led_effect_key_led(keypos_t key)
+{
+#if LED_EFFECT_LEDS == 1
+    (void)key;
+    return 0;
+#else
+    uint16_t led = (uint16_t)key.row * MATRIX_COLS + key.col;
+    return (led < LED_EFFECT_LEDS) ? led : LED_EFFECT_NO_LED;
+#endif
+}
+
+__attribute__ ((weak))
+uint8_t led_effect_base(uint8_t led, uint32_t layer_state, uint8_t leds)
+{
+#ifdef LED_EFFECT_CAPS_LOCK_LED
+    if (led == LED_EFFECT_CAPS_LOCK_LED && (leds & (1<<USB_LED_CAPS_LOCK))) return 255;
+#else
+    (void)led;
+    (void)leds;
+#endif
+    return (layer_state & ~1UL) ? LED_EFFECT_LAYER_LEVEL : LED_EFFECT_BASE_LEVEL;
+}
+
+#ifdef BACKLIGHT_PWM_ENABLE
+__attribute__ ((weak))
+void led_effect_write(uint8_t led, uint8_t value)
+{
+    if (led == 0) backlight_pwm_duty(value);
+}
+#endif
@@ -0,0 +1,88 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LED_EFFECT_H
+#define LED_EFFECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyboard.h"
+
+/*
+ * Lighting effects(LED_EFFECT_ENABLE)
+ *
+ * Brightness of LED is the larger of its base and its reactive fade:
+ *   base    led_effect_base() of layer and lock state, default is
+ *           LED_EFFECT_LAYER_LEVEL while a layer is on and LED_EFFECT_BASE_LEVEL
+ *           otherwise, and Caps Lock on LED_EFFECT_CAPS_LOCK_LED.
+ *   fade    LED of key is full while the key is held and goes down to 0 in
+ *           LED_EFFECT_FADE_MS after release.
+ *
+ * Default hooks of hook.c feed key, layer and LED state changes and run
+ * led_effect_task() from keyboard loop, call them from your hooks when you
+ * override those. A frame starts every LED_EFFECT_FRAME_MS while something
+ * is fading or has changed, and looks at LED_EFFECT_BUDGET LEDs at most in
+ * a loop so that a frame spreads over loops. Only LEDs held, fading or
+ * marked by a change are computed, and led_effect_write() is called only
+ * when the value differs from the last one written. Fade is 8.8 fixed point.
+ *
+ * Board provides led_effect_write(), e.g. to a framebuffer of LED driver.
+ * With BACKLIGHT_PWM_ENABLE default is one LED on backlight PWM which all
+ * keys light up.
+ */
+#ifndef LED_EFFECT_LEDS
+#   ifdef BACKLIGHT_PWM_ENABLE
+#       define LED_EFFECT_LEDS      1
+#   else
+#       define LED_EFFECT_LEDS      (MATRIX_ROWS * MATRIX_COLS)
+#   endif
+#endif
+#ifndef LED_EFFECT_FRAME_MS
+#define LED_EFFECT_FRAME_MS     16
+#endif
+#ifndef LED_EFFECT_BUDGET
+#define LED_EFFECT_BUDGET       16
+#endif
+#ifndef LED_EFFECT_FADE_MS
+#define LED_EFFECT_FADE_MS      500
+#endif
+#ifndef LED_EFFECT_BASE_LEVEL
+#define LED_EFFECT_BASE_LEVEL   0
+#endif
+#ifndef LED_EFFECT_LAYER_LEVEL
+#define LED_EFFECT_LAYER_LEVEL  64
+#endif
+
+#define LED_EFFECT_NO_LED       0xFF
+
+/* state changes, called from default hooks */
+void led_effect_key(keyevent_t event);
+void led_effect_layer(uint32_t layer_state);
+void led_effect_leds(uint8_t usb_led);
+/* renders part of a frame, call every keyboard loop */
+void led_effect_task(void);
+/* computes all LEDs in next frame, e.g. after change of led_effect_base() */
+void led_effect_refresh(void);
+
+/* LED of key, default row * MATRIX_COLS + col or LED 0 of one LED */
+uint8_t led_effect_key_led(keypos_t key);
+/* brightness without key fade */
+uint8_t led_effect_base(uint8_t led, uint32_t layer_state, uint8_t usb_led);
+/* output of board */
+void led_effect_write(uint8_t led, uint8_t value);
+
+#endif
@@ -15,7 +15,9 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "print.h"
+#include "util.h"
 #include "matrix.h"
+#include "telemetry.h"
 
 
 __attribute__ ((weak))
@@ -38,15 +40,29 @@ void matrix_clear(void)
 __attribute__ ((weak))
 void matrix_setup(void) {}
 
+__attribute__ ((weak))
+matrix_rows_t matrix_changed_rows(void)
+{
+    return MATRIX_ROWS_ALL;
+}
+
 __attribute__ ((weak))
 bool matrix_is_on(uint8_t row, uint8_t col)
 {
-    return (matrix_get_row(row) & (1<<col));
+    return (MATRIX_READ_ROW(row) & (1<<col));
 }
 
 __attribute__ ((weak))
 void matrix_print(void)
 {
+#ifdef MATRIX_SNAPSHOT
+    matrix_row_t rows[MATRIX_ROWS];
+    matrix_snapshot(rows);
+#   define PRINT_ROW(row)   rows[row]
+#else
+#   define PRINT_ROW(row)   matrix_get_row(row)
+#endif
+
 #if (MATRIX_COLS <= 8)
     print("r/c 01234567\n");
 #elif (MATRIX_COLS <= 16)
@@ -58,11 +74,11 @@ void matrix_print(void)
     for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
 
 #if (MATRIX_COLS <= 8)
-        xprintf("%02X: %08b%s\n", row, bitrev(matrix_get_row(row)),
+        xprintf("%02X: %08b%s\n", row, bitrev(PRINT_ROW(row)),
 #elif (MATRIX_COLS <= 16)
-        xprintf("%02X: %016b%s\n", row, bitrev16(matrix_get_row(row)),
+        xprintf("%02X: %016b%s\n", row, bitrev16(PRINT_ROW(row)),
 #elif (MATRIX_COLS <= 32)
-        xprintf("%02X: %032b%s\n", row, bitrev32(matrix_get_row(row)),
+        xprintf("%02X: %032b%s\n", row, bitrev32(PRINT_ROW(row)),
 #endif
 #ifdef MATRIX_HAS_GHOST
         matrix_has_ghost_in_row(row) ?  " <ghost" : ""
@@ -71,8 +87,56 @@ void matrix_print(void)
 #endif
         );
     }
+#undef PRINT_ROW
+}
+
+#ifdef MATRIX_SNAPSHOT
+/* Frame seq & 1 is published, scanner writes the other. Written in
+ * interrupt and read in main loop, or any single writer against readers. */
+static matrix_row_t snapshot_frames[2][MATRIX_ROWS];
+static volatile uint8_t snapshot_seq = 0;
+
+#define COMPILER_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+void matrix_snapshot_publish(void)
+{
+    matrix_row_t *frame = snapshot_frames[(snapshot_seq + 1) & 1];
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        frame[r] = matrix_get_row(r);
+    }
+    // rows are in memory before the flip
+    COMPILER_BARRIER();
+    snapshot_seq++;
 }
 
+matrix_row_t matrix_snapshot_row(uint8_t row)
+{
+    uint8_t seq;
+    matrix_row_t r;
+    do {
+        seq = snapshot_seq;
+        COMPILER_BARRIER();
+        r = snapshot_frames[seq & 1][row];
+        COMPILER_BARRIER();
+    } while (seq != snapshot_seq);
+    return r;
+}
+
+void matrix_snapshot(matrix_row_t rows[MATRIX_ROWS])
+{
+    uint8_t seq;
+    do {
+        seq = snapshot_seq;
+        COMPILER_BARRIER();
+        const matrix_row_t *frame = snapshot_frames[seq & 1];
+        for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+            rows[r] = frame[r];
+        }
+        COMPILER_BARRIER();
+    } while (seq != snapshot_seq);
+}
+#endif
+
 #ifdef MATRIX_HAS_GHOST
 __attribute__ ((weak))
 bool matrix_has_ghost_in_row(uint8_t row)
@@ -91,5 +155,78 @@ bool matrix_has_ghost_in_row(uint8_t row)
 }
 #endif
 
+#ifdef MATRIX_HAS_EVENTS
+#ifndef MATRIX_EVENT_QUEUE_SIZE
+#define MATRIX_EVENT_QUEUE_SIZE 8
+#endif
+#if (MATRIX_EVENT_QUEUE_SIZE < 2 || MATRIX_EVENT_QUEUE_SIZE > 128 || \
+     (MATRIX_EVENT_QUEUE_SIZE & (MATRIX_EVENT_QUEUE_SIZE - 1)))
+#   error "MATRIX_EVENT_QUEUE_SIZE must be power of two from 2 to 128"
+#endif
+#define EVENT_MASK  (MATRIX_EVENT_QUEUE_SIZE - 1)
+
+/* put by matrix_scan() and taken by keyboard_task(), both in main loop */
+static keyevent_t events[MATRIX_EVENT_QUEUE_SIZE];
+static uint8_t events_head = 0;
+static uint8_t events_tail = 0;
+
+bool matrix_event_put(keypos_t key, bool pressed, uint16_t time)
+{
+    uint8_t next = (events_head + 1) & EVENT_MASK;
+    if (next == events_tail) {
+        TELEMETRY_COUNT(TELEMETRY_EVENT_LOST);
+        xprintf("matrix: event lost: %02X%02X\n", key.row, key.col);
+        return false;
+    }
+    events[events_head] = (keyevent_t){
+        .key = key,
+        .pressed = pressed,
+        .time = (time | 1) /* time should not be 0 */
+    };
+    events_head = next;
+    TELEMETRY_PEAK_SET(TELEMETRY_EVENT_PEAK, (next - events_tail) & EVENT_MASK);
+    return true;
+}
+
+bool matrix_event_get(keyevent_t *event)
+{
+    if (events_tail == events_head) return false;
+    *event = events[events_tail];
+    events_tail = (events_tail + 1) & EVENT_MASK;
+    return true;
+}
+
+void matrix_event_clear(void)
+{
+    events_head = events_tail = 0;
+}
+
+__attribute__ ((weak))
+uint8_t matrix_key_count(void)
+{
+    uint8_t count = 0;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+#if (MATRIX_COLS <= 8)
+        count += bitpop(matrix_get_row(r));
+#elif (MATRIX_COLS <= 16)
+        count += bitpop16(matrix_get_row(r));
+#else
+        count += bitpop32(matrix_get_row(r));
+#endif
+    }
+    return count;
+}
+#endif
+
 __attribute__ ((weak)) void matrix_power_up(void) {}
 __attribute__ ((weak)) void matrix_power_down(void) {}
+
+__attribute__ ((weak))
+bool matrix_any_key_down(void)
+{
+    matrix_scan();
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (matrix_get_row(r)) return true;
+    }
+    return false;
+}
@@ -36,8 +36,40 @@ typedef  uint32_t   matrix_row_t;
 #error "MATRIX_ROWS must not exceed 255"
 #endif
 
+/* mask of rows, rows over 32 share bit of (row % 32) */
+#if (MATRIX_ROWS <= 8)
+typedef  uint8_t    matrix_rows_t;
+#elif (MATRIX_ROWS <= 16)
+typedef  uint16_t   matrix_rows_t;
+#else
+typedef  uint32_t   matrix_rows_t;
+#endif
+#define MATRIX_ROWS_ALL     ((matrix_rows_t)~0)
+#define MATRIX_ROW_BIT(row) ((matrix_rows_t)1 << ((row) % (sizeof(matrix_rows_t) * 8)))
+
 #define MATRIX_IS_ON(row, col)  (matrix_get_row(row) && (1<<col))
 
+/* Matrix snapshot(MATRIX_SNAPSHOT, on with MATRIX_SCAN_ISR)
+ *
+ * When matrix is scanned in interrupt, matrix_get_row() of main loop can see
+ * a row being written or rows of two scans. Scanner publishes each scan it
+ * completed with matrix_snapshot_publish(), which copies rows into frame
+ * main loop is not reading and then flips to it. Readers of main loop take
+ * rows from the published frame with MATRIX_READ_ROW() or a whole frame with
+ * matrix_snapshot(); sequence count of frames tells them their read crossed
+ * a flip and they read again, which is rare as the copy is short against
+ * scan period. Neither side disables interrupts or waits for the other.
+ * Code in the scanner's context keeps reading matrix_get_row().
+ */
+#if defined(MATRIX_SCAN_ISR) && !defined(MATRIX_SNAPSHOT)
+#   define MATRIX_SNAPSHOT
+#endif
+#ifdef MATRIX_SNAPSHOT
+#   define MATRIX_READ_ROW(row)    matrix_snapshot_row(row)
+#else
+#   define MATRIX_READ_ROW(row)    matrix_get_row(row)
+#endif
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,14 +95,47 @@ matrix_row_t matrix_get_row(uint8_t row);
 void matrix_print(void);
 /* clear matrix */
 void matrix_clear(void);
+/* Rows changed since last call, 0 when nothing changed. Matrix which knows
+ * this after matrix_scan(), e.g. from debounce(), overrides default of all
+ * rows so that keyboard_task() reads only those with matrix_get_row(). */
+matrix_rows_t matrix_changed_rows(void);
+
+#ifdef MATRIX_SNAPSHOT
+/* scanner: rows of matrix_get_row() become frame of readers, after scan */
+void matrix_snapshot_publish(void);
+/* reader: row of last published frame */
+matrix_row_t matrix_snapshot_row(uint8_t row);
+/* reader: all rows of last published frame */
+void matrix_snapshot(matrix_row_t rows[MATRIX_ROWS]);
+#endif
 
 #ifdef MATRIX_HAS_GHOST
 bool matrix_has_ghost_in_row(uint8_t row);
 #endif
 
+#ifdef MATRIX_HAS_EVENTS
+/* Matrix which knows its own changes, e.g. make/break of converters, puts
+ * them into event queue in order they come and keyboard_task() takes them
+ * instead of diffing all rows. Time of event is timer_read() when the change
+ * was received, e.g. ps2_host_recv_time(), and reaches action_exec() as is.
+ * Size of queue is MATRIX_EVENT_QUEUE_SIZE(power of two, default 8). */
+#include "keyboard.h"
+/* queue key change, false when queue is full and matrix should keep old state */
+bool matrix_event_put(keypos_t key, bool pressed, uint16_t time);
+/* next key change after matrix_scan(), false if none */
+bool matrix_event_get(keyevent_t *event);
+/* discard changes not taken yet */
+void matrix_event_clear(void);
+/* number of keys down, default counts bits of rows */
+uint8_t matrix_key_count(void);
+#endif
+
 /* power control */
 void matrix_power_up(void);
 void matrix_power_down(void);
+/* tell whether any key is down for wakeup from suspend, default is full scan
+ * and matrix can override it with cheaper one */
+bool matrix_any_key_down(void);
 
 #ifdef __cplusplus
 }
@@ -2,5 +2,6 @@
 
 
 void suspend_power_down(void) {}
+void suspend_power_down_reset(void) {}
 bool suspend_wakeup_condition(void) { return true; }
 void suspend_wakeup_init(void) {}
@@ -39,3 +39,20 @@ uint32_t timer_elapsed32(uint32_t last)
 {
     return TIMER_DIFF_32(timer_read32(), last);
 }
+
+/* ms count and SysTick phase, read again if tick came in between */
+uint32_t timer_read_us(void)
+{
+    uint32_t ms, val;
+    do {
+        ms = timer_count;
+        val = SysTick->VAL;
+    } while (ms != timer_count);
+    uint32_t load = SysTick->LOAD + 1;
+    return ms * 1000 + (load - 1 - val) * 1000 / load;
+}
+
+uint32_t timer_elapsed_us(uint32_t last)
+{
+    return TIMER_DIFF_32(timer_read_us(), last);
+}
@@ -0,0 +1,177 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "keycode.h"
+#include "keymap.h"
+#include "matrix.h"
+#include "host.h"
+#include "action.h"
+#include "action_layer.h"
+#include "action_util.h"
+#include "latency.h"
+#include "print.h"
+#include "util.h"
+#include "microbench.h"
+
+
+/* cycles of CPU per tick of latency_ticks() if it is whole */
+#if defined(__AVR__)
+#   define CYCLES_PER_TICK  TIMER_PRESCALER
+#elif defined(PROTOCOL_CHIBIOS) && PORT_SUPPORTS_RT && defined(STM32_SYSCLK)
+#   define CYCLES_PER_TICK  1
+#endif
+
+
+static uint16_t action_all_layers(void)
+{
+    uint16_t ops = 0;
+#ifndef NO_ACTION_LAYER
+    uint32_t layers = layer_state | default_layer_state;
+#else
+    uint32_t layers = default_layer_state;
+#endif
+    if (!layers) layers = 1;
+    while (layers) {
+        uint8_t layer = biton32(layers);
+        for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+            for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+                keypos_t key = { .row = r, .col = c };
+#ifndef ACTIONMAP_ENABLE
+                // action of it jumps to bootloader
+                if (keymap_keycode_for_key(layer, key) == KC_BOOTLOADER) continue;
+#endif
+                action_for_key(layer, key);
+                ops++;
+            }
+        }
+        layers &= ~(1UL<<layer);
+    }
+    return ops;
+}
+
+static uint16_t layer_all_keys(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            current_layer_for_key((keypos_t){ .row = r, .col = c });
+        }
+    }
+    return MATRIX_ROWS * MATRIX_COLS;
+}
+
+static uint16_t layer_cold(void)
+{
+    layer_cache_clear();
+    return layer_all_keys();
+}
+
+static uint16_t keys_add_del(void)
+{
+    for (uint8_t k = KC_A; k < KC_A + 6; k++) add_key(k);
+    for (uint8_t k = KC_A; k < KC_A + 6; k++) del_key(k);
+    return 12;
+}
+
+static uint16_t report_send(void)
+{
+    add_key(KC_A);
+    send_keyboard_report();
+    del_key(KC_A);
+    send_keyboard_report();
+    return 2;
+}
+
+static uint16_t scan(void)
+{
+    matrix_scan();
+    return 1;
+}
+
+
+static uint8_t null_leds(void) { return 0; }
+static void null_keyboard(report_keyboard_t *report) { (void)report; }
+static void null_mouse(report_mouse_t *report) { (void)report; }
+static void null_extra(uint16_t data) { (void)data; }
+static host_driver_t null_driver = {
+    null_leds, null_keyboard, null_mouse, null_extra, null_extra
+};
+
+
+static void bench(uint16_t (*f)(void))
+{
+    uint32_t ticks = 0;
+    uint32_t ops = 0;
+    f();    // warm up
+    for (uint8_t i = 0; i < MICROBENCH_RUNS; i++) {
+        latency_tick_t t = latency_ticks();
+        ops += f();
+        ticks += (latency_tick_t)(latency_ticks() - t);
+    }
+#ifdef CYCLES_PER_TICK
+    xprintf(" %lu\n", (unsigned long)(ticks * CYCLES_PER_TICK / ops));
+#else
+    xprintf(" %lu\n", (unsigned long)((uint64_t)ticks * 1000000000 / LATENCY_TICK_FREQ / ops));
+#endif
+}
+
+void microbench_run(void)
+{
+    if (has_anykey()) {
+        print("microbench: release keys\n");
+        return;
+    }
+
+#ifdef CYCLES_PER_TICK
+    print("\n\t- Microbench(cycles/op) -\n");
+#else
+    print("\n\t- Microbench(ns/op) -\n");
+#endif
+    print("action_for_key    "); bench(action_all_layers);
+    print("layer_for_key cold"); bench(layer_cold);
+    print("layer_for_key warm"); bench(layer_all_keys);
+
+#ifdef NKRO_ENABLE
+    bool nkro = keyboard_nkro;
+    keyboard_nkro = false;
+#endif
+    print("add/del_key 6KRO  "); bench(keys_add_del);
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol) {
+        keyboard_nkro = true;
+        clear_keys();
+        print("add/del_key NKRO  "); bench(keys_add_del);
+    }
+    keyboard_nkro = nkro;
+    clear_keys();
+#endif
+
+    if (!host_driver_pending()) {
+        host_driver_t *driver = host_get_driver();
+        host_set_driver(&null_driver);
+        print("send_report       "); bench(report_send);
+        host_set_driver(driver);
+    }
+
+#ifdef MATRIX_SCAN_ISR
+    keyboard_scan_isr_enable(false);
+#endif
+    print("matrix_scan       "); bench(scan);
+#ifdef MATRIX_SCAN_ISR
+    keyboard_scan_isr_enable(true);
+#endif
+}
@@ -0,0 +1,43 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+/* Microbenchmark of core paths, Magic+B
+ *
+ * Runs each path MICROBENCH_RUNS times on the device and prints average cost
+ * per operation, in CPU cycles where tick of latency_ticks() is a whole
+ * number of cycles(AVR Timer0, ChibiOS realtime counter) and in ns otherwise.
+ * Loop and interrupts in the meantime are included, resolution on AVR is
+ * prescaler of Timer0(64 cycles at 16MHz) per pass averaged over many ops.
+ *
+ *   action_for_key     every key on every active layer but KC_BOOTLOADER
+ *   layer_for_key      cold after layer_cache_clear() and warm from cache
+ *   add/del_key        six keys added and deleted, 6KRO and NKRO
+ *   send_report        send_keyboard_report() with null host driver
+ *   matrix_scan        whole scan
+ *
+ * Keys other than Magic modifiers have to be released, report and host
+ * driver are left as they were.
+ */
+#ifndef MICROBENCH_RUNS
+#define MICROBENCH_RUNS     16
+#endif
+
+void microbench_run(void);
+
+#endif
@@ -56,6 +56,26 @@ uint8_t mk_wheel_time_to_max = MOUSEKEY_WHEEL_TIME_TO_MAX;
 static uint16_t last_timer = 0;
 
 
+/*
+ * Acceleration in fixed point
+ *
+ * Fraction of steady speed(1/256) grows by step(8.8) each repeat. Step is
+ * computed when time_to_max is changed so that repeat needs no division.
+ */
+static uint8_t  move_time = 0;
+static uint16_t move_step;
+static uint8_t  wheel_time = 0;
+static uint16_t wheel_step;
+
+static uint16_t accel_unit(uint16_t max, uint16_t step)
+{
+    uint16_t frac = ((uint32_t)mousekey_repeat * step) >> 8;
+#if MOUSEKEY_CURVE == MOUSEKEY_CURVE_QUADRATIC
+    frac = (frac * frac) >> 8;
+#endif
+    return ((uint32_t)max * frac) >> 8;
+}
+
 static uint8_t move_unit(void)
 {
     uint16_t unit;
@@ -70,7 +90,11 @@ static uint8_t move_unit(void)
     } else if (mousekey_repeat >= mk_time_to_max) {
         unit = MOUSEKEY_MOVE_DELTA * mk_max_speed;
     } else {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed * mousekey_repeat) / mk_time_to_max;
+        if (move_time != mk_time_to_max) {
+            move_time = mk_time_to_max;
+            move_step = UINT16_MAX / move_time;
+        }
+        unit = accel_unit(MOUSEKEY_MOVE_DELTA * mk_max_speed, move_step);
     }
     return (unit > MOUSEKEY_MOVE_MAX ? MOUSEKEY_MOVE_MAX : (unit == 0 ? 1 : unit));
 }
@@ -89,19 +113,49 @@ static uint8_t wheel_unit(void)
     } else if (mousekey_repeat >= mk_wheel_time_to_max) {
         unit = MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed;
     } else {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed * mousekey_repeat) / mk_wheel_time_to_max;
+        if (wheel_time != mk_wheel_time_to_max) {
+            wheel_time = mk_wheel_time_to_max;
+            wheel_step = UINT16_MAX / wheel_time;
+        }
+        unit = accel_unit(MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed, wheel_step);
     }
     return (unit > MOUSEKEY_WHEEL_MAX ? MOUSEKEY_WHEEL_MAX : (unit == 0 ? 1 : unit));
 }
 
-void mousekey_task(void)
+#ifndef MOUSEKEY_ANALOG_XYVH
+/* without float, rounds toward zero */
+static int8_t diagonal(int8_t d)
 {
-    if (timer_elapsed(last_timer) < (mousekey_repeat ? mk_interval : mk_delay*10))
-        return;
+    return (d < 0) ? -(int8_t)(((uint16_t)-d * 181) >> 8) : (int8_t)(((uint16_t)d * 181) >> 8);
+}
+#endif
 
-    if (mouse_report.x == 0 && mouse_report.y == 0 && mouse_report.v == 0 && mouse_report.h == 0)
-        return;
+#ifdef MOUSEKEY_HIGH_RATE
+/*
+ * Motion of an interval is sent in pieces every millisecond, at the same
+ * speed as unit per mk_interval. Pieces are taken out of accumulators in
+ * 1/65536 units so that no motion is lost.
+ */
+static uint16_t frame_time;
+static uint8_t  frame_interval = 0;
+static uint16_t frame_step;
+static int32_t  frame_acc[4];
+
+static int8_t frame_piece(int32_t *acc, int8_t unit, uint8_t dt)
+{
+    if (!unit) {
+        *acc = 0;
+        return 0;
+    }
+    *acc += (int32_t)unit * dt * frame_step;
+    int8_t d = *acc / 65536;
+    *acc -= (int32_t)d * 65536;
+    return d;
+}
+#endif
 
+static void mousekey_accelerate(void)
+{
     if (mousekey_repeat != UINT8_MAX)
         mousekey_repeat++;
 
@@ -111,10 +165,10 @@ void mousekey_task(void)
     if (mouse_report.y > 0) mouse_report.y = move_unit();
     if (mouse_report.y < 0) mouse_report.y = move_unit() * -1;
 
-    /* diagonal move [1/sqrt(2) = 0.7] */
+    /* diagonal move [1/sqrt(2) = 181/256] */
     if (mouse_report.x && mouse_report.y) {
-        mouse_report.x *= 0.7;
-        mouse_report.y *= 0.7;
+        mouse_report.x = diagonal(mouse_report.x);
+        mouse_report.y = diagonal(mouse_report.y);
     }
 
     if (mouse_report.v > 0) mouse_report.v = wheel_unit();
@@ -122,8 +176,50 @@ void mousekey_task(void)
     if (mouse_report.h > 0) mouse_report.h = wheel_unit();
     if (mouse_report.h < 0) mouse_report.h = wheel_unit() * -1;
 #endif
+}
+
+void mousekey_task(void)
+{
+    if (mouse_report.x == 0 && mouse_report.y == 0 && mouse_report.v == 0 && mouse_report.h == 0)
+        return;
 
+#ifdef MOUSEKEY_HIGH_RATE
+    uint16_t now = timer_read();
+    if (now == frame_time) return;
+    uint16_t dt = TIMER_DIFF_16(now, frame_time);
+    frame_time = now;
+
+    // no motion until first repeat as normal mode
+    uint16_t elapsed = timer_elapsed(last_timer);
+    if (!mousekey_repeat && elapsed < mk_delay*10) return;
+    if (!mousekey_repeat || elapsed >= mk_interval) {
+        mousekey_accelerate();
+        mousekey_debug();
+        last_timer = now;
+    }
+
+    uint8_t interval = mk_interval ? mk_interval : 1;
+    if (frame_interval != interval) {
+        frame_interval = interval;
+        frame_step = UINT16_MAX / interval;
+    }
+    if (dt > interval) dt = interval;
+
+    report_mouse_t report = mouse_report;
+    report.x = frame_piece(&frame_acc[0], mouse_report.x, dt);
+    report.y = frame_piece(&frame_acc[1], mouse_report.y, dt);
+    report.v = frame_piece(&frame_acc[2], mouse_report.v, dt);
+    report.h = frame_piece(&frame_acc[3], mouse_report.h, dt);
+    if (report.x || report.y || report.v || report.h) {
+        host_mouse_send(&report);
+    }
+#else
+    if (timer_elapsed(last_timer) < (mousekey_repeat ? mk_interval : mk_delay*10))
+        return;
+
+    mousekey_accelerate();
     mousekey_send();
+#endif
 }
 
 #ifdef MOUSEKEY_ANALOG_XYVH
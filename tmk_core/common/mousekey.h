@@ -51,6 +51,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MOUSEKEY_WHEEL_TIME_TO_MAX 40
 #endif
 
+/* speed up to max: linear, or quadratic for fine move at start */
+#define MOUSEKEY_CURVE_LINEAR       0
+#define MOUSEKEY_CURVE_QUADRATIC    1
+#ifndef MOUSEKEY_CURVE
+#define MOUSEKEY_CURVE MOUSEKEY_CURVE_LINEAR
+#endif
+
+/* MOUSEKEY_HIGH_RATE: send motion every millisecond instead of a unit every
+ * MOUSEKEY_INTERVAL, speed is the same, unit * 1000 / interval per second. */
+
 
 #ifdef __cplusplus
 extern "C" {
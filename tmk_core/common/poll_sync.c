@@ -0,0 +1,171 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "print.h"
+#include "poll_sync.h"
+
+
+#define FRAME_US        1000
+/* longest period learnt from first two polls, bInterval of full speed HID
+ * is 32 at most in practice */
+#define PERIOD_MAX      32
+
+/* updated in USB interrupt */
+static volatile uint32_t sof_time = 0;      // timer_read_us() at last SOF
+static volatile uint16_t frame = 0;         // SOFs counted
+static volatile uint16_t poll_frame = 0;    // frame of last poll seen
+static volatile uint8_t period = 0;         // frames between polls, 0 until known
+static volatile uint16_t offset = 0;        // us from SOF to poll
+static volatile bool offset_timed = false;
+static volatile bool seen = false;
+
+/* main loop */
+static uint16_t work = 0;                   // us of scan and its events, decaying max
+static uint16_t scanned = 0;                // frame of poll last scanned for
+
+
+static uint8_t gcd(uint8_t a, uint16_t b)
+{
+    while (b) {
+        uint16_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+void poll_sync_reset(void)
+{
+    period = 0;
+    offset = 0;
+    offset_timed = false;
+    seen = false;
+}
+
+void poll_sync_sof(void)
+{
+    sof_time = timer_read_us();
+    frame++;
+}
+
+void poll_sync_in(bool timed)
+{
+    uint16_t f = frame;
+
+    if (timed) {
+        // earliest at once, later ones slowly as host may be early at times
+        uint32_t o = timer_elapsed_us(sof_time);
+        if (o < FRAME_US) {
+            if (!offset_timed || o < offset) {
+                offset = o;
+            } else {
+                offset += (o - offset) / 8;
+            }
+            offset_timed = true;
+        }
+    }
+
+    // polls far apart tell little and are more likely off by a lost SOF
+    if (seen) {
+        uint16_t d = f - poll_frame;
+        if (d && d <= UINT8_MAX) {
+            if (period) {
+                period = gcd(period, d);
+            } else if (d <= PERIOD_MAX) {
+                period = d;
+            }
+        }
+    }
+    poll_frame = f;
+    seen = true;
+}
+
+/* us until scan for next poll not scanned for yet, *pf is frame of the poll */
+static uint32_t scan_wait(uint16_t *pf)
+{
+    uint32_t st;
+    uint16_t fr, pl, off;
+    uint8_t p;
+
+    // frame changes in SOF interrupt after others are updated
+    do {
+        fr = frame;
+        st = sof_time;
+        pl = poll_frame;
+        off = offset;
+        p = period;
+    } while (fr != frame);
+
+    *pf = scanned;
+    if (!p) return 0;
+    uint32_t since = timer_elapsed_us(st);
+    if (since > POLL_SYNC_STALE) return 0;
+
+    // next poll frame and us to its poll from last SOF
+    uint16_t k = (uint16_t)(fr - pl) % p;
+    uint16_t f = fr + (k ? p - k : 0);
+    uint32_t t = (uint32_t)(uint16_t)(f - fr) * FRAME_US + off;
+    if (t <= since) {
+        f += p;
+        t += (uint32_t)p * FRAME_US;
+    }
+    if (f == scanned) {
+        f += p;
+        t += (uint32_t)p * FRAME_US;
+    }
+    *pf = f;
+
+    uint32_t left = t - since;
+    uint32_t lead = (uint32_t)work + POLL_SYNC_MARGIN;
+    return left > lead ? left - lead : 0;
+}
+
+bool poll_sync_due(void)
+{
+    uint16_t f;
+    if (scan_wait(&f)) return false;
+    scanned = f;
+    return true;
+}
+
+uint32_t poll_sync_wait_us(void)
+{
+    uint16_t f;
+    return scan_wait(&f);
+}
+
+void poll_sync_work(uint32_t us)
+{
+    if (us > UINT16_MAX) us = UINT16_MAX;
+    if (us > work) {
+        work = us;
+    } else {
+        work -= (work - us) / 16;
+    }
+}
+
+void poll_sync_print(void)
+{
+    if (!period) {
+        print("poll_sync: no poll\n");
+        return;
+    }
+    xprintf("poll_sync: period:%u offset:%u work:%u lead:%u\n",
+            period, offset, work, work + POLL_SYNC_MARGIN);
+}
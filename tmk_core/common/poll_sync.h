@@ -0,0 +1,75 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef POLL_SYNC_H
+#define POLL_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Scan aligned to host poll(POLL_SYNC_ENABLE, LUFA and ChibiOS), Magic+J
+ *
+ * Host takes keyboard report at an interrupt IN poll every bInterval frames,
+ * so a report made just after a poll waits nearly a whole period for the
+ * next one. Driver tells Start of Frame and reports taken by host, which
+ * gives period of polls in frames and time of poll from SOF; keyboard_task()
+ * then starts scan only when next poll is work time of last scans plus
+ * POLL_SYNC_MARGIN(us) away, once per poll, and returns at once otherwise:
+ *
+ *     poll_sync: period:8 offset:120 work:310 lead:410
+ *
+ * Period is greatest common divisor of frames between polls seen, offset
+ * is earliest time of report taken from SOF and follows later ones slowly.
+ * LUFA has no IN complete interrupt and finds report taken at next SOF, it
+ * knows frame of poll and takes offset 0; ChibiOS has both from IN callback.
+ * Polls are seen only while reports are sent, counting SOFs keeps phase
+ * between them. Until a poll is seen, and without SOF for POLL_SYNC_STALE
+ * (us, suspend), every call scans as usual.
+ */
+#ifndef POLL_SYNC_MARGIN
+#define POLL_SYNC_MARGIN    100
+#endif
+#ifndef POLL_SYNC_STALE
+#define POLL_SYNC_STALE     3000
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bus reset and configuration, polls learnt again */
+void poll_sync_reset(void);
+/* Start of Frame, from interrupt */
+void poll_sync_sof(void);
+/* keyboard report taken by host in current frame, from interrupt;
+ * timed when called at the time of poll, otherwise before poll_sync_sof() of
+ * next frame */
+void poll_sync_in(bool timed);
+/* whether keyboard_task() scans now */
+bool poll_sync_due(void);
+/* us until scan is due, 0 when it is due or polls are not known */
+uint32_t poll_sync_wait_us(void);
+/* us from start of scan to end of its events */
+void poll_sync_work(uint32_t us);
+void poll_sync_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include "print.h"
+#include "profile.h"
+
+
+static volatile uint16_t histogram[PROFILE_BUCKETS];
+static volatile uint32_t samples = 0;
+static volatile uint32_t out = 0;
+
+
+void profile_sample(uint32_t addr)
+{
+    samples++;
+    uint32_t i = (addr - PROFILE_BASE) >> PROFILE_SHIFT;
+    if (addr < PROFILE_BASE || i >= PROFILE_BUCKETS) {
+        out++;
+        return;
+    }
+    if (histogram[i] != UINT16_MAX) histogram[i]++;
+}
+
+/* bucket lines "address count" are read by tool/profile/profile.awk */
+void profile_print(void)
+{
+#ifndef NO_PRINT
+    xprintf("\n\t- Profile(%ums) -\n", PROFILE_INTERVAL);
+    xprintf("profile: %lu samples %lu out shift %u\n",
+            (unsigned long)samples, (unsigned long)out, PROFILE_SHIFT);
+    for (uint16_t i = 0; i < PROFILE_BUCKETS; i++) {
+        if (!histogram[i]) continue;
+        xprintf("%08lX %u\n", (unsigned long)PROFILE_BASE + ((uint32_t)i << PROFILE_SHIFT), histogram[i]);
+    }
+#endif
+}
+
+void profile_clear(void)
+{
+    for (uint16_t i = 0; i < PROFILE_BUCKETS; i++) histogram[i] = 0;
+    samples = 0;
+    out = 0;
+}
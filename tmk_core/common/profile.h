@@ -0,0 +1,73 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+
+/* Sampling profiler(PROFILE_ENABLE), Magic+P
+ *
+ * Timer interrupt takes address of code it interrupted every PROFILE_INTERVAL
+ * ms and counts it in a histogram of PROFILE_BUCKETS buckets, each covers
+ * 2^PROFILE_SHIFT bytes of flash from PROFILE_BASE. Magic+P prints it and
+ * clears; tool/profile/profile.awk sums buckets into functions of the ELF
+ * symbol table. Counts stop at 65535 and samples out of range are counted
+ * apart.
+ *
+ * AVR:     Timer0 compare B in middle of the 1ms tick, reads return address
+ *          off the stack; 1kHz at most without a timer of its own. Default
+ *          histogram of 256 bytes in RAM covers 32KB.
+ * ChibiOS: virtual timer, reads PC from exception frame of the thread on
+ *          PSP, code of other interrupts is counted as the thread it broke.
+ *
+ *     $ avr-nm -n keyboard.elf | awk -f profile.awk - console.log
+ */
+#ifndef PROFILE_INTERVAL
+#define PROFILE_INTERVAL    1
+#endif
+
+#if defined(__AVR__)
+#   ifndef PROFILE_BASE
+#   define PROFILE_BASE     0
+#   endif
+#   ifndef PROFILE_SHIFT
+#   define PROFILE_SHIFT    8
+#   endif
+#   ifndef PROFILE_BUCKETS
+#   define PROFILE_BUCKETS  128
+#   endif
+#else
+#   ifndef PROFILE_BASE
+#   define PROFILE_BASE     0x08000000
+#   endif
+#   ifndef PROFILE_SHIFT
+#   define PROFILE_SHIFT    6
+#   endif
+#   ifndef PROFILE_BUCKETS
+#   define PROFILE_BUCKETS  1024
+#   endif
+#endif
+
+
+void profile_init(void);
+/* byte address of interrupted code, from timer interrupt */
+void profile_sample(uint32_t addr);
+void profile_print(void);
+void profile_clear(void);
+
+#endif
@@ -3,10 +3,11 @@
 
 #if defined(__AVR__)
 #   include <avr/pgmspace.h>
-#elif defined(__arm__)
+#elif defined(__arm__) || defined(PROTOCOL_NATIVE)
 #   define PROGMEM
 #   define pgm_read_byte(p)     *((unsigned char*)p)
 #   define pgm_read_word(p)     *((uint16_t*)p)
+#   define pgm_read_dword(p)    *((uint32_t*)p)
 #endif
 
 #endif
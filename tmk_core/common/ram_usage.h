@@ -0,0 +1,42 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RAM_USAGE_H
+#define RAM_USAGE_H
+
+#include <stdint.h>
+
+
+/* RAM usage(AVR), Magic+U
+ *
+ * RAM between end of static data(.data and .bss) and top of stack is painted
+ * with a pattern before startup code sets up stack, bytes stack has ever
+ * written since then lose it. Lowest byte lost from top is high-water mark
+ * of stack, with malloc heap grows into the same gap and counts as used.
+ * Overflow of stack into static data is not seen as error on AVR but shows
+ * here as no free RAM left.
+ *
+ * Static RAM of each object comes from map file after build:
+ *     make ram
+ */
+/* bytes of stack used at the most since reset */
+uint16_t ram_usage_stack_max(void);
+/* bytes between static data and stack never touched */
+uint16_t ram_usage_free_min(void);
+void ram_usage_print(void);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef RAMFUNC_H
+#define RAMFUNC_H 1
+
+/*
+ * Code in RAM(RAMFUNC_ENABLE)
+ *
+ * Functions marked RAMFUNC are put in section .ramtext which linker script
+ * places in .data, startup code copies it from flash with initialized data.
+ * Code runs from RAM without flash wait states, ld inserts long branch
+ * veneers for calls between flash and RAM. Callees not marked stay in flash.
+ * Only on ARM, without RAMFUNC_ENABLE or on AVR it is nothing.
+ */
+#if defined(__arm__) && defined(RAMFUNC_ENABLE)
+#   define RAMFUNC  __attribute__ ((section (".ramtext"), noinline))
+#else
+#   define RAMFUNC
+#endif
+
+#endif
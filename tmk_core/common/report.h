@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define REPORT_ID_MOUSE     1
 #define REPORT_ID_SYSTEM    2
 #define REPORT_ID_CONSUMER  3
+#define REPORT_ID_NKRO      4   /* V-USB takes 4-6 for segments of bitmap */
 
 /* mouse buttons */
 #define MOUSE_BTN1 (1<<0)
@@ -79,6 +80,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   define KEYBOARD_REPORT_KEYS (KBD2_SIZE - 2)
 #   define KEYBOARD_REPORT_BITS (KBD2_SIZE - 1)
 
+#elif defined(PROTOCOL_LUFA) && defined(NKRO_ENABLE) && defined(NKRO_HYBRID)
+    /* boot report with six keys and bitmap after it */
+#   include "protocol/lufa/descriptor.h"
+#   define KEYBOARD_REPORT_SIZE NKRO_EPSIZE
+#   define KEYBOARD_REPORT_KEYS (KEYBOARD_EPSIZE - 2)
+#   define KEYBOARD_REPORT_BITS (NKRO_EPSIZE - KEYBOARD_EPSIZE)
 #elif defined(PROTOCOL_LUFA) && defined(NKRO_ENABLE)
 #   include "protocol/lufa/descriptor.h"
 #   define KEYBOARD_REPORT_SIZE NKRO_EPSIZE
@@ -89,6 +96,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   define KEYBOARD_REPORT_SIZE NKRO_EPSIZE
 #   define KEYBOARD_REPORT_KEYS (NKRO_EPSIZE - 2)
 #   define KEYBOARD_REPORT_BITS (NKRO_EPSIZE - 1)
+#elif defined(PROTOCOL_VUSB) && defined(NKRO_ENABLE)
+    /* boot report is first 8 bytes, bitmap goes in 7-byte segments of
+     * report IDs from REPORT_ID_NKRO on endpoint 3, see protocol/vusb/vusb.c */
+#   define KEYBOARD_REPORT_SIZE 21
+#   define KEYBOARD_REPORT_KEYS 6
+#   define KEYBOARD_REPORT_BITS (21 - 1)
+#elif defined(__MBED__) && defined(NKRO_ENABLE)
+    /* sent after report ID on shared endpoint, see protocol/mbed/HIDKeyboard.h */
+#   define KEYBOARD_REPORT_SIZE 16
+#   define KEYBOARD_REPORT_KEYS (16 - 2)
+#   define KEYBOARD_REPORT_BITS (16 - 1)
 
 #else
 #   define KEYBOARD_REPORT_SIZE 8
@@ -113,6 +131,12 @@ extern "C" {
  * -----+--------+--------+--------+--------+--------+--------+--------+--------     +--------
  * desc |mods    |bits[0] |bits[1] |bits[2] |bits[3] |bits[4] |bits[5] |bits[6]  ... |bit[14]
  *
+ * With NKRO_HYBRID both are in one report, bitmap follows 8 bytes of boot report.
+ *
+ * byte |0       |1       |2       ... |7       |8       ... |31
+ * -----+--------+--------+--------     +--------+--------     +--------
+ * desc |mods    |reserved|keys[0] ... |keys[5] |bits[0] ... |bits[23]
+ *
  * mods retains state of 8 modifiers.
  *
  *  bit |0       |1       |2       |3       |4       |5       |6       |7
@@ -130,6 +154,9 @@ typedef union {
 #ifdef NKRO_ENABLE
     struct {
         uint8_t mods;
+#ifdef NKRO_HYBRID
+        uint8_t boot[KEYBOARD_REPORT_SIZE - KEYBOARD_REPORT_BITS - 1];
+#endif
         uint8_t bits[KEYBOARD_REPORT_BITS];
     } nkro;
 #endif
@@ -150,6 +177,21 @@ typedef struct {
     int8_t h;
 } __attribute__ ((packed)) report_mouse_t;
 
+/* Consumer usages held at once, array of usages without report id. With 1
+ * report is same as report_extra_t of drivers, more than that needs driver
+ * with send_consumer_report(). Report id and usages fit in 8-byte endpoint.
+ */
+#ifndef CONSUMER_USAGES
+#define CONSUMER_USAGES 1
+#endif
+#if CONSUMER_USAGES < 1 || CONSUMER_USAGES > 3
+#   error "CONSUMER_USAGES must be 1-3"
+#endif
+
+typedef struct {
+    uint16_t usage[CONSUMER_USAGES];
+} __attribute__ ((packed)) report_consumer_t;
+
 
 /* keycode to system usage */
 #define KEYCODE2SYSTEM(key) \
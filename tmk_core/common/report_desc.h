@@ -0,0 +1,295 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REPORT_DESC_H
+#define REPORT_DESC_H
+
+#include "report.h"
+
+
+/*
+ * HID report descriptors shared by USB protocol drivers
+ *
+ * Each macro expands to a byte list of report items which matches one of
+ * report structures in report.h. A driver puts them into its own array
+ * and storage(PROGMEM, flash or RAM) and numbers interfaces and endpoints
+ * by itself:
+ *
+ *     static const uint8_t PROGMEM keyboard_report_desc[] = {
+ *         HID_DESC_KEYBOARD(KEYBOARD_REPORT_KEYS)
+ *     };
+ *
+ * See "Device Class Definition for Human Interface Devices (HID)"
+ * (http://www.usb.org/developers/hidpage/HID1_11.pdf) for the items.
+ */
+
+
+/* Keyboard Protocol 1, HID 1.11 spec, Appendix B, page 59-60
+ * report_keyboard_t in boot protocol: modifiers, reserved and <keys> keycodes
+ */
+#define HID_DESC_KEYBOARD(keys) \
+    0x05, 0x01,          /* Usage Page (Generic Desktop), */ \
+    0x09, 0x06,          /* Usage (Keyboard), */ \
+    0xA1, 0x01,          /* Collection (Application), */ \
+    0x75, 0x01,          /*   Report Size (1), */ \
+    0x95, 0x08,          /*   Report Count (8), */ \
+    0x05, 0x07,          /*   Usage Page (Key Codes), */ \
+    0x19, 0xE0,          /*   Usage Minimum (224), */ \
+    0x29, 0xE7,          /*   Usage Maximum (231), */ \
+    0x15, 0x00,          /*   Logical Minimum (0), */ \
+    0x25, 0x01,          /*   Logical Maximum (1), */ \
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), ;Modifier byte */ \
+    0x95, 0x01,          /*   Report Count (1), */ \
+    0x75, 0x08,          /*   Report Size (8), */ \
+    0x81, 0x03,          /*   Input (Constant),                 ;Reserved byte */ \
+    HID_DESC_KEYBOARD_LED \
+    0x95, (keys),        /*   Report Count (), */ \
+    0x75, 0x08,          /*   Report Size (8), */ \
+    0x15, 0x00,          /*   Logical Minimum (0), */ \
+    0x26, 0xFF, 0x00,    /*   Logical Maximum(255), */ \
+    0x05, 0x07,          /*   Usage Page (Key Codes), */ \
+    0x19, 0x00,          /*   Usage Minimum (0), */ \
+    0x29, 0xFF,          /*   Usage Maximum (255), */ \
+    0x81, 0x00,          /*   Input (Data, Array), */ \
+    0xC0                 /* End Collection */
+
+/* NKRO: modifiers and bitmap of <bytes>*8 keys(from usage 0)
+ * report_keyboard_t with nkro.bits
+ *
+ * HID_DESC_NKRO is for a dedicated interface, HID_DESC_NKRO_ID for an
+ * interface shared with other reports.
+ */
+#define HID_DESC_NKRO(bytes) \
+    0x05, 0x01,          /* Usage Page (Generic Desktop), */ \
+    0x09, 0x06,          /* Usage (Keyboard), */ \
+    0xA1, 0x01,          /* Collection (Application), */ \
+    HID_DESC_NKRO_KEYS(bytes)
+
+#define HID_DESC_NKRO_ID(id, bytes) \
+    0x05, 0x01,          /* Usage Page (Generic Desktop), */ \
+    0x09, 0x06,          /* Usage (Keyboard), */ \
+    0xA1, 0x01,          /* Collection (Application), */ \
+    0x85, (id),          /*   Report ID, */ \
+    HID_DESC_NKRO_KEYS(bytes)
+
+#define HID_DESC_NKRO_KEYS(bytes) \
+    0x75, 0x01,          /*   Report Size (1), */ \
+    0x95, 0x08,          /*   Report Count (8), */ \
+    0x05, 0x07,          /*   Usage Page (Key Codes), */ \
+    0x19, 0xE0,          /*   Usage Minimum (224), */ \
+    0x29, 0xE7,          /*   Usage Maximum (231), */ \
+    0x15, 0x00,          /*   Logical Minimum (0), */ \
+    0x25, 0x01,          /*   Logical Maximum (1), */ \
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), ;Modifier byte */ \
+    HID_DESC_KEYBOARD_LED \
+    0x95, (bytes)*8,     /*   Report Count (), */ \
+    0x75, 0x01,          /*   Report Size (1), */ \
+    0x15, 0x00,          /*   Logical Minimum (0), */ \
+    0x25, 0x01,          /*   Logical Maximum(1), */ \
+    0x05, 0x07,          /*   Usage Page (Key Codes), */ \
+    0x19, 0x00,          /*   Usage Minimum (0), */ \
+    0x29, (bytes)*8-1,   /*   Usage Maximum (), */ \
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), */ \
+    0xC0                 /* End Collection */
+
+/* NKRO after boot report(NKRO_HYBRID): modifiers, <pad> bytes of reserved and
+ * keys of boot protocol which are constant for host, and bitmap of <bytes>*8
+ * keys. report_keyboard_t with both keys and nkro.bits, boot protocol host
+ * reads only first 8 bytes.
+ */
+#define HID_DESC_NKRO_HYBRID(pad, bytes) \
+    0x05, 0x01,          /* Usage Page (Generic Desktop), */ \
+    0x09, 0x06,          /* Usage (Keyboard), */ \
+    0xA1, 0x01,          /* Collection (Application), */ \
+    0x75, 0x01,          /*   Report Size (1), */ \
+    0x95, 0x08,          /*   Report Count (8), */ \
+    0x05, 0x07,          /*   Usage Page (Key Codes), */ \
+    0x19, 0xE0,          /*   Usage Minimum (224), */ \
+    0x29, 0xE7,          /*   Usage Maximum (231), */ \
+    0x15, 0x00,          /*   Logical Minimum (0), */ \
+    0x25, 0x01,          /*   Logical Maximum (1), */ \
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), ;Modifier byte */ \
+    0x95, (pad),         /*   Report Count (), */ \
+    0x75, 0x08,          /*   Report Size (8), */ \
+    0x81, 0x03,          /*   Input (Constant),                 ;Boot report */ \
+    HID_DESC_KEYBOARD_LED \
+    0x95, (bytes)*8,     /*   Report Count (), */ \
+    0x75, 0x01,          /*   Report Size (1), */ \
+    0x15, 0x00,          /*   Logical Minimum (0), */ \
+    0x25, 0x01,          /*   Logical Maximum(1), */ \
+    0x05, 0x07,          /*   Usage Page (Key Codes), */ \
+    0x19, 0x00,          /*   Usage Minimum (0), */ \
+    0x29, (bytes)*8-1,   /*   Usage Maximum (), */ \
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), */ \
+    0xC0                 /* End Collection */
+
+/* LED output report: 5 bits and padding */
+#define HID_DESC_KEYBOARD_LED \
+    0x95, 0x05,          /*   Report Count (5), */ \
+    0x75, 0x01,          /*   Report Size (1), */ \
+    0x05, 0x08,          /*   Usage Page (LEDs), */ \
+    0x19, 0x01,          /*   Usage Minimum (1), */ \
+    0x29, 0x05,          /*   Usage Maximum (5), */ \
+    0x91, 0x02,          /*   Output (Data, Variable, Absolute), ;LED report */ \
+    0x95, 0x01,          /*   Report Count (1), */ \
+    0x75, 0x03,          /*   Report Size (3), */ \
+    0x91, 0x03,          /*   Output (Constant),                 ;LED report padding */
+
+
+/* Mouse Protocol 1, HID 1.11 spec, Appendix B, page 59-60, with wheel extension
+ * http://www.microchip.com/forums/tm.aspx?high=&m=391435&mpage=1#391521
+ * http://www.keil.com/forum/15671/
+ * http://www.microsoft.com/whdc/device/input/wheel.mspx
+ * report_mouse_t: buttons, x, y, v and h
+ *
+ * HID_DESC_MOUSE is for a dedicated interface, HID_DESC_MOUSE_ID for an
+ * interface shared with other reports.
+ */
+#define HID_DESC_MOUSE \
+    0x05, 0x01,          /* USAGE_PAGE (Generic Desktop) */ \
+    0x09, 0x02,          /* USAGE (Mouse) */ \
+    0xA1, 0x01,          /* COLLECTION (Application) */ \
+    HID_DESC_MOUSE_POINTER
+
+#define HID_DESC_MOUSE_ID(id) \
+    0x05, 0x01,          /* USAGE_PAGE (Generic Desktop) */ \
+    0x09, 0x02,          /* USAGE (Mouse) */ \
+    0xA1, 0x01,          /* COLLECTION (Application) */ \
+    0x85, (id),          /*   REPORT_ID */ \
+    HID_DESC_MOUSE_POINTER
+
+#define HID_DESC_MOUSE_POINTER \
+    0x09, 0x01,          /*   USAGE (Pointer) */ \
+    0xA1, 0x00,          /*   COLLECTION (Physical) */ \
+                         /* ----------------------------  Buttons */ \
+    0x05, 0x09,          /*     USAGE_PAGE (Button) */ \
+    0x19, 0x01,          /*     USAGE_MINIMUM (Button 1) */ \
+    0x29, 0x05,          /*     USAGE_MAXIMUM (Button 5) */ \
+    0x15, 0x00,          /*     LOGICAL_MINIMUM (0) */ \
+    0x25, 0x01,          /*     LOGICAL_MAXIMUM (1) */ \
+    0x75, 0x01,          /*     REPORT_SIZE (1) */ \
+    0x95, 0x05,          /*     REPORT_COUNT (5) */ \
+    0x81, 0x02,          /*     INPUT (Data,Var,Abs) */ \
+    0x75, 0x03,          /*     REPORT_SIZE (3) */ \
+    0x95, 0x01,          /*     REPORT_COUNT (1) */ \
+    0x81, 0x03,          /*     INPUT (Cnst,Var,Abs) */ \
+                         /* ----------------------------  X,Y position */ \
+    0x05, 0x01,          /*     USAGE_PAGE (Generic Desktop) */ \
+    0x09, 0x30,          /*     USAGE (X) */ \
+    0x09, 0x31,          /*     USAGE (Y) */ \
+    0x15, 0x81,          /*     LOGICAL_MINIMUM (-127) */ \
+    0x25, 0x7F,          /*     LOGICAL_MAXIMUM (127) */ \
+    0x75, 0x08,          /*     REPORT_SIZE (8) */ \
+    0x95, 0x02,          /*     REPORT_COUNT (2) */ \
+    0x81, 0x06,          /*     INPUT (Data,Var,Rel) */ \
+                         /* ----------------------------  Vertical wheel */ \
+    0x09, 0x38,          /*     USAGE (Wheel) */ \
+    0x15, 0x81,          /*     LOGICAL_MINIMUM (-127) */ \
+    0x25, 0x7F,          /*     LOGICAL_MAXIMUM (127) */ \
+    0x35, 0x00,          /*     PHYSICAL_MINIMUM (0)        - reset physical */ \
+    0x45, 0x00,          /*     PHYSICAL_MAXIMUM (0) */ \
+    0x75, 0x08,          /*     REPORT_SIZE (8) */ \
+    0x95, 0x01,          /*     REPORT_COUNT (1) */ \
+    0x81, 0x06,          /*     INPUT (Data,Var,Rel) */ \
+                         /* ----------------------------  Horizontal wheel */ \
+    0x05, 0x0C,          /*     USAGE_PAGE (Consumer Devices) */ \
+    0x0A, 0x38, 0x02,    /*     USAGE (AC Pan) */ \
+    0x15, 0x81,          /*     LOGICAL_MINIMUM (-127) */ \
+    0x25, 0x7F,          /*     LOGICAL_MAXIMUM (127) */ \
+    0x75, 0x08,          /*     REPORT_SIZE (8) */ \
+    0x95, 0x01,          /*     REPORT_COUNT (1) */ \
+    0x81, 0x06,          /*     INPUT (Data,Var,Rel) */ \
+    0xC0,                /*   END_COLLECTION */ \
+    0xC0                 /* END_COLLECTION */
+
+
+/* audio controls & system controls
+ * http://www.microsoft.com/whdc/archive/w2kbd.mspx
+ * report_extra_t: report id and 16bit usage
+ */
+#define HID_DESC_SYSTEM(id) \
+    0x05, 0x01,          /* USAGE_PAGE (Generic Desktop) */ \
+    0x09, 0x80,          /* USAGE (System Control) */ \
+    0xA1, 0x01,          /* COLLECTION (Application) */ \
+    0x85, (id),          /*   REPORT_ID */ \
+    0x15, 0x01,          /*   LOGICAL_MINIMUM (0x1) */ \
+    0x26, 0xB7, 0x00,    /*   LOGICAL_MAXIMUM (0xb7) */ \
+    0x19, 0x01,          /*   USAGE_MINIMUM (0x1) */ \
+    0x29, 0xB7,          /*   USAGE_MAXIMUM (0xb7) */ \
+    0x75, 0x10,          /*   REPORT_SIZE (16) */ \
+    0x95, 0x01,          /*   REPORT_COUNT (1) */ \
+    0x81, 0x00,          /*   INPUT (Data,Array,Abs) */ \
+    0xC0                 /* END_COLLECTION */
+
+/* n usages at once, report is id and usages(report_consumer_t) */
+#define HID_DESC_CONSUMER_N(id, n) \
+    0x05, 0x0C,          /* USAGE_PAGE (Consumer Devices) */ \
+    0x09, 0x01,          /* USAGE (Consumer Control) */ \
+    0xA1, 0x01,          /* COLLECTION (Application) */ \
+    0x85, (id),          /*   REPORT_ID */ \
+    0x15, 0x01,          /*   LOGICAL_MINIMUM (0x1) */ \
+    0x26, 0x9C, 0x02,    /*   LOGICAL_MAXIMUM (0x29c) */ \
+    0x19, 0x01,          /*   USAGE_MINIMUM (0x1) */ \
+    0x2A, 0x9C, 0x02,    /*   USAGE_MAXIMUM (0x29c) */ \
+    0x75, 0x10,          /*   REPORT_SIZE (16) */ \
+    0x95, (n),           /*   REPORT_COUNT (n) */ \
+    0x81, 0x00,          /*   INPUT (Data,Array,Abs) */ \
+    0xC0                 /* END_COLLECTION */
+
+#define HID_DESC_CONSUMER(id) HID_DESC_CONSUMER_N(id, 1)
+
+#define HID_DESC_EXTRAKEY_N(n) \
+    HID_DESC_SYSTEM(REPORT_ID_SYSTEM), \
+    HID_DESC_CONSUMER_N(REPORT_ID_CONSUMER, n)
+#define HID_DESC_EXTRAKEY HID_DESC_EXTRAKEY_N(1)
+
+
+/* Console: vendor page compatible with PJRC hid_listen
+ * HID_DESC_CONSOLE has only input report of <size> bytes,
+ * HID_DESC_CONSOLE_INOUT also has output report of same size.
+ */
+#define HID_DESC_CONSOLE(size) \
+    0x06, 0x31, 0xFF,    /* Usage Page 0xFF31 (vendor defined) */ \
+    0x09, 0x74,          /* Usage 0x74 */ \
+    0xA1, 0x53,          /* Collection 0x53 */ \
+    0x75, 0x08,          /*   report size = 8 bits */ \
+    0x15, 0x00,          /*   logical minimum = 0 */ \
+    0x26, 0xFF, 0x00,    /*   logical maximum = 255 */ \
+    0x95, (size),        /*   report count */ \
+    0x09, 0x75,          /*   usage */ \
+    0x81, 0x02,          /*   Input (array) */ \
+    0xC0                 /* end collection */
+
+#define HID_DESC_CONSOLE_INOUT(size) \
+    0x06, 0x31, 0xFF,    /* Usage Page 0xFF31 (vendor defined) */ \
+    0x09, 0x74,          /* Usage 0x74 */ \
+    0xA1, 0x01,          /* Collection (Application) */ \
+    0x09, 0x75,          /*   Usage 0x75 */ \
+    0x15, 0x00,          /*   logical minimum = 0 */ \
+    0x26, 0xFF, 0x00,    /*   logical maximum = 255 */ \
+    0x95, (size),        /*   report count */ \
+    0x75, 0x08,          /*   report size = 8 bits */ \
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute) */ \
+    0x09, 0x76,          /*   Usage 0x76 */ \
+    0x15, 0x00,          /*   logical minimum = 0 */ \
+    0x26, 0xFF, 0x00,    /*   logical maximum = 255 */ \
+    0x95, (size),        /*   report count */ \
+    0x75, 0x08,          /*   report size = 8 bits */ \
+    0x91, 0x82,          /*   Output (Data, Variable, Absolute, Non-volatile) */ \
+    0xC0                 /* end collection */
+
+#endif
@@ -0,0 +1,130 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Single-producer/single-consumer queue
+ *
+ * Producer is an ISR and consumer is main loop(or the other way around). Only
+ * producer writes head and only consumer writes tail, indices are 8-bit so
+ * that loads and stores of them are atomic and no interrupt masking is needed.
+ * Size must be power of two up to 256, one slot is kept empty to tell full
+ * from empty. Enqueue on full queue drops data and counts it in overflow.
+ *
+ *     SPSC_QUEUE(pbuf, uint8_t, 32)
+ *
+ * defines static pbuf_enqueue(), pbuf_dequeue(), pbuf_has_data(),
+ * pbuf_count(), pbuf_clear() and pbuf_overflow counter in the file.
+ */
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "telemetry.h"
+#include "input_trace.h"
+
+
+#define SPSC_QUEUE(name, type, size)                                        \
+typedef char name##_size_check[((size) >= 2 && (size) <= 256 &&            \
+                                !((size) & ((size) - 1))) ? 1 : -1];        \
+static volatile type name##_buf[size];                                      \
+static volatile uint8_t name##_head = 0;                                    \
+static volatile uint8_t name##_tail = 0;                                    \
+static volatile uint8_t name##_overflow = 0;                                \
+                                                                            \
+/* producer */                                                              \
+static inline bool name##_enqueue(type data)                                \
+{                                                                           \
+    uint8_t head = name##_head;                                             \
+    uint8_t next = (head + 1) & ((size) - 1);                               \
+    if (next == name##_tail) {                                              \
+        if (name##_overflow != UINT8_MAX) name##_overflow++;                \
+        return false;                                                       \
+    }                                                                       \
+    name##_buf[head] = data;                                                \
+    name##_head = next;                                                     \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+/* consumer: returns 0 when empty */                                        \
+static inline type name##_dequeue(void)                                     \
+{                                                                           \
+    uint8_t tail = name##_tail;                                             \
+    if (tail == name##_head) return 0;                                      \
+    type data = name##_buf[tail];                                           \
+    name##_tail = (tail + 1) & ((size) - 1);                                \
+    return data;                                                            \
+}                                                                           \
+                                                                            \
+static inline bool name##_has_data(void)                                    \
+{                                                                           \
+    return name##_head != name##_tail;                                      \
+}                                                                           \
+                                                                            \
+static inline uint8_t name##_count(void)                                    \
+{                                                                           \
+    return (name##_head - name##_tail) & ((size) - 1);                      \
+}                                                                           \
+                                                                            \
+/* consumer: drops queued data */                                           \
+static inline void name##_clear(void)                                       \
+{                                                                           \
+    name##_tail = name##_head;                                              \
+}
+
+
+/*
+ * Queue which keeps time(timer_read()) of enqueue with each entry, for
+ * receivers of key events so that time of a key is not when main loop got
+ * around to it. Same functions as above, name##_dequeue() leaves time of the
+ * entry in name##_time. Losses and peak depth of these queues are counted in
+ * telemetry as RX, entries dequeued are recorded by input trace.
+ *
+ *     SPSC_STAMPED_QUEUE(pbuf, uint8_t, 32)
+ */
+#define SPSC_STAMPED_QUEUE(name, type, size)                                \
+SPSC_QUEUE(name##_q, type, size)                                            \
+static volatile uint16_t name##_stamp[size];                                \
+static uint16_t name##_time = 0;                                            \
+                                                                            \
+/* producer: time goes into free slot before head publishes it */          \
+static inline bool name##_enqueue(type data)                                \
+{                                                                           \
+    name##_stamp[name##_q_head] = timer_read();                             \
+    if (!name##_q_enqueue(data)) {                                          \
+        TELEMETRY_COUNT(TELEMETRY_RX_LOST);                                 \
+        return false;                                                       \
+    }                                                                       \
+    TELEMETRY_PEAK_SET(TELEMETRY_RX_PEAK, name##_q_count());                \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline type name##_dequeue(void)                                     \
+{                                                                           \
+    if (!name##_q_has_data()) return 0;                                     \
+    name##_time = name##_stamp[name##_q_tail];                              \
+    type data = name##_q_dequeue();                                         \
+    INPUT_TRACE_BYTE(data, name##_time);                                    \
+    return data;                                                            \
+}                                                                           \
+                                                                            \
+static inline bool name##_has_data(void) { return name##_q_has_data(); }    \
+static inline uint8_t name##_count(void) { return name##_q_count(); }       \
+static inline void name##_clear(void) { name##_q_clear(); }
+
+#endif
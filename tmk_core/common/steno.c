@@ -0,0 +1,132 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "action_layer.h"
+#include "host.h"
+#include "steno.h"
+
+#ifdef DEBUG_ACTION
+#include "debug.h"
+#else
+#include "nodebug.h"
+#endif
+
+
+#define KEY_BIT(key)        ((matrix_row_t)1 << (key).col)
+
+/* GeminiPR: first byte has bit7 set, 7 keys in each byte from bit6 */
+#define GEMINI_BYTE(k)      (((k) - 1) / 7)
+#define GEMINI_BIT(k)       (0x40 >> (((k) - 1) % 7))
+
+/* TX Bolt: group in bit7-6 and 6 keys of group, 0 is no key */
+#define BOLT(group, bit)    ((group) << 6 | (bit))
+#define BOLT_NUM            BOLT(3, 0x10)
+static const uint8_t bolt_keys[] PROGMEM = {
+    [STN_N1] = BOLT_NUM, [STN_N2] = BOLT_NUM, [STN_N3] = BOLT_NUM,
+    [STN_N4] = BOLT_NUM, [STN_N5] = BOLT_NUM, [STN_N6] = BOLT_NUM,
+    [STN_S1] = BOLT(0, 0x01), [STN_S2] = BOLT(0, 0x01),
+    [STN_TL] = BOLT(0, 0x02), [STN_KL] = BOLT(0, 0x04), [STN_PL] = BOLT(0, 0x08),
+    [STN_WL] = BOLT(0, 0x10), [STN_HL] = BOLT(0, 0x20),
+    [STN_RL] = BOLT(1, 0x01), [STN_A]  = BOLT(1, 0x02), [STN_O]  = BOLT(1, 0x04),
+    [STN_ST1] = BOLT(1, 0x08), [STN_ST2] = BOLT(1, 0x08),
+    [STN_ST3] = BOLT(1, 0x08), [STN_ST4] = BOLT(1, 0x08),
+    [STN_E]  = BOLT(1, 0x10), [STN_U]  = BOLT(1, 0x20),
+    [STN_FR] = BOLT(2, 0x01), [STN_RR] = BOLT(2, 0x02), [STN_PR] = BOLT(2, 0x04),
+    [STN_BR] = BOLT(2, 0x08), [STN_LR] = BOLT(2, 0x10), [STN_GR] = BOLT(2, 0x20),
+    [STN_TR] = BOLT(3, 0x01), [STN_SR] = BOLT(3, 0x02), [STN_DR] = BOLT(3, 0x04),
+    [STN_ZR] = BOLT(3, 0x08),
+    [STN_N7] = BOLT_NUM, [STN_N8] = BOLT_NUM, [STN_N9] = BOLT_NUM,
+    [STN_NA] = BOLT_NUM, [STN_NB] = BOLT_NUM, [STN_NC] = BOLT_NUM,
+};
+
+static steno_mode_t mode = STENO_MODE;
+
+/* chord as GeminiPR bits and steno keys still held */
+static uint8_t chord[STENO_PACKET_SIZE];
+static matrix_row_t down[MATRIX_ROWS];
+static uint8_t down_count = 0;
+
+
+void steno_set_mode(steno_mode_t m)
+{
+    mode = m;
+}
+
+steno_mode_t steno_get_mode(void)
+{
+    return mode;
+}
+
+static void send_gemini(void)
+{
+    uint8_t packet[STENO_PACKET_SIZE];
+    for (uint8_t i = 0; i < STENO_PACKET_SIZE; i++) packet[i] = chord[i];
+    packet[0] |= 0x80;
+    host_steno_send(packet, STENO_PACKET_SIZE);
+}
+
+static void send_txbolt(void)
+{
+    uint8_t group[4] = {};
+    for (uint8_t k = STN_FN; k <= STN_ZR; k++) {
+        if (!(chord[GEMINI_BYTE(k)] & GEMINI_BIT(k))) continue;
+        uint8_t b = pgm_read_byte(&bolt_keys[k]);
+        if (b) group[b >> 6] |= b & 0x3F;
+    }
+
+    // groups without keys are left out, 0 tells host stroke is complete
+    uint8_t packet[5];
+    uint8_t len = 0;
+    for (uint8_t g = 0; g < 4; g++) {
+        if (group[g]) packet[len++] = g << 6 | group[g];
+    }
+    packet[len++] = 0;
+    host_steno_send(packet, len);
+}
+
+void steno_key(keyevent_t event)
+{
+    if (event.key.row >= MATRIX_ROWS || event.key.col >= MATRIX_COLS) return;
+    matrix_row_t bit = KEY_BIT(event.key);
+
+    // same event can come to the hook more than once, held bits make it no-op
+    if (event.pressed) {
+        if (down[event.key.row] & bit) return;
+        if (current_layer_for_key(event.key) != STENO_LAYER) return;
+        uint8_t k = pgm_read_byte(&steno_layout[event.key.row][event.key.col]);
+        if (k == STN_NO || k > STN_ZR) return;
+        down[event.key.row] |= bit;
+        down_count++;
+        chord[GEMINI_BYTE(k)] |= GEMINI_BIT(k);
+        return;
+    }
+
+    if (!(down[event.key.row] & bit)) return;
+    down[event.key.row] &= ~bit;
+    if (--down_count) return;
+
+    dprintf("steno: %02X %02X %02X %02X %02X %02X\n",
+            chord[0], chord[1], chord[2], chord[3], chord[4], chord[5]);
+    if (mode == STENO_TXBOLT) {
+        send_txbolt();
+    } else {
+        send_gemini();
+    }
+    for (uint8_t i = 0; i < STENO_PACKET_SIZE; i++) chord[i] = 0;
+}
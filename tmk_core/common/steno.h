@@ -0,0 +1,75 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef STENO_H
+#define STENO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "progmem.h"
+#include "keyboard.h"
+
+
+/*
+ * Stenography(STENO_ENABLE)
+ *
+ * Keys pressed on STENO_LAYER are steno keys given by steno_layout[] of
+ * keymap. They are added to a chord from hook_matrix_change() and the chord
+ * goes to host as one GeminiPR or TX Bolt packet when all of them are
+ * released, through send_steno of host driver(LUFA: CDC ACM virtual serial
+ * port for Plover). Keymap has KC_NO for those keys on the layer so that
+ * they send no keyboard report:
+ *     const uint8_t steno_layout[MATRIX_ROWS][MATRIX_COLS] PROGMEM = {
+ *         { STN_S1, STN_TL, STN_PL, STN_HL, STN_ST1, ... },
+ *         ...
+ *     };
+ * Layer of key is looked up on press only, a key pressed elsewhere is not
+ * steno key until it is released.
+ */
+#ifndef STENO_LAYER
+#define STENO_LAYER     1
+#endif
+#ifndef STENO_MODE
+#define STENO_MODE      STENO_GEMINI
+#endif
+
+typedef enum {
+    STENO_GEMINI,       // 6 bytes of all keys
+    STENO_TXBOLT,       // byte of each key group used, 0 ends stroke
+} steno_mode_t;
+
+/* steno keys in GeminiPR bit order, 0 is not steno key */
+enum steno_keys {
+    STN_NO = 0,
+    STN_FN, STN_N1, STN_N2, STN_N3, STN_N4, STN_N5, STN_N6,
+    STN_S1, STN_S2, STN_TL, STN_KL, STN_PL, STN_WL, STN_HL,
+    STN_RL, STN_A,  STN_O,  STN_ST1, STN_ST2, STN_RE1, STN_RE2,
+    STN_PWR, STN_ST3, STN_ST4, STN_E, STN_U,  STN_FR, STN_RR,
+    STN_PR, STN_BR, STN_LR, STN_GR, STN_TR, STN_SR, STN_DR,
+    STN_N7, STN_N8, STN_N9, STN_NA, STN_NB, STN_NC, STN_ZR,
+};
+
+/* bytes of GeminiPR packet */
+#define STENO_PACKET_SIZE   6
+
+extern const uint8_t steno_layout[MATRIX_ROWS][MATRIX_COLS];
+
+void steno_set_mode(steno_mode_t mode);
+steno_mode_t steno_get_mode(void);
+/* event of matrix, from hook_matrix_change() */
+void steno_key(keyevent_t event);
+
+#endif
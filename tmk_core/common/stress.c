@@ -0,0 +1,196 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyboard.h"
+#include "matrix.h"
+#include "action.h"
+#include "timer.h"
+#include "print.h"
+#include "telemetry.h"
+#include "stress.h"
+
+
+#ifdef STRESS_KEYS
+static const keypos_t keys[] = STRESS_KEYS;
+#   define KEYS_N       (sizeof(keys) / sizeof(keys[0]))
+#   define KEY(i)       (keys[i])
+#else
+#   define KEYS_N       (MATRIX_COLS < 6 ? MATRIX_COLS : 6)
+#   define KEY(i)       ((keypos_t){ .row = 0, .col = (i) })
+#endif
+/* keys held are bits of down, last bit is STRESS_LT_KEY */
+#define LT              15
+#define KEY_COUNT       (KEYS_N < LT ? KEYS_N : LT)
+#ifdef STRESS_LT_KEY
+static const keypos_t lt_key = STRESS_LT_KEY;
+#endif
+
+enum {
+    STRESS_ROLLOVER,
+    STRESS_TAP,
+#ifdef STRESS_LT_KEY
+    STRESS_LAYER_TAP,
+#endif
+    STRESS_PATTERNS
+};
+
+static enum { IDLE, ARMED, RUNNING } state = IDLE;
+static uint8_t pattern = STRESS_ROLLOVER;
+static uint8_t step;
+static uint16_t down;
+static uint16_t last;
+static uint32_t start;
+static uint32_t events;
+#ifdef TELEMETRY_ENABLE
+static uint32_t reports, lost;
+#endif
+
+
+static void print_pattern(void)
+{
+    switch (pattern) {
+        case STRESS_ROLLOVER:   print("rollover"); break;
+        case STRESS_TAP:        print("tap"); break;
+#ifdef STRESS_LT_KEY
+        case STRESS_LAYER_TAP:  print("layer tap"); break;
+#endif
+    }
+}
+
+static void key_event(uint8_t i, bool pressed)
+{
+#ifdef STRESS_LT_KEY
+    keypos_t key = (i == LT) ? lt_key : KEY(i);
+#else
+    keypos_t key = KEY(i);
+#endif
+    if (pressed) {
+        down |= 1U << i;
+    } else {
+        down &= ~(1U << i);
+    }
+    action_exec((keyevent_t){ .key = key, .pressed = pressed, .time = (timer_read() | 1) });
+    events++;
+}
+
+static void next_event(void)
+{
+    switch (pattern) {
+        case STRESS_ROLLOVER:
+            // press 0..n-1, then release 0..n-1
+            if (step < KEY_COUNT) {
+                key_event(step, true);
+            } else {
+                key_event(step - KEY_COUNT, false);
+            }
+            if (++step >= 2 * KEY_COUNT) step = 0;
+            break;
+        case STRESS_TAP:
+            key_event(0, !(step & 1));
+            step ^= 1;
+            break;
+#ifdef STRESS_LT_KEY
+        case STRESS_LAYER_TAP:
+            // LT down, key tap, LT up, then LT tap
+            switch (step) {
+                case 0: key_event(LT, true); break;
+                case 1: key_event(0, true); break;
+                case 2: key_event(0, false); break;
+                case 3: key_event(LT, false); break;
+                case 4: key_event(LT, true); break;
+                case 5: key_event(LT, false); break;
+            }
+            if (++step > 5) step = 0;
+            break;
+#endif
+    }
+}
+
+static bool matrix_idle(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (MATRIX_READ_ROW(r)) return false;
+    }
+    return true;
+}
+
+static void stress_start(void)
+{
+    state = RUNNING;
+    step = 0;
+    down = 0;
+    events = 0;
+    start = timer_read32();
+    last = timer_read();
+#ifdef TELEMETRY_ENABLE
+    reports = telemetry_counters[TELEMETRY_REPORT];
+    lost = telemetry_counters[TELEMETRY_REPORT_LOST];
+#endif
+}
+
+static void stress_stop(void)
+{
+    if (state == RUNNING) {
+        for (uint8_t i = 0; down; i++) {
+            if (down & (1U << i)) key_event(i, false);
+        }
+        uint32_t ms = timer_elapsed32(start);
+        print("stress: "); print_pattern();
+        xprintf(" %lu events", (unsigned long)events);
+#ifdef TELEMETRY_ENABLE
+        xprintf(" %lu reports %lu lost",
+                (unsigned long)(telemetry_counters[TELEMETRY_REPORT] - reports),
+                (unsigned long)(telemetry_counters[TELEMETRY_REPORT_LOST] - lost));
+#endif
+        xprintf(" %lu ms\n", (unsigned long)ms);
+    }
+    state = IDLE;
+    if (++pattern >= STRESS_PATTERNS) pattern = STRESS_ROLLOVER;
+}
+
+void stress_toggle(void)
+{
+    if (state != IDLE) {
+        stress_stop();
+        return;
+    }
+    state = ARMED;
+    print("stress: "); print_pattern(); print(", release keys to start\n");
+}
+
+void stress_task(void)
+{
+    switch (state) {
+        case IDLE:
+            return;
+        case ARMED:
+            if (matrix_idle()) stress_start();
+            return;
+        case RUNNING:
+            if (!matrix_idle()) {
+                stress_stop();
+                return;
+            }
+#if STRESS_INTERVAL > 0
+            if (timer_elapsed(last) < STRESS_INTERVAL) return;
+            last += STRESS_INTERVAL;
+#endif
+            next_event();
+            return;
+    }
+}
@@ -0,0 +1,60 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef STRESS_H
+#define STRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Synthetic key events for report throughput test(STRESS_ENABLE), Magic+F
+ *
+ * Magic+F arms next pattern, it starts when all keys of matrix are released
+ * and feeds a key event to action_exec() every STRESS_INTERVAL ms from
+ * keyboard_task(), 0 feeds one every call. Any key pressed or Magic+F again
+ * stops it, keys it holds are released and counts of the run are printed:
+ *
+ *   events     key events fed
+ *   reports    keyboard reports given to host driver
+ *   lost       of them, timed out or replaced in full queue by driver
+ *   ms         time of run
+ *
+ * Count reports on host meanwhile to get how many were committed, firmware
+ * only knows reports minus lost went to endpoint. Patterns in order:
+ *
+ *   rollover   STRESS_KEYS pressed one after another, then released in order
+ *   tap        first of STRESS_KEYS pressed and released
+ *   layer tap  STRESS_LT_KEY held over a tap of first of STRESS_KEYS, then
+ *              tapped itself; only when config.h defines STRESS_LT_KEY
+ *
+ * Keys are matrix positions and type what keymap has there, default is first
+ * six columns of row 0. Report counts need TELEMETRY_ENABLE.
+ *
+ *     #define STRESS_KEYS     { { .row = 1, .col = 1 }, { .row = 1, .col = 2 } }
+ *     #define STRESS_LT_KEY   { .row = 3, .col = 0 }
+ */
+#ifndef STRESS_INTERVAL
+#define STRESS_INTERVAL     1
+#endif
+
+/* Magic+F, arm next pattern or stop */
+void stress_toggle(void);
+/* from keyboard_task() */
+void stress_task(void);
+
+#endif
@@ -7,6 +7,8 @@
 
 void suspend_idle(uint8_t timeout);
 void suspend_power_down(void);
+void suspend_power_down_reset(void);
+bool suspend_pin_wakeup(void);
 bool suspend_wakeup_condition(void);
 void suspend_wakeup_init(void);
 
@@ -0,0 +1,224 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "print.h"
+#include "latency.h"
+#include "telemetry.h"
+#ifdef DEBOUNCE_ADAPTIVE
+#include "debounce.h"
+#endif
+#include "watchdog.h"
+#include "typing_stat.h"
+
+
+volatile uint32_t telemetry_counters[TELEMETRY_COUNTERS];
+volatile uint8_t telemetry_peaks[TELEMETRY_PEAKS];
+
+
+#ifndef NO_PRINT
+static void print_counter(uint8_t counter)
+{
+    switch (counter) {
+        case TELEMETRY_SCAN:            print("scan        "); break;
+        case TELEMETRY_LOOP:            print("loop        "); break;
+        case TELEMETRY_EVENT_LOST:      print("event lost  "); break;
+        case TELEMETRY_CONSOLE_LOST:    print("console lost"); break;
+        case TELEMETRY_RX_LOST:         print("rx lost     "); break;
+        case TELEMETRY_WAITING_LOST:    print("waiting lost"); break;
+        case TELEMETRY_REPORT_LOST:     print("report lost "); break;
+        case TELEMETRY_REPORT:          print("report      "); break;
+    }
+}
+#endif
+
+
+static uint8_t put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v; p[1] = v >> 8;
+    return 2;
+}
+
+static uint8_t put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+    return 4;
+}
+
+bool telemetry_command(uint8_t *data, uint8_t length)
+{
+    if (length == 0) return false;
+
+    uint8_t command = data[0];
+    uint8_t n = 1;
+    switch (command) {
+        case TELEMETRY_INFO:
+            if (length < 10) break;
+            data[n++] = TELEMETRY_VERSION;
+            data[n++] = TELEMETRY_COUNTERS;
+            data[n++] = TELEMETRY_PEAKS;
+#ifdef LATENCY_TRACE_ENABLE
+            data[n++] = LATENCY_STAGES;
+#else
+            data[n++] = 0;
+#endif
+            data[n++] = LATENCY_HIST_BUCKETS;
+            put32(&data[n], LATENCY_TICK_FREQ);
+            return true;
+        case TELEMETRY_COUNTER:
+            if (length < 2 + 4 + 4 || data[1] >= TELEMETRY_COUNTERS) break;
+            n = 2;
+            n += put32(&data[n], timer_read32());
+            for (uint8_t i = data[1]; i < TELEMETRY_COUNTERS && n + 4 <= length; i++) {
+                n += put32(&data[n], telemetry_counters[i]);
+            }
+            return true;
+#ifdef LATENCY_TRACE_ENABLE
+        case TELEMETRY_LATENCY: {
+            if (length < 16 || data[1] >= LATENCY_STAGES) break;
+            const latency_stat_t *s = latency_stat(data[1]);
+            n = 2;
+            n += put32(&data[n], s->min);
+            n += put32(&data[n], s->max);
+            n += put32(&data[n], s->sum);
+            n += put16(&data[n], s->count);
+            for (uint8_t b = 0; b < LATENCY_HIST_BUCKETS && n + 2 <= length; b++) {
+                n += put16(&data[n], s->hist[b]);
+            }
+            return true;
+        }
+#endif
+#ifdef DEBOUNCE_ADAPTIVE
+        case TELEMETRY_KEYS: {
+            if (length < 3 + 3 || data[1] >= MATRIX_ROWS || data[2] >= MATRIX_COLS) break;
+            uint8_t r = data[1], c = data[2];
+            n = 3;
+            while (r < MATRIX_ROWS && n + 3 <= length) {
+                const debounce_stat_t *s = debounce_stat(r, c);
+                data[n++] = s->bounces;
+                data[n++] = s->chatters;
+                data[n++] = s->time;
+                if (++c == MATRIX_COLS) { c = 0; r++; }
+            }
+            return true;
+        }
+#endif
+#ifdef WATCHDOG_ENABLE
+        case TELEMETRY_WATCHDOG:
+            if (length < 4) break;
+            data[n++] = watchdog_reset_cause();
+            data[n++] = watchdog_reset_stage();
+            data[n++] = watchdog_reset_count();
+            return true;
+#endif
+#ifdef TYPING_STAT_ENABLE
+        case TELEMETRY_TYPING: {
+            if (length < 13) break;
+            const typing_stat_t *s = typing_stat();
+            n += put32(&data[n], s->presses);
+            n += put16(&data[n], s->kpm);
+            n += put16(&data[n], s->kpm_avg);
+            n += put16(&data[n], s->hold_count ? s->hold_sum / s->hold_count : 0);
+            n += put16(&data[n], s->latency_max);
+            for (uint8_t b = 0; b < TYPING_STAT_BUCKETS && n + 2 <= length; b++) {
+                n += put16(&data[n], s->latency[b]);
+            }
+            return true;
+        }
+        case TELEMETRY_KEY_TYPING: {
+            if (length < 3 + 4 || data[1] >= MATRIX_ROWS || data[2] >= MATRIX_COLS) break;
+            uint8_t r = data[1], c = data[2];
+            n = 3;
+            while (r < MATRIX_ROWS && n + 4 <= length) {
+                const typing_key_stat_t *s = typing_key_stat(r, c);
+                n += put16(&data[n], s->presses);
+                n += put16(&data[n], s->hold);
+                if (++c == MATRIX_COLS) { c = 0; r++; }
+            }
+            return true;
+        }
+#endif
+        case TELEMETRY_CLEAR:
+            telemetry_clear();
+#ifdef LATENCY_TRACE_ENABLE
+            latency_clear();
+#endif
+            return true;
+        case TELEMETRY_PEAK:
+            if (length < 1 + TELEMETRY_PEAKS) break;
+            for (uint8_t i = 0; i < TELEMETRY_PEAKS; i++) {
+                data[n++] = telemetry_peaks[i];
+            }
+            return true;
+        default:
+            if ((command & 0xF0) != (TELEMETRY_INFO & 0xF0)) return false;
+            break;
+    }
+
+    data[0] = TELEMETRY_ERROR;
+    data[1] = command;
+    return true;
+}
+
+void telemetry_clear(void)
+{
+    for (uint8_t i = 0; i < TELEMETRY_COUNTERS; i++) {
+        telemetry_counters[i] = 0;
+    }
+    for (uint8_t i = 0; i < TELEMETRY_PEAKS; i++) {
+        telemetry_peaks[i] = 0;
+    }
+#ifdef DEBOUNCE_ADAPTIVE
+    debounce_stat_clear();
+#endif
+#ifdef TYPING_STAT_ENABLE
+    typing_stat_clear();
+#endif
+}
+
+void telemetry_print(void)
+{
+#ifndef NO_PRINT
+    xprintf("\n\t- Telemetry(%lums) -\n", (unsigned long)timer_read32());
+    for (uint8_t i = 0; i < TELEMETRY_COUNTERS; i++) {
+        print_counter(i);
+        xprintf(" %lu\n", (unsigned long)telemetry_counters[i]);
+    }
+    xprintf("peak: event %u rx %u waiting %u\n",
+            telemetry_peaks[TELEMETRY_EVENT_PEAK],
+            telemetry_peaks[TELEMETRY_RX_PEAK],
+            telemetry_peaks[TELEMETRY_WAITING_PEAK]);
+#ifdef WATCHDOG_ENABLE
+    watchdog_print();
+#endif
+#ifdef TYPING_STAT_ENABLE
+    typing_stat_print();
+#endif
+#ifdef DEBOUNCE_ADAPTIVE
+    // keys which bounced or chattered only
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            const debounce_stat_t *s = debounce_stat(r, c);
+            if (!s->bounces && !s->chatters) continue;
+            xprintf("key %u,%u: bounce %u chatter %u debounce %ums\n",
+                    r, c, s->bounces, s->chatters, s->time);
+        }
+    }
+#endif
+#endif
+}
@@ -0,0 +1,105 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Telemetry
+ *
+ * Counters of what firmware is doing, read by host through console command
+ * or printed with Magic+T, instead of debug print which changes timing of
+ * the loop it looks at. Counters are 32-bit and wrap, peaks are highest
+ * depth of queues(8-bit, queues are 256 entries at most). Both are updated
+ * from interrupt too and read without lock.
+ *
+ *   C0                 info    -> C0 version counters peaks stages buckets tick_freq(4)
+ *   C1 first           counters-> C1 first ms(4) counter[first](4) ...
+ *   C2 stage           latency -> C2 stage min(4) max(4) sum(4) count(2) hist[](2)...
+ *   C3                 clear   -> C3, counters, peaks and latency stats are zeroed
+ *   C4                 peaks   -> C4 peak[0] peak[1] ...
+ *   C5 row col         keys    -> C5 row col (bounces chatters time) ...
+ *   C6                 watchdog-> C6 mcusr stage count
+ *   C7                 typing  -> C7 presses(4) kpm(2) kpm_avg(2) hold(2) latency_max(2) latency[](2)...
+ *   C8 row col         key typ -> C8 row col (presses(2) hold(2)) ...
+ *   error                      -> CF command
+ *
+ * Values are little endian. C1 returns counters from first as many as fit in
+ * packet. Scan rate is difference of SCAN counter over difference of ms
+ * between two C1. Latency needs LATENCY_TRACE_ENABLE, hist is cut off at end
+ * of packet. C5 returns debounce statistics of keys from row and col on, in
+ * order of matrix as many as fit in packet, see DEBOUNCE_ADAPTIVE in
+ * debounce.h. C3 zeroes them too but not debounce time. C6 needs
+ * WATCHDOG_ENABLE, it returns reset cause and stage of last reset by
+ * watchdog with count of them since power on, see watchdog.h. C7 and C8
+ * need TYPING_STAT_ENABLE, C7 hold is mean of all keys(ms) and C8 hold is
+ * of each key(1/16 ms), keys from row and col on like C5; see typing_stat.h.
+ */
+#define TELEMETRY_INFO          0xC0
+#define TELEMETRY_COUNTER       0xC1
+#define TELEMETRY_LATENCY       0xC2
+#define TELEMETRY_CLEAR         0xC3
+#define TELEMETRY_PEAK          0xC4
+#define TELEMETRY_KEYS          0xC5
+#define TELEMETRY_WATCHDOG      0xC6
+#define TELEMETRY_TYPING        0xC7
+#define TELEMETRY_KEY_TYPING    0xC8
+#define TELEMETRY_ERROR         0xCF
+
+#define TELEMETRY_VERSION       6
+
+enum telemetry_counter {
+    TELEMETRY_SCAN,             /* matrix_scan() calls */
+    TELEMETRY_LOOP,             /* keyboard_task() calls */
+    TELEMETRY_EVENT_LOST,       /* matrix_event_put() to full queue */
+    TELEMETRY_CONSOLE_LOST,     /* characters dropped by console buffer */
+    TELEMETRY_RX_LOST,          /* bytes dropped by receive queue of converter */
+    TELEMETRY_WAITING_LOST,     /* overflow of tapping waiting_buffer */
+    TELEMETRY_REPORT_LOST,      /* keyboard report timed out or replaced in full queue */
+    TELEMETRY_REPORT,           /* keyboard reports given to host driver */
+    TELEMETRY_COUNTERS
+};
+
+enum telemetry_peak {
+    TELEMETRY_EVENT_PEAK,       /* matrix event queue */
+    TELEMETRY_RX_PEAK,          /* receive queue of converter(pbuf/rbuf) */
+    TELEMETRY_WAITING_PEAK,     /* tapping waiting_buffer */
+    TELEMETRY_PEAKS
+};
+
+#ifdef TELEMETRY_ENABLE
+extern volatile uint32_t telemetry_counters[TELEMETRY_COUNTERS];
+extern volatile uint8_t telemetry_peaks[TELEMETRY_PEAKS];
+#   define TELEMETRY_COUNT(counter)   (telemetry_counters[counter]++)
+#   define TELEMETRY_PEAK_SET(peak, depth)  do { \
+        uint8_t d_ = (depth); \
+        if (d_ > telemetry_peaks[peak]) telemetry_peaks[peak] = d_; \
+    } while (0)
+#else
+#   define TELEMETRY_COUNT(counter)         ((void)0)
+#   define TELEMETRY_PEAK_SET(peak, depth)  ((void)0)
+#endif
+
+
+/* runs command in data and puts reply in it, returns false if not command */
+bool telemetry_command(uint8_t *data, uint8_t length);
+void telemetry_print(void);
+void telemetry_clear(void);
+
+#endif
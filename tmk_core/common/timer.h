@@ -25,11 +25,25 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
-#define TIMER_DIFF(a, b, max)   ((a) >= (b) ?  (a) - (b) : (max) - (b) + (a))
-#define TIMER_DIFF_8(a, b)      TIMER_DIFF(a, b, UINT8_MAX)
-#define TIMER_DIFF_16(a, b)     TIMER_DIFF(a, b, UINT16_MAX)
-#define TIMER_DIFF_32(a, b)     TIMER_DIFF(a, b, UINT32_MAX)
+/*
+ * Time API
+ *
+ * timer_read32() is the millisecond tick, it wraps at 49 days. timer_read()
+ * is its low 16 bits, fast view for hot paths and keyevent_t.time which
+ * wraps at 65 seconds; use it only for intervals known to be shorter.
+ * timer_read_us() is free-running microsecond counter which wraps at 71
+ * minutes, resolution depends on platform(4us on AVR at 16MHz).
+ *
+ * Difference of two readings is modulo width of the counter, and it is right
+ * across wrap as long as interval fits in the width.
+ */
+#define TIMER_DIFF(a, b, max)   ((a) >= (b) ?  (a) - (b) : (max) - (b) + (a) + 1)
+#define TIMER_DIFF_8(a, b)      ((uint8_t)((uint8_t)(a) - (uint8_t)(b)))
+#define TIMER_DIFF_16(a, b)     ((uint16_t)((uint16_t)(a) - (uint16_t)(b)))
+#define TIMER_DIFF_32(a, b)     ((uint32_t)((uint32_t)(a) - (uint32_t)(b)))
+#ifndef TIMER_DIFF_RAW
 #define TIMER_DIFF_RAW(a, b)    TIMER_DIFF_8(a, b)
+#endif
 
 
 #ifdef __cplusplus
@@ -45,6 +59,8 @@ uint16_t timer_read(void);
 uint32_t timer_read32(void);
 uint16_t timer_elapsed(uint16_t last);
 uint32_t timer_elapsed32(uint32_t last);
+uint32_t timer_read_us(void);
+uint32_t timer_elapsed_us(uint32_t last);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,221 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "keycode.h"
+#include "report.h"
+#include "host.h"
+#include "timer.h"
+#include "progmem.h"
+#include "action_util.h"
+#include "type_inject.h"
+
+#ifdef DEBUG_ACTION
+#include "debug.h"
+#else
+#include "nodebug.h"
+#endif
+
+
+#if (TYPE_INJECT_SIZE < 2 || TYPE_INJECT_SIZE > 256 || (TYPE_INJECT_SIZE & (TYPE_INJECT_SIZE - 1)))
+#   error "TYPE_INJECT_SIZE must be power of two up to 256"
+#endif
+
+#define SLOT(i)         ((uint8_t)((i) & (TYPE_INJECT_SIZE - 1)))
+#define QUEUED()        SLOT(head - tail)
+#define FREE()          (TYPE_INJECT_SIZE - 1 - QUEUED())
+
+/* Console_Task() can run in SOF interrupt, commands write head only and
+ * type_inject_task() writes tail only. Clear is left to the task, queue
+ * takes nothing until it is done. */
+static volatile uint8_t queue[TYPE_INJECT_SIZE];
+static volatile uint8_t head = 0;
+static volatile uint8_t tail = 0;
+static volatile bool clear_pending = false;
+
+/* keys of run in report, released in next one */
+static uint8_t typed[6];
+static uint8_t typed_count = 0;
+static uint8_t typed_mods = 0;
+static uint16_t report_time;
+
+/* US layout from ' ' to '~', bit7 is shift */
+#define S(kc)   (0x80 | (kc))
+static const uint8_t ascii_usage[] PROGMEM = {
+    KC_SPC,     S(KC_1),    S(KC_QUOT), S(KC_3),    S(KC_4),    S(KC_5),    S(KC_7),    KC_QUOT,
+    S(KC_9),    S(KC_0),    S(KC_8),    S(KC_EQL),  KC_COMM,    KC_MINS,    KC_DOT,     KC_SLSH,
+    KC_0,       KC_1,       KC_2,       KC_3,       KC_4,       KC_5,       KC_6,       KC_7,
+    KC_8,       KC_9,       S(KC_SCLN), KC_SCLN,    S(KC_COMM), KC_EQL,     S(KC_DOT),  S(KC_SLSH),
+    S(KC_2),    S(KC_A),    S(KC_B),    S(KC_C),    S(KC_D),    S(KC_E),    S(KC_F),    S(KC_G),
+    S(KC_H),    S(KC_I),    S(KC_J),    S(KC_K),    S(KC_L),    S(KC_M),    S(KC_N),    S(KC_O),
+    S(KC_P),    S(KC_Q),    S(KC_R),    S(KC_S),    S(KC_T),    S(KC_U),    S(KC_V),    S(KC_W),
+    S(KC_X),    S(KC_Y),    S(KC_Z),    KC_LBRC,    KC_BSLS,    KC_RBRC,    S(KC_6),    S(KC_MINS),
+    KC_GRV,     KC_A,       KC_B,       KC_C,       KC_D,       KC_E,       KC_F,       KC_G,
+    KC_H,       KC_I,       KC_J,       KC_K,       KC_L,       KC_M,       KC_N,       KC_O,
+    KC_P,       KC_Q,       KC_R,       KC_S,       KC_T,       KC_U,       KC_V,       KC_W,
+    KC_X,       KC_Y,       KC_Z,       S(KC_LBRC), S(KC_BSLS), S(KC_RBRC), S(KC_GRV),
+};
+
+
+static bool key_in_report(uint8_t code)
+{
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        if ((code >> 3) >= KEYBOARD_REPORT_BITS) return false;
+        return keyboard_report->nkro.bits[code >> 3] & (1 << (code & 7));
+    }
+#endif
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (keyboard_report->keys[i] == code) return true;
+    }
+    return false;
+}
+
+/* Adds run of keys from queue to report, keys go in the run while they have
+ * the same modifiers and are not in report yet. With NKRO run also ends at
+ * key lower than previous since host reads the bitmap in keycode order, and
+ * order of keys in report is order of typing only when it starts empty. */
+static void type_run(void)
+{
+    bool empty = !has_anykey();
+    uint8_t t = tail;
+
+    while (typed_count < 6 && t != head) {
+        uint8_t mods = 0;
+        uint8_t s = t;
+        while (s != head && IS_MOD(queue[s])) {
+            mods |= MOD_BIT(queue[s]);
+            s = SLOT(s + 1);
+        }
+        // key for the modifiers is not here yet
+        if (s == head) break;
+
+        uint8_t code = queue[s];
+        if (!IS_KEY(code)) {
+            dprintf("type_inject: drop %02X\n", code);
+            t = tail = SLOT(s + 1);
+            continue;
+        }
+        if (key_in_report(code)) break;
+        if (typed_count) {
+            if (!empty || mods != typed_mods) break;
+#ifdef NKRO_ENABLE
+            if (keyboard_protocol && keyboard_nkro && code <= typed[typed_count - 1]) break;
+#endif
+        } else {
+            typed_mods = mods;
+            add_weak_mods(mods);
+        }
+        add_key(code);
+        typed[typed_count++] = code;
+        t = tail = SLOT(s + 1);
+    }
+}
+
+void type_inject_task(void)
+{
+    if (clear_pending) {
+        tail = head;
+        clear_pending = false;
+    }
+    if (!typed_count && head == tail) return;
+    if (TIMER_DIFF_16(timer_read(), report_time) < TYPE_INJECT_INTERVAL) return;
+
+    if (typed_count) {
+        for (uint8_t i = 0; i < typed_count; i++) del_key(typed[i]);
+        del_weak_mods(typed_mods);
+        typed_count = 0;
+        typed_mods = 0;
+    } else {
+        type_run();
+        if (!typed_count) return;
+    }
+    send_keyboard_report();
+    report_time = timer_read();
+}
+
+
+static uint8_t queue_keys(const uint8_t *usage, uint8_t n)
+{
+    uint8_t h = head;
+    uint8_t taken = 0;
+    for (; taken < n && FREE(); taken++) {
+        queue[h] = usage[taken];
+        head = h = SLOT(h + 1);
+    }
+    return taken;
+}
+
+static uint8_t queue_text(const uint8_t *text, uint8_t n)
+{
+    uint8_t h = head;
+    uint8_t taken = 0;
+    for (; taken < n; taken++) {
+        uint8_t c = text[taken];
+        uint8_t u;
+        if (c == '\n')                  u = KC_ENTER;
+        else if (c == '\t')             u = KC_TAB;
+        else if (' ' <= c && c <= '~')  u = pgm_read_byte(&ascii_usage[c - ' ']);
+        else                            continue;
+
+        if (FREE() < ((u & 0x80) ? 2 : 1)) break;
+        if (u & 0x80) {
+            queue[h] = KC_LSHIFT;
+            head = h = SLOT(h + 1);
+        }
+        queue[h] = u & 0x7F;
+        head = h = SLOT(h + 1);
+    }
+    return taken;
+}
+
+bool type_inject_command(uint8_t *data, uint8_t length)
+{
+    if (length == 0) return false;
+
+    uint8_t command = data[0];
+    switch (command) {
+        case TYPE_INJECT_KEYS:
+        case TYPE_INJECT_TEXT: {
+            if (length < 3) break;
+            uint8_t n = data[1];
+            if (n > length - 2) break;
+            uint8_t taken = 0;
+            if (!clear_pending) {
+                taken = (command == TYPE_INJECT_KEYS) ?
+                        queue_keys(&data[2], n) : queue_text(&data[2], n);
+            }
+            data[1] = taken;
+            data[2] = clear_pending ? 0 : FREE();
+            return true;
+        }
+        case TYPE_INJECT_STATUS:
+            if (length < 3) break;
+            data[1] = clear_pending ? 0 : FREE();
+            data[2] = clear_pending ? 0 : QUEUED();
+            return true;
+        case TYPE_INJECT_CLEAR:
+            clear_pending = true;
+            return true;
+        default:
+            break;
+    }
+
+    data[0] = TYPE_INJECT_ERROR;
+    if (length > 1) data[1] = command;
+    return true;
+}
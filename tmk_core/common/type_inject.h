@@ -0,0 +1,70 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TYPE_INJECT_H
+#define TYPE_INJECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Typing from host(TYPE_INJECT_ENABLE)
+ *
+ * Host tool queues keys for keyboard to type, e.g. provisioning strings,
+ * without a macro compiled in. type_inject_task() in keyboard_task() types
+ * them while keys of matrix are processed as usual: a run of distinct keys
+ * with the same modifiers is pressed in one report and released in next,
+ * like FAST_TYPE of macro, one report in TYPE_INJECT_INTERVAL ms at most.
+ *
+ * Queue holds usages, a modifier(E0-E7) is held for next key only so that
+ * E1 04 types 'A'. Text is ASCII of US layout, it is turned into usages on
+ * arrival and characters without a key are dropped; '\n' is Enter and '\t'
+ * is Tab. Commands come on console OUT endpoint as other clients of
+ * console_command.h:
+ *
+ *   E0 n usage...      keys    -> E0 taken free
+ *   E1 n char...       text    -> E1 taken free
+ *   E2                 status  -> E2 free queued
+ *   E3                 clear   -> E3, queue is emptied
+ *   error                      -> EF command
+ *
+ * Flow control is by free slots of queue in every reply. Taken is how many
+ * of n bytes were queued, host sends the rest again when free allows; a
+ * character of text takes two slots with shift.
+ */
+#define TYPE_INJECT_KEYS        0xE0
+#define TYPE_INJECT_TEXT        0xE1
+#define TYPE_INJECT_STATUS      0xE2
+#define TYPE_INJECT_CLEAR       0xE3
+#define TYPE_INJECT_ERROR       0xEF
+
+/* slots of queue, power of two up to 256 */
+#ifndef TYPE_INJECT_SIZE
+#define TYPE_INJECT_SIZE        128
+#endif
+
+/* ms between reports, polling interval of keyboard endpoint with
+ * LUFA_SOF_REPORT_QUEUE; blocking drivers wait for endpoint anyway */
+#ifndef TYPE_INJECT_INTERVAL
+#define TYPE_INJECT_INTERVAL    1
+#endif
+
+
+void type_inject_task(void);
+/* runs command in data and puts reply in it, returns false if not command */
+bool type_inject_command(uint8_t *data, uint8_t length);
+
+#endif
@@ -0,0 +1,167 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "timer.h"
+#include "print.h"
+#include "typing_stat.h"
+
+
+#define MINUTE          60000UL
+#define HOLD_MAX        4095        // ms, 1/16 of it fits in 16 bits
+#define KPM_MAX         4095
+
+static typing_stat_t stat;
+static typing_key_stat_t keys[MATRIX_ROWS][MATRIX_COLS];
+
+/* keys down with time of press, 0 is free slot as event time is odd */
+static struct {
+    keypos_t key;
+    uint16_t time;
+} held[TYPING_STAT_HELD];
+
+/* current minute of kpm */
+static uint32_t minute_start = 0;
+static uint16_t minute_presses = 0;
+
+/* scan time of events waiting for their report */
+static uint32_t scan_us;
+static bool scan_pending = false;
+
+
+/* close minutes passed by now, one without presses before now makes kpm 0 */
+static void kpm_roll(uint32_t now)
+{
+    uint32_t elapsed = now - minute_start;
+    if (elapsed < MINUTE) return;
+
+    stat.kpm = (elapsed < 2 * MINUTE) ? minute_presses : 0;
+    if (stat.kpm) {
+        uint16_t k = (stat.kpm < KPM_MAX) ? stat.kpm << 4 : KPM_MAX << 4;
+        if (stat.kpm_avg) {
+            stat.kpm_avg += ((int32_t)k - stat.kpm_avg) / 8;
+        } else {
+            stat.kpm_avg = k;
+        }
+    }
+    minute_start = (elapsed < 2 * MINUTE) ? minute_start + MINUTE : now;
+    minute_presses = 0;
+}
+
+static void hold_add(keypos_t key, uint16_t ms)
+{
+    if (ms > HOLD_MAX) ms = HOLD_MAX;
+    stat.hold_sum += ms;
+    stat.hold_count++;
+
+    typing_key_stat_t *k = &keys[key.row][key.col];
+    if (k->hold) {
+        k->hold += ((int32_t)(ms << 4) - k->hold) / 8;
+    } else {
+        k->hold = ms << 4;
+    }
+}
+
+void typing_stat_scan(void)
+{
+    scan_us = timer_read_us();
+    scan_pending = false;
+}
+
+void typing_stat_key(keyevent_t event)
+{
+    keypos_t key = event.key;
+    if (key.row >= MATRIX_ROWS || key.col >= MATRIX_COLS) return;
+    scan_pending = true;
+
+    if (event.pressed) {
+        kpm_roll(timer_read32());
+        minute_presses++;
+        stat.presses++;
+        if (keys[key.row][key.col].presses < UINT16_MAX) keys[key.row][key.col].presses++;
+        for (uint8_t i = 0; i < TYPING_STAT_HELD; i++) {
+            if (!held[i].time) {
+                held[i].key = key;
+                held[i].time = event.time;
+                break;
+            }
+        }
+    } else {
+        for (uint8_t i = 0; i < TYPING_STAT_HELD; i++) {
+            if (held[i].time && KEYEQ(held[i].key, key)) {
+                hold_add(key, event.time - held[i].time);
+                held[i].time = 0;
+                break;
+            }
+        }
+    }
+}
+
+void typing_stat_report(void)
+{
+    if (!scan_pending) return;
+    scan_pending = false;
+
+    uint32_t us = timer_elapsed_us(scan_us);
+    if (us > stat.latency_max) stat.latency_max = (us < UINT16_MAX) ? us : UINT16_MAX;
+
+    uint8_t b = 0;
+    for (us /= TYPING_STAT_LATENCY_BASE; us && b < TYPING_STAT_BUCKETS - 1; us >>= 1) b++;
+    if (stat.latency[b] < UINT16_MAX) stat.latency[b]++;
+}
+
+const typing_stat_t *typing_stat(void)
+{
+    kpm_roll(timer_read32());
+    return &stat;
+}
+
+const typing_key_stat_t *typing_key_stat(uint8_t row, uint8_t col)
+{
+    return &keys[row][col];
+}
+
+/* keys held now stay timed */
+void typing_stat_clear(void)
+{
+    stat = (typing_stat_t){};
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            keys[r][c] = (typing_key_stat_t){};
+        }
+    }
+    minute_start = timer_read32();
+    minute_presses = 0;
+}
+
+void typing_stat_print(void)
+{
+#ifndef NO_PRINT
+    const typing_stat_t *s = typing_stat();
+    xprintf("typing: presses %lu kpm %u avg %u hold %lums\n",
+            (unsigned long)s->presses, s->kpm, s->kpm_avg >> 4,
+            (unsigned long)(s->hold_count ? s->hold_sum / s->hold_count : 0));
+    xprintf("latency(us): max %u", s->latency_max);
+    for (uint8_t b = 0; b < TYPING_STAT_BUCKETS; b++) {
+        xprintf(" %s%lu:%u", (b == TYPING_STAT_BUCKETS - 1) ? ">=" : "<",
+                (unsigned long)TYPING_STAT_LATENCY_BASE << (b == TYPING_STAT_BUCKETS - 1 ? b - 1 : b),
+                s->latency[b]);
+    }
+    print("\n");
+#endif
+}
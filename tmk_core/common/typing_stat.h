@@ -0,0 +1,100 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TYPING_STAT_H
+#define TYPING_STAT_H
+
+#include <stdint.h>
+#include "keyboard.h"
+
+
+/*
+ * Typing statistics(TYPING_STAT_ENABLE)
+ *
+ * Updated with fixed work at each key event of action_exec() and keyboard
+ * report, read by host through telemetry commands C7 and C8 or shown by
+ * Magic+T, so that worn or failing units show up as rising latency or odd
+ * holds without debug print which changes timing:
+ *
+ *   presses    key presses since clear
+ *   kpm        presses in last whole minute, and moving average of minutes
+ *              with presses(1/16)
+ *   hold       mean hold time of all keys(ms) and of each key(1/16 ms,
+ *              moving average of its last holds or so)
+ *   latency    keyboard reports by time from start of scan which found the
+ *              event to handing report to host driver(us), buckets of
+ *              TYPING_STAT_LATENCY_BASE << n, last one takes the rest
+ *
+ * Report counts for latency only when it comes of events of the last scan,
+ * not after tapping term or macro wait. Holds are timed for
+ * TYPING_STAT_HELD keys down at once, more keys are counted but not timed.
+ * Each key takes 4 bytes of RAM.
+ */
+#ifndef TYPING_STAT_HELD
+#define TYPING_STAT_HELD            8
+#endif
+#ifndef TYPING_STAT_BUCKETS
+#define TYPING_STAT_BUCKETS         8
+#endif
+#ifndef TYPING_STAT_LATENCY_BASE
+#define TYPING_STAT_LATENCY_BASE    128
+#endif
+
+typedef struct {
+    uint32_t presses;
+    uint32_t hold_sum;          /* ms of holds timed */
+    uint32_t hold_count;
+    uint16_t kpm;
+    uint16_t kpm_avg;           /* 1/16 */
+    uint16_t latency_max;       /* us, saturated */
+    uint16_t latency[TYPING_STAT_BUCKETS];
+} typing_stat_t;
+
+typedef struct {
+    uint16_t presses;           /* saturated */
+    uint16_t hold;              /* 1/16 ms */
+} typing_key_stat_t;
+
+
+#ifdef TYPING_STAT_ENABLE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* start of matrix scan, and of taking events scanned in interrupt */
+void typing_stat_scan(void);
+/* key event from matrix, from action_exec() */
+void typing_stat_key(keyevent_t event);
+/* keyboard report given to host driver */
+void typing_stat_report(void);
+/* kpm is brought up to date by reading */
+const typing_stat_t *typing_stat(void);
+const typing_key_stat_t *typing_key_stat(uint8_t row, uint8_t col);
+void typing_stat_clear(void);
+void typing_stat_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#else
+#define typing_stat_scan()
+#define typing_stat_key(event)
+#define typing_stat_report()
+#endif
+
+#endif
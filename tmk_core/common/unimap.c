@@ -2,6 +2,9 @@
 #include "action.h"
 #include "unimap.h"
 #include "print.h"
+#ifdef KEYMAP_PACK_ENABLE
+#   include "keymap_pack.h"
+#endif
 #if defined(__AVR__)
 #   include <avr/pgmspace.h>
 #endif
@@ -15,18 +18,32 @@ extern const uint8_t unimap_trans[MATRIX_ROWS][MATRIX_COLS];
 
 
 
-// translates raw matrix to universal map
-keypos_t unimap_translate(keypos_t key)
+/* Translation of last key looked up. action_for_key() is called for the
+ * same key on every layer walked by current_layer_for_key() and once more
+ * for its action, so the table is read once per key instead. */
+static keypos_t last_key = { .col = 0xFF, .row = 0xFF };
+static uint8_t last_pos = UNIMAP_NO;
+
+static uint8_t unimap_pos(keypos_t key)
 {
-    uint8_t unimap_pos = 
+    if (!KEYEQ(key, last_key)) {
+        last_key = key;
 #if defined(__AVR__)
-        pgm_read_byte(&unimap_trans[key.row][key.col]);
+        last_pos = pgm_read_byte(&unimap_trans[key.row][key.col]);
 #else
-        unimap_trans[key.row][key.col];
+        last_pos = unimap_trans[key.row][key.col];
 #endif
+    }
+    return last_pos;
+}
+
+// translates raw matrix to universal map
+keypos_t unimap_translate(keypos_t key)
+{
+    uint8_t pos = unimap_pos(key);
     return (keypos_t) {
-        .row = ((unimap_pos & 0xf0) >> 4),
-        .col = (unimap_pos & 0x0f)
+        .row = ((pos & 0xf0) >> 4),
+        .col = (pos & 0x0f)
     };
 }
 
@@ -34,17 +51,28 @@ keypos_t unimap_translate(keypos_t key)
 __attribute__ ((weak))
 action_t action_for_key(uint8_t layer, keypos_t key)
 {
-    keypos_t uni = unimap_translate(key);
-    if ((uni.row << 4 | uni.col) == UNIMAP_NO) {
+    uint8_t pos = unimap_pos(key);
+    if (pos == UNIMAP_NO) {
         return (action_t)ACTION_NO;
     }
-#if defined(__AVR__)
-    return (action_t)pgm_read_word(&actionmaps[(layer)][(uni.row & 0x7)][(uni.col)]);
+    uint8_t row = (pos >> 4) & 0x7;
+    uint8_t col = pos & 0x0f;
+#if defined(KEYMAP_PACK_ENABLE)
+    return (action_t)keymap_pack_get(layer, row, col);
+#elif defined(__AVR__)
+    return (action_t)pgm_read_word(&actionmaps[layer][row][col]);
 #else
-    return actionmaps[(layer)][(uni.row & 0x7)][(uni.col)];
+    return actionmaps[layer][row][col];
 #endif
 }
 
+/* action of actionmap has no side effect */
+__attribute__ ((weak))
+bool keymap_key_is_transparent(uint8_t layer, keypos_t key)
+{
+    return action_for_key(layer, key).code == (action_t)ACTION_TRANSPARENT.code;
+}
+
 /* Macro */
 __attribute__ ((weak))
 const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt)
@@ -44,6 +44,30 @@ uint8_t  bitrev(uint8_t bits);
 uint16_t bitrev16(uint16_t bits);
 uint32_t bitrev32(uint32_t bits);
 
+// least significant on-bit - return number of off-bits below it
+// NOTE: bits must not be 0
+#ifdef __AVR__
+/* no instruction for this, nibble table */
+static inline uint8_t bitctz(uint8_t bits)
+{
+    static const uint8_t ctz4[16] = { 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
+    return (bits & 0x0F) ? ctz4[bits & 0x0F] : 4 + ctz4[bits >> 4];
+}
+static inline uint8_t bitctz16(uint16_t bits)
+{
+    return (bits & 0xFF) ? bitctz(bits) : 8 + bitctz(bits >> 8);
+}
+static inline uint8_t bitctz32(uint32_t bits)
+{
+    return (bits & 0xFFFF) ? bitctz16(bits) : 16 + bitctz16(bits >> 16);
+}
+#else
+/* RBIT and CLZ on Cortex-M3/M4, CLZ-less M0 gets libgcc */
+static inline uint8_t bitctz(uint8_t bits)     { return __builtin_ctz(bits); }
+static inline uint8_t bitctz16(uint16_t bits)  { return __builtin_ctz(bits); }
+static inline uint8_t bitctz32(uint32_t bits)  { return __builtin_ctzl(bits); }
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,6 +15,10 @@ extern "C" {
 #   define wait_us(us) chThdSleepMicroseconds(us)
 #elif defined(__arm__) /* __AVR__ */
 #   include "wait_api.h"
+#elif defined(PROTOCOL_NATIVE) /* __AVR__ */
+#   include <stdint.h>
+void wait_ms(uint16_t ms);
+void wait_us(uint16_t us);
 #endif /* __AVR__ */
 
 #ifdef __cplusplus
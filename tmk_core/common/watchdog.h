@@ -0,0 +1,95 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+
+
+/*
+ * Hang detection(WATCHDOG_ENABLE, AVR), Magic+W
+ *
+ * Watchdog resets MCU when keyboard_task() is not called for WATCHDOG_WDTO,
+ * e.g. ps2_host_send() waiting for clock of a device which went away. Each
+ * stage of the loop and of protocol code which can block leaves its number
+ * in watchdog_stage, left in .noinit so that it survives the reset. Startup
+ * code takes reset cause(MCUSR) before anything else, watchdog_init() prints
+ * it with the stage it hung in and Magic+W or telemetry command C6 reads it
+ * later:
+ *
+ *     watchdog: reset at stage 8(ps2 send) MCUSR:08 count:1
+ *
+ * Timeout is long enough for synchronous macros and waits of converters.
+ * Suspend leaves watchdog to its own use while MCU sleeps and resumes it.
+ */
+#ifndef WATCHDOG_WDTO
+#define WATCHDOG_WDTO   WDTO_2S
+#endif
+
+enum watchdog_stage {
+    WATCHDOG_BOOT,          /* startup until keyboard_init() */
+    WATCHDOG_LOOP,          /* out of keyboard_task(), protocol main loop */
+    WATCHDOG_SCAN,          /* matrix_scan() */
+    WATCHDOG_ACTION,        /* action_exec() of matrix change */
+    WATCHDOG_TIMED,         /* deadlines, eeconfig and extra reports */
+    WATCHDOG_MOUSE,         /* keyboard_mouse_task() */
+    WATCHDOG_LED,           /* LED update */
+    WATCHDOG_REPORT,        /* host_keyboard_send() */
+    WATCHDOG_PS2_SEND,      /* ps2_host_send() */
+    WATCHDOG_PS2_RECV,      /* ps2_host_recv_response() */
+    WATCHDOG_ADB_TALK,      /* adb_host_talk() */
+    WATCHDOG_ADB_LISTEN,    /* adb_host_listen() */
+    WATCHDOG_USB_HOST,      /* USB::Task() of usb_usb */
+    WATCHDOG_SUSPEND,       /* suspend_power_down() */
+};
+
+#ifdef WATCHDOG_ENABLE
+#include <avr/wdt.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern volatile uint8_t watchdog_stage;
+/* MCUSR taken by startup code in .init3, see avr/bootloader.c */
+extern uint8_t watchdog_mcusr;
+
+/* prints reset by watchdog and starts it, end of keyboard_init() */
+void watchdog_init(void);
+/* after suspend used watchdog for sleep */
+void watchdog_resume(void);
+/* reset cause, stage before reset and resets by watchdog since power on */
+uint8_t watchdog_reset_cause(void);
+uint8_t watchdog_reset_stage(void);
+uint8_t watchdog_reset_count(void);
+void watchdog_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* each keyboard_task() */
+#define watchdog_kick()     wdt_reset()
+#define WATCHDOG_STAGE(s)   (watchdog_stage = (s))
+#else
+#define WATCHDOG_STAGE(s)   ((void)0)
+#define watchdog_init()
+#define watchdog_kick()
+#define watchdog_resume()
+#endif
+
+#endif
@@ -207,16 +207,24 @@ SECTIONS
   /* keymap region is located at end of flash
    * .fn_actions        Fn actions definitions
    * .keymaps           Mapping layers
+   * .keymap_header     Image header at last 16 bytes, see common/keymap_image.h
    */
   .keymap :
   {
     PROVIDE(__keymap_start = .) ;
     *(.keymap.fn_actions)   /* 32*actions = 64bytes */
+    PROVIDE(__keymap_fn_actions_end = .) ;
     . = ALIGN(0x40);
+    PROVIDE(__keymap_keymaps = .) ;
     *(.keymap.keymaps)      /* rest of .keymap section */
-    *(.keymap*)
+    PROVIDE(__keymap_keymaps_end = .) ;
+    *(.keymap.*)
     /* . = ALIGN(0x800); */ /* keymap section takes 2KB- */
   } > keymap = 0x00         /* zero fill */
+  .keymap_header ORIGIN(keymap) + LENGTH(keymap) - 0x10 :
+  {
+    KEEP(*(.keymap_header))
+  } > keymap
   .eeprom  :
   {
     *(.eeprom*)
@@ -29,13 +29,13 @@ endif
 ifeq (yes,$(strip $(SERIAL_MOUSE_MICROSOFT_ENABLE)))
     SRC += $(PROTOCOL_DIR)/serial_mouse_microsoft.c
     OPT_DEFS += -DSERIAL_MOUSE_ENABLE -DSERIAL_MOUSE_MICROSOFT \
-                -DMOUSE_ENABLE
+                -DMOUSE_ENABLE -DSERIAL_RX_CALLBACK
 endif
 
 ifeq (yes,$(strip $(SERIAL_MOUSE_MOUSESYSTEMS_ENABLE)))
     SRC += $(PROTOCOL_DIR)/serial_mouse_mousesystems.c
     OPT_DEFS += -DSERIAL_MOUSE_ENABLE -DSERIAL_MOUSE_MOUSESYSTEMS \
-                -DMOUSE_ENABLE
+                -DMOUSE_ENABLE -DSERIAL_RX_CALLBACK
 endif
 
 ifeq (yes,$(strip $(SERIAL_MOUSE_USE_SOFT)))
@@ -50,5 +50,12 @@ ifeq (yes,$(strip $(ADB_MOUSE_ENABLE)))
 	 OPT_DEFS += -DADB_MOUSE_ENABLE -DMOUSE_ENABLE
 endif
 
+# Link of split keyboard halves on hardware UART, see protocol/split_serial.h
+ifeq (yes,$(strip $(SPLIT_SERIAL_ENABLE)))
+    SRC += $(PROTOCOL_DIR)/split_serial.c
+    SRC += $(PROTOCOL_DIR)/serial_uart.c
+    OPT_DEFS += -DSPLIT_SERIAL_ENABLE
+endif
+
 # Search Path
 VPATH += $(TMK_DIR)/protocol
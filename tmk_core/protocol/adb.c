@@ -37,10 +37,12 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <util/delay.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "adb.h"
+#include "watchdog.h"
 
 
 // GCC doesn't inline functions normally
@@ -61,6 +63,13 @@ static inline void send_byte(uint8_t data);
 static inline uint16_t wait_data_lo(uint16_t us);
 static inline uint16_t wait_data_hi(uint16_t us);
 
+static bool srq = false;
+
+#ifdef ADB_USE_ICP
+static uint16_t talk_icp(uint8_t addr, uint8_t reg);
+static void wait_icp(void);
+#endif
+
 
 void adb_host_init(void)
 {
@@ -92,8 +101,21 @@ uint16_t adb_host_kbd_recv(uint8_t addr)
 }
 
 #ifdef ADB_MOUSE_ENABLE
-void adb_mouse_init(void) {
-	    return;
+static uint8_t mouse_handler = 0;
+
+void adb_mouse_init(void)
+{
+    // Switch to Extended Mouse Protocol, mouse keeps its handler if it doesn't support it.
+    // Listen Register3
+    //  upper byte: reserved bits 00, SRQ enable 1, 0, mouse address 0011
+    //  lower byte: device handler 00000100
+    adb_host_listen(ADB_ADDR_MOUSE, ADB_REG_3, 0x20 | ADB_ADDR_MOUSE, ADB_HANDLER_EXTENDED_MOUSE);
+    mouse_handler = (uint8_t) adb_host_talk(ADB_ADDR_MOUSE, ADB_REG_3);
+}
+
+uint8_t adb_mouse_handler(void)
+{
+    return mouse_handler;
 }
 
 uint16_t adb_host_mouse_recv(void)
@@ -102,17 +124,123 @@ uint16_t adb_host_mouse_recv(void)
 }
 #endif
 
+
+/*
+ * Bus enumeration
+ *
+ * Devices of a kind come up at the same default address and collision
+ * detection lets one of them win Talk. Listen Register3 with handler 0xFE
+ * moves only the device that won last Talk, so devices at default address are
+ * moved one by one to free address from 15 down until nobody answers there,
+ * and the last one moved goes back. Register3 has 0 in bit15, any other
+ * response tells just that someone is at the address.
+ * ADB Manager(5-12) "Address Resolution"
+ */
+#define ADB_HANDLER_MOVE    0xFE
+#define REG3_VALID(reg3)    ((reg3) && !((reg3) & 0x8000))
+
+static adb_device_t devices[ADB_ADDR_MAX];
+static uint8_t device_count = 0;
+
+/* some of controllers miss Talk in a row */
+static uint16_t talk_reg3(uint8_t addr)
+{
+    _delay_ms(20);
+    return adb_host_talk(addr, ADB_REG_3);
+}
+
+static void move_device(uint8_t from, uint8_t to)
+{
+    // Listen Register3: exceptional event 1, SRQ enable 1, and new address
+    adb_host_listen(from, ADB_REG_3, 0x60 | to, ADB_HANDLER_MOVE);
+}
+
+uint8_t adb_bus_enumerate(void)
+{
+    uint8_t kind[ADB_ADDR_MAX + 1] = {};
+    uint16_t used = 0;
+
+    for (uint8_t addr = 1; addr <= ADB_ADDR_MAX; addr++) {
+        if (talk_reg3(addr)) used |= (1U<<addr);
+    }
+    // devices moved by last enumeration keep their kind
+    for (uint8_t addr = 1; addr <= ADB_ADDR_APPLIANCE; addr++) kind[addr] = addr;
+    for (uint8_t i = 0; i < device_count; i++) {
+        if (devices[i].addr > ADB_ADDR_APPLIANCE) kind[devices[i].addr] = devices[i].kind;
+    }
+
+    for (uint8_t addr = 1; addr <= ADB_ADDR_APPLIANCE; addr++) {
+        if (!(used & (1U<<addr))) continue;
+
+        uint8_t moved = 0;
+        for (;;) {
+            uint8_t to = ADB_ADDR_MAX;
+            while (to > ADB_ADDR_APPLIANCE && (used & (1U<<to))) to--;
+            if (to == ADB_ADDR_APPLIANCE) break;    // no free address
+            if (!talk_reg3(addr)) break;            // nobody left
+            move_device(addr, to);
+            if (!talk_reg3(to)) break;              // nobody moved
+            used |= (1U<<to);
+            kind[to] = addr;
+            moved = to;
+        }
+        if (moved && !talk_reg3(addr)) {
+            move_device(moved, addr);
+            used &= ~(1U<<moved);
+        }
+    }
+
+    device_count = 0;
+    for (uint8_t addr = 1; addr <= ADB_ADDR_MAX; addr++) {
+        if (!(used & (1U<<addr))) continue;
+        uint16_t reg3 = talk_reg3(addr);
+        if (!REG3_VALID(reg3)) continue;
+        devices[device_count++] = (adb_device_t){
+            .addr = addr, .kind = kind[addr], .handler = reg3 & 0xFF
+        };
+    }
+    return device_count;
+}
+
+uint8_t adb_bus_count(void)
+{
+    return device_count;
+}
+
+const adb_device_t *adb_bus_device(uint8_t i)
+{
+    return (i < device_count) ? &devices[i] : NULL;
+}
+
+uint8_t adb_bus_update(uint8_t addr)
+{
+    for (uint8_t i = 0; i < device_count; i++) {
+        if (devices[i].addr != addr) continue;
+        uint16_t reg3 = talk_reg3(addr);
+        if (REG3_VALID(reg3)) devices[i].handler = reg3 & 0xFF;
+        return devices[i].handler;
+    }
+    return 0;
+}
+
 uint16_t adb_host_talk(uint8_t addr, uint8_t reg)
 {
+    WATCHDOG_STAGE(WATCHDOG_ADB_TALK);
+#ifdef ADB_USE_ICP
+    return talk_icp(addr, reg);
+#else
     uint16_t data = 0;
     cli();
     attention();
     send_byte((addr<<4) | (ADB_CMD_TALK<<2) | reg);
     place_bit0();               // Stopbit(0)
-    if (!wait_data_hi(500)) {    // Service Request(310us Adjustable Keyboard): just ignored
+    // Service Request: other device holds Stopbit lo for 300us in total(310us Adjustable Keyboard)
+    uint16_t srq_wait = wait_data_hi(500);
+    if (!srq_wait) {
         sei();
         return -30;             // something wrong
     }
+    srq = (srq_wait < 500 - 50);
     if (!wait_data_lo(500)) {   // Tlt/Stop to Start(140-260us)
         sei();
         return 0;               // No data to send
@@ -154,10 +282,89 @@ uint16_t adb_host_talk(uint8_t addr, uint8_t reg)
 error:
     sei();
     return -n;
+#endif
+}
+
+/*
+ * Talk with busy wait for response longer than 16 bits, Extended Mouse Protocol
+ * sends 3 to 8 bytes. Length is told by Stopbit that is the only cell whose
+ * high state isn't followed by another cell.
+ */
+uint8_t adb_host_talk_buf(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len)
+{
+#ifdef ADB_USE_ICP
+    wait_icp();
+#endif
+    uint8_t n = 0;              // bytes received
+    uint8_t bits = 0;           // bits of current byte
+    uint8_t data = 0;
+    bool start = true;
+    cli();
+    attention();
+    send_byte((addr<<4) | (ADB_CMD_TALK<<2) | reg);
+    place_bit0();               // Stopbit(0)
+    uint16_t srq_wait = wait_data_hi(500);
+    if (!srq_wait)
+        goto error;             // something wrong
+    srq = (srq_wait < 500 - 50);
+    if (!wait_data_lo(500))
+        goto error;             // No data to send
+
+    for (;;) {
+        uint8_t lo = (uint8_t) wait_data_hi(130);
+        if (!lo) {
+            // Stopbit lengthened with service request
+            if (!start && !bits && wait_data_hi(351)) {
+                srq = true;
+                break;
+            }
+            goto error;
+        }
+
+        uint8_t hi = (uint8_t) wait_data_lo(lo);
+        if (!hi)
+            break;              // Stopbit
+
+        hi = lo - hi;
+        lo = 130 - lo;
+
+        if (start) {
+            if (lo >= hi)
+                goto error;     // Startbit should be 1
+            start = false;
+            continue;
+        }
+        data <<= 1;
+        if (lo < hi) {
+            data |= 1;
+        }
+        if (++bits == 8) {
+            if (n == len)
+                goto error;
+            buf[n++] = data;
+            bits = 0;
+        }
+    }
+    sei();
+    return bits ? 0 : n;
+
+error:
+    sei();
+    return 0;
+}
+
+/* other device asked for service during last Talk */
+bool adb_host_srq(void)
+{
+    return srq;
 }
 
 void adb_host_listen(uint8_t addr, uint8_t reg, uint8_t data_h, uint8_t data_l)
 {
+    WATCHDOG_STAGE(WATCHDOG_ADB_LISTEN);
+#ifdef ADB_USE_ICP
+    wait_icp();
+#endif
     cli();
     attention();
     send_byte((addr<<4) | (ADB_CMD_LISTEN<<2) | reg);
@@ -180,6 +387,151 @@ void adb_host_kbd_led(uint8_t addr, uint8_t led)
 }
 
 
+#ifdef ADB_USE_ICP
+/*
+ * Talk with Timer1 input capture
+ *
+ * Command is still sent by the CPU with interrupts disabled, since cell timing
+ * of host is made of delays. Response of device is timed by the capture unit
+ * and decoded in its ISR so that interrupts are enabled and main loop can run
+ * while device is talking(up to 2.5ms with Service Request).
+ * Data line should be on ICP1 pin. Timer1 runs in normal mode at F_CPU/8.
+ */
+#if defined(SLEEP_LED_ENABLE)
+#   error "ADB_USE_ICP can't be used with SLEEP_LED_ENABLE, both need Timer1."
+#endif
+#if (defined(__AVR_ATmega32U4__) || defined(__AVR_AT90USB1286__) || defined(__AVR_AT90USB646__)) && \
+    ADB_DATA_BIT != 4
+#   error "ADB_USE_ICP: data line should be on ICP1(PD4)."
+#endif
+
+#define ICP_US(us)  ((uint16_t)((F_CPU / 8) / 1000000.0 * (us)))
+
+static volatile enum {
+    ICP_IDLE,
+    ICP_BUSY,
+    ICP_DONE,
+} icp_state = ICP_IDLE;
+static volatile uint16_t icp_result;
+/* ISR only while ICP_BUSY */
+static uint16_t icp_data;
+static uint16_t icp_fall;   // time of falling edge of current cell
+static uint8_t icp_bits;    // cells received: start bit, 16 data bits and stop bit
+static bool icp_srq;        // waiting for end of Service Request
+
+static inline void icp_timeout(uint16_t from, uint16_t ticks)
+{
+    OCR1B = from + ticks;
+    TIFR1 = (1<<OCF1B);
+}
+
+static inline void icp_finish(uint16_t result)
+{
+    TIMSK1 &= ~((1<<ICIE1) | (1<<OCIE1B));
+    icp_result = result;
+    icp_state = ICP_DONE;
+}
+
+bool adb_host_talk_start(uint8_t addr, uint8_t reg)
+{
+    if (icp_state != ICP_IDLE) return false;
+
+    TCCR1A = 0;
+    TCCR1B = (1<<CS11);         // normal mode, F_CPU/8, capture on falling edge
+    cli();
+    attention();
+    send_byte((addr<<4) | (ADB_CMD_TALK<<2) | reg);
+    place_bit0();               // Stopbit(0)
+
+    uint16_t now = TCNT1;
+    icp_data = 0;
+    icp_bits = 0;
+    // Service Request: other device holds Stopbit lo longer
+    icp_srq = srq = !data_in();
+    if (icp_srq) TCCR1B |= (1<<ICES1);
+    TIFR1 = (1<<ICF1);
+    icp_timeout(now, ICP_US(500));
+    icp_state = ICP_BUSY;
+    TIMSK1 |= (1<<ICIE1) | (1<<OCIE1B);
+    sei();
+    return true;
+}
+
+bool adb_host_talk_done(uint16_t *data)
+{
+    if (icp_state != ICP_DONE) return false;
+    *data = icp_result;
+    icp_state = ICP_IDLE;
+    return true;
+}
+
+/* wait for response of Talk on the bus */
+static void wait_icp(void)
+{
+    while (icp_state == ICP_BUSY) ;
+}
+
+static uint16_t talk_icp(uint8_t addr, uint8_t reg)
+{
+    uint16_t data;
+    wait_icp();
+    adb_host_talk_done(&data);  // drop result nobody picked up
+    adb_host_talk_start(addr, reg);
+    while (!adb_host_talk_done(&data)) ;
+    return data;
+}
+
+ISR(TIMER1_CAPT_vect)
+{
+    uint16_t t = ICR1;
+    bool rising = TCCR1B & (1<<ICES1);
+    TCCR1B ^= (1<<ICES1);
+    TIFR1 = (1<<ICF1);          // needed after changing edge
+
+    if (!rising) {
+        icp_fall = t;
+        // Stopbit can be lengthened with Service Request
+        icp_timeout(t, ICP_US(icp_bits == 17 ? 351 : 130));
+        return;
+    }
+    if (icp_srq) {
+        icp_srq = false;
+        icp_timeout(t, ICP_US(500));    // Tlt/Stop to Start(140-260us)
+        return;
+    }
+
+    bool bit1 = (uint16_t)(t - icp_fall) < ICP_US(50);  // lo 35us for 1, 65us for 0
+    icp_bits++;
+    if (icp_bits == 1) {
+        if (!bit1) {
+            icp_finish(-20);
+            return;
+        }
+    } else if (icp_bits <= 17) {
+        icp_data <<= 1;
+        if (bit1) icp_data |= 1;
+    } else {
+        icp_finish(icp_data);
+        return;
+    }
+    icp_timeout(t, ICP_US(130));
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+    if (icp_srq) {
+        icp_finish(-30);        // something wrong
+    } else if (icp_bits == 0 && data_in()) {
+        icp_finish(0);          // No data to send
+    } else if (icp_bits >= 17) {
+        icp_finish(-21);
+    } else {
+        icp_finish(-(17 - icp_bits));
+    }
+}
+#endif
+
+
 #ifdef ADB_PSW_BIT
 static inline void psw_lo()
 {
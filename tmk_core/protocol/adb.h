@@ -69,6 +69,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #define ADB_REG_1           1
 #define ADB_REG_2           2
 #define ADB_REG_3           3
+// Address 8-15 are free for devices moved from default address
+#define ADB_ADDR_MAX        15
 
 /* ADB keyboard handler id */
 #define ADB_HANDLER_M0116               0x01
@@ -78,6 +80,11 @@ POSSIBILITY OF SUCH DAMAGE.
 #define ADB_HANDLER_M1242_ANSI          0x10
 #define ADB_HANDLER_EXTENDED_PROTOCOL   0x03
 
+/* ADB mouse handler id */
+#define ADB_HANDLER_CLASSIC1_MOUSE      0x01
+#define ADB_HANDLER_CLASSIC2_MOUSE      0x02
+#define ADB_HANDLER_EXTENDED_MOUSE      0x04
+
 
 // ADB host
 void     adb_host_init(void);
@@ -85,10 +92,36 @@ bool     adb_host_psw(void);
 uint16_t adb_host_kbd_recv(uint8_t addr);
 uint16_t adb_host_mouse_recv(void);
 uint16_t adb_host_talk(uint8_t addr, uint8_t reg);
+/* Talk with response of any length up to len bytes, returns bytes received or 0 */
+uint8_t  adb_host_talk_buf(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len);
+bool     adb_host_srq(void);
+#ifdef ADB_USE_ICP
+/* start Talk and return, response is decoded with input capture interrupt */
+bool     adb_host_talk_start(uint8_t addr, uint8_t reg);
+bool     adb_host_talk_done(uint16_t *data);
+#endif
 void     adb_host_listen(uint8_t addr, uint8_t reg, uint8_t data_h, uint8_t data_l);
 void     adb_host_kbd_led(uint8_t addr, uint8_t led);
 void     adb_mouse_task(void);
 void     adb_mouse_init(void);
+/* handler id mouse runs with after adb_mouse_init() */
+uint8_t  adb_mouse_handler(void);
+
+/* ADB bus
+ * Devices sharing default address are moved to free addresses, one of each
+ * kind stays at default address. Table of devices keeps handler ids.
+ */
+typedef struct {
+    uint8_t addr;       // address on bus
+    uint8_t kind;       // default address it came from, ADB_ADDR_*, 0 unknown
+    uint8_t handler;    // handler id in Register3
+} adb_device_t;
+
+uint8_t  adb_bus_enumerate(void);
+uint8_t  adb_bus_count(void);
+const adb_device_t *adb_bus_device(uint8_t i);
+/* reread handler id of device after Listen Register3, 0 if not found */
+uint8_t  adb_bus_update(uint8_t addr);
 
 
 #endif
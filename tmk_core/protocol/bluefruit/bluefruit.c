@@ -19,19 +19,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 #include "host.h"
 #include "report.h"
 #include "print.h"
 #include "debug.h"
 #include "host_driver.h"
 #include "serial.h"
+#include "serial_frame.h"
+#include "timer.h"
 #include "bluefruit.h"
 
-#define BLUEFRUIT_TRACE_SERIAL 1
+/* define BLUEFRUIT_TRACE_SERIAL in config.h to echo frames to debug console,
+ * it takes far longer than the frame on serial */
 
 static uint8_t bluefruit_keyboard_leds = 0;
 
-static void bluefruit_serial_send(uint8_t);
+static void mouse_task(void);
 
 void bluefruit_keyboard_print_report(report_keyboard_t *report)
 {
@@ -56,14 +61,19 @@ static void bluefruit_trace_footer()
 }
 #endif
 
-static void bluefruit_serial_send(uint8_t data)
+/* frame is written by serial_frame_task() as serial takes it */
+static void frame_queued(uint8_t *f, uint8_t len)
 {
 #ifdef BLUEFRUIT_TRACE_SERIAL
-    dprintf(" ");
-    debug_hex8(data);
-    dprintf(" ");
+    bluefruit_trace_header();
+    for (uint8_t i = 0; i < len; i++) {
+        dprintf(" ");
+        debug_hex8(f[i]);
+        dprintf(" ");
+    }
+    bluefruit_trace_footer();
 #endif
-    serial_send(data);
+    serial_frame_task();
 }
 
 /*------------------------------------------------------------------*
@@ -95,35 +105,92 @@ static uint8_t keyboard_leds(void) {
 
 static void send_keyboard(report_keyboard_t *report)
 {
-#ifdef BLUEFRUIT_TRACE_SERIAL   
-    bluefruit_trace_header();
-#endif
-    bluefruit_serial_send(0xFD);
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_SIZE; i++) {
-        bluefruit_serial_send(report->raw[i]);
-    }
-#ifdef BLUEFRUIT_TRACE_SERIAL   
-    bluefruit_trace_footer();   
+    uint8_t *f = serial_frame_alloc(SERIAL_FRAME_KEYBOARD, 1 + KEYBOARD_REPORT_SIZE);
+    f[0] = 0xFD;
+    memcpy(&f[1], report->raw, KEYBOARD_REPORT_SIZE);
+    frame_queued(f, 1 + KEYBOARD_REPORT_SIZE);
+}
+
+/*
+ * Mouse report rate limit
+ *
+ * Motion is merged and sent once in BLUEFRUIT_MOUSE_INTERVAL so that mouse
+ * takes bounded share of the link, button change is sent at once. Report
+ * without motion nor button change is dropped.
+ */
+#ifndef BLUEFRUIT_MOUSE_INTERVAL
+#define BLUEFRUIT_MOUSE_INTERVAL 10
 #endif
+static report_mouse_t mouse_report = {};    // buttons sent and motion merged since
+static bool mouse_pending = false;
+static uint16_t mouse_time = 0;
+
+static bool mouse_merge(report_mouse_t *report)
+{
+    int16_t x = mouse_report.x + report->x;
+    int16_t y = mouse_report.y + report->y;
+    int16_t v = mouse_report.v + report->v;
+    int16_t h = mouse_report.h + report->h;
+    if (x < -127 || x > 127 || y < -127 || y > 127 ||
+        v < -127 || v > 127 || h < -127 || h > 127)
+        return false;
+    mouse_report.x = x;
+    mouse_report.y = y;
+    mouse_report.v = v;
+    mouse_report.h = h;
+    if (report->x || report->y || report->v || report->h)
+        mouse_pending = true;
+    return true;
+}
+
+static void mouse_flush(void)
+{
+    uint8_t *f = serial_frame_alloc(SERIAL_FRAME_MOUSE, 9);
+    f[0] = 0xFD;
+    f[1] = 0x00;
+    f[2] = 0x03;
+    f[3] = mouse_report.buttons;
+    f[4] = mouse_report.x;
+    f[5] = mouse_report.y;
+    f[6] = mouse_report.v; // should try sending the wheel v here
+    f[7] = mouse_report.h; // should try sending the wheel h here
+    f[8] = 0x00;
+    frame_queued(f, 9);
+
+    mouse_report.x = mouse_report.y = mouse_report.v = mouse_report.h = 0;
+    mouse_pending = false;
+    mouse_time = timer_read();
 }
 
 static void send_mouse(report_mouse_t *report)
 {
-#ifdef BLUEFRUIT_TRACE_SERIAL   
-    bluefruit_trace_header();
-#endif
-    bluefruit_serial_send(0xFD);
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x03);
-    bluefruit_serial_send(report->buttons);
-    bluefruit_serial_send(report->x);
-    bluefruit_serial_send(report->y);
-    bluefruit_serial_send(report->v); // should try sending the wheel v here
-    bluefruit_serial_send(report->h); // should try sending the wheel h here
-    bluefruit_serial_send(0x00);
-#ifdef BLUEFRUIT_TRACE_SERIAL
-    bluefruit_trace_footer();
-#endif
+    if (!mouse_merge(report)) {
+        // sum overflows, send earlier motion first
+        mouse_flush();
+        mouse_merge(report);
+    }
+    if (report->buttons != mouse_report.buttons) {
+        mouse_report.buttons = report->buttons;
+        mouse_flush();
+        return;
+    }
+    mouse_task();
+}
+
+/* send motion merged when its interval has passed */
+static void mouse_task(void)
+{
+    if (mouse_pending && timer_elapsed(mouse_time) >= BLUEFRUIT_MOUSE_INTERVAL) {
+        mouse_flush();
+    }
+}
+
+/* call in main loop to write queued frames and merged motion */
+void bluefruit_task(void)
+{
+    serial_send_task();
+    serial_frame_task();
+    mouse_task();
 }
 
 static void send_system(uint16_t data)
@@ -184,19 +251,17 @@ static void send_consumer(uint16_t data)
     dprintf("; bitmap: "); 
     debug_hex16(bitmap); 
     dprintf("\n");
-    bluefruit_trace_header();
-#endif
-    bluefruit_serial_send(0xFD);
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x02);
-    bluefruit_serial_send((bitmap>>8)&0xFF);
-    bluefruit_serial_send(bitmap&0xFF); 
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x00);
-#ifdef BLUEFRUIT_TRACE_SERIAL
-    bluefruit_trace_footer();
 #endif
+    uint8_t *f = serial_frame_alloc(SERIAL_FRAME_CONSUMER, 9);
+    f[0] = 0xFD;
+    f[1] = 0x00;
+    f[2] = 0x02;
+    f[3] = (bitmap>>8)&0xFF;
+    f[4] = bitmap&0xFF;
+    f[5] = 0x00;
+    f[6] = 0x00;
+    f[7] = 0x00;
+    f[8] = 0x00;
+    frame_queued(f, 9);
 }
 
@@ -24,5 +24,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 host_driver_t *bluefruit_driver(void);
+void bluefruit_task(void);
 
 #endif
@@ -86,6 +86,7 @@ int main(void)
         dprintf("Starting main loop");
         while (1) {
             keyboard_task();
+            bluefruit_task();
         }
 
     } else {
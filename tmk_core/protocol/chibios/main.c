@@ -36,6 +36,7 @@
 #endif
 #include "suspend.h"
 #include "hook.h"
+#include "poll_sync.h"
 
 
 /* -------------------------
@@ -49,6 +50,9 @@ void send_keyboard(report_keyboard_t *report);
 void send_mouse(report_mouse_t *report);
 void send_system(uint16_t data);
 void send_consumer(uint16_t data);
+#if defined(EXTRAKEY_ENABLE) && CONSUMER_USAGES > 1
+void send_consumer_report(report_consumer_t *report);
+#endif
 
 /* host struct */
 host_driver_t chibios_driver = {
@@ -56,7 +60,11 @@ host_driver_t chibios_driver = {
   send_keyboard,
   send_mouse,
   send_system,
-  send_consumer
+  send_consumer,
+#if defined(EXTRAKEY_ENABLE) && CONSUMER_USAGES > 1
+  NULL,
+  send_consumer_report
+#endif
 };
 
 /* Default hooks definitions. */
@@ -72,6 +80,7 @@ void hook_usb_suspend_loop(void) {
   suspend_power_down(); // on AVR this deep sleeps for 15ms
   /* Remote wakeup */
   if((USB_DRIVER.status & 2) && suspend_wakeup_condition()) {
+    keyboard_wakeup_keys();
     send_remote_wakeup(&USB_DRIVER);
   }
 }
@@ -96,6 +105,85 @@ void hook_usb_suspend_loop(void) {
 //   }
 // }
 
+/* USB suspend until woken up */
+static void usb_suspend_task(void) {
+  if(USB_DRIVER.state == USB_SUSPENDED) {
+    print("[s]");
+    while(USB_DRIVER.state == USB_SUSPENDED) {
+      hook_usb_suspend_loop();
+    }
+    /* Woken up */
+    // variables have been already cleared
+    send_keyboard_report();
+#ifdef MOUSEKEY_ENABLE
+    mousekey_send();
+#endif /* MOUSEKEY_ENABLE */
+  }
+}
+
+#ifdef CHIBIOS_THREADS
+/* Keyboard on threads(CHIBIOS_THREADS)
+ *   scan    keyboard_task() every CHIBIOS_SCAN_MS, highest; with
+ *           POLL_SYNC_ENABLE until scan is due for next host poll once
+ *           polls are known, POLL_SYNC_MARGIN should cover a system tick
+ *   mouse   keyboard_mouse_task() every CHIBIOS_MOUSE_MS
+ *   main    USB suspend and wakeup, lowest
+ * Console is flushed from virtual timer of usb_main.c in any case.
+ * Mousekey and report state are shared with action_exec(), so TMK code
+ * runs under tmk_mutex; with priority inheritance scan thread waits for
+ * one mouse task at most.
+ */
+#ifndef CHIBIOS_SCAN_MS
+#define CHIBIOS_SCAN_MS     1
+#endif
+#ifndef CHIBIOS_MOUSE_MS
+#define CHIBIOS_MOUSE_MS    2
+#endif
+
+static MUTEX_DECL(tmk_mutex);
+
+static THD_WORKING_AREA(waScanThread, 512);
+static THD_FUNCTION(scanThread, arg) {
+  (void)arg;
+  chRegSetThreadName("scan");
+  systime_t next = chVTGetSystemTime();
+  while(true) {
+    chMtxLock(&tmk_mutex);
+    keyboard_task();
+    chMtxUnlock(&tmk_mutex);
+#ifdef POLL_SYNC_ENABLE
+    /* until scan is due for next poll, late by a tick at most */
+    uint32_t us = poll_sync_wait_us();
+    if(us) {
+      systime_t t = US2ST(us);
+      chThdSleep(t > 1 ? t - 1 : 1);
+      continue;
+    }
+#endif
+    /* period from start of last scan, at once when it took longer */
+    systime_t prev = next;
+    next += MS2ST(CHIBIOS_SCAN_MS);
+    if(chVTIsSystemTimeWithin(prev, next)) {
+      chThdSleepUntilWindowed(prev, next);
+    } else {
+      next = chVTGetSystemTime();
+    }
+  }
+}
+
+static THD_WORKING_AREA(waMouseThread, 256);
+static THD_FUNCTION(mouseThread, arg) {
+  (void)arg;
+  chRegSetThreadName("mouse");
+  while(true) {
+    chMtxLock(&tmk_mutex);
+    keyboard_mouse_task();
+    chMtxUnlock(&tmk_mutex);
+    chThdSleepMilliseconds(CHIBIOS_MOUSE_MS);
+  }
+}
+#endif
+
 
 
 /* Main thread
@@ -141,22 +229,24 @@ int main(void) {
 
   hook_late_init();
 
-  /* Main loop */
-  while(true) {
+#ifdef CHIBIOS_THREADS
+  chThdCreateStatic(waScanThread, sizeof(waScanThread), NORMALPRIO + 2, scanThread, NULL);
+  chThdCreateStatic(waMouseThread, sizeof(waMouseThread), NORMALPRIO + 1, mouseThread, NULL);
 
+  /* Main loop, scan and mouse are stopped while suspended */
+  while(true) {
     if(USB_DRIVER.state == USB_SUSPENDED) {
-      print("[s]");
-      while(USB_DRIVER.state == USB_SUSPENDED) {
-        hook_usb_suspend_loop();
-      }
-      /* Woken up */
-      // variables have been already cleared
-      send_keyboard_report();
-#ifdef MOUSEKEY_ENABLE
-      mousekey_send();
-#endif /* MOUSEKEY_ENABLE */
+      chMtxLock(&tmk_mutex);
+      usb_suspend_task();
+      chMtxUnlock(&tmk_mutex);
     }
-
+    chThdSleepMilliseconds(10);
+  }
+#else
+  /* Main loop */
+  while(true) {
+    usb_suspend_task();
     keyboard_task();
   }
+#endif
 }
@@ -19,6 +19,7 @@
 #include "hal.h"
 
 #include "usb_main.h"
+#include "report_desc.h"
 
 #include "host.h"
 #include "debug.h"
@@ -28,6 +29,9 @@
 #include "led.h"
 #endif
 #include "hook.h"
+#include "bench_gpio.h"
+#include "telemetry.h"
+#include "poll_sync.h"
 
 /* TMK hooks */
 __attribute__((weak))
@@ -58,16 +62,30 @@ uint16_t keyboard_led_stats __attribute__((aligned(2))) = 0;
 volatile uint16_t keyboard_idle_count = 0;
 static virtual_timer_t keyboard_idle_timer;
 static void keyboard_idle_timer_cb(void *arg);
+static void keyboard_idle_arm_I(USBDriver *usbp);
 #ifdef NKRO_ENABLE
 extern bool keyboard_nkro;
 #endif /* NKRO_ENABLE */
 
 report_keyboard_t keyboard_report_sent = {{0}};
+
+/* Keyboard report queue
+ * send_keyboard() only posts a snapshot of the report and the IN callback
+ * sends the next one as soon as the previous has made it IN, so that
+ * keyboard_task() never waits for the endpoint. When the queue is full
+ * the newest snapshot is replaced. Accessed in locked state only. */
+#define KBD_REPORT_QUEUE 4
+static report_keyboard_t kbd_queue[KBD_REPORT_QUEUE];
+static uint8_t kbd_queue_head = 0;
+static uint8_t kbd_queue_len = 0;
+/* buffer of the report being transmitted */
+static report_keyboard_t kbd_report_inflight;
+static void kbd_send_next_I(USBDriver *usbp);
 #ifdef MOUSE_ENABLE
 report_mouse_t mouse_report_blank = {0};
 #endif /* MOUSE_ENABLE */
 #ifdef EXTRAKEY_ENABLE
-uint8_t extra_report_blank[3] = {0};
+uint8_t extra_report_blank[1 + 2 * CONSUMER_USAGES] = {0};
 #endif /* EXTRAKEY_ENABLE */
 
 #ifdef CONSOLE_ENABLE
@@ -78,6 +96,13 @@ static uint8_t console_queue_buffer[BQ_BUFFER_SIZE(CONSOLE_QUEUE_CAPACITY, CONSO
 static virtual_timer_t console_flush_timer;
 void console_queue_onotify(io_buffers_queue_t *bqp);
 static void console_flush_cb(void *arg);
+/* set while thread writes into partial buffer, flush timer keeps off it */
+static volatile bool console_writing = false;
+#define CONSOLE_WRITING(on) do { \
+    __asm__ volatile ("" ::: "memory"); \
+    console_writing = (on); \
+    __asm__ volatile ("" ::: "memory"); \
+} while (0)
 #endif /* CONSOLE_ENABLE */
 
 /* ---------------------------------------------------------
@@ -127,38 +152,7 @@ static const USBDescriptor usb_device_descriptor = {
 
 /* Keyboard Protocol 1, HID 1.11 spec, Appendix B, page 59-60 */
 static const uint8_t keyboard_hid_report_desc_data[] = {
-  0x05, 0x01,                // Usage Page (Generic Desktop),
-  0x09, 0x06,                // Usage (Keyboard),
-  0xA1, 0x01,                // Collection (Application),
-  0x75, 0x01,                //   Report Size (1),
-  0x95, 0x08,                //   Report Count (8),
-  0x05, 0x07,                //   Usage Page (Key Codes),
-  0x19, 0xE0,                //   Usage Minimum (224),
-  0x29, 0xE7,                //   Usage Maximum (231),
-  0x15, 0x00,                //   Logical Minimum (0),
-  0x25, 0x01,                //   Logical Maximum (1),
-  0x81, 0x02,                //   Input (Data, Variable, Absolute), ;Modifier byte
-  0x95, 0x01,                //   Report Count (1),
-  0x75, 0x08,                //   Report Size (8),
-  0x81, 0x03,                //   Input (Constant),                 ;Reserved byte
-  0x95, 0x05,                //   Report Count (5),
-  0x75, 0x01,                //   Report Size (1),
-  0x05, 0x08,                //   Usage Page (LEDs),
-  0x19, 0x01,                //   Usage Minimum (1),
-  0x29, 0x05,                //   Usage Maximum (5),
-  0x91, 0x02,                //   Output (Data, Variable, Absolute), ;LED report
-  0x95, 0x01,                //   Report Count (1),
-  0x75, 0x03,                //   Report Size (3),
-  0x91, 0x03,                //   Output (Constant),                 ;LED report padding
-  0x95, KBD_REPORT_KEYS,          //   Report Count (),
-  0x75, 0x08,                //   Report Size (8),
-  0x15, 0x00,                //   Logical Minimum (0),
-  0x26, 0xFF, 0x00,          //   Logical Maximum(255),
-  0x05, 0x07,                //   Usage Page (Key Codes),
-  0x19, 0x00,                //   Usage Minimum (0),
-  0x29, 0xFF,                //   Usage Maximum (255),
-  0x81, 0x00,                //   Input (Data, Array),
-  0xc0                       // End Collection
+  HID_DESC_KEYBOARD(KBD_REPORT_KEYS)
 };
 /* wrapper */
 static const USBDescriptor keyboard_hid_report_descriptor = {
@@ -168,38 +162,7 @@ static const USBDescriptor keyboard_hid_report_descriptor = {
 
 #ifdef NKRO_ENABLE
 static const uint8_t nkro_hid_report_desc_data[] = {
-  0x05, 0x01,                           // Usage Page (Generic Desktop),
-  0x09, 0x06,                           // Usage (Keyboard),
-  0xA1, 0x01,                           // Collection (Application),
-  // bitmap of modifiers
-  0x75, 0x01,                           //   Report Size (1),
-  0x95, 0x08,                           //   Report Count (8),
-  0x05, 0x07,                           //   Usage Page (Key Codes),
-  0x19, 0xE0,                           //   Usage Minimum (224),
-  0x29, 0xE7,                           //   Usage Maximum (231),
-  0x15, 0x00,                           //   Logical Minimum (0),
-  0x25, 0x01,                           //   Logical Maximum (1),
-  0x81, 0x02,                           //   Input (Data, Variable, Absolute), ;Modifier byte
-  // LED output report
-  0x95, 0x05,                           //   Report Count (5),
-  0x75, 0x01,                           //   Report Size (1),
-  0x05, 0x08,                           //   Usage Page (LEDs),
-  0x19, 0x01,                           //   Usage Minimum (1),
-  0x29, 0x05,                           //   Usage Maximum (5),
-  0x91, 0x02,                           //   Output (Data, Variable, Absolute),
-  0x95, 0x01,                           //   Report Count (1),
-  0x75, 0x03,                           //   Report Size (3),
-  0x91, 0x03,                           //   Output (Constant),
-  // bitmap of keys
-  0x95, NKRO_REPORT_KEYS * 8,           //   Report Count (),
-  0x75, 0x01,                           //   Report Size (1),
-  0x15, 0x00,                           //   Logical Minimum (0),
-  0x25, 0x01,                           //   Logical Maximum(1),
-  0x05, 0x07,                           //   Usage Page (Key Codes),
-  0x19, 0x00,                           //   Usage Minimum (0),
-  0x29, NKRO_REPORT_KEYS * 8 - 1,       //   Usage Maximum (),
-  0x81, 0x02,                           //   Input (Data, Variable, Absolute),
-  0xc0                                  // End Collection
+  HID_DESC_NKRO(NKRO_REPORT_KEYS)
 };
 /* wrapper */
 static const USBDescriptor nkro_hid_report_descriptor = {
@@ -214,53 +177,7 @@ static const USBDescriptor nkro_hid_report_descriptor = {
  * http://www.keil.com/forum/15671/
  * http://www.microsoft.com/whdc/device/input/wheel.mspx */
 static const uint8_t mouse_hid_report_desc_data[] = {
-  /* mouse */
-  0x05, 0x01,                      // USAGE_PAGE (Generic Desktop)
-  0x09, 0x02,                      // USAGE (Mouse)
-  0xa1, 0x01,                      // COLLECTION (Application)
-  //0x85, REPORT_ID_MOUSE,         //   REPORT_ID (1)
-  0x09, 0x01,                      //   USAGE (Pointer)
-  0xa1, 0x00,                      //   COLLECTION (Physical)
-                                   // ----------------------------  Buttons
-  0x05, 0x09,                      //     USAGE_PAGE (Button)
-  0x19, 0x01,                      //     USAGE_MINIMUM (Button 1)
-  0x29, 0x05,                      //     USAGE_MAXIMUM (Button 5)
-  0x15, 0x00,                      //     LOGICAL_MINIMUM (0)
-  0x25, 0x01,                      //     LOGICAL_MAXIMUM (1)
-  0x75, 0x01,                      //     REPORT_SIZE (1)
-  0x95, 0x05,                      //     REPORT_COUNT (5)
-  0x81, 0x02,                      //     INPUT (Data,Var,Abs)
-  0x75, 0x03,                      //     REPORT_SIZE (3)
-  0x95, 0x01,                      //     REPORT_COUNT (1)
-  0x81, 0x03,                      //     INPUT (Cnst,Var,Abs)
-                                   // ----------------------------  X,Y position
-  0x05, 0x01,                      //     USAGE_PAGE (Generic Desktop)
-  0x09, 0x30,                      //     USAGE (X)
-  0x09, 0x31,                      //     USAGE (Y)
-  0x15, 0x81,                      //     LOGICAL_MINIMUM (-127)
-  0x25, 0x7f,                      //     LOGICAL_MAXIMUM (127)
-  0x75, 0x08,                      //     REPORT_SIZE (8)
-  0x95, 0x02,                      //     REPORT_COUNT (2)
-  0x81, 0x06,                      //     INPUT (Data,Var,Rel)
-                                   // ----------------------------  Vertical wheel
-  0x09, 0x38,                      //     USAGE (Wheel)
-  0x15, 0x81,                      //     LOGICAL_MINIMUM (-127)
-  0x25, 0x7f,                      //     LOGICAL_MAXIMUM (127)
-  0x35, 0x00,                      //     PHYSICAL_MINIMUM (0)        - reset physical
-  0x45, 0x00,                      //     PHYSICAL_MAXIMUM (0)
-  0x75, 0x08,                      //     REPORT_SIZE (8)
-  0x95, 0x01,                      //     REPORT_COUNT (1)
-  0x81, 0x06,                      //     INPUT (Data,Var,Rel)
-                                   // ----------------------------  Horizontal wheel
-  0x05, 0x0c,                      //     USAGE_PAGE (Consumer Devices)
-  0x0a, 0x38, 0x02,                //     USAGE (AC Pan)
-  0x15, 0x81,                      //     LOGICAL_MINIMUM (-127)
-  0x25, 0x7f,                      //     LOGICAL_MAXIMUM (127)
-  0x75, 0x08,                      //     REPORT_SIZE (8)
-  0x95, 0x01,                      //     REPORT_COUNT (1)
-  0x81, 0x06,                      //     INPUT (Data,Var,Rel)
-  0xc0,                            //   END_COLLECTION
-  0xc0,                            // END_COLLECTION
+  HID_DESC_MOUSE
 };
 /* wrapper */
 static const USBDescriptor mouse_hid_report_descriptor = {
@@ -271,16 +188,7 @@ static const USBDescriptor mouse_hid_report_descriptor = {
 
 #ifdef CONSOLE_ENABLE
 static const uint8_t console_hid_report_desc_data[] = {
-  0x06, 0x31, 0xFF, // Usage Page 0xFF31 (vendor defined)
-  0x09, 0x74,       // Usage 0x74
-  0xA1, 0x53,       // Collection 0x53
-  0x75, 0x08,       // report size = 8 bits
-  0x15, 0x00,       // logical minimum = 0
-  0x26, 0xFF, 0x00, // logical maximum = 255
-  0x95, CONSOLE_EPSIZE, // report count
-  0x09, 0x75,       // usage
-  0x81, 0x02,       // Input (array)
-  0xC0              // end collection
+  HID_DESC_CONSOLE(CONSOLE_EPSIZE)
 };
 /* wrapper */
 static const USBDescriptor console_hid_report_descriptor = {
@@ -293,32 +201,7 @@ static const USBDescriptor console_hid_report_descriptor = {
 /* audio controls & system controls
  * http://www.microsoft.com/whdc/archive/w2kbd.mspx */
 static const uint8_t extra_hid_report_desc_data[] = {
-  /* system control */
-  0x05, 0x01,                      // USAGE_PAGE (Generic Desktop)
-  0x09, 0x80,                      // USAGE (System Control)
-  0xa1, 0x01,                      // COLLECTION (Application)
-  0x85, REPORT_ID_SYSTEM,          //   REPORT_ID (2)
-  0x15, 0x01,                      //   LOGICAL_MINIMUM (0x1)
-  0x26, 0xb7, 0x00,                //   LOGICAL_MAXIMUM (0xb7)
-  0x19, 0x01,                      //   USAGE_MINIMUM (0x1)
-  0x29, 0xb7,                      //   USAGE_MAXIMUM (0xb7)
-  0x75, 0x10,                      //   REPORT_SIZE (16)
-  0x95, 0x01,                      //   REPORT_COUNT (1)
-  0x81, 0x00,                      //   INPUT (Data,Array,Abs)
-  0xc0,                            // END_COLLECTION
-  /* consumer */
-  0x05, 0x0c,                      // USAGE_PAGE (Consumer Devices)
-  0x09, 0x01,                      // USAGE (Consumer Control)
-  0xa1, 0x01,                      // COLLECTION (Application)
-  0x85, REPORT_ID_CONSUMER,        //   REPORT_ID (3)
-  0x15, 0x01,                      //   LOGICAL_MINIMUM (0x1)
-  0x26, 0x9c, 0x02,                //   LOGICAL_MAXIMUM (0x29c)
-  0x19, 0x01,                      //   USAGE_MINIMUM (0x1)
-  0x2a, 0x9c, 0x02,                //   USAGE_MAXIMUM (0x29c)
-  0x75, 0x10,                      //   REPORT_SIZE (16)
-  0x95, 0x01,                      //   REPORT_COUNT (1)
-  0x81, 0x00,                      //   INPUT (Data,Array,Abs)
-  0xc0,                            // END_COLLECTION
+  HID_DESC_EXTRAKEY_N(CONSUMER_USAGES)
 };
 /* wrapper */
 static const USBDescriptor extra_hid_report_descriptor = {
@@ -402,7 +285,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(KBD_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     KBD_EPSIZE,// wMaxPacketSize
-                    10),       // bInterval
+                    KEYBOARD_POLLING_INTERVAL), // bInterval
 
   #ifdef MOUSE_ENABLE
   /* Interface Descriptor (9 bytes) USB spec 9.6.5, page 267-269, Table 9-12 */
@@ -432,7 +315,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(MOUSE_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     MOUSE_EPSIZE,  // wMaxPacketSize
-                    1),        // bInterval
+                    MOUSE_POLLING_INTERVAL), // bInterval
   #endif /* MOUSE_ENABLE */
 
   #ifdef CONSOLE_ENABLE
@@ -458,7 +341,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(CONSOLE_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     CONSOLE_EPSIZE, // wMaxPacketSize
-                    1),        // bInterval
+                    CONSOLE_POLLING_INTERVAL), // bInterval
   #endif /* CONSOLE_ENABLE */
 
   #ifdef EXTRAKEY_ENABLE
@@ -484,7 +367,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(EXTRA_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     EXTRA_EPSIZE, // wMaxPacketSize
-                    10),       // bInterval
+                    EXTRAKEY_POLLING_INTERVAL), // bInterval
   #endif /* EXTRAKEY_ENABLE */
 
   #ifdef NKRO_ENABLE
@@ -510,7 +393,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(NKRO_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     NKRO_EPSIZE, // wMaxPacketSize
-                    1),       // bInterval
+                    NKRO_POLLING_INTERVAL), // bInterval
   #endif /* NKRO_ENABLE */
 };
 
@@ -787,6 +670,12 @@ static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
   switch(event) {
   case USB_EVENT_RESET:
     //TODO: from ISR! print("[R]");
+    osalSysLockFromISR();
+    kbd_queue_len = 0;
+#ifdef POLL_SYNC_ENABLE
+    poll_sync_reset();
+#endif
+    osalSysUnlockFromISR();
     return;
 
   case USB_EVENT_ADDRESS:
@@ -809,6 +698,9 @@ static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
 #ifdef NKRO_ENABLE
     usbInitEndpointI(usbp, NKRO_ENDPOINT, &nkro_ep_config);
 #endif /* NKRO_ENABLE */
+#ifdef POLL_SYNC_ENABLE
+    poll_sync_reset();
+#endif
     osalSysUnlockFromISR();
     return;
 
@@ -851,6 +743,12 @@ static uint16_t get_hword(uint8_t *p) {
  * Other Device    Required    Optional    Optional    Optional    Optional    Optional
  */
 
+/* LED report arrived, called from ISR */
+static void set_led_cb(USBDriver *usbp) {
+  (void)usbp;
+  host_keyboard_leds_changed();
+}
+
 /* Callback for SETUP request on the endpoint 0 (control) */
 static bool usb_request_hook_cb(USBDriver *usbp) {
   const USBDescriptor *dp;
@@ -898,7 +796,7 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
             switch(usbp->setup[2]) { /* LSB(wValue) [Report ID] */
               case REPORT_ID_SYSTEM:
                 extra_report_blank[0] = REPORT_ID_SYSTEM;
-                usbSetupTransfer(usbp, (uint8_t *)extra_report_blank, sizeof(extra_report_blank), NULL);
+                usbSetupTransfer(usbp, (uint8_t *)extra_report_blank, sizeof(report_extra_t), NULL);
                 return TRUE;
                 break;
               case REPORT_ID_CONSUMER:
@@ -946,7 +844,7 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
 #endif  /* NKRO_ENABLE */
         /* keyboard_led_stats = <read byte from next OUT report>
          * keyboard_led_stats needs be word (or dword), otherwise we get an exception on F0 */
-          usbSetupTransfer(usbp, (uint8_t *)&keyboard_led_stats, 1, NULL);
+          usbSetupTransfer(usbp, (uint8_t *)&keyboard_led_stats, 1, set_led_cb);
           return TRUE;
           break;
         }
@@ -957,15 +855,10 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
           keyboard_protocol = ((usbp->setup[2]) != 0x00);   /* LSB(wValue) */
 #ifdef NKRO_ENABLE
           keyboard_nkro = !!keyboard_protocol;
-          if(!keyboard_nkro && keyboard_idle) {
-#else /* NKRO_ENABLE */
-          if(keyboard_idle) {
 #endif /* NKRO_ENABLE */
-          /* arm the idle timer if boot protocol & idle */
-            osalSysLockFromISR();
-            chVTSetI(&keyboard_idle_timer, 4*MS2ST(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
-            osalSysUnlockFromISR();
-          }
+          osalSysLockFromISR();
+          keyboard_idle_arm_I(usbp);
+          osalSysUnlockFromISR();
         }
         usbSetupTransfer(usbp, NULL, 0, NULL);
         return TRUE;
@@ -974,15 +867,9 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
       case HID_SET_IDLE:
         keyboard_idle = usbp->setup[3];     /* MSB(wValue) */
         /* arm the timer */
-#ifdef NKRO_ENABLE
-        if(!keyboard_nkro && keyboard_idle) {
-#else /* NKRO_ENABLE */
-        if(keyboard_idle) {
-#endif /* NKRO_ENABLE */
-          osalSysLockFromISR();
-          chVTSetI(&keyboard_idle_timer, 4*MS2ST(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
-          osalSysUnlockFromISR();
-        }
+        osalSysLockFromISR();
+        keyboard_idle_arm_I(usbp);
+        osalSysUnlockFromISR();
         usbSetupTransfer(usbp, NULL, 0, NULL);
         return TRUE;
         break;
@@ -1003,18 +890,30 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
   return FALSE;
 }
 
-/* Start-of-frame callback */
+#ifdef POLL_SYNC_ENABLE
+/* Start Of Frame callback, phase of host polls for scan */
 static void usb_sof_cb(USBDriver *usbp) {
-  kbd_sof_cb(usbp);
+  (void)usbp;
+  osalSysLockFromISR();
+  poll_sync_sof();
+  osalSysUnlockFromISR();
 }
+#endif
 
-
-/* USB driver configuration */
+/* USB driver configuration
+ * Periodic work is scheduled with virtual timers which are armed only while
+ * there is something to do(idle rate, console flush), no Start Of Frame
+ * callback so that the driver leaves SOF interrupt disabled and the MCU
+ * is not woken up every 1ms. POLL_SYNC_ENABLE needs SOF and takes it. */
 static const USBConfig usbcfg = {
   usb_event_cb,                 /* USB events callback */
   usb_get_descriptor_cb,        /* Device GET_DESCRIPTOR request callback */
   usb_request_hook_cb,          /* Requests hook callback */
+#ifdef POLL_SYNC_ENABLE
   usb_sof_cb                    /* Start Of Frame callback */
+#else
+  NULL                          /* Start Of Frame callback */
+#endif
 };
 
 /*
@@ -1064,27 +963,64 @@ void send_remote_wakeup(USBDriver *usbp) {
  * ---------------------------------------------------------
  */
 
+/* start transmitting the oldest queued report if the endpoint is free
+ * called in locked state */
+static void kbd_send_next_I(USBDriver *usbp) {
+  usbep_t ep = KBD_ENDPOINT;
+  size_t size = KBD_EPSIZE;
+#ifdef NKRO_ENABLE
+  if(keyboard_nkro) {
+    ep = NKRO_ENDPOINT;
+    size = sizeof(report_keyboard_t);
+  }
+#endif /* NKRO_ENABLE */
+  if(kbd_queue_len == 0 || usbGetTransmitStatusI(usbp, ep)) {
+    return;
+  }
+  kbd_report_inflight = kbd_queue[kbd_queue_head];
+  kbd_queue_head = (kbd_queue_head + 1) % KBD_REPORT_QUEUE;
+  kbd_queue_len--;
+  usbStartTransmitI(usbp, ep, (uint8_t *)&kbd_report_inflight, size);
+  BENCH_GPIO_REPORT();
+}
+
 /* keyboard IN callback hander (a kbd report has made it IN) */
 void kbd_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
-  (void)usbp;
   (void)ep;
+  osalSysLockFromISR();
+#ifdef POLL_SYNC_ENABLE
+  poll_sync_in(true);
+#endif
+  kbd_send_next_I(usbp);
+  osalSysUnlockFromISR();
 }
 
 #ifdef NKRO_ENABLE
 /* nkro IN callback hander (a nkro report has made it IN) */
 void nkro_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
-  (void)usbp;
   (void)ep;
+  osalSysLockFromISR();
+#ifdef POLL_SYNC_ENABLE
+  poll_sync_in(true);
+#endif
+  kbd_send_next_I(usbp);
+  osalSysUnlockFromISR();
 }
 #endif /* NKRO_ENABLE */
 
-/* start-of-frame handler
- * TODO: i guess it would be better to re-implement using timers,
- *  so that this is not going to have to be checked every 1ms */
-void kbd_sof_cb(USBDriver *usbp) {
-  (void)usbp;
+/* (re)start idle rate timer, or stop it when idle is disabled
+ * called in locked state */
+static void keyboard_idle_arm_I(USBDriver *usbp) {
+#ifdef NKRO_ENABLE
+  if(!keyboard_nkro && keyboard_idle) {
+#else /* NKRO_ENABLE */
+  if(keyboard_idle) {
+#endif /* NKRO_ENABLE */
+    /* idle rate is in 4ms unit */
+    chVTSetI(&keyboard_idle_timer, 4*MS2ST(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
+  } else {
+    chVTResetI(&keyboard_idle_timer);
+  }
 }
 
 /* Idle requests timer code
@@ -1101,21 +1037,14 @@ static void keyboard_idle_timer_cb(void *arg) {
     return;
   }
 
-#ifdef NKRO_ENABLE
-  if(!keyboard_nkro && keyboard_idle) {
-#else /* NKRO_ENABLE */
-  if(keyboard_idle) {
-#endif /* NKRO_ENABLE */
-    /* TODO: are we sure we want the KBD_ENDPOINT? */
-    if(!usbGetTransmitStatusI(usbp, KBD_ENDPOINT)) {
-      usbStartTransmitI(usbp, KBD_ENDPOINT, (uint8_t *)&keyboard_report_sent, KBD_EPSIZE);
-    }
-    /* rearm the timer */
-    chVTSetI(&keyboard_idle_timer, 4*MS2ST(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
+  /* TODO: are we sure we want the KBD_ENDPOINT? */
+  if(!usbGetTransmitStatusI(usbp, KBD_ENDPOINT)) {
+    kbd_report_inflight = keyboard_report_sent;
+    usbStartTransmitI(usbp, KBD_ENDPOINT, (uint8_t *)&kbd_report_inflight, KBD_EPSIZE);
   }
-
-  /* do not rearm the timer if the condition above fails
+  /* rearm the timer, or leave it stopped if idle has been disabled
    * it should be enabled again on either IDLE or SET_PROTOCOL requests */
+  keyboard_idle_arm_I(usbp);
   osalSysUnlockFromISR();
 }
 
@@ -1124,7 +1053,7 @@ uint8_t keyboard_leds(void) {
   return (uint8_t)(keyboard_led_stats & 0xFF);
 }
 
-/* prepare and start sending a report IN
+/* queue a report and start sending it IN if the endpoint is free
  * not callable from ISR or locked state */
 void send_keyboard(report_keyboard_t *report) {
   osalSysLock();
@@ -1132,42 +1061,20 @@ void send_keyboard(report_keyboard_t *report) {
     osalSysUnlock();
     return;
   }
-  osalSysUnlock();
 
-#ifdef NKRO_ENABLE
-  if(keyboard_nkro) {  /* NKRO protocol */
-    /* need to wait until the previous packet has made it through */
-    /* can rewrite this using the synchronous API, then would wait
-     * until *after* the packet has been transmitted. I think
-     * this is more efficient */
-    /* busy wait, should be short and not very common */
-    osalSysLock();
-    if(usbGetTransmitStatusI(&USB_DRIVER, NKRO_ENDPOINT)) {
-      /* Need to either suspend, or loop and call unlock/lock during
-       * every iteration - otherwise the system will remain locked,
-       * no interrupts served, so USB not going through as well.
-       * Note: for suspend, need USB_USE_WAIT == TRUE in halconf.h */
-      osalThreadSuspendS(&(&USB_DRIVER)->epc[NKRO_ENDPOINT]->in_state->thread);
-    }
-    usbStartTransmitI(&USB_DRIVER, NKRO_ENDPOINT, (uint8_t *)report, sizeof(report_keyboard_t));
-    osalSysUnlock();
-  } else
-#endif /* NKRO_ENABLE */
-  { /* boot protocol */
-    /* need to wait until the previous packet has made it through */
-    /* busy wait, should be short and not very common */
-    osalSysLock();
-    if(usbGetTransmitStatusI(&USB_DRIVER, KBD_ENDPOINT)) {
-      /* Need to either suspend, or loop and call unlock/lock during
-       * every iteration - otherwise the system will remain locked,
-       * no interrupts served, so USB not going through as well.
-       * Note: for suspend, need USB_USE_WAIT == TRUE in halconf.h */
-      osalThreadSuspendS(&(&USB_DRIVER)->epc[KBD_ENDPOINT]->in_state->thread);
-    }
-    usbStartTransmitI(&USB_DRIVER, KBD_ENDPOINT, (uint8_t *)report, KBD_EPSIZE);
-    osalSysUnlock();
+  if(kbd_queue_len < KBD_REPORT_QUEUE) {
+    kbd_queue[(kbd_queue_head + kbd_queue_len) % KBD_REPORT_QUEUE] = *report;
+    kbd_queue_len++;
+  } else {
+    /* host is not polling fast enough, replace the newest */
+    TELEMETRY_COUNT(TELEMETRY_REPORT_LOST);
+    kbd_queue[(kbd_queue_head + KBD_REPORT_QUEUE - 1) % KBD_REPORT_QUEUE] = *report;
   }
+  kbd_send_next_I(&USB_DRIVER);
   keyboard_report_sent = *report;
+  /* idle period starts again from the last report */
+  keyboard_idle_arm_I(&USB_DRIVER);
+  osalSysUnlock();
 }
 
 /* ---------------------------------------------------------
@@ -1245,6 +1152,27 @@ void send_consumer(uint16_t data) {
   send_extra_report(REPORT_ID_CONSUMER, data);
 }
 
+#if CONSUMER_USAGES > 1
+/* stays put while endpoint sends it */
+static struct {
+  uint8_t report_id;
+  report_consumer_t consumer;
+} __attribute__ ((packed)) consumer_report;
+
+void send_consumer_report(report_consumer_t *report) {
+  osalSysLock();
+  if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
+    osalSysUnlock();
+    return;
+  }
+
+  consumer_report.report_id = REPORT_ID_CONSUMER;
+  consumer_report.consumer = *report;
+  usbStartTransmitI(&USB_DRIVER, EXTRA_ENDPOINT, (uint8_t *)&consumer_report, sizeof(consumer_report));
+  osalSysUnlock();
+}
+#endif
+
 #else /* EXTRAKEY_ENABLE */
 void send_system(uint16_t data) {
   (void)data;
@@ -1269,9 +1197,6 @@ void console_in_cb(USBDriver *usbp, usbep_t ep) {
 
   osalSysLockFromISR();
 
-  /* rearm the timer */
-  chVTSetI(&console_flush_timer, MS2ST(CONSOLE_FLUSH_MS), console_flush_cb, (void *)usbp);
-
   /* Freeing the buffer just transmitted, if it was not a zero size packet.*/
   if (usbp->epc[CONSOLE_ENDPOINT]->in_state->txsize > 0U) {
     obqReleaseEmptyBufferI(&console_buf_queue);
@@ -1328,8 +1253,8 @@ static void console_flush_cb(void *arg) {
   }
 
   /* If there is already a transaction ongoing then another one cannot be
-     started.*/
-  if (usbGetTransmitStatusI(usbp, CONSOLE_ENDPOINT)) {
+     started. Partial buffer can't be taken while thread writes into it.*/
+  if (usbGetTransmitStatusI(usbp, CONSOLE_ENDPOINT) || console_writing) {
     /* rearm the timer */
     chVTSetI(&console_flush_timer, MS2ST(CONSOLE_FLUSH_MS), console_flush_cb, (void *)usbp);
     osalSysUnlockFromISR();
@@ -1350,26 +1275,69 @@ static void console_flush_cb(void *arg) {
     usbStartTransmitI(usbp, CONSOLE_ENDPOINT, buf, CONSOLE_EPSIZE);
   }
 
-  /* rearm the timer */
-  chVTSetI(&console_flush_timer, MS2ST(CONSOLE_FLUSH_MS), console_flush_cb, (void *)usbp);
+  /* the timer is armed again by sendchar() when new packet is started */
   osalSysUnlockFromISR();
 }
 
 
+/* Characters go straight into packet buffer of the queue, printf formatter
+ * calls this through sendchar_pf(). Lock is taken only to get an empty packet
+ * buffer and to post it when full, not for each character as obqPutTimeout()
+ * does. Partial packet is sent by flush timer CONSOLE_FLUSH_MS after it is
+ * started or by console_flush_output(). Only one thread may print at a time,
+ * with CHIBIOS_THREADS they are serialized by tmk_mutex. */
 int8_t sendchar(uint8_t c) {
-  osalSysLock();
-  if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
+  output_buffers_queue_t *obqp = &console_buf_queue;
+  int8_t ret = 0;
+
+  CONSOLE_WRITING(true);
+  if(obqp->ptr == NULL) {
+    osalSysLock();
+    if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
+      osalSysUnlock();
+      goto DONE;
+    }
+    /* Timeout after 100us if the queue is full.
+     * Increase this timeout if too much stuff is getting
+     * dropped (i.e. the buffer is getting full too fast
+     * for USB/HIDRAW to dequeue). Another possibility
+     * for fixing this kind of thing is to increase
+     * CONSOLE_QUEUE_CAPACITY. */
+    if(obqGetEmptyBufferTimeoutS(obqp, US2ST(100)) != MSG_OK) {
+      osalSysUnlock();
+      ret = -1;
+      goto DONE;
+    }
+    /* flush partial buffer later, timer runs only while output is pending */
+    if(!chVTIsArmedI(&console_flush_timer)) {
+      chVTSetI(&console_flush_timer, MS2ST(CONSOLE_FLUSH_MS), console_flush_cb, (void *)&USB_DRIVER);
+    }
     osalSysUnlock();
-    return 0;
   }
-  osalSysUnlock();
-  /* Timeout after 100us if the queue is full.
-   * Increase this timeout if too much stuff is getting
-   * dropped (i.e. the buffer is getting full too fast
-   * for USB/HIDRAW to dequeue). Another possibility
-   * for fixing this kind of thing is to increase
-   * CONSOLE_QUEUE_CAPACITY. */
-  return(obqPutTimeout(&console_buf_queue, c, US2ST(100)));
+
+  *obqp->ptr++ = c;
+  if(obqp->ptr >= obqp->top) {
+    osalSysLock();
+    obqPostFullBufferS(obqp, CONSOLE_EPSIZE);
+    osalSysUnlock();
+  }
+DONE:
+  CONSOLE_WRITING(false);
+  return ret;
+}
+
+/* send partial packet now, thread context */
+void console_flush_output(void) {
+  output_buffers_queue_t *obqp = &console_buf_queue;
+
+  CONSOLE_WRITING(true);
+  if(obqp->ptr != NULL) {
+    while(obqp->ptr < obqp->top) *obqp->ptr++ = 0;
+    osalSysLock();
+    obqPostFullBufferS(obqp, CONSOLE_EPSIZE);
+    osalSysUnlock();
+  }
+  CONSOLE_WRITING(false);
 }
 
 #else /* CONSOLE_ENABLE */
@@ -44,6 +44,52 @@ void send_remote_wakeup(USBDriver *usbp);
  * ---------------
  */
 
+/* Polling interval of interrupt IN endpoints in ms, can be set in config.h
+ * for each interface or USB_POLLING_INTERVAL for all of them at once.
+ * Full speed USB can not poll faster than 1ms(1kHz). */
+#ifndef KEYBOARD_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define KEYBOARD_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define KEYBOARD_POLLING_INTERVAL   10
+#   endif
+#endif
+#ifndef MOUSE_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define MOUSE_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define MOUSE_POLLING_INTERVAL   1
+#   endif
+#endif
+#ifndef CONSOLE_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define CONSOLE_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define CONSOLE_POLLING_INTERVAL   1
+#   endif
+#endif
+#ifndef EXTRAKEY_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define EXTRAKEY_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define EXTRAKEY_POLLING_INTERVAL   10
+#   endif
+#endif
+#ifndef NKRO_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define NKRO_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define NKRO_POLLING_INTERVAL   1
+#   endif
+#endif
+#if KEYBOARD_POLLING_INTERVAL < 1 || KEYBOARD_POLLING_INTERVAL > 255 || \
+    MOUSE_POLLING_INTERVAL < 1 || MOUSE_POLLING_INTERVAL > 255 || \
+    CONSOLE_POLLING_INTERVAL < 1 || CONSOLE_POLLING_INTERVAL > 255 || \
+    EXTRAKEY_POLLING_INTERVAL < 1 || EXTRAKEY_POLLING_INTERVAL > 255 || \
+    NKRO_POLLING_INTERVAL < 1 || NKRO_POLLING_INTERVAL > 255
+#   error "POLLING_INTERVAL must be 1-255ms"
+#endif
+
 /* main keyboard (6kro) */
 #define KBD_INTERFACE   0
 #define KBD_ENDPOINT    1
@@ -63,9 +109,6 @@ void send_remote_wakeup(USBDriver *usbp);
 /* keyboard IN request callback handler */
 void kbd_in_cb(USBDriver *usbp, usbep_t ep);
 
-/* start-of-frame handler */
-void kbd_sof_cb(USBDriver *usbp);
-
 #ifdef NKRO_ENABLE
 /* nkro IN callback hander */
 void nkro_in_cb(USBDriver *usbp, usbep_t ep);
@@ -2,12 +2,17 @@
 Copyright 2010,2011,2012,2013 Jun WAKO <wakojun@gmail.com>
 */
 #include <stdbool.h>
+#include <stddef.h>
 #include <util/delay.h>
 #include "debug.h"
-#include "ring_buffer.h"
+#include "timer.h"
+#include "spsc_queue.h"
 #include "ibm4704.h"
 
 
+SPSC_STAMPED_QUEUE(rbuf, uint8_t, 32)
+
+
 #define WAIT(stat, us, err) do { \
     if (!wait_##stat(us)) { \
         ibm4704_error = err; \
@@ -19,6 +24,139 @@ Copyright 2010,2011,2012,2013 Jun WAKO <wakojun@gmail.com>
 uint8_t ibm4704_error = 0;
 
 
+/* receiver state, reset when host starts sending */
+static enum {
+    BIT0, BIT1, BIT2, BIT3, BIT4, BIT5, BIT6, BIT7, PARITY, STOP
+} rx_state = BIT0;
+static uint8_t rx_data = 0;     // LSB first
+static uint8_t rx_parity = 0;   // Odd parity
+static volatile bool rx_resend = false;
+
+static void rx_reset(void)
+{
+    rx_state = BIT0;
+    rx_data = 0;
+    rx_parity = false;
+}
+
+
+/*
+ * Queued send
+ *
+ * Request to send waits for start bit up to 300us, keyboard needs Clock
+ * released as soon as it raises Data. Then the rest of command is written
+ * on rising edges of Clock in interrupt instead of waiting for the bits,
+ * and the next command is started by ibm4704_recv() in main loop.
+ */
+#ifndef IBM4704_TXQ_SIZE
+#   define IBM4704_TXQ_SIZE     4
+#endif
+/* ten bits of around 90us and Ack */
+#define IBM4704_TX_TIMEOUT      5
+
+static struct {
+    uint8_t data;
+    ibm4704_send_cb_t cb;
+} txq[IBM4704_TXQ_SIZE];
+static uint8_t txq_head = 0;
+static uint8_t txq_count = 0;
+static uint16_t tx_time;
+
+static volatile enum {
+    TX_IDLE,
+    TX_SENDING,
+    TX_DONE,
+    TX_ERROR,
+} tx_state = TX_IDLE;
+/* ISR only while TX_SENDING */
+static uint8_t tx_bit;
+static uint8_t tx_data;
+static bool tx_parity;
+
+static void tx_start(void)
+{
+    IBM4704_INT_OFF();
+    rx_reset();
+
+    /* Request to send */
+    idle();
+    clock_lo();
+
+    /* wait for Start bit(Clock:lo/Data:hi) */
+    if (!wait_data_hi(300)) {
+        idle();
+        tx_state = TX_ERROR;
+        IBM4704_INT_ON();
+        return;
+    }
+
+    tx_data = txq[txq_head].data;
+    tx_parity = true;
+    tx_bit = 0;
+    tx_time = timer_read();
+    tx_state = TX_SENDING;
+
+    /* keyboard drives Clock from here */
+    clock_hi();
+    IBM4704_INT_ON();
+}
+
+static void tx_poll(void)
+{
+    if (rx_resend && txq_count < IBM4704_TXQ_SIZE) {
+        uint8_t i = (txq_head + txq_count) % IBM4704_TXQ_SIZE;
+        rx_resend = false;
+        txq[i].data = 0xFE;
+        txq[i].cb = NULL;
+        txq_count++;
+    }
+
+    switch (tx_state) {
+        case TX_IDLE:
+            if (txq_count) tx_start();
+            if (tx_state != TX_ERROR) return;
+            break;
+        case TX_SENDING:
+            if (timer_elapsed(tx_time) < IBM4704_TX_TIMEOUT) return;
+            IBM4704_INT_OFF();
+            if (tx_state == TX_SENDING) {
+                // no clock from keyboard
+                tx_state = TX_ERROR;
+                idle();
+                rx_reset();
+            }
+            IBM4704_INT_ON();
+            break;
+        default:
+            break;
+    }
+
+    uint8_t data = txq[txq_head].data;
+    ibm4704_send_cb_t cb = txq[txq_head].cb;
+    bool ok = (tx_state == TX_DONE);
+    if (!ok) xprintf("S:%02X ", data);
+    txq_head = (txq_head + 1) % IBM4704_TXQ_SIZE;
+    txq_count--;
+    tx_state = TX_IDLE;
+
+    if (txq_count) tx_start();
+    if (cb) cb(data, ok);
+}
+
+bool ibm4704_send_async(uint8_t data, ibm4704_send_cb_t cb)
+{
+    if (txq_count >= IBM4704_TXQ_SIZE) {
+        return false;
+    }
+    uint8_t i = (txq_head + txq_count) % IBM4704_TXQ_SIZE;
+    txq[i].data = data;
+    txq[i].cb = cb;
+    txq_count++;
+    tx_poll();
+    return true;
+}
+
+
 void ibm4704_init(void)
 {
     inhibit();  // keep keyboard from sending
@@ -51,7 +189,13 @@ uint8_t ibm4704_send(uint8_t data)
     bool parity = true; // odd parity
     ibm4704_error = 0;
 
+    /* finish queued commands first */
+    while (txq_count) {
+        tx_poll();
+    }
+
     IBM4704_INT_OFF();
+    rx_reset();
 
     /* Request to send */
     idle();
@@ -100,6 +244,7 @@ ERROR:
 uint8_t ibm4704_recv_response(void)
 {
     while (!rbuf_has_data()) {
+        if (txq_count || rx_resend) tx_poll();
         _delay_ms(1);
     }
     return rbuf_dequeue();
@@ -107,6 +252,10 @@ uint8_t ibm4704_recv_response(void)
 
 uint8_t ibm4704_recv(void)
 {
+    if (txq_count || rx_resend) {
+        tx_poll();
+    }
+
     if (rbuf_has_data()) {
         return rbuf_dequeue();
     } else {
@@ -114,6 +263,12 @@ uint8_t ibm4704_recv(void)
     }
 }
 
+/* time(timer_read()) when the byte last got by ibm4704_recv() came */
+uint16_t ibm4704_recv_time(void)
+{
+    return rbuf_time;
+}
+
 /*
 Keyboard to Host
 ----------------
@@ -132,17 +287,31 @@ Stop bit:   Keyboard pulls down Data line to lo after 9th clock.
 */
 ISR(IBM4704_INT_VECT)
 {
-    static enum {
-        BIT0, BIT1, BIT2, BIT3, BIT4, BIT5, BIT6, BIT7, PARITY, STOP
-    } state = BIT0;
-    // LSB first
-    static uint8_t data = 0;
-    // Odd parity
-    static uint8_t parity = false;
+    if (tx_state == TX_SENDING) {
+        // host writes a bit while Clock is hi and keyboard reads it while lo
+        tx_bit++;
+        if (tx_bit <= 8) {
+            if (tx_data & 1) {
+                tx_parity = !tx_parity;
+                data_hi();
+            } else {
+                data_lo();
+            }
+            tx_data >>= 1;
+        } else if (tx_bit == 9) {
+            if (tx_parity) { data_hi(); } else { data_lo(); }
+        } else {
+            /* Stop bit and keyboard pulls Data down at end */
+            data_hi();
+            tx_state = wait_data_lo(100) ? TX_DONE : TX_ERROR;
+            idle();
+        }
+        return;
+    }
 
     ibm4704_error = 0;
 
-    switch (state) {
+    switch (rx_state) {
         case BIT0:
         case BIT1:
         case BIT2:
@@ -151,39 +320,37 @@ ISR(IBM4704_INT_VECT)
         case BIT5:
         case BIT6:
         case BIT7:
-            data >>= 1;
+            rx_data >>= 1;
             if (data_in()) {
-                data |= 0x80;
-                parity = !parity;
+                rx_data |= 0x80;
+                rx_parity = !rx_parity;
             }
             break;
         case PARITY:
             if (data_in()) {
-                parity = !parity;
+                rx_parity = !rx_parity;
             }
-            if (!parity)
+            if (!rx_parity)
                 goto ERROR;
             break;
         case STOP:
             // Data:Low
-            WAIT(data_lo, 100, state);
-            rbuf_enqueue(data);
+            WAIT(data_lo, 100, rx_state);
+            rbuf_enqueue(rx_data);
             ibm4704_error = IBM4704_ERR_NONE;
             goto DONE;
             break;
         default:
             goto ERROR;
     }
-    state++;
+    rx_state++;
     goto RETURN;
 ERROR:
-    ibm4704_error = state;
-    while (ibm4704_send(0xFE)) _delay_ms(1); // resend
-    xprintf("R:%02X%02X\n", state, data);
+    ibm4704_error = rx_state;
+    rx_resend = true;   // Resend command is queued from main loop
+    xprintf("R:%02X%02X\n", rx_state, rx_data);
 DONE:
-    state = BIT0;
-    data = 0;
-    parity = false;
+    rx_reset();
 RETURN:
     return;
 }
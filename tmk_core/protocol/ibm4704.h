@@ -4,6 +4,9 @@ Copyright 2014 Jun WAKO <wakojun@gmail.com>
 #ifndef IBM4704_H
 #define IBM4704_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define IBM4704_ERR_NONE        0
 #define IBM4704_ERR_PARITY      0x70
 
@@ -12,6 +15,15 @@ void ibm4704_init(void);
 uint8_t ibm4704_send(uint8_t data);
 uint8_t ibm4704_recv_response(void);
 uint8_t ibm4704_recv(void);
+uint16_t ibm4704_recv_time(void);
+
+/*
+ * Queue command and return without waiting, rest of bits after start bit go
+ * in interrupt. cb(data, ok) is called in main loop from ibm4704_recv() when
+ * the command is sent. Returns false when queue is full.
+ */
+typedef void (*ibm4704_send_cb_t)(uint8_t data, bool ok);
+bool ibm4704_send_async(uint8_t data, ibm4704_send_cb_t cb);
 
 
 /* Check pin configuration */
@@ -4,7 +4,7 @@ OPT_DEFS += -DPROTOCOL_IWRAP
 
 SRC +=	$(IWRAP_DIR)/main.c \
 	$(IWRAP_DIR)/iwrap.c \
-	$(IWRAP_DIR)/suart.S \
+	protocol/serial_soft.c \
 	$(COMMON_DIR)/sendchar_uart.c \
 	$(COMMON_DIR)/uart.c
 
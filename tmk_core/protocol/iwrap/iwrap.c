@@ -30,25 +30,58 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include "keycode.h"
-#include "suart.h"
+#include "serial.h"
 #include "uart.h"
 #include "report.h"
 #include "host_driver.h"
 #include "iwrap.h"
+#include "timer.h"
 #include "print.h"
 
 
 /* iWRAP MUX mode utils. 3.10 HID raw mode(iWRAP_HID_Application_Note.pdf) */
 #define MUX_HEADER(LINK, LENGTH) do { \
-    xmit(0xbf);     /* SOF    */ \
-    xmit(LINK);     /* Link   */ \
-    xmit(0x00);     /* Flags  */ \
-    xmit(LENGTH);   /* Length */ \
+    serial_send(0xbf);      /* SOF    */ \
+    serial_send(LINK);      /* Link   */ \
+    serial_send(0x00);      /* Flags  */ \
+    serial_send(LENGTH);    /* Length */ \
 } while (0)
-#define MUX_FOOTER(LINK) xmit(LINK^0xff)
+#define MUX_FOOTER(LINK) serial_send(LINK^0xff)
 
+#define MUX_LINK_HID    0x01
+#define MUX_LINK_CTRL   0xff
 
-static uint8_t connected = 0;
+/*
+ * HID raw frame on link of HID, report is written into data part and the
+ * frame goes out in one loop. Header is constant but the lengths.
+ *   SOF, Link, Flags, Length, 0x9f, Length, 0xa1(DATA Input), ID, data, ~Link
+ */
+#define HID_FRAME_HEADER    8
+#define HID_FRAME_DATA_MAX  8
+static uint8_t hid_frame[HID_FRAME_HEADER + HID_FRAME_DATA_MAX + 1] = {
+    0xbf, MUX_LINK_HID, 0x00, 0x00, 0x9f, 0x00, 0xa1, 0x00
+};
+
+static uint8_t *hid_frame_data(uint8_t id, uint8_t size)
+{
+    hid_frame[3] = size + 4;
+    hid_frame[5] = size + 2;
+    hid_frame[7] = id;
+    return &hid_frame[HID_FRAME_HEADER];
+}
+
+static void hid_frame_send(uint8_t size)
+{
+    uint8_t len = HID_FRAME_HEADER + size;
+    hid_frame[len++] = MUX_LINK_HID ^ 0xff;
+    for (uint8_t i = 0; i < len; i++)
+        serial_send(hid_frame[i]);
+}
+
+
+/* updated from link events in ISR and LIST response */
+static volatile uint8_t connected = 0;
+static uint16_t last_check = 0;
 //static uint8_t channel = 1;
 
 /* iWRAP buffer */
@@ -96,15 +129,39 @@ static void rcv_clear(void)
     rcv_tail = rcv_head = 0;
 }
 
-/* iWRAP response */
-ISR(PCINT1_vect, ISR_BLOCK) // recv() runs away in case of ISR_NOBLOCK
+/*
+ * Link events on control link are told by first four chars of the line,
+ * there is no need to parse rest of it for the only HID link.
+ *   RING {link} {addr} {channel} HID       host connected
+ *   CONNECT {link} HID {channel}           CALL succeeded
+ *   NO CARRIER {link} ERROR {code} ...     link closed
+ */
+static void link_event(uint8_t c)
 {
-    if ((SUART_IN_PIN & (1<<SUART_IN_BIT)))
+    static uint8_t line_pos = 0;
+    static char line_head[4];
+
+    if (c == '\r' || c == '\n') {
+        line_pos = 0;
+        return;
+    }
+    if (line_pos >= sizeof(line_head))
+        return;
+    line_head[line_pos++] = c;
+    if (line_pos < sizeof(line_head))
         return;
 
-    static volatile uint8_t mux_state = 0xff;
-    static volatile uint8_t mux_link = 0xff;
-    uint8_t c = recv();
+    if (!memcmp(line_head, "RING", 4) || !memcmp(line_head, "CONN", 4))
+        connected = 1;
+    else if (!memcmp(line_head, "NO C", 4))
+        connected = 0;
+}
+
+/* iWRAP response, byte from receive interrupt of serial_soft.c */
+void serial_rx_callback(uint8_t c)
+{
+    static uint8_t mux_state = 0xff;
+    static uint8_t mux_link = 0xff;
     switch (mux_state) {
         case 0xff: // SOF
             if (c == 0xbf)
@@ -128,6 +185,8 @@ ISR(PCINT1_vect, ISR_BLOCK) // recv() runs away in case of ISR_NOBLOCK
             if (mux_state--) {
                 uart_putchar(c);
                 rcv_enq(c);
+                if (mux_link == MUX_LINK_CTRL)
+                    link_event(c);
             }
     }
 }
@@ -150,15 +209,15 @@ void iwrap_init(void)
 void iwrap_mux_send(const char *s)
 {
     rcv_clear();
-    MUX_HEADER(0xff, strlen((char *)s));
+    MUX_HEADER(MUX_LINK_CTRL, strlen((char *)s));
     iwrap_send(s);
-    MUX_FOOTER(0xff);
+    MUX_FOOTER(MUX_LINK_CTRL);
 }
 
 void iwrap_send(const char *s)
 {
     while (*s)
-        xmit(*s++);
+        serial_send(*s++);
 }
 
 /* send buffer */
@@ -290,6 +349,7 @@ uint8_t iwrap_connected(void)
 
 uint8_t iwrap_check_connection(void)
 {
+    last_check = timer_read();
     iwrap_mux_send("LIST");
     _delay_ms(100);
 
@@ -301,6 +361,16 @@ uint8_t iwrap_check_connection(void)
 }
 
 
+/* Link state is kept by link events, LIST takes 100ms and is asked only
+ * once a second in case an event is lost while disconnected. */
+static bool link_up(void)
+{
+    if (connected) return true;
+    if (timer_elapsed(last_check) < 1000) return false;
+    return iwrap_check_connection();
+}
+
+
 /*------------------------------------------------------------------*
  * Host driver
  *------------------------------------------------------------------*/
@@ -329,40 +399,77 @@ static uint8_t keyboard_leds(void) {
 
 static void send_keyboard(report_keyboard_t *report)
 {
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
-    MUX_HEADER(0x01, 0x0c);
-    // HID raw mode header
-    xmit(0x9f);
-    xmit(0x0a); // Length
-    xmit(0xa1); // DATA(Input)
-    xmit(0x01); // Report ID
-    xmit(report->mods);
-    xmit(0x00); // reserved byte(always 0)
-    xmit(report->keys[0]);
-    xmit(report->keys[1]);
-    xmit(report->keys[2]);
-    xmit(report->keys[3]);
-    xmit(report->keys[4]);
-    xmit(report->keys[5]);
-    MUX_FOOTER(0x01);
+    if (!link_up()) return;
+    uint8_t *data = hid_frame_data(0x01, 8);
+    data[0] = report->mods;
+    data[1] = 0x00; // reserved byte(always 0)
+    memcpy(&data[2], report->keys, 6);
+    hid_frame_send(8);
+}
+
+/*
+ * Mouse report shares the link with key report and takes as long to send.
+ * Button change is sent at once, motion is merged and waits for
+ * iwrap_mouse_task() after keyboard_task() so that key reports of the scan
+ * go out before it.
+ */
+#if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
+static report_mouse_t mouse_report = {};    // buttons sent and motion merged since
+static bool mouse_pending = false;
+
+static bool mouse_merge(report_mouse_t *report)
+{
+    int16_t x = mouse_report.x + report->x;
+    int16_t y = mouse_report.y + report->y;
+    int16_t v = mouse_report.v + report->v;
+    int16_t h = mouse_report.h + report->h;
+    if (x < -127 || x > 127 || y < -127 || y > 127 ||
+        v < -127 || v > 127 || h < -127 || h > 127)
+        return false;
+    mouse_report.x = x;
+    mouse_report.y = y;
+    mouse_report.v = v;
+    mouse_report.h = h;
+    if (report->x || report->y || report->v || report->h)
+        mouse_pending = true;
+    return true;
+}
+
+static void mouse_flush(void)
+{
+    mouse_pending = false;
+    if (!link_up()) return;
+    uint8_t *data = hid_frame_data(0x02, 5);
+    data[0] = mouse_report.buttons;
+    data[1] = mouse_report.x;
+    data[2] = mouse_report.y;
+    data[3] = mouse_report.v;
+    data[4] = mouse_report.h;
+    hid_frame_send(5);
+    mouse_report.x = mouse_report.y = mouse_report.v = mouse_report.h = 0;
 }
+#endif
 
 static void send_mouse(report_mouse_t *report)
 {
 #if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
-    MUX_HEADER(0x01, 0x09);
-    // HID raw mode header
-    xmit(0x9f);
-    xmit(0x07); // Length
-    xmit(0xa1); // DATA(Input)
-    xmit(0x02); // Report ID
-    xmit(report->buttons);
-    xmit(report->x);
-    xmit(report->y);
-    xmit(report->v);
-    xmit(report->h);
-    MUX_FOOTER(0x01);
+    if (!mouse_merge(report)) {
+        // sum overflows, send earlier motion first
+        mouse_flush();
+        mouse_merge(report);
+    }
+    if (report->buttons != mouse_report.buttons) {
+        mouse_report.buttons = report->buttons;
+        mouse_flush();
+    }
+#endif
+}
+
+/* send motion merged while key reports went out */
+void iwrap_mouse_task(void)
+{
+#if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
+    if (mouse_pending) mouse_flush();
 #endif
 }
 
@@ -379,7 +486,7 @@ static void send_consumer(uint16_t data)
     uint8_t bits2 = 0;
     uint8_t bits3 = 0;
 
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
+    if (!link_up()) return;
     if (data == last_data) return;
     last_data = data;
 
@@ -456,14 +563,10 @@ static void send_consumer(uint16_t data)
             break;
     }
 
-    MUX_HEADER(0x01, 0x07);
-    xmit(0x9f);
-    xmit(0x05); // Length
-    xmit(0xa1); // DATA(Input)
-    xmit(0x03); // Report ID
-    xmit(bits1);
-    xmit(bits2);
-    xmit(bits3);
-    MUX_FOOTER(0x01);
+    uint8_t *frame = hid_frame_data(0x03, 3);
+    frame[0] = bits1;
+    frame[1] = bits2;
+    frame[2] = bits3;
+    hid_frame_send(3);
 #endif
 }
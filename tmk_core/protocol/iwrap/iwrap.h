@@ -45,5 +45,6 @@ void iwrap_subrate(void);
 bool iwrap_failed(void);
 uint8_t iwrap_connected(void);
 uint8_t iwrap_check_connection(void);
+void iwrap_mouse_task(void);
 
 #endif
@@ -32,7 +32,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   include "usbdrv.h"
 #endif
 #include "uart.h"
-#include "suart.h"
+#include "serial.h"
 #include "timer.h"
 #include "debug.h"
 #include "keycode.h"
@@ -142,18 +142,9 @@ int main(void)
     keyboard_init();
     print("\nSend BREAK for UART Console Commands.\n");
 
-    // TODO: move to iWRAP/suart file
-    print("suart init\n");
-    // suart init
-    // PC4: Tx Output IDLE(Hi)
-    PORTC |= (1<<4);
-    DDRC  |= (1<<4);
-    // PC5: Rx Input(pull-up)
-    PORTC |= (1<<5);
-    DDRC  &= ~(1<<5);
-    // suart receive interrut(PC5/PCINT13)
-    PCMSK1 = 0b00100000;
-    PCICR  = 0b00000010;
+    // software serial to iWRAP, see SERIAL_SOFT_* in config.h
+    print("serial init\n");
+    serial_init();
 
     host_set_driver(iwrap_driver());
 
@@ -168,9 +159,13 @@ int main(void)
             usbPoll();
 #endif
         keyboard_task();
+        if (host_get_driver() == iwrap_driver())
+            iwrap_mouse_task();
 #ifdef PROTOCOL_VUSB
-        if (host_get_driver() == vusb_driver())
+        if (host_get_driver() == vusb_driver()) {
             vusb_transfer_keyboard();
+            vusb_transfer_mouse_extra();
+        }
 #endif
         // TODO: depricated
         if (matrix_is_modified() || console()) {
@@ -289,7 +284,7 @@ static bool console_command(uint8_t c)
             change_driver(vusb_driver());
             //iwrap_kill();
             //iwrap_sleep();
-            // disable suart receive interrut(PC5/PCINT13)
+            // disable serial receive interrut(PC5/PCINT13)
             PCMSK1 &= ~(0b00100000);
             PCICR  &= ~(0b00000010);
             return 1;
@@ -297,7 +292,7 @@ static bool console_command(uint8_t c)
             print("iWRAP mode\n");
             change_driver(iwrap_driver());
             disable_vusb();
-            // enable suart receive interrut(PC5/PCINT13)
+            // enable serial receive interrut(PC5/PCINT13)
             PCMSK1 |= 0b00100000;
             PCICR  |= 0b00000010;
             return 1;
@@ -49,6 +49,30 @@ OPT_DEFS += $(LUFA_OPTS)
 # This indicates using LUFA stack
 OPT_DEFS += -DPROTOCOL_LUFA
 
+# Send keyboard report from Start of Frame interrupt instead of waiting
+# for endpoint in keyboard_task()
+ifeq (yes,$(strip $(LUFA_SOF_REPORT)))
+    OPT_DEFS += -DLUFA_SOF_REPORT
+endif
+
+# Double bank HID IN endpoints, report is written without waiting while
+# host has not read previous one(ATmega32U4/AT90USB)
+ifeq (yes,$(strip $(LUFA_DOUBLE_BANK)))
+    OPT_DEFS += -DLUFA_DOUBLE_BANK
+endif
+
+# Send mouse reports through extrakey endpoint with report ID, this saves
+# one interface and endpoint. Mouse is not available in BIOS(boot protocol).
+ifeq (yes,$(strip $(MOUSE_SHARED_EP)))
+    OPT_DEFS += -DMOUSE_SHARED_EP
+endif
+
+# Send NKRO bitmap after boot report on keyboard endpoint instead of its own
+# interface and endpoint. Requires NKRO_ENABLE, NKRO can't be turned off.
+ifeq (yes,$(strip $(NKRO_HYBRID)))
+    OPT_DEFS += -DNKRO_HYBRID
+endif
+
 ifeq (yes,$(strip $(LUFA_DEBUG_SUART)))
     SRC += common/avr/suart.S
     LUFA_OPTS += -DLUFA_DEBUG_SUART
@@ -45,6 +45,9 @@
 #define _DESCRIPTORS_H_
 
 #include <LUFA/Drivers/USB/USB.h>
+#ifdef STENO_ENABLE
+#include <LUFA/Drivers/USB/Class/Common/CDCClassCommon.h>
+#endif
 #include <avr/pgmspace.h>
 
 
@@ -57,7 +60,7 @@ typedef struct
     USB_HID_Descriptor_HID_t              Keyboard_HID;
     USB_Descriptor_Endpoint_t             Keyboard_INEndpoint;
 
-#ifdef MOUSE_ENABLE
+#if defined(MOUSE_ENABLE) && !defined(MOUSE_SHARED_EP)
     // Mouse HID Interface
     USB_Descriptor_Interface_t            Mouse_Interface;
     USB_HID_Descriptor_HID_t              Mouse_HID;
@@ -79,19 +82,39 @@ typedef struct
     USB_Descriptor_Endpoint_t             Console_OUTEndpoint;
 #endif
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_HYBRID)
     // NKRO HID Interface
     USB_Descriptor_Interface_t            NKRO_Interface;
     USB_HID_Descriptor_HID_t              NKRO_HID;
     USB_Descriptor_Endpoint_t             NKRO_INEndpoint;
 #endif
+
+#ifdef STENO_ENABLE
+    // Steno CDC ACM Interfaces
+    USB_Descriptor_Interface_Association_t Steno_IAD;
+    USB_Descriptor_Interface_t            Steno_CCI_Interface;
+    USB_CDC_Descriptor_FunctionalHeader_t Steno_Functional_Header;
+    USB_CDC_Descriptor_FunctionalACM_t    Steno_Functional_ACM;
+    USB_CDC_Descriptor_FunctionalUnion_t  Steno_Functional_Union;
+    USB_Descriptor_Endpoint_t             Steno_NotificationEndpoint;
+    USB_Descriptor_Interface_t            Steno_DCI_Interface;
+    USB_Descriptor_Endpoint_t             Steno_OUTEndpoint;
+    USB_Descriptor_Endpoint_t             Steno_INEndpoint;
+#endif
 } USB_Descriptor_Configuration_t;
 
 
+/* Mouse reports are sent through extrakey interface with report ID
+ * instead of own interface and endpoint */
+#if defined(MOUSE_SHARED_EP) && !(defined(MOUSE_ENABLE) && defined(EXTRAKEY_ENABLE))
+#   error "MOUSE_SHARED_EP requires both MOUSE_ENABLE and EXTRAKEY_ENABLE"
+#endif
+
+
 /* index of interface */
 #define KEYBOARD_INTERFACE          0
 
-#ifdef MOUSE_ENABLE
+#if defined(MOUSE_ENABLE) && !defined(MOUSE_SHARED_EP)
 #   define MOUSE_INTERFACE          (KEYBOARD_INTERFACE + 1)
 #else
 #   define MOUSE_INTERFACE          KEYBOARD_INTERFACE
@@ -109,21 +132,33 @@ typedef struct
 #   define CONSOLE_INTERFACE        EXTRAKEY_INTERFACE
 #endif
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_HYBRID) && !defined(NKRO_ENABLE)
+#   error "NKRO_HYBRID requires NKRO_ENABLE"
+#endif
+
+#if defined(NKRO_ENABLE) && !defined(NKRO_HYBRID)
 #   define NKRO_INTERFACE           (CONSOLE_INTERFACE + 1)
 #else
 #   define NKRO_INTERFACE           CONSOLE_INTERFACE
 #endif
 
+/* steno virtual serial port, control and data interface */
+#ifdef STENO_ENABLE
+#   define STENO_CCI_INTERFACE      (NKRO_INTERFACE + 1)
+#   define STENO_DCI_INTERFACE      (NKRO_INTERFACE + 2)
+#else
+#   define STENO_DCI_INTERFACE      NKRO_INTERFACE
+#endif
+
 
 /* nubmer of interfaces */
-#define TOTAL_INTERFACES            (NKRO_INTERFACE + 1)
+#define TOTAL_INTERFACES            (STENO_DCI_INTERFACE + 1)
 
 
 // Endopoint number and size
 #define KEYBOARD_IN_EPNUM           1
 
-#ifdef MOUSE_ENABLE
+#if defined(MOUSE_ENABLE) && !defined(MOUSE_SHARED_EP)
 #   define MOUSE_IN_EPNUM           (KEYBOARD_IN_EPNUM + 1) 
 #else
 #   define MOUSE_IN_EPNUM           KEYBOARD_IN_EPNUM
@@ -142,12 +177,28 @@ typedef struct
 #   define CONSOLE_OUT_EPNUM        EXTRAKEY_IN_EPNUM
 #endif
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_HYBRID)
 #   define NKRO_IN_EPNUM            (CONSOLE_OUT_EPNUM + 1)
 #else
 #   define NKRO_IN_EPNUM            CONSOLE_OUT_EPNUM
 #endif
 
+/* endpoint NKRO report is sent to, NKRO_HYBRID carries it on keyboard endpoint */
+#ifdef NKRO_HYBRID
+#   define NKRO_REPORT_EPNUM        KEYBOARD_IN_EPNUM
+#else
+#   define NKRO_REPORT_EPNUM        NKRO_IN_EPNUM
+#endif
+
+#ifdef STENO_ENABLE
+#   define STENO_NOTIFICATION_EPNUM (NKRO_IN_EPNUM + 1)
+#   define STENO_OUT_EPNUM          (NKRO_IN_EPNUM + 2)
+#   define STENO_IN_EPNUM           (NKRO_IN_EPNUM + 3)
+#   if STENO_IN_EPNUM >= ENDPOINT_TOTAL_ENDPOINTS
+#       error "Endpoints are not available enough for STENO_ENABLE. Disable some of build options in Makefile.(MOUSEKEY, EXTRAKEY, CONSOLE, NKRO)"
+#   endif
+#endif
+
 /* Check number of endpoints. ATmega32u2 has only four except for control endpoint. */
 #if defined(__AVR_ATmega32U2__) && NKRO_IN_EPNUM > 4
 #   error "Endpoints are not available enough to support all functions. Disable some of build options in Makefile.(MOUSEKEY, EXTRAKEY, CONSOLE, NKRO)"
@@ -160,6 +211,63 @@ typedef struct
 #define CONSOLE_EPSIZE              32
 #define NKRO_EPSIZE                 32
 
+/* NKRO_HYBRID: boot report of KEYBOARD_EPSIZE and NKRO bitmap after it */
+#ifdef NKRO_HYBRID
+#   define KEYBOARD_IN_EPSIZE       NKRO_EPSIZE
+#else
+#   define KEYBOARD_IN_EPSIZE       KEYBOARD_EPSIZE
+#endif
+#define STENO_NOTIFICATION_EPSIZE   8
+#define STENO_EPSIZE                8
+
+/* Polling interval of interrupt IN endpoints in ms, can be set in config.h
+ * for each interface or USB_POLLING_INTERVAL for all of them at once.
+ * Full speed USB can not poll faster than 1ms(1kHz). */
+#ifndef KEYBOARD_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define KEYBOARD_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   elif defined(NKRO_HYBRID)
+#       define KEYBOARD_POLLING_INTERVAL   1
+#   else
+#       define KEYBOARD_POLLING_INTERVAL   10
+#   endif
+#endif
+#ifndef MOUSE_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define MOUSE_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define MOUSE_POLLING_INTERVAL   10
+#   endif
+#endif
+#ifndef EXTRAKEY_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define EXTRAKEY_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define EXTRAKEY_POLLING_INTERVAL   10
+#   endif
+#endif
+#ifndef CONSOLE_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define CONSOLE_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define CONSOLE_POLLING_INTERVAL   1
+#   endif
+#endif
+#ifndef NKRO_POLLING_INTERVAL
+#   ifdef USB_POLLING_INTERVAL
+#       define NKRO_POLLING_INTERVAL   USB_POLLING_INTERVAL
+#   else
+#       define NKRO_POLLING_INTERVAL   1
+#   endif
+#endif
+#if KEYBOARD_POLLING_INTERVAL < 1 || KEYBOARD_POLLING_INTERVAL > 255 || \
+    MOUSE_POLLING_INTERVAL < 1 || MOUSE_POLLING_INTERVAL > 255 || \
+    EXTRAKEY_POLLING_INTERVAL < 1 || EXTRAKEY_POLLING_INTERVAL > 255 || \
+    CONSOLE_POLLING_INTERVAL < 1 || CONSOLE_POLLING_INTERVAL > 255 || \
+    NKRO_POLLING_INTERVAL < 1 || NKRO_POLLING_INTERVAL > 255
+#   error "POLLING_INTERVAL must be 1-255ms"
+#endif
+
 
 uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
                                     const uint8_t wIndex,
@@ -55,6 +55,11 @@
 #endif
 
 #include "matrix.h"
+#include "spsc_queue.h"
+#include "console_command.h"
+#include "telemetry.h"
+#include "bench_gpio.h"
+#include "poll_sync.h"
 #include "descriptor.h"
 #include "lufa.h"
 
@@ -69,19 +74,86 @@ static uint8_t keyboard_led_stats = 0;
 
 static report_keyboard_t keyboard_report_sent;
 
+#ifdef LUFA_SOF_REPORT
+/* Keyboard reports waiting for Start of Frame, written from SOF interrupt */
+#ifndef LUFA_SOF_REPORT_QUEUE
+#   define LUFA_SOF_REPORT_QUEUE 4
+#endif
+static report_keyboard_t keyboard_report_queue[LUFA_SOF_REPORT_QUEUE];
+static volatile uint8_t keyboard_report_head = 0;
+static volatile uint8_t keyboard_report_count = 0;
+static void keyboard_report_flush(void);
+#endif
+
+#ifdef POLL_SYNC_ENABLE
+/* Endpoint of keyboard report written and not taken by host yet, 0 if none.
+ * No IN complete interrupt in LUFA, SOF finds the report gone instead. */
+static volatile uint8_t poll_sync_ep = 0;
+#define POLL_SYNC_WRITTEN(ep)   (poll_sync_ep = (ep))
+
+/* Called in SOF interrupt before poll_sync_sof() */
+static void poll_sync_check(void)
+{
+    if (!poll_sync_ep) return;
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(poll_sync_ep);
+    if (!Endpoint_GetBusyBanks()) {
+        poll_sync_ep = 0;
+        poll_sync_in(false);
+    }
+    Endpoint_SelectEndpoint(ep);
+}
+#else
+#define POLL_SYNC_WRITTEN(ep)
+#endif
+
 
 /* Host driver */
 static uint8_t keyboard_leds(void);
 static void send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
+#if defined(LUFA_DOUBLE_BANK) && defined(MOUSE_ENABLE)
+static void mouse_report_flush(void);
+#endif
+
+/* HID IN endpoints with two banks can take next report while host has not
+ * read previous one yet. DPRAM of 32u2/16u2 is too small for that. */
+#ifdef LUFA_DOUBLE_BANK
+#   if !(defined(__AVR_ATmega32U4__) || defined(__AVR_ATmega16U4__) || \
+         defined(__AVR_AT90USB646__) || defined(__AVR_AT90USB647__) || \
+         defined(__AVR_AT90USB1286__) || defined(__AVR_AT90USB1287__))
+#       error "LUFA_DOUBLE_BANK is supported on ATmega32U4/16U4 and AT90USB only"
+#   endif
+#   define HID_EP_BANK  ENDPOINT_BANK_DOUBLE
+#else
+#   define HID_EP_BANK  ENDPOINT_BANK_SINGLE
+#endif
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
+#if CONSUMER_USAGES > 1
+static void send_consumer_report(report_consumer_t *report);
+#endif
+#ifdef STENO_ENABLE
+static void send_steno(const uint8_t *data, uint8_t len);
+#endif
 host_driver_t lufa_driver = {
     keyboard_leds,
     send_keyboard,
     send_mouse,
     send_system,
-    send_consumer
+    send_consumer,
+#if CONSUMER_USAGES > 1 || defined(STENO_ENABLE)
+    NULL,
+#endif
+#if CONSUMER_USAGES > 1
+    send_consumer_report,
+#elif defined(STENO_ENABLE)
+    NULL,
+#endif
+#ifdef STENO_ENABLE
+    send_steno
+#endif
 };
 
 
@@ -89,6 +161,12 @@ host_driver_t lufa_driver = {
  * Console
  ******************************************************************************/
 #ifdef CONSOLE_ENABLE
+#ifdef CONSOLE_BUFFER_SIZE
+/* Characters of sendchar() waiting for console IN endpoint. Console_Task()
+ * sends them in packets from main loop, sendchar() drops them when full. */
+SPSC_QUEUE(cbuf, uint8_t, CONSOLE_BUFFER_SIZE);
+#endif
+
 static void Console_Task(void)
 {
     /* Device must be connected and configured for the task to run */
@@ -97,30 +175,33 @@ static void Console_Task(void)
 
     uint8_t ep = Endpoint_GetCurrentEndpoint();
 
-#if 0
     // TODO: impl receivechar()/recvchar()
     Endpoint_SelectEndpoint(CONSOLE_OUT_EPNUM);
 
     /* Check to see if a packet has been sent from the host */
     if (Endpoint_IsOUTReceived())
     {
-        /* Check to see if the packet contains data */
-        if (Endpoint_IsReadWriteAllowed())
-        {
-            /* Create a temporary buffer to hold the read in report from the host */
-            uint8_t ConsoleData[CONSOLE_EPSIZE];
+        uint8_t ConsoleData[CONSOLE_EPSIZE] = {};
+        uint8_t len = 0;
 
-            /* Read Console Report Data */
-            Endpoint_Read_Stream_LE(&ConsoleData, sizeof(ConsoleData), NULL);
-
-            /* Process Console Report Data */
-            //ProcessConsoleHIDReport(ConsoleData);
-        }
+        /* Read Console Report Data */
+        while (Endpoint_IsReadWriteAllowed() && len < sizeof(ConsoleData))
+            ConsoleData[len++] = Endpoint_Read_8();
 
         /* Finalize the stream transfer to send the last packet */
         Endpoint_ClearOUT();
+
+        /* Command, reply on IN endpoint after text already in bank */
+        if (console_command(ConsoleData, len)) {
+            Endpoint_SelectEndpoint(CONSOLE_IN_EPNUM);
+            if (Endpoint_BytesInEndpoint())
+                Endpoint_ClearIN();
+            if (Endpoint_WaitUntilReady() == ENDPOINT_READYWAIT_NoError) {
+                Endpoint_Write_Stream_LE(ConsoleData, sizeof(ConsoleData), NULL);
+                Endpoint_ClearIN();
+            }
+        }
     }
-#endif
 
     /* IN packet */
     Endpoint_SelectEndpoint(CONSOLE_IN_EPNUM);
@@ -129,6 +210,18 @@ static void Console_Task(void)
         return;
     }
 
+#ifdef CONSOLE_BUFFER_SIZE
+    // a packet when bank is free, rest waits for next call
+    if (cbuf_has_data() && Endpoint_IsReadWriteAllowed()) {
+        while (cbuf_has_data() && Endpoint_IsReadWriteAllowed())
+            Endpoint_Write_8(cbuf_dequeue());
+
+        // fill rest of bank
+        while (Endpoint_IsReadWriteAllowed())
+            Endpoint_Write_8(0);
+        Endpoint_ClearIN();
+    }
+#else
     // fill empty bank
     while (Endpoint_IsReadWriteAllowed())
         Endpoint_Write_8(0);
@@ -137,6 +230,7 @@ static void Console_Task(void)
     if (Endpoint_IsINReady()) {
         Endpoint_ClearIN();
     }
+#endif
 
     Endpoint_SelectEndpoint(ep);
 }
@@ -147,6 +241,34 @@ static void Console_Task(void)
 #endif
 
 
+/*******************************************************************************
+ * Steno virtual serial port
+ ******************************************************************************/
+#ifdef STENO_ENABLE
+/* kept only to be read back, port has no real line */
+static CDC_LineEncoding_t steno_line_encoding = {
+    .BaudRateBPS = 9600,
+    .CharFormat  = CDC_LINEENCODING_OneStopBit,
+    .ParityType  = CDC_PARITY_None,
+    .DataBits    = 8
+};
+
+/* steno software sends nothing, data from host is thrown away so that
+ * terminal on the port doesn't stall */
+static void Steno_Task(void)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(STENO_OUT_EPNUM);
+    if (Endpoint_IsOUTReceived())
+        Endpoint_ClearOUT();
+    Endpoint_SelectEndpoint(ep);
+}
+#endif
+
+
 /*******************************************************************************
  * USB Events
  ******************************************************************************/
@@ -187,6 +309,10 @@ void EVENT_USB_Device_Reset(void)
 #ifdef LUFA_DEBUG
     print("[R]");
 #endif
+#ifdef POLL_SYNC_ENABLE
+    poll_sync_ep = 0;
+    poll_sync_reset();
+#endif
 }
 
 void EVENT_USB_Device_Suspend()
@@ -205,15 +331,27 @@ void EVENT_USB_Device_WakeUp()
     hook_usb_wakeup();
 }
 
-#ifdef CONSOLE_ENABLE
+#if defined(CONSOLE_ENABLE) && !defined(CONSOLE_BUFFER_SIZE)
 static bool console_flush = false;
 #define CONSOLE_FLUSH_SET(b)   do { \
     uint8_t sreg = SREG; cli(); console_flush = b; SREG = sreg; \
 } while (0)
+#endif
 
+#if defined(CONSOLE_ENABLE) || defined(LUFA_SOF_REPORT) || defined(POLL_SYNC_ENABLE)
 // called every 1ms
 void EVENT_USB_Device_StartOfFrame(void)
 {
+#ifdef POLL_SYNC_ENABLE
+    poll_sync_check();
+    poll_sync_sof();
+#endif
+
+#ifdef LUFA_SOF_REPORT
+    keyboard_report_flush();
+#endif
+
+#if defined(CONSOLE_ENABLE) && !defined(CONSOLE_BUFFER_SIZE)
     static uint8_t count;
     if (++count % 50) return;
     count = 0;
@@ -221,6 +359,7 @@ void EVENT_USB_Device_StartOfFrame(void)
     if (!console_flush) return;
     Console_Task();
     console_flush = false;
+#endif
 }
 #endif
 
@@ -237,20 +376,28 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 #endif
     bool ConfigSuccess = true;
 
+#ifdef LUFA_SOF_REPORT
+    keyboard_report_count = 0;
+#endif
+#ifdef POLL_SYNC_ENABLE
+    poll_sync_ep = 0;
+    poll_sync_reset();
+#endif
+
     /* Setup Keyboard HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(KEYBOARD_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     KEYBOARD_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     KEYBOARD_IN_EPSIZE, HID_EP_BANK);
 
-#ifdef MOUSE_ENABLE
+#if defined(MOUSE_ENABLE) && !defined(MOUSE_SHARED_EP)
     /* Setup Mouse HID Report Endpoint */
     ConfigSuccess &= ENDPOINT_CONFIG(MOUSE_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     MOUSE_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     MOUSE_EPSIZE, HID_EP_BANK);
 #endif
 
 #ifdef EXTRAKEY_ENABLE
     /* Setup Extra HID Report Endpoint */
     ConfigSuccess &= ENDPOINT_CONFIG(EXTRAKEY_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     EXTRAKEY_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     EXTRAKEY_EPSIZE, HID_EP_BANK);
 #endif
 
 #ifdef CONSOLE_ENABLE
@@ -263,10 +410,20 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 #endif
 #endif
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_HYBRID)
     /* Setup NKRO HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(NKRO_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     NKRO_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     NKRO_EPSIZE, HID_EP_BANK);
+#endif
+
+#ifdef STENO_ENABLE
+    /* Setup Steno CDC Endpoints */
+    ConfigSuccess &= ENDPOINT_CONFIG(STENO_NOTIFICATION_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
+                                     STENO_NOTIFICATION_EPSIZE, ENDPOINT_BANK_SINGLE);
+    ConfigSuccess &= ENDPOINT_CONFIG(STENO_OUT_EPNUM, EP_TYPE_BULK, ENDPOINT_DIR_OUT,
+                                     STENO_EPSIZE, ENDPOINT_BANK_SINGLE);
+    ConfigSuccess &= ENDPOINT_CONFIG(STENO_IN_EPNUM, EP_TYPE_BULK, ENDPOINT_DIR_IN,
+                                     STENO_EPSIZE, ENDPOINT_BANK_SINGLE);
 #endif
 }
 
@@ -334,6 +491,7 @@ void EVENT_USB_Device_ControlRequest(void)
                           return;
                     }
                     keyboard_led_stats = Endpoint_Read_8();
+                    host_keyboard_leds_changed();
 
                     Endpoint_ClearOUT();
                     Endpoint_ClearStatusStage();
@@ -406,6 +564,39 @@ void EVENT_USB_Device_ControlRequest(void)
             }
 
             break;
+
+#ifdef STENO_ENABLE
+        /* CDC Class specific requests of steno port */
+        case CDC_REQ_GetLineEncoding:
+            if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE) &&
+                USB_ControlRequest.wIndex == STENO_CCI_INTERFACE)
+            {
+                Endpoint_ClearSETUP();
+                Endpoint_Write_Control_Stream_LE(&steno_line_encoding, sizeof(CDC_LineEncoding_t));
+                Endpoint_ClearOUT();
+            }
+
+            break;
+        case CDC_REQ_SetLineEncoding:
+            if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE) &&
+                USB_ControlRequest.wIndex == STENO_CCI_INTERFACE)
+            {
+                Endpoint_ClearSETUP();
+                Endpoint_Read_Control_Stream_LE(&steno_line_encoding, sizeof(CDC_LineEncoding_t));
+                Endpoint_ClearIN();
+            }
+
+            break;
+        case CDC_REQ_SetControlLineState:
+            if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE) &&
+                USB_ControlRequest.wIndex == STENO_CCI_INTERFACE)
+            {
+                Endpoint_ClearSETUP();
+                Endpoint_ClearStatusStage();
+            }
+
+            break;
+#endif
     }
 }
 
@@ -417,6 +608,110 @@ static uint8_t keyboard_leds(void)
     return keyboard_led_stats;
 }
 
+#ifdef LUFA_SOF_REPORT
+/* Whether next can replace tail in queue without losing a change of tail
+ * from base(report before tail) which host has not seen yet. */
+static bool keyboard_report_mergeable(report_keyboard_t *base,
+                                      report_keyboard_t *tail,
+                                      report_keyboard_t *next)
+{
+    if ((base->mods ^ tail->mods) & (tail->mods ^ next->mods))
+        return false;
+
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        /* bitmap: each bit is a key */
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_BITS; i++) {
+            if ((base->nkro.bits[i] ^ tail->nkro.bits[i]) & (tail->nkro.bits[i] ^ next->nkro.bits[i]))
+                return false;
+        }
+        return true;
+    }
+#endif
+    /* key array: each slot holds a key */
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (base->keys[i] != tail->keys[i] && tail->keys[i] != next->keys[i])
+            return false;
+    }
+    return true;
+}
+
+/* Write a report without waiting, returns false if endpoint is busy.
+ * Called in SOF interrupt, endpoint selection of main loop is restored. */
+static bool keyboard_report_write(report_keyboard_t *report)
+{
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    bool written = false;
+
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        Endpoint_SelectEndpoint(NKRO_REPORT_EPNUM);
+        if (Endpoint_IsReadWriteAllowed()) {
+            Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
+            written = true;
+        }
+    }
+    else
+#endif
+    {
+        Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
+        if (Endpoint_IsReadWriteAllowed()) {
+            Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
+            written = true;
+        }
+    }
+
+    if (written) {
+        Endpoint_ClearIN();
+        BENCH_GPIO_REPORT();
+        POLL_SYNC_WRITTEN(Endpoint_GetCurrentEndpoint());
+    }
+    Endpoint_SelectEndpoint(ep);
+    return written;
+}
+
+/* Send a queued report, one per frame */
+static void keyboard_report_flush(void)
+{
+    if (!keyboard_report_count) return;
+    if (USB_DeviceState != DEVICE_STATE_Configured) return;
+
+    report_keyboard_t *report = &keyboard_report_queue[keyboard_report_head];
+    if (!keyboard_report_write(report)) return;
+
+    keyboard_report_sent = *report;
+    keyboard_report_head = (keyboard_report_head + 1) % LUFA_SOF_REPORT_QUEUE;
+    keyboard_report_count--;
+}
+
+/* Queue report for next frame, merged into last queued one if possible */
+static void send_keyboard(report_keyboard_t *report)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t n = keyboard_report_count;
+    if (n) {
+        uint8_t tail = (keyboard_report_head + n - 1) % LUFA_SOF_REPORT_QUEUE;
+        report_keyboard_t *base = (n > 1) ?
+            &keyboard_report_queue[(tail + LUFA_SOF_REPORT_QUEUE - 1) % LUFA_SOF_REPORT_QUEUE] :
+            &keyboard_report_sent;
+        if (n == LUFA_SOF_REPORT_QUEUE ||
+                keyboard_report_mergeable(base, &keyboard_report_queue[tail], report)) {
+            /* replace tail, a change can be lost only when queue is full */
+            if (n == LUFA_SOF_REPORT_QUEUE) TELEMETRY_COUNT(TELEMETRY_REPORT_LOST);
+            keyboard_report_queue[tail] = *report;
+            SREG = sreg;
+            return;
+        }
+    }
+    keyboard_report_queue[(keyboard_report_head + n) % LUFA_SOF_REPORT_QUEUE] = *report;
+    keyboard_report_count = n + 1;
+    SREG = sreg;
+}
+#else
 static void send_keyboard(report_keyboard_t *report)
 {
     uint8_t timeout = 255;
@@ -428,11 +723,11 @@ static void send_keyboard(report_keyboard_t *report)
 #ifdef NKRO_ENABLE
     if (keyboard_protocol && keyboard_nkro) {
         /* Report protocol - NKRO */
-        Endpoint_SelectEndpoint(NKRO_IN_EPNUM);
+        Endpoint_SelectEndpoint(NKRO_REPORT_EPNUM);
 
         /* Check if write ready for a polling interval around 1ms */
         while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(8);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+        if (!Endpoint_IsReadWriteAllowed()) goto TIMEOUT;
 
         /* Write Keyboard Report Data */
         Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
@@ -445,7 +740,7 @@ static void send_keyboard(report_keyboard_t *report)
 
         /* Check if write ready for a polling interval around 10ms */
         while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+        if (!Endpoint_IsReadWriteAllowed()) goto TIMEOUT;
 
         /* Write Keyboard Report Data */
         Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
@@ -453,10 +748,93 @@ static void send_keyboard(report_keyboard_t *report)
 
     /* Finalize the stream transfer to send the last packet */
     Endpoint_ClearIN();
+    BENCH_GPIO_REPORT();
+    POLL_SYNC_WRITTEN(Endpoint_GetCurrentEndpoint());
 
     keyboard_report_sent = *report;
+    return;
+TIMEOUT:
+    TELEMETRY_COUNT(TELEMETRY_REPORT_LOST);
+}
+#endif
+
+#ifdef MOUSE_ENABLE
+#ifdef MOUSE_SHARED_EP
+#   define MOUSE_REPORT_EPNUM   EXTRAKEY_IN_EPNUM
+#else
+#   define MOUSE_REPORT_EPNUM   MOUSE_IN_EPNUM
+#endif
+
+/* Write report into selected endpoint, with report ID on shared endpoint */
+static void mouse_write_stream(report_mouse_t *report)
+{
+#ifdef MOUSE_SHARED_EP
+    Endpoint_Write_8(REPORT_ID_MOUSE);
+#endif
+    Endpoint_Write_Stream_LE(report, sizeof(report_mouse_t), NULL);
+}
+#endif
+
+#if defined(LUFA_DOUBLE_BANK) && defined(MOUSE_ENABLE)
+/* Mouse report which could not be written while both banks were full.
+ * Motion of next reports is merged into it instead of waiting. */
+static report_mouse_t mouse_pending;
+static bool mouse_pending_valid = false;
+
+static int8_t mouse_add(int8_t a, int8_t b)
+{
+    int16_t v = a + b;
+    if (v > 127) return 127;
+    if (v < -127) return -127;
+    return v;
+}
+
+/* Write a report if a bank gets free in timeout*40us */
+static bool mouse_report_write(report_mouse_t *report, uint8_t timeout)
+{
+    Endpoint_SelectEndpoint(MOUSE_REPORT_EPNUM);
+    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
+    if (!Endpoint_IsReadWriteAllowed()) return false;
+
+    mouse_write_stream(report);
+    Endpoint_ClearIN();
+    return true;
+}
+
+/* Called in main loop to send merged motion when host reads a bank */
+static void mouse_report_flush(void)
+{
+    if (!mouse_pending_valid) return;
+    if (USB_DeviceState != DEVICE_STATE_Configured) return;
+    if (mouse_report_write(&mouse_pending, 0)) mouse_pending_valid = false;
 }
 
+static void send_mouse(report_mouse_t *report)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    if (mouse_pending_valid) {
+        if (!mouse_report_write(&mouse_pending, 0)) {
+            if (mouse_pending.buttons == report->buttons) {
+                mouse_pending.x = mouse_add(mouse_pending.x, report->x);
+                mouse_pending.y = mouse_add(mouse_pending.y, report->y);
+                mouse_pending.v = mouse_add(mouse_pending.v, report->v);
+                mouse_pending.h = mouse_add(mouse_pending.h, report->h);
+                return;
+            }
+            /* button change is not merged so as not to lose a click */
+            if (!mouse_report_write(&mouse_pending, 255)) return;
+        }
+        mouse_pending_valid = false;
+    }
+
+    if (!mouse_report_write(report, 0)) {
+        mouse_pending = *report;
+        mouse_pending_valid = true;
+    }
+}
+#else
 static void send_mouse(report_mouse_t *report)
 {
 #ifdef MOUSE_ENABLE
@@ -466,19 +844,20 @@ static void send_mouse(report_mouse_t *report)
         return;
 
     /* Select the Mouse Report Endpoint */
-    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
+    Endpoint_SelectEndpoint(MOUSE_REPORT_EPNUM);
 
     /* Check if write ready for a polling interval around 10ms */
     while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
     if (!Endpoint_IsReadWriteAllowed()) return;
 
     /* Write Mouse Report Data */
-    Endpoint_Write_Stream_LE(report, sizeof(report_mouse_t), NULL);
+    mouse_write_stream(report);
 
     /* Finalize the stream transfer to send the last packet */
     Endpoint_ClearIN();
 #endif
 }
+#endif
 
 static void send_system(uint16_t data)
 {
@@ -526,11 +905,72 @@ static void send_consumer(uint16_t data)
 #endif
 }
 
+#if CONSUMER_USAGES > 1
+static void send_consumer_report(report_consumer_t *report)
+{
+#ifdef EXTRAKEY_ENABLE
+    uint8_t timeout = 255;
+
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
+
+    /* Check if write ready for a polling interval around 10ms */
+    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
+    if (!Endpoint_IsReadWriteAllowed()) return;
+
+    Endpoint_Write_8(REPORT_ID_CONSUMER);
+    Endpoint_Write_Stream_LE(report, sizeof(report_consumer_t), NULL);
+    Endpoint_ClearIN();
+#endif
+}
+#endif
+
+#ifdef STENO_ENABLE
+/* whole chord in one bulk packet, steno software needs no polling interval */
+static void send_steno(const uint8_t *data, uint8_t len)
+{
+    uint8_t timeout = 255;
+
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(STENO_IN_EPNUM);
+
+    /* Check if write ready for around 10ms, port may not be opened by host */
+    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
+    if (Endpoint_IsReadWriteAllowed()) {
+        Endpoint_Write_Stream_LE(data, len, NULL);
+        Endpoint_ClearIN();
+    }
+    Endpoint_SelectEndpoint(ep);
+}
+#endif
+
 
 /*******************************************************************************
  * sendchar
  ******************************************************************************/
-#ifdef CONSOLE_ENABLE
+#if defined(CONSOLE_ENABLE) && defined(CONSOLE_BUFFER_SIZE)
+int8_t sendchar(uint8_t c)
+{
+#ifdef LUFA_DEBUG_SUART
+    xmit(c);
+#endif
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return -1;
+
+    // USB event handlers print from interrupt
+    uint8_t sreg = SREG;
+    cli();
+    bool queued = cbuf_enqueue(c);
+    if (!queued) TELEMETRY_COUNT(TELEMETRY_CONSOLE_LOST);
+    SREG = sreg;
+    return queued ? 0 : -1;
+}
+#elif defined(CONSOLE_ENABLE)
 #define SEND_TIMEOUT 5
 int8_t sendchar(uint8_t c)
 {
@@ -622,7 +1062,7 @@ static void setup_usb(void)
 
     USB_Init();
 
-    // for Console_Task
+    // for Console_Task, LUFA_SOF_REPORT and POLL_SYNC_ENABLE
     USB_Device_EnableSOFEvents();
 }
 
@@ -652,6 +1092,7 @@ int main(void)
 #endif
     }
 
+#ifdef CONSOLE_ENABLE
     /* wait for Console startup */
     // TODO: long delay often works anyhoo but proper startup would be better
     uint16_t delay = 2000;
@@ -661,6 +1102,7 @@ int main(void)
 #endif
         _delay_ms(1);
     }
+#endif
 
     print("USB configured.\n");
 
@@ -681,7 +1123,25 @@ int main(void)
             hook_usb_suspend_loop();
         }
 
+        /* only USB state is lost when host resets or enumerates device again
+         * (KVM switch, hub power cycle), reports are held meanwhile and the
+         * latest state is sent as soon as it is configured */
+        if (USB_DeviceState != DEVICE_STATE_Configured) {
+            host_driver_reset();
+        } else if (host_driver_pending()) {
+            host_driver_ready();
+        }
+
         keyboard_task();
+#if defined(LUFA_DOUBLE_BANK) && defined(MOUSE_ENABLE)
+        mouse_report_flush();
+#endif
+#if defined(CONSOLE_ENABLE) && defined(CONSOLE_BUFFER_SIZE)
+        Console_Task();
+#endif
+#ifdef STENO_ENABLE
+        Steno_Task();
+#endif
 
 #if !defined(INTERRUPT_CONTROL_ENDPOINT)
         USB_USBTask();
@@ -707,6 +1167,7 @@ void hook_usb_suspend_entry(void)
     _led_stats = keyboard_led_stats;
     keyboard_led_stats = 0;
     led_set(keyboard_led_stats);
+    host_keyboard_leds_changed();
 
     matrix_clear();
     clear_keyboard();
@@ -720,6 +1181,7 @@ void hook_usb_suspend_loop(void)
 {
     suspend_power_down();
     if (USB_Device_RemoteWakeupEnabled && suspend_wakeup_condition()) {
+        keyboard_wakeup_keys();
         USB_Device_SendRemoteWakeup();
     }
 }
@@ -738,4 +1200,5 @@ void hook_usb_wakeup(void)
     //led_set(host_keyboard_leds());
     // Instead, restore stats and update at keyboard_task() in main loop
     keyboard_led_stats = _led_stats;
+    host_keyboard_leds_changed();
 }
@@ -42,9 +42,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <util/delay.h>
 #include "m0110.h"
 #include "debug.h"
+#include "timer.h"
+#include "spsc_queue.h"
 
 
 static inline uint8_t raw2scan(uint8_t raw);
+static bool raw_at(uint8_t i, uint8_t *raw);
+static void raw_consume(uint8_t n);
 static inline uint8_t inquiry(void);
 static inline uint8_t instant(void);
 static inline void clock_lo(void);
@@ -89,10 +93,97 @@ static inline void request(void);
 uint8_t m0110_error = 0;
 
 
+#ifdef M0110_USE_INT
+/*
+ * Pipelined Inquiry
+ *
+ * ISR on both edges of clock sends Inquiry and receives its response bit by
+ * bit, puts response into the queue and requests next Inquiry at once. So
+ * an Inquiry is always outstanding and keyboard answers as soon as a key
+ * event occurs, main loop only picks bytes from the queue.
+ */
+#if !(defined(M0110_INT_INIT) && defined(M0110_INT_ON) && \
+      defined(M0110_INT_OFF) && defined(M0110_INT_VECT))
+#   error "M0110_USE_INT needs interrupt on both edges of clock in config.h"
+#endif
+
+SPSC_QUEUE(rbuf, uint8_t, 8)
+
+static volatile enum { ENG_SEND, ENG_RECV } eng_state;
+static volatile bool eng_alive;
+static uint8_t eng_bits;
+static uint8_t eng_data;
+
+/* keyboard responds to Inquiry in 250ms when no key is pressed */
+#define ENG_TIMEOUT 500
+
+static inline void eng_request(void)
+{
+    eng_state = ENG_SEND;
+    eng_bits = 0;
+    eng_data = M0110_INQUIRY;
+    request();
+}
+
+static void eng_start(void)
+{
+    M0110_INT_OFF();
+    idle();
+    _delay_us(100);
+    eng_request();
+    M0110_INT_ON();
+}
+
+ISR(M0110_INT_VECT)
+{
+    bool clock = clock_in();
+
+    if (eng_state == ENG_SEND) {
+        if (!clock) {
+            // host puts bit while clock is lo
+            if (eng_data & 0x80) { data_hi(); } else { data_lo(); }
+            eng_data <<= 1;
+        } else if (++eng_bits == 8) {
+            _delay_us(100); // hold last bit for 80us
+            idle();
+            eng_state = ENG_RECV;
+            eng_bits = 0;
+        }
+    } else if (clock) {
+        // host reads bit on rising edge
+        eng_data <<= 1;
+        if (data_in()) eng_data |= 1;
+        if (++eng_bits == 8) {
+            rbuf_enqueue(eng_data);
+            eng_alive = true;
+            eng_request();
+        }
+    }
+}
+
+/* restart when keyboard stops answering(unplugged or out of sync) */
+static void eng_watch(void)
+{
+    static uint16_t last = 0;
+    if (eng_alive) {
+        eng_alive = false;
+        last = timer_read();
+    } else if (timer_elapsed(last) > ENG_TIMEOUT) {
+        m0110_error = 1;
+        eng_start();
+        last = timer_read();
+    }
+}
+#endif
+
 void m0110_init(void)
 {
     idle();
     _delay_ms(1000);
+#ifdef M0110_USE_INT
+    M0110_INT_INIT();
+    eng_start();
+#endif
 
 /* Not needed to initialize in fact.
     uint8_t data;
@@ -199,33 +290,35 @@ During Calc key is hold:
     *b: Shift(d) event is ignored.
     *c: Arrow/Calc(d) event is ignored.
 */
+static uint8_t keybuf = M0110_NULL;
+static uint8_t keybuf2 = M0110_NULL;
+
 uint8_t m0110_recv_key(void)
 {
-    static uint8_t keybuf = 0x00;
-    static uint8_t keybuf2 = 0x00;
-    static uint8_t rawbuf = 0x00;
     uint8_t raw, raw2, raw3;
 
-    if (keybuf) {
+    // scan code 00(A) is valid, M0110_NULL marks empty buffer
+    if (keybuf != M0110_NULL) {
         raw = keybuf;
-        keybuf = 0x00;
+        keybuf = M0110_NULL;
         return raw;
     }
-    if (keybuf2) {
+    if (keybuf2 != M0110_NULL) {
         raw = keybuf2;
-        keybuf2 = 0x00;
+        keybuf2 = M0110_NULL;
         return raw;
     }
 
-    if (rawbuf) {
-        raw = rawbuf;
-        rawbuf = 0x00;
-    } else {
-        raw = instant();  // Use INSTANT for better response. Should be INQUIRY ?
-    }
+#ifdef M0110_USE_INT
+    eng_watch();
+#endif
+
+    // bytes of an event are consumed only after the whole event has come
+    if (!raw_at(0, &raw)) return M0110_NULL;
     switch (KEY(raw)) {
         case M0110_KEYPAD:
-            raw2 = instant();
+            if (!raw_at(1, &raw2)) return M0110_NULL;
+            raw_consume(2);
             switch (KEY(raw2)) {
                 case M0110_ARROW_UP:
                 case M0110_ARROW_DOWN:
@@ -242,16 +335,17 @@ uint8_t m0110_recv_key(void)
             return (raw2scan(raw2) | M0110_KEYPAD_OFFSET);
             break;
         case M0110_SHIFT:
-            raw2 = instant();
+            if (!raw_at(1, &raw2)) return M0110_NULL;
             switch (KEY(raw2)) {
                 case M0110_SHIFT:
                     // Case: 5-8,C,G,H
-                    rawbuf = raw2;
+                    raw_consume(1);     // second Shift is next event
                     return raw2scan(raw); // Shift(d/u)
                     break;
                 case M0110_KEYPAD:
                     // Shift + Arrow, Calc, or etc.
-                    raw3 = instant();
+                    if (!raw_at(2, &raw3)) return M0110_NULL;
+                    raw_consume(3);
                     switch (KEY(raw3)) {
                         case M0110_ARROW_UP:
                         case M0110_ARROW_DOWN:
@@ -291,6 +385,7 @@ uint8_t m0110_recv_key(void)
                     break;
                 default:
                     // Shift + Normal keys
+                    raw_consume(2);
                     keybuf = raw2scan(raw2);
                     return raw2scan(raw);   // Shift(d/u)
                     break;
@@ -298,12 +393,66 @@ uint8_t m0110_recv_key(void)
             break;
         default:
             // Normal keys
+            raw_consume(1);
             return raw2scan(raw);
             break;
     }
 }
 
 
+/*
+ * Raw bytes of key event
+ *
+ * An event is up to three bytes with Keypad and Shift prefix. Blocking version
+ * asks keyboard with Instant for each byte as needed. With M0110_USE_INT bytes
+ * come from the queue filled by the ISR, and raw_at() fails until all bytes of
+ * the event have arrived.
+ */
+static uint8_t pend[3];
+static uint8_t pend_len = 0;
+
+static bool raw_at(uint8_t i, uint8_t *raw)
+{
+    while (pend_len <= i) {
+#ifdef M0110_USE_INT
+        if (!rbuf_has_data()) return false;
+        uint8_t data = rbuf_dequeue();
+        if (data == M0110_NULL) continue;   // no key in Inquiry period
+        debug_hex(data); debug(" ");
+        pend[pend_len++] = data;
+#else
+        pend[pend_len++] = instant();  // Use INSTANT for better response. Should be INQUIRY ?
+#endif
+    }
+    *raw = pend[i];
+    return true;
+}
+
+static void raw_consume(uint8_t n)
+{
+    for (uint8_t i = n; i < pend_len; i++) {
+        pend[i - n] = pend[i];
+    }
+    pend_len -= n;
+}
+
+/*
+ * Codes which m0110_recv_key() can return without asking keyboard
+ *
+ * A prefixed event decodes into up to three codes and bytes of next event may
+ * be fetched already. Blocking version needs Instant for anything else.
+ */
+bool m0110_key_pending(void)
+{
+    if (keybuf != M0110_NULL || keybuf2 != M0110_NULL) return true;
+    if (pend_len) return true;
+#ifdef M0110_USE_INT
+    if (rbuf_has_data()) return true;
+#endif
+    return false;
+}
+
+
 static inline uint8_t raw2scan(uint8_t raw) {
     return (raw == M0110_NULL) ?  M0110_NULL : (
                 (raw == M0110_ERROR) ?  M0110_ERROR : (
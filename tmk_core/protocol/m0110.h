@@ -38,6 +38,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef M0110_H
 #define M0110_H
 
+#include <stdint.h>
+#include <stdbool.h>
 
 /* port settings for clock and data line */
 #if !(defined(M0110_CLOCK_PORT) && \
@@ -81,11 +83,16 @@ POSSIBILITY OF SUCH DAMAGE.
 
 extern uint8_t m0110_error;
 
-/* host role */
+/* host role
+ * With M0110_USE_INT the ISR owns the line after m0110_init(), use only
+ * m0110_recv_key() then; it returns M0110_NULL while no key event is queued.
+ */
 void m0110_init(void);
 uint8_t m0110_send(uint8_t data);
 uint8_t m0110_recv(void);
 uint8_t m0110_recv_key(void);
+/* true when m0110_recv_key() has code or bytes already, without Instant */
+bool m0110_key_pending(void);
 uint8_t m0110_inquiry(void);
 uint8_t m0110_instant(void);
 
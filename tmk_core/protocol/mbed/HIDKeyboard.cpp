@@ -1,37 +1,149 @@
 #include <stdint.h>
+#include <string.h>
 #include "USBHID.h"
 #include "USBHID_Types.h"
 #include "USBDescriptor.h"
+#include "host.h"
+#include "report_desc.h"
 #include "HIDKeyboard.h"
 
 #define DEFAULT_CONFIGURATION (1)
 
+/* HID class requests not in USBHID_Types.h */
+#define GET_PROTOCOL    (0x3)
+#define SET_PROTOCOL    (0xb)
+
+#define KEYBOARD_INTERFACE  0
+#define KEYBOARD_EP         EP1IN
+#ifdef HIDKEYBOARD_SHARED
+#   define SHARED_INTERFACE 1
+#   define SHARED_EP        EP2IN
+#   define NUM_INTERFACES   2
+#else
+#   define NUM_INTERFACES   1
+#endif
+
+/* 0: boot, 1: report(default) */
+uint8_t keyboard_protocol = 1;
+
 
 HIDKeyboard::HIDKeyboard(uint16_t vendor_id, uint16_t product_id, uint16_t product_release): USBDevice(vendor_id, product_id, product_release)
 {
+    clearQueues();
     USBDevice::connect();
 }
 
-bool HIDKeyboard::sendReport(report_keyboard_t report) {
-    USBDevice::write(EP1IN, report.raw, sizeof(report), MAX_PACKET_SIZE_EP1);
-    return true;
+bool HIDKeyboard::sendKeyboard(report_keyboard_t *report) {
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        return queueReport(SHARED_EP, &shared_queue, REPORT_ID_NKRO, report->raw, KEYBOARD_REPORT_SIZE);
+    }
+#endif
+    // boot keyboard report: mods, reserved and 6 keys
+    return queueReport(KEYBOARD_EP, &keyboard_queue, 0, report->raw, 8);
+}
+
+bool HIDKeyboard::sendMouse(report_mouse_t *report) {
+#ifdef MOUSE_ENABLE
+    return queueReport(SHARED_EP, &shared_queue, REPORT_ID_MOUSE, (uint8_t *)report, sizeof(report_mouse_t));
+#else
+    (void)report;
+    return false;
+#endif
+}
+
+bool HIDKeyboard::sendExtra(uint8_t report_id, uint16_t data) {
+#ifdef EXTRAKEY_ENABLE
+    uint8_t usage[2] = { (uint8_t)(data & 0xFF), (uint8_t)(data >> 8) };
+    return queueReport(SHARED_EP, &shared_queue, report_id, usage, sizeof(usage));
+#else
+    (void)report_id; (void)data;
+    return false;
+#endif
 }
 
 uint8_t HIDKeyboard::leds() {
     return led_state;
 }
 
+bool HIDKeyboard::queueReport(uint8_t endpoint, report_queue_t *q, uint8_t id, uint8_t *data, uint8_t size) {
+    if (!configured()) {
+        return false;
+    }
+
+    __disable_irq();
+    uint8_t i;
+    if (q->count < HIDKEYBOARD_QUEUE_SIZE) {
+        i = (q->head + q->count++) % HIDKEYBOARD_QUEUE_SIZE;
+    } else {
+        // full: replace last queued report, head is in flight
+        i = (q->head + HIDKEYBOARD_QUEUE_SIZE - 1) % HIDKEYBOARD_QUEUE_SIZE;
+    }
+    uint8_t n = 0;
+    if (id) q->data[i][n++] = id;
+    memcpy(&q->data[i][n], data, size);
+    q->len[i] = n + size;
+
+    // endpoint is idle, otherwise callback of report in flight writes this
+    if (q->count == 1) {
+        if (endpointWrite(endpoint, q->data[q->head], q->len[q->head]) != EP_PENDING) {
+            q->count = 0;
+        }
+    }
+    __enable_irq();
+    return true;
+}
+
+/* called from USB interrupt when host took report at head */
+void HIDKeyboard::writeNext(uint8_t endpoint, report_queue_t *q) {
+    if (q->count == 0) return;
+
+    q->head = (q->head + 1) % HIDKEYBOARD_QUEUE_SIZE;
+    q->count--;
+    if (q->count) {
+        if (endpointWrite(endpoint, q->data[q->head], q->len[q->head]) != EP_PENDING) {
+            q->count = 0;
+        }
+    }
+}
+
+void HIDKeyboard::clearQueues(void) {
+    keyboard_queue.head = keyboard_queue.count = 0;
+#ifdef HIDKEYBOARD_SHARED
+    shared_queue.head = shared_queue.count = 0;
+#endif
+}
+
+bool HIDKeyboard::EP1_IN_callback() {
+    writeNext(KEYBOARD_EP, &keyboard_queue);
+    return true;
+}
+
+#ifdef HIDKEYBOARD_SHARED
+bool HIDKeyboard::EP2_IN_callback() {
+    writeNext(SHARED_EP, &shared_queue);
+    return true;
+}
+#endif
+
+void HIDKeyboard::USBCallback_busReset(void) {
+    clearQueues();
+    keyboard_protocol = 1;
+}
+
 bool HIDKeyboard::USBCallback_setConfiguration(uint8_t configuration) {
     if (configuration != DEFAULT_CONFIGURATION) {
         return false;
     }
 
-    // Configure endpoints > 0
-    addEndpoint(EPINT_IN, MAX_PACKET_SIZE_EPINT);
-    //addEndpoint(EPINT_OUT, MAX_PACKET_SIZE_EPINT);
+    // reports in flight are lost by reconfiguration
+    clearQueues();
 
-    // We activate the endpoint to be able to recceive data
-    //readStart(EPINT_OUT, MAX_PACKET_SIZE_EPINT);
+    // Configure endpoints > 0
+    addEndpoint(KEYBOARD_EP, MAX_PACKET_SIZE_EP1);
+#ifdef HIDKEYBOARD_SHARED
+    addEndpoint(SHARED_EP, MAX_PACKET_SIZE_EP2);
+#endif
     return true;
 }
 
@@ -63,49 +175,28 @@ uint8_t * HIDKeyboard::stringIserialDesc() {
     return stringIserialDescriptor;
 }
 
+
+static uint8_t keyboardReportDescriptor[] = {
+    HID_DESC_KEYBOARD(6)
+};
+
+#ifdef HIDKEYBOARD_SHARED
+static uint8_t sharedReportDescriptor[] = {
+#   ifdef MOUSE_ENABLE
+    HID_DESC_MOUSE_ID(REPORT_ID_MOUSE),
+#   endif
+#   ifdef EXTRAKEY_ENABLE
+    HID_DESC_EXTRAKEY,
+#   endif
+#   ifdef NKRO_ENABLE
+    HID_DESC_NKRO_ID(REPORT_ID_NKRO, KEYBOARD_REPORT_BITS),
+#   endif
+};
+#endif
+
 uint8_t * HIDKeyboard::reportDesc() {
-    static uint8_t reportDescriptor[] = {
-        USAGE_PAGE(1), 0x01,                    // Generic Desktop
-        USAGE(1), 0x06,                         // Keyboard
-        COLLECTION(1), 0x01,                    // Application
-
-        USAGE_PAGE(1), 0x07,                    // Key Codes
-        USAGE_MINIMUM(1), 0xE0,
-        USAGE_MAXIMUM(1), 0xE7,
-        LOGICAL_MINIMUM(1), 0x00,
-        LOGICAL_MAXIMUM(1), 0x01,
-        REPORT_SIZE(1), 0x01,
-        REPORT_COUNT(1), 0x08,
-        INPUT(1), 0x02,                         // Data, Variable, Absolute
-
-        REPORT_COUNT(1), 0x01,
-        REPORT_SIZE(1), 0x08,
-        INPUT(1), 0x01,                         // Constant
-
-        REPORT_COUNT(1), 0x05,
-        REPORT_SIZE(1), 0x01,
-        USAGE_PAGE(1), 0x08,                    // LEDs
-        USAGE_MINIMUM(1), 0x01,
-        USAGE_MAXIMUM(1), 0x05,
-        OUTPUT(1), 0x02,                        // Data, Variable, Absolute
-
-        REPORT_COUNT(1), 0x01,
-        REPORT_SIZE(1), 0x03,
-        OUTPUT(1), 0x01,                        // Constant
-
-
-        REPORT_COUNT(1), 0x06,
-        REPORT_SIZE(1), 0x08,
-        LOGICAL_MINIMUM(1), 0x00,
-        LOGICAL_MAXIMUM(2), 0xFF, 0x00,
-        USAGE_PAGE(1), 0x07,                    // Key Codes
-        USAGE_MINIMUM(1), 0x00,
-        USAGE_MAXIMUM(1), 0xFF,
-        INPUT(1), 0x00,                         // Data, Array
-        END_COLLECTION(0),
-    };
-    reportLength = sizeof(reportDescriptor);
-    return reportDescriptor;
+    reportLength = sizeof(keyboardReportDescriptor);
+    return keyboardReportDescriptor;
 }
 
 uint16_t HIDKeyboard::reportDescLength() {
@@ -113,25 +204,31 @@ uint16_t HIDKeyboard::reportDescLength() {
     return reportLength;
 }
 
-#define TOTAL_DESCRIPTOR_LENGTH ((1 * CONFIGURATION_DESCRIPTOR_LENGTH) \
-                               + (1 * INTERFACE_DESCRIPTOR_LENGTH) \
-                               + (1 * HID_DESCRIPTOR_LENGTH) \
-                               + (1 * ENDPOINT_DESCRIPTOR_LENGTH))
+#define HID_INTERFACE_LENGTH    (INTERFACE_DESCRIPTOR_LENGTH \
+                               + HID_DESCRIPTOR_LENGTH \
+                               + ENDPOINT_DESCRIPTOR_LENGTH)
+#define TOTAL_DESCRIPTOR_LENGTH (CONFIGURATION_DESCRIPTOR_LENGTH \
+                               + (NUM_INTERFACES * HID_INTERFACE_LENGTH))
+/* HID descriptor of interface follows its interface descriptor */
+#define HID_DESCRIPTOR_OFFSET(interface) (CONFIGURATION_DESCRIPTOR_LENGTH \
+                               + (interface) * HID_INTERFACE_LENGTH \
+                               + INTERFACE_DESCRIPTOR_LENGTH)
+
 uint8_t * HIDKeyboard::configurationDesc() {
     static uint8_t configurationDescriptor[] = {
         CONFIGURATION_DESCRIPTOR_LENGTH,// bLength
         CONFIGURATION_DESCRIPTOR,       // bDescriptorType
         LSB(TOTAL_DESCRIPTOR_LENGTH),   // wTotalLength (LSB)
         MSB(TOTAL_DESCRIPTOR_LENGTH),   // wTotalLength (MSB)
-        0x01,                           // bNumInterfaces
+        NUM_INTERFACES,                 // bNumInterfaces
         DEFAULT_CONFIGURATION,          // bConfigurationValue
         0x00,                           // iConfiguration
         C_RESERVED | C_REMOTE_WAKEUP,   // bmAttributes
-        C_POWER(100),                   // bMaxPowerHello World from Mbed
+        C_POWER(100),                   // bMaxPower
 
         INTERFACE_DESCRIPTOR_LENGTH,    // bLength
         INTERFACE_DESCRIPTOR,           // bDescriptorType
-        0x00,                           // bInterfaceNumber
+        KEYBOARD_INTERFACE,             // bInterfaceNumber
         0x00,                           // bAlternateSetting
         0x01,                           // bNumEndpoints
         HID_CLASS,                      // bInterfaceClass
@@ -146,16 +243,46 @@ uint8_t * HIDKeyboard::configurationDesc() {
         0x00,                           // bCountryCode
         0x01,                           // bNumDescriptors
         REPORT_DESCRIPTOR,              // bDescriptorType
-        (uint8_t)(LSB(reportDescLength())),  // wDescriptorLength (LSB)
-        (uint8_t)(MSB(reportDescLength())),  // wDescriptorLength (MSB)
+        (uint8_t)(LSB(sizeof(keyboardReportDescriptor))),  // wDescriptorLength (LSB)
+        (uint8_t)(MSB(sizeof(keyboardReportDescriptor))),  // wDescriptorLength (MSB)
+
+        ENDPOINT_DESCRIPTOR_LENGTH,     // bLength
+        ENDPOINT_DESCRIPTOR,            // bDescriptorType
+        PHY_TO_DESC(KEYBOARD_EP),       // bEndpointAddress
+        E_INTERRUPT,                    // bmAttributes
+        LSB(MAX_PACKET_SIZE_EP1),       // wMaxPacketSize (LSB)
+        MSB(MAX_PACKET_SIZE_EP1),       // wMaxPacketSize (MSB)
+        1,                              // bInterval (milliseconds)
+
+#ifdef HIDKEYBOARD_SHARED
+        INTERFACE_DESCRIPTOR_LENGTH,    // bLength
+        INTERFACE_DESCRIPTOR,           // bDescriptorType
+        SHARED_INTERFACE,               // bInterfaceNumber
+        0x00,                           // bAlternateSetting
+        0x01,                           // bNumEndpoints
+        HID_CLASS,                      // bInterfaceClass
+        HID_SUBCLASS_NONE,              // bInterfaceSubClass
+        HID_PROTOCOL_NONE,              // bInterfaceProtocol
+        0x00,                           // iInterface
+
+        HID_DESCRIPTOR_LENGTH,          // bLength
+        HID_DESCRIPTOR,                 // bDescriptorType
+        LSB(HID_VERSION_1_11),          // bcdHID (LSB)
+        MSB(HID_VERSION_1_11),          // bcdHID (MSB)
+        0x00,                           // bCountryCode
+        0x01,                           // bNumDescriptors
+        REPORT_DESCRIPTOR,              // bDescriptorType
+        (uint8_t)(LSB(sizeof(sharedReportDescriptor))),  // wDescriptorLength (LSB)
+        (uint8_t)(MSB(sizeof(sharedReportDescriptor))),  // wDescriptorLength (MSB)
 
         ENDPOINT_DESCRIPTOR_LENGTH,     // bLength
         ENDPOINT_DESCRIPTOR,            // bDescriptorType
-        PHY_TO_DESC(EP1IN),             // bEndpointAddress
+        PHY_TO_DESC(SHARED_EP),         // bEndpointAddress
         E_INTERRUPT,                    // bmAttributes
-        LSB(MAX_PACKET_SIZE_EPINT),     // wMaxPacketSize (LSB)
-        MSB(MAX_PACKET_SIZE_EPINT),     // wMaxPacketSize (MSB)
-        1,                           // bInterval (milliseconds)
+        LSB(MAX_PACKET_SIZE_EP2),       // wMaxPacketSize (LSB)
+        MSB(MAX_PACKET_SIZE_EP2),       // wMaxPacketSize (MSB)
+        1,                              // bInterval (milliseconds)
+#endif
     };
     return configurationDescriptor;
 }
@@ -186,10 +313,11 @@ uint8_t * HIDKeyboard::deviceDesc() {
 }
 #endif
 
+
 bool HIDKeyboard::USBCallback_request() {
     bool success = false;
     CONTROL_TRANSFER * transfer = getTransferPtr();
-    uint8_t *hidDescriptor;
+    uint8_t interface = transfer->setup.wIndex & 0xFF;
 
     // Process additional standard requests
 
@@ -201,26 +329,29 @@ bool HIDKeyboard::USBCallback_request() {
                 switch (DESCRIPTOR_TYPE(transfer->setup.wValue))
                 {
                     case REPORT_DESCRIPTOR:
-                        if ((reportDesc() != NULL) \
-                            && (reportDescLength() != 0))
-                        {
-                            transfer->remaining = reportDescLength();
-                            transfer->ptr = reportDesc();
+                        if (interface == KEYBOARD_INTERFACE) {
+                            transfer->remaining = sizeof(keyboardReportDescriptor);
+                            transfer->ptr = keyboardReportDescriptor;
+                            transfer->direction = DEVICE_TO_HOST;
+                            success = true;
+                        }
+#ifdef HIDKEYBOARD_SHARED
+                        if (interface == SHARED_INTERFACE) {
+                            transfer->remaining = sizeof(sharedReportDescriptor);
+                            transfer->ptr = sharedReportDescriptor;
                             transfer->direction = DEVICE_TO_HOST;
                             success = true;
                         }
+#endif
                         break;
                     case HID_DESCRIPTOR:
-                            // Find the HID descriptor, after the configuration descriptor
-                            hidDescriptor = findDescriptor(HID_DESCRIPTOR);
-                            if (hidDescriptor != NULL)
-                            {
-                                transfer->remaining = HID_DESCRIPTOR_LENGTH;
-                                transfer->ptr = hidDescriptor;
-                                transfer->direction = DEVICE_TO_HOST;
-                                success = true;
-                            }
-                            break;
+                        if (interface < NUM_INTERFACES) {
+                            transfer->remaining = HID_DESCRIPTOR_LENGTH;
+                            transfer->ptr = configurationDesc() + HID_DESCRIPTOR_OFFSET(interface);
+                            transfer->direction = DEVICE_TO_HOST;
+                            success = true;
+                        }
+                        break;
                      
                     default:
                         break;
@@ -236,16 +367,29 @@ bool HIDKeyboard::USBCallback_request() {
     {
         switch (transfer->setup.bRequest) {
             case SET_REPORT:
-                // LED indicator
-                // TODO: check Interface and Report length?
-                // if (transfer->setup.wIndex == INTERFACE_KEYBOAD) { }
-                // if (transfer->setup.wLength == 1)
-
-                transfer->remaining = 1;
-                //transfer->ptr = ?? what ptr should be set when OUT(not used?)
+                // LED indicator: [leds] on keyboard, [REPORT_ID_NKRO, leds] on shared interface
+                if (transfer->setup.wLength == 0 || transfer->setup.wLength > 2) break;
+                transfer->remaining = transfer->setup.wLength;
                 transfer->direction = HOST_TO_DEVICE;
                 transfer->notify = true;    /* notify with USBCallback_requestCompleted */
                 success = true;
+                break;
+            case GET_PROTOCOL:
+                if (interface != KEYBOARD_INTERFACE) break;
+                transfer->remaining = 1;
+                transfer->ptr = &keyboard_protocol;
+                transfer->direction = DEVICE_TO_HOST;
+                success = true;
+                break;
+            case SET_PROTOCOL:
+                if (interface != KEYBOARD_INTERFACE) break;
+                keyboard_protocol = transfer->setup.wValue & 0xFF;
+                success = true;
+                break;
+            case SET_IDLE:
+                // reports are sent only on change anyway
+                success = true;
+                break;
             default:
                 break;
         }
@@ -261,7 +405,12 @@ void HIDKeyboard::USBCallback_requestCompleted(uint8_t * buf, uint32_t length)
         if (transfer->setup.bmRequestType.Type == CLASS_TYPE) {
             switch (transfer->setup.bRequest) {
                 case SET_REPORT:
-                    led_state = buf[0];
+                    if (length == 1) {
+                        led_state = buf[0];
+                    } else if (buf[0] == REPORT_ID_NKRO) {
+                        led_state = buf[1];
+                    }
+                    host_keyboard_leds_changed();
                     break;
                 default:
                     break;
@@ -1,4 +1,5 @@
 #ifndef HIDKEYBOARD_H
+#define HIDKEYBOARD_H
 
 #include "stdint.h"
 #include "stdbool.h"
@@ -6,15 +7,49 @@
 #include "report.h"
 
 
+/*
+ * Composite HID device
+ *
+ * Interface 0: boot keyboard on EP1 IN
+ * Interface 1: mouse, system, consumer and NKRO keyboard with report ID on
+ *              EP2 IN, only when any of them is enabled
+ *
+ * EP1 and EP2 only: IN completion of EP3 and up is not delivered to its own
+ * callback by USBHAL_KL25Z(infinity).
+ *
+ * Reports are written without waiting. Each IN endpoint has a small queue,
+ * next report is written from endpoint callback when previous one is taken
+ * by host. When the queue is full latest report replaces last queued one,
+ * reports are states and the last one has to reach host.
+ */
+#if defined(MOUSE_ENABLE) || defined(EXTRAKEY_ENABLE) || defined(NKRO_ENABLE)
+#   define HIDKEYBOARD_SHARED
+#endif
+
+#define HIDKEYBOARD_QUEUE_SIZE  4
+/* report ID and NKRO report */
+#define HIDKEYBOARD_REPORT_MAX  (1 + KEYBOARD_REPORT_SIZE)
+
+typedef struct {
+    uint8_t data[HIDKEYBOARD_QUEUE_SIZE][HIDKEYBOARD_REPORT_MAX];
+    uint8_t len[HIDKEYBOARD_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t count;      // head is in flight while count > 0
+} report_queue_t;
+
+
 class HIDKeyboard : public USBDevice {
 public:
     HIDKeyboard(uint16_t vendor_id = 0xFEED, uint16_t product_id = 0xabed, uint16_t product_release = 0x0001);
 
-    bool sendReport(report_keyboard_t report);
+    bool sendKeyboard(report_keyboard_t *report);
+    bool sendMouse(report_mouse_t *report);
+    bool sendExtra(uint8_t report_id, uint16_t data);
     uint8_t leds(void);
 protected:
     uint16_t reportLength;
     virtual bool USBCallback_setConfiguration(uint8_t configuration);
+    virtual void USBCallback_busReset(void);
     virtual uint8_t * stringImanufacturerDesc();
     virtual uint8_t * stringIproductDesc();
     virtual uint8_t * stringIserialDesc();
@@ -24,8 +59,19 @@ protected:
     //virtual uint8_t * deviceDesc();
     virtual bool USBCallback_request();
     virtual void USBCallback_requestCompleted(uint8_t * buf, uint32_t length);
+    virtual bool EP1_IN_callback();
+#ifdef HIDKEYBOARD_SHARED
+    virtual bool EP2_IN_callback();
+#endif
 private:
     uint8_t led_state;
+    report_queue_t keyboard_queue;
+#ifdef HIDKEYBOARD_SHARED
+    report_queue_t shared_queue;
+#endif
+    bool queueReport(uint8_t endpoint, report_queue_t *q, uint8_t id, uint8_t *data, uint8_t size);
+    void writeNext(uint8_t endpoint, report_queue_t *q);
+    void clearQueues(void);
 };
 
 #endif
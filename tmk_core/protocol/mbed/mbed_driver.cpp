@@ -28,14 +28,17 @@ static uint8_t keyboard_leds(void)
 }
 static void send_keyboard(report_keyboard_t *report)
 {
-    keyboard.sendReport(*report);
+    keyboard.sendKeyboard(report);
 }
 static void send_mouse(report_mouse_t *report)
 {
+    keyboard.sendMouse(report);
 }
 static void send_system(uint16_t data)
 {
+    keyboard.sendExtra(REPORT_ID_SYSTEM, data);
 }
 static void send_consumer(uint16_t data)
 {
+    keyboard.sendExtra(REPORT_ID_CONSUMER, data);
 }
@@ -45,6 +45,7 @@ POSSIBILITY OF SUCH DAMAGE.
 /* host role */
 void news_init(void);
 uint8_t news_recv(void);
+uint16_t news_recv_time(void);
 
 /* device role */
 
@@ -50,6 +50,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdbool.h>
 #include <util/atomic.h>
 #include <util/delay.h>
+#include <avr/interrupt.h>
 #include "next_kbd.h"
 #include "debug.h"
 
@@ -70,6 +71,166 @@ static inline uint32_t response(void);
 #define query_delay(intervals)   do { query();  _delay_us((NEXT_KBD_TIMING+1) * intervals); } while (0);
 #define reset_delay(intervals)   do { reset();  _delay_us((NEXT_KBD_TIMING+1) * intervals); } while (0);
 
+#define NEXT_KBD_READ (NEXT_KBD_IN_PIN&(1<<NEXT_KBD_IN_BIT))
+
+#ifdef NEXT_KBD_USE_TIMER
+/*
+ * Timer driven query/response
+ *
+ * Timer1 compare ticks at one interval and shifts out query, reset and LED
+ * sequences as bit patterns, then samples the response in the middle of
+ * each bit. Falling edge interrupt on KBD_IN aligns sampling to start of
+ * the response and again at bit 11, which is always a falling edge, like
+ * the blocking version does. The ISR writes the response straight into the
+ * back slot of a double buffer and swaps it in when complete; next query
+ * is not sent until main loop has taken the front frame.
+ */
+#if !(defined(NEXT_KBD_INT_INIT) && defined(NEXT_KBD_INT_ON) && \
+      defined(NEXT_KBD_INT_OFF) && defined(NEXT_KBD_INT_VECT))
+#   error "NEXT_KBD_USE_TIMER needs falling edge interrupt of KBD_IN in config.h"
+#endif
+#ifdef SLEEP_LED_ENABLE
+#   error "NEXT_KBD_USE_TIMER uses Timer1 and conflicts with SLEEP_LED_ENABLE"
+#endif
+
+/* Timer1 clock at F_CPU/8 */
+#define TICKS(us)   ((uint16_t)((us) * (F_CPU / 8 / 1000000)) - 1)
+#define TICK_OUT    TICKS(NEXT_KBD_TIMING + 1)
+#define TICK_IN     TICKS(NEXT_KBD_TIMING)
+
+/* output sequences: one bit for each interval from LSB, 1 is hi */
+#define SEQ_QUERY_PAT   (1UL<<5)                /* lo5 hi1 lo3 */
+#define SEQ_QUERY_LEN   9
+#define SEQ_RESET_PAT   (0x1EUL | (0x3FUL<<6))  /* lo1 hi4 lo1 hi6 lo10 */
+#define SEQ_RESET_LEN   22
+#define SEQ_LEDS_PAT    (7UL<<9)                /* lo9 hi3 lo1 L R lo7 */
+#define SEQ_LEDS_LEN    22
+
+/* keyboard responds in 5ms after query; gap is scan rate of blocking version */
+#define WAIT_INTERVALS  (5000 / (NEXT_KBD_TIMING + 1))
+#define GAP_INTERVALS   (5000 / (NEXT_KBD_TIMING + 1))
+
+static enum {
+    ENG_GAP,
+    ENG_OUT,
+    ENG_WAIT,
+    ENG_RECV,
+    ENG_RESYNC,
+} eng_state;
+static bool     eng_query;  // output is query and response follows
+static uint32_t out_pat;
+static uint8_t  out_len;
+static uint8_t  eng_count;
+static uint8_t  rx_bit;
+
+static volatile uint32_t frame[2];
+static volatile uint8_t  frame_front = 0;
+static volatile bool     frame_ready = false;
+
+static volatile bool     led_pending = false;
+static volatile uint32_t led_pat;
+
+static void eng_out(uint32_t pat, uint8_t len, bool query)
+{
+    out_pat = pat;
+    out_len = len;
+    eng_query = query;
+    eng_state = ENG_OUT;
+    OCR1A = TICK_OUT;
+}
+
+static void eng_gap(void)
+{
+    out_hi();
+    eng_count = GAP_INTERVALS;
+    eng_state = ENG_GAP;
+    OCR1A = TICK_OUT;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    switch (eng_state) {
+        case ENG_GAP:
+            if (eng_count && --eng_count) break;
+            if (led_pending) {
+                led_pending = false;
+                eng_out(led_pat, SEQ_LEDS_LEN, false);
+            } else if (!frame_ready && NEXT_KBD_READ) {
+                // KBD_IN is lo when keyboard is not connected
+                eng_out(SEQ_QUERY_PAT, SEQ_QUERY_LEN, true);
+            }
+            break;
+        case ENG_OUT:
+            if (out_len) {
+                if (out_pat & 1) { out_hi(); } else { out_lo(); }
+                out_pat >>= 1;
+                out_len--;
+            } else if (eng_query) {
+                out_hi();
+                frame[frame_front ^ 1] = 0;
+                eng_count = WAIT_INTERVALS;
+                eng_state = ENG_WAIT;
+                NEXT_KBD_INT_ON();
+            } else {
+                eng_gap();
+            }
+            break;
+        case ENG_WAIT:
+            if (--eng_count == 0) {
+                // no response
+                NEXT_KBD_INT_OFF();
+                eng_out(SEQ_RESET_PAT, SEQ_RESET_LEN, false);
+            }
+            break;
+        case ENG_RECV:
+            OCR1A = TICK_IN;
+            if (NEXT_KBD_READ) {
+                frame[frame_front ^ 1] |= ((uint32_t)1 << rx_bit);
+                if (rx_bit == 10) {
+                    // bit 11 is always 0: wait for its edge to resync
+                    rx_bit = 12;
+                    eng_count = 3;
+                    eng_state = ENG_RESYNC;
+                    NEXT_KBD_INT_ON();
+                    break;
+                }
+            }
+            if (++rx_bit == 22) {
+                frame_front ^= 1;
+                frame_ready = true;
+                eng_gap();
+            }
+            break;
+        case ENG_RESYNC:
+            if (--eng_count == 0) {
+                // lost edge of bit 11
+                NEXT_KBD_INT_OFF();
+                eng_gap();
+            }
+            break;
+    }
+}
+
+ISR(NEXT_KBD_INT_VECT)
+{
+    NEXT_KBD_INT_OFF();
+    if (eng_state == ENG_WAIT) {
+        // sample from middle of bit 0
+        rx_bit = 0;
+        OCR1A = TICKS(NEXT_KBD_TIMING / 2);
+        eng_state = ENG_RECV;
+    } else if (eng_state == ENG_RESYNC) {
+        // sample from middle of bit 12
+        OCR1A = TICKS(NEXT_KBD_TIMING * 3 / 2);
+        eng_state = ENG_RECV;
+    } else {
+        return;
+    }
+    TCNT1 = 0;
+    TIFR1 = (1<<OCF1A);
+}
+#endif
+
 void next_kbd_init(void)
 {
     out_hi();
@@ -81,10 +242,33 @@ void next_kbd_init(void)
     
     query_delay(5);
     reset_delay(8);
+
+#ifdef NEXT_KBD_USE_TIMER
+    NEXT_KBD_INT_INIT();
+    NEXT_KBD_INT_OFF();
+    eng_count = 0;
+    eng_state = ENG_GAP;
+    TCCR1A = 0;
+    TCNT1 = 0;
+    OCR1A = TICK_OUT;
+    TCCR1B = (1<<WGM12) | (1<<CS11);    // CTC, clk/8
+    TIFR1 = (1<<OCF1A);
+    TIMSK1 |= (1<<OCIE1A);
+#endif
 }
 
 void next_kbd_set_leds(bool left, bool right)
 {
+#ifdef NEXT_KBD_USE_TIMER
+    // sent by timer in place of next query
+    uint32_t pat = SEQ_LEDS_PAT;
+    if (left)  pat |= (1UL<<13);
+    if (right) pat |= (1UL<<14);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        led_pat = pat;
+        led_pending = true;
+    }
+#else
     cli();
     out_lo_delay(9);
     
@@ -106,11 +290,18 @@ void next_kbd_set_leds(bool left, bool right)
     out_lo_delay(7);
     out_hi();
     sei();
+#endif
 }
 
-#define NEXT_KBD_READ (NEXT_KBD_IN_PIN&(1<<NEXT_KBD_IN_BIT))
 uint32_t next_kbd_recv(void)
 {
+#ifdef NEXT_KBD_USE_TIMER
+    // front slot is not written until next frame is swapped in
+    if (!frame_ready) return 0;
+    uint32_t resp = frame[frame_front];
+    frame_ready = false;
+    return resp;
+#else
     
     // First check to make sure that the keyboard is actually connected;
     // if not, just return
@@ -124,6 +315,7 @@ uint32_t next_kbd_recv(void)
     uint32_t resp = response();
     
     return resp;
+#endif
 }
 
 static inline uint32_t response(void)
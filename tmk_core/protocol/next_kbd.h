@@ -55,7 +55,10 @@ POSSIBILITY OF SUCH DAMAGE.
 
 extern uint8_t next_kbd_error;
 
-/* host role */
+/* host role
+ * With NEXT_KBD_USE_TIMER next_kbd_recv() returns latest response captured by
+ * Timer1 in background, or 0 if no new response has come.
+ */
 void next_kbd_init(void);
 void next_kbd_set_leds(bool left, bool right);
 uint32_t next_kbd_recv(void);
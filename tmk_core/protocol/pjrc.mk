@@ -23,6 +23,12 @@ ifdef EXTRAKEY_ENABLE
     SRC += $(PJRC_DIR)/usb_extra.c
 endif
 
+# Send keyboard report from Start of Frame interrupt instead of waiting
+# for endpoint in keyboard_task()
+ifeq (yes,$(strip $(PJRC_SOF_REPORT)))
+    OPT_DEFS += -DPJRC_SOF_REPORT
+endif
+
 # Search Path
 VPATH += $(TMK_DIR)/$(PJRC_DIR)
 
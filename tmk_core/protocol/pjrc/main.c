@@ -36,6 +36,13 @@
 #include "suspend.h"
 #include "host.h"
 #include "pjrc.h"
+#include "hook.h"
+#include "led.h"
+#include "action.h"
+#include "usb_keyboard.h"
+#ifdef SLEEP_LED_ENABLE
+#include "sleep_led.h"
+#endif
 
 
 #define CPU_PRESCALE(n)    (CLKPR = 0x80, CLKPR = (n))
@@ -63,12 +70,53 @@ int main(void)
 #endif
     while (1) {
         while (suspend) {
-            suspend_power_down();
-            if (remote_wakeup && suspend_wakeup_condition()) {
-                usb_remote_wakeup();
-            }
+            hook_usb_suspend_loop();
         }
 
         keyboard_task(); 
     }
 }
+
+
+/* hooks, USB interrupt calls entry and wakeup */
+static uint8_t _led_stats = 0;
+__attribute__((weak))
+void hook_usb_suspend_entry(void)
+{
+    // Turn LED off with putting aside status, it is restored after wakeup
+    // and updated at keyboard_task() in main loop
+    _led_stats = usb_keyboard_leds;
+    usb_keyboard_leds = 0;
+    led_set(usb_keyboard_leds);
+    host_keyboard_leds_changed();
+
+    matrix_clear();
+    clear_keyboard();
+#ifdef SLEEP_LED_ENABLE
+    sleep_led_enable();
+#endif
+}
+
+__attribute__((weak))
+void hook_usb_suspend_loop(void)
+{
+    suspend_power_down();
+    if (remote_wakeup && suspend_wakeup_condition()) {
+        keyboard_wakeup_keys();
+        usb_remote_wakeup();
+    }
+}
+
+__attribute__((weak))
+void hook_usb_wakeup(void)
+{
+    suspend_wakeup_init();
+#ifdef SLEEP_LED_ENABLE
+    sleep_led_disable();
+#endif
+
+    // led_set() here takes long and converters miss wakeup, update it at
+    // keyboard_task() in main loop instead
+    usb_keyboard_leds = _led_stats;
+    host_keyboard_leds_changed();
+}
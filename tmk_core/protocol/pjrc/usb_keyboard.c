@@ -29,6 +29,8 @@
 #include "debug.h"
 #include "util.h"
 #include "host.h"
+#include "bench_gpio.h"
+#include "telemetry.h"
 
 
 // protocol setting from the host.  We use exactly the same report
@@ -48,6 +50,113 @@ uint8_t usb_keyboard_idle_count=0;
 volatile uint8_t usb_keyboard_leds=0;
 
 
+#ifdef PJRC_SOF_REPORT
+/* Reports waiting for Start of Frame, written from USB general interrupt
+ * by usb_keyboard_flush() like usb_debug.c flushes its buffer. */
+#ifndef PJRC_SOF_REPORT_QUEUE
+#   define PJRC_SOF_REPORT_QUEUE 4
+#endif
+static report_keyboard_t report_queue[PJRC_SOF_REPORT_QUEUE];
+static uint8_t report_head = 0;
+static uint8_t report_count = 0;
+/* last report written to endpoint */
+static report_keyboard_t report_sent;
+
+/* Whether next can replace tail in queue without losing a change of tail
+ * from base(report before tail) which host has not seen yet. */
+static bool report_mergeable(report_keyboard_t *base,
+                             report_keyboard_t *tail,
+                             report_keyboard_t *next)
+{
+    if ((base->mods ^ tail->mods) & (tail->mods ^ next->mods))
+        return false;
+
+#ifdef NKRO_ENABLE
+    if (keyboard_nkro) {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_BITS; i++) {
+            if ((base->nkro.bits[i] ^ tail->nkro.bits[i]) & (tail->nkro.bits[i] ^ next->nkro.bits[i]))
+                return false;
+        }
+        return true;
+    }
+#endif
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (base->keys[i] != tail->keys[i] && tail->keys[i] != next->keys[i])
+            return false;
+    }
+    return true;
+}
+
+/* Queue report for next frame, merged into last queued one if possible.
+ * Never waits for endpoint. */
+int8_t usb_keyboard_send_report(report_keyboard_t *report)
+{
+    if (!usb_configured()) return -1;
+
+    uint8_t intr_state = SREG;
+    cli();
+    uint8_t n = report_count;
+    if (n) {
+        uint8_t tail = (report_head + n - 1) % PJRC_SOF_REPORT_QUEUE;
+        report_keyboard_t *base = (n > 1) ?
+            &report_queue[(tail + PJRC_SOF_REPORT_QUEUE - 1) % PJRC_SOF_REPORT_QUEUE] :
+            &report_sent;
+        if (n == PJRC_SOF_REPORT_QUEUE ||
+                report_mergeable(base, &report_queue[tail], report)) {
+            /* replace tail, a change can be lost only when queue is full */
+            if (n == PJRC_SOF_REPORT_QUEUE) TELEMETRY_COUNT(TELEMETRY_REPORT_LOST);
+            report_queue[tail] = *report;
+            goto QUEUED;
+        }
+    }
+    report_queue[(report_head + n) % PJRC_SOF_REPORT_QUEUE] = *report;
+    report_count = n + 1;
+QUEUED:
+    SREG = intr_state;
+    usb_keyboard_print_report(report);
+    return 0;
+}
+
+/* Write a queued report if endpoint is free, one per frame.
+ * Called from SOF of USB general interrupt. */
+void usb_keyboard_flush(void)
+{
+    if (!report_count) return;
+
+    report_keyboard_t *report = &report_queue[report_head];
+    uint8_t size;
+#ifdef NKRO_ENABLE
+    if (keyboard_nkro) {
+        UENUM = KBD2_ENDPOINT;
+        size = KBD2_SIZE;
+    } else
+#endif
+    {
+        UENUM = KBD_ENDPOINT;
+        size = KBD_SIZE;
+    }
+    if (!(UEINTX & (1<<RWAL))) return;
+
+    for (uint8_t i = 0; i < size; i++) {
+        UEDATX = report->raw[i];
+    }
+    UEINTX = 0x3A;
+    BENCH_GPIO_REPORT();
+
+    report_sent = *report;
+    report_head = (report_head + 1) % PJRC_SOF_REPORT_QUEUE;
+    report_count--;
+    usb_keyboard_idle_count = 0;
+}
+
+/* Called on USB reset */
+void usb_keyboard_clear(void)
+{
+    report_head = 0;
+    report_count = 0;
+    report_sent = (report_keyboard_t){};
+}
+#else
 static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, uint8_t keys_start, uint8_t keys_end);
 
 
@@ -65,10 +174,12 @@ int8_t usb_keyboard_send_report(report_keyboard_t *report)
     }
 
     if (result) return result;
+    BENCH_GPIO_REPORT();
     usb_keyboard_idle_count = 0;
     usb_keyboard_print_report(report);
     return 0;
 }
+#endif
 
 void usb_keyboard_print_report(report_keyboard_t *report)
 {
@@ -79,6 +190,7 @@ void usb_keyboard_print_report(report_keyboard_t *report)
 }
 
 
+#ifndef PJRC_SOF_REPORT
 static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, uint8_t keys_start, uint8_t keys_end)
 {
     uint8_t intr_state, timeout;
@@ -95,7 +207,10 @@ static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, ui
             // has the USB gone offline?
             if (!usb_configured()) return -1;
             // have we waited too long?
-            if (UDFNUML == timeout) return -1;
+            if (UDFNUML == timeout) {
+                TELEMETRY_COUNT(TELEMETRY_REPORT_LOST);
+                return -1;
+            }
             // get ready to try checking again
             intr_state = SREG;
             cli();
@@ -108,3 +223,4 @@ static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, ui
     SREG = intr_state;
     return 0;
 }
+#endif
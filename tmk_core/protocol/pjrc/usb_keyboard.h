@@ -36,5 +36,9 @@ extern volatile uint8_t usb_keyboard_leds;
 
 int8_t usb_keyboard_send_report(report_keyboard_t *report);
 void usb_keyboard_print_report(report_keyboard_t *report);
+#ifdef PJRC_SOF_REPORT
+void usb_keyboard_flush(void);
+void usb_keyboard_clear(void);
+#endif
 
 #endif
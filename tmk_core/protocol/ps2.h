@@ -85,13 +85,43 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 extern uint8_t ps2_error;
+#ifdef PS2_USE_INT
+/* frames dropped by error and by timeout */
+extern uint16_t ps2_error_count;
+extern uint16_t ps2_resync_count;
+
+/*
+ * Frame timeout of interrupt receiver
+ *
+ * Falling edges of a frame come 60-100us apart([1], 10-16.7kHz clock). When
+ * next edge comes later than this the frame is abandoned and the edge is
+ * taken as start bit of new frame, otherwise one lost edge would shift bits
+ * of every following frame.
+ */
+#ifndef PS2_INT_TIMEOUT_US
+#   define PS2_INT_TIMEOUT_US   200
+#endif
+#endif
 
 void ps2_host_init(void);
 uint8_t ps2_host_send(uint8_t data);
 uint8_t ps2_host_recv_response(void);
 uint8_t ps2_host_recv(void);
+/* time(timer_read()) of byte last returned by ps2_host_recv(), taken when
+ * receiver got it in interrupt so that key timing is not delayed by loop */
+uint16_t ps2_host_recv_time(void);
 void ps2_host_set_led(uint8_t usb_led);
 
+/*
+ * Queue command and return without waiting. cb(data, response) is called in
+ * main loop when response comes, response is 0 on error. Returns false when
+ * queue is full. PS2_USE_INT on AVR sends in background, PS2_USE_USART clocks
+ * out frame at once and waits for response in background, others send at
+ * once and call cb before return.
+ */
+typedef void (*ps2_send_cb_t)(uint8_t data, uint8_t response);
+bool ps2_host_send_async(uint8_t data, ps2_send_cb_t cb);
+
 
 /*--------------------------------------------------------------------
  * static functions
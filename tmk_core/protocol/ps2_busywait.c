@@ -44,6 +44,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "ps2.h"
 #include "ps2_io.h"
 #include "debug.h"
+#include "timer.h"
+#include "watchdog.h"
 
 
 #define WAIT(stat, us, err) do { \
@@ -70,6 +72,7 @@ void ps2_host_init(void)
 
 uint8_t ps2_host_send(uint8_t data)
 {
+    WATCHDOG_STAGE(WATCHDOG_PS2_SEND);
     bool parity = true;
     ps2_error = PS2_ERR_NONE;
 
@@ -123,6 +126,7 @@ ERROR:
 /* receive data when host want else inhibit communication */
 uint8_t ps2_host_recv_response(void)
 {
+    WATCHDOG_STAGE(WATCHDOG_PS2_RECV);
     // Command may take 25ms/20ms at most([5]p.46, [3]p.21)
     // 250 * 100us(wait for start bit in ps2_host_recv)
     uint8_t data = 0;
@@ -181,6 +185,19 @@ ERROR:
     return 0;
 }
 
+/* received in the call, time of the byte is now */
+uint16_t ps2_host_recv_time(void)
+{
+    return timer_read();
+}
+
+bool ps2_host_send_async(uint8_t data, ps2_send_cb_t cb)
+{
+    uint8_t response = ps2_host_send(data);
+    if (cb) cb(data, response);
+    return true;
+}
+
 /* send LED state to keyboard */
 void ps2_host_set_led(uint8_t led)
 {
@@ -0,0 +1,11 @@
+PS2_DEVICE_DIR = protocol/ps2_device
+
+OPT_DEFS += -DPROTOCOL_PS2_DEVICE
+
+SRC +=	$(PS2_DEVICE_DIR)/main.c \
+	$(PS2_DEVICE_DIR)/ps2_device.c \
+	protocol/ps2_io_avr.c \
+	$(COMMON_DIR)/sendchar_null.c
+
+# Search Path
+VPATH += $(TMK_DIR)/$(PS2_DEVICE_DIR)
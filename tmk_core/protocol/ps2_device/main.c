@@ -0,0 +1,47 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+#include "keyboard.h"
+#include "host.h"
+#include "ps2_device.h"
+
+
+/* boot protocol of PS/2, no NKRO */
+uint8_t keyboard_protocol = 0;
+uint8_t keyboard_idle = 0;
+
+int main(void)
+{
+#ifdef CLKPR
+    clock_prescale_set(clock_div_1);
+#endif
+    keyboard_setup();
+
+    ps2_device_init();
+    host_set_driver(ps2_device_driver());
+    keyboard_init();
+    sei();
+
+    while (1) {
+        keyboard_task();
+        ps2_device_task();
+    }
+}
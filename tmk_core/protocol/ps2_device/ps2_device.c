@@ -0,0 +1,702 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * PS/2 keyboard device
+ *
+ * References:
+ *     [1] The PS/2 Mouse/Keyboard Protocol, Adam Chapweske
+ *         http://www.tayloredge.com/reference/Interface/atkeyboard.pdf
+ *     [2] Keyboard Scan Code Specification, Microsoft
+ *         http://download.microsoft.com/download/1/6/1/161ba512-40e2-4cc9-843a-923143f3456c/scancode.doc
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "spsc_queue.h"
+#include "ps2_io.h"
+#include "report.h"
+#include "host.h"
+#include "led.h"
+#include "timer.h"
+#include "ps2_device.h"
+
+
+#if !(defined(PS2_INT_INIT) && defined(PS2_INT_ON) && defined(PS2_INT_OFF) && defined(PS2_INT_VECT))
+#   error "PS/2 clock interrupt setting(PS2_INT_*) is required in config.h"
+#endif
+
+#ifndef PS2_DEVICE_TIMER_VECT
+#   if defined(BACKLIGHT_PWM_ENABLE) || defined(SLEEP_LED_ENABLE)
+#       error "PS/2 device uses Timer1, define PS2_DEVICE_TIMER_* of other timer"
+#   endif
+#   define PS2_DEVICE_TIMER_INIT()  do {                            \
+        TCCR1A = 0;                                                 \
+        TCCR1B = (1<<WGM12) | (1<<CS11);                            \
+        OCR1A = (F_CPU / 8 / 1000000UL) * PS2_DEVICE_TICK_US - 1;   \
+    } while (0)
+#   define PS2_DEVICE_TIMER_ON()    do {                            \
+        TCNT1 = 0;                                                  \
+        TIFR1 = (1<<OCF1A);                                         \
+        TIMSK1 |= (1<<OCIE1A);                                      \
+    } while (0)
+#   define PS2_DEVICE_TIMER_OFF()   do { TIMSK1 &= ~(1<<OCIE1A); } while (0)
+#   define PS2_DEVICE_TIMER_VECT    TIMER1_COMPA_vect
+#endif
+
+
+/* answers of main loop go out before key codes */
+SPSC_QUEUE(resq, uint8_t, 8)
+SPSC_QUEUE(keyq, uint8_t, 64)
+/* bytes from host, RX_ERROR on parity or framing error */
+#define RX_ERROR    0x100
+SPSC_QUEUE(rxq, uint16_t, 4)
+
+
+/*
+ * Line, ISR only except where noted
+ */
+static volatile enum {
+    IDLE,
+    TX,
+    RX,
+    RX_ACK,
+} state = IDLE;
+static volatile bool running = false;   // timer is on
+static uint8_t idle_ticks;
+static uint8_t bit;
+static uint8_t phase;
+static uint8_t tx_byte;
+static bool tx_res;
+static uint8_t rx_byte;
+static uint8_t parity;          // odd parity of TX and RX
+static bool rx_ok;
+
+/* byte taken from queue stays here until it is out without inhibit */
+static bool res_pending = false;
+static uint8_t res_byte;
+static volatile bool key_pending = false;
+static uint8_t key_byte;
+/* last byte clocked out for Resend(0xFE) */
+static volatile uint8_t last_sent = 0xAA;
+
+/* keys wait from a byte of host until main loop has answered it
+ * main loop touches keyq and key_pending only while this is set */
+static volatile bool key_hold = false;
+static volatile bool enabled = true;
+
+
+static void line_idle(void)
+{
+    state = IDLE;
+    idle_ticks = 0;
+    data_hi();
+    clock_hi();
+}
+
+/* main loop: starts timer to send queued byte */
+static void kick(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!running) {
+            running = true;
+            idle_ticks = 0;
+            PS2_INT_OFF();
+            PS2_DEVICE_TIMER_ON();
+        }
+    }
+}
+
+/* host pulls clock down to inhibit or to request to send */
+ISR(PS2_INT_VECT)
+{
+    if (!running) {
+        running = true;
+        idle_ticks = 0;
+        PS2_INT_OFF();
+        PS2_DEVICE_TIMER_ON();
+    }
+}
+
+static bool tx_next(void)
+{
+    if (!res_pending && resq_has_data()) {
+        res_byte = resq_dequeue();
+        res_pending = true;
+    }
+    if (res_pending) {
+        tx_byte = res_byte;
+        tx_res = true;
+        return true;
+    }
+    if (key_hold || !enabled) return false;
+    if (!key_pending && keyq_has_data()) {
+        key_byte = keyq_dequeue();
+        key_pending = true;
+    }
+    if (key_pending) {
+        tx_byte = key_byte;
+        tx_res = false;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * A tick is half of clock period. Device sets data while clock is high and
+ * host reads it on falling edge; host sets data while clock is low and
+ * device reads it before rising edge.
+ */
+ISR(PS2_DEVICE_TIMER_VECT)
+{
+    switch (state) {
+    case IDLE:
+        if (!clock_in()) {
+            // inhibited
+            idle_ticks = 0;
+            break;
+        }
+        if (!data_in()) {
+            // request to send: start bit is on data
+            state = RX;
+            bit = 0;
+            phase = 0;
+            rx_byte = 0;
+            parity = 0;
+            rx_ok = true;
+            break;
+        }
+        // clock must be high for 50us before sending([1])
+        if (++idle_ticks < 2) break;
+        if (tx_next()) {
+            state = TX;
+            bit = 0;
+            phase = 0;
+            break;
+        }
+        running = false;
+        PS2_DEVICE_TIMER_OFF();
+        PS2_INT_ON();
+        break;
+
+    case TX:
+        if (phase == 0) {
+            clock_hi();
+            if (bit == 11) {
+                // stop bit is out
+                if (tx_res) {
+                    res_pending = false;
+                } else {
+                    key_pending = false;
+                }
+                last_sent = tx_byte;
+                line_idle();
+                break;
+            }
+            if (!clock_in()) {
+                // host inhibits before stop bit: send the byte again later
+                line_idle();
+                break;
+            }
+            // start, data LSB first, odd parity, stop
+            bool b;
+            if (bit == 0) {
+                b = 0;
+                parity = 1;
+            } else if (bit <= 8) {
+                b = tx_byte & (1 << (bit - 1));
+                parity ^= b;
+            } else if (bit == 9) {
+                b = parity;
+            } else {
+                b = 1;
+            }
+            if (b) data_hi(); else data_lo();
+            phase = 1;
+        } else {
+            clock_lo();
+            bit++;
+            phase = 0;
+        }
+        break;
+
+    case RX:
+        if (phase == 0) {
+            clock_lo();
+            phase = 1;
+            break;
+        }
+        clock_hi();
+        if (!clock_in()) {
+            // host aborts
+            line_idle();
+            break;
+        }
+        phase = 0;
+        bool b = data_in();
+        if (bit == 0) {
+            // first clock is of start bit host has put already
+        } else if (bit <= 8) {
+            if (b) rx_byte |= (1 << (bit - 1));
+            parity ^= b;
+        } else if (bit == 9) {
+            if (parity == b) rx_ok = false;
+        } else {
+            if (!b) rx_ok = false;
+            state = RX_ACK;
+            bit = 0;
+            break;
+        }
+        bit++;
+        break;
+
+    case RX_ACK:
+        // data low over one clock pulse
+        if (bit == 0) {
+            data_lo();
+        } else if (bit == 1) {
+            clock_lo();
+        } else {
+            line_idle();
+            key_hold = true;
+            rxq_enqueue(rx_ok ? rx_byte : RX_ERROR);
+            break;
+        }
+        bit++;
+        break;
+    }
+}
+
+
+/*
+ * Host commands, main loop
+ */
+#define TYPEMATIC_DEFAULT   0x2B    // 10.9cps, 500ms
+static uint8_t typematic = TYPEMATIC_DEFAULT;
+static uint8_t leds = 0;
+static uint8_t cmd = 0;             // command waiting for its argument
+
+static void respond(uint8_t data)
+{
+    while (!resq_enqueue(data)) ;
+    kick();
+}
+
+static void keys_clear(void)
+{
+    keyq_clear();
+    key_pending = false;
+}
+
+static void set_defaults(void)
+{
+    typematic = TYPEMATIC_DEFAULT;
+}
+
+static void command(uint8_t data)
+{
+    if (cmd && !(data & 0x80)) {
+        // argument
+        respond(0xFA);
+        switch (cmd) {
+        case 0xED:
+            // scroll, num and caps lock on bit 0-2
+            leds = ((data & 1) ? (1<<USB_LED_SCROLL_LOCK) : 0) |
+                   ((data & 2) ? (1<<USB_LED_NUM_LOCK) : 0) |
+                   ((data & 4) ? (1<<USB_LED_CAPS_LOCK) : 0);
+            host_keyboard_leds_changed();
+            break;
+        case 0xF0:
+            // only Set 2
+            if (data == 0) respond(0x02);
+            break;
+        case 0xF3:
+            typematic = data;
+            break;
+        }
+        cmd = 0;
+        return;
+    }
+    cmd = 0;
+
+    switch (data) {
+    case 0xFF:          // Reset
+        respond(0xFA);
+        keys_clear();
+        set_defaults();
+        enabled = true;
+        respond(0xAA);
+        break;
+    case 0xFE:          // Resend
+        respond(last_sent);
+        break;
+    case 0xF2:          // Read ID
+        respond(0xFA);
+        respond(0xAB);
+        respond(0x83);
+        break;
+    case 0xEE:          // Echo
+        respond(0xEE);
+        break;
+    case 0xED:          // Set LEDs
+    case 0xF0:          // Set scan code set
+    case 0xF3:          // Set typematic rate/delay
+        respond(0xFA);
+        cmd = data;
+        break;
+    case 0xF4:          // Enable
+        respond(0xFA);
+        keys_clear();
+        enabled = true;
+        break;
+    case 0xF5:          // Disable
+        respond(0xFA);
+        keys_clear();
+        set_defaults();
+        enabled = false;
+        break;
+    case 0xF6:          // Set defaults
+        respond(0xFA);
+        keys_clear();
+        set_defaults();
+        break;
+    default:
+        // Set 3 only commands are acknowledged and ignored
+        respond(0xFA);
+        break;
+    }
+}
+
+static void commands(void)
+{
+    if (!rxq_has_data()) return;
+    while (rxq_has_data()) {
+        uint16_t data = rxq_dequeue();
+        if (data & RX_ERROR) {
+            respond(0xFE);
+        } else {
+            command(data);
+        }
+    }
+    // keys go out again when no argument is awaited
+    if (!cmd) {
+        key_hold = false;
+        kick();
+    }
+}
+
+
+/*
+ * Scan Code Set 2([2])
+ */
+#define E0(code)    (0x100 | (code))
+#define PRTSC       0x200
+#define PAUSE       0x201
+
+static const uint16_t PROGMEM set2[] = {
+    /* 0x00 */ 0,           0,           0,           0,
+    /* 0x04 A-Z */   0x1C, 0x32, 0x21, 0x23, 0x24, 0x2B, 0x34, 0x33,
+    /* 0x0C */ 0x43,        0x3B,        0x42,        0x4B,
+    /* 0x10 */ 0x3A,        0x31,        0x44,        0x4D,
+    /* 0x14 */ 0x15,        0x2D,        0x1B,        0x2C,
+    /* 0x18 */ 0x3C,        0x2A,        0x1D,        0x22,
+    /* 0x1C */ 0x35,        0x1A,        0x16,        0x1E,       // Y Z 1 2
+    /* 0x20 */ 0x26,        0x25,        0x2E,        0x36,
+    /* 0x24 */ 0x3D,        0x3E,        0x46,        0x45,       // 7 8 9 0
+    /* 0x28 */ 0x5A,        0x76,        0x66,        0x0D,       // Enter Esc BS Tab
+    /* 0x2C */ 0x29,        0x4E,        0x55,        0x54,       // Space - = [
+    /* 0x30 */ 0x5B,        0x5D,        0x5D,        0x4C,       // ] \ NUHS ;
+    /* 0x34 */ 0x52,        0x0E,        0x41,        0x49,       // ' ` , .
+    /* 0x38 */ 0x4A,        0x58,        0x05,        0x06,       // / Caps F1 F2
+    /* 0x3C */ 0x04,        0x0C,        0x03,        0x0B,
+    /* 0x40 */ 0x83,        0x0A,        0x01,        0x09,       // F7-F10
+    /* 0x44 */ 0x78,        0x07,        PRTSC,       0x7E,       // F11 F12 PrtSc ScrLk
+    /* 0x48 */ PAUSE,       E0(0x70),    E0(0x6C),    E0(0x7D),   // Pause Ins Home PgUp
+    /* 0x4C */ E0(0x71),    E0(0x69),    E0(0x7A),    E0(0x74),   // Del End PgDn Right
+    /* 0x50 */ E0(0x6B),    E0(0x72),    E0(0x75),    0x77,       // Left Down Up NumLk
+    /* 0x54 */ E0(0x4A),    0x7C,        0x7B,        0x79,       // KP / * - +
+    /* 0x58 */ E0(0x5A),    0x69,        0x72,        0x7A,       // KP Enter 1 2 3
+    /* 0x5C */ 0x6B,        0x73,        0x74,        0x6C,       // KP 4 5 6 7
+    /* 0x60 */ 0x75,        0x7D,        0x70,        0x71,       // KP 8 9 0 .
+    /* 0x64 */ 0x61,        E0(0x2F),    E0(0x37),    0x0F,       // NUBS App Power KP =
+    /* 0x68 */ 0x08,        0x10,        0x18,        0x20,       // F13-F16
+    /* 0x6C */ 0x28,        0x30,        0x38,        0x40,       // F17-F20
+    /* 0x70 */ 0x48,        0x50,        0x57,        0x5F,       // F21-F24
+    /* 0x74 */ 0,           0,           0,           0,
+    /* 0x78 */ 0,           0,           0,           0,
+    /* 0x7C */ 0,           0,           0,           0,
+    /* 0x80 */ 0,           0,           0,           0,
+    /* 0x84 */ 0,           0x6D,        0x0F,        0x51,       // KP , KP = RO
+    /* 0x88 */ 0x13,        0x6A,        0x64,        0x67,       // KANA JYEN HENK MHEN
+};
+
+/* modifier bits of report */
+static const uint16_t PROGMEM set2_mods[8] = {
+    0x14, 0x12, 0x11, E0(0x1F), E0(0x14), 0x59, E0(0x11), E0(0x27),
+};
+
+static bool overrun = false;
+
+void ps2_device_send(uint8_t data)
+{
+    // host holding clock low for long must not stop the keyboard
+    if (!keyq_enqueue(data)) overrun = true;
+}
+
+static void make(uint16_t code)
+{
+    if (code & 0x100) ps2_device_send(0xE0);
+    ps2_device_send(code);
+}
+
+static void brk(uint16_t code)
+{
+    if (code & 0x100) ps2_device_send(0xE0);
+    ps2_device_send(0xF0);
+    ps2_device_send(code);
+}
+
+static uint16_t code_of(uint8_t key)
+{
+    return (key < sizeof(set2) / sizeof(set2[0])) ? pgm_read_word(&set2[key]) : 0;
+}
+
+static void key_make(uint16_t code)
+{
+    if (code == PRTSC) {
+        make(E0(0x12)); make(E0(0x7C));
+    } else if (code == PAUSE) {
+        // no break code
+        ps2_device_send(0xE1); ps2_device_send(0x14); ps2_device_send(0x77);
+        ps2_device_send(0xE1); ps2_device_send(0xF0); ps2_device_send(0x14);
+        ps2_device_send(0xF0); ps2_device_send(0x77);
+    } else {
+        make(code);
+    }
+}
+
+static void key_break(uint16_t code)
+{
+    if (code == PRTSC) {
+        brk(E0(0x7C)); brk(E0(0x12));
+    } else if (code != PAUSE) {
+        brk(code);
+    }
+}
+
+
+/*
+ * Typematic, repeats make code of the last key pressed([1])
+ */
+static uint16_t repeat_code = 0;
+static uint16_t repeat_time;
+static bool repeating;
+
+static uint16_t repeat_delay(void)
+{
+    return 250 * (1 + ((typematic >> 5) & 3));
+}
+
+static uint16_t repeat_period(void)
+{
+    // (8 + A) * 2^B * 4.17ms
+    return (((uint32_t)(8 + (typematic & 7)) << ((typematic >> 3) & 3)) * 417) / 100;
+}
+
+static void typematic_task(void)
+{
+    if (!repeat_code || !enabled) return;
+    if (timer_elapsed(repeat_time) < (repeating ? repeat_period() : repeat_delay())) return;
+    // keep one repeat in queue at most
+    if (keyq_has_data()) return;
+    repeat_time = timer_read();
+    repeating = true;
+    make(repeat_code);
+    kick();
+}
+
+
+/*
+ * Host driver
+ */
+static report_keyboard_t last_report;
+
+static bool has_key(report_keyboard_t *report, uint8_t key)
+{
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (report->keys[i] == key) return true;
+    }
+    return false;
+}
+
+static uint8_t keyboard_leds(void)
+{
+    return leds;
+}
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    commands();
+    if (!enabled) {
+        last_report = *report;
+        return;
+    }
+
+    // breaks first
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        uint8_t key = last_report.keys[i];
+        if (!key || has_key(report, key)) continue;
+        uint16_t code = code_of(key);
+        if (!code) continue;
+        key_break(code);
+        if (code == repeat_code) repeat_code = 0;
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t m = 1 << i;
+        if ((last_report.mods & m) && !(report->mods & m)) {
+            brk(pgm_read_word(&set2_mods[i]));
+        }
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t m = 1 << i;
+        if (!(last_report.mods & m) && (report->mods & m)) {
+            make(pgm_read_word(&set2_mods[i]));
+        }
+    }
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        uint8_t key = report->keys[i];
+        if (!key || has_key(&last_report, key)) continue;
+        uint16_t code = code_of(key);
+        if (!code) continue;
+        key_make(code);
+        if (code != PRTSC && code != PAUSE) {
+            repeat_code = code;
+            repeat_time = timer_read();
+            repeating = false;
+        }
+    }
+
+    last_report = *report;
+    kick();
+}
+
+static void send_mouse(report_mouse_t *report)
+{
+    (void)report;
+}
+
+static uint16_t last_system = 0;
+static uint16_t last_consumer = 0;
+
+static uint16_t system_code(uint16_t usage)
+{
+    switch (usage) {
+    case SYSTEM_POWER_DOWN:             return E0(0x37);
+    case SYSTEM_SLEEP:                  return E0(0x3F);
+    case SYSTEM_WAKE_UP:                return E0(0x5E);
+    }
+    return 0;
+}
+
+static uint16_t consumer_code(uint16_t usage)
+{
+    switch (usage) {
+    case TRANSPORT_NEXT_TRACK:          return E0(0x4D);
+    case TRANSPORT_PREV_TRACK:          return E0(0x15);
+    case TRANSPORT_STOP:                return E0(0x3B);
+    case TRANSPORT_PLAY_PAUSE:          return E0(0x34);
+    case AUDIO_MUTE:                    return E0(0x23);
+    case AUDIO_VOL_UP:                  return E0(0x32);
+    case AUDIO_VOL_DOWN:                return E0(0x21);
+    case APPLAUNCH_EMAIL:               return E0(0x48);
+    case APPLAUNCH_CALCULATOR:          return E0(0x2B);
+    case APPLAUNCH_LOCAL_BROWSER:       return E0(0x40);
+    case APPCONTROL_SEARCH:             return E0(0x10);
+    case APPCONTROL_HOME:               return E0(0x3A);
+    case APPCONTROL_BACK:               return E0(0x38);
+    case APPCONTROL_FORWARD:            return E0(0x30);
+    case APPCONTROL_STOP:               return E0(0x28);
+    case APPCONTROL_REFRESH:            return E0(0x20);
+    case APPCONTROL_BOOKMARKS:          return E0(0x18);
+    }
+    return 0;
+}
+
+/* one usage at a time: break of last one and make of new one */
+static void send_usage(uint16_t code, uint16_t last)
+{
+    if (!enabled || code == last) return;
+    if (last) brk(last);
+    if (code) make(code);
+    kick();
+}
+
+static void send_system(uint16_t data)
+{
+    uint16_t code = system_code(data);
+    send_usage(code, last_system);
+    last_system = code;
+}
+
+static void send_consumer(uint16_t data)
+{
+    uint16_t code = consumer_code(data);
+    send_usage(code, last_consumer);
+    last_consumer = code;
+}
+
+static host_driver_t driver = {
+    keyboard_leds,
+    send_keyboard,
+    send_mouse,
+    send_system,
+    send_consumer
+};
+
+host_driver_t *ps2_device_driver(void)
+{
+    return &driver;
+}
+
+
+void ps2_device_init(void)
+{
+    clock_init();
+    data_init();
+    line_idle();
+
+    PS2_DEVICE_TIMER_INIT();
+    PS2_INT_INIT();
+    PS2_INT_ON();
+
+    // Basic Assurance Test passed
+    respond(0xAA);
+}
+
+void ps2_device_task(void)
+{
+    commands();
+    if (overrun && !keyq_has_data() && !key_pending) {
+        overrun = false;
+        ps2_device_send(0x00);
+        kick();
+    }
+    typematic_task();
+}
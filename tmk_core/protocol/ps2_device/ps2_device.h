@@ -0,0 +1,59 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PS2_DEVICE_H
+#define PS2_DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "host_driver.h"
+
+/*
+ * Keyboard as PS/2 device(PROTOCOL_PS2_DEVICE)
+ *
+ * Keyboard reports are turned into Scan Code Set 2 make and break codes
+ * and sent to host as soon as they are queued, there is no polling interval
+ * on PS/2. Device generates clock from timer compare interrupt, a tick is
+ * half of clock period. Timer runs only while a byte is on the line or host
+ * holds clock low, otherwise falling edge interrupt of clock(PS2_INT_* as
+ * in ps2_interrupt.c) waits for host to inhibit or request to send.
+ * Lines are driven with ps2_io_avr.c(PS2_CLOCK_* and PS2_DATA_*).
+ *
+ * Host commands are answered from ps2_device_task(): reset, resend, echo,
+ * read ID, LEDs, scan code set(only 2), typematic rate/delay, enable,
+ * disable and defaults. Typematic repeat is made by device from rate and
+ * delay given by host. Answers go out before key codes queued earlier.
+ *
+ * Timer, default is Timer1 compare A in CTC:
+ *     #define PS2_DEVICE_TIMER_INIT()  do { TCCR1B = (1<<WGM12) | (1<<CS11); OCR1A = ...; } while (0)
+ *     #define PS2_DEVICE_TIMER_ON()    do { TCNT1 = 0; TIFR1 = (1<<OCF1A); TIMSK1 |= (1<<OCIE1A); } while (0)
+ *     #define PS2_DEVICE_TIMER_OFF()   do { TIMSK1 &= ~(1<<OCIE1A); } while (0)
+ *     #define PS2_DEVICE_TIMER_VECT    TIMER1_COMPA_vect
+ */
+/* half of clock period(us), clock of 10-16.7kHz */
+#ifndef PS2_DEVICE_TICK_US
+#define PS2_DEVICE_TICK_US      40
+#endif
+
+void ps2_device_init(void);
+/* answers host commands and repeats key, call from main loop */
+void ps2_device_task(void);
+/* queue byte to host, overrun(0x00) is sent later when queue is full */
+void ps2_device_send(uint8_t data);
+host_driver_t *ps2_device_driver(void);
+
+#endif
@@ -40,12 +40,170 @@ POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
-#include "pbuff.h"
+#include "spsc_queue.h"
 #include "ps2.h"
 #include "ps2_io.h"
 #include "print.h"
+#include "timer.h"
+#include "watchdog.h"
+
+
+SPSC_STAMPED_QUEUE(pbuf, uint8_t, 32)
+
+
+/*
+ * Frame timeout(see PS2_INT_TIMEOUT_US in ps2.h) in Timer0 ticks
+ */
+#define PS2_INT_TIMEOUT_TICKS   (PS2_INT_TIMEOUT_US * (TIMER_RAW_FREQ / 1000) / 1000)
+#if PS2_INT_TIMEOUT_TICKS < 2 || PS2_INT_TIMEOUT_TICKS > 0x7FFF
+#   error "PS2_INT_TIMEOUT_US is out of range of Timer0 ticks."
+#endif
+
+/* Timer0 ticks; wraps after 65536 ticks(262ms at 16MHz) which is far longer than a frame */
+static inline uint16_t edge_ticks(void)
+{
+    uint16_t ms = (uint16_t)timer_count;
+    uint8_t raw = TIMER_RAW;
+#ifdef TIFR0
+    if (TIFR0 & (1<<OCF0A)) {
+#else
+    if (TIFR & (1<<OCF0A)) {
+#endif
+        // compare match not serviced yet since we are in ISR
+        ms++;
+        raw = TIMER_RAW;
+    }
+    return ms * (TIMER_RAW_TOP + 1) + raw;
+}
+
+uint16_t ps2_error_count = 0;
+uint16_t ps2_resync_count = 0;
+
+
+/* receiver state, ISR only except reset on start of transmission */
+static enum {
+    INIT,
+    START,
+    BIT0, BIT1, BIT2, BIT3, BIT4, BIT5, BIT6, BIT7,
+    PARITY,
+    STOP,
+} rx_state = INIT;
+static uint8_t rx_data = 0;
+static uint8_t rx_parity = 1;
+
+static inline void rx_reset(void)
+{
+    rx_state = INIT;
+    rx_data = 0;
+    rx_parity = 1;
+}
+
+
+/*
+ * Asynchronous send
+ *
+ * Commands are queued and sent one at a time. Main loop only pulls clock
+ * line down to request to send, then ISR clocks bits out on falling edges
+ * and takes next received byte as response of the command instead of
+ * putting it into pbuf. Next command is started and completion callback is
+ * called from ps2_host_recv() or ps2_host_send_async() in main loop context.
+ */
+#ifndef PS2_TXQ_SIZE
+#   define PS2_TXQ_SIZE     4
+#endif
+/* device starts clock in 15ms and responds in 20ms([5]p.50, p.46) */
+#define PS2_TX_TIMEOUT      40
+
+static struct {
+    uint8_t data;
+    ps2_send_cb_t cb;
+} txq[PS2_TXQ_SIZE];
+static uint8_t txq_head = 0;
+static uint8_t txq_count = 0;
+static uint16_t tx_time;
+
+static volatile enum {
+    TX_IDLE,
+    TX_SENDING,
+    TX_RESPONSE,
+    TX_DONE,
+    TX_ERROR,
+} tx_state = TX_IDLE;
+static volatile uint8_t tx_response;
+/* ISR only while TX_SENDING */
+static uint8_t tx_bit;
+static uint8_t tx_data;
+static uint8_t tx_parity;
+
+static void tx_start(void)
+{
+    PS2_INT_OFF();
+
+    /* terminate a transmission if we have */
+    inhibit();
+    _delay_us(100); // 100us [4]p.13, [5]p.50
+    rx_reset();
+
+    tx_data = txq[txq_head].data;
+    tx_parity = 1;
+    tx_bit = 0;
+    tx_state = TX_SENDING;
+    tx_time = timer_read();
+
+    /* 'Request to Send' and Start bit */
+    data_lo();
+    clock_hi();
+    PS2_INT_ON();
+}
+
+static void tx_poll(void)
+{
+    switch (tx_state) {
+        case TX_IDLE:
+            if (txq_count) tx_start();
+            return;
+        case TX_SENDING:
+        case TX_RESPONSE:
+            if (timer_elapsed(tx_time) < PS2_TX_TIMEOUT) return;
+            PS2_INT_OFF();
+            if (tx_state == TX_SENDING || tx_state == TX_RESPONSE) {
+                // no clock or no response from device
+                tx_state = TX_ERROR;
+                idle();
+                rx_reset();
+            }
+            PS2_INT_ON();
+            break;
+        default:
+            break;
+    }
+
+    uint8_t data = txq[txq_head].data;
+    ps2_send_cb_t cb = txq[txq_head].cb;
+    uint8_t response = (tx_state == TX_DONE) ? tx_response : 0;
+    txq_head = (txq_head + 1) % PS2_TXQ_SIZE;
+    txq_count--;
+    tx_state = TX_IDLE;
+
+    if (txq_count) tx_start();
+    if (cb) cb(data, response);
+}
+
+bool ps2_host_send_async(uint8_t data, ps2_send_cb_t cb)
+{
+    if (txq_count >= PS2_TXQ_SIZE) {
+        return false;
+    }
+    uint8_t i = (txq_head + txq_count) % PS2_TXQ_SIZE;
+    txq[i].data = data;
+    txq[i].cb = cb;
+    txq_count++;
+    tx_poll();
+    return true;
+}
 
 
 #define WAIT(stat, us, err) do { \
@@ -69,10 +227,17 @@ void ps2_host_init(void)
 
 uint8_t ps2_host_send(uint8_t data)
 {
+    WATCHDOG_STAGE(WATCHDOG_PS2_SEND);
     bool parity = true;
     ps2_error = PS2_ERR_NONE;
 
+    /* finish queued commands first */
+    while (txq_count) {
+        tx_poll();
+    }
+
     PS2_INT_OFF();
+    rx_reset();
 
     /* terminate a transmission if we have */
     inhibit();
@@ -125,6 +290,7 @@ ERROR:
 
 uint8_t ps2_host_recv_response(void)
 {
+    WATCHDOG_STAGE(WATCHDOG_PS2_RECV);
     // Command may take 25ms/20ms at most([5]p.46, [3]p.21)
     uint8_t retry = 25;
     while (retry-- && !pbuf_has_data()) {
@@ -136,6 +302,10 @@ uint8_t ps2_host_recv_response(void)
 /* get data received by interrupt */
 uint8_t ps2_host_recv(void)
 {
+    if (txq_count) {
+        tx_poll();
+    }
+
     if (pbuf_has_data()) {
         ps2_error = PS2_ERR_NONE;
         return pbuf_dequeue();
@@ -145,27 +315,54 @@ uint8_t ps2_host_recv(void)
     }
 }
 
+/* time(timer_read()) when the byte last got by ps2_host_recv() came */
+uint16_t ps2_host_recv_time(void)
+{
+    return pbuf_time;
+}
+
 ISR(PS2_INT_VECT)
 {
-    static enum {
-        INIT,
-        START,
-        BIT0, BIT1, BIT2, BIT3, BIT4, BIT5, BIT6, BIT7,
-        PARITY,
-        STOP,
-    } state = INIT;
-    static uint8_t data = 0;
-    static uint8_t parity = 1;
-
-    // TODO: abort if elapse 100us from previous interrupt
+    static uint16_t last = 0;
 
     // return unless falling edge
     if (clock_in()) {
         goto RETURN;
     }
 
-    state++;
-    switch (state) {
+    if (tx_state == TX_SENDING) {
+        // host writes a bit while clock is low and device reads it on rising edge
+        tx_bit++;
+        if (tx_bit <= 8) {
+            if (tx_data & 1) {
+                data_hi();
+                tx_parity++;
+            } else {
+                data_lo();
+            }
+            tx_data >>= 1;
+        } else if (tx_bit == 9) {
+            if (tx_parity & 1) { data_hi(); } else { data_lo(); }
+        } else if (tx_bit == 10) {
+            /* Stop bit */
+            data_hi();
+        } else {
+            /* Ack */
+            tx_state = data_in() ? TX_ERROR : TX_RESPONSE;
+        }
+        goto RETURN;
+    }
+
+    uint16_t now = edge_ticks();
+    if (rx_state != INIT && (uint16_t)(now - last) > PS2_INT_TIMEOUT_TICKS) {
+        // edge lost in previous frame: start over with this edge
+        if (ps2_resync_count != UINT16_MAX) ps2_resync_count++;
+        rx_reset();
+    }
+    last = now;
+
+    rx_state++;
+    switch (rx_state) {
         case START:
             if (data_in())
                 goto ERROR;
@@ -178,25 +375,30 @@ ISR(PS2_INT_VECT)
         case BIT5:
         case BIT6:
         case BIT7:
-            data >>= 1;
+            rx_data >>= 1;
             if (data_in()) {
-                data |= 0x80;
-                parity++;
+                rx_data |= 0x80;
+                rx_parity++;
             }
             break;
         case PARITY:
             if (data_in()) {
-                if (!(parity & 0x01))
+                if (!(rx_parity & 0x01))
                     goto ERROR;
             } else {
-                if (parity & 0x01)
+                if (rx_parity & 0x01)
                     goto ERROR;
             }
             break;
         case STOP:
             if (!data_in())
                 goto ERROR;
-            pbuf_enqueue(data);
+            if (tx_state == TX_RESPONSE) {
+                tx_response = rx_data;
+                tx_state = TX_DONE;
+            } else {
+                pbuf_enqueue(rx_data);
+            }
             goto DONE;
             break;
         default:
@@ -204,18 +406,20 @@ ISR(PS2_INT_VECT)
     }
     goto RETURN;
 ERROR:
-    ps2_error = state;
+    ps2_error = rx_state;
+    if (ps2_error_count != UINT16_MAX) ps2_error_count++;
 DONE:
-    state = INIT;
-    data = 0;
-    parity = 1;
+    rx_reset();
 RETURN:
     return;
 }
 
-/* send LED state to keyboard */
+/* send LED state to keyboard without waiting for response */
 void ps2_host_set_led(uint8_t led)
 {
-    ps2_host_send(0xED);
-    ps2_host_send(led);
+    while (txq_count > PS2_TXQ_SIZE - 2) {
+        tx_poll();
+    }
+    ps2_host_send_async(PS2_SET_LED, NULL);
+    ps2_host_send_async(led, NULL);
 }
@@ -1,6 +1,15 @@
 #ifndef PS2_IO_H
 #define PS2_IO_H
 
+#if defined(__arm__) && !defined(PROTOCOL_CHIBIOS)
+/* mbed: pins of clock and data line */
+#   ifndef PS2_MBED_CLOCK
+#       define PS2_MBED_CLOCK   P0_9
+#   endif
+#   ifndef PS2_MBED_DATA
+#       define PS2_MBED_DATA    P0_8
+#   endif
+#endif
 
 void clock_init(void);
 void clock_lo(void);
@@ -11,7 +11,7 @@ static gpio_t data;
  */
 void clock_init(void)
 {
-    gpio_init(&clock, P0_9);
+    gpio_init(&clock, PS2_MBED_CLOCK);
     gpio_mode(&clock, OpenDrain|PullNone);
 }
 
@@ -37,7 +37,7 @@ bool clock_in(void)
  */
 void data_init(void)
 {
-    gpio_init(&data, P0_8);
+    gpio_init(&data, PS2_MBED_DATA);
     gpio_mode(&data, OpenDrain|PullNone);
 }
 
@@ -27,19 +27,87 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debug.h"
 
 
+#if defined(PS2_MOUSE_STREAM_MODE) && defined(PS2_USE_BUSYWAIT)
+#   error "PS2_MOUSE_STREAM_MODE needs PS2_USE_INT or PS2_USE_USART to receive in background"
+#endif
+
+
 static report_mouse_t mouse_report = {};
 
 
 static void print_usb_data(void);
 
 
+#ifdef PS2_MOUSE_STREAM_MODE
+/* 4 with IntelliMouse wheel */
+static uint8_t packet_size = 3;
+static uint8_t packet[4];
+static uint8_t packet_len = 0;
+static uint16_t packet_time;
+
+static uint8_t set_sample_rate(uint8_t rate)
+{
+    uint8_t rcv = ps2_host_send(0xF3);
+    if (rcv != PS2_ACK) return rcv;
+    return ps2_host_send(rate);
+}
+
+/* Assembles packet from bytes queued by ISR without waiting, returns true
+ * when a packet is complete. Packet starts with byte of bit3 set, when
+ * byte is lost the rest of packet is dropped on timeout. */
+static bool recv_packet(void)
+{
+    while (true) {
+        uint8_t data = ps2_host_recv();
+        if (ps2_error == PS2_ERR_NODATA) {
+            if (packet_len && timer_elapsed(packet_time) > PS2_MOUSE_PACKET_TIMEOUT) {
+                if (debug_mouse) print("ps2_mouse: packet timeout\n");
+                packet_len = 0;
+            }
+            return false;
+        }
+        if (ps2_error) continue;
+
+        if (packet_len == 0) {
+            if (!(data & (1<<3))) continue;
+            packet_time = timer_read();
+        }
+        packet[packet_len++] = data;
+        if (packet_len == packet_size) {
+            packet_len = 0;
+            return true;
+        }
+    }
+}
+#endif
+
+
+/*
+ * Mouse is set up from ps2_mouse_task() in steps so that keyboard scans and
+ * reports while it powers up, mouse comes online a second or so after boot.
+ *   POWER_UP:  wait for powering up without blocking
+ *   RESET:     Reset, BAT and Device ID
+ *   CONFIG:    mode, rate and wheel
+ */
+static enum {
+    MOUSE_POWER_UP,
+    MOUSE_RESET,
+    MOUSE_CONFIG,
+    MOUSE_READY,
+} mouse_state = MOUSE_POWER_UP;
+static uint16_t init_time;
+
 /* supports only 3 button mouse at this time */
 uint8_t ps2_mouse_init(void) {
-    uint8_t rcv;
-
     ps2_host_init();
+    init_time = timer_read();
+    mouse_state = MOUSE_POWER_UP;
+    return 0;
+}
 
-    _delay_ms(1000);    // wait for powering up
+static void mouse_reset(void)
+{
+    uint8_t rcv;
 
     // send Reset
     rcv = ps2_host_send(0xFF);
@@ -55,13 +123,61 @@ uint8_t ps2_mouse_init(void) {
     rcv = ps2_host_recv_response();
     print("ps2_mouse_init: read DevID: ");
     phex(rcv); phex(ps2_error); print("\n");
+}
+
+static void mouse_config(void)
+{
+    uint8_t rcv;
+
+#ifdef PS2_MOUSE_STREAM_MODE
+    // IntelliMouse: sample rate 200, 100 then 80 turns on wheel and Device ID 3
+    set_sample_rate(200);
+    set_sample_rate(100);
+    set_sample_rate(80);
+    rcv = ps2_host_send(0xF2);
+    if (rcv == PS2_ACK) {
+        rcv = ps2_host_recv_response();
+        if (rcv == 3) packet_size = 4;
+    }
+    print("ps2_mouse_init: IntelliMouse DevID: ");
+    phex(rcv); phex(ps2_error); print("\n");
+
+    rcv = set_sample_rate(PS2_MOUSE_SAMPLE_RATE);
+    print("ps2_mouse_init: set sample rate: ");
+    phex(rcv); phex(ps2_error); print("\n");
 
+    // send Enable Data Reporting, device is in Stream mode after reset
+    rcv = ps2_host_send(0xF4);
+    print("ps2_mouse_init: send 0xF4: ");
+    phex(rcv); phex(ps2_error); print("\n");
+#else
     // send Set Remote mode
     rcv = ps2_host_send(0xF0);
     print("ps2_mouse_init: send 0xF0: ");
     phex(rcv); phex(ps2_error); print("\n");
+#endif
+}
 
-    return 0;
+/* one step of set up in a call, true when mouse is ready */
+static bool mouse_setup(void)
+{
+    switch (mouse_state) {
+        case MOUSE_POWER_UP:
+            if (timer_elapsed(init_time) < PS2_MOUSE_POWER_UP_TIME) break;
+            mouse_state = MOUSE_RESET;
+            break;
+        case MOUSE_RESET:
+            mouse_reset();
+            mouse_state = MOUSE_CONFIG;
+            break;
+        case MOUSE_CONFIG:
+            mouse_config();
+            mouse_state = MOUSE_READY;
+            break;
+        case MOUSE_READY:
+            return true;
+    }
+    return false;
 }
 
 #define X_IS_NEG  (mouse_report.buttons & (1<<PS2_MOUSE_X_SIGN))
@@ -74,7 +190,17 @@ void ps2_mouse_task(void)
     static uint8_t scroll_state = SCROLL_NONE;
     static uint8_t buttons_prev = 0;
 
+    if (!mouse_setup()) return;
+
     /* receives packet from mouse */
+#ifdef PS2_MOUSE_STREAM_MODE
+    if (!recv_packet()) return;
+    mouse_report.buttons = packet[0];
+    mouse_report.x = packet[1];
+    mouse_report.y = packet[2];
+    // wheel of IntelliMouse is positive downward, 0 for 3-byte packet
+    mouse_report.v = -(int8_t)packet[3];
+#else
     uint8_t rcv;
     rcv = ps2_host_send(PS2_MOUSE_READ_DATA);
     if (rcv == PS2_ACK) {
@@ -85,9 +211,10 @@ void ps2_mouse_task(void)
         if (debug_mouse) print("ps2_mouse: fail to get mouse packet\n");
         return;
     }
+#endif
 
     /* if mouse moves or buttons state changes */
-    if (mouse_report.x || mouse_report.y ||
+    if (mouse_report.x || mouse_report.y || mouse_report.v ||
             ((mouse_report.buttons ^ buttons_prev) & PS2_MOUSE_BTN_MASK)) {
 
 #ifdef PS2_MOUSE_DEBUG
@@ -100,6 +227,14 @@ void ps2_mouse_task(void)
 
         buttons_prev = mouse_report.buttons;
 
+#ifdef MOUSE_REPORT_MERGE
+        // 9-bit movement as it is, host splits it into reports
+        int16_t move_x = X_IS_OVF ? (X_IS_NEG ? -256 : 255) :
+                         (X_IS_NEG ? (int16_t)(uint8_t)mouse_report.x - 256 : (uint8_t)mouse_report.x);
+        int16_t move_y = Y_IS_OVF ? (Y_IS_NEG ? -256 : 255) :
+                         (Y_IS_NEG ? (int16_t)(uint8_t)mouse_report.y - 256 : (uint8_t)mouse_report.y);
+#endif
+
         // PS/2 mouse data is '9-bit integer'(-256 to 255) which is comprised of sign-bit and 8-bit value.
         // bit: 8    7 ... 0
         //      sign \8-bit/
@@ -160,7 +295,16 @@ void ps2_mouse_task(void)
 #endif
 
 
+#ifdef MOUSE_REPORT_MERGE
+        // no movement left when turned into scroll
+        if (!mouse_report.x && !mouse_report.y) {
+            move_x = 0;
+            move_y = 0;
+        }
+        host_mouse_move(mouse_report.buttons, move_x, -move_y, mouse_report.v, mouse_report.h);
+#else
         host_mouse_send(&mouse_report);
+#endif
         print_usb_data();
     }
     // clear report
@@ -205,7 +349,9 @@ static void print_usb_data(void)
  * Stream Mode: devices sends the data when it changs its state
  * Remote Mode: host polls the data periodically
  *
- * This code uses Remote Mode and polls the data with Read Data(0xEB).
+ * This code uses Remote Mode and polls the data with Read Data(0xEB) by
+ * default. With PS2_MOUSE_STREAM_MODE it enables data reporting in Stream
+ * Mode and takes packets received in background.
  *
  * Data format:
  * byte|7       6       5       4       3       2       1       0
@@ -213,4 +359,5 @@ static void print_usb_data(void)
  *    0|Yovflw  Xovflw  Ysign   Xsign   1       Middle  Right   Left
  *    1|                    X movement
  *    2|                    Y movement
+ *    3|                    Z movement(IntelliMouse, Device ID 3)
  */
@@ -40,6 +40,28 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define PS2_MOUSE_Y_OVFLW       7
 
 
+/*
+ * Stream mode
+ *
+ * PS2_MOUSE_STREAM_MODE: mouse sends packets by itself, they are received
+ * by interrupt(PS2_USE_INT or PS2_USE_USART) and task doesn't wait for mouse.
+ * Wheel of IntelliMouse is also used when detected.
+ */
+/* 10, 20, 40, 60, 80, 100 or 200(samples/sec) */
+#ifndef PS2_MOUSE_SAMPLE_RATE
+#define PS2_MOUSE_SAMPLE_RATE           100
+#endif
+/* drop incomplete packet after this time(ms) */
+#ifndef PS2_MOUSE_PACKET_TIMEOUT
+#define PS2_MOUSE_PACKET_TIMEOUT        10
+#endif
+
+/* time(ms) to wait for mouse to power up before Reset, keyboard works meanwhile */
+#ifndef PS2_MOUSE_POWER_UP_TIME
+#define PS2_MOUSE_POWER_UP_TIME         1000
+#endif
+
+
 /*
  * Scroll by mouse move with pressing button
  */
@@ -40,11 +40,15 @@ POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include "ps2.h"
 #include "ps2_io.h"
 #include "print.h"
+#include "spsc_queue.h"
+#include "timer.h"
+#include "watchdog.h"
 
 
 #define WAIT(stat, us, err) do { \
@@ -58,10 +62,92 @@ POSSIBILITY OF SUCH DAMAGE.
 uint8_t ps2_error = PS2_ERR_NONE;
 
 
-static inline uint8_t pbuf_dequeue(void);
-static inline void pbuf_enqueue(uint8_t data);
-static inline bool pbuf_has_data(void);
-static inline void pbuf_clear(void);
+SPSC_STAMPED_QUEUE(pbuf, uint8_t, 32)
+
+
+/*
+ * Asynchronous send
+ *
+ * Frame is still clocked out by CPU(about 1ms) since USART can't transmit
+ * on this wiring: data line is on RXD not TXD, and clock line on XCK can't
+ * be held low for request to send while USART is slave. Waiting for response
+ * of device is done in background, RX interrupt takes next byte as response
+ * of the command instead of putting it into pbuf. Next command is started and
+ * completion callback is called from ps2_host_recv() or ps2_host_send_async()
+ * in main loop context, as in ps2_interrupt.c.
+ */
+#ifndef PS2_TXQ_SIZE
+#   define PS2_TXQ_SIZE     4
+#endif
+/* device responds in 20ms([5]p.46) */
+#define PS2_TX_TIMEOUT      40
+
+static struct {
+    uint8_t data;
+    ps2_send_cb_t cb;
+} txq[PS2_TXQ_SIZE];
+static uint8_t txq_head = 0;
+static uint8_t txq_count = 0;
+static uint16_t tx_time;
+
+static volatile enum {
+    TX_IDLE,
+    TX_RESPONSE,
+    TX_DONE,
+    TX_ERROR,
+} tx_state = TX_IDLE;
+static volatile uint8_t tx_response;
+
+static bool send_frame(uint8_t data);
+
+static void tx_start(void)
+{
+    tx_state = send_frame(txq[txq_head].data) ? TX_RESPONSE : TX_ERROR;
+    tx_time = timer_read();
+}
+
+static void tx_poll(void)
+{
+    switch (tx_state) {
+        case TX_IDLE:
+            if (txq_count) tx_start();
+            return;
+        case TX_RESPONSE:
+            if (timer_elapsed(tx_time) < PS2_TX_TIMEOUT) return;
+            PS2_USART_RX_POLL_ON();
+            if (tx_state == TX_RESPONSE) {
+                // no response from device
+                tx_state = TX_ERROR;
+            }
+            PS2_USART_RX_INT_ON();
+            break;
+        default:
+            break;
+    }
+
+    uint8_t data = txq[txq_head].data;
+    ps2_send_cb_t cb = txq[txq_head].cb;
+    uint8_t response = (tx_state == TX_DONE) ? tx_response : 0;
+    txq_head = (txq_head + 1) % PS2_TXQ_SIZE;
+    txq_count--;
+    tx_state = TX_IDLE;
+
+    if (txq_count) tx_start();
+    if (cb) cb(data, response);
+}
+
+bool ps2_host_send_async(uint8_t data, ps2_send_cb_t cb)
+{
+    if (txq_count >= PS2_TXQ_SIZE) {
+        return false;
+    }
+    uint8_t i = (txq_head + txq_count) % PS2_TXQ_SIZE;
+    txq[i].data = data;
+    txq[i].cb = cb;
+    txq_count++;
+    tx_poll();
+    return true;
+}
 
 
 void ps2_host_init(void)
@@ -74,6 +160,19 @@ void ps2_host_init(void)
 }
 
 uint8_t ps2_host_send(uint8_t data)
+{
+    WATCHDOG_STAGE(WATCHDOG_PS2_SEND);
+    /* finish queued commands first */
+    while (txq_count) {
+        tx_poll();
+    }
+
+    if (!send_frame(data)) return 0;
+    return ps2_host_recv_response();
+}
+
+/* clock out a byte to device, USART receiver is on again at return */
+static bool send_frame(uint8_t data)
 {
     bool parity = true;
     ps2_error = PS2_ERR_NONE;
@@ -123,16 +222,17 @@ uint8_t ps2_host_send(uint8_t data)
     idle();
     PS2_USART_INIT();
     PS2_USART_RX_INT_ON();
-    return ps2_host_recv_response();
+    return true;
 ERROR:
     idle();
     PS2_USART_INIT();
     PS2_USART_RX_INT_ON();
-    return 0;
+    return false;
 }
 
 uint8_t ps2_host_recv_response(void)
 {
+    WATCHDOG_STAGE(WATCHDOG_PS2_RECV);
     // Command may take 25ms/20ms at most([5]p.46, [3]p.21)
     uint8_t retry = 25;
     while (retry-- && !pbuf_has_data()) {
@@ -143,6 +243,10 @@ uint8_t ps2_host_recv_response(void)
 
 uint8_t ps2_host_recv(void)
 {
+    if (txq_count) {
+        tx_poll();
+    }
+
     if (pbuf_has_data()) {
         ps2_error = PS2_ERR_NONE;
         return pbuf_dequeue();
@@ -152,12 +256,21 @@ uint8_t ps2_host_recv(void)
     }
 }
 
+/* time(timer_read()) when the byte last got by ps2_host_recv() came */
+uint16_t ps2_host_recv_time(void)
+{
+    return pbuf_time;
+}
+
 ISR(PS2_USART_RX_VECT)
 {
     // TODO: request RESEND when error occurs?
     uint8_t error = PS2_USART_ERROR;    // USART error should be read before data
     uint8_t data = PS2_USART_RX_DATA;
-    if (!error) {
+    if (tx_state == TX_RESPONSE) {
+        tx_response = data;
+        tx_state = error ? TX_ERROR : TX_DONE;
+    } else if (!error) {
         pbuf_enqueue(data);
     } else {
         xprintf("PS2 USART error: %02X data: %02X\n", error, data);
@@ -167,57 +280,6 @@ ISR(PS2_USART_RX_VECT)
 /* send LED state to keyboard */
 void ps2_host_set_led(uint8_t led)
 {
-    ps2_host_send(0xED);
-    ps2_host_send(led);
-}
-
-
-/*--------------------------------------------------------------------
- * Ring buffer to store scan codes from keyboard
- *------------------------------------------------------------------*/
-#define PBUF_SIZE 32
-static uint8_t pbuf[PBUF_SIZE];
-static uint8_t pbuf_head = 0;
-static uint8_t pbuf_tail = 0;
-static inline void pbuf_enqueue(uint8_t data)
-{
-    uint8_t sreg = SREG;
-    cli();
-    uint8_t next = (pbuf_head + 1) % PBUF_SIZE;
-    if (next != pbuf_tail) {
-        pbuf[pbuf_head] = data;
-        pbuf_head = next;
-    } else {
-        print("pbuf: full\n");
-    }
-    SREG = sreg;
-}
-static inline uint8_t pbuf_dequeue(void)
-{
-    uint8_t val = 0;
-
-    uint8_t sreg = SREG;
-    cli();
-    if (pbuf_head != pbuf_tail) {
-        val = pbuf[pbuf_tail];
-        pbuf_tail = (pbuf_tail + 1) % PBUF_SIZE;
-    }
-    SREG = sreg;
-
-    return val;
-}
-static inline bool pbuf_has_data(void)
-{
-    uint8_t sreg = SREG;
-    cli();
-    bool has_data = (pbuf_head != pbuf_tail);
-    SREG = sreg;
-    return has_data;
-}
-static inline void pbuf_clear(void)
-{
-    uint8_t sreg = SREG;
-    cli();
-    pbuf_head = pbuf_tail = 0;
-    SREG = sreg;
+    ps2_host_send_async(PS2_SET_LED, NULL);
+    ps2_host_send_async(led, NULL);
 }
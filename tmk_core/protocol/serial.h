@@ -42,6 +42,20 @@ POSSIBILITY OF SUCH DAMAGE.
 void serial_init(void);
 uint8_t serial_recv(void);
 int16_t serial_recv2(void);
+/* time(timer_read()) of byte last received, taken in receive interrupt */
+uint16_t serial_recv_time(void);
 void serial_send(uint8_t data);
+/* number of bytes serial_send() takes without waiting, 0 while flow control
+ * holds transmit so that caller can keep its data to merge */
+uint8_t serial_send_space(void);
+/* restart background transmit held by flow control, call it in main loop */
+void serial_send_task(void);
+
+/* SERIAL_RX_CALLBACK: received byte is passed to serial_rx_callback() in
+ * receive interrupt instead of receive buffer and serial_recv() gets nothing.
+ * Keep it short, it runs with interrupts disabled. */
+#ifdef SERIAL_RX_CALLBACK
+void serial_rx_callback(uint8_t data);
+#endif
 
 #endif
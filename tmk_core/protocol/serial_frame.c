@@ -0,0 +1,86 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "serial.h"
+#include "serial_frame.h"
+
+
+#define FRAME_SLOT(n)   ((frame_head + (n)) < SERIAL_FRAME_QUEUE_SIZE ? \
+                         (frame_head + (n)) : \
+                         (frame_head + (n)) - SERIAL_FRAME_QUEUE_SIZE)
+
+static uint8_t frames[SERIAL_FRAME_QUEUE_SIZE][SERIAL_FRAME_SIZE];
+static uint8_t frame_len[SERIAL_FRAME_QUEUE_SIZE];
+static uint8_t frame_type[SERIAL_FRAME_QUEUE_SIZE];
+static uint8_t frame_head = 0;
+static uint8_t frame_count = 0;
+static uint8_t frame_pos = 0;       // bytes of head frame written already
+
+
+/* write head frame as far as serial takes it, true when it is done */
+static bool frame_send(bool wait)
+{
+    uint8_t len = frame_len[frame_head];
+    while (frame_pos < len) {
+        if (!wait && !serial_send_space()) return false;
+        serial_send(frames[frame_head][frame_pos++]);
+    }
+    frame_pos = 0;
+    frame_head = FRAME_SLOT(1);
+    frame_count--;
+    return true;
+}
+
+uint8_t *serial_frame_alloc(enum serial_frame_type type, uint8_t len)
+{
+    if (type == SERIAL_FRAME_KEYBOARD && frame_count) {
+        uint8_t last = FRAME_SLOT(frame_count - 1);
+        if (frame_type[last] == SERIAL_FRAME_KEYBOARD && !(frame_count == 1 && frame_pos)) {
+            frame_len[last] = len;
+            return frames[last];
+        }
+    }
+    if (frame_count == SERIAL_FRAME_QUEUE_SIZE) {
+        frame_send(true);
+    }
+    uint8_t i = FRAME_SLOT(frame_count);
+    frame_count++;
+    frame_type[i] = type;
+    frame_len[i] = len;
+    return frames[i];
+}
+
+void serial_frame_task(void)
+{
+    while (frame_count && frame_send(false)) ;
+}
+
+bool serial_frame_pending(void)
+{
+    return frame_count;
+}
+
+/* drop queued frames, head frame is finished if it is written partly */
+void serial_frame_clear(void)
+{
+    if (frame_pos) frame_send(true);
+    frame_head = 0;
+    frame_count = 0;
+    frame_pos = 0;
+}
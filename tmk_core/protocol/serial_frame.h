@@ -0,0 +1,58 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "report.h"
+
+/*
+ * Transmit queue of report frames for wireless modules on serial.h
+ *
+ * Driver fills frame in its own encoding and it is written to serial as far
+ * as serial takes without waiting, right after queued and from
+ * serial_frame_task() in main loop, so that scan doesn't wait for the link.
+ * Keyboard frame replaces keyboard frame queued right before it as only the
+ * latest state matters, other frames are kept so that both press and release
+ * of consumer key go out. Head frame is written waiting only when queue is
+ * full.
+ */
+#ifndef SERIAL_FRAME_QUEUE_SIZE
+#define SERIAL_FRAME_QUEUE_SIZE 4
+#endif
+/* raw report mode header of RN-42 is 3 bytes */
+#ifndef SERIAL_FRAME_SIZE
+#define SERIAL_FRAME_SIZE       (3 + KEYBOARD_REPORT_SIZE)
+#endif
+
+enum serial_frame_type {
+    SERIAL_FRAME_KEYBOARD,
+    SERIAL_FRAME_MOUSE,
+    SERIAL_FRAME_CONSUMER,
+    SERIAL_FRAME_OTHER,
+};
+
+/* frame of len bytes to fill in */
+uint8_t *serial_frame_alloc(enum serial_frame_type type, uint8_t len);
+/* write queued frames as far as serial takes */
+void serial_frame_task(void);
+bool serial_frame_pending(void);
+void serial_frame_clear(void);
+
+#endif
@@ -30,4 +30,19 @@ static inline uint8_t serial_mouse_init(void)
 
 void serial_mouse_task(void);
 
+/*
+ * Packets are decoded in receive interrupt(serial_rx_callback) and queued
+ * as events, buttons(bit0-7), x(bit8-15), y(bit16-23) and kind(bit24-31).
+ * Bytes of a packet come back to back, packet is dropped when next byte
+ * doesn't come in this time(ms).
+ */
+#define SERIAL_MOUSE_EVENT_MOVE     0
+#define SERIAL_MOUSE_EVENT_SCROLL   1   /* x and y are h and v */
+#define SERIAL_MOUSE_EVENT(kind, buttons, x, y) \
+    ((uint32_t)(kind)<<24 | (uint32_t)(uint8_t)(y)<<16 | (uint16_t)(uint8_t)(x)<<8 | (uint8_t)(buttons))
+
+#ifndef SERIAL_MOUSE_PACKET_TIMEOUT
+#define SERIAL_MOUSE_PACKET_TIMEOUT 20
+#endif
+
 #endif
@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <avr/io.h>
 #include <util/delay.h>
 
+#include "spsc_queue.h"
 #include "serial.h"
 #include "serial_mouse.h"
 #include "report.h"
@@ -34,47 +35,41 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 static void print_usb_data(const report_mouse_t *report);
 
-void serial_mouse_task(void)
+/* events decoded in receive interrupt */
+SPSC_QUEUE(mbuf, uint32_t, 16)
+
+void serial_rx_callback(uint8_t data)
 {
-    /* 3 byte ring buffer */
     static uint8_t buffer[3];
-    static int buffer_cur = 0;
-
-    static report_mouse_t report = {};
-
-    int16_t rcv;
-
-    rcv = serial_recv2();
-    if (rcv < 0)
-        /* no new data */
-        return;
+    static uint8_t buffer_cur = 0;
+    static uint8_t buttons = 0;
+    static uint16_t last = 0;
 
-    if (debug_mouse)
-        xprintf("serial_mouse: byte: %04X\n", rcv);
+    /* rest of packet was lost */
+    if (buffer_cur && timer_elapsed(last) > SERIAL_MOUSE_PACKET_TIMEOUT)
+        buffer_cur = 0;
+    last = timer_read();
 
     /*
      * If bit 6 is one, this signals the beginning
      * of a 3 byte sequence/packet.
      */
-    if (rcv & (1 << 6))
+    if (data & (1 << 6)) {
         buffer_cur = 0;
-
-    buffer[buffer_cur] = (uint8_t)rcv;
-
-    if (buffer_cur == 0 && buffer[buffer_cur] == 0x20) {
-        /*
-         * Logitech extension: This must be a follow-up on
-         * the last 3-byte packet signaling a middle button click
-         */
-        report.buttons |= MOUSE_BTN3;
-        report.x = report.y = 0;
-
-        print_usb_data(&report);
-        host_mouse_send(&report);
+    } else if (buffer_cur == 0) {
+        if (data == 0x20) {
+            /*
+             * Logitech extension: This must be a follow-up on
+             * the last 3-byte packet signaling a middle button click
+             */
+            buttons |= MOUSE_BTN3;
+            mbuf_enqueue(SERIAL_MOUSE_EVENT(SERIAL_MOUSE_EVENT_MOVE, buttons, 0, 0));
+        }
+        /* not in sync */
         return;
     }
 
-    buffer_cur++;
+    buffer[buffer_cur++] = data;
 
     if (buffer_cur < 3)
         return;
@@ -86,31 +81,33 @@ void serial_mouse_task(void)
      * if the mouse moved or the button states
      * change.
      */
-    report.buttons = 0;
+    buttons = 0;
     if (buffer[0] & (1 << 5))
-        report.buttons |= MOUSE_BTN1;
+        buttons |= MOUSE_BTN1;
     if (buffer[0] & (1 << 4))
-        report.buttons |= MOUSE_BTN2;
+        buttons |= MOUSE_BTN2;
 
-    report.x = (buffer[0] << 6) | buffer[1];
-    report.y = ((buffer[0] << 4) & 0xC0) | buffer[2];
+    int8_t x = (buffer[0] << 6) | buffer[1];
+    int8_t y = ((buffer[0] << 4) & 0xC0) | buffer[2];
 
     /* USB HID uses values from -127 to 127 only */
-    report.x = MAX(report.x, -127);
-    report.y = MAX(report.y, -127);
-
-#if 0
-    if (!report.buttons && !report.x && !report.y) {
-        /*
-         * Microsoft extension: Middle mouse button pressed
-         * FIXME: I don't know how exactly this extension works.
-         */
-        report.buttons |= MOUSE_BTN3;
-    }
-#endif
+    mbuf_enqueue(SERIAL_MOUSE_EVENT(SERIAL_MOUSE_EVENT_MOVE, buttons,
+                                    MAX(x, -127), MAX(y, -127)));
+}
+
+void serial_mouse_task(void)
+{
+    while (mbuf_has_data()) {
+        uint32_t event = mbuf_dequeue();
+        report_mouse_t report = {
+            .buttons = event,
+            .x = event >> 8,
+            .y = event >> 16,
+        };
 
-    print_usb_data(&report);
-    host_mouse_send(&report);
+        print_usb_data(&report);
+        host_mouse_send(&report);
+    }
 }
 
 static void print_usb_data(const report_mouse_t *report)
@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <avr/io.h>
 #include <util/delay.h>
 
+#include "spsc_queue.h"
 #include "serial.h"
 #include "serial_mouse.h"
 #include "report.h"
@@ -36,23 +37,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 static void print_usb_data(const report_mouse_t *report);
 
-void serial_mouse_task(void)
+/* events decoded in receive interrupt */
+SPSC_QUEUE(mbuf, uint32_t, 16)
+
+void serial_rx_callback(uint8_t data)
 {
     /* 5 byte ring buffer */
     static uint8_t buffer[5];
-    static int buffer_cur = 0;
-
-    int16_t rcv;
-
-    report_mouse_t report = {0, 0, 0, 0, 0};
+    static uint8_t buffer_cur = 0;
+    static uint16_t last = 0;
 
-    rcv = serial_recv2();
-    if (rcv < 0)
-        /* no new data */
-        return;
+    uint8_t buttons = 0;
 
-    if (debug_mouse)
-        xprintf("serial_mouse: byte: %04X\n", rcv);
+    /* rest of packet was lost */
+    if (buffer_cur && timer_elapsed(last) > SERIAL_MOUSE_PACKET_TIMEOUT)
+        buffer_cur = 0;
+    last = timer_read();
 
     /*
      * Synchronization: mouse(4) says that all
@@ -61,10 +61,10 @@ void serial_mouse_task(void)
      * Therefore we discard all bytes up to the
      * first one with the characteristic bit pattern.
      */
-    if (buffer_cur == 0 && (rcv >> 3) != 0x10)
+    if (buffer_cur == 0 && (data >> 3) != 0x10)
         return;
 
-    buffer[buffer_cur++] = (uint8_t)rcv;
+    buffer[buffer_cur++] = data;
 
     if (buffer_cur < 5)
         return;
@@ -73,18 +73,14 @@ void serial_mouse_task(void)
 #ifdef SERIAL_MOUSE_CENTER_SCROLL
     if ((buffer[0] & 0x7) == 0x5 && (buffer[1] || buffer[2])) {
         /* USB HID uses only values from -127 to 127 */
-        report.h = MAX((int8_t)buffer[1], -127);
-        report.v = MAX((int8_t)buffer[2], -127);
-
-        print_usb_data(&report);
-        host_mouse_send(&report);
+        mbuf_enqueue(SERIAL_MOUSE_EVENT(SERIAL_MOUSE_EVENT_SCROLL, 0,
+                                        MAX((int8_t)buffer[1], -127),
+                                        MAX((int8_t)buffer[2], -127)));
 
         if (buffer[3] || buffer[4]) {
-            report.h = MAX((int8_t)buffer[3], -127);
-            report.v = MAX((int8_t)buffer[4], -127);
-
-            print_usb_data(&report);
-            host_mouse_send(&report);
+            mbuf_enqueue(SERIAL_MOUSE_EVENT(SERIAL_MOUSE_EVENT_SCROLL, 0,
+                                            MAX((int8_t)buffer[3], -127),
+                                            MAX((int8_t)buffer[4], -127)));
         }
 
         return;
@@ -98,22 +94,36 @@ void serial_mouse_task(void)
      * change.
      */
     if (!(buffer[0] & (1 << 2)))
-        report.buttons |= MOUSE_BTN1;
+        buttons |= MOUSE_BTN1;
     if (!(buffer[0] & (1 << 1)))
-        report.buttons |= MOUSE_BTN3;
+        buttons |= MOUSE_BTN3;
     if (!(buffer[0] & (1 << 0)))
-        report.buttons |= MOUSE_BTN2;
+        buttons |= MOUSE_BTN2;
 
     /* USB HID uses only values from -127 to 127 */
-    report.x = MAX((int8_t)buffer[1], -127);
-    report.y = MAX(-(int8_t)buffer[2], -127);
-
-    print_usb_data(&report);
-    host_mouse_send(&report);
+    mbuf_enqueue(SERIAL_MOUSE_EVENT(SERIAL_MOUSE_EVENT_MOVE, buttons,
+                                    MAX((int8_t)buffer[1], -127),
+                                    MAX(-(int8_t)buffer[2], -127)));
 
     if (buffer[3] || buffer[4]) {
-        report.x = MAX((int8_t)buffer[3], -127);
-        report.y = MAX(-(int8_t)buffer[4], -127);
+        mbuf_enqueue(SERIAL_MOUSE_EVENT(SERIAL_MOUSE_EVENT_MOVE, buttons,
+                                        MAX((int8_t)buffer[3], -127),
+                                        MAX(-(int8_t)buffer[4], -127)));
+    }
+}
+
+void serial_mouse_task(void)
+{
+    while (mbuf_has_data()) {
+        uint32_t event = mbuf_dequeue();
+        report_mouse_t report = { .buttons = event };
+        if ((event >> 24) == SERIAL_MOUSE_EVENT_SCROLL) {
+            report.h = event >> 8;
+            report.v = event >> 16;
+        } else {
+            report.x = event >> 8;
+            report.y = event >> 16;
+        }
 
         print_usb_data(&report);
         host_mouse_send(&report);
@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
+#include "spsc_queue.h"
 #include "serial.h"
 
 /*
@@ -47,6 +48,19 @@ POSSIBILITY OF SUCH DAMAGE.
  *  if it is not supported by hardware UART.
  *
  *  TODO: delay is not accurate enough. Instruction cycle should be counted and inline assemby is needed.
+ *
+ *  With timer configured by SERIAL_SOFT_TXD_TIMER_* and SERIAL_SOFT_TXD_VECT
+ *  serial_send() only queues data and timer compare interrupt shifts out
+ *  one bit each. RX interrupt then allows nesting to keep TX bits on time,
+ *  SERIAL_SOFT_RXD_INT_ENTER() must mask RX interrupt and
+ *  SERIAL_SOFT_RXD_INT_EXIT() unmask it in that case.
+ *
+ *  When TXD is on output compare pin of the timer, SERIAL_SOFT_TXD_OC_ON() and
+ *  SERIAL_SOFT_TXD_OC_OFF() set compare output mode to place ON/OFF level at
+ *  next compare match. Interrupt then programs each bit a period ahead and the
+ *  compare unit puts it on the pin exactly at the match, latency of interrupt
+ *  or other ISRs doesn't skew it as long as it is less than a bit period.
+ *  SERIAL_SOFT_TXD_TIMER_INIT() should force the pin to idle(ON) level.
  */
 
 #define WAIT_US     (1000000L/SERIAL_SOFT_BAUD)
@@ -77,45 +91,157 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 
+#if defined(SERIAL_SOFT_TXD_VECT) && defined(SERIAL_SOFT_TXD_TIMER_INIT) && \
+    defined(SERIAL_SOFT_TXD_TIMER_ON) && defined(SERIAL_SOFT_TXD_TIMER_OFF)
+#define SERIAL_SOFT_TXD_QUEUE
+#if defined(SERIAL_SOFT_TXD_OC_ON) && defined(SERIAL_SOFT_TXD_OC_OFF)
+#define SERIAL_SOFT_TXD_OC
+#endif
+#endif
+
 void serial_init(void)
 {
     SERIAL_SOFT_DEBUG_INIT();
 
     SERIAL_SOFT_RXD_INIT();
     SERIAL_SOFT_TXD_INIT();
+#ifdef SERIAL_SOFT_TXD_QUEUE
+    SERIAL_SOFT_TXD_TIMER_INIT();
+#endif
 }
 
 /* RX ring buffer */
-#define RBUF_SIZE   8
-static uint8_t rbuf[RBUF_SIZE];
-static uint8_t rbuf_head = 0;
-static uint8_t rbuf_tail = 0;
+SPSC_STAMPED_QUEUE(rbuf, uint8_t, 8)
 
 
 uint8_t serial_recv(void)
 {
-    uint8_t data = 0;
-    if (rbuf_head == rbuf_tail) {
-        return 0;
-    }
-
-    data = rbuf[rbuf_tail];
-    rbuf_tail = (rbuf_tail + 1) % RBUF_SIZE;
-    return data;
+    return rbuf_dequeue();
 }
 
 int16_t serial_recv2(void)
 {
-    uint8_t data = 0;
-    if (rbuf_head == rbuf_tail) {
+    if (!rbuf_has_data()) {
         return -1;
     }
+    return rbuf_dequeue();
+}
 
-    data = rbuf[rbuf_tail];
-    rbuf_tail = (rbuf_tail + 1) % RBUF_SIZE;
-    return data;
+/* time(timer_read()) when the byte last got by serial_recv() came */
+uint16_t serial_recv_time(void)
+{
+    return rbuf_time;
+}
+
+#ifdef SERIAL_SOFT_TXD_QUEUE
+/* TX ring buffer */
+#define TBUF_SIZE   16
+SPSC_QUEUE(tbuf, uint8_t, TBUF_SIZE)
+
+static volatile bool tx_busy = false;
+static uint16_t tx_frame;   /* signal state of bits from LSB, 1 is ON */
+static uint8_t tx_bits;
+
+static void tx_load(uint8_t data)
+{
+#ifdef SERIAL_SOFT_BIT_ORDER_MSB
+    #ifdef SERIAL_SOFT_DATA_7BIT
+    uint8_t mask = 0x40;
+    #else
+    uint8_t mask = 0x80;
+    #endif
+#else
+    uint8_t mask = 0x01;
+#endif
+
+    uint8_t parity = 0;
+
+    /* start bit: OFF */
+    tx_frame = 0;
+    tx_bits = 1;
+
+#ifdef SERIAL_SOFT_DATA_7BIT
+    while (mask&0x7F) {
+#else
+    while (mask&0xFF) {
+#endif
+        if (data&mask) {
+            tx_frame |= (1<<tx_bits);
+            parity ^= 1;
+        }
+        tx_bits++;
+
+#ifdef SERIAL_SOFT_BIT_ORDER_MSB
+        mask >>= 1;
+#else
+        mask <<= 1;
+#endif
+    }
+
+#if defined(SERIAL_SOFT_PARITY_EVEN) || defined(SERIAL_SOFT_PARITY_ODD)
+    if (parity != SERIAL_SOFT_PARITY_VAL) {
+        tx_frame |= (1<<tx_bits);
+    }
+    tx_bits++;
+#endif
+
+    /* stop bit: ON */
+    tx_frame |= (1<<tx_bits);
+    tx_bits++;
 }
 
+void serial_send(uint8_t data)
+{
+    /* wait only when queue is full */
+    while (tbuf_count() == TBUF_SIZE - 1) ;
+    tbuf_enqueue(data);
+
+    uint8_t sreg = SREG;
+    cli();
+    if (!tx_busy) {
+        tx_busy = true;
+        SERIAL_SOFT_TXD_TIMER_ON();
+    }
+    SREG = sreg;
+}
+
+uint8_t serial_send_space(void)
+{
+    return TBUF_SIZE - 1 - tbuf_count();
+}
+
+/* bit period of TX
+ * With SERIAL_SOFT_TXD_OC bit is placed at next match, stop bit programmed
+ * last time is on the line when there is nothing to send and it stays there
+ * as idle. */
+ISR(SERIAL_SOFT_TXD_VECT)
+{
+    if (!tx_bits) {
+        if (!tbuf_has_data()) {
+            SERIAL_SOFT_TXD_TIMER_OFF();
+            tx_busy = false;
+            return;
+        }
+        tx_load(tbuf_dequeue());
+    }
+
+#ifdef SERIAL_SOFT_TXD_OC
+    if (tx_frame & 1) {
+        SERIAL_SOFT_TXD_OC_ON();
+    } else {
+        SERIAL_SOFT_TXD_OC_OFF();
+    }
+#else
+    if (tx_frame & 1) {
+        SERIAL_SOFT_TXD_ON();
+    } else {
+        SERIAL_SOFT_TXD_OFF();
+    }
+#endif
+    tx_frame >>= 1;
+    tx_bits--;
+}
+#else
 void serial_send(uint8_t data)
 {
     /* signal state: IDLE: ON, START: OFF, STOP: ON, DATA0: OFF, DATA1: ON */
@@ -171,11 +297,27 @@ void serial_send(uint8_t data)
     _delay_us(WAIT_US);
 }
 
+/* sent while caller waits, one byte at a time */
+uint8_t serial_send_space(void)
+{
+    return 1;
+}
+#endif
+
+/* no flow control on transmit */
+void serial_send_task(void)
+{
+}
+
 /* detect edge of start bit */
 ISR(SERIAL_SOFT_RXD_VECT)
 {
     SERIAL_SOFT_DEBUG_TGL();
     SERIAL_SOFT_RXD_INT_ENTER();
+#ifdef SERIAL_SOFT_TXD_QUEUE
+    /* let TX timer in while receiving */
+    sei();
+#endif
 
     uint8_t data = 0;
 
@@ -224,15 +366,14 @@ ISR(SERIAL_SOFT_RXD_VECT)
     /* to center of stop bit */
     _delay_us(WAIT_US);
 
-    uint8_t next = (rbuf_head + 1) % RBUF_SIZE;
 #if defined(SERIAL_SOFT_PARITY_EVEN) || defined(SERIAL_SOFT_PARITY_ODD)
-    if ((parity == SERIAL_SOFT_PARITY_VAL) && next != rbuf_tail) {
+    if (parity == SERIAL_SOFT_PARITY_VAL)
+#endif
+#ifdef SERIAL_RX_CALLBACK
+        serial_rx_callback(data);
 #else
-    if (next != rbuf_tail) {
+        rbuf_enqueue(data);
 #endif
-        rbuf[rbuf_head] = data;
-        rbuf_head = next;
-    }
 
     SERIAL_SOFT_RXD_INT_EXIT();
     SERIAL_SOFT_DEBUG_TGL();
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdbool.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include "spsc_queue.h"
 #include "serial.h"
 
 
@@ -46,7 +47,7 @@ POSSIBILITY OF SUCH DAMAGE.
     //   Empty:           RBUF_SPACE == RBUF_SIZE(head==tail)
     //   Last 1 space:    RBUF_SPACE == 2
     //   Full:            RBUF_SPACE == 1(last cell of rbuf be never used.)
-    #define RBUF_SPACE()   (rbuf_head < rbuf_tail ?  (rbuf_tail - rbuf_head) : (RBUF_SIZE - rbuf_head + rbuf_tail))
+    #define RBUF_SPACE()   (RBUF_SIZE - rbuf_count())
     // allow to send
     #define rbuf_check_rts_lo() do { if (RBUF_SPACE() > 2) SERIAL_UART_RTS_LO(); } while (0)
     // prohibit to send
@@ -64,49 +65,103 @@ void serial_init(void)
 
 // RX ring buffer
 #define RBUF_SIZE   256
-static uint8_t rbuf[RBUF_SIZE];
-static uint8_t rbuf_head = 0;
-static uint8_t rbuf_tail = 0;
+SPSC_STAMPED_QUEUE(rbuf, uint8_t, RBUF_SIZE)
 
 uint8_t serial_recv(void)
 {
-    uint8_t data = 0;
-    if (rbuf_head == rbuf_tail) {
+    if (!rbuf_has_data()) {
         return 0;
     }
 
-    data = rbuf[rbuf_tail];
-    rbuf_tail = (rbuf_tail + 1) % RBUF_SIZE;
+    uint8_t data = rbuf_dequeue();
     rbuf_check_rts_lo();
     return data;
 }
 
 int16_t serial_recv2(void)
 {
-    uint8_t data = 0;
-    if (rbuf_head == rbuf_tail) {
+    if (!rbuf_has_data()) {
         return -1;
     }
 
-    data = rbuf[rbuf_tail];
-    rbuf_tail = (rbuf_tail + 1) % RBUF_SIZE;
+    uint8_t data = rbuf_dequeue();
     rbuf_check_rts_lo();
     return data;
 }
 
+/* time(timer_read()) when the byte last got by serial_recv() came */
+uint16_t serial_recv_time(void)
+{
+    return rbuf_time;
+}
+
+#if defined(SERIAL_UART_TXD_VECT) && \
+    defined(SERIAL_UART_TXD_INT_ON) && defined(SERIAL_UART_TXD_INT_OFF)
+// TX ring buffer: sent from data register empty interrupt
+#ifndef SERIAL_UART_TBUF_SIZE
+#define SERIAL_UART_TBUF_SIZE   16
+#endif
+#define TBUF_SIZE   SERIAL_UART_TBUF_SIZE
+SPSC_QUEUE(tbuf, uint8_t, TBUF_SIZE)
+
+// flow control: SERIAL_UART_TXD_HOLD is true while peer can't receive
+#ifndef SERIAL_UART_TXD_HOLD
+#define SERIAL_UART_TXD_HOLD    0
+#endif
+
+void serial_send(uint8_t data)
+{
+    // wait only when queue is full
+    while (tbuf_count() == TBUF_SIZE - 1) SERIAL_UART_TXD_INT_ON();
+    tbuf_enqueue(data);
+    SERIAL_UART_TXD_INT_ON();
+}
+
+uint8_t serial_send_space(void)
+{
+    if (SERIAL_UART_TXD_HOLD) return 0;
+    return TBUF_SIZE - 1 - tbuf_count();
+}
+
+void serial_send_task(void)
+{
+    if (tbuf_has_data()) SERIAL_UART_TXD_INT_ON();
+}
+
+// USART data register empty interrupt
+ISR(SERIAL_UART_TXD_VECT)
+{
+    if (tbuf_has_data() && !(SERIAL_UART_TXD_HOLD)) {
+        SERIAL_UART_DATA = tbuf_dequeue();
+    } else {
+        // resumed by next serial_send() or serial_send_task() when held
+        SERIAL_UART_TXD_INT_OFF();
+    }
+}
+#else
 void serial_send(uint8_t data)
 {
     while (!SERIAL_UART_TXD_READY) ;
     SERIAL_UART_DATA = data;
 }
 
+uint8_t serial_send_space(void)
+{
+    return SERIAL_UART_TXD_READY ? 1 : 0;
+}
+
+void serial_send_task(void)
+{
+}
+#endif
+
 // USART RX complete interrupt
 ISR(SERIAL_UART_RXD_VECT)
 {
-    uint8_t next = (rbuf_head + 1) % RBUF_SIZE;
-    if (next != rbuf_tail) {
-        rbuf[rbuf_head] = SERIAL_UART_DATA;
-        rbuf_head = next;
-    }
+#ifdef SERIAL_RX_CALLBACK
+    serial_rx_callback(SERIAL_UART_DATA);
+#else
+    rbuf_enqueue(SERIAL_UART_DATA);
     rbuf_check_rts_hi();
+#endif
 }
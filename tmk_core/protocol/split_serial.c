@@ -0,0 +1,208 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "serial.h"
+#include "timer.h"
+#include "split_serial.h"
+
+
+#define SPLIT_SOF           0xA5
+#define SPLIT_CHANGES       0x1
+#define SPLIT_ACK           0x2
+#define SEQ_MASK            0x0F
+
+#define ROW_BYTES           sizeof(matrix_row_t)
+#define PAYLOAD_MAX         (SPLIT_ROWS * (1 + ROW_BYTES))
+
+
+static uint8_t crc8(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+    return crc;
+}
+
+static void send_frame(uint8_t type, uint8_t seq, const uint8_t *payload, uint8_t len)
+{
+    uint8_t head = (type << 4) | (seq & SEQ_MASK);
+    uint8_t crc = crc8(crc8(0, head), len);
+    serial_send(SPLIT_SOF);
+    serial_send(head);
+    serial_send(len);
+    for (uint8_t i = 0; i < len; i++) {
+        serial_send(payload[i]);
+        crc = crc8(crc, payload[i]);
+    }
+    serial_send(crc);
+}
+
+
+/*
+ * Receiver
+ * Bytes are taken from serial as far as they have come, frame with bad CRC or
+ * length is dropped and receiver hunts for next SOF.
+ */
+static enum {
+    RX_SOF,
+    RX_HEAD,
+    RX_LEN,
+    RX_PAYLOAD,
+    RX_CRC,
+} rx_state = RX_SOF;
+static uint8_t rx_head;
+static uint8_t rx_len;
+static uint8_t rx_pos;
+static uint8_t rx_crc;
+static uint8_t rx_payload[PAYLOAD_MAX];
+
+/* true when a frame is complete in rx_head/rx_len/rx_payload */
+static bool recv_frame(void)
+{
+    int16_t c;
+    while ((c = serial_recv2()) != -1) {
+        uint8_t data = c;
+        switch (rx_state) {
+            case RX_SOF:
+                if (data == SPLIT_SOF) rx_state = RX_HEAD;
+                break;
+            case RX_HEAD:
+                rx_head = data;
+                rx_crc = crc8(0, data);
+                rx_state = RX_LEN;
+                break;
+            case RX_LEN:
+                if (data > PAYLOAD_MAX) {
+                    rx_state = RX_SOF;
+                    break;
+                }
+                rx_len = data;
+                rx_pos = 0;
+                rx_crc = crc8(rx_crc, data);
+                rx_state = rx_len ? RX_PAYLOAD : RX_CRC;
+                break;
+            case RX_PAYLOAD:
+                rx_payload[rx_pos++] = data;
+                rx_crc = crc8(rx_crc, data);
+                if (rx_pos == rx_len) rx_state = RX_CRC;
+                break;
+            case RX_CRC:
+                rx_state = RX_SOF;
+                if (data == rx_crc) return true;
+                break;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * Slave
+ */
+static matrix_row_t acked[SPLIT_ROWS];      // rows master has
+static matrix_row_t sent[SPLIT_ROWS];       // rows in frame waiting for ack
+static bool waiting = false;
+static uint8_t seq = 0;
+static uint16_t sent_time;
+static uint16_t ack_time;
+
+void split_slave_task(const matrix_row_t *rows)
+{
+    while (recv_frame()) {
+        if ((rx_head >> 4) != SPLIT_ACK) continue;
+        if (!waiting || (rx_head & SEQ_MASK) != seq) continue;   // ack of frame sent before
+        for (uint8_t i = 0; i < SPLIT_ROWS; i++) acked[i] = sent[i];
+        waiting = false;
+        seq = (seq + 1) & SEQ_MASK;
+        ack_time = timer_read();
+    }
+
+    if (waiting) {
+        if (timer_elapsed(sent_time) < SPLIT_RETRY_MS) return;
+        // lost frame or ack, send changes with next sequence
+        waiting = false;
+        seq = (seq + 1) & SEQ_MASK;
+    }
+
+    // master has released our rows
+    if (timer_elapsed(ack_time) > SPLIT_LINK_TIMEOUT) {
+        for (uint8_t i = 0; i < SPLIT_ROWS; i++) acked[i] = 0;
+        ack_time = timer_read();
+    }
+
+    uint8_t payload[PAYLOAD_MAX];
+    uint8_t len = 0;
+    for (uint8_t i = 0; i < SPLIT_ROWS; i++) {
+        sent[i] = rows[i];
+        if (rows[i] == acked[i]) continue;
+        payload[len++] = i;
+        matrix_row_t r = rows[i];
+        for (uint8_t b = 0; b < ROW_BYTES; b++) {
+            payload[len++] = r;
+            r >>= 8;
+        }
+    }
+    if (!len && timer_elapsed(ack_time) < SPLIT_KEEPALIVE_MS) return;
+
+    send_frame(SPLIT_CHANGES, seq, payload, len);
+    waiting = true;
+    sent_time = timer_read();
+}
+
+
+/*
+ * Master
+ */
+static matrix_row_t slave_rows[SPLIT_ROWS];
+static bool connected = false;
+static uint16_t recv_time;
+
+void split_master_task(void)
+{
+    while (recv_frame()) {
+        if ((rx_head >> 4) != SPLIT_CHANGES) continue;
+        for (uint8_t pos = 0; pos + 1 + ROW_BYTES <= rx_len; ) {
+            uint8_t row = rx_payload[pos++];
+            matrix_row_t r = 0;
+            for (uint8_t b = 0; b < ROW_BYTES; b++) {
+                r |= (matrix_row_t)rx_payload[pos++] << (b * 8);
+            }
+            if (row < SPLIT_ROWS) slave_rows[row] = r;
+        }
+        send_frame(SPLIT_ACK, rx_head & SEQ_MASK, 0, 0);
+        connected = true;
+        recv_time = timer_read();
+    }
+
+    if (connected && timer_elapsed(recv_time) > SPLIT_LINK_TIMEOUT) {
+        for (uint8_t i = 0; i < SPLIT_ROWS; i++) slave_rows[i] = 0;
+        connected = false;
+    }
+}
+
+matrix_row_t split_row(uint8_t row)
+{
+    return (row < SPLIT_ROWS) ? slave_rows[row] : 0;
+}
+
+bool split_connected(void)
+{
+    return connected;
+}
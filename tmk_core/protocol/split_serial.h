@@ -0,0 +1,66 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPLIT_SERIAL_H
+#define SPLIT_SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+/*
+ * Link between halves of split keyboard on serial.h
+ *
+ * Slave half scans its rows and sends only rows which differ from what master
+ * acknowledged, as row index and row state, nothing while no key changes but
+ * keepalive. Master puts them into its copy of slave rows and acknowledges
+ * with sequence number of the frame, slave sends changes again with next
+ * sequence number when no ack comes in SPLIT_RETRY_MS. Row states are
+ * absolute so that a frame sent twice does no harm. Master releases slave
+ * rows when nothing comes in SPLIT_LINK_TIMEOUT and slave then sends all of
+ * its rows again.
+ *
+ * Frame: 0xA5, type<<4|seq, length, payload, CRC-8(poly 0x07) of type to payload
+ *   changes(slave): (row, row bytes LSB first) * n
+ *   ack(master):    no payload
+ *
+ * Neither side waits for the link, call the task every scan. With hardware
+ * UART at 1Mbaud a change of one row is 6 bytes, 60us on the wire.
+ */
+#ifndef SPLIT_ROWS
+#define SPLIT_ROWS          (MATRIX_ROWS / 2)
+#endif
+#ifndef SPLIT_RETRY_MS
+#define SPLIT_RETRY_MS      5
+#endif
+#ifndef SPLIT_KEEPALIVE_MS
+#define SPLIT_KEEPALIVE_MS  250
+#endif
+#ifndef SPLIT_LINK_TIMEOUT
+#define SPLIT_LINK_TIMEOUT  1000
+#endif
+
+/* slave: rows of this half after matrix_scan() */
+void split_slave_task(const matrix_row_t *rows);
+
+/* master: takes changes from slave, then split_row() of this scan is up to date */
+void split_master_task(void);
+matrix_row_t split_row(uint8_t row);
+/* frame came from slave in SPLIT_LINK_TIMEOUT */
+bool split_connected(void);
+
+#endif
@@ -22,7 +22,7 @@ static uint8_t usb_error = 0;
 static uint8_t usb_task_state;
 
 /* constructor */
-USB::USB() : bmHubPre(0) {
+USB::USB() : bmHubPre(0), pfWaitHandler(NULL), bWaiting(false), hrsl(0) {
         usb_task_state = USB_DETACHED_SUBSTATE_INITIALIZE; //set up state machine
         init();
 }
@@ -33,6 +33,19 @@ void USB::init() {
         bmHubPre = 0;
 }
 
+/* delay() that keeps running devices served, not reentered from the handler */
+void USB::Wait(uint16_t ms) {
+        unsigned long end = millis() + ms;
+
+        while((long)(millis() - end) < 0L) {
+                if(pfWaitHandler && !bWaiting) {
+                        bWaiting = true;
+                        pfWaitHandler();
+                        bWaiting = false;
+                }
+        }
+}
+
 uint8_t USB::getUsbTaskState(void) {
         return ( usb_task_state);
 }
@@ -170,7 +183,7 @@ uint8_t USB::ctrlReq(uint8_t addr, uint8_t ep, uint8_t bmReqType, uint8_t bReque
                                 rcode = InTransfer(pep, nak_limit, &read, dataptr);
                                 if(rcode == hrTOGERR) {
                                         // yes, we flip it wrong here so that next time it is actually correct!
-                                        pep->bmRcvToggle = (regRd(rHRSL) & bmSNDTOGRD) ? 0 : 1;
+                                        pep->bmRcvToggle = (hrsl & bmSNDTOGRD) ? 0 : 1;
                                         continue;
                                 }
 
@@ -234,7 +247,7 @@ uint8_t USB::InTransfer(EpInfo *pep, uint16_t nak_limit, uint16_t *nbytesptr, ui
                 rcode = dispatchPkt(tokIN, pep->epAddr, nak_limit); //IN packet to EP-'endpoint'. Function takes care of NAKS.
                 if(rcode == hrTOGERR) {
                         // yes, we flip it wrong here so that next time it is actually correct!
-                        pep->bmRcvToggle = (regRd(rHRSL) & bmRCVTOGRD) ? 0 : 1;
+                        pep->bmRcvToggle = (hrsl & bmRCVTOGRD) ? 0 : 1;
                         regWr(rHCTL, (pep->bmRcvToggle) ? bmRCVTOG1 : bmRCVTOG0); //set toggle value
                         continue;
                 }
@@ -244,12 +257,14 @@ uint8_t USB::InTransfer(EpInfo *pep, uint16_t nak_limit, uint16_t *nbytesptr, ui
                 }
                 /* check for RCVDAVIRQ and generate error if not present */
                 /* the only case when absence of RCVDAVIRQ makes sense is when toggle error occurred. Need to add handling for that */
-                if((regRd(rHIRQ) & bmRCVDAVIRQ) == 0) {
+                /* HIRQ comes as status byte of RCVBC read */
+                uint8_t hirq;
+                pktsize = regRdIrq(rRCVBC, &hirq); //number of received bytes
+                if((hirq & bmRCVDAVIRQ) == 0) {
                         //printf(">>>>>>>> Problem! NO RCVDAVIRQ!\r\n");
                         rcode = 0xf0; //receive error
                         break;
                 }
-                pktsize = regRd(rRCVBC); //number of received bytes
                 //printf("Got %i bytes \r\n", pktsize);
                 // This would be OK, but...
                 //assert(pktsize <= nbytes);
@@ -276,7 +291,8 @@ uint8_t USB::InTransfer(EpInfo *pep, uint16_t nak_limit, uint16_t *nbytesptr, ui
                 if((pktsize < maxpktsize) || (*nbytesptr >= nbytes)) // have we transferred 'nbytes' bytes?
                 {
                         // Save toggle value
-                        pep->bmRcvToggle = ((regRd(rHRSL) & bmRCVTOGRD)) ? 1 : 0;
+                        // HRSL doesn't change while FIFO is read
+                        pep->bmRcvToggle = ((hrsl & bmRCVTOGRD)) ? 1 : 0;
                         //printf("\r\n");
                         rcode = 0;
                         break;
@@ -386,7 +402,8 @@ uint8_t USB::dispatchPkt(uint8_t token, uint8_t ep, uint16_t nak_limit) {
 
                 while((long)(millis() - timeout) < 0L) //wait for transfer completion
                 {
-                        tmpdata = regRd(rHIRQ);
+                        // HRSL is read with HIRQ as status byte, it is valid once HXFRDNIRQ is set
+                        hrsl = regRdIrq(rHRSL, &tmpdata);
 
                         if(tmpdata & bmHXFRDNIRQ) {
                                 regWr(rHIRQ, bmHXFRDNIRQ); //clear the interrupt
@@ -399,7 +416,7 @@ uint8_t USB::dispatchPkt(uint8_t token, uint8_t ep, uint16_t nak_limit) {
                 //if (rcode != 0x00) //exit if timeout
                 //        return ( rcode);
 
-                rcode = (regRd(rHRSL) & 0x0f); //analyze transfer result
+                rcode = (hrsl & 0x0f); //analyze transfer result
 
                 switch(rcode) {
                         case hrNAK:
@@ -577,13 +594,13 @@ again:
                 if(parent == 0) {
                         // Send a bus reset on the root interface.
                         regWr(rHCTL, bmBUSRST); //issue bus reset
-                        delay(102); // delay 102ms, compensate for clock inaccuracy.
+                        Wait(102); // delay 102ms, compensate for clock inaccuracy.
                 } else {
                         // reset parent port
                         devConfig[parent]->ResetHubPort(port);
                 }
         } else if(rcode == hrJERR && retries < 3) { // Some devices returns this when plugged in - trying to initialize the device again usually works
-                delay(100);
+                Wait(100);
                 retries++;
                 goto again;
         } else if(rcode)
@@ -591,7 +608,7 @@ again:
 
         rcode = devConfig[driver]->Init(parent, port, lowspeed);
         if(rcode == hrJERR && retries < 3) { // Some devices returns this when plugged in - trying to initialize the device again usually works
-                delay(100);
+                Wait(100);
                 retries++;
                 goto again;
         }
@@ -600,7 +617,7 @@ again:
                 if(parent == 0) {
                         // Send a bus reset on the root interface.
                         regWr(rHCTL, bmBUSRST); //issue bus reset
-                        delay(102); // delay 102ms, compensate for clock inaccuracy.
+                        Wait(102); // delay 102ms, compensate for clock inaccuracy.
                 } else {
                         // reset parent port
                         devConfig[parent]->ResetHubPort(port);
@@ -799,7 +816,7 @@ uint8_t USB::getStrDescr(uint8_t addr, uint8_t ep, uint16_t ns, uint8_t index, u
 uint8_t USB::setAddr(uint8_t oldaddr, uint8_t ep, uint8_t newaddr) {
         uint8_t rcode = ctrlReq(oldaddr, ep, bmREQ_SET, USB_REQUEST_SET_ADDRESS, newaddr, 0x00, 0x0000, 0x0000, 0x0000, NULL, NULL);
         //delay(2); //per USB 2.0 sect.9.2.6.3
-        delay(300); // Older spec says you should wait at least 200ms
+        Wait(300); // Older spec says you should wait at least 200ms
         return rcode;
         //return ( ctrlReq(oldaddr, ep, bmREQ_SET, USB_REQUEST_SET_ADDRESS, newaddr, 0x00, 0x0000, 0x0000, 0x0000, NULL, NULL));
 }
@@ -198,6 +198,9 @@ class USB : public MAX3421E {
         AddressPoolImpl<USB_NUMDEVICES> addrPool;
         USBDeviceConfig* devConfig[USB_NUMDEVICES];
         uint8_t bmHubPre;
+        void (*pfWaitHandler)(void);
+        bool bWaiting;
+        uint8_t hrsl; // HRSL of last packet, read at completion in dispatchPkt()
 
 public:
         USB(void);
@@ -230,6 +233,13 @@ public:
         uint8_t getUsbTaskState(void);
         void setUsbTaskState(uint8_t state);
 
+        // Handler is called repeatedly while enumeration waits in Wait(), to serve
+        // devices already running. No transfer is in progress when it is called.
+        void setWaitHandler(void (*handler)(void)) {
+                pfWaitHandler = handler;
+        };
+        void Wait(uint16_t ms);
+
         EpInfo* getEpInfoEntry(uint8_t addr, uint8_t ep);
         uint8_t setEpInfoEntry(uint8_t addr, uint8_t epcount, EpInfo* eprecord_ptr);
 
@@ -340,9 +340,16 @@ void HIDUniversal::EndpointXtract(uint8_t conf, uint8_t iface, uint8_t alt, uint
 uint8_t HIDUniversal::Release() {
         pUsb->GetAddressPool().FreeAddress(bAddress);
 
+        for(uint8_t i = 0; i < maxHidInterfaces; i++) {
+                for(uint8_t j = 0; j < maxEpPerInterface; j++)
+                        hidInterfaces[i].epIndex[j] = 0;
+        }
+
         bNumEP = 1;
+        bNumIface = 0;
         bAddress = 0;
         qNextPollTime = 0;
+        pollInterval = 0;
         bPollEnable = false;
         return 0;
 }
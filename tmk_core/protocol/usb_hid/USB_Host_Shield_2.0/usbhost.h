@@ -115,6 +115,7 @@ public:
         uint8_t* bytesWr(uint8_t reg, uint8_t nbytes, uint8_t* data_p);
         void gpioWr(uint8_t data);
         uint8_t regRd(uint8_t reg);
+        uint8_t regRdIrq(uint8_t reg, uint8_t* hirq_p);
         uint8_t* bytesRd(uint8_t reg, uint8_t nbytes, uint8_t* data_p);
         uint8_t gpioRd();
         uint16_t reset();
@@ -276,6 +277,41 @@ uint8_t MAX3421e< SPI_SS, INTR >::regRd(uint8_t reg) {
         XMEM_RELEASE_SPI();
         return (rv);
 }
+/* single host register read with HIRQ                                    */
+/* in full-duplex mode MAX3421E clocks HIRQ out on MISO during command byte, */
+/* so interrupt status comes with the read instead of a transfer of its own */
+template< typename SPI_SS, typename INTR >
+uint8_t MAX3421e< SPI_SS, INTR >::regRdIrq(uint8_t reg, uint8_t* hirq_p) {
+#if USING_SPI4TEENSY3
+        *hirq_p = regRd(rHIRQ);
+        return regRd(reg);
+#else
+        XMEM_ACQUIRE_SPI();
+#if SPI_HAS_TRANSACTION
+        SPI.beginTransaction(SPISettings(26000000, MSBFIRST, SPI_MODE0)); // The MAX3421E can handle up to 26MHz, use MSB First and SPI mode 0
+#endif
+        SPI_SS::Clear();
+#if !defined(SPDR) || SPI_HAS_TRANSACTION
+        *hirq_p = SPI.transfer(reg);
+        uint8_t rv = SPI.transfer(0); // Send empty byte
+        SPI_SS::Set();
+#else
+        SPDR = reg;
+        while(!(SPSR & (1 << SPIF)));
+        *hirq_p = SPDR;
+        SPDR = 0; // Send empty byte
+        while(!(SPSR & (1 << SPIF)));
+        SPI_SS::Set();
+        uint8_t rv = SPDR;
+#endif
+
+#if SPI_HAS_TRANSACTION
+        SPI.endTransaction();
+#endif
+        XMEM_RELEASE_SPI();
+        return (rv);
+#endif
+}
 /* multiple-byte register read  */
 
 /* returns a pointer to a memory position after last read   */
@@ -384,7 +420,7 @@ int8_t MAX3421e< SPI_SS, INTR >::Init() {
 
         regWr(rMODE, bmDPPULLDN | bmDMPULLDN | bmHOST); // set pull-downs, Host
 
-        regWr(rHIEN, bmCONDETIE | bmFRAMEIE); //connection detection
+        regWr(rHIEN, bmCONDETIE); //connection detection, INT pin is not asserted at every SOF
 
         /* check if device is connected */
         regWr(rHCTL, bmSAMPLEBUS); // sample USB bus
@@ -425,7 +461,7 @@ int8_t MAX3421e< SPI_SS, INTR >::Init(int mseconds) {
 
         regWr(rMODE, bmDPPULLDN | bmDMPULLDN | bmHOST); // set pull-downs, Host
 
-        regWr(rHIEN, bmCONDETIE | bmFRAMEIE); //connection detection
+        regWr(rHIEN, bmCONDETIE); //connection detection, INT pin is not asserted at every SOF
 
         /* check if device is connected */
         regWr(rHCTL, bmSAMPLEBUS); // sample USB bus
@@ -320,11 +320,11 @@ void USBHub::ResetHubPort(uint8_t port) {
                 if(evt.bmEvent == bmHUB_PORT_EVENT_RESET_COMPLETE || evt.bmEvent == bmHUB_PORT_EVENT_LS_RESET_COMPLETE) {
                         break;
                 }
-                delay(100); // simulate polling.
+                pUsb->Wait(100); // simulate polling.
         }
         ClearPortFeature(HUB_FEATURE_C_PORT_RESET, port, 0);
         ClearPortFeature(HUB_FEATURE_C_PORT_CONNECTION, port, 0);
-        delay(20);
+        pUsb->Wait(20);
 }
 
 uint8_t USBHub::PortStatusChange(uint8_t port, HubEvent &evt) {
@@ -361,7 +361,7 @@ uint8_t USBHub::PortStatusChange(uint8_t port, HubEvent &evt) {
                         ClearPortFeature(HUB_FEATURE_C_PORT_RESET, port, 0);
                         ClearPortFeature(HUB_FEATURE_C_PORT_CONNECTION, port, 0);
 
-                        delay(20);
+                        pUsb->Wait(20);
 
                         a.devAddress = bAddress;
 
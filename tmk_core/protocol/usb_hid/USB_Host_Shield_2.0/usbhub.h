@@ -178,7 +178,13 @@ class USBHub : USBDeviceConfig {
         uint8_t PortStatusChange(uint8_t port, HubEvent &evt);
 
 public:
-        USBHub(USB *p);
+        USBHub(USB *p = NULL);
+
+        // register instance created without host, for tables of hubs
+        void Attach(USB *p) {
+                pUsb = p;
+                pUsb->RegisterDeviceClass(this);
+        };
 
         uint8_t ClearHubFeature(uint8_t fid);
         uint8_t ClearPortFeature(uint8_t fid, uint8_t port, uint8_t sel = 0);
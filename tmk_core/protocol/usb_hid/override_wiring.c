@@ -1,5 +1,7 @@
 /*
  * To keep Timer0 for common/timer.c override arduino/wiring.c.
+ * Arduino time is tmk timer, timestamps of both are comparable and only
+ * Timer0 compare interrupt of common/avr/timer.c runs.
  */
 #define __DELAY_BACKWARD_COMPATIBLE__
 #include <util/delay.h>
@@ -13,10 +15,11 @@ unsigned long millis()
 }
 unsigned long micros()
 {
-    return timer_read32() * 1000UL;
+    return timer_read_us();
 }
 void delay(unsigned long ms)
 {
+    // busy loop, safe before sei() in startup
     _delay_ms(ms);
 }
 void delayMicroseconds(unsigned int us)
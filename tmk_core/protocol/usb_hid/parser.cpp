@@ -1,12 +1,30 @@
+#include <avr/pgmspace.h>
 #include "parser.h"
 #include "usb_hid.h"
 
+#include "keycode.h"
 #include "debug.h"
 
 
 void KBDReportParser::Parse(HID *hid, bool is_rpt_id, uint8_t len, uint8_t *buf)
 {
+    // phantom state, keys are unknown and kept as last report
+    if (((report_keyboard_t *)buf)->keys[0] == KC_ROLL_OVER) {
+        dprint("input: rollover\r\n");
+        return;
+    }
+
+    // update bitmap with keys of last and this report
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        bitmap[report.keys[i] >> 3] &= ~(1 << (report.keys[i] & 7));
+    }
     ::memcpy(&report, buf, sizeof(report_keyboard_t));
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        bitmap[report.keys[i] >> 3] |= (1 << (report.keys[i] & 7));
+    }
+    // usage 0-3 are no key and errors
+    bitmap[0] &= ~0x0F;
+    bitmap[0xE0 >> 3] = report.mods;
     time_stamp = millis();
 
     dprintf("input %d:  %02X %02X", hid->GetAddress(), report.mods, report.reserved);
@@ -15,3 +33,558 @@ void KBDReportParser::Parse(HID *hid, bool is_rpt_id, uint8_t len, uint8_t *buf)
     }
     dprint("\r\n");
 }
+
+
+
+/*
+ * Report descriptor parser
+ *
+ * Descriptor comes in chunks of control transfer and items may straddle
+ * them, so it is parsed byte by byte. Global items are kept for Main items,
+ * Push/Pop and delimiters are not supported. Bit offset restarts at Report ID
+ * item, a report should be described in one piece.
+ */
+#define PAGE_GENERIC_DESKTOP    0x01
+#define PAGE_KEYBOARD           0x07
+#define PAGE_LED                0x08
+#define PAGE_BUTTON             0x09
+#define PAGE_CONSUMER           0x0C
+
+#define HID_USAGES  16
+
+#define LED_IFACE_NONE  0xFF
+
+class ReportDescParser : public USBReadParser
+{
+    HIDReportDevice *dev;
+    uint8_t iface;
+
+    // item being read
+    uint8_t prefix;
+    uint8_t size;       // data bytes
+    uint8_t pos;
+    uint8_t skip;       // bytes of long item
+    bool    in_item;
+    uint32_t data;
+
+    // global items
+    uint16_t page;
+    int16_t  logical_min;
+    uint8_t  report_size;
+    uint8_t  report_count;
+    uint8_t  report_id;
+    uint16_t offset;
+
+    // local items, usage page is in high word when given with usage
+    uint32_t usage[HID_USAGES];
+    uint8_t  usages;
+    uint32_t usage_min;
+    uint32_t usage_max;
+    bool     range;
+
+    void item(void);
+    void input(void);
+    uint32_t extend(uint32_t u) { return (u >> 16) ? u : ((uint32_t)page << 16 | u); }
+
+public:
+    ReportDescParser(HIDReportDevice *d, uint8_t i) :
+        dev(d), iface(i), prefix(0), size(0), pos(0), skip(0), in_item(false), data(0),
+        page(0), logical_min(0), report_size(0), report_count(0), report_id(0), offset(0),
+        usages(0), usage_min(0), usage_max(0), range(false) {}
+    void Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset);
+};
+
+void ReportDescParser::Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset)
+{
+    for (uint16_t i = 0; i < len; i++) {
+        uint8_t b = pbuf[i];
+        if (skip) {
+            skip--;
+            continue;
+        }
+        if (!in_item) {
+            // prefix
+            prefix = b;
+            size = (b & DATA_SIZE_MASK) == DATA_SIZE_4 ? 4 : (b & DATA_SIZE_MASK);
+            // long item: size of data follows, then tag
+            if (prefix == HID_LONG_ITEM_PREFIX) size = 1;
+            pos = 0;
+            data = 0;
+            in_item = (size != 0);
+        } else {
+            // data in little endian
+            data |= (uint32_t)b << (pos * 8);
+            in_item = (++pos < size);
+            if (prefix == HID_LONG_ITEM_PREFIX) {
+                skip = b + 1;
+                continue;
+            }
+        }
+        if (!in_item) item();
+    }
+}
+
+void ReportDescParser::item(void)
+{
+    switch (prefix & TYPE_MASK) {
+    case TYPE_MAIN:
+        switch (prefix & TAG_MASK) {
+        case TAG_MAIN_INPUT:
+            input();
+            offset += (uint16_t)report_size * report_count;
+            break;
+        case TAG_MAIN_OUTPUT:
+            // LED report to send lock state
+            if (page == PAGE_LED && dev->led_iface == LED_IFACE_NONE) {
+                dev->led_iface = iface;
+                dev->led_report_id = report_id;
+            }
+            break;
+        }
+        // collection, end collection and feature as well
+        usages = 0;
+        range = false;
+        break;
+    case TYPE_GLOBAL:
+        switch (prefix & TAG_MASK) {
+        case TAG_GLOBAL_USAGEPAGE:
+            page = data;
+            break;
+        case TAG_GLOBAL_LOGICALMIN:
+            // signed
+            if (size == 1) logical_min = (int8_t)data;
+            else logical_min = (int16_t)data;
+            break;
+        case TAG_GLOBAL_REPORTSIZE:
+            report_size = data;
+            break;
+        case TAG_GLOBAL_REPORTCOUNT:
+            report_count = data;
+            break;
+        case TAG_GLOBAL_REPORTID:
+            report_id = data;
+            offset = 0;
+            dev->has_report_id |= (1 << iface);
+            break;
+        }
+        break;
+    case TYPE_LOCAL:
+        switch (prefix & TAG_MASK) {
+        case TAG_LOCAL_USAGE:
+            if (usages < HID_USAGES) usage[usages++] = data;
+            break;
+        case TAG_LOCAL_USAGEMIN:
+            usage_min = data;
+            range = true;
+            break;
+        case TAG_LOCAL_USAGEMAX:
+            usage_max = data;
+            range = true;
+            break;
+        }
+        break;
+    }
+}
+
+#define USAGE_X         0x30
+#define USAGE_Y         0x31
+#define USAGE_WHEEL     0x38
+#define USAGE_AC_PAN    0x0238
+
+/* kind of field out of usage with page in high word */
+static uint8_t field_page(uint32_t u)
+{
+    uint16_t usage = u;
+    switch (u >> 16) {
+    case PAGE_KEYBOARD:
+        return HIDReportDevice::FIELD_KEYBOARD;
+    case PAGE_CONSUMER:
+        return (usage == USAGE_AC_PAN) ? HIDReportDevice::FIELD_POINTER : HIDReportDevice::FIELD_CONSUMER;
+    case PAGE_BUTTON:
+        return HIDReportDevice::FIELD_BUTTON;
+    case PAGE_GENERIC_DESKTOP:
+        if (SYSTEM_POWER_DOWN <= usage && usage <= SYSTEM_WAKE_UP)
+            return HIDReportDevice::FIELD_SYSTEM;
+        if (usage == USAGE_X || usage == USAGE_Y || usage == USAGE_WHEEL)
+            return HIDReportDevice::FIELD_POINTER;
+        break;
+    }
+    return HIDReportDevice::FIELD_NONE;
+}
+
+void ReportDescParser::input(void)
+{
+    // constant is padding
+    if (data & 0x01) return;
+    if (!report_size || report_size > 16 || !report_count) return;
+
+    if (!(data & 0x02)) {
+        // array: item value is index of usage from logical minimum
+        uint32_t u = extend(range ? usage_min : (usages ? usage[0] : 0));
+        uint8_t p = field_page(u);
+        // system control array starts at usage out of range, e.g. 0x80
+        if (p == HIDReportDevice::FIELD_NONE && (u >> 16) == PAGE_GENERIC_DESKTOP && range &&
+                (uint16_t)usage_min <= SYSTEM_WAKE_UP && (uint16_t)usage_max >= SYSTEM_POWER_DOWN)
+            p = HIDReportDevice::FIELD_SYSTEM;
+        if (p != HIDReportDevice::FIELD_KEYBOARD && p != HIDReportDevice::FIELD_CONSUMER &&
+                p != HIDReportDevice::FIELD_SYSTEM) return;
+        dev->add_field(iface, p, false, false, report_id, report_size, report_count, offset,
+                       (uint16_t)u - logical_min);
+        return;
+    }
+
+    // variable: item per usage, consecutive usages are merged into a field
+    if (range) {
+        uint32_t u = extend(usage_min);
+        uint16_t n = (uint16_t)(usage_max - usage_min) + 1;
+        if (n > report_count) n = report_count;
+        // pointer axes and system usages are not consecutive with others
+        for (uint16_t i = 0; i < n; i++) {
+            uint8_t p = field_page(u + i);
+            if (p == HIDReportDevice::FIELD_NONE) continue;
+            uint16_t m = 1;
+            if (p != HIDReportDevice::FIELD_POINTER && p != HIDReportDevice::FIELD_SYSTEM) m = n - i;
+            dev->add_field(iface, p, true, logical_min < 0, report_id, report_size, m,
+                           offset + i * report_size, (uint16_t)(u + i));
+            i += m - 1;
+        }
+        return;
+    }
+    // items without usage are ignored
+    for (uint8_t i = 0, n; i < report_count && i < usages; i += n) {
+        uint32_t u = extend(usage[i]);
+        for (n = 1; i + n < report_count && i + n < usages &&
+                extend(usage[i + n]) == u + n; n++) ;
+        uint8_t p = field_page(u);
+        if (p == HIDReportDevice::FIELD_NONE) continue;
+        // axis is a field each
+        if (p == HIDReportDevice::FIELD_POINTER) n = 1;
+        dev->add_field(iface, p, true, logical_min < 0, report_id, report_size, n,
+                       offset + (uint16_t)i * report_size, (uint16_t)u);
+    }
+}
+
+
+/* consumer usages of keycode KC_MEDIA_NEXT_TRACK..KC_WWW_FAVORITES */
+static const uint16_t consumer_usage[] PROGMEM = {
+    KEYCODE2CONSUMER(KC_MEDIA_NEXT_TRACK),
+    KEYCODE2CONSUMER(KC_MEDIA_PREV_TRACK),
+    KEYCODE2CONSUMER(KC_MEDIA_FAST_FORWARD),
+    KEYCODE2CONSUMER(KC_MEDIA_REWIND),
+    KEYCODE2CONSUMER(KC_MEDIA_STOP),
+    KEYCODE2CONSUMER(KC_MEDIA_PLAY_PAUSE),
+    KEYCODE2CONSUMER(KC_MEDIA_EJECT),
+    KEYCODE2CONSUMER(KC_MEDIA_SELECT),
+    KEYCODE2CONSUMER(KC_MAIL),
+    KEYCODE2CONSUMER(KC_CALCULATOR),
+    KEYCODE2CONSUMER(KC_MY_COMPUTER),
+    KEYCODE2CONSUMER(KC_WWW_SEARCH),
+    KEYCODE2CONSUMER(KC_WWW_HOME),
+    KEYCODE2CONSUMER(KC_WWW_BACK),
+    KEYCODE2CONSUMER(KC_WWW_FORWARD),
+    KEYCODE2CONSUMER(KC_WWW_STOP),
+    KEYCODE2CONSUMER(KC_WWW_REFRESH),
+    KEYCODE2CONSUMER(KC_WWW_FAVORITES),
+};
+
+/* code in bitmap, 0 for no key */
+static uint8_t usage_code(uint8_t page, uint16_t usage)
+{
+    switch (page) {
+    case HIDReportDevice::FIELD_KEYBOARD:
+        return (usage < 0x100) ? usage : 0;
+    case HIDReportDevice::FIELD_SYSTEM:
+        if (SYSTEM_POWER_DOWN <= usage && usage <= SYSTEM_WAKE_UP)
+            return KC_SYSTEM_POWER + (usage - SYSTEM_POWER_DOWN);
+        return 0;
+    case HIDReportDevice::FIELD_CONSUMER:
+        // at keyboard usage so that keymap has them at the same place
+        if (usage == AUDIO_MUTE)        return KC__MUTE;
+        if (usage == AUDIO_VOL_UP)      return KC__VOLUP;
+        if (usage == AUDIO_VOL_DOWN)    return KC__VOLDOWN;
+        if (!usage) return 0;
+        for (uint8_t i = 0; i < sizeof(consumer_usage)/sizeof(consumer_usage[0]); i++) {
+            if (pgm_read_word(&consumer_usage[i]) == usage) return KC_MEDIA_NEXT_TRACK + i;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+/* item of up to 16 bits at bit offset, LSB first */
+static uint16_t get_bits(const uint8_t *buf, uint16_t offset, uint8_t size)
+{
+    const uint8_t *p = buf + (offset >> 3);
+    uint8_t n = ((offset & 7) + size + 7) >> 3;
+    uint32_t v = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        v |= (uint32_t)p[i] << (i * 8);
+    }
+    return (v >> (offset & 7)) & ((1UL << size) - 1);
+}
+
+
+HIDReportDevice::HIDReportDevice(USB *p) :
+    HIDUniversal(p), num_fields(0), num_array_keys(0),
+    has_report_id(0), led_iface(0), led_report_id(0), next_poll(0), poll_interval(0),
+    mouse_handler(NULL), buttons(0), x(0), y(0), v(0), h(0), changed(0)
+{
+    ::memset(bitmap, 0, sizeof(bitmap));
+}
+
+void HIDReportDevice::Attach(USB *p)
+{
+    pUsb = p;
+    pUsb->RegisterDeviceClass(this);
+}
+
+bool HIDReportDevice::add_field(uint8_t iface, uint8_t page, bool variable, bool sign, uint8_t report_id,
+                                uint8_t size, uint8_t count, uint16_t offset, uint16_t usage)
+{
+    if (num_fields >= HID_REPORT_FIELDS) {
+        dprint("field: full\r\n");
+        return false;
+    }
+    if (!variable) {
+        if (count > HID_REPORT_ARRAY_KEYS - num_array_keys) count = HID_REPORT_ARRAY_KEYS - num_array_keys;
+        if (!count) {
+            dprint("field: array keys full\r\n");
+            return false;
+        }
+    }
+
+    field_t *f = &field[num_fields++];
+    f->iface = iface;
+    f->page = page;
+    f->variable = variable;
+    f->sign = sign;
+    f->report_id = report_id;
+    f->size = size;
+    f->count = count;
+    f->offset = offset;
+    f->usage = usage;
+    f->slot = num_array_keys;
+    if (!variable) {
+        ::memset(&array_keys[num_array_keys], 0, count);
+        num_array_keys += count;
+    }
+    dprintf("field: if:%d id:%02X page:%d %s %dx%d @%d usage:%04X\r\n", iface, report_id, page,
+            variable ? "var" : "ary", size, count, offset, usage);
+    return true;
+}
+
+uint8_t HIDReportDevice::OnInitSuccessful()
+{
+    uint8_t buf[64];
+
+    num_fields = 0;
+    num_array_keys = 0;
+    has_report_id = 0;
+    led_iface = LED_IFACE_NONE;
+    led_report_id = 0;
+    for (uint8_t i = 0; i < maxHidInterfaces; i++) {
+        if (!hidInterfaces[i].epIndex[epInterruptInIndex]) continue;
+
+        uint8_t n = num_fields;
+        uint8_t keys = num_array_keys;
+        ReportDescParser prs(this, i);
+        // GetReportDescr() reads only 128 bytes, NKRO descriptors are longer
+        uint8_t rcode = pUsb->ctrlReq(bAddress, 0x00, bmREQ_HID_REPORT, USB_REQUEST_GET_DESCRIPTOR, 0x00,
+                                      HID_DESCRIPTOR_REPORT, hidInterfaces[i].bmInterface, 0x200,
+                                      sizeof(buf), buf, &prs);
+        if (!rcode && num_fields != n) {
+            SetProtocol(hidInterfaces[i].bmInterface, HID_RPT_PROTOCOL);
+            continue;
+        }
+
+        // no usable field, boot keyboard and mouse still work in boot protocol
+        num_fields = n;
+        num_array_keys = keys;
+        has_report_id &= ~(1 << i);
+        if (hidInterfaces[i].bmProtocol == HID_PROTOCOL_KEYBOARD) {
+            dprintf("if:%d boot keyboard\r\n", i);
+            SetProtocol(hidInterfaces[i].bmInterface, HID_BOOT_PROTOCOL);
+            add_field(i, FIELD_KEYBOARD, true, false, 0, 1, 8, 0, 0xE0);
+            add_field(i, FIELD_KEYBOARD, false, false, 0, 8, KEYBOARD_REPORT_KEYS, 16, 0);
+        } else if (hidInterfaces[i].bmProtocol == HID_PROTOCOL_MOUSE) {
+            dprintf("if:%d boot mouse\r\n", i);
+            SetProtocol(hidInterfaces[i].bmInterface, HID_BOOT_PROTOCOL);
+            add_field(i, FIELD_BUTTON, true, false, 0, 1, 8, 0, 1);
+            add_field(i, FIELD_POINTER, true, true, 0, 8, 1, 8, USAGE_X);
+            add_field(i, FIELD_POINTER, true, true, 0, 8, 1, 16, USAGE_Y);
+        }
+    }
+    if (led_iface == LED_IFACE_NONE) led_iface = 0;
+    next_poll = 0;
+    return 0;
+}
+
+void HIDReportDevice::EndpointXtract(uint8_t conf, uint8_t iface, uint8_t alt, uint8_t proto, const USB_ENDPOINT_DESCRIPTOR *ep)
+{
+    HIDUniversal::EndpointXtract(conf, iface, alt, proto, ep);
+    if (poll_interval < ep->bInterval) poll_interval = ep->bInterval;
+}
+
+uint8_t HIDReportDevice::Release()
+{
+    // keys and buttons of removed device are released
+    num_fields = 0;
+    num_array_keys = 0;
+    poll_interval = 0;
+    ::memset(bitmap, 0, sizeof(bitmap));
+    buttons = 0;
+    x = y = v = h = 0;
+    changed = CHANGED_KEYS | CHANGED_MOUSE;
+    return HIDUniversal::Release();
+}
+
+/* HIDUniversal::Poll() stops at NAK of first interface and drops reports
+ * identical to last one of other interface, every interface is read here. */
+uint8_t HIDReportDevice::Poll()
+{
+    if (!isReady()) return 0;
+    if ((int32_t)(millis() - next_poll) < 0) return 0;
+    next_poll = millis() + poll_interval;
+
+    uint8_t buf[64];
+    for (uint8_t i = 0; i < maxHidInterfaces; i++) {
+        uint8_t index = hidInterfaces[i].epIndex[epInterruptInIndex];
+        if (!index) continue;
+
+        uint16_t read = epInfo[index].maxPktSize;
+        if (read > sizeof(buf)) read = sizeof(buf);
+        uint8_t rcode = pUsb->inTransfer(bAddress, epInfo[index].epAddr, &read, buf);
+        if (rcode) {
+            if (rcode != hrNAK) dprintf("poll if:%d: %02X\r\n", i, rcode);
+            continue;
+        }
+        decode(i, read, buf);
+    }
+    return 0;
+}
+
+void HIDReportDevice::key(uint8_t code, bool on)
+{
+    // usage 0-3 are no key and errors
+    if (code < 4) return;
+    uint8_t b = bitmap[code >> 3];
+    if (on) b |=  (1 << (code & 7));
+    else    b &= ~(1 << (code & 7));
+    if (b == bitmap[code >> 3]) return;
+    bitmap[code >> 3] = b;
+    changed |= CHANGED_KEYS;
+}
+
+void HIDReportDevice::pointer(uint16_t usage, int16_t value)
+{
+    if (!value) return;
+    int16_t *acc;
+    switch (usage) {
+    case USAGE_X:       acc = &x; break;
+    case USAGE_Y:       acc = &y; break;
+    case USAGE_WHEEL:   acc = &v; break;
+    case USAGE_AC_PAN:  acc = &h; break;
+    default: return;
+    }
+    // motion not taken yet is kept, saturated rather than wrapped
+    int32_t sum = (int32_t)*acc + value;
+    if (sum > 32767) sum = 32767;
+    if (sum < -32767) sum = -32767;
+    *acc = sum;
+    changed |= CHANGED_MOUSE;
+}
+
+void HIDReportDevice::decode(uint8_t iface, uint8_t len, const uint8_t *buf)
+{
+    uint8_t id = 0;
+    if (has_report_id & (1 << iface)) {
+        if (!len) return;
+        id = *buf++;
+        len--;
+    }
+
+    if (debug_keyboard) {
+        dprintf("input %d/%d:", GetAddress(), iface);
+        if (id) dprintf(" [%02X]", id);
+        for (uint8_t i = 0; i < len; i++) dprintf(" %02X", buf[i]);
+        dprint("\r\n");
+    }
+
+    // mouse flag of this report alone, for handler
+    uint8_t last = changed;
+    changed &= ~CHANGED_MOUSE;
+
+    for (uint8_t i = 0; i < num_fields; i++) {
+        field_t *f = &field[i];
+        if (f->iface != iface || f->report_id != id) continue;
+        // short report
+        if (f->offset + (uint16_t)f->size * f->count > (uint16_t)len * 8) continue;
+
+        if (f->page == FIELD_POINTER) {
+            uint16_t d = get_bits(buf, f->offset, f->size);
+            // sign extension
+            if (f->sign && f->size < 16 && (d & (1 << (f->size - 1)))) d |= ~((1 << f->size) - 1);
+            pointer(f->usage, d);
+            continue;
+        }
+        if (f->page == FIELD_BUTTON) {
+            uint8_t b = buttons;
+            for (uint8_t j = 0; j < f->count; j++) {
+                uint16_t u = f->usage + j;
+                if (u < 1 || u > 8) continue;
+                if (get_bits(buf, f->offset + (uint16_t)j * f->size, f->size)) b |=  (1 << (u - 1));
+                else                                                            b &= ~(1 << (u - 1));
+            }
+            if (b != buttons) {
+                buttons = b;
+                changed |= CHANGED_MOUSE;
+            }
+            continue;
+        }
+        if (f->variable) {
+            for (uint8_t j = 0; j < f->count; j++) {
+                key(usage_code(f->page, f->usage + j), get_bits(buf, f->offset + (uint16_t)j * f->size, f->size));
+            }
+            continue;
+        }
+
+        // phantom state, keys are unknown and kept as last report
+        if (f->page == FIELD_KEYBOARD) {
+            bool rollover = false;
+            for (uint8_t j = 0; j < f->count; j++) {
+                if ((uint16_t)(f->usage + get_bits(buf, f->offset + (uint16_t)j * f->size, f->size)) == KC_ROLL_OVER)
+                    rollover = true;
+            }
+            if (rollover) {
+                dprint("input: rollover\r\n");
+                continue;
+            }
+        }
+        for (uint8_t j = 0; j < f->count; j++) {
+            key(array_keys[f->slot + j], false);
+        }
+        for (uint8_t j = 0; j < f->count; j++) {
+            uint8_t code = usage_code(f->page, f->usage + get_bits(buf, f->offset + (uint16_t)j * f->size, f->size));
+            array_keys[f->slot + j] = code;
+            key(code, true);
+        }
+    }
+
+    if (!(changed & CHANGED_MOUSE)) {
+        changed |= last & CHANGED_MOUSE;
+    } else if (mouse_handler) {
+        mouse_handler(this);
+    }
+}
+
+uint8_t HIDReportDevice::SetLED(uint8_t usb_led)
+{
+    if (!isReady()) return 0;
+
+    uint8_t iface = hidInterfaces[led_iface].bmInterface;
+    if (led_report_id) {
+        uint8_t buf[2] = { led_report_id, usb_led };
+        return SetReport(0, iface, 2, led_report_id, 2, buf);
+    }
+    return SetReport(0, iface, 2, 0, 1, &usb_led);
+}
@@ -2,14 +2,107 @@
 #define PARSER_H
 
 #include "hid.h"
+#include "hiduniversal.h"
 #include "report.h"
 
 class KBDReportParser : public HIDReportParser
 {
 public:
     report_keyboard_t report;
+    // keys down in bit per usage, modifiers are at usage 0xE0-E7
+    uint8_t bitmap[32];
     uint16_t time_stamp;
     virtual void Parse(HID *hid, bool is_rpt_id, uint8_t len, uint8_t *buf);
 };
 
+
+/*
+ * Report protocol device
+ *
+ * Input fields of keyboard page, consumer page, system control usages and
+ * mouse buttons and axes are located from report descriptor of each interface
+ * at enumeration, reports are decoded into bitmap with the same layout as
+ * KBDReportParser and into mouse state. Bitmap keyboards(NKRO) keep all keys
+ * down, consumer usages are put at their 8-bit
+ * keycode(KC_SYSTEM_POWER..KC_WWW_FAVORITES) or at keyboard usage of
+ * mute/volume. Boot keyboard or mouse interface without usable field falls
+ * back to boot protocol.
+ *
+ * One class serves keyboards, mice and composite devices so that a table of
+ * them takes whatever is plugged in. Constructed without USB host it is
+ * registered later with Attach().
+ */
+#ifndef HID_REPORT_FIELDS
+#define HID_REPORT_FIELDS       12
+#endif
+#ifndef HID_REPORT_ARRAY_KEYS
+#define HID_REPORT_ARRAY_KEYS   16
+#endif
+
+class HIDReportDevice : public HIDUniversal
+{
+    friend class ReportDescParser;
+
+    struct field_t {
+        uint8_t  iface:2;
+        uint8_t  page:3;        // FIELD_*
+        uint8_t  variable:1;
+        uint8_t  sign:1;        // item is signed
+        uint8_t  report_id;
+        uint8_t  size;          // bits of an item
+        uint8_t  count;         // items
+        uint16_t offset;        // bit position in report without report id
+        uint16_t usage;         // usage of first bit, or of item value 0 in array
+        uint8_t  slot;          // of array_keys for keys of last report
+    } field[HID_REPORT_FIELDS];
+    uint8_t num_fields;
+
+    // keys of array fields in last report, as bitmap code
+    uint8_t array_keys[HID_REPORT_ARRAY_KEYS];
+    uint8_t num_array_keys;
+
+    uint8_t has_report_id;      // bit per interface
+    uint8_t led_iface;
+    uint8_t led_report_id;
+
+    uint32_t next_poll;
+    uint8_t poll_interval;
+
+    void (*mouse_handler)(HIDReportDevice *dev);
+
+    bool add_field(uint8_t iface, uint8_t page, bool variable, bool sign, uint8_t report_id,
+                   uint8_t size, uint8_t count, uint16_t offset, uint16_t usage);
+    void decode(uint8_t iface, uint8_t len, const uint8_t *buf);
+    void key(uint8_t code, bool on);
+    void pointer(uint16_t usage, int16_t value);
+
+protected:
+    virtual uint8_t OnInitSuccessful();
+
+public:
+    enum { FIELD_KEYBOARD, FIELD_CONSUMER, FIELD_SYSTEM, FIELD_BUTTON, FIELD_POINTER, FIELD_NONE };
+
+    // keys down in bit per usage, modifiers are at usage 0xE0-E7
+    uint8_t bitmap[32];
+
+    // mouse buttons and motion summed until taken by user
+    uint8_t buttons;
+    int16_t x, y, v, h;
+
+    // set on change of bitmap or mouse state, cleared by user
+    enum { CHANGED_KEYS = 1, CHANGED_MOUSE = 2 };
+    uint8_t changed;
+
+    // called at each report with mouse change to pass it through at report
+    // rate of the mouse, handler takes motion and clears CHANGED_MOUSE
+    void setMouseHandler(void (*handler)(HIDReportDevice *dev)) { mouse_handler = handler; }
+
+    HIDReportDevice(USB *p = NULL);
+    void Attach(USB *p);
+    uint8_t Release();
+    uint8_t Poll();
+    void EndpointXtract(uint8_t conf, uint8_t iface, uint8_t alt, uint8_t proto, const USB_ENDPOINT_DESCRIPTOR *ep);
+    uint8_t SetLED(uint8_t usb_led);
+};
+
 #endif
@@ -0,0 +1,123 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * USB Host Shield library for host build of parser.cpp and usb_usb.cpp
+ *
+ * Stands in for Usb.h of the library, which drives MAX3421E. hid.h and
+ * hiduniversal.h of the library are used as they are; this is included
+ * first(-include) so that they see it in place of the real one. USB plays
+ * recorded devices of bench.cpp: report descriptor of an interface comes to
+ * the parser of ctrlReq() and a report put with report() comes out of
+ * inTransfer() once, then the endpoint NAKs.
+ */
+#ifndef _usb_h_
+#define _usb_h_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "usb_ch9.h"
+#include "address.h"
+
+#define USB_NUMDEVICES      16
+#define USB_STATE_RUNNING   0x90
+#define FSHOST              2
+
+#define hrSUCCESS           0x00
+#define hrNAK               0x04
+#define hrSTALL             0x05
+
+/* interfaces of a recorded device, at address of port given to Init() */
+#define USB_FAKE_IFACES     3
+
+
+/* virtual ms, advanced by bench */
+uint32_t millis(void);
+
+
+class USBReadParser {
+public:
+    virtual void Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset) = 0;
+};
+
+class USBDeviceConfig {
+public:
+    virtual uint8_t Init(uint8_t parent, uint8_t port, bool lowspeed) { return 0; }
+    virtual uint8_t ConfigureDevice(uint8_t parent, uint8_t port, bool lowspeed) { return 0; }
+    virtual uint8_t Release() { return 0; }
+    virtual uint8_t Poll() { return 0; }
+    virtual uint8_t GetAddress() { return 0; }
+    virtual void ResetHubPort(uint8_t port) {}
+    virtual bool VIDPIDOK(uint16_t vid, uint16_t pid) { return false; }
+    virtual bool DEVCLASSOK(uint8_t klass) { return false; }
+    virtual bool DEVSUBCLASSOK(uint8_t subklass) { return true; }
+};
+
+class UsbConfigXtracter {
+public:
+    virtual void EndpointXtract(uint8_t conf, uint8_t iface, uint8_t alt, uint8_t proto, const USB_ENDPOINT_DESCRIPTOR *ep) {}
+};
+
+class USB {
+public:
+    struct fake_iface_t {
+        uint8_t protocol;           // HID_PROTOCOL_* of interface descriptor
+        const uint8_t *desc;        // report descriptor, NULL for none
+        uint16_t desc_len;
+        const uint8_t *in;          // report not read yet, NULL to NAK
+        uint8_t in_len;
+        uint8_t set_protocol;       // last SET_PROTOCOL
+    };
+    struct fake_device_t {
+        uint8_t ifaces;
+        fake_iface_t iface[USB_FAKE_IFACES];
+    } fake[USB_NUMDEVICES];
+
+    USB(void) : pfWaitHandler(NULL) { memset(devConfig, 0, sizeof(devConfig)); memset(fake, 0, sizeof(fake)); }
+
+    uint8_t RegisterDeviceClass(USBDeviceConfig *pdev) {
+        for (uint8_t i = 0; i < USB_NUMDEVICES; i++) {
+            if (!devConfig[i]) {
+                devConfig[i] = pdev;
+                return 0;
+            }
+        }
+        return 0xD9;
+    }
+    void setWaitHandler(void (*handler)(void)) { pfWaitHandler = handler; }
+    uint8_t getUsbTaskState(void) { return USB_STATE_RUNNING; }
+    uint8_t getVbusState(void) { return FSHOST; }
+    void Init(void) {}
+    void Task(void) {}
+
+    // endpoint of interface i is i + 1
+    void report(uint8_t addr, uint8_t iface, const uint8_t *buf, uint8_t len) {
+        fake[addr].iface[iface].in = buf;
+        fake[addr].iface[iface].in_len = len;
+    }
+
+    uint8_t inTransfer(uint8_t addr, uint8_t ep, uint16_t *nbytesptr, uint8_t *data);
+    uint8_t ctrlReq(uint8_t addr, uint8_t ep, uint8_t bmReqType, uint8_t bRequest, uint8_t wValLo, uint8_t wValHi,
+                    uint16_t wInd, uint16_t total, uint16_t nbytes, uint8_t *dataptr, USBReadParser *p);
+
+private:
+    USBDeviceConfig *devConfig[USB_NUMDEVICES];
+    void (*pfWaitHandler)(void);
+};
+
+#endif
@@ -0,0 +1,10 @@
+/* pgmspace of avr-libc for host build, see Usb.h */
+#ifndef __PGMSPACE_H_
+#define __PGMSPACE_H_
+
+#include <stdint.h>
+#include "progmem.h"
+
+#define PSTR(s)     (s)
+
+#endif
@@ -0,0 +1,424 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Replays recorded HID reports through HIDReportDevice(parser.cpp) and
+ * usb_usb.cpp of the converter on the build machine.
+ *
+ * Recording file: one statement per line, '#' starts a comment. Bytes are hex.
+ *   device <n>                     following statements are of device n
+ *   iface <n> <keyboard|mouse|none>  interface n and its boot protocol
+ *   desc <byte>..                  report descriptor of interface, appended
+ *   in <byte>..                    report of interface, with report id if any
+ *   keys [<code>..]                converter matrix must have just these keys
+ *   mouse <buttons> <x> <y> <v> <h>  mouse sent since last mouse statement
+ * Devices are enumerated in report protocol of descriptors, interface
+ * without desc falls back to boot protocol. A report is read at each
+ * virtual millisecond and merged into converter matrix by matrix_scan().
+ *
+ * Devices whose interfaces are all boot protocol are read by
+ * KBDReportParser as well, its bitmap must match HIDReportDevice at keys.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#else
+#   include <time.h>
+#endif
+#include "Usb.h"
+#include "parser.h"
+#include "matrix.h"
+#include "timer.h"
+#include "host.h"
+#include "keyboard.h"
+
+
+#define STEP_MAX        4096
+#define DESC_MAX        512
+#define REPORT_MAX      64
+
+enum {
+    S_IN,
+    S_KEYS,
+    S_MOUSE,
+};
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  dev;
+    uint8_t  iface;
+    uint8_t  len;
+    uint8_t  data[REPORT_MAX];  // report, or bitmap(32) of keys
+    int16_t  mouse[5];
+    uint16_t line;
+} step_t;
+
+typedef struct {
+    uint32_t reports;
+    uint32_t events;
+    uint64_t parse_cycles;
+    uint64_t merge_cycles;
+    uint32_t boot_reports;
+    uint64_t boot_cycles;
+    uint32_t failures;
+} stat_t;
+
+/* converter, see converter/usb_usb/usb_usb.cpp */
+extern USB usb_host;
+extern HIDReportDevice hid_dev[];
+#ifndef USB_HID_DEVICES
+#define USB_HID_DEVICES 4
+#endif
+
+static step_t step[STEP_MAX];
+static uint16_t step_len;
+static uint8_t desc[USB_HID_DEVICES][USB_FAKE_IFACES][DESC_MAX];
+static bool boot_device[USB_HID_DEVICES];
+static KBDReportParser kbd_parser[USB_HID_DEVICES];
+static bool verbose = false;
+
+static uint32_t now = 0;
+static uint8_t mouse_buttons;
+static int32_t mouse_sum[4];
+
+
+/* cycle counter: TSC on x86, nanoseconds elsewhere */
+static inline uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* virtual clock of library and tmk_core */
+uint32_t millis(void) { return now; }
+uint16_t timer_read(void) { return (uint16_t)now; }
+uint16_t timer_elapsed(uint16_t last) { return (uint16_t)now - last; }
+
+/* host side of converter */
+void keyboard_task(void) {}
+void keyboard_set_leds(uint8_t leds) { (void)leds; }
+uint8_t host_keyboard_leds(void) { return 0; }
+void host_mouse_move(uint8_t buttons, int16_t x, int16_t y, int16_t v, int16_t h)
+{
+    mouse_buttons = buttons;
+    mouse_sum[0] += x; mouse_sum[1] += y; mouse_sum[2] += v; mouse_sum[3] += h;
+}
+
+
+static uint8_t hex_bytes(uint8_t *buf, uint16_t size, uint16_t *len)
+{
+    char *v;
+    while ((v = strtok(NULL, " \t\r\n"))) {
+        if (*len >= size) return 1;
+        buf[(*len)++] = strtoul(v, NULL, 16);
+    }
+    return 0;
+}
+
+static int load_recording(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    char buf[1024];
+    uint16_t line = 0;
+    uint8_t dev = 0, iface = 0;
+    step_len = 0;
+    memset(usb_host.fake, 0, sizeof(usb_host.fake));
+    for (uint8_t d = 0; d < USB_HID_DEVICES; d++) boot_device[d] = true;
+    while (fgets(buf, sizeof(buf), fp)) {
+        line++;
+        char *p = strchr(buf, '#');
+        if (p) *p = '\0';
+
+        char *op = strtok(buf, " \t\r\n");
+        if (!op) continue;
+
+        // devices are at address of their port, see Init() of fake.cpp
+        USB::fake_device_t *d = &usb_host.fake[dev + 1];
+        if (!strcmp(op, "device")) {
+            char *v = strtok(NULL, " \t\r\n");
+            dev = v ? strtoul(v, NULL, 0) : USB_HID_DEVICES;
+            if (dev >= USB_HID_DEVICES) {
+                fprintf(stderr, "%s:%u: device out of range\n", path, line);
+                goto error;
+            }
+            iface = 0;
+            continue;
+        }
+        if (!strcmp(op, "iface")) {
+            char *v = strtok(NULL, " \t\r\n");
+            char *proto = strtok(NULL, " \t\r\n");
+            iface = v ? strtoul(v, NULL, 0) : USB_FAKE_IFACES;
+            if (iface >= USB_FAKE_IFACES || !proto) {
+                fprintf(stderr, "%s:%u: need interface and protocol\n", path, line);
+                goto error;
+            }
+            if (!strcmp(proto, "keyboard"))     d->iface[iface].protocol = HID_PROTOCOL_KEYBOARD;
+            else if (!strcmp(proto, "mouse"))   d->iface[iface].protocol = HID_PROTOCOL_MOUSE;
+            else                                d->iface[iface].protocol = HID_PROTOCOL_NONE;
+            if (d->ifaces <= iface) d->ifaces = iface + 1;
+            continue;
+        }
+        if (iface >= d->ifaces) {
+            fprintf(stderr, "%s:%u: no interface\n", path, line);
+            goto error;
+        }
+        if (!strcmp(op, "desc")) {
+            d->iface[iface].desc = desc[dev][iface];
+            if (hex_bytes(desc[dev][iface], DESC_MAX, &d->iface[iface].desc_len)) {
+                fprintf(stderr, "%s:%u: descriptor too long\n", path, line);
+                goto error;
+            }
+            boot_device[dev] = false;
+            continue;
+        }
+
+        if (step_len >= STEP_MAX) {
+            fprintf(stderr, "%s:%u: too many statements\n", path, line);
+            goto error;
+        }
+        step_t *s = &step[step_len];
+        memset(s, 0, sizeof(*s));
+        s->line = line;
+        s->dev = dev;
+        s->iface = iface;
+        if (!strcmp(op, "in")) {
+            uint16_t len = 0;
+            s->type = S_IN;
+            if (hex_bytes(s->data, REPORT_MAX, &len) || !len) {
+                fprintf(stderr, "%s:%u: report of 1 to %u bytes\n", path, line, REPORT_MAX);
+                goto error;
+            }
+            s->len = len;
+        } else if (!strcmp(op, "keys")) {
+            char *v;
+            s->type = S_KEYS;
+            while ((v = strtok(NULL, " \t\r\n"))) {
+                uint8_t code = strtoul(v, NULL, 16);
+                s->data[code >> 3] |= (1 << (code & 7));
+            }
+        } else if (!strcmp(op, "mouse")) {
+            s->type = S_MOUSE;
+            for (uint8_t i = 0; i < 5; i++) {
+                char *v = strtok(NULL, " \t\r\n");
+                if (!v) {
+                    fprintf(stderr, "%s:%u: mouse needs buttons, x, y, v and h\n", path, line);
+                    goto error;
+                }
+                s->mouse[i] = strtol(v, NULL, i ? 10 : 16);
+            }
+        } else {
+            fprintf(stderr, "%s:%u: unknown statement: %s\n", path, line, op);
+            goto error;
+        }
+        step_len++;
+    }
+    fclose(fp);
+    return 0;
+
+error:
+    fclose(fp);
+    return -1;
+}
+
+/* scan until all changes are queued and taken, returns events */
+static uint32_t settle(void)
+{
+    uint32_t events = 0;
+    uint8_t n;
+    do {
+        matrix_scan();
+        keyevent_t e;
+        for (n = 0; matrix_event_get(&e); n++) ;
+        events += n;
+    } while (n);
+    return events;
+}
+
+static void print_keys(const uint8_t *bitmap)
+{
+    for (uint16_t code = 0; code < 256; code++) {
+        if (bitmap[code >> 3] & (1 << (code & 7))) fprintf(stderr, " %02X", code);
+    }
+}
+
+static bool check_keys(const char *path, const step_t *s)
+{
+    uint8_t matrix[32] = {};
+    for (uint16_t code = 0; code < 256; code++) {
+        if (matrix_is_on(code >> 4, code & 0xF)) matrix[code >> 3] |= (1 << (code & 7));
+    }
+
+    bool ok = !memcmp(matrix, s->data, sizeof(matrix));
+    if (!ok) {
+        fprintf(stderr, "%s:%u: keys", path, s->line);
+        print_keys(s->data);
+        fprintf(stderr, " but");
+        print_keys(matrix);
+        fprintf(stderr, "\n");
+    }
+
+    // usages 0-3 are not keys to either parser
+    for (uint8_t d = 0; d < USB_HID_DEVICES; d++) {
+        if (!boot_device[d] || !usb_host.fake[d + 1].ifaces) continue;
+        if (memcmp(kbd_parser[d].bitmap, hid_dev[d].bitmap, sizeof(hid_dev[d].bitmap))) {
+            fprintf(stderr, "%s:%u: device %u: KBDReportParser", path, s->line, d);
+            print_keys(kbd_parser[d].bitmap);
+            fprintf(stderr, " but HIDReportDevice");
+            print_keys(hid_dev[d].bitmap);
+            fprintf(stderr, "\n");
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool check_mouse(const char *path, const step_t *s)
+{
+    bool ok = (mouse_buttons == s->mouse[0]);
+    for (uint8_t i = 0; i < 4; i++) {
+        if (mouse_sum[i] != s->mouse[i + 1]) ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "%s:%u: mouse %02X %d %d %d %d but %02X %d %d %d %d\n", path, s->line,
+                s->mouse[0], s->mouse[1], s->mouse[2], s->mouse[3], s->mouse[4],
+                mouse_buttons, mouse_sum[0], mouse_sum[1], mouse_sum[2], mouse_sum[3]);
+    }
+    memset(mouse_sum, 0, sizeof(mouse_sum));
+    return ok;
+}
+
+static void run(const char *path, stat_t *st, bool check)
+{
+    // unplug all, then enumerate devices of recording
+    for (uint8_t d = 0; d < USB_HID_DEVICES; d++) {
+        hid_dev[d].Release();
+        memset(&kbd_parser[d].report, 0, sizeof(kbd_parser[d].report));
+        memset(kbd_parser[d].bitmap, 0, sizeof(kbd_parser[d].bitmap));
+    }
+    settle();
+    for (uint8_t d = 0; d < USB_HID_DEVICES; d++) {
+        if (usb_host.fake[d + 1].ifaces) hid_dev[d].Init(0, d + 1, false);
+    }
+    mouse_buttons = 0;
+    memset(mouse_sum, 0, sizeof(mouse_sum));
+
+    for (uint16_t i = 0; i < step_len; i++) {
+        const step_t *s = &step[i];
+        switch (s->type) {
+        case S_IN: {
+            now++;
+            usb_host.report(s->dev + 1, s->iface, s->data, s->len);
+            uint64_t t0 = cycles();
+            hid_dev[s->dev].Poll();
+            uint64_t t1 = cycles();
+            st->events += settle();
+            uint64_t t2 = cycles();
+            st->parse_cycles += t1 - t0;
+            st->merge_cycles += t2 - t1;
+            st->reports++;
+
+            if (boot_device[s->dev] && usb_host.fake[s->dev + 1].iface[s->iface].protocol == HID_PROTOCOL_KEYBOARD) {
+                t0 = cycles();
+                kbd_parser[s->dev].Parse(&hid_dev[s->dev], false, s->len, (uint8_t *)s->data);
+                st->boot_cycles += cycles() - t0;
+                st->boot_reports++;
+            }
+            break;
+        }
+        case S_KEYS:
+            if (check && !check_keys(path, s)) st->failures++;
+            break;
+        case S_MOUSE:
+            if (check && !check_mouse(path, s)) st->failures++;
+            break;
+        }
+        if (verbose && check && s->type == S_IN) {
+            fprintf(stderr, "  %4u: if:%u", s->line, s->iface);
+            for (uint8_t j = 0; j < s->len; j++) fprintf(stderr, " %02X", s->data[j]);
+            fprintf(stderr, "  ->");
+            uint8_t matrix[32] = {};
+            for (uint16_t code = 0; code < 256; code++) {
+                if (matrix_is_on(code >> 4, code & 0xF)) matrix[code >> 3] |= (1 << (code & 7));
+            }
+            print_keys(matrix);
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n runs] [-v] recording...\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t runs = 1000;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            runs = strtoul(argv[++i], NULL, 0);
+            if (!runs) runs = 1;
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (i == argc) usage(argv[0]);
+
+    matrix_init();
+
+    uint32_t failures = 0;
+    printf("%-32s %8s %7s %10s %10s %10s\n",
+           "recording", "reports", "events", "cyc/parse", "cyc/merge", "cyc/boot");
+    for (; i < argc; i++) {
+        if (load_recording(argv[i]) < 0) {
+            failures++;
+            continue;
+        }
+
+        stat_t st = {};
+        for (uint32_t n = 0; n < runs; n++) {
+            run(argv[i], &st, n == 0);
+        }
+        failures += st.failures;
+
+        printf("%-32s %8u %7u %10.1f %10.1f %10.1f%s\n",
+               argv[i], st.reports / runs, st.events / runs,
+               st.reports ? (double)st.parse_cycles / st.reports : 0.0,
+               st.reports ? (double)st.merge_cycles / st.reports : 0.0,
+               st.boot_reports ? (double)st.boot_cycles / st.boot_reports : 0.0,
+               st.failures ? "  FAIL" : "");
+    }
+    return failures ? 1 : 0;
+}
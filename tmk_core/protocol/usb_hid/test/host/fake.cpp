@@ -0,0 +1,158 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * USB host and HID class of USB Host Shield library for host build, see Usb.h.
+ * HIDUniversal keeps the library header and its members, Init() takes
+ * interfaces of recorded device at address of port instead of reading
+ * descriptors of real one.
+ */
+#include <string.h>
+#include "Usb.h"
+#include "hiduniversal.h"
+
+
+uint8_t USB::inTransfer(uint8_t addr, uint8_t ep, uint16_t *nbytesptr, uint8_t *data)
+{
+    if (addr >= USB_NUMDEVICES || !ep || ep > fake[addr].ifaces) return hrSTALL;
+    fake_iface_t *f = &fake[addr].iface[ep - 1];
+    if (!f->in) return hrNAK;
+
+    uint16_t n = (f->in_len < *nbytesptr) ? f->in_len : *nbytesptr;
+    memcpy(data, f->in, n);
+    *nbytesptr = n;
+    f->in = NULL;
+    return hrSUCCESS;
+}
+
+uint8_t USB::ctrlReq(uint8_t addr, uint8_t ep, uint8_t bmReqType, uint8_t bRequest, uint8_t wValLo, uint8_t wValHi,
+                     uint16_t wInd, uint16_t total, uint16_t nbytes, uint8_t *dataptr, USBReadParser *p)
+{
+    if (addr >= USB_NUMDEVICES || wInd >= fake[addr].ifaces) return hrSTALL;
+    fake_iface_t *f = &fake[addr].iface[wInd];
+
+    if (bRequest == HID_REQUEST_SET_PROTOCOL && (bmReqType & USB_SETUP_TYPE_CLASS)) {
+        f->set_protocol = wValLo;
+        return hrSUCCESS;
+    }
+    if (bRequest != USB_REQUEST_GET_DESCRIPTOR || wValHi != HID_DESCRIPTOR_REPORT) return hrSUCCESS;
+    if (!f->desc) return hrSTALL;
+
+    // in packets of buffer size as MAX3421E gives them to parser
+    uint16_t len = (f->desc_len < total) ? f->desc_len : total;
+    for (uint16_t offset = 0; offset < len; offset += nbytes) {
+        uint16_t n = (len - offset < nbytes) ? len - offset : nbytes;
+        memcpy(dataptr, f->desc + offset, n);
+        if (p) p->Parse(n, dataptr, offset);
+    }
+    return hrSUCCESS;
+}
+
+
+uint8_t HID::SetProtocol(uint8_t iface, uint8_t protocol)
+{
+    return pUsb->ctrlReq(bAddress, 0, bmREQ_HID_OUT, HID_REQUEST_SET_PROTOCOL, protocol, 0x00,
+                         iface, 0x0000, 0x0000, NULL, NULL);
+}
+
+uint8_t HID::SetReport(uint8_t ep, uint8_t iface, uint8_t report_type, uint8_t report_id, uint16_t nbytes, uint8_t *dataptr)
+{
+    return pUsb->ctrlReq(bAddress, ep, bmREQ_HID_OUT, HID_REQUEST_SET_REPORT, report_id, report_type,
+                         iface, nbytes, nbytes, dataptr, NULL);
+}
+
+
+HIDUniversal::HIDUniversal(USB *p) : HID(p), qNextPollTime(0), pollInterval(0)
+{
+    Initialize();
+    if (pUsb) pUsb->RegisterDeviceClass(this);
+}
+
+void HIDUniversal::Initialize()
+{
+    memset(rptParsers, 0, sizeof(rptParsers));
+    memset(hidInterfaces, 0, sizeof(hidInterfaces));
+    memset(epInfo, 0, sizeof(epInfo));
+    bNumIface = 0;
+    bNumEP = 1;
+    bPollEnable = false;
+    bHasReportId = false;
+}
+
+uint8_t HIDUniversal::Init(uint8_t parent, uint8_t port, bool lowspeed)
+{
+    USB::fake_device_t *d = &pUsb->fake[port];
+    if (!d->ifaces) return hrSTALL;
+
+    Initialize();
+    bAddress = port;
+    for (uint8_t i = 0; i < d->ifaces && i < maxHidInterfaces; i++) {
+        USB_ENDPOINT_DESCRIPTOR ep = {};
+        ep.bLength = sizeof(ep);
+        ep.bDescriptorType = USB_DESCRIPTOR_ENDPOINT;
+        ep.bEndpointAddress = 0x80 | (i + 1);
+        ep.bmAttributes = USB_TRANSFER_TYPE_INTERRUPT;
+        ep.wMaxPacketSize = 64;
+        ep.bInterval = 1;
+        EndpointXtract(1, i, 0, d->iface[i].protocol, &ep);
+    }
+    bPollEnable = true;
+    return OnInitSuccessful();
+}
+
+void HIDUniversal::EndpointXtract(uint8_t conf, uint8_t iface, uint8_t alt, uint8_t proto, const USB_ENDPOINT_DESCRIPTOR *ep)
+{
+    HIDInterface *h = &hidInterfaces[bNumIface++];
+    h->bmInterface = iface;
+    h->bmAltSet = alt;
+    h->bmProtocol = proto;
+    h->epIndex[epInterruptInIndex] = bNumEP;
+    epInfo[bNumEP].epAddr = ep->bEndpointAddress & 0x0F;
+    epInfo[bNumEP].maxPktSize = ep->wMaxPacketSize;
+    bNumEP++;
+}
+
+uint8_t HIDUniversal::Release()
+{
+    Initialize();
+    bAddress = 0;
+    return 0;
+}
+
+uint8_t HIDUniversal::Poll()
+{
+    return 0;
+}
+
+HIDReportParser *HIDUniversal::GetReportParser(uint8_t id)
+{
+    for (uint8_t i = 0; i < MAX_REPORT_PARSERS; i++) {
+        if (rptParsers[i].rptParser && rptParsers[i].rptId == id) return rptParsers[i].rptParser;
+    }
+    return NULL;
+}
+
+bool HIDUniversal::SetReportParser(uint8_t id, HIDReportParser *prs)
+{
+    for (uint8_t i = 0; i < MAX_REPORT_PARSERS; i++) {
+        if (!rptParsers[i].rptParser) {
+            rptParsers[i].rptId = id;
+            rptParsers[i].rptParser = prs;
+            return true;
+        }
+    }
+    return false;
+}
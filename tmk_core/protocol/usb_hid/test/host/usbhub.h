@@ -0,0 +1,37 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Hub of USB Host Shield library for host build, see Usb.h.
+ * Registers only, recorded devices are not behind hub.
+ */
+#ifndef __USBHUB_H__
+#define __USBHUB_H__
+
+#include "Usb.h"
+
+class USBHub : USBDeviceConfig {
+    USB *pUsb;
+
+public:
+    USBHub(USB *p = NULL) : pUsb(p) {}
+    void Attach(USB *p) {
+        pUsb = p;
+        pUsb->RegisterDeviceClass(this);
+    }
+};
+
+#endif
@@ -96,10 +96,13 @@ int main(void)
 
             // TODO: configuration process is incosistent. it sometime fails.
             // To prevent failing to configure NOT scan keyboard during configuration
+            // With KEYBOARD_TASK_SLICE this is a slice of scan pass and
+            // usbPoll() runs between slices.
             if (usbConfiguration && usbInterruptIsReady()) {
                 keyboard_task();
             }
             vusb_transfer_keyboard();
+            vusb_transfer_mouse_extra();
         } else if (suspend_wakeup_condition()) {
             usb_remote_wakeup();
         }
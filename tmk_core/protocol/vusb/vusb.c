@@ -16,24 +16,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
+#include <string.h>
 #include "usbdrv.h"
 #include "usbconfig.h"
 #include "host.h"
 #include "report.h"
+#include "report_desc.h"
 #include "print.h"
 #include "debug.h"
 #include "host_driver.h"
 #include "vusb.h"
+#include "bench_gpio.h"
+#include "telemetry.h"
+#include "timer.h"
+#include "action_util.h"
 
 
 static uint8_t vusb_keyboard_leds = 0;
 static uint8_t vusb_idle_rate = 0;
-
-/* Keyboard report send buffer */
-#define KBUF_SIZE 16
-static report_keyboard_t kbuf[KBUF_SIZE];
-static uint8_t kbuf_head = 0;
-static uint8_t kbuf_tail = 0;
+#ifdef NKRO_ENABLE
+uint8_t keyboard_protocol = 1;
+#endif
 
 typedef struct {
         uint8_t modifier;
@@ -41,7 +44,13 @@ typedef struct {
         uint8_t keycode[6];
 } keyboard_report_t;
 
-static keyboard_report_t keyboard_report; // sent to PC
+/* Keyboard report send buffer, boot report part of report_keyboard_t */
+#define KBUF_SIZE 16
+static keyboard_report_t kbuf[KBUF_SIZE];
+static uint8_t kbuf_head = 0;
+static uint8_t kbuf_tail = 0;
+
+static keyboard_report_t boot_report; // sent to PC
 
 /* transfer keyboard report from buffer */
 void vusb_transfer_keyboard(void)
@@ -49,6 +58,7 @@ void vusb_transfer_keyboard(void)
     if (usbInterruptIsReady()) {
         if (kbuf_head != kbuf_tail) {
             usbSetInterrupt((void *)&kbuf[kbuf_tail], sizeof(report_keyboard_t));
+            BENCH_GPIO_REPORT();
             kbuf_tail = (kbuf_tail + 1) % KBUF_SIZE;
             if (debug_keyboard) {
                 print("V-USB: kbuf["); pdec(kbuf_tail); print("->"); pdec(kbuf_head); print("](");
@@ -68,13 +78,15 @@ static void send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
+static bool extra_ready(void);
 
 static host_driver_t driver = {
         keyboard_leds,
         send_keyboard,
         send_mouse,
         send_system,
-        send_consumer
+        send_consumer,
+        extra_ready
 };
 
 host_driver_t *vusb_driver(void)
@@ -86,14 +98,25 @@ static uint8_t keyboard_leds(void) {
     return vusb_keyboard_leds;
 }
 
+#ifdef NKRO_ENABLE
+static void send_nkro(report_keyboard_t *report);
+#endif
+
 static void send_keyboard(report_keyboard_t *report)
 {
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        send_nkro(report);
+        return;
+    }
+#endif
     uint8_t next = (kbuf_head + 1) % KBUF_SIZE;
     if (next != kbuf_tail) {
-        kbuf[kbuf_head] = *report;
+        memcpy(&kbuf[kbuf_head], report, sizeof(keyboard_report_t));
         kbuf_head = next;
     } else {
         debug("kbuf: full\n");
+        TELEMETRY_COUNT(TELEMETRY_REPORT_LOST);
     }
 
     // NOTE: send key strokes of Macro
@@ -107,22 +130,154 @@ typedef struct {
     report_mouse_t report;
 } __attribute__ ((packed)) vusb_mouse_report_t;
 
+typedef struct {
+    uint8_t  report_id;
+    uint16_t usage;
+} __attribute__ ((packed)) report_extra_t;
+
+#ifdef NKRO_ENABLE
+/*
+ * NKRO on low speed endpoint
+ *
+ * Interrupt transfer of low speed device is 8 bytes, so report_keyboard_t
+ * is split into segments of 7 bytes and each goes with its own report ID
+ * from REPORT_ID_NKRO on endpoint 3. Host keeps state of each report ID, only
+ * segments changed since last one queued are sent and a key change costs
+ * one transfer. Modifiers are first byte of segment 0.
+ */
+#   if !USB_CFG_HAVE_INTRIN_ENDPOINT3
+#       error "NKRO_ENABLE of V-USB needs USB_CFG_HAVE_INTRIN_ENDPOINT3"
+#   endif
+#   define NKRO_SEGMENT_SIZE   7
+#   define NKRO_SEGMENTS       (KEYBOARD_REPORT_SIZE / NKRO_SEGMENT_SIZE)
+#   if KEYBOARD_REPORT_SIZE % NKRO_SEGMENT_SIZE || REPORT_ID_NKRO + NKRO_SEGMENTS - 1 > 6
+#       error "KEYBOARD_REPORT_SIZE of V-USB must be segments of 7 bytes"
+#   endif
+/* ms to wait for room in ebuf, polling USB meanwhile */
+#   define NKRO_TIMEOUT        20
+
+typedef struct {
+    uint8_t report_id;
+    uint8_t bits[NKRO_SEGMENT_SIZE];
+} __attribute__ ((packed)) vusb_nkro_report_t;
+#endif
+
+/* Mouse, extra and NKRO report send buffer of interrupt endpoint 3
+ * Motion of consecutive mouse reports with same buttons is merged into the
+ * last queued one, so that it is not lost while host has not read it yet. */
+#ifdef NKRO_ENABLE
+#   define EBUF_SIZE 8
+#else
+#   define EBUF_SIZE 4
+#endif
+typedef union {
+    uint8_t report_id;
+    vusb_mouse_report_t mouse;
+    report_extra_t extra;
+#ifdef NKRO_ENABLE
+    vusb_nkro_report_t nkro;
+#endif
+} ebuf_report_t;
+static ebuf_report_t ebuf[EBUF_SIZE];
+static uint8_t ebuf_head = 0;
+static uint8_t ebuf_tail = 0;
+
+/* transfer mouse and extra report from buffer */
+void vusb_transfer_mouse_extra(void)
+{
+    if (usbInterruptIsReady3()) {
+        if (ebuf_head != ebuf_tail) {
+            ebuf_report_t *r = &ebuf[ebuf_tail];
+            uint8_t len = sizeof(report_extra_t);
+            if (r->report_id == REPORT_ID_MOUSE) len = sizeof(vusb_mouse_report_t);
+#ifdef NKRO_ENABLE
+            if (r->report_id >= REPORT_ID_NKRO) len = sizeof(vusb_nkro_report_t);
+#endif
+            usbSetInterrupt3((void *)r, len);
+            ebuf_tail = (ebuf_tail + 1) % EBUF_SIZE;
+        }
+    }
+}
+
+static int8_t mouse_add(int8_t a, int8_t b)
+{
+    int16_t v = a + b;
+    if (v > 127) return 127;
+    if (v < -127) return -127;
+    return v;
+}
+
+static void ebuf_put(ebuf_report_t *report)
+{
+    uint8_t next = (ebuf_head + 1) % EBUF_SIZE;
+    if (next != ebuf_tail) {
+        ebuf[ebuf_head] = *report;
+        ebuf_head = next;
+    } else {
+        debug("ebuf: full\n");
+    }
+    vusb_transfer_mouse_extra();
+}
+
 static void send_mouse(report_mouse_t *report)
 {
-    vusb_mouse_report_t r = {
+    if (ebuf_head != ebuf_tail) {
+        vusb_mouse_report_t *last = &ebuf[(ebuf_head + EBUF_SIZE - 1) % EBUF_SIZE].mouse;
+        if (last->report_id == REPORT_ID_MOUSE && last->report.buttons == report->buttons) {
+            last->report.x = mouse_add(last->report.x, report->x);
+            last->report.y = mouse_add(last->report.y, report->y);
+            last->report.v = mouse_add(last->report.v, report->v);
+            last->report.h = mouse_add(last->report.h, report->h);
+            vusb_transfer_mouse_extra();
+            return;
+        }
+    }
+
+    ebuf_report_t r = { .mouse = {
         .report_id = REPORT_ID_MOUSE,
         .report = *report
-    };
-    if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&r, sizeof(vusb_mouse_report_t));
-    }
+    }};
+    ebuf_put(&r);
 }
 
+#ifdef NKRO_ENABLE
+static void send_nkro(report_keyboard_t *report)
+{
+    static report_keyboard_t sent = {};
+    static uint8_t stale = 0;   // segments which couldn't be queued
+
+    for (uint8_t s = 0; s < NKRO_SEGMENTS; s++) {
+        uint8_t *bits = &report->raw[s * NKRO_SEGMENT_SIZE];
+        uint8_t *last = &sent.raw[s * NKRO_SEGMENT_SIZE];
+        if (!(stale & (1<<s)) && !memcmp(bits, last, NKRO_SEGMENT_SIZE)) continue;
+
+        uint16_t t = timer_read();
+        while ((ebuf_head + 1) % EBUF_SIZE == ebuf_tail && timer_elapsed(t) < NKRO_TIMEOUT) {
+            usbPoll();
+            vusb_transfer_mouse_extra();
+        }
+        if ((ebuf_head + 1) % EBUF_SIZE == ebuf_tail) {
+            debug("ebuf: full\n");
+            TELEMETRY_COUNT(TELEMETRY_REPORT_LOST);
+            stale |= (1<<s);
+            continue;
+        }
+        ebuf_report_t r = { .nkro = { .report_id = REPORT_ID_NKRO + s } };
+        memcpy(r.nkro.bits, bits, NKRO_SEGMENT_SIZE);
+        memcpy(last, bits, NKRO_SEGMENT_SIZE);
+        stale &= ~(1<<s);
+        ebuf_put(&r);
+    }
+    BENCH_GPIO_REPORT();
+}
+#endif
 
-typedef struct {
-    uint8_t  report_id;
-    uint16_t usage;
-} __attribute__ ((packed)) report_extra_t;
+/* room in ebuf, otherwise host queues system and consumer reports */
+static bool extra_ready(void)
+{
+    vusb_transfer_mouse_extra();
+    return (ebuf_head + 1) % EBUF_SIZE != ebuf_tail;
+}
 
 static void send_system(uint16_t data)
 {
@@ -130,13 +285,11 @@ static void send_system(uint16_t data)
     if (data == last_data) return;
     last_data = data;
 
-    report_extra_t report = {
+    ebuf_report_t r = { .extra = {
         .report_id = REPORT_ID_SYSTEM,
         .usage = data
-    };
-    if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&report, sizeof(report));
-    }
+    }};
+    ebuf_put(&r);
 }
 
 static void send_consumer(uint16_t data)
@@ -145,13 +298,11 @@ static void send_consumer(uint16_t data)
     if (data == last_data) return;
     last_data = data;
 
-    report_extra_t report = {
+    ebuf_report_t r = { .extra = {
         .report_id = REPORT_ID_CONSUMER,
         .usage = data
-    };
-    if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&report, sizeof(report));
-    }
+    }};
+    ebuf_put(&r);
 }
 
 
@@ -175,8 +326,8 @@ usbRequest_t    *rq = (void *)data;
         if(rq->bRequest == USBRQ_HID_GET_REPORT){
             debug("GET_REPORT:");
             /* we only have one report type, so don't look at wValue */
-            usbMsgPtr = (void *)&keyboard_report;
-            return sizeof(keyboard_report);
+            usbMsgPtr = (void *)&boot_report;
+            return sizeof(boot_report);
         }else if(rq->bRequest == USBRQ_HID_GET_IDLE){
             debug("GET_IDLE: ");
             //debug_hex(vusb_idle_rate);
@@ -186,6 +337,23 @@ usbRequest_t    *rq = (void *)data;
             vusb_idle_rate = rq->wValue.bytes[1];
             debug("SET_IDLE: ");
             debug_hex(vusb_idle_rate);
+#ifdef NKRO_ENABLE
+        }else if(rq->bRequest == USBRQ_HID_GET_PROTOCOL){
+            debug("GET_PROTOCOL: ");
+            usbMsgPtr = &keyboard_protocol;
+            return 1;
+        }else if(rq->bRequest == USBRQ_HID_SET_PROTOCOL){
+            // boot protocol host(BIOS) reads only boot keyboard interface.
+            // This runs in usbPoll() which sending report calls, so keys
+            // are dropped from report without sending it.
+            if (rq->wIndex.word == 0) {
+                keyboard_protocol = rq->wValue.bytes[0];
+                keyboard_nkro = !!keyboard_protocol;
+                clear_keys();
+            }
+            debug("SET_PROTOCOL: ");
+            debug_hex(keyboard_protocol);
+#endif
         }else if(rq->bRequest == USBRQ_HID_SET_REPORT){
             debug("SET_REPORT: ");
             // Report Type: 0x02(Out)/ReportID: 0x00(none) && Interface: 0(keyboard)
@@ -217,6 +385,7 @@ uchar usbFunctionWrite(uchar *data, uchar len)
             debug_hex(data[0]);
             debug("\n");
             vusb_keyboard_leds = data[0];
+            host_keyboard_leds_changed();
             last_req.len = 0;
             return 1;
             break;
@@ -240,38 +409,7 @@ uchar usbFunctionWrite(uchar *data, uchar len)
  * from an example in HID spec appendix
  */
 const PROGMEM uchar keyboard_hid_report[] = {
-    0x05, 0x01,          // Usage Page (Generic Desktop),
-    0x09, 0x06,          // Usage (Keyboard),
-    0xA1, 0x01,          // Collection (Application),
-    0x75, 0x01,          //   Report Size (1),
-    0x95, 0x08,          //   Report Count (8),
-    0x05, 0x07,          //   Usage Page (Key Codes),
-    0x19, 0xE0,          //   Usage Minimum (224),
-    0x29, 0xE7,          //   Usage Maximum (231),
-    0x15, 0x00,          //   Logical Minimum (0),
-    0x25, 0x01,          //   Logical Maximum (1),
-    0x81, 0x02,          //   Input (Data, Variable, Absolute), ;Modifier byte
-    0x95, 0x01,          //   Report Count (1),
-    0x75, 0x08,          //   Report Size (8),
-    0x81, 0x03,          //   Input (Constant),                 ;Reserved byte
-    0x95, 0x05,          //   Report Count (5),
-    0x75, 0x01,          //   Report Size (1),
-    0x05, 0x08,          //   Usage Page (LEDs),
-    0x19, 0x01,          //   Usage Minimum (1),
-    0x29, 0x05,          //   Usage Maximum (5),
-    0x91, 0x02,          //   Output (Data, Variable, Absolute), ;LED report
-    0x95, 0x01,          //   Report Count (1),
-    0x75, 0x03,          //   Report Size (3),
-    0x91, 0x03,          //   Output (Constant),                 ;LED report padding
-    0x95, 0x06,          //   Report Count (6),
-    0x75, 0x08,          //   Report Size (8),
-    0x15, 0x00,          //   Logical Minimum (0),
-    0x26, 0xFF, 0x00,    //   Logical Maximum(255),
-    0x05, 0x07,          //   Usage Page (Key Codes),
-    0x19, 0x00,          //   Usage Minimum (0),
-    0x29, 0xFF,          //   Usage Maximum (255),
-    0x81, 0x00,          //   Input (Data, Array),
-    0xc0                 // End Collection
+    HID_DESC_KEYBOARD(KEYBOARD_REPORT_KEYS)
 };
 
 /*
@@ -283,79 +421,38 @@ const PROGMEM uchar keyboard_hid_report[] = {
  * http://www.microsoft.com/whdc/device/input/wheel.mspx
  */
 const PROGMEM uchar mouse_hid_report[] = {
-    /* mouse */
-    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
-    0x09, 0x02,                    // USAGE (Mouse)
-    0xa1, 0x01,                    // COLLECTION (Application)
-    0x85, REPORT_ID_MOUSE,         //   REPORT_ID (1)
-    0x09, 0x01,                    //   USAGE (Pointer)
-    0xa1, 0x00,                    //   COLLECTION (Physical)
-                                   // ----------------------------  Buttons
-    0x05, 0x09,                    //     USAGE_PAGE (Button)
-    0x19, 0x01,                    //     USAGE_MINIMUM (Button 1)
-    0x29, 0x05,                    //     USAGE_MAXIMUM (Button 5)
-    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
-    0x25, 0x01,                    //     LOGICAL_MAXIMUM (1)
-    0x75, 0x01,                    //     REPORT_SIZE (1)
-    0x95, 0x05,                    //     REPORT_COUNT (5)
-    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
-    0x75, 0x03,                    //     REPORT_SIZE (3)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x03,                    //     INPUT (Cnst,Var,Abs)
-                                   // ----------------------------  X,Y position
-    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
-    0x09, 0x30,                    //     USAGE (X)
-    0x09, 0x31,                    //     USAGE (Y)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x02,                    //     REPORT_COUNT (2)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
-                                   // ----------------------------  Vertical wheel
-    0x09, 0x38,                    //     USAGE (Wheel)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x35, 0x00,                    //     PHYSICAL_MINIMUM (0)        - reset physical
-    0x45, 0x00,                    //     PHYSICAL_MAXIMUM (0)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
-                                   // ----------------------------  Horizontal wheel
-    0x05, 0x0c,                    //     USAGE_PAGE (Consumer Devices)
-    0x0a, 0x38, 0x02,              //     USAGE (AC Pan)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
-    0xc0,                          //   END_COLLECTION
-    0xc0,                          // END_COLLECTION
-    /* system control */
-    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
-    0x09, 0x80,                    // USAGE (System Control)
-    0xa1, 0x01,                    // COLLECTION (Application)
-    0x85, REPORT_ID_SYSTEM,        //   REPORT_ID (2)
-    0x15, 0x01,                    //   LOGICAL_MINIMUM (0x1)
-    0x26, 0xb7, 0x00,              //   LOGICAL_MAXIMUM (0xb7)
-    0x19, 0x01,                    //   USAGE_MINIMUM (0x1)
-    0x29, 0xb7,                    //   USAGE_MAXIMUM (0xb7)
-    0x75, 0x10,                    //   REPORT_SIZE (16)
-    0x95, 0x01,                    //   REPORT_COUNT (1)
-    0x81, 0x00,                    //   INPUT (Data,Array,Abs)
-    0xc0,                          // END_COLLECTION
-    /* consumer */
-    0x05, 0x0c,                    // USAGE_PAGE (Consumer Devices)
-    0x09, 0x01,                    // USAGE (Consumer Control)
-    0xa1, 0x01,                    // COLLECTION (Application)
-    0x85, REPORT_ID_CONSUMER,      //   REPORT_ID (3)
-    0x15, 0x01,                    //   LOGICAL_MINIMUM (0x1)
-    0x26, 0x9c, 0x02,              //   LOGICAL_MAXIMUM (0x29c)
-    0x19, 0x01,                    //   USAGE_MINIMUM (0x1)
-    0x2a, 0x9c, 0x02,              //   USAGE_MAXIMUM (0x29c)
-    0x75, 0x10,                    //   REPORT_SIZE (16)
-    0x95, 0x01,                    //   REPORT_COUNT (1)
-    0x81, 0x00,                    //   INPUT (Data,Array,Abs)
-    0xc0,                          // END_COLLECTION
+    HID_DESC_MOUSE_ID(REPORT_ID_MOUSE),
+    HID_DESC_EXTRAKEY,
+#ifdef NKRO_ENABLE
+    /* segments of NKRO bitmap, modifiers and usage 0-47, 48-103, 104-159 */
+    0x05, 0x01,          /* Usage Page (Generic Desktop), */
+    0x09, 0x06,          /* Usage (Keyboard), */
+    0xA1, 0x01,          /* Collection (Application), */
+    0x85, REPORT_ID_NKRO,    /* Report ID, */
+    0x75, 0x01,          /*   Report Size (1), */
+    0x95, 0x08,          /*   Report Count (8), */
+    0x05, 0x07,          /*   Usage Page (Key Codes), */
+    0x19, 0xE0,          /*   Usage Minimum (224), */
+    0x29, 0xE7,          /*   Usage Maximum (231), */
+    0x15, 0x00,          /*   Logical Minimum (0), */
+    0x25, 0x01,          /*   Logical Maximum (1), */
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), ;Modifier byte */
+    0x95, 48,            /*   Report Count (48), */
+    0x19, 0,             /*   Usage Minimum (0), */
+    0x29, 47,            /*   Usage Maximum (47), */
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), */
+    0x85, REPORT_ID_NKRO + 1,    /* Report ID, */
+    0x95, 56,            /*   Report Count (56), */
+    0x19, 48,            /*   Usage Minimum (48), */
+    0x29, 103,           /*   Usage Maximum (103), */
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), */
+    0x85, REPORT_ID_NKRO + 2,    /* Report ID, */
+    0x95, 56,            /*   Report Count (56), */
+    0x19, 104,           /*   Usage Minimum (104), */
+    0x29, 159,           /*   Usage Maximum (159), */
+    0x81, 0x02,          /*   Input (Data, Variable, Absolute), */
+    0xC0                 /* End Collection */
+#endif
 };
 
 
@@ -23,5 +23,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 host_driver_t *vusb_driver(void);
 void vusb_transfer_keyboard(void);
+void vusb_transfer_mouse_extra(void);
 
 #endif
@@ -65,7 +65,14 @@ POSSIBILITY OF SUCH DAMAGE.
 } while (0)
 
 
+/*
+ * xt_host_recv() returns decoded code, 0 when nothing is received.
+ * Bit 7 is set on break. E0-escaped keys and Pause(E1 sequence) are moved into
+ * code area unused by XT keyboard in ISR, so that a multi-byte key comes as
+ * one code stamped with time of its last byte. Fake shifts are dropped.
+ */
 void xt_host_init(void);
 uint8_t xt_host_recv(void);
+uint16_t xt_host_recv_time(void);
 
 #endif
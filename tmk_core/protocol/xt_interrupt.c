@@ -39,11 +39,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdbool.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
-#include "pbuff.h"
+#include "spsc_queue.h"
 #include "xt.h"
 #include "wait.h"
 #include "print.h"
 
+
+SPSC_STAMPED_QUEUE(pbuf, uint8_t, 32)
+
 void xt_host_init(void)
 {
     XT_INT_INIT();
@@ -66,6 +69,94 @@ void xt_host_init(void)
     XT_INT_ON();
 }
 
+// convert E0-escaped codes into unused area
+static uint8_t move_e0code(uint8_t code)
+{
+    switch(code) {
+        // Original IBM XT keyboard has these keys
+        case 0x37: return 0x54; // Print Screen
+        case 0x46: return 0x55; // Ctrl + Pause
+        case 0x1C: return 0x6F; // Keypad Enter
+        case 0x35: return 0x7F; // Keypad /
+
+        // Any XT keyobard with these keys?
+        // http://download.microsoft.com/download/1/6/1/161ba512-40e2-4cc9-843a-923143f3456c/translate.pdf
+        // https://download.microsoft.com/download/1/6/1/161ba512-40e2-4cc9-843a-923143f3456c/scancode.doc
+        case 0x5B: return 0x5A; // Left  GUI
+        case 0x5C: return 0x5B; // Right GUI
+        case 0x5D: return 0x5C; // Application
+        case 0x5E: return 0x5D; // Power(not used)
+        case 0x5F: return 0x5E; // Sleep(not used)
+        case 0x63: return 0x5F; // Wake (not used)
+        case 0x48: return 0x60; // Up
+        case 0x4B: return 0x61; // Left
+        case 0x50: return 0x62; // Down
+        case 0x4D: return 0x63; // Right
+        case 0x52: return 0x71; // Insert
+        case 0x53: return 0x72; // Delete
+        case 0x47: return 0x74; // Home
+        case 0x4F: return 0x75; // End
+        case 0x49: return 0x77; // Home
+        case 0x51: return 0x78; // End
+        case 0x1D: return 0x7A; // Right Ctrl
+        case 0x38: return 0x7C; // Right Alt
+    }
+    return 0x00;
+}
+
+/* E0/E1 prefixed sequence into a code, 0 while sequence continues */
+static uint8_t decode(uint8_t data)
+{
+    static enum {
+        INIT,
+        E0,
+        // Pause: E1 1D 45, E1 9D C5
+        E1,
+        E1_1D,
+        E1_9D,
+    } state = INIT;
+
+    uint8_t code = 0;
+    switch (state) {
+        case INIT:
+            switch (data) {
+                case 0xE0: state = E0; break;
+                case 0xE1: state = E1; break;
+                default:   code = data; break;
+            }
+            break;
+        case E0:
+            switch (data & 0x7F) {
+                case 0x2A:
+                case 0x36:
+                    // ignore fake shift
+                    break;
+                default:
+                    code = move_e0code(data & 0x7F);
+                    if (code) code |= (data & 0x80);
+                    break;
+            }
+            state = INIT;
+            break;
+        case E1:
+            switch (data) {
+                case 0x1D: state = E1_1D; break;
+                case 0x9D: state = E1_9D; break;
+                default:   state = INIT; break;
+            }
+            break;
+        case E1_1D:
+            if ((data & 0x7F) == 0x45) code = 0x55;
+            state = INIT;
+            break;
+        case E1_9D:
+            if ((data & 0x7F) == 0x45) code = 0x55 | 0x80;
+            state = INIT;
+            break;
+    }
+    return code;
+}
+
 /* get data received by interrupt */
 uint8_t xt_host_recv(void)
 {
@@ -76,6 +167,12 @@ uint8_t xt_host_recv(void)
     }
 }
 
+/* time(timer_read()) when last byte of the code got by xt_host_recv() came */
+uint16_t xt_host_recv_time(void)
+{
+    return pbuf_time;
+}
+
 ISR(XT_INT_VECT)
 {
     /*
@@ -111,7 +208,8 @@ ISR(XT_INT_VECT)
             break;
     }
     if (state++ == BIT7) {
-        pbuf_enqueue(data);
+        uint8_t code = decode(data);
+        if (code) pbuf_enqueue(code);
         state = START;
         data = 0;
     }
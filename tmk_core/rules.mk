@@ -329,6 +329,10 @@ MSG_COMPILING_CPP = Compiling C++:
 MSG_ASSEMBLING = Assembling:
 MSG_CLEANING = Cleaning project:
 MSG_CREATING_LIBRARY = Creating library:
+MSG_KEYMAP_PACK = Packing keymap:
+MSG_LEADER_TRIE = Building leader trie:
+MSG_MACRO_PACK = Packing macros:
+MSG_KEYMAP_IMAGE = Keymap image:
 
 
 
@@ -399,6 +403,19 @@ sizeafter:
 	@if test -f $(TARGET).elf; then echo; echo $(MSG_SIZE_AFTER); $(ELFSIZE); \
 	2>/dev/null; echo; fi
 
+# Static RAM of each object from map file, see tool/ram_usage
+ram: $(TARGET).elf
+	@echo
+	@echo "Static RAM(bytes):"
+	@awk -f $(TMK_DIR)/tool/ram_usage/ram_usage.awk $(TARGET).map | sort -rn
+
+# Histogram of sampling profiler per function, see tool/profile
+PROFILE_LOG ?= profile.log
+profile: $(TARGET).elf
+	@echo
+	@echo "Profile samples:"
+	@$(NM) -n $(TARGET).elf | awk -f $(TMK_DIR)/tool/profile/profile.awk - $(PROFILE_LOG) | sort -rn
+
 
 
 # Display compiler version information.
@@ -500,11 +517,44 @@ extcoff: $(TARGET).elf
 
 
 
+# Keymap section: header of keymap image is sealed with checksum in hex and
+# keymap alone can be made into image to patch firmware hex, see
+# common/keymap_image.h
+ifeq (yes,$(strip $(KEYMAP_SECTION_ENABLE)))
+HOSTCC ?= cc
+KEYMAP_IMAGE_TOOL = $(OBJDIR)/keymap_image
+
+$(KEYMAP_IMAGE_TOOL): $(TMK_DIR)/tool/keymap_image/keymap_image.c
+	@echo
+	mkdir -p $(@D)
+	$(HOSTCC) -O2 -o $@ $<
+
+# fn_actions and keymaps dumped from objects, no link: make keymap_image
+keymap_image: $(TARGET)_keymap.bin
+
+$(TARGET)_keymap.bin: $(OBJ) $(KEYMAP_IMAGE_TOOL)
+	@echo
+	@echo $(MSG_KEYMAP_IMAGE) $@
+	set -- `echo 'KEYMAP_IMAGE_ROWS KEYMAP_IMAGE_COLS KEYMAP_IMAGE_WIDTH' | \
+		$(CC) -E -P -x c $(ALL_CFLAGS) -include keymap_image.h - | tail -n 1` && \
+	for o in $(OBJ); do \
+		$(OBJCOPY) -O binary -j .keymap.fn_actions $$o $@.tmp && cat $@.tmp || exit 1; \
+	done > $@.fn && \
+	for o in $(OBJ); do \
+		$(OBJCOPY) -O binary -j .keymap.keymaps $$o $@.tmp && cat $@.tmp || exit 1; \
+	done > $@.km && \
+	$(KEYMAP_IMAGE_TOOL) build $$1 $$2 $$3 $@.fn $@.km $@ || { rm -f $@; exit 1; }
+	rm -f $@.tmp $@.fn $@.km
+endif
+
 # Create final output files (.hex, .eep) from ELF output file.
-%.hex: %.elf
+%.hex: %.elf $(KEYMAP_IMAGE_TOOL)
 	@echo
 	@echo $(MSG_FLASH) $@
 	$(OBJCOPY) -O $(FORMAT) -R .eeprom -R .fuse -R .lock -R .signature $< $@
+ifeq (yes,$(strip $(KEYMAP_SECTION_ENABLE)))
+	$(KEYMAP_IMAGE_TOOL) seal $@
+endif
 
 %.eep: %.elf
 	@echo
@@ -552,6 +602,89 @@ $(OBJDIR)/%.o : %.c
 	$(CC) -c $(ALL_CFLAGS) $< -o $@ 
 
 
+# Packed keymap: keymaps[] is dumped from objects and converted by host tool
+ifeq (yes,$(strip $(KEYMAP_PACK_ENABLE)))
+HOSTCC ?= cc
+KEYMAP_PACK_TOOL = $(OBJDIR)/keymap_pack
+KEYMAP_PACK_DATA = $(OBJDIR)/keymap_pack_data.h
+KEYMAP_PACK_OBJ = $(OBJDIR)/$(COMMON_DIR)/keymap_pack.o
+# objects made from generated data hold none of it, out of each dump to keep rules acyclic
+KEYMAP_PACK_SRC_OBJ = $(filter-out $(KEYMAP_PACK_OBJ) $(LEADER_TRIE_OBJ) $(MACRO_PACK_OBJ),$(OBJ))
+KEYMAP_PACK_SECTION ?= .progmem.data
+ALL_CFLAGS += -I$(OBJDIR)
+
+$(KEYMAP_PACK_TOOL): $(TMK_DIR)/tool/keymap_pack/keymap_pack.c
+	@echo
+	mkdir -p $(@D)
+	$(HOSTCC) -O2 -o $@ $<
+
+# shape of keymap from keymap_pack.h: rows cols width symbol
+$(KEYMAP_PACK_DATA): $(KEYMAP_PACK_SRC_OBJ) $(KEYMAP_PACK_TOOL)
+	@echo
+	@echo $(MSG_KEYMAP_PACK) $@
+	set -- `echo 'KEYMAP_PACK_ROWS KEYMAP_PACK_COLS KEYMAP_PACK_WIDTH KEYMAP_PACK_SYMBOL' | \
+		$(CC) -E -P -x c $(ALL_CFLAGS) -include keymap_pack.h - | tail -n 1` && \
+	for o in $(KEYMAP_PACK_SRC_OBJ); do \
+		$(OBJCOPY) -O binary -j $(KEYMAP_PACK_SECTION).$$4 $$o $@.tmp && cat $@.tmp || exit 1; \
+	done > $@.bin && \
+	$(KEYMAP_PACK_TOOL) $$1 $$2 $$3 $@.bin > $@ || { rm -f $@; exit 1; }
+
+$(KEYMAP_PACK_OBJ): $(KEYMAP_PACK_DATA)
+endif
+
+# Leader key: trie of leader_sequences[] dumped from objects is made by host tool
+ifeq (yes,$(strip $(LEADER_ENABLE)))
+HOSTCC ?= cc
+LEADER_TRIE_TOOL = $(OBJDIR)/leader_trie
+LEADER_TRIE_DATA = $(OBJDIR)/leader_trie_data.h
+LEADER_TRIE_OBJ = $(OBJDIR)/$(COMMON_DIR)/action_leader.o
+LEADER_TRIE_SRC_OBJ = $(filter-out $(KEYMAP_PACK_OBJ) $(LEADER_TRIE_OBJ) $(MACRO_PACK_OBJ),$(OBJ))
+LEADER_TRIE_SECTION ?= .progmem.data
+ALL_CFLAGS += -I$(OBJDIR)
+
+$(LEADER_TRIE_TOOL): $(TMK_DIR)/tool/leader_trie/leader_trie.c
+	@echo
+	mkdir -p $(@D)
+	$(HOSTCC) -O2 -o $@ $<
+
+$(LEADER_TRIE_DATA): $(LEADER_TRIE_SRC_OBJ) $(LEADER_TRIE_TOOL)
+	@echo
+	@echo $(MSG_LEADER_TRIE) $@
+	for o in $(LEADER_TRIE_SRC_OBJ); do \
+		$(OBJCOPY) -O binary -j $(LEADER_TRIE_SECTION).leader_sequences $$o $@.tmp && cat $@.tmp || exit 1; \
+	done > $@.bin && \
+	$(LEADER_TRIE_TOOL) $@.bin > $@ || { rm -f $@; exit 1; }
+
+$(LEADER_TRIE_OBJ): $(LEADER_TRIE_DATA)
+endif
+
+# Packed macros: macro_sources[] dumped from objects is compressed by host tool
+ifeq (yes,$(strip $(MACRO_PACK_ENABLE)))
+HOSTCC ?= cc
+MACRO_PACK_TOOL = $(OBJDIR)/macro_pack
+MACRO_PACK_DATA = $(OBJDIR)/macro_pack_data.h
+MACRO_PACK_OBJ = $(OBJDIR)/$(COMMON_DIR)/action_macro.o
+MACRO_PACK_SRC_OBJ = $(filter-out $(KEYMAP_PACK_OBJ) $(LEADER_TRIE_OBJ) $(MACRO_PACK_OBJ),$(OBJ))
+MACRO_PACK_SECTION ?= .progmem.data
+ALL_CFLAGS += -I$(OBJDIR)
+
+$(MACRO_PACK_TOOL): $(TMK_DIR)/tool/macro_pack/macro_pack.c
+	@echo
+	mkdir -p $(@D)
+	$(HOSTCC) -O2 -o $@ $<
+
+$(MACRO_PACK_DATA): $(MACRO_PACK_SRC_OBJ) $(MACRO_PACK_TOOL)
+	@echo
+	@echo $(MSG_MACRO_PACK) $@
+	for o in $(MACRO_PACK_SRC_OBJ); do \
+		$(OBJCOPY) -O binary -j $(MACRO_PACK_SECTION).macro_sources $$o $@.tmp && cat $@.tmp || exit 1; \
+	done > $@.bin && \
+	$(MACRO_PACK_TOOL) $@.bin > $@ || { rm -f $@; exit 1; }
+
+$(MACRO_PACK_OBJ): $(MACRO_PACK_DATA)
+endif
+
+
 # Compile: create object files from C++ source files.
 $(OBJDIR)/%.o : %.cpp
 	@echo
@@ -595,6 +728,7 @@ clean_list :
 	$(REMOVE) $(TARGET).map
 	$(REMOVE) $(TARGET).sym
 	$(REMOVE) $(TARGET).lss
+	$(REMOVE) $(TARGET)_keymap.bin
 	$(REMOVE) $(OBJ)
 	$(REMOVE) $(LST)
 	$(REMOVE) $(OBJ:.o=.s)
@@ -616,7 +750,7 @@ $(shell mkdir $(OBJDIR) 2>/dev/null)
 
 
 # Listing of phony targets.
-.PHONY : all begin finish end sizebefore sizeafter gccversion \
+.PHONY : all begin finish end sizebefore sizeafter ram profile gccversion \
 build elf hex eep lss sym coff extcoff \
-clean clean_list debug gdb-config show_path \
+clean clean_list debug gdb-config show_path keymap_image \
 program teensy dfu flip dfu-ee flip-ee dfu-start
@@ -0,0 +1,176 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Measures press to host latency of keyboard with external switch trigger.
+ *
+ * Runs on Linux host. RTS of serial port drives actuator of the switch
+ * (optocoupler or relay across switch, or solenoid), time from asserting
+ * RTS to arrival of changed report on hidraw of the keyboard is one sample.
+ * Same for release with RTS negated.
+ *
+ *   bench_latency <hidraw> <tty> [count] [hold_ms]
+ *
+ *   bench_latency /dev/hidraw3 /dev/ttyUSB0 200 50
+ *
+ * Prints samples in us as "<n> press <us> release <us>" and summary at end.
+ * Delay before each press is random in a frame so that samples are spread
+ * over phase of USB polling and matrix scan. Pulse of BENCH_GPIO_ENABLE
+ * on scope tells part in firmware from part in scan and USB.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+
+#define MAX_SAMPLES     10000
+#define TIMEOUT_MS      1000
+#define REPORT_MAX      64
+
+
+static int hid_fd;
+static int tty_fd;
+static uint8_t last_report[REPORT_MAX];
+static ssize_t last_len = 0;
+
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void trigger(int on)
+{
+    int bits = TIOCM_RTS;
+    if (ioctl(tty_fd, on ? TIOCMBIS : TIOCMBIC, &bits) < 0) {
+        perror("bench_latency: RTS");
+        exit(1);
+    }
+}
+
+/* reads reports until one differs from last, returns arrival time or 0 */
+static uint64_t wait_change(void)
+{
+    uint64_t start = now_us();
+    for (;;) {
+        int left = TIMEOUT_MS - (int)((now_us() - start) / 1000);
+        if (left <= 0) return 0;
+
+        struct pollfd p = { .fd = hid_fd, .events = POLLIN };
+        if (poll(&p, 1, left) <= 0) continue;
+
+        uint8_t buf[REPORT_MAX];
+        ssize_t len = read(hid_fd, buf, sizeof(buf));
+        uint64_t t = now_us();
+        if (len <= 0) continue;
+        if (len == last_len && !memcmp(buf, last_report, len)) continue;
+        memcpy(last_report, buf, len);
+        last_len = len;
+        return t;
+    }
+}
+
+/* drops reports already queued, last one is current state */
+static void drain(void)
+{
+    uint8_t buf[REPORT_MAX];
+    ssize_t len;
+    while ((len = read(hid_fd, buf, sizeof(buf))) > 0) {
+        memcpy(last_report, buf, len);
+        last_len = len;
+    }
+}
+
+static int compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void summary(const char *name, uint32_t *s, int n)
+{
+    if (!n) return;
+    uint64_t sum = 0;
+    for (int i = 0; i < n; i++) sum += s[i];
+    qsort(s, n, sizeof(s[0]), compare);
+    printf("%-8s n=%d min=%u avg=%u median=%u p99=%u max=%u\n", name, n,
+           s[0], (uint32_t)(sum / n), s[n / 2], s[(n * 99) / 100], s[n - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    static uint32_t press[MAX_SAMPLES], release[MAX_SAMPLES];
+    int np = 0, nr = 0;
+
+    if (argc < 3 || argc > 5) {
+        fprintf(stderr, "usage: %s <hidraw> <tty> [count] [hold_ms]\n", argv[0]);
+        return 2;
+    }
+    int count = (argc > 3) ? atoi(argv[3]) : 100;
+    int hold_ms = (argc > 4) ? atoi(argv[4]) : 50;
+    if (count <= 0 || count > MAX_SAMPLES || hold_ms <= 0) {
+        fprintf(stderr, "bench_latency: count 1-%d, hold_ms > 0\n", MAX_SAMPLES);
+        return 2;
+    }
+
+    hid_fd = open(argv[1], O_RDONLY | O_NONBLOCK);
+    if (hid_fd < 0) { perror(argv[1]); return 1; }
+    tty_fd = open(argv[2], O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (tty_fd < 0) { perror(argv[2]); return 1; }
+
+    srand(time(NULL));
+    trigger(0);
+    usleep(hold_ms * 1000);
+
+    for (int i = 0; i < count; i++) {
+        drain();
+        usleep(rand() % 1000);
+
+        uint64_t t0 = now_us();
+        trigger(1);
+        uint64_t t1 = wait_change();
+        if (t1) press[np++] = t1 - t0;
+        usleep(hold_ms * 1000);
+
+        drain();
+        uint64_t t2 = now_us();
+        trigger(0);
+        uint64_t t3 = wait_change();
+        if (t3) release[nr++] = t3 - t2;
+        usleep(hold_ms * 1000);
+
+        printf("%d press ", i);
+        if (t1) printf("%u", (uint32_t)(t1 - t0)); else printf("timeout");
+        printf(" release ");
+        if (t3) printf("%u", (uint32_t)(t3 - t2)); else printf("timeout");
+        printf("\n");
+        fflush(stdout);
+    }
+
+    summary("press", press, np);
+    summary("release", release, nr);
+    return (np == count && nr == count) ? 0 : 1;
+}
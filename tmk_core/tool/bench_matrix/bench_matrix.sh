@@ -0,0 +1,144 @@
+#!/bin/sh
+#
+# Benchmark matrix of keyboard and converter firmwares
+#
+#   tool/bench_matrix/bench_matrix.sh [-t trace] [Makefile...] > bench.json
+#
+# Builds every keyboard/*/Makefile* and converter/*/Makefile* variant, or
+# those given, and prints a JSON array with an object per variant:
+#
+#   { "target": "keyboard/gh60/Makefile", "mcu": "atmega32u4", "build": "ok",
+#     "flash": 21534, "ram": 618, "sim": { "cycles_per_pass": 812.4,
+#     "cycles_per_event": 5120.3, "latency_us": 5210.0, ... } }
+#
+# flash is text and data of the ELF, ram is data and bss. AVR variants also
+# run their keymap and config.h on tool/simavr with a standard trace: taps
+# across the matrix with some rollover and a held key, made for the shape of
+# matrix so that it fits every board. Keys do what keymap has there, so
+# cycles per event are comparable between builds of one variant, not between
+# variants. -t gives own trace instead. sim is null when the variant is not
+# AVR or its keymap doesn't build with the harness, e.g. it calls matrix or
+# protocol code of the board; see the log for why.
+#
+# Variants are cleaned and built in place. Output of make and simulated
+# builds go to $BENCH_MATRIX_OUT(tool/bench_matrix/out). Needs avr-gcc and
+# simavr for sim, and toolchains of other variants for their sizes.
+#
+
+TOOL_DIR=$(cd "$(dirname "$0")" && pwd)
+TMK_DIR=$(cd "$TOOL_DIR/../.." && pwd)
+ROOT_DIR=$(cd "$TMK_DIR/.." && pwd)
+OUT=${BENCH_MATRIX_OUT:-$TOOL_DIR/out}
+LOG=$OUT/bench_matrix.log
+TRACE=
+
+if [ "$1" = "-t" ]; then
+    TRACE=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+    shift 2
+fi
+if [ $# -eq 0 ]; then
+    set -- "$ROOT_DIR"/keyboard/*/Makefile* "$ROOT_DIR"/converter/*/Makefile*
+fi
+
+mkdir -p "$OUT"
+: > "$LOG"
+
+# value of make variable $3 of Makefile $2 in $1
+var() {
+    make -s --no-print-directory -C "$1" -f "$2" -f "$TOOL_DIR/print.mk" "print-$3" 2>>"$LOG" | tail -n 1
+}
+
+# JSON string or null
+str() {
+    if [ -n "$1" ]; then printf '"%s"' "$1"; else printf 'null'; fi
+}
+
+# taps of keys spread over rows x cols, each overlaps next, then a hold
+standard_trace() {
+    awk -v rows="$1" -v cols="$2" 'BEGIN {
+        n = rows * cols; taps = (n < 24) ? n : 24; t = 0
+        for (i = 0; i < taps; i++) {
+            p = (i * 37) % n
+            printf "%u d %u %u\n", t, int(p / cols), p % cols
+            printf "%u u %u %u\n", t + 60, int(p / cols), p % cols
+            t += 40
+        }
+        t += 200
+        printf "%u d 0 0\n%u u 0 0\n%u end\n", t, t + 300, t + 800
+    }' | sort -n -s -k1,1
+}
+
+# simulation of variant $1/$2 into $3, prints JSON of simavr_bench or nothing
+simulate() {
+    dir=$1 mk=$2 o=$3
+    mcu=$(var "$dir" "$mk" MCU)
+    [ -n "$mcu" ] || return
+    f_cpu=$(var "$dir" "$mk" F_CPU)
+    config=$dir/$(var "$dir" "$mk" CONFIG_H)
+    keymap=
+    for f in $(var "$dir" "$mk" SRC); do
+        case "$f" in
+            common/*|protocol/*) ;;
+            *keymap*.c|*unimap*.c|*actionmap*.c)
+                keymap="$keymap $(realpath --relative-to="$TMK_DIR" "$dir/$f")" ;;
+        esac
+    done
+    [ -n "$keymap" ] || { echo "$dir/$mk: no keymap in SRC" >> "$LOG"; return; }
+
+    shape=$(printf 'MATRIX_ROWS MATRIX_COLS\n' | \
+        avr-gcc -E -P -x c -mmcu="$mcu" -include "$config" - 2>>"$LOG" | tail -n 1)
+    set -- $shape
+    rows=$(($1)) cols=$(($2))
+    if [ "$rows" -lt 1 ] || [ "$cols" -lt 1 ] || [ "$cols" -gt 32 ]; then
+        echo "$dir/$mk: matrix $shape not supported" >> "$LOG"
+        return
+    fi
+
+    mkdir -p "$o"
+    trace=$TRACE
+    if [ -z "$trace" ]; then
+        trace=$o/standard.trace
+        standard_trace "$rows" "$cols" > "$trace"
+    fi
+    make -C "$TMK_DIR/tool/simavr" all \
+        KEYMAP_SRC="$keymap" CONFIG_H="$config" MCU="$mcu" F_CPU="${f_cpu:-16000000}" \
+        UNIMAP_ENABLE="$(var "$dir" "$mk" UNIMAP_ENABLE)" \
+        ACTIONMAP_ENABLE="$(var "$dir" "$mk" ACTIONMAP_ENABLE)" \
+        OBJDIR="$o/obj" TARGET="$o/sim_avr" BENCH="$o/simavr_bench" >> "$LOG" 2>&1 || return
+    "$o/simavr_bench" -j "$o/sim_avr.elf" "$trace" 2>> "$LOG" | tail -n 1
+}
+
+sep=
+echo "["
+for makefile in "$@"; do
+    case "$makefile" in *~|*.orig|*.bak) continue ;; esac
+    [ -f "$makefile" ] || continue
+    dir=$(cd "$(dirname "$makefile")" && pwd)
+    mk=$(basename "$makefile")
+    name=${dir#$ROOT_DIR/}/$mk
+    o=$OUT/$(echo "$name" | tr '/' '_')
+    echo "=== $name" >> "$LOG"
+
+    build=fail flash= ram= sim=
+    rm -rf "$o"
+    mkdir -p "$o"
+    touch "$o/stamp"
+    make -C "$dir" -f "$mk" clean >> "$LOG" 2>&1
+    if make -C "$dir" -f "$mk" >> "$LOG" 2>&1; then
+        build=ok
+        elf=$(find "$dir" -name '*.elf' -newer "$o/stamp" | head -n 1)
+        size=$(var "$dir" "$mk" SIZE)
+        if [ -n "$elf" ]; then
+            set -- $(${size:-size} "$elf" 2>>"$LOG" | awk 'NR == 2 { print $1 + $2, $2 + $3 }')
+            flash=$1 ram=$2
+        fi
+        sim=$(simulate "$dir" "$mk" "$o")
+    fi
+
+    printf '%s  { "target": "%s", "mcu": %s, "build": "%s", "flash": %s, "ram": %s, "sim": %s }' \
+        "$sep" "$name" "$(str "$(var "$dir" "$mk" MCU)")" "$build" \
+        "${flash:-null}" "${ram:-null}" "${sim:-null}"
+    sep=",
+"
+done
+printf '\n]\n'
@@ -0,0 +1,5 @@
+# Value of a variable of keyboard Makefile for bench_matrix.sh
+#
+#   make -f Makefile -f print.mk print-TARGET
+print-%:
+	$(info $($*))@:
@@ -11,13 +11,21 @@ SRC +=	$(COMMON_DIR)/host.c \
 	$(COMMON_DIR)/debug.c \
 	$(COMMON_DIR)/util.c \
 	$(COMMON_DIR)/hook.c \
+	$(COMMON_DIR)/debounce.c \
+	$(COMMON_DIR)/deadline.c \
 	$(COMMON_DIR)/chibios/suspend.c \
 	$(COMMON_DIR)/chibios/printf.c \
 	$(COMMON_DIR)/chibios/timer.c \
+	$(COMMON_DIR)/chibios/matrix_port.c \
 	$(COMMON_DIR)/chibios/bootloader.c
 
 
 # Option modules
+ifdef COMBO_ENABLE
+    SRC += $(COMMON_DIR)/action_combo.c
+    OPT_DEFS += -DCOMBO_ENABLE
+endif
+
 ifdef BOOTMAGIC_ENABLE
     SRC += $(COMMON_DIR)/bootmagic.c
     SRC += $(COMMON_DIR)/chibios/eeconfig.c
@@ -65,6 +73,59 @@ ifdef BACKLIGHT_ENABLE
     OPT_DEFS += -DBACKLIGHT_ENABLE
 endif
 
+ifdef LATENCY_TRACE_ENABLE
+    SRC += $(COMMON_DIR)/latency.c
+    OPT_DEFS += -DLATENCY_TRACE_ENABLE
+endif
+
+ifdef INPUT_TRACE_ENABLE
+    SRC += $(COMMON_DIR)/input_trace.c
+    OPT_DEFS += -DINPUT_TRACE_ENABLE
+endif
+
+ifdef MICROBENCH_ENABLE
+    SRC += $(COMMON_DIR)/microbench.c
+    ifndef LATENCY_TRACE_ENABLE
+        SRC += $(COMMON_DIR)/latency.c
+    endif
+    OPT_DEFS += -DMICROBENCH_ENABLE
+endif
+
+ifdef STRESS_ENABLE
+    SRC += $(COMMON_DIR)/stress.c
+    OPT_DEFS += -DSTRESS_ENABLE
+endif
+
+ifdef PROFILE_ENABLE
+    SRC += $(COMMON_DIR)/profile.c \
+           $(COMMON_DIR)/chibios/profile.c
+    OPT_DEFS += -DPROFILE_ENABLE
+endif
+
+ifdef BENCH_GPIO_ENABLE
+    OPT_DEFS += -DBENCH_GPIO_ENABLE
+endif
+
+ifdef MATRIX_DMA_ENABLE
+    SRC += $(COMMON_DIR)/chibios/matrix_dma.c
+    OPT_DEFS += -DMATRIX_DMA_ENABLE
+endif
+
+ifdef IDLE_SLEEP_ENABLE
+    OPT_DEFS += -DIDLE_SLEEP_ENABLE
+endif
+
+# scan, mouse and suspend in threads of their own, see protocol/chibios/main.c
+ifdef CHIBIOS_THREADS
+    OPT_DEFS += -DCHIBIOS_THREADS
+    OPT_DEFS += -DMOUSE_TASK_SEPARATE
+endif
+
+# code in .ramtext, rules.ld of ChibiOS places it in .data
+ifdef RAMFUNC_ENABLE
+    OPT_DEFS += -DRAMFUNC_ENABLE
+endif
+
 ifdef KEYMAP_SECTION_ENABLE
     OPT_DEFS += -DKEYMAP_SECTION_ENABLE
 
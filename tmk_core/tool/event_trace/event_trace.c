@@ -0,0 +1,165 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Decodes records of common/event_trace.c in console output.
+ *
+ * Runs on build machine. Reads output of hid_listen from stdin or files
+ * and prints records one per line, other text is passed through:
+ *
+ *   hid_listen | event_trace
+ *
+ *   <ms> +<delta> <type> <row>,<col> <detail> layer:<hex>
+ *
+ * Time is timer_read() of firmware, which wraps at 65536ms.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+
+/* same as enum event_trace_type of event_trace.h */
+enum {
+    TRACE_KEY = 1,
+    TRACE_ACTION,
+    TRACE_TAPPING,
+    TRACE_PROCESSED,
+    TRACE_OVERFLOW,
+    TRACE_LAYER,
+    TRACE_DEFAULT_LAYER,
+    TRACE_DROP,
+};
+
+/* kind id of action_code.h */
+static const char *action_name(uint8_t id)
+{
+    switch (id) {
+        case 0x0: return "ACT_LMODS";
+        case 0x1: return "ACT_RMODS";
+        case 0x2: return "ACT_LMODS_TAP";
+        case 0x3: return "ACT_RMODS_TAP";
+        case 0x4: return "ACT_USAGE";
+        case 0x5: return "ACT_MOUSEKEY";
+        case 0x8: return "ACT_LAYER";
+        case 0xA: return "ACT_LAYER_TAP";
+        case 0xB: return "ACT_LAYER_TAP_EXT";
+        case 0xC: return "ACT_MACRO";
+        case 0xE: return "ACT_COMMAND";
+        case 0xF: return "ACT_FUNCTION";
+    }
+    return "UNKNOWN";
+}
+
+static void print_tap(uint8_t arg)
+{
+    printf("%c tap:%u%s", (arg & 0x80) ? 'd' : 'u', arg & 0x0F,
+           (arg & 0x40) ? " interrupted" : "");
+}
+
+static int hex(const char *s, int n, unsigned *v)
+{
+    *v = 0;
+    for (int i = 0; i < n; i++) {
+        if (!isxdigit((unsigned char)s[i])) return -1;
+        *v = (*v << 4) | (isdigit((unsigned char)s[i]) ? s[i] - '0' : (toupper((unsigned char)s[i]) - 'A' + 10));
+    }
+    return 0;
+}
+
+static int last_time = -1;
+
+/* returns 0 if line is a record */
+static int decode(const char *line)
+{
+    const char *p = strchr(line, '!');
+    if (!p) return -1;
+    p++;
+
+    unsigned type, arg, row, col, time, layer;
+    if (strlen(p) < 16 ||
+        hex(p, 2, &type) || hex(p + 2, 2, &arg) ||
+        hex(p + 4, 2, &row) || hex(p + 6, 2, &col) ||
+        hex(p + 8, 4, &time) || hex(p + 12, 4, &layer)) {
+        return -1;
+    }
+
+    unsigned delta = (last_time < 0) ? 0 : ((time - last_time) & 0xFFFF);
+    last_time = time;
+    printf("%5u +%-5u ", time, delta);
+
+    switch (type) {
+        case TRACE_KEY:
+            printf("KEY       %u,%u %c", row, col, arg ? 'd' : 'u');
+            break;
+        case TRACE_ACTION:
+            printf("ACTION    %u,%u %s", row, col, action_name(arg));
+            break;
+        case TRACE_TAPPING:
+            printf("TAPPING   %u,%u ", row, col);
+            print_tap(arg);
+            break;
+        case TRACE_PROCESSED:
+            printf("PROCESSED %u,%u ", row, col);
+            print_tap(arg);
+            break;
+        case TRACE_OVERFLOW:
+            printf("OVERFLOW  %u,%u %s", row, col, (arg == 2) ? "clear all" : "settle tapping");
+            break;
+        case TRACE_LAYER:
+            printf("LAYER    ");
+            break;
+        case TRACE_DEFAULT_LAYER:
+            printf("DEFAULT  ");
+            break;
+        case TRACE_DROP:
+            printf("DROP      %u records lost\n", arg);
+            return 0;
+        default:
+            printf("type:%02X  %u,%u arg:%02X", type, row, col, arg);
+            break;
+    }
+    printf(" layer:%04X\n", layer);
+    return 0;
+}
+
+static void run(FILE *fp)
+{
+    char buf[256];
+    while (fgets(buf, sizeof(buf), fp)) {
+        if (decode(buf) < 0) fputs(buf, stdout);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 1) {
+        run(stdin);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *fp = fopen(argv[i], "r");
+        if (!fp) {
+            perror(argv[i]);
+            return 1;
+        }
+        run(fp);
+        fclose(fp);
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Converts dump of common/input_trace.c into trace of tool/native.
+ *
+ * Runs on build machine. Reads output of hid_listen from stdin or files,
+ * takes lines of '@' records and prints key statements of the trace with
+ * time relative to the first record, other text is dropped:
+ *
+ *   hid_listen | input_trace > site.trace
+ *   make test TRACES=site.trace
+ *
+ * Bytes of converters are printed as comments. Native build has to have
+ * MATRIX_ROWS and MATRIX_COLS of the keyboard for the trace to load, append
+ * expect statements from reports of 'native_bench -v' to make it a test.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+
+#define MAX_ROWS    256
+
+/* same as enum input_trace_type of input_trace.h */
+enum {
+    INPUT_TRACE_ROW = 1,
+    INPUT_TRACE_BYTE,
+};
+
+static uint32_t rows[MAX_ROWS];
+static int started = 0;
+static uint16_t last_time;
+static uint32_t now;        // ms since first record
+
+
+static int parse_hex(const char *s, int digits, uint32_t *v)
+{
+    *v = 0;
+    for (int i = 0; i < digits; i++) {
+        if (!isxdigit((unsigned char)s[i])) return -1;
+        char c = toupper((unsigned char)s[i]);
+        *v = (*v << 4) | (c <= '9' ? c - '0' : c - 'A' + 10);
+    }
+    return 0;
+}
+
+static void record(const char *s)
+{
+    uint32_t type, row, time, data;
+    if (parse_hex(s, 2, &type) || parse_hex(s + 2, 2, &row) ||
+        parse_hex(s + 4, 4, &time) || parse_hex(s + 8, 8, &data)) {
+        return;
+    }
+
+    // timer_read() wraps at 65536ms
+    if (!started) {
+        started = 1;
+        last_time = time;
+        printf("# input_trace: first record at %u ms of keyboard\n", (unsigned)time);
+    }
+    now += (uint16_t)(time - last_time);
+    last_time = time;
+
+    switch (type) {
+        case INPUT_TRACE_ROW: {
+            uint32_t change = data ^ rows[row];
+            for (int c = 0; c < 32; c++) {
+                if (change & (1UL << c)) {
+                    printf("%-4u %c %u %d\n", (unsigned)now,
+                           (data & (1UL << c)) ? 'd' : 'u', (unsigned)row, c);
+                }
+            }
+            rows[row] = data;
+            break;
+        }
+        case INPUT_TRACE_BYTE:
+            printf("# %-4u byte %02X\n", (unsigned)now, (unsigned)data);
+            break;
+        default:
+            printf("# %-4u unknown record %02X\n", (unsigned)now, (unsigned)type);
+            break;
+    }
+}
+
+static void convert(FILE *fp)
+{
+    char buf[256];
+    while (fgets(buf, sizeof(buf), fp)) {
+        char *p = strchr(buf, '@');
+        if (p && strlen(p) >= 17) record(p + 1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 1) {
+        convert(stdin);
+    } else {
+        for (int i = 1; i < argc; i++) {
+            FILE *fp = fopen(argv[i], "r");
+            if (!fp) {
+                perror(argv[i]);
+                return 1;
+            }
+            convert(fp);
+            fclose(fp);
+        }
+    }
+
+    // release keys held at end of dump as replay on device does
+    for (int r = 0; r < MAX_ROWS; r++) {
+        for (int c = 0; c < 32; c++) {
+            if (rows[r] & (1UL << c)) printf("%-4u u %d %d\n", (unsigned)now, r, c);
+        }
+    }
+    if (started) printf("%-4u end\n", (unsigned)now);
+    return 0;
+}
@@ -0,0 +1,405 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Keymap image of firmware built with KEYMAP_SECTION_ENABLE, format is in
+ * common/keymap_image.h.
+ *
+ * Runs on build machine. Firmware is Intel HEX, image is binary file.
+ *
+ *   keymap_image info <firmware.hex>
+ *   keymap_image seal <firmware.hex>
+ *   keymap_image extract <firmware.hex> <image>
+ *   keymap_image build <rows> <cols> <width> <fn_actions> <keymaps> <image>
+ *   keymap_image patch <firmware.hex> <image> <out.hex>
+ *
+ * seal writes checksum into header of firmware, build makes image from raw
+ * content of fn_actions[] and keymaps[] dumped from object file with
+ * objcopy, patch replaces keymap of firmware with image of the same shape.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#define FLASH_SIZE      0x40000
+#define HEADER_SIZE     16
+#define VERSION         1
+#define MAX_IMAGE       (HEADER_SIZE + 0x10000)
+
+typedef struct {
+    uint8_t  version;
+    uint8_t  width;
+    uint8_t  rows;
+    uint8_t  cols;
+    uint16_t crc;
+    uint16_t fn_actions;
+    uint16_t fn_actions_end;
+    uint16_t keymaps;
+    uint16_t keymaps_end;
+} header_t;
+
+static uint8_t flash[FLASH_SIZE];
+static uint8_t used[FLASH_SIZE];
+
+
+static void die(const char *fmt, const char *arg)
+{
+    fprintf(stderr, "keymap_image: ");
+    fprintf(stderr, fmt, arg);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+/* accepts macro expansion such as (5) */
+static unsigned long parse_num(const char *s, const char *name)
+{
+    char *end;
+    while (*s == '(') s++;
+    unsigned long n = strtoul(s, &end, 0);
+    while (*end == ')' || *end == 'U' || *end == 'L') end++;
+    if (end == s || *end) die("invalid %s", name);
+    return n;
+}
+
+/* CRC-16/CCITT, 0x1021 with init 0xFFFF */
+static uint16_t crc16(uint16_t crc, const uint8_t *p, size_t len)
+{
+    while (len--) {
+        crc ^= (uint16_t)*p++ << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static int header_get(const uint8_t *p, header_t *h)
+{
+    if (p[0] != 'K' || p[1] != 'M') return 0;
+    h->version        = p[2];
+    h->width          = p[3];
+    h->rows           = p[4];
+    h->cols           = p[5];
+    h->crc            = le16(p + 6);
+    h->fn_actions     = le16(p + 8);
+    h->fn_actions_end = le16(p + 10);
+    h->keymaps        = le16(p + 12);
+    h->keymaps_end    = le16(p + 14);
+    return 1;
+}
+
+static void header_put(uint8_t *p, const header_t *h)
+{
+    p[0] = 'K';
+    p[1] = 'M';
+    p[2] = h->version;
+    p[3] = h->width;
+    p[4] = h->rows;
+    p[5] = h->cols;
+    put16(p + 6, h->crc);
+    put16(p + 8, h->fn_actions);
+    put16(p + 10, h->fn_actions_end);
+    put16(p + 12, h->keymaps);
+    put16(p + 14, h->keymaps_end);
+}
+
+/* layout of header is sane for data ending at limit */
+static int header_valid(const header_t *h, uint32_t limit)
+{
+    return h->version == VERSION &&
+           (h->width == 1 || h->width == 2) && h->rows && h->cols &&
+           h->fn_actions <= h->fn_actions_end &&
+           h->fn_actions_end <= h->keymaps &&
+           h->keymaps <= h->keymaps_end &&
+           h->keymaps_end <= limit &&
+           (h->keymaps_end - h->keymaps) % (h->rows * h->cols * h->width) == 0;
+}
+
+static uint16_t data_crc(const uint8_t *base, const header_t *h)
+{
+    uint16_t crc = crc16(0xFFFF, base + h->fn_actions, h->fn_actions_end - h->fn_actions);
+    return crc16(crc, base + h->keymaps, h->keymaps_end - h->keymaps);
+}
+
+static void header_print(const char *name, const header_t *h, uint16_t crc)
+{
+    printf("%s: %ux%u width %u, %u layers at 0x%04X, %u fn_actions at 0x%04X, crc %04X %s\n",
+           name, h->rows, h->cols, h->width,
+           (h->keymaps_end - h->keymaps) / (h->rows * h->cols * h->width), h->keymaps,
+           (h->fn_actions_end - h->fn_actions) / 2, h->fn_actions,
+           h->crc, (h->crc == crc) ? "ok" : h->crc ? "BAD" : "not sealed");
+}
+
+
+/*
+ * Intel HEX
+ */
+static void hex_read(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) die("can't open %s", path);
+
+    char line[600];
+    uint32_t base = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] != ':') continue;
+        uint8_t rec[256 + 5];
+        int n = 0;
+        for (char *s = line + 1; s[0] && s[1] && s[0] != '\r' && s[0] != '\n' && n < (int)sizeof(rec); s += 2) {
+            unsigned v;
+            if (sscanf(s, "%2x", &v) != 1) die("%s: invalid record", path);
+            rec[n++] = v;
+        }
+        if (n < 5 || n != rec[0] + 5) die("%s: invalid record", path);
+        uint8_t sum = 0;
+        for (int i = 0; i < n; i++) sum += rec[i];
+        if (sum) die("%s: checksum error", path);
+
+        uint32_t addr = base + (rec[1] << 8 | rec[2]);
+        switch (rec[3]) {
+        case 0x00:
+            for (int i = 0; i < rec[0]; i++, addr++) {
+                if (addr >= FLASH_SIZE) die("%s: address out of flash", path);
+                flash[addr] = rec[4 + i];
+                used[addr] = 1;
+            }
+            break;
+        case 0x01:
+            fclose(fp);
+            return;
+        case 0x02:
+            base = (uint32_t)(rec[4] << 8 | rec[5]) << 4;
+            break;
+        case 0x04:
+            base = (uint32_t)(rec[4] << 8 | rec[5]) << 16;
+            break;
+        }
+    }
+    fclose(fp);
+}
+
+static void hex_record(FILE *fp, uint8_t type, uint16_t addr, const uint8_t *data, uint8_t len)
+{
+    uint8_t sum = len + (addr >> 8) + (addr & 0xFF) + type;
+    fprintf(fp, ":%02X%04X%02X", len, addr, type);
+    for (int i = 0; i < len; i++) {
+        fprintf(fp, "%02X", data[i]);
+        sum += data[i];
+    }
+    fprintf(fp, "%02X\r\n", (uint8_t)-sum);
+}
+
+/* bytes loaded in 16-byte records, as avr-objcopy writes them */
+static void hex_write(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) die("can't create %s", path);
+
+    uint32_t segment = 0;
+    for (uint32_t addr = 0; addr < FLASH_SIZE; ) {
+        if (!used[addr]) { addr++; continue; }
+        if ((addr >> 16) != segment) {
+            segment = addr >> 16;
+            uint8_t s[2] = { segment >> 8, segment & 0xFF };
+            hex_record(fp, 0x04, 0, s, 2);
+        }
+        uint8_t len = 0;
+        while (len < 16 && addr + len < FLASH_SIZE && used[addr + len] && ((addr + len) >> 16) == segment) len++;
+        hex_record(fp, 0x00, addr & 0xFFFF, &flash[addr], len);
+        addr += len;
+    }
+    hex_record(fp, 0x01, 0, NULL, 0);
+    if (fclose(fp)) die("can't write %s", path);
+}
+
+/* header is at end of keymap region, last match of 16-byte boundary */
+static uint32_t firmware_header(const char *path, header_t *h)
+{
+    for (uint32_t a = FLASH_SIZE - HEADER_SIZE; a < FLASH_SIZE; a -= HEADER_SIZE) {
+        if (!used[a] || !header_get(&flash[a], h)) continue;
+        if (header_valid(h, a)) return a;
+    }
+    die("%s: no keymap image header, build with KEYMAP_SECTION_ENABLE", path);
+    return 0;
+}
+
+
+/*
+ * Image file
+ */
+static size_t file_read(const char *path, uint8_t *buf, size_t size)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) die("can't open %s", path);
+    size_t n = fread(buf, 1, size, fp);
+    if (!feof(fp)) die("%s: too large", path);
+    fclose(fp);
+    return n;
+}
+
+static void file_write(const char *path, const uint8_t *buf, size_t size)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp || fwrite(buf, 1, size, fp) != size || fclose(fp)) die("can't write %s", path);
+}
+
+/* header and data of image in file order, offsets of header are set */
+static size_t image_make(uint8_t *image, header_t *h,
+                         const uint8_t *fn, size_t fn_size,
+                         const uint8_t *km, size_t km_size)
+{
+    h->fn_actions = HEADER_SIZE;
+    h->fn_actions_end = h->fn_actions + fn_size;
+    h->keymaps = h->fn_actions_end;
+    h->keymaps_end = h->keymaps + km_size;
+    memcpy(image + h->fn_actions, fn, fn_size);
+    memcpy(image + h->keymaps, km, km_size);
+    h->crc = data_crc(image, h);
+    header_put(image, h);
+    return h->keymaps_end;
+}
+
+
+static int cmd_info(char **argv)
+{
+    header_t h;
+    hex_read(argv[0]);
+    firmware_header(argv[0], &h);
+    header_print(argv[0], &h, data_crc(flash, &h));
+    return 0;
+}
+
+static int cmd_seal(char **argv)
+{
+    header_t h;
+    hex_read(argv[0]);
+    uint32_t a = firmware_header(argv[0], &h);
+    h.crc = data_crc(flash, &h);
+    header_put(&flash[a], &h);
+    hex_write(argv[0]);
+    header_print(argv[0], &h, h.crc);
+    return 0;
+}
+
+static int cmd_extract(char **argv)
+{
+    static uint8_t image[MAX_IMAGE];
+    header_t h;
+    hex_read(argv[0]);
+    firmware_header(argv[0], &h);
+    if (h.crc && h.crc != data_crc(flash, &h)) die("%s: checksum of keymap is bad", argv[0]);
+    size_t size = image_make(image, &h,
+                             &flash[h.fn_actions], h.fn_actions_end - h.fn_actions,
+                             &flash[h.keymaps], h.keymaps_end - h.keymaps);
+    file_write(argv[1], image, size);
+    header_print(argv[1], &h, h.crc);
+    return 0;
+}
+
+static int cmd_build(char **argv)
+{
+    static uint8_t fn[0x10000], km[0x10000], image[MAX_IMAGE];
+    header_t h = {
+        .version = VERSION,
+        .rows  = parse_num(argv[0], "rows"),
+        .cols  = parse_num(argv[1], "cols"),
+        .width = parse_num(argv[2], "width"),
+    };
+    size_t fn_size = file_read(argv[3], fn, sizeof(fn));
+    size_t km_size = file_read(argv[4], km, sizeof(km));
+    if (!h.rows || !h.cols || (h.width != 1 && h.width != 2)) die("unsupported shape%s", "");
+    if (fn_size % 2) die("%s: size is not multiple of action", argv[3]);
+    if (km_size == 0 || km_size % (h.rows * h.cols * h.width)) die("%s: size is not multiple of layer", argv[4]);
+    if (HEADER_SIZE + fn_size + km_size > 0xFFFF) die("%s: too large", argv[4]);
+
+    size_t size = image_make(image, &h, fn, fn_size, km, km_size);
+    file_write(argv[5], image, size);
+    header_print(argv[5], &h, h.crc);
+    return 0;
+}
+
+static int cmd_patch(char **argv)
+{
+    static uint8_t image[MAX_IMAGE];
+    header_t fw, im;
+    hex_read(argv[0]);
+    uint32_t a = firmware_header(argv[0], &fw);
+
+    size_t size = file_read(argv[1], image, sizeof(image));
+    if (size < HEADER_SIZE || !header_get(image, &im) ||
+        !header_valid(&im, size) || im.keymaps_end != size) die("%s: not keymap image", argv[1]);
+    if (im.crc != data_crc(image, &im)) die("%s: checksum of image is bad", argv[1]);
+    if (im.rows != fw.rows || im.cols != fw.cols || im.width != fw.width) die("%s: shape differs from firmware", argv[1]);
+
+    size_t fn_size = im.fn_actions_end - im.fn_actions;
+    size_t km_size = im.keymaps_end - im.keymaps;
+    if (fn_size > (size_t)(fw.keymaps - fw.fn_actions)) die("%s: too many fn_actions for firmware", argv[1]);
+    if (km_size > a - fw.keymaps) die("%s: too many layers for keymap region", argv[1]);
+
+    // old keymap is cleared, layer beyond new ones reads KC_NO
+    memset(&flash[fw.fn_actions], 0, fw.fn_actions_end - fw.fn_actions);
+    memset(&flash[fw.keymaps], 0, fw.keymaps_end - fw.keymaps);
+    memcpy(&flash[fw.fn_actions], image + im.fn_actions, fn_size);
+    memset(&used[fw.fn_actions], 1, fn_size);
+    memcpy(&flash[fw.keymaps], image + im.keymaps, km_size);
+    memset(&used[fw.keymaps], 1, km_size);
+
+    fw.fn_actions_end = fw.fn_actions + fn_size;
+    fw.keymaps_end = fw.keymaps + km_size;
+    fw.crc = data_crc(flash, &fw);
+    header_put(&flash[a], &fw);
+    hex_write(argv[2]);
+    header_print(argv[2], &fw, fw.crc);
+    return 0;
+}
+
+
+static const struct {
+    const char *name;
+    int args;
+    int (*run)(char **argv);
+    const char *usage;
+} commands[] = {
+    { "info",    1, cmd_info,    "<firmware.hex>" },
+    { "seal",    1, cmd_seal,    "<firmware.hex>" },
+    { "extract", 2, cmd_extract, "<firmware.hex> <image>" },
+    { "build",   6, cmd_build,   "<rows> <cols> <width> <fn_actions> <keymaps> <image>" },
+    { "patch",   3, cmd_patch,   "<firmware.hex> <image> <out.hex>" },
+};
+
+int main(int argc, char **argv)
+{
+    for (size_t i = 0; argc >= 2 && i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (strcmp(argv[1], commands[i].name) == 0 && argc == commands[i].args + 2)
+            return commands[i].run(argv + 2);
+    }
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+        fprintf(stderr, "%s %s %s %s\n", i ? "      " : "usage:", argv[0], commands[i].name, commands[i].usage);
+    return 2;
+}
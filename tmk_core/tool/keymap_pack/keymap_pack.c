@@ -0,0 +1,161 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Converts keymap into packed format of common/keymap_pack.c.
+ *
+ * Runs on build machine. Input is raw content of keymaps[](or actionmaps[])
+ * dumped from object file with objcopy, output is keymap_pack_data.h.
+ *
+ *   keymap_pack <rows> <cols> <width> <dump>
+ *
+ * width is size of code in bytes: 1 for keycode and 2 for action.
+ * Codes are stored in little endian as on AVR and ARM.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#define MAX_LAYERS      32
+#define MAX_COLS        32
+#define MAX_CODES       0xFFFF
+#define TRANSPARENT     1
+
+
+/* accepts macro expansion such as (5) */
+static unsigned long parse_num(const char *s, const char *name)
+{
+    char *end;
+    while (*s == '(') s++;
+    unsigned long n = strtoul(s, &end, 0);
+    while (*end == ')' || *end == 'U' || *end == 'L') end++;
+    if (end == s || *end) {
+        fprintf(stderr, "keymap_pack: invalid %s: %s\n", name, s);
+        exit(1);
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 5) {
+        fprintf(stderr, "usage: %s <rows> <cols> <width> <dump>\n", argv[0]);
+        return 2;
+    }
+    unsigned long rows  = parse_num(argv[1], "rows");
+    unsigned long cols  = parse_num(argv[2], "cols");
+    unsigned long width = parse_num(argv[3], "width");
+    if (!rows || !cols || cols > MAX_COLS || (width != 1 && width != 2)) {
+        fprintf(stderr, "keymap_pack: unsupported shape %lux%lu width %lu\n", rows, cols, width);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[4], "rb");
+    if (!fp) {
+        perror(argv[4]);
+        return 1;
+    }
+    static uint8_t dump[MAX_LAYERS * 256 * MAX_COLS * 2];
+    size_t size = fread(dump, 1, sizeof(dump), fp);
+    fclose(fp);
+
+    size_t layer_size = rows * cols * width;
+    if (size == 0 || size % layer_size) {
+        fprintf(stderr, "keymap_pack: %s: size %zu is not multiple of layer(%zu bytes)\n",
+                argv[4], size, layer_size);
+        return 1;
+    }
+    unsigned long layers = size / layer_size;
+    if (layers > MAX_LAYERS) {
+        fprintf(stderr, "keymap_pack: too many layers: %lu\n", layers);
+        return 1;
+    }
+
+    unsigned bits_size = (cols <= 8) ? 1 : (cols <= 16) ? 2 : 4;
+    const char *bits_type = (bits_size == 1) ? "uint8_t" : (bits_size == 2) ? "uint16_t" : "uint32_t";
+    const char *code_type = (width == 1) ? "uint8_t" : "uint16_t";
+
+    printf("/* Generated by tool/keymap_pack from %s, do not edit. */\n", argv[4]);
+    printf("#define KEYMAP_PACK_LAYERS      %lu\n", layers);
+    printf("#define KEYMAP_PACK_BITS_SIZE   %u\n", bits_size);
+    printf("#if (KEYMAP_PACK_ROWS != %lu || KEYMAP_PACK_COLS != %lu || KEYMAP_PACK_WIDTH != %lu)\n",
+           rows, cols, width);
+    printf("#   error \"keymap_pack_data.h: shape differs from keymap_pack.h\"\n");
+    printf("#endif\n\n");
+
+    /* bitmaps and index */
+    uint32_t index = 0;
+    printf("static const %s keymap_pack_bits[][%lu] PROGMEM = {\n", bits_type, rows);
+    for (unsigned long l = 0; l < layers; l++) {
+        printf("    {");
+        for (unsigned long r = 0; r < rows; r++) {
+            uint32_t bits = 0;
+            for (unsigned long c = 0; c < cols; c++) {
+                const uint8_t *p = &dump[((l * rows + r) * cols + c) * width];
+                uint16_t code = (width == 1) ? p[0] : (p[0] | p[1]<<8);
+                if (code != TRANSPARENT) bits |= (1UL<<c);
+            }
+            printf(" 0x%0*X,", bits_size * 2, bits);
+        }
+        printf(" },\n");
+    }
+    printf("};\n\n");
+
+    printf("static const uint16_t keymap_pack_index[][%lu] PROGMEM = {\n", rows);
+    for (unsigned long l = 0; l < layers; l++) {
+        printf("    {");
+        for (unsigned long r = 0; r < rows; r++) {
+            printf(" %u,", index);
+            for (unsigned long c = 0; c < cols; c++) {
+                const uint8_t *p = &dump[((l * rows + r) * cols + c) * width];
+                uint16_t code = (width == 1) ? p[0] : (p[0] | p[1]<<8);
+                if (code != TRANSPARENT) index++;
+            }
+        }
+        printf(" },\n");
+    }
+    printf("};\n\n");
+    if (index > MAX_CODES) {
+        fprintf(stderr, "keymap_pack: too many codes: %u\n", index);
+        return 1;
+    }
+
+    /* codes of non-transparent keys, a line per row */
+    printf("static const %s keymap_pack_codes[] PROGMEM = {\n", code_type);
+    for (unsigned long l = 0; l < layers; l++) {
+        printf("    /* layer %lu */\n", l);
+        for (unsigned long r = 0; r < rows; r++) {
+            int n = 0;
+            for (unsigned long c = 0; c < cols; c++) {
+                const uint8_t *p = &dump[((l * rows + r) * cols + c) * width];
+                uint16_t code = (width == 1) ? p[0] : (p[0] | p[1]<<8);
+                if (code == TRANSPARENT) continue;
+                printf("%s0x%0*X,", n++ ? " " : "    ", (int)width * 2, code);
+            }
+            if (n) printf("\n");
+        }
+    }
+    if (!index) printf("    0\n");
+    printf("};\n");
+
+    fprintf(stderr, "keymap_pack: %lu layers, %u of %lu keys packed in %lu bytes\n",
+            layers, index, layers * rows * cols,
+            (unsigned long)(layers * rows * (bits_size + 2) + index * width));
+    return 0;
+}
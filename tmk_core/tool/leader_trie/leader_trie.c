@@ -0,0 +1,157 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Builds trie of leader key sequences for common/action_leader.c.
+ *
+ * Runs on build machine. Input is raw content of leader_sequences[] dumped
+ * from object file with objcopy, output is leader_trie_data.h.
+ *
+ *   leader_trie <dump>
+ *
+ * Dump is sequences of LEADER_SEQ(): id of macro, keycodes and 0. Nodes are
+ * numbered in order of creation from root 0, edges of a node are sorted by
+ * keycode so that firmware finds child with binary search.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#define MAX_NODES       4096
+#define MAX_DUMP        (MAX_NODES * 2)
+#define NONE            0xFF
+
+
+static int16_t child[MAX_NODES][256];
+static uint8_t id[MAX_NODES];
+static unsigned nodes = 1;
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <dump>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (!fp) {
+        perror(argv[1]);
+        return 1;
+    }
+    static uint8_t dump[MAX_DUMP];
+    size_t size = fread(dump, 1, sizeof(dump), fp);
+    fclose(fp);
+    if (size == sizeof(dump)) {
+        fprintf(stderr, "leader_trie: %s: too large\n", argv[1]);
+        return 1;
+    }
+
+    memset(child, 0, sizeof(child));
+    memset(id, NONE, sizeof(id));
+
+    unsigned sequences = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t start = i;
+        uint8_t seq_id = dump[i++];
+        if (seq_id == NONE) {
+            fprintf(stderr, "leader_trie: sequence %u: id 255 is reserved\n", sequences);
+            return 1;
+        }
+        unsigned n = 0, len = 0;
+        while (i < size && dump[i]) {
+            uint8_t code = dump[i++];
+            if (!child[n][code]) {
+                if (nodes == MAX_NODES) {
+                    fprintf(stderr, "leader_trie: too many nodes\n");
+                    return 1;
+                }
+                child[n][code] = nodes++;
+            }
+            n = child[n][code];
+            len++;
+        }
+        if (i == size) {
+            fprintf(stderr, "leader_trie: sequence %u: no end at offset %zu\n", sequences, start);
+            return 1;
+        }
+        i++;
+        if (!len) {
+            fprintf(stderr, "leader_trie: sequence %u: no keys\n", sequences);
+            return 1;
+        }
+        if (id[n] != NONE) {
+            fprintf(stderr, "leader_trie: sequence %u: same keys as other\n", sequences);
+            return 1;
+        }
+        id[n] = seq_id;
+        sequences++;
+    }
+
+    printf("/* Generated by tool/leader_trie from %s, do not edit. */\n", argv[1]);
+    printf("#define LEADER_TRIE_NODES   %u\n", nodes);
+    printf("#define LEADER_TRIE_NONE    0x%02X\n\n", NONE);
+
+    /* first edge of each node and end of last */
+    unsigned edges = 0;
+    printf("static const uint16_t leader_node_edges[] PROGMEM = {\n");
+    for (unsigned n = 0; n < nodes; n++) {
+        printf("%s%u,", (n % 16) ? " " : "    ", edges);
+        for (unsigned c = 0; c < 256; c++) {
+            if (child[n][c]) edges++;
+        }
+        if (n % 16 == 15) printf("\n");
+    }
+    printf("%s%u\n};\n\n", (nodes % 16) ? " " : "    ", edges);
+
+    printf("static const uint8_t leader_node_id[] PROGMEM = {\n");
+    for (unsigned n = 0; n < nodes; n++) {
+        printf("%s0x%02X,", (n % 16) ? " " : "    ", id[n]);
+        if (n % 16 == 15) printf("\n");
+    }
+    if (nodes % 16) printf("\n");
+    printf("};\n\n");
+
+    /* keycode and child of edges, a line per node */
+    printf("static const uint8_t leader_edge_key[] PROGMEM = {\n");
+    for (unsigned n = 0; n < nodes; n++) {
+        int k = 0;
+        for (unsigned c = 0; c < 256; c++) {
+            if (child[n][c]) printf("%s0x%02X,", k++ ? " " : "    ", c);
+        }
+        if (k) printf("\n");
+    }
+    if (!edges) printf("    0\n");
+    printf("};\n\n");
+
+    printf("static const uint16_t leader_edge_node[] PROGMEM = {\n");
+    for (unsigned n = 0; n < nodes; n++) {
+        int k = 0;
+        for (unsigned c = 0; c < 256; c++) {
+            if (child[n][c]) printf("%s%u,", k++ ? " " : "    ", child[n][c]);
+        }
+        if (k) printf("\n");
+    }
+    if (!edges) printf("    0\n");
+    printf("};\n");
+
+    fprintf(stderr, "leader_trie: %u sequences in %u nodes, %lu bytes\n",
+            sequences, nodes, (unsigned long)(nodes * 3 + 2 + edges * 3));
+    return 0;
+}
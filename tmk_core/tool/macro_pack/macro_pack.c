@@ -0,0 +1,336 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Packs macros for common/action_macro.c(MACRO_PACK_ENABLE).
+ *
+ * Runs on build machine. Input is raw content of macro_sources[] dumped from
+ * object file with objcopy, output is macro_pack_data.h.
+ *
+ *   macro_pack <dump>
+ *
+ * Dump is macros of MACRO_SRC(): id and commands up to END. Key commands of
+ * two bytes are turned into one byte ones where keycode allows, then runs of
+ * commands found more than once are moved into a dictionary greedily, the run
+ * which saves most bytes first. A run is replaced with reference to its entry:
+ * one byte(MACRO_DICT_SHORT + n) for first MACRO_DICT_SHORTS entries, (DICT, n)
+ * for others. Entries end with END and hold no reference so that player needs
+ * only one place to return to.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/* from common/action_macro.h */
+#define END                 0x00
+#define KEY_DOWN            0x01
+#define KEY_UP              0x02
+#define WAIT                0x74
+#define INTERVAL            0x75
+#define FAST_TYPE           0x79
+#define DICT                0x7A
+#define MACRO_DICT_SHORT    0xF4
+#define MACRO_DICT_SHORTS   12
+
+#define MAX_DUMP        16384
+#define MAX_TOKENS      MAX_DUMP
+#define MAX_RUN         16          // commands in a dictionary entry
+#define MAX_ENTRIES     256
+#define NONE            0xFFFF
+
+/* command of one or two bytes, or reference to entry when ref is set */
+typedef struct {
+    uint8_t b[2];
+    uint8_t len;
+    uint8_t ref;
+    uint16_t entry;
+} token_t;
+
+typedef struct {
+    token_t *t;
+    unsigned n;
+} run_t;
+
+static run_t macros[256];
+static run_t entries[MAX_ENTRIES];
+static unsigned n_entries = 0;
+
+static unsigned ref_len(unsigned entry)
+{
+    return (entry < MACRO_DICT_SHORTS) ? 1 : 2;
+}
+
+static unsigned run_bytes(const token_t *t, unsigned n)
+{
+    unsigned bytes = 0;
+    for (unsigned i = 0; i < n; i++) bytes += t[i].ref ? ref_len(t[i].entry) : t[i].len;
+    return bytes;
+}
+
+static int token_eq(const token_t *a, const token_t *b)
+{
+    if (a->ref || b->ref) return 0;
+    return a->len == b->len && !memcmp(a->b, b->b, a->len);
+}
+
+
+/* candidate runs hashed by bytes */
+#define HASH_SIZE       (1 << 18)
+typedef struct {
+    const token_t *t;   // first occurrence
+    unsigned n;
+    unsigned count;     // occurrences not overlapping earlier one
+    const token_t *last_end;
+} cand_t;
+static cand_t cands[HASH_SIZE];
+
+static uint32_t run_hash(const token_t *t, unsigned n)
+{
+    uint32_t h = 2166136261u;
+    for (unsigned i = 0; i < n; i++) {
+        for (unsigned j = 0; j < t[i].len; j++) h = (h ^ t[i].b[j]) * 16777619u;
+        h = (h ^ 0xFF) * 16777619u;
+    }
+    return h;
+}
+
+static int run_eq(const token_t *a, const token_t *b, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {
+        if (!token_eq(&a[i], &b[i])) return 0;
+    }
+    return 1;
+}
+
+/* run of commands which saves most bytes as next entry, 0 when none saves */
+static int find_best(const token_t **best_t, unsigned *best_n)
+{
+    memset(cands, 0, sizeof(cands));
+    unsigned cost = ref_len(n_entries);
+    int best = 0;
+
+    for (unsigned m = 0; m < 256; m++) {
+        const token_t *t = macros[m].t;
+        for (unsigned i = 0; i < macros[m].n; i++) {
+            if (t[i].ref) continue;
+            for (unsigned n = 2; n <= MAX_RUN && i + n <= macros[m].n; n++) {
+                if (t[i + n - 1].ref) break;
+                uint32_t h = run_hash(&t[i], n) & (HASH_SIZE - 1);
+                while (cands[h].t && !(cands[h].n == n && run_eq(cands[h].t, &t[i], n))) {
+                    h = (h + 1) & (HASH_SIZE - 1);
+                }
+                cand_t *c = &cands[h];
+                if (!c->t) {
+                    *c = (cand_t){ .t = &t[i], .n = n };
+                }
+                // macros are in order in tokens[], earlier end is in this one
+                if (&t[i] < c->last_end) continue;
+                c->count++;
+                c->last_end = &t[i + n];
+
+                unsigned bytes = run_bytes(&t[i], n);
+                int saving = (int)(c->count * (bytes - cost)) - (int)(bytes + 1 + 2);
+                if (c->count > 1 && saving > best) {
+                    best = saving;
+                    *best_t = c->t;
+                    *best_n = n;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+/* moves run into entry and replaces its occurrences with reference */
+static void add_entry(const token_t *run, unsigned n)
+{
+    unsigned e = n_entries++;
+    entries[e].t = malloc(n * sizeof(token_t));
+    memcpy(entries[e].t, run, n * sizeof(token_t));
+    entries[e].n = n;
+
+    for (unsigned m = 0; m < 256; m++) {
+        token_t *t = macros[m].t;
+        unsigned j = 0;
+        for (unsigned i = 0; i < macros[m].n; ) {
+            if (i + n <= macros[m].n && run_eq(&t[i], entries[e].t, n)) {
+                t[j++] = (token_t){ .ref = 1, .entry = e };
+                i += n;
+            } else {
+                t[j++] = t[i++];
+            }
+        }
+        macros[m].n = j;
+    }
+}
+
+static void print_run(const run_t *r, unsigned *col)
+{
+    for (unsigned i = 0; i <= r->n; i++) {
+        uint8_t b[2];
+        unsigned len;
+        if (i == r->n) {
+            b[0] = END; len = 1;
+        } else if (r->t[i].ref) {
+            unsigned e = r->t[i].entry;
+            if (e < MACRO_DICT_SHORTS) { b[0] = MACRO_DICT_SHORT + e; len = 1; }
+            else                       { b[0] = DICT; b[1] = e; len = 2; }
+        } else {
+            memcpy(b, r->t[i].b, 2); len = r->t[i].len;
+        }
+        for (unsigned j = 0; j < len; j++) {
+            printf("%s0x%02X,", (*col % 16) ? " " : "    ", b[j]);
+            if (++*col % 16 == 0) printf("\n");
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <dump>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (!fp) {
+        perror(argv[1]);
+        return 1;
+    }
+    static uint8_t dump[MAX_DUMP];
+    size_t size = fread(dump, 1, sizeof(dump), fp);
+    fclose(fp);
+    if (size == sizeof(dump)) {
+        fprintf(stderr, "macro_pack: %s: too large\n", argv[1]);
+        return 1;
+    }
+
+    /* commands of each macro, two byte key commands made one byte */
+    static token_t tokens[MAX_TOKENS];
+    unsigned n_tokens = 0, n_macros = 0, ids = 0;
+    size_t raw = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t start = i;
+        uint8_t id = dump[i++];
+        if (macros[id].t) {
+            fprintf(stderr, "macro_pack: macro %u: id used twice\n", id);
+            return 1;
+        }
+        macros[id].t = &tokens[n_tokens];
+        for (;;) {
+            if (i == size) {
+                fprintf(stderr, "macro_pack: macro %u: no END at offset %zu\n", id, start);
+                return 1;
+            }
+            uint8_t c = dump[i++];
+            if (c == END) break;
+            token_t t = { .b = { c }, .len = 1 };
+            switch (c) {
+                case KEY_DOWN:
+                case KEY_UP:
+                case WAIT:
+                case INTERVAL:
+                    if (i == size) {
+                        fprintf(stderr, "macro_pack: macro %u: no argument at offset %zu\n", id, i - 1);
+                        return 1;
+                    }
+                    t.b[1] = dump[i++];
+                    t.len = 2;
+                    if (c == KEY_DOWN && 0x04 <= t.b[1] && t.b[1] <= 0x73) {
+                        t = (token_t){ .b = { t.b[1] }, .len = 1 };
+                    } else if (c == KEY_UP && 0x04 <= t.b[1] && t.b[1] <= 0x73) {
+                        t = (token_t){ .b = { t.b[1] | 0x80 }, .len = 1 };
+                    }
+                    break;
+                case 0x04 ... 0x73:
+                case 0x76 ... FAST_TYPE:
+                case 0x84 ... 0xF3:
+                    break;
+                default:
+                    fprintf(stderr, "macro_pack: macro %u: unknown command %02X at offset %zu\n", id, c, i - 1);
+                    return 1;
+            }
+            tokens[n_tokens++] = t;
+            macros[id].n++;
+        }
+        raw += i - start - 1;
+        n_macros++;
+        if (id + 1u > ids) ids = id + 1;
+    }
+
+    const token_t *run;
+    unsigned n;
+    while (n_entries < MAX_ENTRIES && find_best(&run, &n) > 0) {
+        // run points into a macro which add_entry() rewrites
+        token_t copy[MAX_RUN];
+        memcpy(copy, run, n * sizeof(token_t));
+        add_entry(copy, n);
+    }
+
+    printf("/* Generated by tool/macro_pack from %s, do not edit. */\n", argv[1]);
+    printf("#define MACRO_PACK_IDS      %u\n", ids);
+    printf("#define MACRO_PACK_NONE     0x%04X\n\n", NONE);
+
+    unsigned col = 0, dict = 0;
+    printf("static const macro_t macro_pack_dict[] PROGMEM = {\n");
+    for (unsigned e = 0; e < n_entries; e++) print_run(&entries[e], &col);
+    if (!n_entries) printf("    END");
+    if (col % 16 || !n_entries) printf("\n");
+    printf("};\n\n");
+
+    printf("static const uint16_t macro_pack_dict_index[] PROGMEM = {\n");
+    for (unsigned e = 0; e < n_entries; e++) {
+        printf("%s%u,", (e % 16) ? " " : "    ", dict);
+        dict += run_bytes(entries[e].t, entries[e].n) + 1;
+        if (e % 16 == 15) printf("\n");
+    }
+    if (!n_entries) printf("    0");
+    if (n_entries % 16 || !n_entries) printf("\n");
+    printf("};\n\n");
+
+    unsigned data = 0;
+    col = 0;
+    printf("static const macro_t macro_pack_data[] PROGMEM = {\n");
+    for (unsigned m = 0; m < ids; m++) {
+        if (macros[m].t) print_run(&macros[m], &col);
+    }
+    if (!n_macros) printf("    END");
+    if (col % 16 || !n_macros) printf("\n");
+    printf("};\n\n");
+
+    printf("static const uint16_t macro_pack_index[] PROGMEM = {\n");
+    for (unsigned m = 0; m < ids; m++) {
+        unsigned offset = NONE;
+        if (macros[m].t) {
+            offset = data;
+            data += run_bytes(macros[m].t, macros[m].n) + 1;
+        }
+        printf("%s0x%04X,", (m % 8) ? " " : "    ", offset);
+        if (m % 8 == 7) printf("\n");
+    }
+    if (!ids) printf("    MACRO_PACK_NONE");
+    if (ids % 8 || !ids) printf("\n");
+    printf("};\n");
+
+    fprintf(stderr, "macro_pack: %u macros of %lu bytes in %u bytes, %u dictionary entries\n",
+            n_macros, (unsigned long)raw,
+            data + dict + (n_entries + ids) * 2, n_entries);
+    return 0;
+}
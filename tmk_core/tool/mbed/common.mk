@@ -7,10 +7,13 @@ OBJECTS += \
 	$(OBJDIR)/common/host.o \
 	$(OBJDIR)/common/keymap.o \
 	$(OBJDIR)/common/keyboard.o \
+	$(OBJDIR)/common/matrix.o \
 	$(OBJDIR)/common/print.o \
 	$(OBJDIR)/common/debug.o \
 	$(OBJDIR)/common/util.o \
 	$(OBJDIR)/common/hook.o \
+	$(OBJDIR)/common/debounce.o \
+	$(OBJDIR)/common/deadline.o \
 	$(OBJDIR)/common/mbed/suspend.o \
 	$(OBJDIR)/common/mbed/timer.o \
 	$(OBJDIR)/common/mbed/xprintf.o \
@@ -25,6 +28,11 @@ CC_FLAGS += -include $(CONFIG_H)
 
 
 # Option modules
+ifdef COMBO_ENABLE
+    OBJECTS += $(OBJDIR)/common/action_combo.o
+    OPT_DEFS += -DCOMBO_ENABLE
+endif
+
 ifdef BOOTMAGIC_ENABLE
     $(error Not Supported)
     OBJECTS += $(OBJDIR)/common/bootmagic.o
@@ -39,7 +47,6 @@ ifdef MOUSEKEY_ENABLE
 endif
 
 ifdef EXTRAKEY_ENABLE
-    $(error Not Supported)
     OPT_DEFS += -DEXTRAKEY_ENABLE
 endif
 
@@ -58,7 +65,6 @@ ifdef COMMAND_ENABLE
 endif
 
 ifdef NKRO_ENABLE
-    $(error Not Supported)
     OPT_DEFS += -DNKRO_ENABLE
 endif
 
@@ -75,6 +81,20 @@ ifdef BACKLIGHT_ENABLE
     OPT_DEFS += -DBACKLIGHT_ENABLE
 endif
 
+ifdef LED_EFFECT_ENABLE
+    OBJECTS += $(OBJDIR)/common/led_effect.o
+    OPT_DEFS += -DLED_EFFECT_ENABLE
+endif
+
+ifdef LATENCY_TRACE_ENABLE
+    OBJECTS += $(OBJDIR)/common/latency.o
+    OPT_DEFS += -DLATENCY_TRACE_ENABLE
+endif
+
+ifdef RAMFUNC_ENABLE
+    OPT_DEFS += -DRAMFUNC_ENABLE
+endif
+
 ifdef KEYMAP_SECTION_ENABLE
     $(error Not Supported)
     OPT_DEFS += -DKEYMAP_SECTION_ENABLE
@@ -0,0 +1,376 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Replays key traces through keyboard_task() on the build machine.
+ *
+ * Trace file: one statement per line, '#' starts a comment.
+ *   <ms> d <row> <col>             press key at virtual time <ms>
+ *   <ms> u <row> <col>             release key
+ *   <ms> leds <hex>                host LED state
+ *   <ms> led_set <hex>             LEDs last given to led_set() must match
+ *   <ms> expect <mods> [<key>..]   next recorded report must match(hex)
+ *   <ms> end                       keep scanning until <ms>
+ * Time is relative to start of a run and must not decrease. Statements
+ * of a time are applied before the scan of that millisecond, so expect
+ * sees reports sent up to the previous scan.
+ *
+ * Matrix is scanned once per virtual millisecond.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyboard.h"
+#include "host.h"
+#include "action.h"
+#include "action_layer.h"
+#include "action_tapping.h"
+#include "action_util.h"
+#include "matrix.h"
+#include "timer.h"
+#include "sim.h"
+
+
+#define TRACE_MAX       4096
+#define EXPECT_KEYS     6
+/* idle scans after a run to settle tapping state */
+#define SETTLE_MS       (TAPPING_TERM * 2)
+
+enum {
+    T_PRESS,
+    T_RELEASE,
+    T_LEDS,
+    T_LED_SET,
+    T_EXPECT,
+    T_END,
+};
+
+typedef struct {
+    uint32_t time;
+    uint8_t  type;
+    uint8_t  row;
+    uint8_t  col;
+    uint8_t  mods;
+    uint8_t  nkeys;
+    uint8_t  keys[EXPECT_KEYS];
+    uint16_t line;
+} trace_t;
+
+typedef struct {
+    uint32_t scans;
+    uint32_t events;
+    uint32_t event_scans;
+    uint64_t cycles;
+    uint64_t event_cycles;
+    uint32_t reports;
+    uint32_t latency_sum;
+    uint32_t latency_max;
+    uint64_t report_cycles_sum;
+    uint64_t report_cycles_max;
+    uint32_t dropped;
+    uint32_t failures;
+} stat_t;
+
+static trace_t trace[TRACE_MAX];
+static uint16_t trace_len;
+static bool verbose = false;
+
+
+static int load_trace(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    char buf[256];
+    uint16_t line = 0;
+    uint32_t last = 0;
+    trace_len = 0;
+    while (fgets(buf, sizeof(buf), fp)) {
+        line++;
+        char *p = strchr(buf, '#');
+        if (p) *p = '\0';
+
+        char *tok = strtok(buf, " \t\r\n");
+        if (!tok) continue;
+
+        if (trace_len >= TRACE_MAX) {
+            fprintf(stderr, "%s:%u: too many statements\n", path, line);
+            goto error;
+        }
+        trace_t *t = &trace[trace_len];
+        memset(t, 0, sizeof(*t));
+        t->line = line;
+        t->time = strtoul(tok, NULL, 0);
+        if (t->time < last) {
+            fprintf(stderr, "%s:%u: time goes backward\n", path, line);
+            goto error;
+        }
+        last = t->time;
+
+        char *op = strtok(NULL, " \t\r\n");
+        if (!op) {
+            fprintf(stderr, "%s:%u: missing statement\n", path, line);
+            goto error;
+        }
+        if (!strcmp(op, "d") || !strcmp(op, "u")) {
+            char *r = strtok(NULL, " \t\r\n");
+            char *c = strtok(NULL, " \t\r\n");
+            if (!r || !c) {
+                fprintf(stderr, "%s:%u: need row and col\n", path, line);
+                goto error;
+            }
+            t->type = (op[0] == 'd') ? T_PRESS : T_RELEASE;
+            t->row = strtoul(r, NULL, 0);
+            t->col = strtoul(c, NULL, 0);
+            if (t->row >= MATRIX_ROWS || t->col >= MATRIX_COLS) {
+                fprintf(stderr, "%s:%u: key out of matrix\n", path, line);
+                goto error;
+            }
+        } else if (!strcmp(op, "leds")) {
+            char *v = strtok(NULL, " \t\r\n");
+            t->type = T_LEDS;
+            t->mods = v ? strtoul(v, NULL, 16) : 0;
+        } else if (!strcmp(op, "led_set")) {
+            char *v = strtok(NULL, " \t\r\n");
+            t->type = T_LED_SET;
+            t->mods = v ? strtoul(v, NULL, 16) : 0;
+        } else if (!strcmp(op, "expect")) {
+            char *v = strtok(NULL, " \t\r\n");
+            if (!v) {
+                fprintf(stderr, "%s:%u: expect needs mods\n", path, line);
+                goto error;
+            }
+            t->type = T_EXPECT;
+            t->mods = strtoul(v, NULL, 16);
+            while ((v = strtok(NULL, " \t\r\n"))) {
+                if (t->nkeys >= EXPECT_KEYS) {
+                    fprintf(stderr, "%s:%u: too many keys\n", path, line);
+                    goto error;
+                }
+                t->keys[t->nkeys++] = strtoul(v, NULL, 16);
+            }
+        } else if (!strcmp(op, "end")) {
+            t->type = T_END;
+        } else {
+            fprintf(stderr, "%s:%u: unknown statement: %s\n", path, line, op);
+            goto error;
+        }
+        trace_len++;
+    }
+    fclose(fp);
+    return 0;
+
+error:
+    fclose(fp);
+    return -1;
+}
+
+/* compare key set regardless of slot order */
+static bool report_match(const report_keyboard_t *r, const trace_t *t)
+{
+    if (r->mods != t->mods) return false;
+
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (!r->keys[i]) continue;
+        bool found = false;
+        for (uint8_t j = 0; j < t->nkeys; j++) {
+            if (r->keys[i] == t->keys[j]) found = true;
+        }
+        if (!found) return false;
+        n++;
+    }
+    return n == t->nkeys;
+}
+
+static void print_report(const report_keyboard_t *r)
+{
+    fprintf(stderr, "%02X |", r->mods);
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (r->keys[i]) fprintf(stderr, " %02X", r->keys[i]);
+    }
+}
+
+static void scan(stat_t *st, bool timed, uint8_t events)
+{
+    uint64_t start = sim_cycles();
+    sim_scan_start = start;
+    keyboard_task();
+    uint64_t c = sim_cycles() - start;
+    sim_timer_advance(1);
+
+    if (!timed) return;
+    st->scans++;
+    st->cycles += c;
+    if (events) {
+        st->events += events;
+        st->event_scans++;
+        st->event_cycles += c;
+    }
+}
+
+static void run(const char *path, stat_t *st, bool check)
+{
+    uint16_t next = 0;
+    uint16_t checked = 0;
+    uint32_t base = sim_timer_now();
+    uint32_t end = trace_len ? trace[trace_len - 1].time + 1 : 0;
+
+    sim_report_clear();
+    for (uint32_t t = 0; t < end; t++) {
+        uint8_t events = 0;
+        for (; next < trace_len && trace[next].time <= t; next++) {
+            trace_t *e = &trace[next];
+            switch (e->type) {
+                case T_PRESS:
+                case T_RELEASE:
+                    sim_matrix_set(e->row, e->col, e->type == T_PRESS);
+                    events++;
+                    break;
+                case T_LEDS:
+                    sim_set_leds(e->mods);
+                    break;
+                case T_LED_SET:
+                    if (!check || sim_led_get() == e->mods) break;
+                    st->failures++;
+                    fprintf(stderr, "%s:%u: at %u ms: led_set %02X but %02X\n",
+                            path, e->line, t, e->mods, sim_led_get());
+                    break;
+                case T_EXPECT:
+                    if (!check) break;
+                    {
+                        const sim_report_t *r = sim_report_get(checked++);
+                        if (!r || !report_match(&r->report, e)) {
+                            st->failures++;
+                            fprintf(stderr, "%s:%u: at %u ms: expect %02X |",
+                                    path, e->line, t, e->mods);
+                            for (uint8_t i = 0; i < e->nkeys; i++) {
+                                fprintf(stderr, " %02X", e->keys[i]);
+                            }
+                            fprintf(stderr, " but ");
+                            if (r) {
+                                print_report(&r->report);
+                                fprintf(stderr, " (sent at %u ms)\n", r->time - base);
+                            } else {
+                                fprintf(stderr, "no report\n");
+                            }
+                        }
+                    }
+                    break;
+                case T_END:
+                    break;
+            }
+        }
+        scan(st, true, events);
+    }
+
+    for (uint16_t i = 0; i < sim_report_count(); i++) {
+        const sim_report_t *r = sim_report_get(i);
+        uint32_t latency = r->time - r->input_time;
+        st->reports++;
+        st->latency_sum += latency;
+        if (latency > st->latency_max) st->latency_max = latency;
+        st->report_cycles_sum += r->cycles;
+        if (r->cycles > st->report_cycles_max) st->report_cycles_max = r->cycles;
+        if (verbose && check) {
+            fprintf(stderr, "  %5u ms: ", r->time - base);
+            print_report(&r->report);
+            fprintf(stderr, "\n");
+        }
+    }
+    st->dropped += sim_report_dropped();
+    if (check && sim_bootloader_count()) {
+        st->failures++;
+        fprintf(stderr, "%s: bootloader jump\n", path);
+    }
+
+    /* release everything and settle so that next run starts from scratch */
+    matrix_init();
+    for (uint32_t t = 0; t < SETTLE_MS; t++) {
+        scan(st, false, 0);
+    }
+    clear_keyboard();
+#ifndef NO_ACTION_LAYER
+    layer_clear();
+#endif
+    default_layer_set(0);
+    sim_set_leds(0);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n runs] [-v] trace...\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t runs = 1000;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            runs = strtoul(argv[++i], NULL, 0);
+            if (!runs) runs = 1;
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (i == argc) usage(argv[0]);
+
+    host_set_driver(&sim_driver);
+    keyboard_setup();
+    keyboard_init();
+
+    uint32_t failures = 0;
+    printf("%-32s %6s %6s %8s %10s %10s %8s %9s %8s\n",
+           "trace", "events", "scans", "reports",
+           "cyc/scan", "cyc/event", "lat(ms)", "max(ms)", "cyc/rep");
+    for (; i < argc; i++) {
+        if (load_trace(argv[i]) < 0) {
+            failures++;
+            continue;
+        }
+
+        stat_t st = {};
+        for (uint32_t n = 0; n < runs; n++) {
+            run(argv[i], &st, n == 0);
+        }
+        failures += st.failures;
+
+        uint32_t idle = st.scans - st.event_scans;
+        printf("%-32s %6u %6u %8u %10.1f %10.1f %8.2f %9u %8.1f%s\n",
+               argv[i], st.events / runs, st.scans / runs, st.reports / runs,
+               idle ? (double)(st.cycles - st.event_cycles) / idle : 0.0,
+               st.events ? (double)st.event_cycles / st.events : 0.0,
+               st.reports ? (double)st.latency_sum / st.reports : 0.0,
+               st.latency_max,
+               st.reports ? (double)st.report_cycles_sum / st.reports : 0.0,
+               st.failures ? "  FAIL" : "");
+        if (st.dropped) {
+            printf("  warning: %u reports not recorded\n", st.dropped);
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include "keycode.h"
+#include "action.h"
+#include "action_code.h"
+#include "keymap.h"
+#include "action_macro.h"
+#include "action_combo.h"
+#include "action_leader.h"
+
+
+/*
+ * Benchmark keymap: gh60-like 5x14 matrix with eight layers.
+ * Layers 1-7 are mostly transparent so that layer resolution has to walk
+ * down the stack, which is the common case on real keymaps.
+ *
+ * Matrix positions used by traces/NAME.trace:
+ *   row 0: Esc 1 2 3 4 5 6 7 8 9 0 - = Bspc
+ *   row 1: Tab Q W E R T Y U I O P [ ] \
+ *   row 2: Fn2(Ctl/Esc) A S D F G H J K L ; ' Enter Fn5(macro)
+ *   row 3: LShift Z X C V B N M , . / RShift Fn4(MO7) Fn3(TG3)
+ *   row 4: LCtl LGui LAlt Fn0(LT1/Space) Fn1(MO2) RAlt RGui App RCtl Fn6(macro)
+ *          Fn7(leader) Fn8(macro)
+ *
+ * Combos: 2+3 Esc, 2+3+4 Tab, 5+6 Enter
+ * Leader: G S, G, D D
+ * Macros: macro_sources[] with MACRO_PACK_ENABLE, same as MACRO() otherwise
+ */
+#define KEYMAP( \
+    K00, K01, K02, K03, K04, K05, K06, K07, K08, K09, K0A, K0B, K0C, K0D, \
+    K10, K11, K12, K13, K14, K15, K16, K17, K18, K19, K1A, K1B, K1C, K1D, \
+    K20, K21, K22, K23, K24, K25, K26, K27, K28, K29, K2A, K2B, K2C, K2D, \
+    K30, K31, K32, K33, K34, K35, K36, K37, K38, K39, K3A, K3B, K3C, K3D, \
+    K40, K41, K42, K43, K44, K45, K46, K47, K48, K49, K4A, K4B, K4C, K4D  \
+) { \
+    { KC_##K00, KC_##K01, KC_##K02, KC_##K03, KC_##K04, KC_##K05, KC_##K06, \
+      KC_##K07, KC_##K08, KC_##K09, KC_##K0A, KC_##K0B, KC_##K0C, KC_##K0D }, \
+    { KC_##K10, KC_##K11, KC_##K12, KC_##K13, KC_##K14, KC_##K15, KC_##K16, \
+      KC_##K17, KC_##K18, KC_##K19, KC_##K1A, KC_##K1B, KC_##K1C, KC_##K1D }, \
+    { KC_##K20, KC_##K21, KC_##K22, KC_##K23, KC_##K24, KC_##K25, KC_##K26, \
+      KC_##K27, KC_##K28, KC_##K29, KC_##K2A, KC_##K2B, KC_##K2C, KC_##K2D }, \
+    { KC_##K30, KC_##K31, KC_##K32, KC_##K33, KC_##K34, KC_##K35, KC_##K36, \
+      KC_##K37, KC_##K38, KC_##K39, KC_##K3A, KC_##K3B, KC_##K3C, KC_##K3D }, \
+    { KC_##K40, KC_##K41, KC_##K42, KC_##K43, KC_##K44, KC_##K45, KC_##K46, \
+      KC_##K47, KC_##K48, KC_##K49, KC_##K4A, KC_##K4B, KC_##K4C, KC_##K4D }  \
+}
+
+#define KEYMAP_TRNS KEYMAP( \
+    TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+    TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+    TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+    TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+    TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS)
+
+const uint8_t keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    /* 0: qwerty */
+    KEYMAP(ESC, 1,   2,   3,   4,   5,   6,   7,   8,   9,   0,   MINS,EQL, BSPC, \
+           TAB, Q,   W,   E,   R,   T,   Y,   U,   I,   O,   P,   LBRC,RBRC,BSLS, \
+           FN2, A,   S,   D,   F,   G,   H,   J,   K,   L,   SCLN,QUOT,ENT, FN5,  \
+           LSFT,Z,   X,   C,   V,   B,   N,   M,   COMM,DOT, SLSH,RSFT,FN4, FN3,  \
+           LCTL,LGUI,LALT,FN0, FN1, RALT,RGUI,APP, RCTL,FN6, FN7, FN8, NO,  NO),
+    /* 1: space layer, cursor keys, Bootloader never pressed by traces */
+    KEYMAP(GRV, F1,  F2,  F3,  F4,  F5,  F6,  F7,  F8,  F9,  F10, F11, F12, DEL,  \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,PGUP,UP,  PGDN,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,HOME,LEFT,DOWN,RGHT,END, TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,BTLD),
+    /* 2: keypad */
+    KEYMAP(TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,P7,  P8,  P9,  PSLS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,P4,  P5,  P6,  PAST,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,P1,  P2,  P3,  PMNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,P0,  TRNS,PDOT,PPLS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS),
+    /* 3: toggled, swaps Z and Y, LShift is RShift/Z */
+    KEYMAP(TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,Z,   TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           FN9, Y,   TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS),
+    /* 4-6: empty, only deepen the layer stack */
+    KEYMAP_TRNS,
+    KEYMAP_TRNS,
+    KEYMAP_TRNS,
+    /* 7: media keys on number row */
+    KEYMAP(TRNS,MUTE,VOLD,VOLU,MPRV,MPLY,MNXT,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS, \
+           TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS),
+};
+
+const action_t fn_actions[] = {
+    [0] = ACTION_LAYER_TAP_KEY(1, KC_SPACE),
+    [1] = ACTION_LAYER_MOMENTARY(2),
+    [2] = ACTION_MODS_TAP_KEY(MOD_LCTL, KC_ESC),
+    [3] = ACTION_LAYER_TOGGLE(3),
+    [4] = ACTION_LAYER_ON_OFF(7),
+    [5] = ACTION_MACRO(0),
+    [6] = ACTION_MACRO(1),
+    [7] = ACTION_LEADER(),
+    [8] = ACTION_MACRO(2),
+    [9] = ACTION_MODS_TAP_KEY(MOD_RSFT, KC_Z),
+};
+
+/* repeated words go to dictionary, second half is fast typed across entries */
+#define MACRO_0     I(10), T(A), W(50), D(LSFT), T(B), U(LSFT), END
+#define MACRO_1     I(10), FT(), T(A), T(B), T(A), SFT_(T(C), T(D)), T(E), END
+#define MACRO_2     T(T), T(H), T(E), T(SPC), T(C), T(A), T(T), T(SPC), \
+                    FT(), T(T), T(H), T(E), T(SPC), T(H), T(A), T(T), END
+
+#ifdef MACRO_PACK_ENABLE
+const macro_t macro_sources[] PROGMEM = {
+    MACRO_SRC(0, MACRO_0),
+    MACRO_SRC(1, MACRO_1),
+    MACRO_SRC(2, MACRO_2),
+};
+
+const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt)
+{
+    (void)opt;
+    return (record->event.pressed ? macro_pack_get(id) : MACRO_NONE);
+}
+#else
+const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt)
+{
+    (void)opt;
+    if (!record->event.pressed) return MACRO_NONE;
+    switch (id) {
+        case 0: return MACRO( MACRO_0 );
+        case 1: return MACRO( MACRO_1 );
+        case 2: return MACRO( MACRO_2 );
+    }
+    return MACRO_NONE;
+}
+#endif
+
+#ifdef COMBO_ENABLE
+const combo_t combos[] PROGMEM = {
+    COMBO(ACTION_KEY(KC_ESC), COMBO_KEY(0, 2), COMBO_KEY(0, 3)),
+    COMBO(ACTION_KEY(KC_TAB), COMBO_KEY(0, 2), COMBO_KEY(0, 3), COMBO_KEY(0, 4)),
+    COMBO(ACTION_KEY(KC_ENT), COMBO_KEY(0, 5), COMBO_KEY(0, 6)),
+    COMBO_END
+};
+#endif
+
+#ifdef LEADER_ENABLE
+const uint8_t leader_sequences[] PROGMEM = {
+    LEADER_SEQ(0, KC_G, KC_S),
+    LEADER_SEQ(1, KC_G),
+    LEADER_SEQ(2, KC_D, KC_D),
+};
+
+const macro_t *leader_get_macro(uint8_t id)
+{
+    switch (id) {
+        case 0: return MACRO( T(X), END );
+        case 1: return MACRO( T(Y), END );
+        case 2: return MACRO( T(Z), END );
+    }
+    return MACRO_NONE;
+}
+#endif
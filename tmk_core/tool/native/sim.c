@@ -0,0 +1,216 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Fake platform for native build: matrix, timer, USB host and the few
+ * MCU services tmk_core/common expects.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "matrix.h"
+#include "timer.h"
+#include "wait.h"
+#include "led.h"
+#include "host.h"
+#include "bootloader.h"
+#include "debounce.h"
+#include "sendchar.h"
+#include "sim.h"
+
+
+/*
+ * Timer
+ */
+volatile uint32_t timer_count = 0;
+
+void timer_init(void) {}
+void timer_clear(void) { timer_count = 0; }
+uint16_t timer_read(void) { return (uint16_t)(timer_count & 0xFFFF); }
+uint32_t timer_read32(void) { return timer_count; }
+
+uint16_t timer_elapsed(uint16_t last)
+{
+    return TIMER_DIFF_16(timer_read(), last);
+}
+
+uint32_t timer_elapsed32(uint32_t last)
+{
+    return TIMER_DIFF_32(timer_read32(), last);
+}
+
+uint32_t timer_read_us(void) { return timer_count * 1000; }
+
+uint32_t timer_elapsed_us(uint32_t last)
+{
+    return TIMER_DIFF_32(timer_read_us(), last);
+}
+
+void sim_timer_set(uint32_t ms) { timer_count = ms; }
+uint32_t sim_timer_now(void) { return timer_count; }
+void sim_timer_advance(uint32_t ms) { timer_count += ms; }
+
+/* busy waits in the core just move virtual time forward */
+void wait_ms(uint16_t ms) { timer_count += ms; }
+void wait_us(uint16_t us) { (void)us; }
+
+/* console output such as event_trace goes to stderr */
+int8_t sendchar(uint8_t c)
+{
+    fputc(c, stderr);
+    return 0;
+}
+
+
+/*
+ * Matrix
+ */
+/* switch state set by trace and debounced state seen by keyboard.c */
+static matrix_row_t sim_matrix[MATRIX_ROWS];
+static matrix_row_t matrix[MATRIX_ROWS];
+static bool sim_changed = false;
+static matrix_rows_t changed_rows = 0;
+static uint32_t last_change = 0;
+
+void matrix_setup(void) {}
+void matrix_init(void)
+{
+    memset(sim_matrix, 0, sizeof(sim_matrix));
+    memset(matrix, 0, sizeof(matrix));
+    sim_changed = false;
+    changed_rows = 0;
+    debounce_init();
+}
+uint8_t matrix_scan(void)
+{
+    if (debounce(sim_matrix, matrix, sim_changed)) changed_rows = MATRIX_ROWS_ALL;
+    sim_changed = false;
+    return 1;
+}
+matrix_rows_t matrix_changed_rows(void)
+{
+    matrix_rows_t rows = changed_rows;
+    changed_rows = 0;
+    return rows;
+}
+uint8_t matrix_rows(void) { return MATRIX_ROWS; }
+uint8_t matrix_cols(void) { return MATRIX_COLS; }
+matrix_row_t matrix_get_row(uint8_t row) { return matrix[row]; }
+bool matrix_is_on(uint8_t row, uint8_t col) { return matrix[row] & ((matrix_row_t)1<<col); }
+void matrix_print(void) {}
+void matrix_power_up(void) {}
+void matrix_power_down(void) {}
+
+void sim_matrix_set(uint8_t row, uint8_t col, bool on)
+{
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return;
+    if (on) {
+        sim_matrix[row] |=  ((matrix_row_t)1<<col);
+    } else {
+        sim_matrix[row] &= ~((matrix_row_t)1<<col);
+    }
+    sim_changed = true;
+    last_change = timer_count;
+}
+
+bool sim_matrix_any(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (sim_matrix[r]) return true;
+    }
+    return false;
+}
+
+
+/*
+ * Host driver
+ */
+uint8_t keyboard_idle = 0;
+uint8_t keyboard_protocol = 1;
+
+static uint8_t sim_leds = 0;
+static uint8_t sim_led_state = 0;
+static sim_report_t report_log[SIM_REPORT_LOG_SIZE];
+static uint16_t report_log_count = 0;
+static uint32_t report_dropped = 0;
+static uint32_t extra_count = 0;
+static uint32_t bootloader_count = 0;
+uint64_t sim_scan_start = 0;
+
+static uint8_t keyboard_leds(void) { return sim_leds; }
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    if (report_log_count >= SIM_REPORT_LOG_SIZE) {
+        report_dropped++;
+        return;
+    }
+    report_log[report_log_count++] = (sim_report_t){
+        .time = timer_count,
+        .input_time = last_change,
+        .cycles = sim_cycles() - sim_scan_start,
+        .report = *report
+    };
+}
+
+static void send_mouse(report_mouse_t *report) { (void)report; extra_count++; }
+static void send_system(uint16_t data) { (void)data; extra_count++; }
+static void send_consumer(uint16_t data) { (void)data; extra_count++; }
+
+host_driver_t sim_driver = {
+    keyboard_leds,
+    send_keyboard,
+    send_mouse,
+    send_system,
+    send_consumer
+};
+
+/* as SET_REPORT of USB, keyboard_task() reads LEDs on change only */
+void sim_set_leds(uint8_t leds)
+{
+    sim_leds = leds;
+    host_keyboard_leds_changed();
+}
+
+uint8_t sim_led_get(void) { return sim_led_state; }
+
+void sim_report_clear(void)
+{
+    report_log_count = 0;
+    report_dropped = 0;
+    extra_count = 0;
+    bootloader_count = 0;
+}
+
+uint16_t sim_report_count(void) { return report_log_count; }
+uint32_t sim_report_dropped(void) { return report_dropped; }
+uint32_t sim_extra_count(void) { return extra_count; }
+uint32_t sim_bootloader_count(void) { return bootloader_count; }
+
+const sim_report_t *sim_report_get(uint16_t index)
+{
+    if (index >= report_log_count) return 0;
+    return &report_log[index];
+}
+
+
+/*
+ * MCU services
+ */
+void led_set(uint8_t usb_led) { sim_led_state = usb_led; }
+void bootloader_jump(void) { bootloader_count++; }
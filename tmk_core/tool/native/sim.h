@@ -0,0 +1,79 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "report.h"
+#include "host_driver.h"
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#else
+#   include <time.h>
+#endif
+
+
+/* Recorded host report */
+typedef struct {
+    uint32_t time;          /* virtual ms when report was sent */
+    uint32_t input_time;    /* virtual ms of latest matrix change before it */
+    uint64_t cycles;        /* cycles since start of the scan which sent it */
+    report_keyboard_t report;
+} sim_report_t;
+
+#define SIM_REPORT_LOG_SIZE 1024
+
+extern host_driver_t sim_driver;
+extern uint64_t sim_scan_start;
+
+
+/* cycle counter: TSC on x86, nanoseconds elsewhere */
+static inline uint64_t sim_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* virtual clock: timer_read() returns this, wait_ms() advances it */
+void sim_timer_set(uint32_t ms);
+uint32_t sim_timer_now(void);
+void sim_timer_advance(uint32_t ms);
+
+/* fake matrix fed by trace */
+void sim_matrix_set(uint8_t row, uint8_t col, bool on);
+bool sim_matrix_any(void);
+
+/* host LED state returned to keyboard, and last one given to led_set() */
+void sim_set_leds(uint8_t leds);
+uint8_t sim_led_get(void);
+
+/* recording host driver */
+void sim_report_clear(void);
+uint16_t sim_report_count(void);
+const sim_report_t *sim_report_get(uint16_t index);
+uint32_t sim_report_dropped(void);
+uint32_t sim_extra_count(void);
+/* bootloader_jump() calls, no trace takes one */
+uint32_t sim_bootloader_count(void);
+
+#endif
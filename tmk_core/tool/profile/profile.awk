@@ -0,0 +1,74 @@
+# Samples of sampling profiler(PROFILE_ENABLE) per function
+#
+#   avr-nm -n keyboard.elf | awk -f profile.awk - console.log | sort -rn
+#
+# First input is symbols of nm -n, second is console output with Magic+P,
+# the last dump in it is used. A bucket covers 2^shift bytes and its count
+# is shared among functions in it by bytes each has there, so small
+# functions in one bucket get fractions. Thumb bit of ARM symbols is
+# ignored.
+
+function hex(s,    n, i)
+{
+    n = 0
+    s = tolower(s)
+    sub(/^0x/, "", s)
+    for (i = 1; i <= length(s); i++)
+        n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    return n
+}
+
+BEGIN { nsym = 0; nbucket = 0 }
+
+# symbols: "address type name", code only; AVR flash is below 1MB
+FNR == NR {
+    if (NF >= 3 && $2 ~ /^[TtWw]$/) {
+        a = hex($1)
+        if (a % 2 && a >= 1048576) a--
+        sym_addr[nsym] = a
+        sym_name[nsym] = $3
+        nsym++
+    }
+    next
+}
+
+/^profile: / {
+    nbucket = 0
+    samples = $2
+    out = $4
+    size = 2 ^ $7
+    in_dump = 1
+    next
+}
+
+in_dump && $1 ~ /^[0-9A-Fa-f]+$/ && $2 ~ /^[0-9]+$/ && NF == 2 {
+    bucket_addr[nbucket] = hex($1)
+    bucket_count[nbucket] = $2
+    nbucket++
+    next
+}
+
+{ in_dump = 0 }
+
+END {
+    for (b = 0; b < nbucket; b++) {
+        lo = bucket_addr[b]
+        hi = lo + size
+        left = bucket_count[b]
+        for (i = 0; i < nsym; i++) {
+            s = sym_addr[i]
+            e = (i + 1 < nsym) ? sym_addr[i + 1] : s
+            if (e <= lo || s >= hi) continue
+            if (s < lo) s = lo
+            if (e > hi) e = hi
+            n = bucket_count[b] * (e - s) / size
+            total[sym_name[i]] += n
+            left -= n
+        }
+        if (left > 0.0001) total["(no symbol)"] += left
+    }
+    if (out) total["(out of range)"] += out
+    for (f in total) {
+        printf "%8.1f %5.1f%%  %s\n", total[f], samples ? total[f] * 100 / samples : 0, f
+    }
+}
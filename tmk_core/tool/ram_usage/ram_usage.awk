@@ -0,0 +1,42 @@
+# Static RAM of each object from linker map file(-Map)
+#
+#   awk -f ram_usage.awk keyboard.map | sort -rn
+#
+# Sums input sections of .data, .bss, .noinit and COMMON per object, objects
+# are sorted with sort -rn. Sections discarded by --gc-sections are listed
+# before the memory map and not counted. Section name longer than its column
+# puts address and size on the next line.
+
+function hex(s,    n, i)
+{
+    n = 0
+    s = tolower(s)
+    sub(/^0x/, "", s)
+    for (i = 1; i <= length(s); i++)
+        n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    return n
+}
+
+function add(size, obj)
+{
+    size = hex(size)
+    if (!size) return
+    ram[obj] += size
+    total += size
+}
+
+/^Linker script and memory map/ { in_map = 1; next }
+!in_map { next }
+
+wrapped && NF == 3 && $1 ~ /^0x/ { add($2, $3); wrapped = 0; next }
+{ wrapped = 0 }
+
+/^ / && ($1 ~ /^\.(data|bss|noinit)(\..*)?$/ || $1 == "COMMON") {
+    if (NF == 1) wrapped = 1
+    else if (NF >= 4 && $2 ~ /^0x/) add($3, $4)
+}
+
+END {
+    for (obj in ram) printf "%6d  %s\n", ram[obj], obj
+    printf "%6d  total\n", total
+}
@@ -0,0 +1,152 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Firmware side of simavr_bench: matrix and host driver talk to the
+ * simulator through the mailbox of sim_avr.h, timer and everything else
+ * are real AVR code.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "matrix.h"
+#include "keyboard.h"
+#include "led.h"
+#include "host.h"
+#include "host_driver.h"
+#include "bootloader.h"
+#include "debounce.h"
+#include "sendchar.h"
+#include "sim_avr.h"
+
+
+#define SIM_MARK(m)     (_SFR_IO8(SIM_MARK_IO) = (m))
+#define SIM_READ()      (_SFR_IO8(SIM_DATA_IO))
+#define SIM_WRITE(v)    (_SFR_IO8(SIM_DATA_IO) = (v))
+
+
+/*
+ * Matrix
+ */
+static matrix_row_t sim_matrix[MATRIX_ROWS];
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_rows_t changed_rows = 0;
+
+void matrix_setup(void) {}
+void matrix_init(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        sim_matrix[r] = 0;
+        matrix[r] = 0;
+    }
+    changed_rows = 0;
+    debounce_init();
+}
+uint8_t matrix_scan(void)
+{
+    SIM_MARK(SIM_MATRIX);
+    bool changed = SIM_READ();
+    if (changed) {
+        for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+            matrix_row_t row = 0;
+            for (uint8_t i = 0; i < sizeof(matrix_row_t); i++) {
+                row |= (matrix_row_t)SIM_READ() << (i * 8);
+            }
+            sim_matrix[r] = row;
+        }
+    }
+    if (debounce(sim_matrix, matrix, changed)) changed_rows = MATRIX_ROWS_ALL;
+    return 1;
+}
+matrix_rows_t matrix_changed_rows(void)
+{
+    matrix_rows_t rows = changed_rows;
+    changed_rows = 0;
+    return rows;
+}
+uint8_t matrix_rows(void) { return MATRIX_ROWS; }
+uint8_t matrix_cols(void) { return MATRIX_COLS; }
+matrix_row_t matrix_get_row(uint8_t row) { return matrix[row]; }
+bool matrix_is_on(uint8_t row, uint8_t col) { return matrix[row] & ((matrix_row_t)1<<col); }
+void matrix_print(void) {}
+void matrix_power_up(void) {}
+void matrix_power_down(void) {}
+
+
+/*
+ * Host driver in place of LUFA
+ */
+uint8_t keyboard_idle = 0;
+uint8_t keyboard_protocol = 1;
+static uint8_t sim_leds = 0;
+
+static uint8_t keyboard_leds(void)
+{
+    return sim_leds;
+}
+
+/* polled between passes, change reaches keyboard_task() as SET_REPORT of USB */
+static void leds_poll(void)
+{
+    SIM_MARK(SIM_LEDS);
+    uint8_t leds = SIM_READ();
+    if (leds == sim_leds) return;
+    sim_leds = leds;
+    host_keyboard_leds_changed();
+}
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    SIM_MARK(SIM_REPORT);
+    SIM_WRITE(KEYBOARD_REPORT_SIZE);
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_SIZE; i++) SIM_WRITE(report->raw[i]);
+}
+
+static void send_mouse(report_mouse_t *report) { (void)report; SIM_MARK(SIM_EXTRA); }
+static void send_system(uint16_t data) { (void)data; SIM_MARK(SIM_EXTRA); }
+static void send_consumer(uint16_t data) { (void)data; SIM_MARK(SIM_EXTRA); }
+
+static host_driver_t sim_driver = {
+    keyboard_leds,
+    send_keyboard,
+    send_mouse,
+    send_system,
+    send_consumer
+};
+
+
+/*
+ * MCU services
+ */
+int8_t sendchar(uint8_t c) { (void)c; return 0; }
+void led_set(uint8_t usb_led) { SIM_MARK(SIM_LED_SET); SIM_WRITE(usb_led); }
+void bootloader_jump(void) {}
+
+int main(void)
+{
+    host_set_driver(&sim_driver);
+    keyboard_setup();
+    keyboard_init();
+    sei();
+
+    for (;;) {
+        leds_poll();
+        SIM_MARK(SIM_TASK);
+        keyboard_task();
+        SIM_MARK(SIM_TASK_END);
+    }
+}
@@ -0,0 +1,50 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SIM_AVR_H
+#define SIM_AVR_H
+
+/*
+ * Mailbox between firmware under simavr and simavr_bench
+ *
+ * Firmware writes a mark to GPIOR0 and moves data bytes through GPIOR1
+ * after it, simavr_bench hooks both registers and takes cycle count of
+ * the simulated core at each mark:
+ *
+ *   SIM_TASK       keyboard_task() starts
+ *   SIM_TASK_END   keyboard_task() returns
+ *   SIM_MATRIX     read: changed(0/1), then rows low byte first if changed
+ *   SIM_LEDS       read: host LED state
+ *   SIM_REPORT     write: length, then bytes of keyboard report
+ *   SIM_EXTRA      mouse, system or consumer report
+ *   SIM_LED_SET    write: LED state given to led_set()
+ */
+#define SIM_TASK        1
+#define SIM_TASK_END    2
+#define SIM_MATRIX      3
+#define SIM_LEDS        4
+#define SIM_REPORT      5
+#define SIM_EXTRA       6
+#define SIM_LED_SET     7
+
+/* I/O address of GPIOR0 and GPIOR1 of ATmega32U4/32U2/AT90USB, data space
+ * address is 0x20 higher */
+#define SIM_MARK_IO     0x1E
+#define SIM_DATA_IO     0x2A
+#define SIM_MARK_ADDR   (SIM_MARK_IO + 0x20)
+#define SIM_DATA_ADDR   (SIM_DATA_IO + 0x20)
+
+#endif
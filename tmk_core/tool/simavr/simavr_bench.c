@@ -0,0 +1,522 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Runs firmware of sim_avr.c under simavr with key traces of tool/native
+ * and counts cycles of the simulated AVR in each keyboard_task() pass.
+ *
+ *   simavr_bench [-v] [-j] firmware.elf trace...
+ *
+ * Trace format is that of tool/native/bench.c. Virtual time is cycles of
+ * the core over F_CPU, and statements of a time are applied at start of
+ * the first pass in that millisecond; firmware runs its main loop freely,
+ * so there are many passes in a millisecond as on the real part. A pass
+ * with events is one whose matrix_scan() got changes of the trace. Latency
+ * is from a change of the trace to the next report, debounce included; a
+ * change which sends no report, like a layer key, counts until the next.
+ *
+ * -j prints a JSON object per trace in place of the table, for scripts like
+ * tool/bench_matrix.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include "sim_avr.h"
+
+
+#define TRACE_MAX       4096
+#define EXPECT_KEYS     6
+#define REPORT_MAX      1024
+#define REPORT_SIZE_MAX 32
+
+#if MATRIX_COLS <= 8
+#   define ROW_BYTES    1
+#elif MATRIX_COLS <= 16
+#   define ROW_BYTES    2
+#else
+#   define ROW_BYTES    4
+#endif
+
+enum {
+    T_PRESS,
+    T_RELEASE,
+    T_LEDS,
+    T_LED_SET,
+    T_EXPECT,
+    T_END,
+};
+
+typedef struct {
+    uint32_t time;
+    uint8_t  type;
+    uint8_t  row;
+    uint8_t  col;
+    uint8_t  mods;
+    uint8_t  nkeys;
+    uint8_t  keys[EXPECT_KEYS];
+    uint16_t line;
+} trace_t;
+
+typedef struct {
+    uint32_t time;
+    uint8_t  size;
+    uint8_t  raw[REPORT_SIZE_MAX];
+} report_t;
+
+typedef struct {
+    avr_t   *avr;
+    const char *path;
+    uint64_t cycles_per_ms;
+    uint64_t base;
+    bool     started;
+    bool     done;
+    uint16_t next;
+    uint16_t checked;
+    uint32_t end;
+
+    /* mailbox */
+    uint8_t  mark;
+    uint8_t  in[1 + MATRIX_ROWS * ROW_BYTES];
+    uint8_t  in_len;
+    uint8_t  in_pos;
+    uint8_t  out_len;
+    uint8_t  out_pos;
+    uint8_t  out[REPORT_SIZE_MAX];
+
+    /* host side state */
+    uint32_t rows[MATRIX_ROWS];
+    bool     changed;
+    uint8_t  pending_events;
+    uint8_t  pass_events;
+    uint8_t  leds;
+    uint8_t  led_state;
+    report_t reports[REPORT_MAX];
+    uint16_t report_count;
+
+    /* stats */
+    uint64_t task_start;
+    uint32_t passes;
+    uint32_t events;
+    uint32_t event_passes;
+    uint64_t cycles;
+    uint64_t event_cycles;
+    uint64_t max_cycles;
+    uint32_t extras;
+    uint32_t failures;
+    bool     latency_pending;
+    uint64_t latency_start;
+    uint64_t latency_cycles;
+    uint64_t latency_max;
+    uint32_t latency_count;
+} sim_t;
+
+static trace_t trace[TRACE_MAX];
+static uint16_t trace_len;
+static bool verbose = false;
+static bool json = false;
+
+
+static int load_trace(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    char buf[256];
+    uint16_t line = 0;
+    uint32_t last = 0;
+    trace_len = 0;
+    while (fgets(buf, sizeof(buf), fp)) {
+        line++;
+        char *p = strchr(buf, '#');
+        if (p) *p = '\0';
+
+        char *tok = strtok(buf, " \t\r\n");
+        if (!tok) continue;
+
+        if (trace_len >= TRACE_MAX) {
+            fprintf(stderr, "%s:%u: too many statements\n", path, line);
+            goto error;
+        }
+        trace_t *t = &trace[trace_len];
+        memset(t, 0, sizeof(*t));
+        t->line = line;
+        t->time = strtoul(tok, NULL, 0);
+        if (t->time < last) {
+            fprintf(stderr, "%s:%u: time goes backward\n", path, line);
+            goto error;
+        }
+        last = t->time;
+
+        char *op = strtok(NULL, " \t\r\n");
+        if (!op) {
+            fprintf(stderr, "%s:%u: missing statement\n", path, line);
+            goto error;
+        }
+        if (!strcmp(op, "d") || !strcmp(op, "u")) {
+            char *r = strtok(NULL, " \t\r\n");
+            char *c = strtok(NULL, " \t\r\n");
+            if (!r || !c) {
+                fprintf(stderr, "%s:%u: need row and col\n", path, line);
+                goto error;
+            }
+            t->type = (op[0] == 'd') ? T_PRESS : T_RELEASE;
+            t->row = strtoul(r, NULL, 0);
+            t->col = strtoul(c, NULL, 0);
+            if (t->row >= MATRIX_ROWS || t->col >= MATRIX_COLS) {
+                fprintf(stderr, "%s:%u: key out of matrix\n", path, line);
+                goto error;
+            }
+        } else if (!strcmp(op, "leds")) {
+            char *v = strtok(NULL, " \t\r\n");
+            t->type = T_LEDS;
+            t->mods = v ? strtoul(v, NULL, 16) : 0;
+        } else if (!strcmp(op, "led_set")) {
+            char *v = strtok(NULL, " \t\r\n");
+            t->type = T_LED_SET;
+            t->mods = v ? strtoul(v, NULL, 16) : 0;
+        } else if (!strcmp(op, "expect")) {
+            char *v = strtok(NULL, " \t\r\n");
+            if (!v) {
+                fprintf(stderr, "%s:%u: expect needs mods\n", path, line);
+                goto error;
+            }
+            t->type = T_EXPECT;
+            t->mods = strtoul(v, NULL, 16);
+            while ((v = strtok(NULL, " \t\r\n"))) {
+                if (t->nkeys >= EXPECT_KEYS) {
+                    fprintf(stderr, "%s:%u: too many keys\n", path, line);
+                    goto error;
+                }
+                t->keys[t->nkeys++] = strtoul(v, NULL, 16);
+            }
+        } else if (!strcmp(op, "end")) {
+            t->type = T_END;
+        } else {
+            fprintf(stderr, "%s:%u: unknown statement: %s\n", path, line, op);
+            goto error;
+        }
+        trace_len++;
+    }
+    fclose(fp);
+    return 0;
+
+error:
+    fclose(fp);
+    return -1;
+}
+
+/* mods, reserved and keys; compare key set regardless of slot order */
+static bool report_match(const report_t *r, const trace_t *t)
+{
+    if (r->raw[0] != t->mods) return false;
+
+    uint8_t n = 0;
+    for (uint8_t i = 2; i < r->size; i++) {
+        if (!r->raw[i]) continue;
+        bool found = false;
+        for (uint8_t j = 0; j < t->nkeys; j++) {
+            if (r->raw[i] == t->keys[j]) found = true;
+        }
+        if (!found) return false;
+        n++;
+    }
+    return n == t->nkeys;
+}
+
+static void print_report(const report_t *r)
+{
+    fprintf(stderr, "%02X |", r->raw[0]);
+    for (uint8_t i = 2; i < r->size; i++) {
+        if (r->raw[i]) fprintf(stderr, " %02X", r->raw[i]);
+    }
+}
+
+static uint32_t sim_ms(sim_t *s)
+{
+    return (s->avr->cycle - s->base) / s->cycles_per_ms;
+}
+
+/* trace statements up to now, before keyboard_task() of the pass */
+static void apply_trace(sim_t *s)
+{
+    uint32_t now = sim_ms(s);
+    for (; s->next < trace_len && trace[s->next].time <= now; s->next++) {
+        trace_t *e = &trace[s->next];
+        if ((e->type == T_PRESS || e->type == T_RELEASE) && !s->latency_pending) {
+            s->latency_pending = true;
+            s->latency_start = s->avr->cycle;
+        }
+        switch (e->type) {
+            case T_PRESS:
+                s->rows[e->row] |= (uint32_t)1 << e->col;
+                s->changed = true;
+                s->pending_events++;
+                break;
+            case T_RELEASE:
+                s->rows[e->row] &= ~((uint32_t)1 << e->col);
+                s->changed = true;
+                s->pending_events++;
+                break;
+            case T_LEDS:
+                s->leds = e->mods;
+                break;
+            case T_LED_SET:
+                if (s->led_state == e->mods) break;
+                s->failures++;
+                fprintf(stderr, "%s:%u: at %u ms: led_set %02X but %02X\n",
+                        s->path, e->line, now, e->mods, s->led_state);
+                break;
+            case T_EXPECT: {
+                const report_t *r = (s->checked < s->report_count) ? &s->reports[s->checked] : NULL;
+                s->checked++;
+                if (r && report_match(r, e)) break;
+                s->failures++;
+                fprintf(stderr, "%s:%u: at %u ms: expect %02X |", s->path, e->line, now, e->mods);
+                for (uint8_t i = 0; i < e->nkeys; i++) fprintf(stderr, " %02X", e->keys[i]);
+                fprintf(stderr, " but ");
+                if (r) {
+                    print_report(r);
+                    fprintf(stderr, " (sent at %u ms)\n", r->time);
+                } else {
+                    fprintf(stderr, "no report\n");
+                }
+                break;
+            }
+            case T_END:
+                break;
+        }
+    }
+    if (s->next == trace_len && now >= s->end) s->done = true;
+}
+
+static void mark_write(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+    sim_t *s = param;
+    (void)addr;
+
+    s->mark = v;
+    s->in_len = s->in_pos = 0;
+    switch (v) {
+        case SIM_TASK:
+            if (!s->started) {
+                s->started = true;
+                s->base = avr->cycle;
+            }
+            apply_trace(s);
+            s->pass_events = 0;
+            s->task_start = avr->cycle;
+            break;
+        case SIM_TASK_END: {
+            uint64_t c = avr->cycle - s->task_start;
+            s->passes++;
+            s->cycles += c;
+            if (c > s->max_cycles) s->max_cycles = c;
+            if (s->pass_events) {
+                s->events += s->pass_events;
+                s->event_passes++;
+                s->event_cycles += c;
+            }
+            break;
+        }
+        case SIM_MATRIX:
+            s->in[s->in_len++] = s->changed;
+            if (s->changed) {
+                for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+                    for (uint8_t i = 0; i < ROW_BYTES; i++) {
+                        s->in[s->in_len++] = s->rows[r] >> (i * 8);
+                    }
+                }
+                s->pass_events = s->pending_events;
+                s->pending_events = 0;
+                s->changed = false;
+            }
+            break;
+        case SIM_LEDS:
+            s->in[s->in_len++] = s->leds;
+            break;
+        case SIM_REPORT:
+            s->out_len = 0;
+            s->out_pos = 0;
+            break;
+        case SIM_EXTRA:
+            s->extras++;
+            break;
+        default:
+            break;
+    }
+}
+
+static uint8_t data_read(avr_t *avr, avr_io_addr_t addr, void *param)
+{
+    sim_t *s = param;
+    (void)avr;
+    (void)addr;
+
+    return (s->in_pos < s->in_len) ? s->in[s->in_pos++] : 0;
+}
+
+static void data_write(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+    sim_t *s = param;
+    (void)avr;
+    (void)addr;
+
+    if (s->mark == SIM_LED_SET) {
+        s->led_state = v;
+        return;
+    }
+    if (s->mark != SIM_REPORT) return;
+    if (!s->out_len) {
+        s->out_len = (v && v <= REPORT_SIZE_MAX) ? v : REPORT_SIZE_MAX;
+        return;
+    }
+    if (s->out_pos >= s->out_len) return;
+    s->out[s->out_pos++] = v;
+    if (s->out_pos < s->out_len) return;
+
+    // oldest change not reported yet
+    if (s->latency_pending) {
+        uint64_t c = avr->cycle - s->latency_start;
+        s->latency_pending = false;
+        s->latency_cycles += c;
+        s->latency_count++;
+        if (c > s->latency_max) s->latency_max = c;
+    }
+
+    if (s->report_count >= REPORT_MAX) return;
+    report_t *r = &s->reports[s->report_count++];
+    r->time = sim_ms(s);
+    r->size = s->out_len;
+    memcpy(r->raw, s->out, s->out_len);
+}
+
+static int run(const char *elf, const char *path, sim_t *s)
+{
+    elf_firmware_t f = {};
+    if (elf_read_firmware(elf, &f)) {
+        fprintf(stderr, "%s: can't read firmware\n", elf);
+        return -1;
+    }
+    if (!f.mmcu[0]) snprintf(f.mmcu, sizeof(f.mmcu), "%s", SIM_MCU);
+    if (!f.frequency) f.frequency = F_CPU;
+
+    avr_t *avr = avr_make_mcu_by_name(f.mmcu);
+    if (!avr) {
+        fprintf(stderr, "%s: unknown MCU\n", f.mmcu);
+        return -1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &f);
+
+    memset(s, 0, sizeof(*s));
+    s->avr = avr;
+    s->path = path;
+    s->cycles_per_ms = f.frequency / 1000;
+    s->end = trace_len ? trace[trace_len - 1].time + 1 : 0;
+    avr_register_io_write(avr, SIM_MARK_ADDR, mark_write, s);
+    avr_register_io_write(avr, SIM_DATA_ADDR, data_write, s);
+    avr_register_io_read(avr, SIM_DATA_ADDR, data_read, s);
+
+    int state = cpu_Running;
+    while (!s->done && state != cpu_Done && state != cpu_Crashed) {
+        state = avr_run(avr);
+    }
+    if (!s->done) {
+        fprintf(stderr, "%s: firmware stopped at %u ms\n", path, sim_ms(s));
+        s->failures++;
+    }
+
+    if (verbose) {
+        for (uint16_t i = 0; i < s->report_count; i++) {
+            fprintf(stderr, "  %5u ms: ", s->reports[i].time);
+            print_report(&s->reports[i]);
+            fprintf(stderr, "\n");
+        }
+    }
+    avr_terminate(avr);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-v] [-j] firmware.elf trace...\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    static sim_t s;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else if (!strcmp(argv[i], "-j")) {
+            json = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (argc - i < 2) usage(argv[0]);
+    const char *elf = argv[i++];
+
+    uint32_t failures = 0;
+    if (!json) {
+        printf("%-32s %6s %8s %8s %10s %10s %10s %9s %8s\n",
+               "trace", "events", "passes", "reports",
+               "cyc/pass", "cyc/event", "max(cyc)", "us/event", "lat(us)");
+    }
+    for (; i < argc; i++) {
+        if (load_trace(argv[i]) < 0 || run(elf, argv[i], &s) < 0) {
+            failures++;
+            continue;
+        }
+        failures += s.failures;
+
+        uint32_t idle = s.passes - s.event_passes;
+        double cyc_pass = idle ? (double)(s.cycles - s.event_cycles) / idle : 0.0;
+        double cyc_event = s.events ? (double)s.event_cycles / s.events : 0.0;
+        double us_per_cyc = 1000.0 / s.cycles_per_ms;
+        double latency = s.latency_count ? (double)s.latency_cycles / s.latency_count : 0.0;
+        if (json) {
+            printf("{\"trace\": \"%s\", \"events\": %u, \"passes\": %u, \"reports\": %u, "
+                   "\"cycles_per_pass\": %.1f, \"cycles_per_event\": %.1f, \"max_cycles\": %llu, "
+                   "\"us_per_event\": %.1f, \"latency_us\": %.1f, \"max_latency_us\": %.1f, "
+                   "\"fail\": %s}\n",
+                   argv[i], s.events, s.passes, s.report_count,
+                   cyc_pass, cyc_event, (unsigned long long)s.max_cycles,
+                   cyc_event * us_per_cyc, latency * us_per_cyc, s.latency_max * us_per_cyc,
+                   s.failures ? "true" : "false");
+            continue;
+        }
+        printf("%-32s %6u %8u %8u %10.1f %10.1f %10llu %9.1f %8.1f%s\n",
+               argv[i], s.events, s.passes, s.report_count,
+               cyc_pass, cyc_event, (unsigned long long)s.max_cycles,
+               cyc_event * us_per_cyc, latency * us_per_cyc,
+               s.failures ? "  FAIL" : "");
+        if (s.report_count >= REPORT_MAX) {
+            printf("  warning: reports after %u not recorded\n", REPORT_MAX);
+        }
+    }
+    return failures ? 1 : 0;
+}